@@ -0,0 +1,859 @@
+/*****************************************************************************
+ * bench.c - microbenchmarks for the Wind River pSOS+ (R) API primitives
+ *           implemented in a POSIX Threads environment.
+ *
+ *  Each benchmark is run with its tasks confined to 1, 2, 4... up to N
+ *  CPUs, with one worker task (or pair of tasks, for the ping-pong and
+ *  streaming benchmarks) per CPU.  For each run one JSON object is written
+ *  per line to stdout, holding the throughput and the p50/p99/p99.9/max
+ *  latency in nanoseconds, so the results of two library versions can be
+ *  compared line by line.  A table of the same results goes to stderr.
+ *
+ *  usage: bench [-n iterations] [-c max_cpus] [-b benchmark] [-q]
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/utsname.h>
+#include "p2linux.h"
+#include "histogram.h"
+
+#ifndef BENCH_VERSION
+#define BENCH_VERSION "unknown"
+#endif
+
+/*
+**  Maximum number of CPUs (and so of workers) a run may use
+*/
+#define MAX_WORKERS     256
+
+/*
+**  Number of idle tasks and queues the ident benchmarks search among
+*/
+#define IDENT_OBJECTS   64
+
+/*
+**  Depth of the variable-length queue used for streaming, and the number
+**  of messages the receiver frees room for at a time
+*/
+#define VQ_DEPTH        256
+#define VQ_BATCH        32
+
+/*
+**  Priority of all benchmark tasks
+*/
+#define BENCH_PRIO      20
+
+/*****************************************************************************
+**  State of one worker task, or of one pair of tasks
+*****************************************************************************/
+typedef struct worker
+{
+    ULONG
+        tid[2];          /* Task IDs of worker and its partner (if any) */
+    ULONG
+        objid[2];        /* Queues, semaphores... used by the worker */
+    ULONG
+        ops;             /* Operations the worker is to make */
+    hist_t
+        latency;         /* Latency of each operation, in nanoseconds */
+} worker_t;
+
+/*****************************************************************************
+**  Description of one benchmark
+*****************************************************************************/
+typedef struct benchmark
+{
+    const char *
+        name;
+    int
+        pairs;           /* Nonzero if each worker is a pair of tasks */
+    ULONG
+        ops_divisor;     /* Fraction of the iterations to make */
+    void
+        (*setup)( worker_t *worker );
+    void
+        (*body[2])( ULONG, ULONG, ULONG, ULONG );
+    void
+        (*cleanup)( worker_t *worker );
+} benchmark_t;
+
+/*****************************************************************************
+**  benchmark program global data structures
+*****************************************************************************/
+static worker_t
+    workers[MAX_WORKERS];
+
+/*
+**  start_barrier holds all workers of a run until every one is ready, and
+**  done_count, done_lock and done_cond tell the driver when they finish.
+**  These are plain pthread objects since the driver is not a task.
+**  run_start and run_end are the times the first worker started and the
+**  last one finished.
+*/
+static pthread_barrier_t
+    start_barrier;
+static int
+    done_count;
+static ULONG
+    run_start;
+static ULONG
+    run_end;
+static pthread_mutex_t
+    done_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t
+    done_cond = PTHREAD_COND_INITIALIZER;
+
+/*
+**  Shared objects used by all workers of a run
+*/
+static ULONG
+    shared_ptid;
+static ULONG
+    ident_tids[IDENT_OBJECTS];
+static ULONG
+    ident_qids[IDENT_OBJECTS];
+
+/*
+**  CPUs the benchmark was started on
+*/
+static cpu_set_t
+    all_cpus;
+
+/*****************************************************************************
+** now_ns - returns the monotonic clock in nanoseconds
+*****************************************************************************/
+static ULONG
+   now_ns( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return( (ULONG)now.tv_sec * 1000000000UL + (ULONG)now.tv_nsec );
+}
+
+/*****************************************************************************
+** worker_ready - waits for the other workers of the run to be ready
+*****************************************************************************/
+static void
+   worker_ready( void )
+{
+    pthread_barrier_wait( &start_barrier );
+    __sync_bool_compare_and_swap( &run_start, 0L, now_ns() );
+}
+
+/*****************************************************************************
+** worker_done - tells the driver a task has finished, and deletes it
+*****************************************************************************/
+static void
+   worker_done( void )
+{
+    pthread_mutex_lock( &done_lock );
+    run_end = now_ns();
+    done_count++;
+    pthread_cond_signal( &done_cond );
+    pthread_mutex_unlock( &done_lock );
+    t_delete( 0L );
+}
+
+/*****************************************************************************
+**  q_send/q_receive ping-pong between a pair of tasks
+*****************************************************************************/
+static void
+   q_pingpong_setup( worker_t *worker )
+{
+    q_create( "BQ1 ", 16, Q_FIFO, &(worker->objid[0]) );
+    q_create( "BQ2 ", 16, Q_FIFO, &(worker->objid[1]) );
+}
+
+static void
+   q_pingpong_a( ULONG index, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    worker_t *worker;
+    ULONG msg[4];
+    ULONG start;
+    ULONG i;
+
+    worker = &workers[index];
+    memset( (void *)msg, 0, sizeof( msg ) );
+    worker_ready();
+    for ( i = 0; i < worker->ops; i++ )
+    {
+        start = now_ns();
+        q_send( worker->objid[0], msg );
+        q_receive( worker->objid[1], Q_WAIT, 0L, msg );
+        hist_record( &(worker->latency), now_ns() - start );
+    }
+    worker_done();
+}
+
+static void
+   q_pingpong_b( ULONG index, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    worker_t *worker;
+    ULONG msg[4];
+    ULONG i;
+
+    worker = &workers[index];
+    worker_ready();
+    for ( i = 0; i < worker->ops; i++ )
+    {
+        q_receive( worker->objid[0], Q_WAIT, 0L, msg );
+        q_send( worker->objid[1], msg );
+    }
+    worker_done();
+}
+
+static void
+   q_cleanup( worker_t *worker )
+{
+    q_delete( worker->objid[0] );
+    if ( worker->objid[1] != 0L )
+        q_delete( worker->objid[1] );
+}
+
+/*****************************************************************************
+**  q_send/q_receive streaming from one task to another.  Latency is from
+**  send to receive, carried in the message.
+*****************************************************************************/
+static void
+   q_stream_setup( worker_t *worker )
+{
+    q_create( "BQS ", 64, Q_FIFO, &(worker->objid[0]) );
+    worker->objid[1] = 0L;
+}
+
+static void
+   q_stream_a( ULONG index, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    worker_t *worker;
+    ULONG msg[4];
+    ULONG i;
+
+    worker = &workers[index];
+    memset( (void *)msg, 0, sizeof( msg ) );
+    worker_ready();
+    for ( i = 0; i < worker->ops; i++ )
+    {
+        msg[0] = now_ns();
+        q_send( worker->objid[0], msg );
+    }
+    worker_done();
+}
+
+static void
+   q_stream_b( ULONG index, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    worker_t *worker;
+    ULONG msg[4];
+    ULONG i;
+
+    worker = &workers[index];
+    worker_ready();
+    for ( i = 0; i < worker->ops; i++ )
+    {
+        q_receive( worker->objid[0], Q_WAIT, 0L, msg );
+        hist_record( &(worker->latency), now_ns() - msg[0] );
+    }
+    worker_done();
+}
+
+/*****************************************************************************
+**  q_vsend/q_vreceive ping-pong between a pair of tasks
+*****************************************************************************/
+static void
+   vq_pingpong_setup( worker_t *worker )
+{
+    q_vcreate( "BVQ1", Q_FIFO, 16, 64, &(worker->objid[0]) );
+    q_vcreate( "BVQ2", Q_FIFO, 16, 64, &(worker->objid[1]) );
+}
+
+static void
+   vq_pingpong_a( ULONG index, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    worker_t *worker;
+    char msgbuf[64];
+    ULONG msglen;
+    ULONG start;
+    ULONG i;
+
+    worker = &workers[index];
+    memset( (void *)msgbuf, 0, sizeof( msgbuf ) );
+    worker_ready();
+    for ( i = 0; i < worker->ops; i++ )
+    {
+        start = now_ns();
+        q_vsend( worker->objid[0], msgbuf, 32L );
+        q_vreceive( worker->objid[1], Q_WAIT, 0L, msgbuf, sizeof( msgbuf ),
+                    &msglen );
+        hist_record( &(worker->latency), now_ns() - start );
+    }
+    worker_done();
+}
+
+static void
+   vq_pingpong_b( ULONG index, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    worker_t *worker;
+    char msgbuf[64];
+    ULONG msglen;
+    ULONG i;
+
+    worker = &workers[index];
+    worker_ready();
+    for ( i = 0; i < worker->ops; i++ )
+    {
+        q_vreceive( worker->objid[0], Q_WAIT, 0L, msgbuf, sizeof( msgbuf ),
+                    &msglen );
+        q_vsend( worker->objid[1], msgbuf, msglen );
+    }
+    worker_done();
+}
+
+static void
+   vq_cleanup( worker_t *worker )
+{
+    q_vdelete( worker->objid[0] );
+    q_vdelete( worker->objid[1] );
+}
+
+/*****************************************************************************
+**  q_vsend/q_vreceive streaming from one task to another.  The queue has
+**  a fixed depth, so the sender takes room for VQ_BATCH messages at a time
+**  from a semaphore which the receiver releases as it empties the queue.
+*****************************************************************************/
+static void
+   vq_stream_setup( worker_t *worker )
+{
+    q_vcreate( "BVQS", Q_FIFO, VQ_DEPTH, 64, &(worker->objid[0]) );
+    sm_create( "BVQC", VQ_DEPTH, SM_FIFO, &(worker->objid[1]) );
+}
+
+static void
+   vq_stream_a( ULONG index, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    worker_t *worker;
+    ULONG msgbuf[8];
+    ULONG i;
+
+    worker = &workers[index];
+    memset( (void *)msgbuf, 0, sizeof( msgbuf ) );
+    worker_ready();
+    for ( i = 0; i < worker->ops; i++ )
+    {
+        if ( (i % VQ_BATCH) == 0 )
+            sm_pn( worker->objid[1], VQ_BATCH, SM_WAIT, 0L );
+        msgbuf[0] = now_ns();
+        q_vsend( worker->objid[0], msgbuf, 32L );
+    }
+    worker_done();
+}
+
+static void
+   vq_stream_b( ULONG index, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    worker_t *worker;
+    ULONG msgbuf[8];
+    ULONG msglen;
+    ULONG i;
+
+    worker = &workers[index];
+    worker_ready();
+    for ( i = 0; i < worker->ops; i++ )
+    {
+        q_vreceive( worker->objid[0], Q_WAIT, 0L, msgbuf, sizeof( msgbuf ),
+                    &msglen );
+        hist_record( &(worker->latency), now_ns() - msgbuf[0] );
+        if ( ((i + 1) % VQ_BATCH) == 0 )
+            sm_vn( worker->objid[1], VQ_BATCH );
+    }
+    worker_done();
+}
+
+static void
+   vq_stream_cleanup( worker_t *worker )
+{
+    q_vdelete( worker->objid[0] );
+    sm_delete( worker->objid[1] );
+}
+
+/*****************************************************************************
+**  sm_v/sm_p handoff between a pair of tasks
+*****************************************************************************/
+static void
+   sm_handoff_setup( worker_t *worker )
+{
+    sm_create( "BSM1", 0L, SM_FIFO, &(worker->objid[0]) );
+    sm_create( "BSM2", 0L, SM_FIFO, &(worker->objid[1]) );
+}
+
+static void
+   sm_handoff_a( ULONG index, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    worker_t *worker;
+    ULONG start;
+    ULONG i;
+
+    worker = &workers[index];
+    worker_ready();
+    for ( i = 0; i < worker->ops; i++ )
+    {
+        start = now_ns();
+        sm_v( worker->objid[0] );
+        sm_p( worker->objid[1], SM_WAIT, 0L );
+        hist_record( &(worker->latency), now_ns() - start );
+    }
+    worker_done();
+}
+
+static void
+   sm_handoff_b( ULONG index, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    worker_t *worker;
+    ULONG i;
+
+    worker = &workers[index];
+    worker_ready();
+    for ( i = 0; i < worker->ops; i++ )
+    {
+        sm_p( worker->objid[0], SM_WAIT, 0L );
+        sm_v( worker->objid[1] );
+    }
+    worker_done();
+}
+
+static void
+   sm_cleanup( worker_t *worker )
+{
+    sm_delete( worker->objid[0] );
+    sm_delete( worker->objid[1] );
+}
+
+/*****************************************************************************
+**  ev_send/ev_receive round trips between a pair of tasks
+*****************************************************************************/
+static void
+   ev_roundtrip_a( ULONG index, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    worker_t *worker;
+    ULONG captured;
+    ULONG start;
+    ULONG i;
+
+    worker = &workers[index];
+    worker_ready();
+    for ( i = 0; i < worker->ops; i++ )
+    {
+        start = now_ns();
+        ev_send( worker->tid[1], 0x01 );
+        ev_receive( 0x02, EV_ANY, 0L, &captured );
+        hist_record( &(worker->latency), now_ns() - start );
+    }
+    worker_done();
+}
+
+static void
+   ev_roundtrip_b( ULONG index, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    worker_t *worker;
+    ULONG captured;
+    ULONG i;
+
+    worker = &workers[index];
+    worker_ready();
+    for ( i = 0; i < worker->ops; i++ )
+    {
+        ev_receive( 0x01, EV_ANY, 0L, &captured );
+        ev_send( worker->tid[0], 0x02 );
+    }
+    worker_done();
+}
+
+/*****************************************************************************
+**  pt_getbuf/pt_retbuf pairs on a partition shared by all workers
+*****************************************************************************/
+static void
+   pt_getret_body( ULONG index, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    worker_t *worker;
+    void *bufaddr;
+    ULONG start;
+    ULONG i;
+
+    worker = &workers[index];
+    worker_ready();
+    for ( i = 0; i < worker->ops; i++ )
+    {
+        start = now_ns();
+        pt_getbuf( shared_ptid, &bufaddr );
+        pt_retbuf( shared_ptid, bufaddr );
+        hist_record( &(worker->latency), now_ns() - start );
+    }
+    worker_done();
+}
+
+/*****************************************************************************
+**  t_create/t_start/t_delete of a child task which signals the worker and
+**  deletes itself
+*****************************************************************************/
+static void
+   t_child( ULONG smid, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    sm_v( smid );
+    t_delete( 0L );
+}
+
+static void
+   t_lifecycle_setup( worker_t *worker )
+{
+    sm_create( "BTSM", 0L, SM_FIFO, &(worker->objid[0]) );
+    worker->objid[1] = 0L;
+}
+
+static void
+   t_lifecycle_body( ULONG index, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    worker_t *worker;
+    ULONG parms[4];
+    ULONG child;
+    ULONG start;
+    ULONG i;
+
+    worker = &workers[index];
+    parms[0] = worker->objid[0];
+    parms[1] = parms[2] = parms[3] = 0L;
+    worker_ready();
+    for ( i = 0; i < worker->ops; i++ )
+    {
+        start = now_ns();
+        t_create( "BCHL", BENCH_PRIO, 0L, 0L, 0L, &child );
+        t_start( child, T_NOTSLICE, t_child, parms );
+        sm_p( worker->objid[0], SM_WAIT, 0L );
+        hist_record( &(worker->latency), now_ns() - start );
+    }
+    worker_done();
+}
+
+static void
+   sm_cleanup_one( worker_t *worker )
+{
+    sm_delete( worker->objid[0] );
+}
+
+/*****************************************************************************
+**  t_ident and q_ident of the last of IDENT_OBJECTS tasks and queues
+*****************************************************************************/
+static void
+   t_ident_body( ULONG index, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    worker_t *worker;
+    char name[5];
+    ULONG tid;
+    ULONG start;
+    ULONG i;
+
+    worker = &workers[index];
+    sprintf( name, "I%03d", IDENT_OBJECTS - 1 );
+    worker_ready();
+    for ( i = 0; i < worker->ops; i++ )
+    {
+        start = now_ns();
+        t_ident( name, 0L, &tid );
+        hist_record( &(worker->latency), now_ns() - start );
+    }
+    worker_done();
+}
+
+static void
+   q_ident_body( ULONG index, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    worker_t *worker;
+    char name[5];
+    ULONG qid;
+    ULONG start;
+    ULONG i;
+
+    worker = &workers[index];
+    sprintf( name, "I%03d", IDENT_OBJECTS - 1 );
+    worker_ready();
+    for ( i = 0; i < worker->ops; i++ )
+    {
+        start = now_ns();
+        q_ident( name, 0L, &qid );
+        hist_record( &(worker->latency), now_ns() - start );
+    }
+    worker_done();
+}
+
+/*****************************************************************************
+** idle_task - body of the tasks the t_ident benchmark searches among
+*****************************************************************************/
+static void
+   idle_task( ULONG dummy0, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    ULONG captured;
+
+    ev_receive( 0x01, EV_ANY, 0L, &captured );
+    t_delete( 0L );
+}
+
+/*
+**  The benchmarks, in the order they are run
+*/
+static benchmark_t
+    benchmarks[] =
+    {
+        { "q_pingpong",   1, 1,  q_pingpong_setup,  { q_pingpong_a,
+                                                      q_pingpong_b },
+                                                    q_cleanup },
+        { "q_stream",     1, 1,  q_stream_setup,    { q_stream_a,
+                                                      q_stream_b },
+                                                    q_cleanup },
+        { "vq_pingpong",  1, 1,  vq_pingpong_setup, { vq_pingpong_a,
+                                                      vq_pingpong_b },
+                                                    vq_cleanup },
+        { "vq_stream",    1, 1,  vq_stream_setup,   { vq_stream_a,
+                                                      vq_stream_b },
+                                                    vq_stream_cleanup },
+        { "sm_handoff",   1, 1,  sm_handoff_setup,  { sm_handoff_a,
+                                                      sm_handoff_b },
+                                                    sm_cleanup },
+        { "ev_roundtrip", 1, 1,  NULL,              { ev_roundtrip_a,
+                                                      ev_roundtrip_b },
+                                                    NULL },
+        { "pt_getret",    0, 1,  NULL,              { pt_getret_body,
+                                                      NULL },
+                                                    NULL },
+        { "t_lifecycle",  0, 50, t_lifecycle_setup, { t_lifecycle_body,
+                                                      NULL },
+                                                    sm_cleanup_one },
+        { "t_ident",      0, 1,  NULL,              { t_ident_body, NULL },
+                                                    NULL },
+        { "q_ident",      0, 1,  NULL,              { q_ident_body, NULL },
+                                                    NULL },
+        { NULL,           0, 0,  NULL,              { NULL, NULL }, NULL }
+    };
+
+/*****************************************************************************
+** set_cpus - confines the calling thread, and the tasks it creates from
+**            now on, to the first 'ncpus' CPUs the benchmark was started on
+*****************************************************************************/
+static void
+   set_cpus( int ncpus )
+{
+    cpu_set_t cpus;
+    int i;
+
+    CPU_ZERO( &cpus );
+    for ( i = 0; (i < CPU_SETSIZE) && (ncpus > 0); i++ )
+    {
+        if ( CPU_ISSET( i, &all_cpus ) )
+        {
+            CPU_SET( i, &cpus );
+            ncpus--;
+        }
+    }
+    sched_setaffinity( 0, sizeof( cpus ), &cpus );
+}
+
+/*****************************************************************************
+** run_benchmark - runs one benchmark on 'ncpus' CPUs and reports it
+*****************************************************************************/
+static void
+   run_benchmark( benchmark_t *bench, int ncpus, ULONG iterations, int quiet )
+{
+    hist_t *total;
+    ULONG parms[4];
+    ULONG elapsed;
+    ULONG ntasks;
+    int i, j;
+
+    total = (hist_t *)malloc( sizeof( hist_t ) );
+    hist_init( total );
+    set_cpus( ncpus );
+
+    ntasks = ncpus * (bench->pairs ? 2 : 1);
+    pthread_barrier_init( &start_barrier, (pthread_barrierattr_t *)NULL,
+                          ntasks + 1 );
+    done_count = 0;
+    run_start = 0L;
+
+    for ( i = 0; i < ncpus; i++ )
+    {
+        memset( (void *)&workers[i], 0, sizeof( worker_t ) );
+        hist_init( &(workers[i].latency) );
+        workers[i].ops = iterations / bench->ops_divisor;
+        if ( bench->setup != NULL )
+            (*bench->setup)( &workers[i] );
+        for ( j = 0; j < (bench->pairs ? 2 : 1); j++ )
+            t_create( "BNCH", BENCH_PRIO, 0L, 0L, 0L, &(workers[i].tid[j]) );
+    }
+    for ( i = 0; i < ncpus; i++ )
+    {
+        parms[0] = (ULONG)i;
+        parms[1] = parms[2] = parms[3] = 0L;
+        for ( j = 0; j < (bench->pairs ? 2 : 1); j++ )
+            t_start( workers[i].tid[j], T_NOTSLICE, bench->body[j], parms );
+    }
+
+    /*
+    **  Release the workers together and wait for the last to finish.
+    */
+    pthread_barrier_wait( &start_barrier );
+    pthread_mutex_lock( &done_lock );
+    while ( done_count < ntasks )
+        pthread_cond_wait( &done_cond, &done_lock );
+    pthread_mutex_unlock( &done_lock );
+    elapsed = run_end - run_start;
+
+    for ( i = 0; i < ncpus; i++ )
+    {
+        hist_merge( total, &(workers[i].latency) );
+        if ( bench->cleanup != NULL )
+            (*bench->cleanup)( &workers[i] );
+    }
+    pthread_barrier_destroy( &start_barrier );
+
+    printf( "{\"bench\":\"%s\",\"version\":\"%s\",\"cpus\":%d,"
+            "\"tasks\":%lu,\"ops\":%lu,\"secs\":%.6f,\"ops_per_sec\":%.0f,"
+            "\"mean_ns\":%lu,\"p50_ns\":%lu,\"p99_ns\":%lu,\"p999_ns\":%lu,"
+            "\"max_ns\":%lu}\n",
+            bench->name, BENCH_VERSION, ncpus, ntasks, total->count,
+            (double)elapsed / 1e9,
+            (double)total->count * 1e9 / (double)(elapsed ? elapsed : 1),
+            total->count ? total->sum / total->count : 0L,
+            hist_percentile( total, 50.0 ), hist_percentile( total, 99.0 ),
+            hist_percentile( total, 99.9 ), total->max );
+    fflush( stdout );
+    if ( !quiet )
+        fprintf( stderr, "%-13s %4d %12.0f %10lu %10lu %10lu %10lu\n",
+                 bench->name, ncpus,
+                 (double)total->count * 1e9 / (double)(elapsed ? elapsed : 1),
+                 hist_percentile( total, 50.0 ),
+                 hist_percentile( total, 99.0 ),
+                 hist_percentile( total, 99.9 ), total->max );
+
+    free( (void *)total );
+}
+
+/*****************************************************************************
+** create_shared_objects - creates the partition and the idle tasks and
+**                         queues shared by all runs
+*****************************************************************************/
+static void
+   create_shared_objects( void )
+{
+    char name[5];
+    ULONG nbuf;
+    int i;
+
+    pt_create( "BPT ", NULL, NULL, 4UL << 20, 64L, PT_DEL, &shared_ptid,
+               &nbuf );
+
+    for ( i = 0; i < IDENT_OBJECTS; i++ )
+    {
+        sprintf( name, "I%03d", i );
+        t_create( name, BENCH_PRIO, 0L, 0L, 0L, &ident_tids[i] );
+        t_start( ident_tids[i], T_NOTSLICE, idle_task, (ULONG *)NULL );
+        q_create( name, 4L, Q_FIFO, &ident_qids[i] );
+    }
+}
+
+/*****************************************************************************
+** delete_shared_objects - deletes the objects create_shared_objects made
+*****************************************************************************/
+static void
+   delete_shared_objects( void )
+{
+    int i;
+
+    for ( i = 0; i < IDENT_OBJECTS; i++ )
+    {
+        ev_send( ident_tids[i], 0x01 );
+        q_delete( ident_qids[i] );
+    }
+    pt_delete( shared_ptid );
+}
+
+int
+   main( int argc, char **argv )
+{
+    benchmark_t *bench;
+    struct utsname host;
+    char *only;
+    ULONG iterations;
+    int max_cpus;
+    int quiet;
+    int ncpus;
+    int opt;
+
+    iterations = 100000L;
+    sched_getaffinity( 0, sizeof( all_cpus ), &all_cpus );
+    max_cpus = CPU_COUNT( &all_cpus );
+    only = (char *)NULL;
+    quiet = 0;
+
+    while ( (opt = getopt( argc, argv, "n:c:b:q" )) != -1 )
+    {
+        switch ( opt )
+        {
+            case 'n':
+                iterations = strtoul( optarg, (char **)NULL, 0 );
+                break;
+            case 'c':
+                max_cpus = atoi( optarg );
+                break;
+            case 'b':
+                only = optarg;
+                break;
+            case 'q':
+                quiet = 1;
+                break;
+            default:
+                fprintf( stderr, "usage: %s [-n iterations] [-c max_cpus] "
+                         "[-b benchmark] [-q]\n", argv[0] );
+                exit( 1 );
+        }
+    }
+    if ( max_cpus < 1 )
+        max_cpus = 1;
+    if ( max_cpus > CPU_COUNT( &all_cpus ) )
+        max_cpus = CPU_COUNT( &all_cpus );
+    if ( max_cpus > MAX_WORKERS )
+        max_cpus = MAX_WORKERS;
+
+    uname( &host );
+    printf( "{\"host\":\"%s\",\"machine\":\"%s\",\"kernel\":\"%s\","
+            "\"version\":\"%s\",\"max_cpus\":%d,\"iterations\":%lu}\n",
+            host.nodename, host.machine, host.release, BENCH_VERSION,
+            max_cpus, iterations );
+    if ( !quiet )
+        fprintf( stderr, "%-13s %4s %12s %10s %10s %10s %10s\n", "bench",
+                 "cpus", "ops/sec", "p50 ns", "p99 ns", "p99.9 ns",
+                 "max ns" );
+
+    create_shared_objects();
+
+    for ( bench = benchmarks; bench->name != NULL; bench++ )
+    {
+        if ( (only != (char *)NULL) && (strcmp( only, bench->name ) != 0) )
+            continue;
+
+        /*
+        **  1, 2, 4... CPUs, and finally all of them.
+        */
+        for ( ncpus = 1; ncpus < max_cpus; ncpus *= 2 )
+            run_benchmark( bench, ncpus, iterations, quiet );
+        run_benchmark( bench, max_cpus, iterations, quiet );
+    }
+
+    delete_shared_objects();
+    set_cpus( max_cpus );
+
+    return( 0 );
+}
@@ -0,0 +1,799 @@
+/*****************************************************************************
+ * condvar.c - defines the wrapper functions and data structures needed
+ *             to implement a p2pthread condition variable API
+ *             in a POSIX Threads environment.
+ ****************************************************************************/
+
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <linux/futex.h>
+#include "p2pthread.h"
+
+#undef DIAG_PRINTFS
+
+#define CV_PRIOR     0x02
+
+#define SM_WAIT      0x00
+
+#define ERR_TIMEOUT  0x01
+#define ERR_NODENO   0x04
+#define ERR_OBJDEL   0x05
+#define ERR_OBJNF    0x09
+#define ERR_SSFN     0x0B
+
+#define ERR_NOCVCB   0x90
+#define ERR_CVKILLD  0x91
+
+/*
+**  Values of the wait word in the tcb of a task waiting on a condition
+*/
+#define CV_WAITING   0
+#define CV_SIGNALLED 1
+#define CV_KILLD     2
+
+/*****************************************************************************
+**  Control block for p2pthread condition variable
+**
+**  A pthread condition variable wakes its waiters in whatever order the
+**  kernel chooses, and a broadcast wakes every waiter at once only to have
+**  them all contend for the mutex.  Here each waiting task sleeps on a futex
+**  word in its own tcb, and the waiters are kept in a FIFO or PRIORITY pend
+**  list like those of the other p2pthread objects.  A task waiting with a
+**  p2pthread mutex is requeued by the kernel onto the mutex when signalled
+**  (FUTEX_CMP_REQUEUE_PI), so it only wakes once it actually owns the mutex.
+**
+*****************************************************************************/
+typedef struct p2pt_condvar
+{
+        /*
+        ** ID for condition variable
+        */
+    ULONG
+        cvid;
+
+        /*
+        ** Condition Variable Name
+        */
+    char
+        cname[4];
+
+        /*
+        ** Option Flags for condition variable
+        */
+    ULONG
+        flags;
+
+        /*
+        ** Mutex protecting the list of waiting tasks
+        */
+    pthread_mutex_t
+        cv_lock;
+    lk_stat_t
+        cv_lkstat;       /* Contention statistics for cv_lock */
+
+        /*
+        **  Pointer to next condition variable control block in list.
+        */
+    struct p2pt_condvar *
+        nxt_condvar;
+
+        /*
+        ** First task control block in list of tasks waiting on condition
+        */
+    p2pthread_cb_t *
+        first_susp;
+} p2pt_condvar_t;
+
+/*****************************************************************************
+**  External function and data references
+*****************************************************************************/
+extern void *
+    ts_malloc( size_t blksize );
+extern void
+    ts_free( void *blkaddr );
+extern p2pthread_cb_t *
+   my_tcb( void );
+extern int
+   mn_caller( void );
+extern void
+   sched_lock( void );
+extern void
+   sched_unlock( void );
+extern void
+   link_susp_tcb( p2pthread_cb_t **list_head, p2pthread_cb_t *new_entry );
+extern void
+   unlink_susp_tcb( p2pthread_cb_t **list_head, p2pthread_cb_t *entry );
+extern long
+   futex_op( volatile int *uaddr, int op, int val,
+             const struct timespec *timeout, volatile int *uaddr2, int val3 );
+extern ULONG
+   mutex_wait_word( ULONG muid, volatile int **word );
+extern ULONG
+   mutex_cv_wait( ULONG muid, volatile int *cv_word,
+                  struct timespec *timeoutp );
+extern ULONG
+   sm_p( ULONG smid, ULONG opt, ULONG max_wait );
+extern ULONG
+   sm_v( ULONG smid );
+extern void
+   stat_block( p2pthread_cb_t *tcb, int reason );
+extern void
+   stat_unblock( p2pthread_cb_t *tcb, int timedout );
+extern void
+   stat_wake( p2pthread_cb_t *tcb );
+
+/*****************************************************************************
+**  p2pthread Global Data Structures
+*****************************************************************************/
+
+/*
+**  condvar_list is a linked list of condition variable control blocks.
+**               It is used to locate condition variables by their ID numbers.
+*/
+static p2pt_condvar_t *
+    condvar_list;
+
+/*
+**  condvar_list_lock is a mutex used to serialize access to the
+**                    condition variable list
+*/
+static pthread_mutex_t
+    condvar_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static lk_stat_t
+    condvar_list_lkstat =
+        LK_STAT_INITIALIZER( TR_CONDVAR, "condvar_list_lock" );
+
+
+/*****************************************************************************
+** cvcb_for - returns the address of the condition variable control block
+**            for the condition variable idenified by cvid
+*****************************************************************************/
+static p2pt_condvar_t *
+   cvcb_for( ULONG cvid )
+{
+    p2pt_condvar_t *current_cvcb;
+
+    for ( current_cvcb = condvar_list;
+          current_cvcb != (p2pt_condvar_t *)NULL;
+          current_cvcb = current_cvcb->nxt_condvar )
+    {
+        if ( current_cvcb->cvid == cvid )
+            break;
+    }
+
+    return( current_cvcb );
+}
+
+/*****************************************************************************
+** new_cvid - automatically returns a valid, unused condition variable ID
+*****************************************************************************/
+static ULONG
+   new_cvid( void )
+{
+    p2pt_condvar_t *current_cvcb;
+    ULONG new_condvar_id;
+
+    /*
+    **  Protect the condition variable list while we examine it.
+    */
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&condvar_list_lock );
+    lk_lock( &condvar_list_lock, &condvar_list_lkstat );
+
+    /*
+    **  Get the highest previously assigned condition variable id and add one.
+    */
+    new_condvar_id = 0;
+    for ( current_cvcb = condvar_list;
+          current_cvcb != (p2pt_condvar_t *)NULL;
+          current_cvcb = current_cvcb->nxt_condvar )
+    {
+        if ( current_cvcb->cvid > new_condvar_id )
+            new_condvar_id = current_cvcb->cvid;
+    }
+    new_condvar_id++;
+
+    /*
+    **  Re-enable access to the condition variable list by other threads.
+    */
+    lk_unlock( &condvar_list_lock, &condvar_list_lkstat );
+    pthread_cleanup_pop( 0 );
+
+    return( new_condvar_id );
+}
+
+/*****************************************************************************
+** link_cvcb - appends a new condition variable control block pointer to the
+**             condvar_list
+*****************************************************************************/
+static void
+   link_cvcb( p2pt_condvar_t *new_condvar )
+{
+    p2pt_condvar_t *current_cvcb;
+
+    /*
+    **  Protect the condition variable list while we examine and modify it.
+    */
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&condvar_list_lock );
+    lk_lock( &condvar_list_lock, &condvar_list_lkstat );
+
+    new_condvar->nxt_condvar = (p2pt_condvar_t *)NULL;
+    if ( condvar_list != (p2pt_condvar_t *)NULL )
+    {
+        /*
+        **  One or more condition variables already exist in the list...
+        **  Insert the new entry in ascending numerical sequence by cvid.
+        */
+        for ( current_cvcb = condvar_list;
+              current_cvcb->nxt_condvar != (p2pt_condvar_t *)NULL;
+              current_cvcb = current_cvcb->nxt_condvar )
+        {
+            if ( (current_cvcb->nxt_condvar)->cvid > new_condvar->cvid )
+            {
+                new_condvar->nxt_condvar = current_cvcb->nxt_condvar;
+                break;
+            }
+        }
+        current_cvcb->nxt_condvar = new_condvar;
+    }
+    else
+    {
+        /*
+        **  this is the first condition variable being added to the list.
+        */
+        condvar_list = new_condvar;
+    }
+#ifdef DIAG_PRINTFS
+    printf( "\r\nadd condition variable cb @ %p to list", new_condvar );
+#endif
+
+    /*
+    **  Re-enable access to the condition variable list by other threads.
+    */
+    lk_unlock( &condvar_list_lock, &condvar_list_lkstat );
+    pthread_cleanup_pop( 0 );
+}
+
+/*****************************************************************************
+** unlink_cvcb - removes a condition variable control block pointer from the
+**               condvar_list
+*****************************************************************************/
+static void
+   unlink_cvcb( p2pt_condvar_t *condvar )
+{
+    p2pt_condvar_t **link;
+
+    /*
+    **  Protect the condition variable list while we examine and modify it.
+    */
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&condvar_list_lock );
+    lk_lock( &condvar_list_lock, &condvar_list_lkstat );
+
+    for ( link = &condvar_list; *link != (p2pt_condvar_t *)NULL;
+          link = &((*link)->nxt_condvar) )
+    {
+        if ( *link == condvar )
+        {
+            *link = condvar->nxt_condvar;
+#ifdef DIAG_PRINTFS
+            printf( "\r\ndel condition variable cb @ %p from list", condvar );
+#endif
+            break;
+        }
+    }
+
+    /*
+    **  Re-enable access to the condition variable list by other threads.
+    */
+    lk_unlock( &condvar_list_lock, &condvar_list_lkstat );
+    pthread_cleanup_pop( 0 );
+}
+
+/*****************************************************************************
+** next_cv_waiter - returns the tcb of the waiting task which is next in line
+**                  to be signalled, according to the pend order for the
+**                  condition variable.  The caller must hold the cv_lock.
+*****************************************************************************/
+static p2pthread_cb_t *
+   next_cv_waiter( p2pt_condvar_t *condvar )
+{
+    p2pthread_cb_t *current_tcb;
+    p2pthread_cb_t *selected_tcb;
+
+    selected_tcb = condvar->first_susp;
+
+    if ( condvar->flags & CV_PRIOR )
+    {
+        /*
+        **  Tasks pend in priority order... select the highest priority
+        **  task, taking the earliest arrival among equals.
+        */
+        for ( current_tcb = condvar->first_susp;
+              current_tcb != (p2pthread_cb_t *)NULL;
+              current_tcb = current_tcb->nxt_susp )
+        {
+            if ( (current_tcb->prv_priority).sched_priority >
+                 (selected_tcb->prv_priority).sched_priority )
+                selected_tcb = current_tcb;
+        }
+    }
+
+    return( selected_tcb );
+}
+
+/*****************************************************************************
+** wake_cv_waiter - removes a task from the condition variable's pend list
+**                  and wakes it with the specified wait word value.  A task
+**                  waiting with a mutex is handed the mutex if it is free,
+**                  or else moved onto the mutex's kernel wait queue, so it
+**                  never runs only to block again on the mutex.
+**                  The caller must hold the cv_lock.
+*****************************************************************************/
+static void
+   wake_cv_waiter( p2pt_condvar_t *condvar, p2pthread_cb_t *tcb, int reason )
+{
+    unlink_susp_tcb( &(condvar->first_susp), tcb );
+    stat_wake( tcb );
+
+    /*
+    **  The kernel compares the wait word to 'reason' before acting, so a
+    **  task which has not yet gone to sleep simply finds it nonzero.
+    */
+    __sync_lock_test_and_set( &(tcb->cv_wakeup), reason );
+
+    if ( tcb->cv_mutex_word != (volatile int *)NULL )
+    {
+        /*
+        **  Wake one task, requeueing none besides it.
+        */
+        futex_op( &(tcb->cv_wakeup), FUTEX_CMP_REQUEUE_PI | FUTEX_PRIVATE_FLAG,
+                  1, (struct timespec *)0, tcb->cv_mutex_word, reason );
+    }
+    else
+    {
+        futex_op( &(tcb->cv_wakeup), FUTEX_WAKE | FUTEX_PRIVATE_FLAG,
+                  1, (struct timespec *)NULL, (volatile int *)NULL, 0 );
+    }
+#ifdef DIAG_PRINTFS
+    printf( "\r\ncondition variable @ %p woke task @ %p", condvar, tcb );
+#endif
+}
+
+/*****************************************************************************
+** cv_timeout - converts a wait in ticks into an absolute CLOCK_REALTIME time.
+**              Returns NULL for an infinite wait.
+*****************************************************************************/
+static struct timespec *
+   cv_timeout( ULONG max_wait, struct timespec *timeout )
+{
+    struct timeval now;
+    long sec, usec;
+
+    if ( max_wait == 0L )
+        return( (struct timespec *)NULL );
+
+    usec = max_wait * P2PT_TICK * 1000;
+    p2pt_time( &now );
+    usec += now.tv_usec;
+    sec = usec / 1000000;
+    usec = usec % 1000000;
+    timeout->tv_sec = now.tv_sec + sec;
+    timeout->tv_nsec = usec * 1000;
+
+    return( timeout );
+}
+
+/*****************************************************************************
+** start_cv_wait - adds the calling task to the condition variable's pend list
+*****************************************************************************/
+static void
+   start_cv_wait( p2pt_condvar_t *condvar, p2pthread_cb_t *our_tcb,
+                  volatile int *mutex_word )
+{
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&(condvar->cv_lock) );
+    lk_lock( &(condvar->cv_lock), &(condvar->cv_lkstat) );
+
+    our_tcb->cv_wakeup = CV_WAITING;
+    our_tcb->cv_mutex_word = mutex_word;
+    stat_block( our_tcb, WAIT_CONDV );
+    link_susp_tcb( &(condvar->first_susp), our_tcb );
+
+    lk_unlock( &(condvar->cv_lock), &(condvar->cv_lkstat) );
+    pthread_cleanup_pop( 0 );
+}
+
+/*****************************************************************************
+** finish_cv_wait - removes the calling task from the condition variable's
+**                  pend list if it was not signalled, and works out the
+**                  result of the wait.
+*****************************************************************************/
+static ULONG
+   finish_cv_wait( ULONG cvid, p2pthread_cb_t *our_tcb, ULONG error )
+{
+    p2pt_condvar_t *condvar;
+
+    TRACE( TR_CONDVAR |
+           ((our_tcb->cv_wakeup == CV_WAITING) ? TR_TIMEOUT : TR_WAKE),
+           cvid, 0 );
+    stat_unblock( our_tcb, (our_tcb->cv_wakeup == CV_WAITING) );
+
+    /*
+    **  A task which was signalled has already been removed from the pend
+    **  list by the signalling task.  Otherwise remove it ourselves, unless
+    **  a signal sneaks in first.  If the condition variable is gone, it was
+    **  deleted and the task was woken by the deletion.
+    */
+    if ( our_tcb->cv_wakeup == CV_WAITING )
+    {
+        if ( (condvar = cvcb_for( cvid )) != (p2pt_condvar_t *)NULL )
+        {
+            pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                                  (void *)&(condvar->cv_lock) );
+            lk_lock( &(condvar->cv_lock), &(condvar->cv_lkstat) );
+            if ( our_tcb->cv_wakeup == CV_WAITING )
+                unlink_susp_tcb( &(condvar->first_susp), our_tcb );
+            lk_unlock( &(condvar->cv_lock), &(condvar->cv_lkstat) );
+            pthread_cleanup_pop( 0 );
+        }
+    }
+
+    if ( our_tcb->cv_wakeup == CV_KILLD )
+        error = ERR_CVKILLD;
+    else if ( (our_tcb->cv_wakeup == CV_SIGNALLED) && (error == ERR_TIMEOUT) )
+        error = ERR_NO_ERROR;
+
+    our_tcb->cv_mutex_word = (volatile int *)NULL;
+
+    return( error );
+}
+
+/*****************************************************************************
+** cv_create - creates a p2pthread condition variable
+*****************************************************************************/
+ULONG
+    cv_create( char name[4], ULONG opt, ULONG *cvid )
+{
+    p2pt_condvar_t *condvar;
+    ULONG error;
+    int i;
+
+    /*
+    **  A waiter is woken by the kernel as the owner of a mutex, and so by
+    **  kernel thread, which M:N tasks share.
+    */
+    if ( mn_caller() )
+        return( ERR_SSFN );
+
+    error = ERR_NO_ERROR;
+
+    /*
+    **  First allocate memory for the condition variable control block
+    */
+    condvar = (p2pt_condvar_t *)ts_malloc( sizeof( p2pt_condvar_t ) );
+    if ( condvar != (p2pt_condvar_t *)NULL )
+    {
+        /*
+        **  Ok... got a control block.  Initialize it.
+        */
+
+        /*
+        ** Option Flags for condition variable
+        */
+        condvar->flags = opt;
+
+        /*
+        ** ID for condition variable
+        */
+        condvar->cvid = new_cvid();
+        if ( cvid != (ULONG *)NULL )
+            *cvid = condvar->cvid;
+
+        /*
+        **  Name for condition variable
+        */
+        for ( i = 0; i < 4; i++ )
+            condvar->cname[i] = name[i];
+
+        /*
+        ** Mutex protecting the list of waiting tasks
+        */
+        pthread_mutex_init( &(condvar->cv_lock), (pthread_mutexattr_t *)NULL );
+        lk_init( &(condvar->cv_lkstat), TR_CONDVAR, condvar->cvid,
+                 condvar->cname, "cv_lock" );
+
+        /*
+        ** First task control block in list of tasks waiting on condition
+        */
+        condvar->first_susp = (p2pthread_cb_t *)NULL;
+
+        /*
+        **  Link the new condition variable into the condition variable list.
+        */
+        link_cvcb( condvar );
+        TRACE( TR_CONDVAR | TR_CREATE, condvar->cvid, 0 );
+    }
+    else
+    {
+        error = ERR_NOCVCB;
+    }
+
+    return( error );
+}
+
+/*****************************************************************************
+** cv_delete - removes the specified condition variable from the condition
+**             variable list and frees the memory allocated for its control
+**             block.  Any waiting tasks are awakened with ERR_CVKILLD.
+*****************************************************************************/
+ULONG
+   cv_delete( ULONG cvid )
+{
+    p2pt_condvar_t *condvar;
+    ULONG error;
+
+    if ( mn_caller() )
+        return( ERR_SSFN );
+
+    error = ERR_NO_ERROR;
+
+    sched_lock();
+
+    if ( (condvar = cvcb_for( cvid )) != (p2pt_condvar_t *)NULL )
+    {
+        pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                              (void *)&(condvar->cv_lock) );
+        lk_lock( &(condvar->cv_lock), &(condvar->cv_lkstat) );
+
+        /*
+        **  Wake every waiting task, then take the condition variable out of
+        **  the list before any of them can look for it again.
+        */
+        while ( condvar->first_susp != (p2pthread_cb_t *)NULL )
+            wake_cv_waiter( condvar, condvar->first_susp, CV_KILLD );
+        unlink_cvcb( condvar );
+        TRACE( TR_CONDVAR | TR_DELETE, cvid, 0 );
+
+        lk_unlock( &(condvar->cv_lock), &(condvar->cv_lkstat) );
+        pthread_cleanup_pop( 0 );
+
+        lk_retire( &(condvar->cv_lkstat) );
+        pthread_mutex_destroy( &(condvar->cv_lock) );
+        ts_free( (void *)condvar );
+    }
+    else
+    {
+        error = ERR_OBJDEL;       /* Invalid condition variable specified */
+    }
+
+    sched_unlock();
+
+    return( error );
+}
+
+/*****************************************************************************
+** cv_wait - atomically unlocks the specified p2pthread mutex and blocks the
+**           calling task until the condition variable is signalled.  The
+**           mutex is always locked again when cv_wait returns.
+*****************************************************************************/
+ULONG
+   cv_wait( ULONG cvid, ULONG muid, ULONG max_wait )
+{
+    p2pt_condvar_t *condvar;
+    p2pthread_cb_t *our_tcb;
+    volatile int *mutex_word;
+    struct timespec timeout;
+    ULONG error;
+
+    if ( mn_caller() )
+        return( ERR_SSFN );
+
+    if ( (condvar = cvcb_for( cvid )) == (p2pt_condvar_t *)NULL )
+        return( ERR_OBJDEL );
+
+    if ( (our_tcb = my_tcb()) == (p2pthread_cb_t *)NULL )
+        return( ERR_OBJDEL );
+
+    /*
+    **  The caller must own the mutex.
+    */
+    if ( (error = mutex_wait_word( muid, &mutex_word )) != ERR_NO_ERROR )
+        return( error );
+
+    start_cv_wait( condvar, our_tcb, mutex_word );
+    TRACE( TR_CONDVAR | TR_BLOCK, cvid, muid );
+
+    error = mutex_cv_wait( muid, &(our_tcb->cv_wakeup),
+                           cv_timeout( max_wait, &timeout ) );
+
+    return( finish_cv_wait( cvid, our_tcb, error ) );
+}
+
+/*****************************************************************************
+** cv_smwait - atomically releases a token to the specified p2pthread
+**             semaphore and blocks the calling task until the condition
+**             variable is signalled.  A token is always taken from the
+**             semaphore again before cv_smwait returns.
+*****************************************************************************/
+ULONG
+   cv_smwait( ULONG cvid, ULONG smid, ULONG max_wait )
+{
+    p2pt_condvar_t *condvar;
+    p2pthread_cb_t *our_tcb;
+    struct timespec timeout;
+    struct timespec *timeoutp;
+    int old_canceltype, result;
+    ULONG error;
+
+    if ( mn_caller() )
+        return( ERR_SSFN );
+
+    if ( (condvar = cvcb_for( cvid )) == (p2pt_condvar_t *)NULL )
+        return( ERR_OBJDEL );
+
+    if ( (our_tcb = my_tcb()) == (p2pthread_cb_t *)NULL )
+        return( ERR_OBJDEL );
+
+    /*
+    **  Join the pend list before releasing the semaphore, so that a signal
+    **  sent as soon as the token is released is not lost.
+    */
+    start_cv_wait( condvar, our_tcb, (volatile int *)NULL );
+    TRACE( TR_CONDVAR | TR_BLOCK, cvid, smid );
+
+    if ( (error = sm_v( smid )) != ERR_NO_ERROR )
+        return( finish_cv_wait( cvid, our_tcb, error ) );
+
+    /*
+    **  Sleep on our wait word until it is made nonzero or the wait times out.
+    **  Allow the task to be deleted while it is blocked here.
+    */
+    timeoutp = cv_timeout( max_wait, &timeout );
+    pthread_setcanceltype( PTHREAD_CANCEL_ASYNCHRONOUS, &old_canceltype );
+    do {
+        result = futex_op( &(our_tcb->cv_wakeup),
+                           FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG |
+                           FUTEX_CLOCK_REALTIME,
+                           CV_WAITING, timeoutp, (volatile int *)NULL,
+                           FUTEX_BITSET_MATCH_ANY );
+    } while ( (our_tcb->cv_wakeup == CV_WAITING) &&
+              ((result == 0) || (errno != ETIMEDOUT)) );
+    pthread_setcanceltype( old_canceltype, (int *)NULL );
+
+    error = finish_cv_wait( cvid, our_tcb,
+                            (our_tcb->cv_wakeup == CV_WAITING) ?
+                            ERR_TIMEOUT : ERR_NO_ERROR );
+
+    /*
+    **  Take a token from the semaphore again before returning.
+    */
+    result = sm_p( smid, SM_WAIT, 0L );
+    if ( (result != ERR_NO_ERROR) && (error == ERR_NO_ERROR) )
+        error = result;
+
+    return( error );
+}
+
+/*****************************************************************************
+** cv_signal - wakes the first selected task waiting on the specified
+**             p2pthread condition variable.
+*****************************************************************************/
+ULONG
+   cv_signal( ULONG cvid )
+{
+    p2pt_condvar_t *condvar;
+
+    if ( mn_caller() )
+        return( ERR_SSFN );
+
+    if ( (condvar = cvcb_for( cvid )) == (p2pt_condvar_t *)NULL )
+        return( ERR_OBJDEL );
+
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&(condvar->cv_lock) );
+    lk_lock( &(condvar->cv_lock), &(condvar->cv_lkstat) );
+
+    if ( condvar->first_susp != (p2pthread_cb_t *)NULL )
+        wake_cv_waiter( condvar, next_cv_waiter( condvar ), CV_SIGNALLED );
+
+    lk_unlock( &(condvar->cv_lock), &(condvar->cv_lkstat) );
+    pthread_cleanup_pop( 0 );
+
+    TRACE( TR_CONDVAR | TR_SEND, cvid, 0 );
+
+    return( ERR_NO_ERROR );
+}
+
+/*****************************************************************************
+** cv_broadcast - wakes all tasks waiting on the specified p2pthread
+**                condition variable, in pend order.  Tasks waiting with a
+**                mutex are requeued onto the mutex rather than woken, so
+**                they run one at a time as the mutex is handed on.
+*****************************************************************************/
+ULONG
+   cv_broadcast( ULONG cvid )
+{
+    p2pt_condvar_t *condvar;
+
+    if ( mn_caller() )
+        return( ERR_SSFN );
+
+    if ( (condvar = cvcb_for( cvid )) == (p2pt_condvar_t *)NULL )
+        return( ERR_OBJDEL );
+
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&(condvar->cv_lock) );
+    lk_lock( &(condvar->cv_lock), &(condvar->cv_lkstat) );
+
+    while ( condvar->first_susp != (p2pthread_cb_t *)NULL )
+        wake_cv_waiter( condvar, next_cv_waiter( condvar ), CV_SIGNALLED );
+
+    lk_unlock( &(condvar->cv_lock), &(condvar->cv_lkstat) );
+    pthread_cleanup_pop( 0 );
+
+    TRACE( TR_CONDVAR | TR_SEND, cvid, 1 );
+
+    return( ERR_NO_ERROR );
+}
+
+/*****************************************************************************
+** cv_ident - identifies the specified p2pthread condition variable
+*****************************************************************************/
+ULONG
+    cv_ident( char name[4], ULONG node, ULONG *cvid )
+{
+    p2pt_condvar_t *current_cvcb;
+    ULONG error;
+
+    if ( mn_caller() )
+        return( ERR_SSFN );
+
+    error = ERR_NO_ERROR;
+
+    /*
+    **  Validate the node specifier... only zero is allowed here.
+    */
+    if ( node != 0L )
+        error = ERR_NODENO;
+    else
+    {
+        /*
+        **  If condition variable name string is a NULL pointer, return with
+        **  error.  We'll ASSUME the cvid pointer isn't NULL!
+        */
+        if ( name == (char *)NULL )
+        {
+            *cvid = (ULONG)NULL;
+            error = ERR_OBJNF;
+        }
+        else
+        {
+            /*
+            **  Scan the condition variable list for a matching name.
+            */
+            for ( current_cvcb = condvar_list;
+                  current_cvcb != (p2pt_condvar_t *)NULL;
+                  current_cvcb = current_cvcb->nxt_condvar )
+            {
+                if ( (strncmp( name, current_cvcb->cname, 4 )) == 0 )
+                {
+                    *cvid = current_cvcb->cvid;
+                    break;
+                }
+            }
+            if ( current_cvcb == (p2pt_condvar_t *)NULL )
+            {
+                *cvid = (ULONG)NULL;
+                error = ERR_OBJNF;
+            }
+        }
+    }
+
+    return( error );
+}
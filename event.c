@@ -11,6 +11,7 @@
 #include <string.h>
 #include <signal.h>
 #include <sys/time.h>
+#include <linux/futex.h>
 #include "p2pthread.h"
 
 #undef DIAG_PRINTFS
@@ -29,91 +30,98 @@
 /*****************************************************************************
 **  External function and data references
 *****************************************************************************/
-extern void
-   sched_lock( void );
-extern void
-   sched_unlock( void );
 extern p2pthread_cb_t *
    my_tcb( void );
 extern p2pthread_cb_t *
    tcb_for( ULONG taskid );
+extern p2pthread_cb_t *
+   tcb_cached( ULONG taskid );
+extern long
+   futex_op( volatile int *uaddr, int op, int val,
+             const struct timespec *timeout, volatile int *uaddr2, int val3 );
+extern void
+   stat_block( p2pthread_cb_t *tcb, int reason );
+extern void
+   stat_unblock( p2pthread_cb_t *tcb, int timedout );
+extern void
+   stat_wake( p2pthread_cb_t *tcb );
+extern pthread_mutex_t
+   task_list_lock;
+extern lk_stat_t
+   task_list_lkstat;
 
 
 /*****************************************************************************
 ** ev_send - sets the specified flag bits in a p2pthread task event group
+**           The flags are set with a single atomic operation.  Only if the
+**           receiving task is waiting for one of the flags is it awakened.
+**           The task is found in the tcb cache without a lock.  Since task
+**           control blocks are never freed, the tcb may be used even if the
+**           task is deleted meanwhile; its taskid is checked again after
+**           the flags are set, before the task is woken.
 *****************************************************************************/
 ULONG
    ev_send( ULONG taskid, ULONG new_events )
 {
-#ifdef DIAG_PRINTFS 
-    p2pthread_cb_t *our_tcb;
-#endif
     p2pthread_cb_t *tcb;
-    ULONG old_flags;
     ULONG error;
 
     error = ERR_NO_ERROR;
 
-    if ( (tcb = tcb_for( taskid )) != (p2pthread_cb_t *)NULL )
+    /*
+    **  A task whose cache entry was taken by a later task is found by
+    **  scanning the task list, which needs the lock.
+    */
+    if ( (tcb = tcb_cached( taskid )) == (p2pthread_cb_t *)NULL )
     {
-        /*
-        **  'Lock the p2pthread scheduler' to defer any context switch to a
-        **  higher priority task until after this call has completed its work.
-        */
-        sched_lock();
-
-        /*
-        **  Lock mutex for event post
-        */
         pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
-                              (void *)&(tcb->event_lock));
-        pthread_mutex_lock( &(tcb->event_lock) );
-
-        /*
-        **  Get the state of the flag bits prior to the send operation
-        */
-        old_flags = tcb->events_pending;
+                              (void *)&task_list_lock );
+        lk_lock( &task_list_lock, &task_list_lkstat );
+        tcb = tcb_for( taskid );
+        lk_unlock( &task_list_lock, &task_list_lkstat );
+        pthread_cleanup_pop( 0 );
+    }
 
+    if ( tcb != (p2pthread_cb_t *)NULL )
+    {
 #ifdef DIAG_PRINTFS 
-        printf( "\r\nevent flags @ tcb %p new %lx pending %lx captured %lx",
-                tcb, new_events, tcb->events_pending, tcb->events_captured );
+        printf( "\r\nevent flags @ tcb %p new %lx pending %lx",
+                tcb, new_events, tcb->events_pending );
 #endif
         /*
-        **  If requested to set any flags which were not already set,
-        */ 
-        if ( (old_flags & new_events) != new_events )
-        {
-            /*
-            **  Set the flag bits specified by the caller
-            */
-            tcb->events_pending = old_flags | new_events;
-#ifdef DIAG_PRINTFS 
-        printf( "\r\nsignalling new event flags %lx @ tcb %p",
-                new_events, tcb );
-#endif
+        **  Set the flag bits specified by the caller.  The atomic operation
+        **  is a full barrier, so either the receiver sees the new flags
+        **  before it sleeps or we see the mask it is waiting on.
+        */
+        __sync_fetch_and_or( &(tcb->events_pending), new_events );
 
+        if ( tcb->taskid != taskid )
+        {
             /*
-            **  Signal the condition variable for the event
+            **  The task was deleted after we found it.
             */
-            pthread_cond_broadcast( &(tcb->event_change) );
+            error = ERR_OBJDEL;
         }
+        else
+        {
+            TRACE( TR_EVENT | TR_SEND, taskid, new_events );
 
-        /*
-        **  Unlock the event mutex. 
-        */
-        pthread_mutex_unlock( &(tcb->event_lock) );
-        pthread_cleanup_pop( 0 );
-
-        /*
-        **  'Unlock the p2pthread scheduler' to enable a possible context switch
-        **  to a task made runnable by this call.
-        */
-        sched_unlock();
+            if ( tcb->event_mask & new_events )
+            {
 #ifdef DIAG_PRINTFS 
-        our_tcb = my_tcb();
-        printf( "\r\ntask @ %p sent event flags %lx @ tcb %p",
-                our_tcb, new_events, tcb );
+                printf( "\r\nsignalling new event flags %lx @ tcb %p",
+                        new_events, tcb );
 #endif
+                /*
+                **  The task is waiting for one of these events... wake it.
+                */
+                stat_wake( tcb );
+                __sync_fetch_and_add( &(tcb->event_seq), 1 );
+                futex_op( &(tcb->event_seq),
+                          FUTEX_WAKE | FUTEX_PRIVATE_FLAG, 1,
+                          (struct timespec *)NULL, (volatile int *)NULL, 0 );
+            }
+        }
     }
     else
     {
@@ -124,82 +132,47 @@ ULONG
 }
 
 /*****************************************************************************
-** events_match_mask - compares the specified set of event flags against
-**                     the specified event combination and returns a boolean
-**                     TRUE/FALSE result.
+** take_matching_events - atomically removes the events matching the specified
+**                        mask and rule from the task's pending events, if
+**                        the rule is satisfied.  Returns the events taken,
+**                        or zero (leaving the pending events untouched) if
+**                        the rule is not yet satisfied.
 *****************************************************************************/
-static int
-    events_match_mask( p2pthread_cb_t *tcb, ULONG rule )
+static ULONG
+    take_matching_events( p2pthread_cb_t *tcb, ULONG mask, ULONG rule )
 {
-    int match;
-    ULONG still_pending;
+    ULONG pending;
+    ULONG matched;
 
-    /*
-    **  Save a mask of events already captured when the new pending events
-    **  arrived. Note: we induct events_captured member here because of we 
-    **  have to test the condition of (rule & EV_ALL).
-    */
-    still_pending = tcb->events_captured;
+    do {
+        pending = tcb->events_pending;
+        matched = pending & mask;
 
-    /*
-    **  Capture any newly-arrived pending events which are wanted.
-    **  These events will be accumulated until the match rule is satisfied.
-    */
-    tcb->events_captured |= (tcb->events_pending & tcb->event_mask);
-
-    /*
-    **  Clear any events just captured from the pending list.  Any events
-    **  which had previously been captured and had occurred again are left
-    **  pending.
-    */
-    tcb->events_pending &= ((~tcb->event_mask) | still_pending);
-
-    /*
-    **  Now see if the match rule has been satisfied by captured events.
-    */
-
-    /*
-	**  Note: i have modified this line to suit for rule == 
-	**  EV_ANY | EV_NOWAIT or EV_ANY |EV_WAIT condition.
-	**  The origin statement here is "if ( rule == EV_ANY )"
-	*/
-	if ( rule & EV_ANY )
-    // if ( rule == EV_ANY )
-    {
-        /* ANY rule... any event matching a bit in mask awakens task */
-        if ( (tcb->events_captured & tcb->event_mask) != 0L )
-            match = TRUE;
-		else 
-		    match = FALSE;
-
-#ifdef DIAG_PRINTFS 
-        printf( "\r\nmatch any event @ tcb %p mask %lx pending %lx captured %lx",
-                tcb, tcb->event_mask, tcb->events_pending,
-                tcb->events_captured );
-#endif
-    }
-    else
-    {
-        /* ALL rule... all bits in mask must be matched by events */
-        if ( (tcb->events_captured & tcb->event_mask) == tcb->event_mask )
-            match = TRUE;
-		else 
-		    match = FALSE;
+        /*
+        **  ANY rule... any event matching a bit in mask awakens task.
+        **  ALL rule... all bits in mask must be matched by events.
+        */
+        if ( (matched == 0L) ||
+             (!(rule & EV_ANY) && (matched != mask)) )
+            return( 0L );
+    } while ( !__sync_bool_compare_and_swap( &(tcb->events_pending),
+                                             pending, pending & ~matched ) );
 
 #ifdef DIAG_PRINTFS 
-        printf( "\r\nmatch all events @ tcb %p mask %lx pending %lx captured %lx",
-                tcb, tcb->event_mask, tcb->events_pending,
-                tcb->events_captured );
+    printf( "\r\nmatched events @ tcb %p mask %lx pending %lx taken %lx",
+            tcb, mask, pending, matched );
 #endif
-    }
 
-    return( match );
+    return( matched );
 }
 
 
 /*****************************************************************************
 ** ev_receive - blocks the calling task until a matching combination of events
 **            occurs in the specified p2pthread event flag group.
+**            Events are only consumed once the match rule is satisfied.
+**            With EV_NOWAIT the call never enters the kernel.  A mask of
+**            zero returns the pending events at once, without taking them.
 *****************************************************************************/
 ULONG
    ev_receive( ULONG mask, ULONG opt, ULONG max_wait, ULONG *captured )
@@ -207,8 +180,10 @@ ULONG
     p2pthread_cb_t *tcb;
     struct timeval now;
     struct timespec timeout;
-    int retcode;
+    struct timespec *timeoutp;
+    ULONG matched;
     long sec, usec;
+    int seq, result, old_canceltype;
     ULONG error;
 
     error = ERR_NO_ERROR;
@@ -218,42 +193,23 @@ ULONG
     */
     tcb = my_tcb();
 
-    /*
-    **  Save event mask in TCB, Note: there is no locking here 
-    **  since only in my own pthread i change this member.
-    */
-    tcb->event_mask = mask;
-
 #ifdef DIAG_PRINTFS 
     printf( "\r\ntask @ %p pend on event flags %lx", tcb, mask );
 #endif
 
     /*
-    ** Lock mutex for event pend.
+    **  As in pSOS+, an empty mask just reports the events pending.
     */
-    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
-                          (void *)&(tcb->event_lock));
-    pthread_mutex_lock( &(tcb->event_lock) );
-
-    retcode = 0;
-
-    if ( opt & EV_NOWAIT )
+    if ( mask == 0L )
     {
-        /*
-        **  Caller specified no wait on events...
-        **  Check the condition variable with an immediate timeout.
-        */
-            gettimeofday( &now, (struct timezone *)NULL );
-            timeout.tv_sec = now.tv_sec;
-            timeout.tv_nsec = now.tv_usec * 1000;
-            while ( !(events_match_mask( tcb, opt )) &&
-                    (retcode != ETIMEDOUT) )
-            {
-                retcode = pthread_cond_timedwait( &(tcb->event_change),
-                                              &(tcb->event_lock), &timeout );
-            }
+        if ( captured != (ULONG *)NULL )
+            *captured = tcb->events_pending;
+        return( error );
     }
-    else
+
+    matched = take_matching_events( tcb, mask, opt );
+
+    if ( (matched == 0L) && !(opt & EV_NOWAIT) )
     {
         /*
         **  Caller expects to wait on events, with or without a timeout.
@@ -261,93 +217,94 @@ ULONG
         if ( max_wait == 0L )
         {
             /*
-            **  Infinite wait was specified... wait without timeout,
-            **  The loop is required since the task may be awakened 
-            **  by signals for events which do not match, or for
-            **  signals other than from a send to the event flags.
+            **  Infinite wait was specified... wait without timeout.
             */
-            while ( !(events_match_mask( tcb, opt )) )
-            {
-                pthread_cond_wait( &(tcb->event_change),
-                                   &(tcb->event_lock) );
-            }
+            timeoutp = (struct timespec *)NULL;
         }
         else
         {
             /*
             **  Calculate timeout delay in seconds and microseconds
             */
-            sec = 0;
             usec = max_wait * P2PT_TICK * 1000;
-                gettimeofday( &now, (struct timezone *)NULL );
+            p2pt_time( &now );
             usec += now.tv_usec;
-            if ( usec > 1000000 )
-            {
-                sec = usec / 1000000;
-                usec = usec % 1000000;
-            }
+            sec = usec / 1000000;
+            usec = usec % 1000000;
             timeout.tv_sec = now.tv_sec + sec;
             timeout.tv_nsec = usec * 1000;
+            timeoutp = &timeout;
+        }
 
-            /*
-            **  Wait for an event match for the current task or for the
-            **  timeout to expire.  The loop is required since the task may
-            **  be awakened by signals for events which do not match, or
-            **  for signals other than from a send to the event flags (some 
-            **  other signals also may cause pthread_cond_timedwait() to 
-            **  premature return, see p2linux.pdf).
-            */
-            while ( !(events_match_mask( tcb, opt )) &&
-                    (retcode != ETIMEDOUT) )
-            {
-                retcode = pthread_cond_timedwait( &(tcb->event_change),
-                                                  &(tcb->event_lock),
-                                                  &timeout );
-            }
+        /*
+        **  Publish the mask we are waiting on, so that ev_send knows to
+        **  wake us.  Only our own pthread changes this member.
+        */
+        tcb->event_mask = mask;
+        __sync_synchronize();
+
+        /*
+        **  Wait for an event match for the current task or for the timeout
+        **  to expire.  The wake count is sampled before the events are
+        **  checked, so a send between the check and the futex wait makes
+        **  the wait return at once.  The loop is required since the task
+        **  may be awakened by events which do not complete an ALL match.
+        **  Allow the task to be deleted while it is blocked here.
+        */
+        result = 0;
+        TRACE( TR_EVENT | TR_BLOCK, tcb->taskid, mask );
+        stat_block( tcb, WAIT_EVENT );
+        pthread_setcanceltype( PTHREAD_CANCEL_ASYNCHRONOUS, &old_canceltype );
+        for ( ;; )
+        {
+            seq = tcb->event_seq;
+            if ( (matched = take_matching_events( tcb, mask, opt )) != 0L )
+                break;
+            if ( result == ETIMEDOUT )
+                break;
+            if ( futex_op( &(tcb->event_seq),
+                           FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG |
+                           FUTEX_CLOCK_REALTIME,
+                           seq, timeoutp, (volatile int *)NULL,
+                           FUTEX_BITSET_MATCH_ANY ) != 0 )
+                result = errno;
         }
-    }
+        pthread_setcanceltype( old_canceltype, (int *)NULL );
 
-    /*
-    **  Return a list of captured events to the caller.
-    */
-    if ( captured != (ULONG *)NULL )
-        *captured = tcb->events_captured;
+        tcb->event_mask = (ULONG)NULL;
+        TRACE( TR_EVENT | ((matched != 0L) ? TR_WAKE : TR_TIMEOUT),
+               tcb->taskid, 0 );
+        stat_unblock( tcb, (matched == 0L) );
+    }
 
-    /*
-    **  See if we timed out or if we got an event match
-    */
-    if ( retcode == ETIMEDOUT )
+    if ( matched != 0L )
     {
         /*
-        **  Timed out without an event match
+        **  An event match occurred... return the events taken.
         */
-        if ( opt & EV_NOWAIT )
-            error = ERR_NOEVS;
-        else
-            error = ERR_TIMEOUT;
 #ifdef DIAG_PRINTFS 
-        printf( "...timed out" );
+        printf( "\r\ntask @ %p captured events %lx", tcb, matched );
 #endif
+        if ( captured != (ULONG *)NULL )
+            *captured = matched;
+        TRACE( TR_EVENT | TR_RECEIVE, tcb->taskid, matched );
     }
     else
     {
         /*
-        **  An event match occurred... Clear the accumulated captured events.
+        **  Timed out without an event match... report the wanted events
+        **  which had arrived, but leave them pending.
         */
+        if ( captured != (ULONG *)NULL )
+            *captured = tcb->events_pending & mask;
+        if ( opt & EV_NOWAIT )
+            error = ERR_NOEVS;
+        else
+            error = ERR_TIMEOUT;
 #ifdef DIAG_PRINTFS 
-        printf( "\r\ntask @ %p captured events %lx", tcb,
-                tcb->events_captured );
+        printf( "...timed out" );
 #endif
-
-        tcb->events_captured = (ULONG)NULL;
     }
 
-    /*
-    **  Unlock the mutex for the condition variable and clean up.
-    */
-    pthread_mutex_unlock( &(tcb->event_lock) );
-    pthread_cleanup_pop( 0 );
-
     return( error );
 }
-
@@ -0,0 +1,884 @@
+/*****************************************************************************
+ * evgroup.c - defines the wrapper functions and data structures needed
+ *             to implement shared p2pthread event group objects
+ *             in a POSIX Threads environment.
+ ****************************************************************************/
+
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <linux/futex.h>
+#include "p2pthread.h"
+
+#undef DIAG_PRINTFS
+
+#define EG_AUTOCLR   0x01
+
+#define EV_NOWAIT    0x01
+#define EV_ANY       0x02
+
+#define ERR_TIMEOUT  0x01
+#define ERR_NODENO   0x04
+#define ERR_OBJDEL   0x05
+#define ERR_OBJNF    0x09
+
+#define ERR_NOEVS    0x3C
+
+#define ERR_NOEGCB   0x92
+#define ERR_EGKILLD  0x93
+
+/*
+**  Number of event flags in an event group
+*/
+#define EG_NUM_FLAGS 32
+
+/*
+**  Values of the wake word of a task waiting on an event group
+*/
+#define EG_WAITING   0
+#define EG_MATCHED   1
+#define EG_KILLD     2
+
+/*****************************************************************************
+**  Link in an event flag's list of waiting tasks
+*****************************************************************************/
+typedef struct eg_link
+{
+    struct eg_link *
+        nxt_link;
+    struct eg_link *
+        prv_link;
+    struct eg_waiter *
+        waiter;
+} eg_link_t;
+
+/*****************************************************************************
+**  Record of a task waiting on an event group.  It lives on the waiting
+**  task's stack, and is linked into the list for each event flag which
+**  could complete its match: every flag in the mask for an ANY wait, or
+**  one still-missing flag for an ALL wait.
+*****************************************************************************/
+typedef struct eg_waiter
+{
+        /*
+        ** ID of the event group the task is waiting on
+        */
+    ULONG
+        egid;
+
+        /*
+        ** Events and match rule the task is waiting for
+        */
+    ULONG
+        mask;
+    ULONG
+        rule;
+
+        /*
+        ** Events which satisfied the match, set by the waking task
+        */
+    ULONG
+        captured;
+
+        /*
+        ** Futex word the task sleeps on... nonzero once it is awakened
+        */
+    volatile int
+        wakeup;
+
+        /*
+        ** Control block of the waiting task, for its statistics
+        */
+    p2pthread_cb_t *
+        tcb;
+
+        /*
+        ** Links into the waiting lists of the event flags
+        */
+    eg_link_t
+        links[EG_NUM_FLAGS];
+} eg_waiter_t;
+
+/*****************************************************************************
+**  Control block for p2pthread event group
+**
+**  Task events in event.c belong to one task, so announcing a change to
+**  many tasks takes one ev_send per task.  An event group is a set of event
+**  flags which any number of tasks can wait on with ANY or ALL masks.  Each
+**  flag keeps its own list of waiting tasks, so setting flags only visits the
+**  tasks which might be satisfied by them, and wakes each satisfied task
+**  individually.
+**
+*****************************************************************************/
+typedef struct p2pt_evgroup
+{
+        /*
+        ** ID for event group
+        */
+    ULONG
+        egid;
+
+        /*
+        ** Event Group Name
+        */
+    char
+        ename[4];
+
+        /*
+        ** Option Flags for event group
+        */
+    ULONG
+        flags;
+
+        /*
+        ** Mutex for event group send/receive
+        */
+    pthread_mutex_t
+        eg_lock;
+    lk_stat_t
+        eg_lkstat;       /* Contention statistics for eg_lock */
+
+        /*
+        ** Current state of the event flags
+        */
+    ULONG
+        events;
+
+        /*
+        ** List head of waiting tasks for each event flag
+        */
+    eg_link_t
+        flag_waiters[EG_NUM_FLAGS];
+
+        /*
+        **  Pointer to next event group control block in event group list.
+        */
+    struct p2pt_evgroup *
+        nxt_evgroup;
+} p2pt_evgroup_t;
+
+/*****************************************************************************
+**  External function and data references
+*****************************************************************************/
+extern void *
+    ts_malloc( size_t blksize );
+extern void
+    ts_free( void *blkaddr );
+extern void
+   sched_lock( void );
+extern void
+   sched_unlock( void );
+extern p2pthread_cb_t *
+   my_tcb( void );
+extern void
+   stat_block( p2pthread_cb_t *tcb, int reason );
+extern void
+   stat_unblock( p2pthread_cb_t *tcb, int timedout );
+extern void
+   stat_wake( p2pthread_cb_t *tcb );
+extern long
+   futex_op( volatile int *uaddr, int op, int val,
+             const struct timespec *timeout, volatile int *uaddr2, int val3 );
+
+/*****************************************************************************
+**  p2pthread Global Data Structures
+*****************************************************************************/
+
+/*
+**  evgroup_list is a linked list of event group control blocks.  It is used
+**               to locate event groups by their ID numbers.
+*/
+static p2pt_evgroup_t *
+    evgroup_list;
+
+/*
+**  evgroup_list_lock is a mutex used to serialize access to the event group
+**                    list
+*/
+static pthread_mutex_t
+    evgroup_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static lk_stat_t
+    evgroup_list_lkstat =
+        LK_STAT_INITIALIZER( TR_EVGROUP, "evgroup_list_lock" );
+
+
+/*****************************************************************************
+** egcb_for - returns the address of the event group control block for the
+**            event group idenified by egid
+*****************************************************************************/
+static p2pt_evgroup_t *
+   egcb_for( ULONG egid )
+{
+    p2pt_evgroup_t *current_egcb;
+
+    for ( current_egcb = evgroup_list;
+          current_egcb != (p2pt_evgroup_t *)NULL;
+          current_egcb = current_egcb->nxt_evgroup )
+    {
+        if ( current_egcb->egid == egid )
+            break;
+    }
+
+    return( current_egcb );
+}
+
+/*****************************************************************************
+** new_egid - automatically returns a valid, unused event group ID
+*****************************************************************************/
+static ULONG
+   new_egid( void )
+{
+    p2pt_evgroup_t *current_egcb;
+    ULONG new_evgroup_id;
+
+    /*
+    **  Protect the event group list while we examine it.
+    */
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&evgroup_list_lock );
+    lk_lock( &evgroup_list_lock, &evgroup_list_lkstat );
+
+    /*
+    **  Get the highest previously assigned event group id and add one.
+    */
+    new_evgroup_id = 0;
+    for ( current_egcb = evgroup_list;
+          current_egcb != (p2pt_evgroup_t *)NULL;
+          current_egcb = current_egcb->nxt_evgroup )
+    {
+        if ( current_egcb->egid > new_evgroup_id )
+            new_evgroup_id = current_egcb->egid;
+    }
+    new_evgroup_id++;
+
+    /*
+    **  Re-enable access to the event group list by other threads.
+    */
+    lk_unlock( &evgroup_list_lock, &evgroup_list_lkstat );
+    pthread_cleanup_pop( 0 );
+
+    return( new_evgroup_id );
+}
+
+/*****************************************************************************
+** link_egcb - appends a new event group control block pointer to the
+**             evgroup_list
+*****************************************************************************/
+static void
+   link_egcb( p2pt_evgroup_t *new_evgroup )
+{
+    p2pt_evgroup_t **link;
+
+    /*
+    **  Protect the event group list while we examine and modify it.
+    */
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&evgroup_list_lock );
+    lk_lock( &evgroup_list_lock, &evgroup_list_lkstat );
+
+    /*
+    **  Insert the new entry in ascending numerical sequence by egid.
+    */
+    for ( link = &evgroup_list; *link != (p2pt_evgroup_t *)NULL;
+          link = &((*link)->nxt_evgroup) )
+    {
+        if ( (*link)->egid > new_evgroup->egid )
+            break;
+    }
+    new_evgroup->nxt_evgroup = *link;
+    *link = new_evgroup;
+#ifdef DIAG_PRINTFS
+    printf( "\r\nadd event group cb @ %p to list", new_evgroup );
+#endif
+
+    /*
+    **  Re-enable access to the event group list by other threads.
+    */
+    lk_unlock( &evgroup_list_lock, &evgroup_list_lkstat );
+    pthread_cleanup_pop( 0 );
+}
+
+/*****************************************************************************
+** unlink_egcb - removes an event group control block pointer from the
+**               evgroup_list
+*****************************************************************************/
+static void
+   unlink_egcb( p2pt_evgroup_t *evgroup )
+{
+    p2pt_evgroup_t **link;
+
+    /*
+    **  Protect the event group list while we examine and modify it.
+    */
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&evgroup_list_lock );
+    lk_lock( &evgroup_list_lock, &evgroup_list_lkstat );
+
+    for ( link = &evgroup_list; *link != (p2pt_evgroup_t *)NULL;
+          link = &((*link)->nxt_evgroup) )
+    {
+        if ( *link == evgroup )
+        {
+            *link = evgroup->nxt_evgroup;
+#ifdef DIAG_PRINTFS
+            printf( "\r\ndel event group cb @ %p from list", evgroup );
+#endif
+            break;
+        }
+    }
+
+    /*
+    **  Re-enable access to the event group list by other threads.
+    */
+    lk_unlock( &evgroup_list_lock, &evgroup_list_lkstat );
+    pthread_cleanup_pop( 0 );
+}
+
+/*****************************************************************************
+** events_satisfy - returns TRUE if the specified events satisfy a waiter's
+**                  mask and match rule.
+*****************************************************************************/
+static int
+   events_satisfy( ULONG events, ULONG mask, ULONG rule )
+{
+    if ( rule & EV_ANY )
+        return( (events & mask) != 0L );
+    else
+        return( (events & mask) == mask );
+}
+
+/*****************************************************************************
+** lowest_flag - returns the number of the lowest flag set in a set of events
+*****************************************************************************/
+static int
+   lowest_flag( ULONG events )
+{
+    return( __builtin_ctzl( events ) );
+}
+
+/*****************************************************************************
+** link_waiter - links a waiting task into the list for one event flag.
+**               The caller must hold the eg_lock.
+*****************************************************************************/
+static void
+   link_waiter( p2pt_evgroup_t *evgroup, eg_waiter_t *waiter, int flag )
+{
+    eg_link_t *head;
+    eg_link_t *link;
+
+    head = &(evgroup->flag_waiters[flag]);
+    link = &(waiter->links[flag]);
+
+    link->waiter = waiter;
+    link->nxt_link = head;
+    link->prv_link = head->prv_link;
+    (head->prv_link)->nxt_link = link;
+    head->prv_link = link;
+}
+
+/*****************************************************************************
+** unlink_waiter - removes a waiting task from the lists of all event flags.
+**                 The caller must hold the eg_lock.
+*****************************************************************************/
+static void
+   unlink_waiter( eg_waiter_t *waiter )
+{
+    eg_link_t *link;
+    int flag;
+
+    for ( flag = 0; flag < EG_NUM_FLAGS; flag++ )
+    {
+        link = &(waiter->links[flag]);
+        if ( link->nxt_link != (eg_link_t *)NULL )
+        {
+            (link->prv_link)->nxt_link = link->nxt_link;
+            (link->nxt_link)->prv_link = link->prv_link;
+            link->nxt_link = (eg_link_t *)NULL;
+            link->prv_link = (eg_link_t *)NULL;
+        }
+    }
+}
+
+/*****************************************************************************
+** enlist_waiter - links a waiting task into the lists of the event flags
+**                 which could complete its match... every flag in its mask
+**                 for an ANY match, or its lowest missing flag for an ALL
+**                 match.  The caller must hold the eg_lock.
+*****************************************************************************/
+static void
+   enlist_waiter( p2pt_evgroup_t *evgroup, eg_waiter_t *waiter )
+{
+    ULONG flags;
+
+    if ( waiter->rule & EV_ANY )
+        flags = waiter->mask;
+    else
+        flags = waiter->mask & ~(evgroup->events);
+
+    while ( flags != 0L )
+    {
+        link_waiter( evgroup, waiter, lowest_flag( flags ) );
+        if ( !(waiter->rule & EV_ANY) )
+            break;
+        flags &= flags - 1;
+    }
+}
+
+/*****************************************************************************
+** wake_waiter - removes a waiting task from the event group and wakes it
+**               with the specified wake word value.
+**               The caller must hold the eg_lock.
+*****************************************************************************/
+static void
+   wake_waiter( eg_waiter_t *waiter, int reason )
+{
+    unlink_waiter( waiter );
+    stat_wake( waiter->tcb );
+    __sync_lock_test_and_set( &(waiter->wakeup), reason );
+    futex_op( &(waiter->wakeup), FUTEX_WAKE | FUTEX_PRIVATE_FLAG, 1,
+              (struct timespec *)NULL, (volatile int *)NULL, 0 );
+}
+
+/*****************************************************************************
+** leave_evgroup - removes the calling task's waiter from its event group if
+**                 no sender has woken it yet.  Called when a wait times out,
+**                 and as a cancellation cleanup handler if the task is
+**                 deleted while it waits, since the waiter lives on the
+**                 task's stack.  If the group is gone, it was deleted and
+**                 already woke the waiter.
+*****************************************************************************/
+static void
+   leave_evgroup( eg_waiter_t *waiter )
+{
+    p2pt_evgroup_t *evgroup;
+
+    if ( waiter->wakeup != EG_WAITING )
+        return;
+
+    if ( (evgroup = egcb_for( waiter->egid )) != (p2pt_evgroup_t *)NULL )
+    {
+        pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                              (void *)&(evgroup->eg_lock) );
+        lk_lock( &(evgroup->eg_lock), &(evgroup->eg_lkstat) );
+        if ( waiter->wakeup == EG_WAITING )
+            unlink_waiter( waiter );
+        lk_unlock( &(evgroup->eg_lock), &(evgroup->eg_lkstat) );
+        pthread_cleanup_pop( 0 );
+    }
+}
+
+/*****************************************************************************
+** eg_create - creates a p2pthread event group with all flags clear
+*****************************************************************************/
+ULONG
+    eg_create( char name[4], ULONG opt, ULONG *egid )
+{
+    p2pt_evgroup_t *evgroup;
+    ULONG error;
+    int i;
+
+    error = ERR_NO_ERROR;
+
+    /*
+    **  First allocate memory for the event group control block
+    */
+    evgroup = (p2pt_evgroup_t *)ts_malloc( sizeof( p2pt_evgroup_t ) );
+    if ( evgroup != (p2pt_evgroup_t *)NULL )
+    {
+        /*
+        **  Ok... got a control block.  Initialize it.
+        */
+
+        /*
+        ** Option Flags for event group
+        */
+        evgroup->flags = opt;
+
+        /*
+        ** ID for event group
+        */
+        evgroup->egid = new_egid();
+        if ( egid != (ULONG *)NULL )
+            *egid = evgroup->egid;
+
+        /*
+        **  Name for event group
+        */
+        for ( i = 0; i < 4; i++ )
+            evgroup->ename[i] = name[i];
+
+        /*
+        ** Mutex for event group send/receive
+        */
+        pthread_mutex_init( &(evgroup->eg_lock), (pthread_mutexattr_t *)NULL );
+        lk_init( &(evgroup->eg_lkstat), TR_EVGROUP, evgroup->egid,
+                 evgroup->ename, "eg_lock" );
+
+        /*
+        ** All event flags start out clear, with no tasks waiting on them.
+        */
+        evgroup->events = (ULONG)NULL;
+        for ( i = 0; i < EG_NUM_FLAGS; i++ )
+        {
+            evgroup->flag_waiters[i].nxt_link = &(evgroup->flag_waiters[i]);
+            evgroup->flag_waiters[i].prv_link = &(evgroup->flag_waiters[i]);
+            evgroup->flag_waiters[i].waiter = (eg_waiter_t *)NULL;
+        }
+
+        /*
+        **  Link the new event group into the event group list.
+        */
+        link_egcb( evgroup );
+        TRACE( TR_EVGROUP | TR_CREATE, evgroup->egid, 0 );
+    }
+    else
+    {
+        error = ERR_NOEGCB;
+    }
+
+    return( error );
+}
+
+/*****************************************************************************
+** eg_delete - removes the specified event group from the event group list
+**             and frees the memory allocated for its control block.
+**             Any waiting tasks are awakened with ERR_EGKILLD.
+*****************************************************************************/
+ULONG
+   eg_delete( ULONG egid )
+{
+    p2pt_evgroup_t *evgroup;
+    eg_link_t *head;
+    ULONG error;
+    int flag;
+
+    error = ERR_NO_ERROR;
+
+    sched_lock();
+
+    if ( (evgroup = egcb_for( egid )) != (p2pt_evgroup_t *)NULL )
+    {
+        pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                              (void *)&(evgroup->eg_lock) );
+        lk_lock( &(evgroup->eg_lock), &(evgroup->eg_lkstat) );
+
+        /*
+        **  Wake every waiting task, then take the event group out of the
+        **  list before any of them can look for it again.
+        */
+        for ( flag = 0; flag < EG_NUM_FLAGS; flag++ )
+        {
+            head = &(evgroup->flag_waiters[flag]);
+            while ( head->nxt_link != head )
+                wake_waiter( (head->nxt_link)->waiter, EG_KILLD );
+        }
+        unlink_egcb( evgroup );
+        TRACE( TR_EVGROUP | TR_DELETE, egid, 0 );
+
+        lk_unlock( &(evgroup->eg_lock), &(evgroup->eg_lkstat) );
+        pthread_cleanup_pop( 0 );
+
+        lk_retire( &(evgroup->eg_lkstat) );
+        pthread_mutex_destroy( &(evgroup->eg_lock) );
+        ts_free( (void *)evgroup );
+    }
+    else
+    {
+        error = ERR_OBJDEL;       /* Invalid event group specified */
+    }
+
+    sched_unlock();
+
+    return( error );
+}
+
+/*****************************************************************************
+** eg_send - sets the specified flags in a p2pthread event group and wakes
+**           every waiting task whose match is now satisfied.  Only the tasks
+**           listed on the newly-set flags are examined.  For an EG_AUTOCLR
+**           group, the flags which satisfied any task are cleared afterward.
+*****************************************************************************/
+ULONG
+   eg_send( ULONG egid, ULONG new_events )
+{
+    p2pt_evgroup_t *evgroup;
+    eg_waiter_t *waiter;
+    eg_link_t *head;
+    eg_link_t *link;
+    eg_link_t *nxt_link;
+    ULONG newly_set;
+    ULONG consumed;
+    int flag;
+
+    if ( (evgroup = egcb_for( egid )) == (p2pt_evgroup_t *)NULL )
+        return( ERR_OBJDEL );
+
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&(evgroup->eg_lock) );
+    lk_lock( &(evgroup->eg_lock), &(evgroup->eg_lkstat) );
+
+    newly_set = new_events & ~(evgroup->events);
+    evgroup->events |= new_events;
+    consumed = (ULONG)NULL;
+
+#ifdef DIAG_PRINTFS
+    printf( "\r\nevent group @ %p new %lx events %lx", evgroup, new_events,
+            evgroup->events );
+#endif
+
+    /*
+    **  Visit the tasks waiting on each newly-set flag.
+    */
+    while ( newly_set != 0L )
+    {
+        flag = lowest_flag( newly_set );
+        newly_set &= newly_set - 1;
+        if ( flag >= EG_NUM_FLAGS )
+            break;
+
+        head = &(evgroup->flag_waiters[flag]);
+        for ( link = head->nxt_link; link != head; link = nxt_link )
+        {
+            nxt_link = link->nxt_link;
+            waiter = link->waiter;
+
+            if ( events_satisfy( evgroup->events, waiter->mask,
+                                 waiter->rule ) )
+            {
+                /*
+                **  Match satisfied... wake the task.
+                */
+                waiter->captured = evgroup->events & waiter->mask;
+                consumed |= waiter->captured;
+                wake_waiter( waiter, EG_MATCHED );
+            }
+            else
+            {
+                /*
+                **  ALL match still incomplete... move the task to the list
+                **  for another flag it is still missing.
+                */
+                unlink_waiter( waiter );
+                enlist_waiter( evgroup, waiter );
+            }
+        }
+    }
+
+    if ( evgroup->flags & EG_AUTOCLR )
+        evgroup->events &= ~consumed;
+
+    lk_unlock( &(evgroup->eg_lock), &(evgroup->eg_lkstat) );
+    pthread_cleanup_pop( 0 );
+
+    TRACE( TR_EVGROUP | TR_SEND, egid, new_events );
+
+    return( ERR_NO_ERROR );
+}
+
+/*****************************************************************************
+** eg_clear - clears the specified flags in a p2pthread event group
+*****************************************************************************/
+ULONG
+   eg_clear( ULONG egid, ULONG events )
+{
+    p2pt_evgroup_t *evgroup;
+
+    if ( (evgroup = egcb_for( egid )) == (p2pt_evgroup_t *)NULL )
+        return( ERR_OBJDEL );
+
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&(evgroup->eg_lock) );
+    lk_lock( &(evgroup->eg_lock), &(evgroup->eg_lkstat) );
+
+    evgroup->events &= ~events;
+
+    lk_unlock( &(evgroup->eg_lock), &(evgroup->eg_lkstat) );
+    pthread_cleanup_pop( 0 );
+
+    return( ERR_NO_ERROR );
+}
+
+/*****************************************************************************
+** eg_receive - blocks the calling task until a matching combination of flags
+**              is set in the specified p2pthread event group.  The flags
+**              which satisfied the match are returned in 'captured'.
+*****************************************************************************/
+ULONG
+   eg_receive( ULONG egid, ULONG mask, ULONG opt, ULONG max_wait,
+               ULONG *captured )
+{
+    p2pt_evgroup_t *evgroup;
+    eg_waiter_t waiter;
+    struct timeval now;
+    struct timespec timeout;
+    struct timespec *timeoutp;
+    long sec, usec;
+    int result, old_canceltype;
+    ULONG error;
+
+    error = ERR_NO_ERROR;
+
+    if ( (evgroup = egcb_for( egid )) == (p2pt_evgroup_t *)NULL )
+        return( ERR_OBJDEL );
+
+    mask &= ((ULONG)1 << (EG_NUM_FLAGS - 1) << 1) - 1;
+    waiter.egid = egid;
+    waiter.mask = mask;
+    waiter.rule = opt;
+    waiter.captured = (ULONG)NULL;
+    waiter.wakeup = EG_WAITING;
+    waiter.tcb = my_tcb();
+    memset( waiter.links, 0, sizeof( waiter.links ) );
+
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&(evgroup->eg_lock) );
+    lk_lock( &(evgroup->eg_lock), &(evgroup->eg_lkstat) );
+
+    if ( events_satisfy( evgroup->events, mask, opt ) )
+    {
+        /*
+        **  Match already satisfied... no need to wait.
+        */
+        waiter.captured = evgroup->events & mask;
+        waiter.wakeup = EG_MATCHED;
+        if ( evgroup->flags & EG_AUTOCLR )
+            evgroup->events &= ~(waiter.captured);
+    }
+    else if ( !(opt & EV_NOWAIT) && (mask != 0L) )
+    {
+        stat_block( waiter.tcb, WAIT_EVENT );
+        enlist_waiter( evgroup, &waiter );
+    }
+
+    lk_unlock( &(evgroup->eg_lock), &(evgroup->eg_lkstat) );
+    pthread_cleanup_pop( 0 );
+
+    if ( (waiter.wakeup == EG_WAITING) && !(opt & EV_NOWAIT) && (mask != 0L) )
+    {
+        if ( max_wait == 0L )
+        {
+            /*
+            **  Infinite wait was specified... wait without timeout.
+            */
+            timeoutp = (struct timespec *)NULL;
+        }
+        else
+        {
+            /*
+            **  Calculate timeout delay in seconds and microseconds
+            */
+            usec = max_wait * P2PT_TICK * 1000;
+            p2pt_time( &now );
+            usec += now.tv_usec;
+            sec = usec / 1000000;
+            usec = usec % 1000000;
+            timeout.tv_sec = now.tv_sec + sec;
+            timeout.tv_nsec = usec * 1000;
+            timeoutp = &timeout;
+        }
+
+        /*
+        **  Sleep until a sender wakes us or the wait times out.  If the
+        **  task is deleted meanwhile, its waiter must leave the group before
+        **  its stack goes away.
+        */
+        result = 0;
+        TRACE( TR_EVGROUP | TR_BLOCK, egid, mask );
+        pthread_cleanup_push( (void(*)(void *))leave_evgroup,
+                              (void *)&waiter );
+        pthread_setcanceltype( PTHREAD_CANCEL_ASYNCHRONOUS, &old_canceltype );
+        while ( (waiter.wakeup == EG_WAITING) && (result != ETIMEDOUT) )
+        {
+            if ( futex_op( &(waiter.wakeup),
+                           FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG |
+                           FUTEX_CLOCK_REALTIME,
+                           EG_WAITING, timeoutp, (volatile int *)NULL,
+                           FUTEX_BITSET_MATCH_ANY ) != 0 )
+                result = errno;
+        }
+        pthread_setcanceltype( old_canceltype, (int *)NULL );
+
+        /*
+        **  Timed out... leave the event group unless a sender sneaks in
+        **  first.
+        */
+        pthread_cleanup_pop( 1 );
+        TRACE( TR_EVGROUP |
+               ((waiter.wakeup == EG_WAITING) ? TR_TIMEOUT : TR_WAKE),
+               egid, 0 );
+        stat_unblock( waiter.tcb, (waiter.wakeup == EG_WAITING) );
+    }
+
+    if ( captured != (ULONG *)NULL )
+        *captured = waiter.captured;
+
+    if ( waiter.wakeup == EG_MATCHED )
+        TRACE( TR_EVGROUP | TR_RECEIVE, egid, waiter.captured );
+    if ( waiter.wakeup == EG_KILLD )
+        error = ERR_EGKILLD;
+    else if ( waiter.wakeup == EG_WAITING )
+    {
+        if ( opt & EV_NOWAIT )
+            error = ERR_NOEVS;
+        else
+            error = ERR_TIMEOUT;
+    }
+
+    return( error );
+}
+
+/*****************************************************************************
+** eg_ident - identifies the specified p2pthread event group
+*****************************************************************************/
+ULONG
+    eg_ident( char name[4], ULONG node, ULONG *egid )
+{
+    p2pt_evgroup_t *current_egcb;
+    ULONG error;
+
+    error = ERR_NO_ERROR;
+
+    /*
+    **  Validate the node specifier... only zero is allowed here.
+    */
+    if ( node != 0L )
+        error = ERR_NODENO;
+    else
+    {
+        /*
+        **  If event group name string is a NULL pointer, return with error.
+        **  We'll ASSUME the egid pointer isn't NULL!
+        */
+        if ( name == (char *)NULL )
+        {
+            *egid = (ULONG)NULL;
+            error = ERR_OBJNF;
+        }
+        else
+        {
+            /*
+            **  Scan the event group list for a matching name.
+            */
+            for ( current_egcb = evgroup_list;
+                  current_egcb != (p2pt_evgroup_t *)NULL;
+                  current_egcb = current_egcb->nxt_evgroup )
+            {
+                if ( (strncmp( name, current_egcb->ename, 4 )) == 0 )
+                {
+                    *egid = current_egcb->egid;
+                    break;
+                }
+            }
+            if ( current_egcb == (p2pt_evgroup_t *)NULL )
+            {
+                *egid = (ULONG)NULL;
+                error = ERR_OBJNF;
+            }
+        }
+    }
+
+    return( error );
+}
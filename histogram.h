@@ -0,0 +1,139 @@
+/*****************************************************************************
+ * histogram.h - log-linear latency histograms for the p2pthread benchmark
+ *               and load generator programs.
+ *
+ *  Values below HIST_SUB_COUNT fall in buckets of their own.  Above that,
+ *  each power of two is split into HIST_SUB_COUNT equal buckets, so any
+ *  recorded value is known to within about 6%.
+ ****************************************************************************/
+
+#ifndef _HISTOGRAM_H
+#define _HISTOGRAM_H
+
+#define HIST_SUB_LOG2   4
+#define HIST_SUB_COUNT  (1 << HIST_SUB_LOG2)
+#define HIST_MAX_LOG2   48
+#define HIST_BUCKETS    ((HIST_MAX_LOG2 - HIST_SUB_LOG2 + 2) * HIST_SUB_COUNT)
+
+typedef struct hist
+{
+    unsigned long
+        count;           /* Number of values recorded */
+    unsigned long
+        sum;             /* Sum of values recorded */
+    unsigned long
+        min;             /* Smallest value recorded */
+    unsigned long
+        max;             /* Largest value recorded */
+    unsigned long
+        buckets[HIST_BUCKETS];
+} hist_t;
+
+/*****************************************************************************
+** hist_bucket - returns the bucket a value falls in
+*****************************************************************************/
+static __inline__ int
+   hist_bucket( unsigned long value )
+{
+    int msb;
+
+    if ( value < HIST_SUB_COUNT )
+        return( (int)value );
+    msb = (int)(sizeof( unsigned long ) * 8 - 1) - __builtin_clzl( value );
+    if ( msb > HIST_MAX_LOG2 )
+        return( HIST_BUCKETS - 1 );
+    return( ((msb - HIST_SUB_LOG2 + 1) << HIST_SUB_LOG2) +
+            (int)((value >> (msb - HIST_SUB_LOG2)) & (HIST_SUB_COUNT - 1)) );
+}
+
+/*****************************************************************************
+** hist_bucket_top - returns the largest value which falls in a bucket
+*****************************************************************************/
+static __inline__ unsigned long
+   hist_bucket_top( int bucket )
+{
+    int msb;
+
+    if ( bucket < HIST_SUB_COUNT )
+        return( (unsigned long)bucket );
+    msb = (bucket >> HIST_SUB_LOG2) + HIST_SUB_LOG2 - 1;
+    return( ((unsigned long)((bucket & (HIST_SUB_COUNT - 1)) +
+                             HIST_SUB_COUNT + 1) << (msb - HIST_SUB_LOG2)) - 1 );
+}
+
+/*****************************************************************************
+** hist_init - empties a histogram
+*****************************************************************************/
+static __inline__ void
+   hist_init( hist_t *hist )
+{
+    memset( (void *)hist, 0, sizeof( hist_t ) );
+    hist->min = ~0UL;
+}
+
+/*****************************************************************************
+** hist_record - records one value
+*****************************************************************************/
+static __inline__ void
+   hist_record( hist_t *hist, unsigned long value )
+{
+    hist->buckets[hist_bucket( value )]++;
+    hist->count++;
+    hist->sum += value;
+    if ( value < hist->min )
+        hist->min = value;
+    if ( value > hist->max )
+        hist->max = value;
+}
+
+/*****************************************************************************
+** hist_merge - adds the values recorded in one histogram to another
+*****************************************************************************/
+static __inline__ void
+   hist_merge( hist_t *to, hist_t *from )
+{
+    int i;
+
+    for ( i = 0; i < HIST_BUCKETS; i++ )
+        to->buckets[i] += from->buckets[i];
+    to->count += from->count;
+    to->sum += from->sum;
+    if ( from->min < to->min )
+        to->min = from->min;
+    if ( from->max > to->max )
+        to->max = from->max;
+}
+
+/*****************************************************************************
+** hist_percentile - returns the value below which 'pct' percent of the
+**                   recorded values fall, to the precision of a bucket.
+**                   The exact maximum is returned for anything beyond it.
+*****************************************************************************/
+static __inline__ unsigned long
+   hist_percentile( hist_t *hist, double pct )
+{
+    unsigned long rank;
+    unsigned long seen;
+    unsigned long top;
+    int i;
+
+    if ( hist->count == 0 )
+        return( 0 );
+    rank = (unsigned long)((pct / 100.0) * (double)hist->count + 0.5);
+    if ( rank < 1 )
+        rank = 1;
+
+    seen = 0;
+    for ( i = 0; i < HIST_BUCKETS; i++ )
+    {
+        seen += hist->buckets[i];
+        if ( seen >= rank )
+            break;
+    }
+    top = hist_bucket_top( i );
+    if ( top > hist->max )
+        top = hist->max;
+    return( top );
+}
+
+#endif
@@ -0,0 +1,216 @@
+/*****************************************************************************
+ * init.c - defines p2linux_init(), which configures the p2pthread library
+ *          at startup, and the accounting of control blocks against the
+ *          maximum number of objects of each class it sets.
+ ****************************************************************************/
+
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include "p2pthread.h"
+
+#undef DIAG_PRINTFS
+
+/*
+**  Memory locking policies
+*/
+#define P2PT_MLOCK_NONE     0
+#define P2PT_MLOCK_CURRENT  1
+#define P2PT_MLOCK_ALL      2
+
+/*****************************************************************************
+**  Startup configuration passed to p2linux_init()
+*****************************************************************************/
+typedef struct p2pt_config
+{
+    ULONG
+        max_tasks;       /* Maximum number of tasks (0 for no limit) */
+    ULONG
+        max_queues;      /* Maximum number of message queues */
+    ULONG
+        max_sema4s;      /* Maximum number of semaphores */
+    ULONG
+        max_partitions;  /* Maximum number of partitions */
+    ULONG
+        tick_ms;         /* Milliseconds per tick (0 to keep the default) */
+    ULONG
+        mlock;           /* P2PT_MLOCK_NONE, _CURRENT or _ALL */
+} p2pt_config_t;
+
+/*****************************************************************************
+**  External function and data references
+*****************************************************************************/
+extern int
+   ts_reserve( size_t blksize, ULONG count );
+extern void *
+   ts_malloc( size_t blksize );
+extern void
+   ts_free( void *blkaddr );
+extern int
+   reserve_qcbs( ULONG count );
+extern int
+   reserve_smcbs( ULONG count );
+extern int
+   reserve_pcbs( ULONG count );
+
+/*****************************************************************************
+**  p2pthread Global Data Structures
+*****************************************************************************/
+
+/*
+**  p2pt_tick is the length of a tick in milliseconds, which P2PT_TICK
+**            stands for
+*/
+ULONG
+    p2pt_tick = 10;
+
+/*
+**  obj_max holds the maximum number of objects of each class (zero for no
+**          limit) and obj_count the number in existence, indexed by the
+**          class number from the trace event type (TR_TASK >> 8, ...)
+*/
+static ULONG
+    obj_max[TR_NCLASSES];
+static volatile ULONG
+    obj_count[TR_NCLASSES];
+
+/*
+**  init_called is set by the first valid call to p2linux_init()
+*/
+static volatile int
+    init_called = 0;
+
+/*****************************************************************************
+** count_object - counts a new object of a class, unless that would exceed
+**                the maximum number of objects set for the class.  Returns
+**                FALSE if it would.
+*****************************************************************************/
+int
+   count_object( UINT obj_class )
+{
+    int index;
+
+    index = obj_class >> 8;
+    if ( (__sync_add_and_fetch( &obj_count[index], 1 ) > obj_max[index]) &&
+         (obj_max[index] != 0) )
+    {
+        __sync_sub_and_fetch( &obj_count[index], 1 );
+        return( FALSE );
+    }
+    return( TRUE );
+}
+
+/*****************************************************************************
+** uncount_object - counts an object of a class as gone
+*****************************************************************************/
+void
+   uncount_object( UINT obj_class )
+{
+    __sync_sub_and_fetch( &obj_count[obj_class >> 8], 1 );
+}
+
+/*****************************************************************************
+** alloc_object - allocates the control block of a new object of a class,
+**                unless that would exceed the maximum number of objects
+**                set for the class.  Returns NULL if it would, or if there
+**                is no memory.
+*****************************************************************************/
+void *
+   alloc_object( UINT obj_class, size_t blksize )
+{
+    void *block;
+
+    if ( !count_object( obj_class ) )
+        return( (void *)NULL );
+
+    if ( (block = ts_malloc( blksize )) == (void *)NULL )
+        uncount_object( obj_class );
+
+    return( block );
+}
+
+/*****************************************************************************
+** free_object - frees the control block of an object of a class
+*****************************************************************************/
+void
+   free_object( UINT obj_class, void *block )
+{
+    ts_free( block );
+    uncount_object( obj_class );
+}
+
+/*****************************************************************************
+** p2linux_init - configures the library before any object is created.  Sets
+**                the maximum numbers of tasks, queues, semaphores and
+**                partitions and carves storage for all their control blocks
+**                up front, touching every page of it, so creating and
+**                deleting objects within the limits never calls malloc()
+**                nor faults.  Then sets the tick length and locks the
+**                process's memory as configured.  Returns 0 or an errno
+**                value; EBUSY if called before, or once any task, queue,
+**                semaphore or partition has been created at runtime.
+*****************************************************************************/
+ULONG
+   p2linux_init( const p2pt_config_t *config )
+{
+    int error, flags;
+
+    if ( config == (const p2pt_config_t *)NULL )
+        return( (ULONG)EINVAL );
+
+    /*
+    **  The limits and reserved storage only account for objects created
+    **  after them, so refuse once any exist, and refuse a second call.
+    **  Objects from the static configuration table are not counted.
+    */
+    if ( !__sync_bool_compare_and_swap( &init_called, 0, 1 ) )
+        return( (ULONG)EBUSY );
+    if ( (obj_count[TR_TASK >> 8] != 0) || (obj_count[TR_QUEUE >> 8] != 0) ||
+         (obj_count[TR_SEMA4 >> 8] != 0) || (obj_count[TR_PRTN >> 8] != 0) )
+        return( (ULONG)EBUSY );
+
+    obj_max[TR_TASK >> 8] = config->max_tasks;
+    obj_max[TR_QUEUE >> 8] = config->max_queues;
+    obj_max[TR_SEMA4 >> 8] = config->max_sema4s;
+    obj_max[TR_PRTN >> 8] = config->max_partitions;
+
+    /*
+    **  A task also takes a parameter block when started.
+    */
+    error = ts_reserve( sizeof( p2pthread_cb_t ), config->max_tasks );
+    if ( error == 0 )
+        error = ts_reserve( sizeof( p2pthread_pb_t ), config->max_tasks );
+    if ( error == 0 )
+        error = reserve_qcbs( config->max_queues );
+    if ( error == 0 )
+        error = reserve_smcbs( config->max_sema4s );
+    if ( error == 0 )
+        error = reserve_pcbs( config->max_partitions );
+    if ( error != 0 )
+        return( (ULONG)error );
+
+    if ( config->tick_ms != 0 )
+        p2pt_tick = config->tick_ms;
+
+    /*
+    **  Lock the pages already mapped (including those just reserved), and
+    **  optionally every page mapped from now on, such as task stacks, so
+    **  the process is never delayed by paging.
+    */
+    flags = 0;
+    if ( config->mlock == P2PT_MLOCK_CURRENT )
+        flags = MCL_CURRENT;
+    else if ( config->mlock == P2PT_MLOCK_ALL )
+        flags = MCL_CURRENT | MCL_FUTURE;
+    if ( (flags != 0) && (mlockall( flags ) != 0) )
+    {
+#ifdef DIAG_PRINTFS
+        perror( "\r\np2linux_init mlockall returned error:" );
+#endif
+        return( (ULONG)errno );
+    }
+
+    return( (ULONG)0 );
+}
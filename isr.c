@@ -0,0 +1,329 @@
+/*****************************************************************************
+ * isr.c - defines the send functions which may be called from outside of
+ *         p2pthread task context... from signal handlers or from threads
+ *         which are not p2pthread tasks, in the way a pSOS+ (R) ISR calls
+ *         ev_send(), q_send() and sm_v().
+ ****************************************************************************/
+
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "p2pthread.h"
+
+#undef DIAG_PRINTFS
+
+#define ERR_ISRFULL  0x94
+
+/*
+**  Number of deferred sends the dispatch ring can hold (a power of two)
+*/
+#define ISR_RING_SIZE 256
+
+/*
+**  Kinds of deferred send
+*/
+#define ISR_Q_SEND   1
+#define ISR_SM_V     2
+#define ISR_EV_SEND  3
+
+/*****************************************************************************
+**  Deferred send entry in the dispatch ring
+*****************************************************************************/
+typedef struct isr_entry
+{
+        /*
+        ** Ring position this entry may next be filled (== position) or
+        ** drained (== position + 1) at
+        */
+    volatile ULONG
+        seq;
+
+        /*
+        ** Kind of send and object it is directed to
+        */
+    int
+        kind;
+    ULONG
+        objid;
+
+        /*
+        ** Events for a deferred ev_send
+        */
+    ULONG
+        events;
+
+        /*
+        ** Message for a deferred q_send
+        */
+    ULONG
+        msg[4];
+} isr_entry_t;
+
+/*****************************************************************************
+**  External function and data references
+*****************************************************************************/
+extern ULONG
+   ev_send( ULONG taskid, ULONG new_events );
+extern ULONG
+   q_send( ULONG qid, ULONG msg[4] );
+extern ULONG
+   sm_v( ULONG smid );
+extern long
+   futex_op( volatile int *uaddr, int op, int val,
+             const struct timespec *timeout, volatile int *uaddr2, int val3 );
+
+/*****************************************************************************
+**  p2pthread Global Data Structures
+*****************************************************************************/
+
+/*
+**  isr_ring is a bounded ring of sends deferred from ISR context.  Any
+**           number of ISRs may fill it without locking; only the dispatch
+**           thread drains it.
+*/
+static isr_entry_t
+    isr_ring[ISR_RING_SIZE];
+
+/*
+**  isr_ring_tail is the next ring position to be filled, and isr_ring_head
+**                the next ring position to be drained
+*/
+static volatile ULONG
+    isr_ring_tail;
+static ULONG
+    isr_ring_head;
+
+/*
+**  isr_ring_doorbell is the futex word the dispatch thread sleeps on.  It is
+**                    bumped after each entry is filled.
+*/
+static volatile int
+    isr_ring_doorbell;
+
+/*
+**  isr_dispatch_errors counts deferred sends which failed when they were
+**                      made by the dispatch thread (queue full, object
+**                      deleted...) since there is no ISR left to tell.
+*/
+static volatile ULONG
+    isr_dispatch_errors;
+
+/*
+**  isr_dispatch_once ensures the dispatch thread is started only once
+*/
+static pthread_once_t
+    isr_dispatch_once = PTHREAD_ONCE_INIT;
+
+
+/*****************************************************************************
+** isr_dispatch - body of the dispatch thread.  Drains the ring in order,
+**                making each deferred send from ordinary thread context.
+*****************************************************************************/
+static void *
+   isr_dispatch( void *arg )
+{
+    isr_entry_t *entry;
+    ULONG head;
+    int doorbell;
+
+    for (;;)
+    {
+        /*
+        **  Sample the doorbell before looking at the ring, so an entry
+        **  filled after we find the ring empty makes the futex wait return.
+        */
+        doorbell = isr_ring_doorbell;
+        __sync_synchronize();
+
+        head = isr_ring_head;
+        entry = &(isr_ring[head & (ISR_RING_SIZE - 1)]);
+        if ( entry->seq != head + 1 )
+        {
+            futex_op( &isr_ring_doorbell, FUTEX_WAIT | FUTEX_PRIVATE_FLAG,
+                      doorbell, (struct timespec *)NULL, (volatile int *)NULL,
+                      0 );
+            continue;
+        }
+        __sync_synchronize();
+
+#ifdef DIAG_PRINTFS
+        printf( "\r\nisr dispatch kind %d object %lx", entry->kind,
+                entry->objid );
+#endif
+        switch ( entry->kind )
+        {
+            case ISR_EV_SEND:
+                if ( ev_send( entry->objid, entry->events ) != ERR_NO_ERROR )
+                    __sync_fetch_and_add( &isr_dispatch_errors, 1 );
+                break;
+            case ISR_Q_SEND:
+                if ( q_send( entry->objid, entry->msg ) != ERR_NO_ERROR )
+                    __sync_fetch_and_add( &isr_dispatch_errors, 1 );
+                break;
+            case ISR_SM_V:
+                if ( sm_v( entry->objid ) != ERR_NO_ERROR )
+                    __sync_fetch_and_add( &isr_dispatch_errors, 1 );
+                break;
+        }
+
+        /*
+        **  Hand the entry back to the ISRs for the next lap of the ring.
+        */
+        __sync_synchronize();
+        entry->seq = head + ISR_RING_SIZE;
+        isr_ring_head = head + 1;
+    }
+
+    return( (void *)NULL );
+}
+
+/*****************************************************************************
+** start_isr_dispatch - starts the dispatch thread at the highest real-time
+**                      priority available to us, or at the default priority
+**                      if real-time scheduling is not permitted.
+*****************************************************************************/
+static void
+   start_isr_dispatch( void )
+{
+    pthread_attr_t attr;
+    struct sched_param param;
+    pthread_t pthrid;
+    ULONG i;
+
+    for ( i = 0; i < ISR_RING_SIZE; i++ )
+        isr_ring[i].seq = i;
+
+    pthread_attr_init( &attr );
+    pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_DETACHED );
+    pthread_attr_setinheritsched( &attr, PTHREAD_EXPLICIT_SCHED );
+    pthread_attr_setschedpolicy( &attr, SCHED_FIFO );
+    param.sched_priority = sched_get_priority_max( SCHED_FIFO );
+    pthread_attr_setschedparam( &attr, &param );
+
+    if ( pthread_create( &pthrid, &attr, isr_dispatch, (void *)NULL ) != 0 )
+    {
+        pthread_attr_setinheritsched( &attr, PTHREAD_INHERIT_SCHED );
+        if ( pthread_create( &pthrid, &attr, isr_dispatch,
+                             (void *)NULL ) != 0 )
+            perror( "\r\nstart_isr_dispatch pthread_create returned error:" );
+    }
+
+    pthread_attr_destroy( &attr );
+}
+
+/*****************************************************************************
+** init_isr_dispatch - makes sure the dispatch thread is running.  This is
+**                     called from task context when tasks, queues and
+**                     semaphores are created, since starting a thread is not
+**                     safe from a signal handler.
+*****************************************************************************/
+void
+   init_isr_dispatch( void )
+{
+    pthread_once( &isr_dispatch_once, start_isr_dispatch );
+}
+
+/*****************************************************************************
+** defer_send - fills the next free entry in the dispatch ring and rings the
+**              doorbell.  Uses only atomic operations and a futex wake, and
+**              records no trace event, so it is safe in a signal handler.
+*****************************************************************************/
+static ULONG
+   defer_send( int kind, ULONG objid, ULONG events, ULONG msg[4] )
+{
+    isr_entry_t *entry;
+    ULONG pos;
+    long diff;
+    int i;
+
+    /*
+    **  Claim a ring position.  An entry is free for position pos when its
+    **  seq equals pos; a smaller seq means the ring is full.
+    */
+    pos = isr_ring_tail;
+    for (;;)
+    {
+        entry = &(isr_ring[pos & (ISR_RING_SIZE - 1)]);
+        diff = (long)(entry->seq - pos);
+        if ( diff == 0 )
+        {
+            if ( __sync_bool_compare_and_swap( &isr_ring_tail, pos, pos + 1 ) )
+                break;
+        }
+        else if ( diff < 0 )
+            return( ERR_ISRFULL );
+        pos = isr_ring_tail;
+    }
+
+    entry->kind = kind;
+    entry->objid = objid;
+    entry->events = events;
+    if ( msg != (ULONG *)NULL )
+    {
+        for ( i = 0; i < 4; i++ )
+            entry->msg[i] = msg[i];
+    }
+
+    /*
+    **  Publish the entry, then wake the dispatch thread.  It is not a task,
+    **  so the wake goes straight to the kernel rather than through futex_op,
+    **  which in simulation and M:N mode locks the scheduler's state.
+    */
+    __sync_synchronize();
+    entry->seq = pos + 1;
+    __sync_fetch_and_add( &isr_ring_doorbell, 1 );
+    syscall( SYS_futex, &isr_ring_doorbell, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, 1,
+             (struct timespec *)NULL, (volatile int *)NULL, 0 );
+
+    return( ERR_NO_ERROR );
+}
+
+/*****************************************************************************
+** ev_send_isr - sets the specified flag bits in a p2pthread task event group
+**               from ISR context.  ev_send() locks the task list and traces
+**               the send, neither of which is safe in a signal handler, so
+**               the flags are set by the dispatch thread, in the order
+**               requested with respect to other ISR sends.
+*****************************************************************************/
+ULONG
+   ev_send_isr( ULONG taskid, ULONG new_events )
+{
+    return( defer_send( ISR_EV_SEND, taskid, new_events, (ULONG *)NULL ) );
+}
+
+/*****************************************************************************
+** q_send_isr - sends a message to a p2pthread queue from ISR context.  The
+**              send is made by the dispatch thread, in the order it was
+**              requested with respect to other ISR sends.
+*****************************************************************************/
+ULONG
+   q_send_isr( ULONG qid, ULONG msg[4] )
+{
+    return( defer_send( ISR_Q_SEND, qid, 0L, msg ) );
+}
+
+/*****************************************************************************
+** sm_v_isr - releases a semaphore token from ISR context.  The token is
+**            released by the dispatch thread.
+*****************************************************************************/
+ULONG
+   sm_v_isr( ULONG smid )
+{
+    return( defer_send( ISR_SM_V, smid, 0L, (ULONG *)NULL ) );
+}
+
+/*****************************************************************************
+** isr_errors - returns the number of deferred ISR sends which failed when
+**              the dispatch thread made them.
+*****************************************************************************/
+ULONG
+   isr_errors( void )
+{
+    return( isr_dispatch_errors );
+}
@@ -0,0 +1,1073 @@
+/*****************************************************************************
+ * loadgen.c - a scenario-driven load generator for the Wind River pSOS+ (R)
+ *             API primitives implemented in a POSIX Threads environment.
+ *
+ *  A configuration file describes one or more streams, each a set of
+ *  queues, variable-length queues, semaphores or partitions with producer
+ *  and consumer tasks of their own.  Producers send at a fixed rate or as
+ *  fast as they can, and consumers record how long each message took to
+ *  arrive.  The whole scenario is run for a fixed time with its tasks
+ *  confined to 1, 2, 4... up to N CPUs.  For each run one JSON object per
+ *  stream and one for the run as a whole is written per line to stdout,
+ *  holding the throughput, latency percentiles, resident set size and
+ *  context switches, and a table of the same results goes to stderr.
+ *
+ *  usage: loadgen [-c max_cpus] [-q] config_file
+ *
+ *  The configuration file holds one setting or stream per line, with
+ *  anything after a '#' ignored:
+ *
+ *      duration <seconds>          length of each run (default 2)
+ *      cpus <n> <n>... | all       CPU counts to run on (default 1, 2, 4...)
+ *      queue  [key=value...]       a stream of q_send/q_receive messages
+ *      vqueue [key=value...]       a stream of q_vsend/q_vreceive messages
+ *      sema4  [key=value...]       a stream of sm_v/sm_p tokens
+ *      prtn   [key=value...]       a stream of pt_getbuf buffers handed to
+ *                                  consumers through a queue and returned
+ *                                  by them with pt_retbuf
+ *
+ *  The keys of a stream, all optional, are:
+ *
+ *      count=<n>       objects in the stream (default 1)
+ *      producers=<n>   producer tasks per object (default 1)
+ *      consumers=<n>   consumer tasks per object (default 1)
+ *      rate=<n>        messages per second per producer, 0 for as fast as
+ *                      possible (default 0)
+ *      size=<n>        message or buffer bytes, for vqueue and prtn
+ *                      streams (default 64)
+ *      depth=<n>       messages which may be outstanding per object before
+ *                      producers must wait (default 64)
+ *      prio=<n>        priority of producers and consumers (default 20)
+ *      pprio=<n>       priority of producers
+ *      cprio=<n>       priority of consumers
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/utsname.h>
+#include "p2linux.h"
+#include "histogram.h"
+
+#ifndef LOADGEN_VERSION
+#define LOADGEN_VERSION "unknown"
+#endif
+
+/*
+**  Limits on the scenario
+*/
+#define MAX_STREAMS     32
+#define MAX_CPU_COUNTS  32
+#define MAX_LINE        256
+
+/*
+**  Priority of the task which ends each run.  It must preempt any stream
+**  task, and p2pthread priorities of 99 and above wrap around.
+*/
+#define STOP_PRIO       98
+#define MAX_STREAM_PRIO 97
+
+/*
+**  Kinds of stream
+*/
+#define ST_QUEUE        0
+#define ST_VQUEUE       1
+#define ST_SEMA4        2
+#define ST_PRTN         3
+
+static const char *
+    kind_names[] = { "queue", "vqueue", "sema4", "prtn", NULL };
+
+/*****************************************************************************
+**  State of one object of a stream
+*****************************************************************************/
+typedef struct lg_object
+{
+    ULONG
+        objid;           /* Queue, vqueue, semaphore or partition ID */
+    ULONG
+        qid;             /* Queue carrying buffers of a partition */
+    ULONG
+        credits;         /* Semaphore counting room for more messages */
+
+        /*
+        ** Send times of semaphore tokens, in the order the tokens were
+        ** posted.  Semaphores carry no data, so consumers look up the send
+        ** time of the n'th token they take in the n'th slot (modulo twice
+        ** the depth, which leaves room for tokens taken out of order).
+        */
+    ULONG *
+        stamps;
+    ULONG
+        nstamps;
+    ULONG
+        posted;          /* Tokens posted so far */
+    ULONG
+        taken;           /* Tokens taken so far */
+} lg_object_t;
+
+/*****************************************************************************
+**  Description and results of one stream
+*****************************************************************************/
+typedef struct stream
+{
+    int
+        kind;            /* ST_QUEUE, ST_VQUEUE... */
+    ULONG
+        count;           /* Objects in stream */
+    ULONG
+        producers;       /* Producer tasks per object */
+    ULONG
+        consumers;       /* Consumer tasks per object */
+    ULONG
+        rate;            /* Messages per second per producer (0 = no limit) */
+    ULONG
+        size;            /* Message or buffer bytes */
+    ULONG
+        depth;           /* Messages outstanding per object */
+    ULONG
+        pprio;           /* Priority of producers */
+    ULONG
+        cprio;           /* Priority of consumers */
+    lg_object_t *
+        objects;
+
+        /*
+        ** Results of the current run, gathered from the stream's tasks
+        */
+    ULONG
+        msgs;            /* Messages received while the run lasted */
+    ULONG
+        full;            /* Times a producer waited for room */
+    hist_t
+        latency;         /* Send to receive time of each message, in ns */
+} stream_t;
+
+/*****************************************************************************
+**  State of one producer or consumer task
+*****************************************************************************/
+typedef struct lg_task
+{
+    stream_t *
+        stream;
+    lg_object_t *
+        object;
+    int
+        consumer;        /* Nonzero for a consumer */
+    ULONG
+        tid;
+    ULONG
+        msgs;            /* Messages received while the run lasted */
+    ULONG
+        full;            /* Times task waited for room */
+    hist_t
+        latency;         /* Latency of each message received, in ns */
+} lg_task_t;
+
+/*****************************************************************************
+**  load generator global data structures
+*****************************************************************************/
+static stream_t
+    streams[MAX_STREAMS];
+static int
+    nstreams;
+static ULONG
+    duration_secs = 2L;
+static int
+    cpu_counts[MAX_CPU_COUNTS];
+static int
+    ncpu_counts;
+
+static lg_task_t *
+    tasks;
+static ULONG
+    ntasks;
+static ULONG
+    nproducers;
+
+/*
+**  start_barrier holds all tasks of a run until every one is ready, and
+**  done_count, producers_done, done_lock and done_cond tell the driver when
+**  they finish.  These are plain pthread objects since the driver is not a
+**  task.
+**  run_start is the time the first task started, stop_time the time the
+**  stop task ended the run, and stopping tells producers to finish.
+*/
+static pthread_barrier_t
+    start_barrier;
+static ULONG
+    done_count;
+static ULONG
+    producers_done;
+static ULONG
+    run_start;
+static ULONG
+    stop_time;
+static volatile int
+    stopping;
+static pthread_mutex_t
+    done_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t
+    done_cond = PTHREAD_COND_INITIALIZER;
+
+/*
+**  CPUs the load generator was started on
+*/
+static cpu_set_t
+    all_cpus;
+
+/*****************************************************************************
+** now_ns - returns the monotonic clock in nanoseconds
+*****************************************************************************/
+static ULONG
+   now_ns( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return( (ULONG)now.tv_sec * 1000000000UL + (ULONG)now.tv_nsec );
+}
+
+/*****************************************************************************
+** sleep_until - sleeps until the monotonic clock reaches 'when' ns
+*****************************************************************************/
+static void
+   sleep_until( ULONG when )
+{
+    struct timespec until;
+
+    until.tv_sec = when / 1000000000UL;
+    until.tv_nsec = when % 1000000000UL;
+    while ( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &until,
+                             (struct timespec *)NULL ) == EINTR )
+        ;
+}
+
+/*****************************************************************************
+** task_ready - waits for the other tasks of the run to be ready
+*****************************************************************************/
+static void
+   task_ready( void )
+{
+    pthread_barrier_wait( &start_barrier );
+    __sync_bool_compare_and_swap( &run_start, 0L, now_ns() );
+}
+
+/*****************************************************************************
+** task_done - tells the driver a task has finished, and deletes it
+*****************************************************************************/
+static void
+   task_done( int producer )
+{
+    pthread_mutex_lock( &done_lock );
+    done_count++;
+    if ( producer )
+        producers_done++;
+    pthread_cond_signal( &done_cond );
+    pthread_mutex_unlock( &done_lock );
+    t_delete( 0L );
+}
+
+/*****************************************************************************
+** produce - sends one message to the task's object, once there is room
+*****************************************************************************/
+static void
+   produce( lg_task_t *task, void *buf )
+{
+    stream_t *stream;
+    lg_object_t *object;
+    ULONG msg[4];
+    ULONG stamp;
+    ULONG slot;
+    void *bufaddr;
+
+    stream = task->stream;
+    object = task->object;
+
+    /*
+    **  Take a credit for the message, waiting for a consumer to return
+    **  one if 'depth' messages are already outstanding.
+    */
+    if ( sm_p( object->credits, SM_NOWAIT, 0L ) != 0L )
+    {
+        task->full++;
+        sm_p( object->credits, SM_WAIT, 0L );
+    }
+    stamp = now_ns();
+
+    switch ( stream->kind )
+    {
+        case ST_QUEUE:
+            msg[0] = stamp;
+            msg[1] = msg[2] = msg[3] = 0L;
+            q_send( object->objid, msg );
+            break;
+
+        case ST_VQUEUE:
+            memcpy( buf, (void *)&stamp, sizeof( stamp ) );
+            q_vsend( object->objid, buf, stream->size );
+            break;
+
+        case ST_SEMA4:
+            /*
+            **  The token is counted as posted before its stamp is written,
+            **  so a consumer may find a slot not yet stamped... it skips
+            **  such tokens rather than report a meaningless latency.
+            */
+            slot = __sync_fetch_and_add( &(object->posted), 1L );
+            object->stamps[slot % object->nstamps] = stamp;
+            sm_v( object->objid );
+            break;
+
+        case ST_PRTN:
+            /*
+            **  Blocks freed by consumers may sit in their caches for a
+            **  while, so the partition can run dry despite the credit.
+            */
+            while ( pt_getbuf( object->objid, &bufaddr ) != 0L )
+            {
+                task->full++;
+                sched_yield();
+            }
+            memset( bufaddr, 0x5a, stream->size );
+            memcpy( bufaddr, (void *)&stamp, sizeof( stamp ) );
+            msg[0] = (ULONG)bufaddr;
+            msg[1] = msg[2] = msg[3] = 0L;
+            q_send( object->qid, msg );
+            break;
+    }
+}
+
+/*****************************************************************************
+** producer - body of a producer task
+*****************************************************************************/
+static void
+   producer( ULONG index, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    lg_task_t *task;
+    ULONG interval;
+    ULONG next;
+    void *buf;
+
+    task = &tasks[index];
+    buf = malloc( task->stream->size );
+    memset( buf, 0x5a, task->stream->size );
+    interval = 0L;
+    if ( task->stream->rate != 0L )
+        interval = 1000000000UL / task->stream->rate;
+
+    task_ready();
+    next = now_ns();
+    while ( !stopping )
+    {
+        if ( interval != 0L )
+        {
+            next += interval;
+            sleep_until( next );
+        }
+        produce( task, buf );
+    }
+
+    free( buf );
+    task_done( 1 );
+}
+
+/*****************************************************************************
+** consume - receives one message from the task's object, and returns the
+**           time it was sent (~0 if unknown) or 0 if it tells the consumer
+**           to finish
+*****************************************************************************/
+static ULONG
+   consume( lg_task_t *task, void *buf )
+{
+    stream_t *stream;
+    lg_object_t *object;
+    ULONG msg[4];
+    ULONG msglen;
+    ULONG stamp;
+    ULONG slot;
+
+    stream = task->stream;
+    object = task->object;
+    stamp = 0L;
+
+    switch ( stream->kind )
+    {
+        case ST_QUEUE:
+            q_receive( object->objid, Q_WAIT, 0L, msg );
+            stamp = msg[0];
+            break;
+
+        case ST_VQUEUE:
+            q_vreceive( object->objid, Q_WAIT, 0L, buf, stream->size,
+                        &msglen );
+            memcpy( (void *)&stamp, buf, sizeof( stamp ) );
+            break;
+
+        case ST_SEMA4:
+            /*
+            **  Tokens beyond the last one posted by a producer are those
+            **  posted by the driver to stop the consumers.
+            */
+            sm_p( object->objid, SM_WAIT, 0L );
+            slot = __sync_fetch_and_add( &(object->taken), 1L );
+            if ( slot >= object->posted )
+                break;
+            stamp = object->stamps[slot % object->nstamps];
+            object->stamps[slot % object->nstamps] = 0L;
+            if ( stamp == 0L )
+                stamp = ~0UL;
+            break;
+
+        case ST_PRTN:
+            q_receive( object->qid, Q_WAIT, 0L, msg );
+            if ( msg[0] != 0L )
+            {
+                memcpy( (void *)&stamp, (void *)msg[0], sizeof( stamp ) );
+                pt_retbuf( object->objid, (void *)msg[0] );
+            }
+            break;
+    }
+
+    /*
+    **  Return the message's credit to the producers.
+    */
+    if ( stamp != 0L )
+        sm_v( object->credits );
+    return( stamp );
+}
+
+/*****************************************************************************
+** consumer - body of a consumer task
+*****************************************************************************/
+static void
+   consumer( ULONG index, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    lg_task_t *task;
+    ULONG stamp;
+    ULONG now;
+    void *buf;
+
+    task = &tasks[index];
+    buf = malloc( task->stream->size );
+
+    task_ready();
+    while ( (stamp = consume( task, buf )) != 0L )
+    {
+        if ( stopping )
+            continue;
+        task->msgs++;
+        now = now_ns();
+        if ( stamp <= now )
+            hist_record( &(task->latency), now - stamp );
+    }
+
+    free( buf );
+    task_done( 0 );
+}
+
+/*****************************************************************************
+** stop_task - ends the run after the configured duration
+*****************************************************************************/
+static void
+   stop_task( ULONG dummy0, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    task_ready();
+    sleep_until( run_start + duration_secs * 1000000000UL );
+    stop_time = now_ns();
+    stopping = 1;
+    task_done( 1 );
+}
+
+/*****************************************************************************
+** create_objects - creates the objects of a stream
+*****************************************************************************/
+static ULONG
+   create_objects( stream_t *stream )
+{
+    lg_object_t *object;
+    ULONG bsize;
+    ULONG nbuf;
+    ULONG error;
+    ULONG i;
+
+    stream->objects = (lg_object_t *)calloc( stream->count,
+                                             sizeof( lg_object_t ) );
+    error = 0L;
+    for ( i = 0; (i < stream->count) && (error == 0L); i++ )
+    {
+        object = &(stream->objects[i]);
+        switch ( stream->kind )
+        {
+            case ST_QUEUE:
+                error = q_create( "LGQ ", stream->depth, Q_FIFO,
+                                  &(object->objid) );
+                break;
+
+            case ST_VQUEUE:
+                error = q_vcreate( "LGV ", Q_FIFO, stream->depth,
+                                   stream->size, &(object->objid) );
+                break;
+
+            case ST_SEMA4:
+                object->nstamps = 2 * stream->depth;
+                object->stamps = (ULONG *)calloc( object->nstamps,
+                                                  sizeof( ULONG ) );
+                error = sm_create( "LGS ", 0L, SM_FIFO, &(object->objid) );
+                break;
+
+            case ST_PRTN:
+                /*
+                **  Buffer sizes are powers of two.  The partition holds
+                **  twice as many buffers as there are credits.
+                */
+                for ( bsize = 16L; bsize < stream->size; bsize <<= 1 )
+                    ;
+                error = pt_create( "LGP ", NULL, NULL,
+                                   2 * stream->depth * bsize, bsize, PT_DEL,
+                                   &(object->objid), &nbuf );
+                if ( error == 0L )
+                    error = q_create( "LGPQ", stream->depth, Q_FIFO,
+                                      &(object->qid) );
+                break;
+        }
+        if ( error == 0L )
+            error = sm_create( "LGCR", stream->depth, SM_FIFO,
+                               &(object->credits) );
+    }
+    return( error );
+}
+
+/*****************************************************************************
+** delete_objects - deletes the objects create_objects made
+*****************************************************************************/
+static void
+   delete_objects( stream_t *stream )
+{
+    lg_object_t *object;
+    ULONG i;
+
+    for ( i = 0; i < stream->count; i++ )
+    {
+        object = &(stream->objects[i]);
+        switch ( stream->kind )
+        {
+            case ST_QUEUE:
+                q_delete( object->objid );
+                break;
+
+            case ST_VQUEUE:
+                q_vdelete( object->objid );
+                break;
+
+            case ST_SEMA4:
+                sm_delete( object->objid );
+                free( (void *)object->stamps );
+                break;
+
+            case ST_PRTN:
+                q_delete( object->qid );
+                pt_delete( object->objid );
+                break;
+        }
+        sm_delete( object->credits );
+    }
+    free( (void *)stream->objects );
+}
+
+/*****************************************************************************
+** stop_consumers - tells every consumer of a stream to finish, once its
+**                  producers have
+*****************************************************************************/
+static void
+   stop_consumers( stream_t *stream )
+{
+    lg_object_t *object;
+    ULONG msg[4];
+    void *stop;
+    ULONG i, j;
+
+    memset( (void *)msg, 0, sizeof( msg ) );
+    stop = calloc( 1, stream->size );
+    for ( i = 0; i < stream->count; i++ )
+    {
+        object = &(stream->objects[i]);
+        for ( j = 0; j < stream->consumers; j++ )
+        {
+            switch ( stream->kind )
+            {
+                case ST_QUEUE:
+                    q_send( object->objid, msg );
+                    break;
+
+                case ST_VQUEUE:
+                    while ( q_vsend( object->objid, stop,
+                                     stream->size ) != 0 )
+                        sched_yield();
+                    break;
+
+                case ST_SEMA4:
+                    sm_v( object->objid );
+                    break;
+
+                case ST_PRTN:
+                    q_send( object->qid, msg );
+                    break;
+            }
+        }
+    }
+    free( stop );
+}
+
+/*****************************************************************************
+** set_cpus - confines the calling thread, and the tasks it creates from
+**            now on, to the first 'ncpus' CPUs the program was started on
+*****************************************************************************/
+static void
+   set_cpus( int ncpus )
+{
+    cpu_set_t cpus;
+    int i;
+
+    CPU_ZERO( &cpus );
+    for ( i = 0; (i < CPU_SETSIZE) && (ncpus > 0); i++ )
+    {
+        if ( CPU_ISSET( i, &all_cpus ) )
+        {
+            CPU_SET( i, &cpus );
+            ncpus--;
+        }
+    }
+    sched_setaffinity( 0, sizeof( cpus ), &cpus );
+}
+
+/*****************************************************************************
+** rss_kbytes - returns the resident set size of the process in kbytes
+*****************************************************************************/
+static ULONG
+   rss_kbytes( void )
+{
+    unsigned long size, resident;
+    FILE *statm;
+
+    resident = 0L;
+    if ( (statm = fopen( "/proc/self/statm", "r" )) != (FILE *)NULL )
+    {
+        if ( fscanf( statm, "%lu %lu", &size, &resident ) != 2 )
+            resident = 0L;
+        fclose( statm );
+    }
+    return( (ULONG)(resident * (sysconf( _SC_PAGESIZE ) / 1024)) );
+}
+
+/*****************************************************************************
+** run_scenario - runs every stream of the scenario together on 'ncpus'
+**                CPUs and reports the results
+*****************************************************************************/
+static void
+   run_scenario( int ncpus, int quiet )
+{
+    stream_t *stream;
+    lg_task_t *task;
+    struct rusage before, after;
+    hist_t *total;
+    ULONG parms[4];
+    ULONG total_msgs;
+    ULONG stop_tid;
+    ULONG elapsed;
+    ULONG rss;
+    ULONG i, j, k, n;
+    int s;
+
+    set_cpus( ncpus );
+    getrusage( RUSAGE_SELF, &before );
+
+    /*
+    **  Create the objects, and a producer and consumer task table entry
+    **  for each task of each object.
+    */
+    n = 0L;
+    for ( s = 0; s < nstreams; s++ )
+    {
+        stream = &streams[s];
+        if ( create_objects( stream ) != 0L )
+        {
+            fprintf( stderr, "cannot create %s objects\n",
+                     kind_names[stream->kind] );
+            exit( 1 );
+        }
+        stream->msgs = 0L;
+        stream->full = 0L;
+        hist_init( &(stream->latency) );
+        for ( i = 0; i < stream->count; i++ )
+        {
+            for ( j = 0; j < stream->producers + stream->consumers; j++ )
+            {
+                task = &tasks[n++];
+                memset( (void *)task, 0, sizeof( lg_task_t ) );
+                task->stream = stream;
+                task->object = &(stream->objects[i]);
+                task->consumer = (j >= stream->producers);
+                hist_init( &(task->latency) );
+            }
+        }
+    }
+
+    pthread_barrier_init( &start_barrier, (pthread_barrierattr_t *)NULL,
+                          ntasks + 2 );
+    done_count = 0L;
+    producers_done = 0L;
+    run_start = 0L;
+    stopping = 0;
+
+    for ( i = 0; i < ntasks; i++ )
+    {
+        task = &tasks[i];
+        t_create( task->consumer ? "LGC " : "LGP ",
+                  task->consumer ? task->stream->cprio : task->stream->pprio,
+                  0L, 0L, 0L, &(task->tid) );
+    }
+    t_create( "LGST", STOP_PRIO, 0L, 0L, 0L, &stop_tid );
+    /*
+    **  Stream tasks are time-sliced, so that producers which never block
+    **  share the CPUs with the other tasks of their priority.
+    */
+    for ( i = 0; i < ntasks; i++ )
+    {
+        parms[0] = i;
+        parms[1] = parms[2] = parms[3] = 0L;
+        t_start( tasks[i].tid, T_TSLICE,
+                 tasks[i].consumer ? consumer : producer, parms );
+    }
+    t_start( stop_tid, T_NOTSLICE, stop_task, (ULONG *)NULL );
+
+    /*
+    **  Release the tasks together.  The stop task ends the run, and once
+    **  it and every producer have finished the consumers are told to stop.
+    */
+    pthread_barrier_wait( &start_barrier );
+    pthread_mutex_lock( &done_lock );
+    while ( producers_done < nproducers + 1 )
+        pthread_cond_wait( &done_cond, &done_lock );
+    pthread_mutex_unlock( &done_lock );
+
+    rss = rss_kbytes();
+    for ( s = 0; s < nstreams; s++ )
+        stop_consumers( &streams[s] );
+
+    pthread_mutex_lock( &done_lock );
+    while ( done_count < ntasks + 1 )
+        pthread_cond_wait( &done_cond, &done_lock );
+    pthread_mutex_unlock( &done_lock );
+    pthread_barrier_destroy( &start_barrier );
+    getrusage( RUSAGE_SELF, &after );
+    elapsed = stop_time - run_start;
+
+    /*
+    **  Gather the results of each stream and of the run as a whole.
+    */
+    total = (hist_t *)malloc( sizeof( hist_t ) );
+    hist_init( total );
+    total_msgs = 0L;
+    for ( i = 0; i < ntasks; i++ )
+    {
+        task = &tasks[i];
+        if ( task->consumer )
+        {
+            task->stream->msgs += task->msgs;
+            hist_merge( &(task->stream->latency), &(task->latency) );
+        }
+        else
+            task->stream->full += task->full;
+    }
+    for ( s = 0; s < nstreams; s++ )
+    {
+        stream = &streams[s];
+        total_msgs += stream->msgs;
+        hist_merge( total, &(stream->latency) );
+        k = stream->count * (stream->producers + stream->consumers);
+
+        printf( "{\"stream\":%d,\"kind\":\"%s\",\"version\":\"%s\","
+                "\"cpus\":%d,\"objects\":%lu,\"tasks\":%lu,\"msgs\":%lu,"
+                "\"msgs_per_sec\":%.0f,\"full\":%lu,\"mean_ns\":%lu,"
+                "\"p50_ns\":%lu,\"p99_ns\":%lu,\"p999_ns\":%lu,"
+                "\"max_ns\":%lu}\n",
+                s, kind_names[stream->kind], LOADGEN_VERSION, ncpus,
+                stream->count, k, stream->msgs,
+                (double)stream->msgs * 1e9 / (double)(elapsed ? elapsed : 1),
+                stream->full,
+                stream->latency.count ?
+                    stream->latency.sum / stream->latency.count : 0L,
+                hist_percentile( &(stream->latency), 50.0 ),
+                hist_percentile( &(stream->latency), 99.0 ),
+                hist_percentile( &(stream->latency), 99.9 ),
+                stream->latency.max );
+        if ( !quiet )
+            fprintf( stderr, "%2d %-7s %4d %12.0f %10lu %10lu %10lu %10lu"
+                     " %10lu\n", s, kind_names[stream->kind], ncpus,
+                     (double)stream->msgs * 1e9 /
+                         (double)(elapsed ? elapsed : 1),
+                     hist_percentile( &(stream->latency), 50.0 ),
+                     hist_percentile( &(stream->latency), 99.0 ),
+                     hist_percentile( &(stream->latency), 99.9 ),
+                     stream->latency.max, stream->full );
+        delete_objects( stream );
+    }
+
+    printf( "{\"run\":\"total\",\"version\":\"%s\",\"cpus\":%d,"
+            "\"tasks\":%lu,\"secs\":%.6f,\"msgs\":%lu,\"msgs_per_sec\":%.0f,"
+            "\"p50_ns\":%lu,\"p99_ns\":%lu,\"p999_ns\":%lu,\"max_ns\":%lu,"
+            "\"rss_kb\":%lu,\"maxrss_kb\":%ld,\"vol_csw\":%ld,"
+            "\"invol_csw\":%ld,\"user_secs\":%.3f,\"sys_secs\":%.3f}\n",
+            LOADGEN_VERSION, ncpus, ntasks, (double)elapsed / 1e9,
+            total_msgs,
+            (double)total_msgs * 1e9 / (double)(elapsed ? elapsed : 1),
+            hist_percentile( total, 50.0 ), hist_percentile( total, 99.0 ),
+            hist_percentile( total, 99.9 ), total->max, rss,
+            after.ru_maxrss, after.ru_nvcsw - before.ru_nvcsw,
+            after.ru_nivcsw - before.ru_nivcsw,
+            (double)(after.ru_utime.tv_sec - before.ru_utime.tv_sec) +
+            (double)(after.ru_utime.tv_usec - before.ru_utime.tv_usec) / 1e6,
+            (double)(after.ru_stime.tv_sec - before.ru_stime.tv_sec) +
+            (double)(after.ru_stime.tv_usec - before.ru_stime.tv_usec) / 1e6 );
+    fflush( stdout );
+    if ( !quiet )
+        fprintf( stderr, "   %-7s %4d %12.0f %10lu %10lu %10lu %10lu"
+                 "  rss %lu kB, %ld+%ld csw\n", "total", ncpus,
+                 (double)total_msgs * 1e9 / (double)(elapsed ? elapsed : 1),
+                 hist_percentile( total, 50.0 ),
+                 hist_percentile( total, 99.0 ),
+                 hist_percentile( total, 99.9 ), total->max, rss,
+                 after.ru_nvcsw - before.ru_nvcsw,
+                 after.ru_nivcsw - before.ru_nivcsw );
+
+    free( (void *)total );
+}
+
+/*****************************************************************************
+** config_error - reports an error in the configuration file and exits
+*****************************************************************************/
+static void
+   config_error( const char *filename, int line, const char *what,
+                 const char *token )
+{
+    fprintf( stderr, "%s:%d: %s '%s'\n", filename, line, what, token );
+    exit( 1 );
+}
+
+/*****************************************************************************
+** read_config - reads the scenario from the configuration file
+*****************************************************************************/
+static void
+   read_config( const char *filename )
+{
+    stream_t *stream;
+    char text[MAX_LINE];
+    char *token;
+    char *value;
+    char *end;
+    FILE *file;
+    ULONG number;
+    int line;
+    int kind;
+
+    if ( (file = fopen( filename, "r" )) == (FILE *)NULL )
+    {
+        perror( filename );
+        exit( 1 );
+    }
+
+    for ( line = 1; fgets( text, sizeof( text ), file ) != NULL; line++ )
+    {
+        if ( (token = strchr( text, '#' )) != (char *)NULL )
+            *token = '\0';
+        if ( (token = strtok( text, " \t\r\n" )) == (char *)NULL )
+            continue;
+
+        if ( strcmp( token, "duration" ) == 0 )
+        {
+            if ( ((value = strtok( NULL, " \t\r\n" )) == (char *)NULL) ||
+                 ((duration_secs = strtoul( value, &end, 0 )) == 0L) ||
+                 (*end != '\0') )
+                config_error( filename, line, "bad duration", token );
+            continue;
+        }
+
+        if ( strcmp( token, "cpus" ) == 0 )
+        {
+            ncpu_counts = 0;
+            while ( (value = strtok( NULL, " \t\r\n" )) != (char *)NULL )
+            {
+                if ( ncpu_counts == MAX_CPU_COUNTS )
+                    config_error( filename, line, "too many CPU counts",
+                                  value );
+                if ( strcmp( value, "all" ) == 0 )
+                    cpu_counts[ncpu_counts++] = CPU_COUNT( &all_cpus );
+                else if ( ((number = strtoul( value, &end, 0 )) == 0L) ||
+                          (*end != '\0') )
+                    config_error( filename, line, "bad CPU count", value );
+                else
+                    cpu_counts[ncpu_counts++] = (int)number;
+            }
+            continue;
+        }
+
+        for ( kind = 0; kind_names[kind] != NULL; kind++ )
+        {
+            if ( strcmp( token, kind_names[kind] ) == 0 )
+                break;
+        }
+        if ( kind_names[kind] == NULL )
+            config_error( filename, line, "unknown setting", token );
+        if ( nstreams == MAX_STREAMS )
+            config_error( filename, line, "too many streams", token );
+
+        stream = &streams[nstreams++];
+        stream->kind = kind;
+        stream->count = 1L;
+        stream->producers = 1L;
+        stream->consumers = 1L;
+        stream->rate = 0L;
+        stream->size = 64L;
+        stream->depth = 64L;
+        stream->pprio = 20L;
+        stream->cprio = 20L;
+
+        while ( (token = strtok( NULL, " \t\r\n" )) != (char *)NULL )
+        {
+            if ( ((value = strchr( token, '=' )) == (char *)NULL) )
+                config_error( filename, line, "expected key=value at",
+                              token );
+            *value++ = '\0';
+            number = strtoul( value, &end, 0 );
+            if ( (*value == '\0') || (*end != '\0') )
+                config_error( filename, line, "bad number", value );
+
+            if ( strcmp( token, "count" ) == 0 )
+                stream->count = number;
+            else if ( strcmp( token, "producers" ) == 0 )
+                stream->producers = number;
+            else if ( strcmp( token, "consumers" ) == 0 )
+                stream->consumers = number;
+            else if ( strcmp( token, "rate" ) == 0 )
+                stream->rate = number;
+            else if ( strcmp( token, "size" ) == 0 )
+                stream->size = number;
+            else if ( strcmp( token, "depth" ) == 0 )
+                stream->depth = number;
+            else if ( strcmp( token, "prio" ) == 0 )
+                stream->pprio = stream->cprio = number;
+            else if ( strcmp( token, "pprio" ) == 0 )
+                stream->pprio = number;
+            else if ( strcmp( token, "cprio" ) == 0 )
+                stream->cprio = number;
+            else
+                config_error( filename, line, "unknown key", token );
+        }
+
+        /*
+        **  Every object needs a producer and a consumer, every message
+        **  room for its send time, and every task a priority below that
+        **  of the stop task.
+        */
+        if ( (stream->count == 0L) || (stream->producers == 0L) ||
+             (stream->consumers == 0L) || (stream->depth == 0L) )
+            config_error( filename, line, "zero count in stream",
+                          kind_names[kind] );
+        if ( stream->size < sizeof( ULONG ) )
+            stream->size = sizeof( ULONG );
+        if ( (stream->pprio < 1L) || (stream->pprio > MAX_STREAM_PRIO) ||
+             (stream->cprio < 1L) || (stream->cprio > MAX_STREAM_PRIO) )
+            config_error( filename, line, "priority out of range in stream",
+                          kind_names[kind] );
+        ntasks += stream->count * (stream->producers + stream->consumers);
+        nproducers += stream->count * stream->producers;
+    }
+    fclose( file );
+
+    if ( nstreams == 0 )
+    {
+        fprintf( stderr, "%s: no streams\n", filename );
+        exit( 1 );
+    }
+}
+
+int
+   main( int argc, char **argv )
+{
+    struct utsname host;
+    int max_cpus;
+    int quiet;
+    int opt;
+    int i;
+
+    sched_getaffinity( 0, sizeof( all_cpus ), &all_cpus );
+    max_cpus = CPU_COUNT( &all_cpus );
+    quiet = 0;
+
+    while ( (opt = getopt( argc, argv, "c:q" )) != -1 )
+    {
+        switch ( opt )
+        {
+            case 'c':
+                max_cpus = atoi( optarg );
+                break;
+            case 'q':
+                quiet = 1;
+                break;
+            default:
+                optind = argc;
+                break;
+        }
+    }
+    if ( optind != argc - 1 )
+    {
+        fprintf( stderr, "usage: %s [-c max_cpus] [-q] config_file\n",
+                 argv[0] );
+        exit( 1 );
+    }
+    if ( max_cpus < 1 )
+        max_cpus = 1;
+    if ( max_cpus > CPU_COUNT( &all_cpus ) )
+        max_cpus = CPU_COUNT( &all_cpus );
+
+    read_config( argv[optind] );
+    tasks = (lg_task_t *)calloc( ntasks, sizeof( lg_task_t ) );
+
+    /*
+    **  Unless the configuration says otherwise, 1, 2, 4... CPUs, and
+    **  finally all of them.
+    */
+    if ( ncpu_counts == 0 )
+    {
+        for ( i = 1; i < max_cpus; i *= 2 )
+            cpu_counts[ncpu_counts++] = i;
+        cpu_counts[ncpu_counts++] = max_cpus;
+    }
+
+    uname( &host );
+    printf( "{\"host\":\"%s\",\"machine\":\"%s\",\"kernel\":\"%s\","
+            "\"version\":\"%s\",\"max_cpus\":%d,\"streams\":%d,"
+            "\"tasks\":%lu,\"duration_secs\":%lu}\n",
+            host.nodename, host.machine, host.release, LOADGEN_VERSION,
+            max_cpus, nstreams, ntasks, duration_secs );
+    if ( !quiet )
+        fprintf( stderr, "%2s %-7s %4s %12s %10s %10s %10s %10s %10s\n",
+                 "#", "stream", "cpus", "msgs/sec", "p50 ns", "p99 ns",
+                 "p99.9 ns", "max ns", "full" );
+
+    for ( i = 0; i < ncpu_counts; i++ )
+    {
+        if ( cpu_counts[i] <= max_cpus )
+            run_scenario( cpu_counts[i], quiet );
+    }
+    set_cpus( CPU_COUNT( &all_cpus ) );
+
+    return( 0 );
+}
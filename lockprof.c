@@ -0,0 +1,632 @@
+/*****************************************************************************
+ * lockprof.c - defines the lock profiler, which counts acquisitions and
+ *              contention and times the waits and holds of the mutexes
+ *              used inside p2pthread objects.
+ ****************************************************************************/
+
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <semaphore.h>
+#include "p2pthread.h"
+
+#undef DIAG_PRINTFS
+
+/*****************************************************************************
+**  Contention statistics for one internal mutex, as returned by lk_stats()
+*****************************************************************************/
+typedef struct lk_info
+{
+    const char *
+        obj_class;       /* Class of object owning mutex ("queue", ...) */
+    ULONG
+        objid;           /* ID of object owning mutex (0 for a list) */
+    char
+        objname[4];      /* Name of object owning mutex */
+    const char *
+        lock_name;       /* Name of mutex within object */
+    ULONG
+        acquires;        /* Times mutex was locked */
+    ULONG
+        contended;       /* Times mutex was found already locked */
+    unsigned long long
+        wait_ns;         /* Total nanoseconds spent waiting to lock it */
+    unsigned long long
+        max_wait_ns;     /* Longest wait to lock it */
+    unsigned long long
+        hold_ns;         /* Total nanoseconds it was held */
+    unsigned long long
+        max_hold_ns;     /* Longest time it was held */
+    ULONG
+        cv_waits;        /* Condition variable waits made with it */
+    unsigned long long
+        cv_wait_ns;      /* Total nanoseconds spent in those waits */
+} lk_info_t;
+
+/*****************************************************************************
+**  External function and data references
+*****************************************************************************/
+extern int
+   sim_cond_wait( pthread_cond_t *cond, pthread_mutex_t *mutex,
+                  const struct timespec *timeout );
+extern int
+   sim_cond_wake( pthread_cond_t *cond, int all );
+extern int
+   mn_cond_wait( pthread_cond_t *cond, pthread_mutex_t *mutex,
+                 const struct timespec *timeout );
+extern int
+   mn_cond_wake( pthread_cond_t *cond, int all );
+
+/*****************************************************************************
+**  p2pthread Global Data Structures
+*****************************************************************************/
+
+/*
+**  lock_profiling is tested by lk_lock() and its relatives before timing
+**                 anything
+*/
+static volatile int
+    lock_profiling = 0;
+
+/*
+**  stat_list is a linked list of the statistics of every mutex acquired
+**            while profiling was enabled.  stat_lock serializes access to
+**            it, and is never held while another mutex is acquired.
+*/
+static lk_stat_t *
+    stat_list;
+static pthread_mutex_t
+    stat_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+**  retired_stats collects the statistics of the mutexes of deleted objects,
+**                one entry per object class
+*/
+static lk_stat_t
+    retired_stats[TR_NCLASSES];
+
+/*
+**  start_nsec is CLOCK_MONOTONIC when profiling was last started
+*/
+static unsigned long long
+    start_nsec;
+
+/*
+**  report_sem is posted by the report signal handler to wake report_thread
+*/
+static sem_t
+    report_sem;
+static pthread_t
+    report_thread;
+static int
+    report_started = FALSE;
+
+
+/*****************************************************************************
+** lk_clock - returns CLOCK_MONOTONIC in nanoseconds
+*****************************************************************************/
+static __inline__ unsigned long long
+   lk_clock( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return( (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec );
+}
+
+/*****************************************************************************
+** link_stat - adds the statistics of a mutex to the list of profiled mutexes
+*****************************************************************************/
+static void
+   link_stat( lk_stat_t *stat )
+{
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&stat_lock );
+    pthread_mutex_lock( &stat_lock );
+
+    if ( stat->linked == 0 )
+    {
+        stat->prv_stat = (lk_stat_t *)NULL;
+        stat->nxt_stat = stat_list;
+        if ( stat_list != (lk_stat_t *)NULL )
+            stat_list->prv_stat = stat;
+        stat_list = stat;
+        stat->linked = TRUE;
+    }
+
+    pthread_mutex_unlock( &stat_lock );
+    pthread_cleanup_pop( 0 );
+}
+
+/*****************************************************************************
+** end_hold - adds the time since the mutex was acquired to its hold time
+*****************************************************************************/
+static __inline__ void
+   end_hold( lk_stat_t *stat, unsigned long long now )
+{
+    unsigned long long held;
+
+    held = now - stat->acquired_at;
+    stat->hold_ns += held;
+    if ( held > stat->max_hold_ns )
+        stat->max_hold_ns = held;
+    stat->acquired_at = 0;
+}
+
+/*****************************************************************************
+** clear_stat - zeroes the counts and times of a mutex
+*****************************************************************************/
+static void
+   clear_stat( lk_stat_t *stat )
+{
+    stat->acquires = 0L;
+    stat->contended = 0L;
+    stat->wait_ns = 0;
+    stat->max_wait_ns = 0;
+    stat->hold_ns = 0;
+    stat->max_hold_ns = 0;
+    stat->cv_waits = 0L;
+    stat->cv_wait_ns = 0;
+}
+
+/*****************************************************************************
+** lk_init - names the statistics of a mutex after the object owning it
+*****************************************************************************/
+void
+   lk_init( lk_stat_t *stat, UINT obj_class, ULONG objid, char name[4],
+            const char *lock_name )
+{
+    memset( (void *)stat, 0, sizeof( lk_stat_t ) );
+    stat->obj_class = obj_class;
+    stat->objid = objid;
+    memcpy( stat->objname, name, 4 );
+    stat->lock_name = lock_name;
+}
+
+/*****************************************************************************
+** lk_retire - folds the statistics of a mutex into those of deleted objects
+**             of its class.  Called as the owning object is deleted.
+*****************************************************************************/
+void
+   lk_retire( lk_stat_t *stat )
+{
+    lk_stat_t *retired;
+
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&stat_lock );
+    pthread_mutex_lock( &stat_lock );
+
+    if ( stat->linked == TRUE )
+    {
+        if ( stat->prv_stat != (lk_stat_t *)NULL )
+            stat->prv_stat->nxt_stat = stat->nxt_stat;
+        else
+            stat_list = stat->nxt_stat;
+        if ( stat->nxt_stat != (lk_stat_t *)NULL )
+            stat->nxt_stat->prv_stat = stat->prv_stat;
+
+        retired = &retired_stats[(stat->obj_class >> 8) % TR_NCLASSES];
+        retired->acquires += stat->acquires;
+        retired->contended += stat->contended;
+        retired->wait_ns += stat->wait_ns;
+        if ( stat->max_wait_ns > retired->max_wait_ns )
+            retired->max_wait_ns = stat->max_wait_ns;
+        retired->hold_ns += stat->hold_ns;
+        if ( stat->max_hold_ns > retired->max_hold_ns )
+            retired->max_hold_ns = stat->max_hold_ns;
+        retired->cv_waits += stat->cv_waits;
+        retired->cv_wait_ns += stat->cv_wait_ns;
+    }
+    stat->linked = LK_RETIRED;
+
+    pthread_mutex_unlock( &stat_lock );
+    pthread_cleanup_pop( 0 );
+}
+
+/*****************************************************************************
+** lk_lock - locks an internal mutex, recording whether it was contended
+**           and how long the caller waited for it
+*****************************************************************************/
+int
+   lk_lock( pthread_mutex_t *mutex, lk_stat_t *stat )
+{
+    unsigned long long start, now;
+    unsigned long long waited;
+    int result;
+
+    if ( !lock_profiling )
+        return( pthread_mutex_lock( mutex ) );
+
+    if ( (result = pthread_mutex_trylock( mutex )) == EBUSY )
+    {
+        /*
+        **  Contended... time the wait.
+        */
+        start = lk_clock();
+        if ( (result = pthread_mutex_lock( mutex )) != 0 )
+            return( result );
+        now = lk_clock();
+        waited = now - start;
+        stat->contended++;
+        stat->wait_ns += waited;
+        if ( waited > stat->max_wait_ns )
+            stat->max_wait_ns = waited;
+    }
+    else if ( result == 0 )
+        now = lk_clock();
+    else
+        return( result );
+
+    stat->acquires++;
+    stat->acquired_at = now;
+    if ( stat->linked == 0 )
+        link_stat( stat );
+
+    return( 0 );
+}
+
+/*****************************************************************************
+** lk_unlock - unlocks an internal mutex, recording how long it was held
+*****************************************************************************/
+int
+   lk_unlock( pthread_mutex_t *mutex, lk_stat_t *stat )
+{
+    if ( stat->acquired_at != 0 )
+    {
+        if ( lock_profiling )
+            end_hold( stat, lk_clock() );
+        else
+            stat->acquired_at = 0;
+    }
+
+    return( pthread_mutex_unlock( mutex ) );
+}
+
+/*****************************************************************************
+** lk_wait - waits on a condition variable with an internal mutex, ending
+**           the hold of the mutex for the duration of the wait
+*****************************************************************************/
+int
+   lk_wait( pthread_cond_t *cond, pthread_mutex_t *mutex, lk_stat_t *stat )
+{
+    return( lk_timedwait( cond, mutex, (const struct timespec *)NULL, stat ) );
+}
+
+/*****************************************************************************
+** lk_timedwait - waits on a condition variable with an internal mutex until
+**                the timeout if one is given, ending the hold of the mutex
+**                for the duration of the wait
+*****************************************************************************/
+int
+   lk_timedwait( pthread_cond_t *cond, pthread_mutex_t *mutex,
+                 const struct timespec *timeout, lk_stat_t *stat )
+{
+    unsigned long long start, now;
+    int result;
+
+    start = 0;
+    if ( lock_profiling )
+    {
+        start = lk_clock();
+        if ( stat->acquired_at != 0 )
+            end_hold( stat, start );
+    }
+    else
+        stat->acquired_at = 0;
+
+    if ( sim_mode )
+        result = sim_cond_wait( cond, mutex, timeout );
+    else if ( mn_mode )
+        result = mn_cond_wait( cond, mutex, timeout );
+    else if ( timeout == (const struct timespec *)NULL )
+        result = pthread_cond_wait( cond, mutex );
+    else
+        result = pthread_cond_timedwait( cond, mutex, timeout );
+
+    if ( lock_profiling && (start != 0) )
+    {
+        now = lk_clock();
+        stat->cv_waits++;
+        stat->cv_wait_ns += now - start;
+        stat->acquired_at = now;
+        if ( stat->linked == 0 )
+            link_stat( stat );
+    }
+
+    return( result );
+}
+
+/*****************************************************************************
+** lk_signal - wakes one task waiting on a condition variable used with an
+**             internal mutex.  In simulation mode the waiter may be parked
+**             in the simulator, and in M:N mode it may be a user-space task
+**             context rather than a pthread.
+*****************************************************************************/
+int
+   lk_signal( pthread_cond_t *cond )
+{
+    if ( sim_mode && (sim_cond_wake( cond, FALSE ) != 0) )
+        return( 0 );
+    if ( mn_mode && (mn_cond_wake( cond, FALSE ) != 0) )
+        return( 0 );
+
+    return( pthread_cond_signal( cond ) );
+}
+
+/*****************************************************************************
+** lk_broadcast - wakes every task waiting on a condition variable used with
+**                an internal mutex
+*****************************************************************************/
+int
+   lk_broadcast( pthread_cond_t *cond )
+{
+    if ( sim_mode )
+        sim_cond_wake( cond, TRUE );
+    if ( mn_mode )
+        mn_cond_wake( cond, TRUE );
+
+    return( pthread_cond_broadcast( cond ) );
+}
+
+/*****************************************************************************
+** compare_wait - orders mutexes by decreasing total wait time
+*****************************************************************************/
+static int
+   compare_wait( const void *a, const void *b )
+{
+    const lk_info_t *info_a = (const lk_info_t *)a;
+    const lk_info_t *info_b = (const lk_info_t *)b;
+
+    if ( info_a->wait_ns != info_b->wait_ns )
+        return( (info_a->wait_ns < info_b->wait_ns) ? 1 : -1 );
+    if ( info_a->cv_wait_ns != info_b->cv_wait_ns )
+        return( (info_a->cv_wait_ns < info_b->cv_wait_ns) ? 1 : -1 );
+    return( (info_a->acquires < info_b->acquires) ? 1 :
+            (info_a->acquires > info_b->acquires) ? -1 : 0 );
+}
+
+/*****************************************************************************
+** copy_stat - fills in the caller's view of the statistics of a mutex
+*****************************************************************************/
+static void
+   copy_stat( lk_info_t *info, lk_stat_t *stat )
+{
+    info->obj_class = trace_class_names[(stat->obj_class >> 8) % TR_NCLASSES];
+    info->objid = stat->objid;
+    memcpy( info->objname, stat->objname, 4 );
+    info->lock_name = stat->lock_name;
+    info->acquires = stat->acquires;
+    info->contended = stat->contended;
+    info->wait_ns = stat->wait_ns;
+    info->max_wait_ns = stat->max_wait_ns;
+    info->hold_ns = stat->hold_ns;
+    info->max_hold_ns = stat->max_hold_ns;
+    info->cv_waits = stat->cv_waits;
+    info->cv_wait_ns = stat->cv_wait_ns;
+}
+
+/*****************************************************************************
+** snapshot - returns a malloc'ed copy of the statistics of all profiled
+**            mutexes, longest waits first, and the number of them
+*****************************************************************************/
+static lk_info_t *
+   snapshot( ULONG *count )
+{
+    lk_stat_t *stat;
+    lk_info_t *info;
+    ULONG max_count;
+    int i;
+
+    info = (lk_info_t *)NULL;
+    *count = 0L;
+
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&stat_lock );
+    pthread_mutex_lock( &stat_lock );
+
+    max_count = TR_NCLASSES;
+    for ( stat = stat_list; stat != (lk_stat_t *)NULL; stat = stat->nxt_stat )
+        max_count++;
+
+    if ( (info = (lk_info_t *)malloc( max_count * sizeof( lk_info_t ) ))
+         != (lk_info_t *)NULL )
+    {
+        for ( stat = stat_list; stat != (lk_stat_t *)NULL;
+              stat = stat->nxt_stat )
+        {
+            if ( stat->acquires != 0L )
+                copy_stat( &info[(*count)++], stat );
+        }
+        for ( i = 0; i < TR_NCLASSES; i++ )
+        {
+            if ( retired_stats[i].acquires != 0L )
+                copy_stat( &info[(*count)++], &retired_stats[i] );
+        }
+    }
+
+    pthread_mutex_unlock( &stat_lock );
+    pthread_cleanup_pop( 0 );
+
+    if ( info != (lk_info_t *)NULL )
+        qsort( (void *)info, *count, sizeof( lk_info_t ), compare_wait );
+    return( info );
+}
+
+/*****************************************************************************
+** lk_start - clears the statistics of all mutexes and starts profiling
+*****************************************************************************/
+void
+   lk_start( void )
+{
+    lk_stat_t *stat;
+    int i;
+
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&stat_lock );
+    pthread_mutex_lock( &stat_lock );
+
+    for ( stat = stat_list; stat != (lk_stat_t *)NULL; stat = stat->nxt_stat )
+        clear_stat( stat );
+    for ( i = 0; i < TR_NCLASSES; i++ )
+    {
+        clear_stat( &retired_stats[i] );
+        retired_stats[i].obj_class = i << 8;
+        memcpy( retired_stats[i].objname, "    ", 4 );
+        retired_stats[i].lock_name = "(deleted)";
+    }
+    start_nsec = lk_clock();
+    lock_profiling = TRUE;
+
+    pthread_mutex_unlock( &stat_lock );
+    pthread_cleanup_pop( 0 );
+}
+
+/*****************************************************************************
+** lk_stop - stops profiling, keeping the statistics gathered
+*****************************************************************************/
+void
+   lk_stop( void )
+{
+    lock_profiling = FALSE;
+}
+
+/*****************************************************************************
+** lk_stats - fills in the statistics of up to 'max_locks' mutexes which
+**            were acquired while profiling, those waited on longest first.
+**            Returns the number of entries filled in.
+*****************************************************************************/
+ULONG
+   lk_stats( lk_info_t info[], ULONG max_locks )
+{
+    lk_info_t *all;
+    ULONG count;
+
+    if ( (all = snapshot( &count )) == (lk_info_t *)NULL )
+        return( 0L );
+    if ( count > max_locks )
+        count = max_locks;
+    memcpy( (void *)info, (void *)all, count * sizeof( lk_info_t ) );
+    free( (void *)all );
+
+    return( count );
+}
+
+/*****************************************************************************
+** lk_dump - writes a table of the statistics of all profiled mutexes to
+**           the specified file descriptor, those waited on longest first.
+**           Returns 0, or an errno value if the report cannot be written.
+*****************************************************************************/
+ULONG
+   lk_dump( int fd )
+{
+    lk_info_t *info;
+    ULONG count, i;
+    double ms;
+
+    if ( (info = snapshot( &count )) == (lk_info_t *)NULL )
+        return( (ULONG)ENOMEM );
+
+    ms = 0.0;
+    if ( start_nsec != 0 )
+        ms = (double)(lk_clock() - start_nsec) / 1e6;
+    dprintf( fd, "\nlock profile: %lu mutexes over %.1f ms%s\n", count, ms,
+             lock_profiling ? "" : " (stopped)" );
+    dprintf( fd, "%-9s %6s %-4s %-16s %10s %9s %10s %10s %10s %10s"
+             " %9s %10s\n", "class", "id", "name", "lock", "acquires",
+             "contended", "wait ms", "maxwait us", "hold ms", "maxhold us",
+             "cv waits", "cv wait ms" );
+    for ( i = 0; i < count; i++ )
+    {
+        dprintf( fd, "%-9s %6lu %-4.4s %-16s %10lu %9lu %10.3f %10.1f %10.3f"
+                 " %10.1f %9lu %10.3f\n", info[i].obj_class, info[i].objid,
+                 info[i].objname, info[i].lock_name, info[i].acquires,
+                 info[i].contended, (double)info[i].wait_ns / 1e6,
+                 (double)info[i].max_wait_ns / 1e3,
+                 (double)info[i].hold_ns / 1e6,
+                 (double)info[i].max_hold_ns / 1e3, info[i].cv_waits,
+                 (double)info[i].cv_wait_ns / 1e6 );
+    }
+    free( (void *)info );
+
+    return( ERR_NO_ERROR );
+}
+
+/*****************************************************************************
+** report_on_signal - wakes the report thread.  Only async-signal-safe
+**                    calls may be made here.
+*****************************************************************************/
+static void
+   report_on_signal( int signo )
+{
+    sem_post( &report_sem );
+}
+
+/*****************************************************************************
+** report_task - writes a lock profile report to stderr each time the report
+**               signal arrives
+*****************************************************************************/
+static void *
+   report_task( void *arg )
+{
+    for ( ;; )
+    {
+        while ( sem_wait( &report_sem ) != 0 )
+            ;
+        lk_dump( STDERR_FILENO );
+    }
+    return( (void *)NULL );
+}
+
+/*****************************************************************************
+** lk_dump_on - arranges for a lock profile report to be written to stderr
+**              whenever the process receives the specified signal.
+**              Returns 0, or an errno value if the signal cannot be caught.
+*****************************************************************************/
+ULONG
+   lk_dump_on( int signo )
+{
+    struct sigaction action;
+    ULONG error;
+
+    error = ERR_NO_ERROR;
+
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&stat_lock );
+    pthread_mutex_lock( &stat_lock );
+
+    if ( !report_started )
+    {
+        /*
+        **  The report is written by a thread of its own, since almost
+        **  nothing may safely be called from a signal handler.
+        */
+        sem_init( &report_sem, 0, 0 );
+        if ( pthread_create( &report_thread, (pthread_attr_t *)NULL,
+                             report_task, (void *)NULL ) == 0 )
+        {
+            pthread_detach( report_thread );
+            report_started = TRUE;
+        }
+        else
+            error = (ULONG)EAGAIN;
+    }
+
+    pthread_mutex_unlock( &stat_lock );
+    pthread_cleanup_pop( 0 );
+
+    if ( error == ERR_NO_ERROR )
+    {
+        memset( (void *)&action, 0, sizeof( action ) );
+        action.sa_handler = report_on_signal;
+        action.sa_flags = SA_RESTART;
+        sigemptyset( &action.sa_mask );
+        if ( sigaction( signo, &action, (struct sigaction *)NULL ) != 0 )
+            error = (ULONG)errno;
+    }
+
+    return( error );
+}
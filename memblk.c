@@ -11,11 +11,22 @@
 #include <string.h>
 #include <signal.h>
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include "p2pthread.h"
 
 #undef DIAG_PRINTFS
 
+#define PT_LOCAL     0x00
+#define PT_NODEL     0x00
+#define PT_CHECK     0x00
 #define PT_DEL       0x04
+#define PT_NOCHECK   0x08
+#define PT_GROW      0x20
+#define PT_SHRINK    0x40
+
+#define PT_NODE_SHIFT 16
+#define PT_NODE_MASK (0xFFUL << PT_NODE_SHIFT)
 
 #define ERR_TIMEOUT  0x01
 #define ERR_NODENO   0x04
@@ -29,6 +40,39 @@
 #define ERR_BUFADDR  0x2D
 #define ERR_BUFFREE  0x2F
 
+/*
+**  Each thread caches free blocks for up to PT_CACHE_SLOTS partitions, in
+**  batches of up to PT_CACHE_BATCH blocks.  A cache holds at most two
+**  batches.  Partitions with fewer than PT_CACHE_SHARE blocks per batch
+**  block are too small to strand blocks in caches, and use smaller batches
+**  (or none).
+*/
+#define PT_CACHE_SLOTS  4
+#define PT_CACHE_BATCH  16
+#define PT_CACHE_SHARE  256
+
+/*
+**  Partition memory mapped by the library is split among up to
+**  PT_INIT_THREADS threads, one per PT_INIT_CHUNK bytes, to initialize.
+*/
+#define PT_INIT_THREADS 16
+#define PT_INIT_CHUNK   (64UL << 20)
+
+/*
+**  Default limit on the number of extents a PT_GROW partition may have
+*/
+#define PT_MAX_EXTENTS  16
+
+#define HUGE_2MB        ((size_t)2 << 20)
+#define HUGE_1GB        ((size_t)1 << 30)
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT  26
+#endif
+#ifndef MPOL_BIND
+#define MPOL_BIND       2
+#endif
+
 /*****************************************************************************
 **  p2pthread partition extent type - this is the header for a dynamically 
 **                                    allocated array of contiguous data blocks
@@ -39,8 +83,66 @@ typedef struct prtn_extent
         baddr;           /* Pointer to data block for current extent */
    ULONG 
         bcount;
+    ULONG *
+        alloc_map;       /* One bit per data block, set while allocated */
+    size_t
+        mapped_size;     /* Bytes mapped by the library for data, or 0 */
+    char **
+        first_free;      /* First data block in free list of extent */
+    char **
+        last_free;       /* Last data block in free list of extent */
+    ULONG
+        free_count;      /* Number of blocks in free list of extent */
+    int
+        grown;           /* Nonzero if added when the partition ran dry */
+    int
+        released;        /* Nonzero if memory given back to the system */
+    struct prtn_extent *
+        nxt_avail;       /* Next extent of partition with free blocks */
+    struct prtn_extent *
+        nxt_extent;      /* Next extent of partition, in creation order */
 } prtn_extent_t;
 
+/*****************************************************************************
+**  p2pthread partition extent map - the extents of a partition sorted by
+**                                   address, so the extent holding a block
+**                                   can be found by binary search.  Extents
+**                                   are never removed from the map, so it
+**                                   is replaced only when the partition
+**                                   grows, and searched without locking.
+*****************************************************************************/
+typedef struct extent_map
+{
+    ULONG
+        count;           /* Number of extents in map */
+    struct extent_map *
+        nxt_map;         /* Map this one replaced (freed with partition) */
+    prtn_extent_t *
+        extents[1];      /* Array of count extents, ascending by baddr */
+} extent_map_t;
+
+/*****************************************************************************
+**  Range of data blocks to be initialized by one thread
+*****************************************************************************/
+typedef struct prtn_init_job
+{
+    char *
+        first_blk;       /* First data block in range */
+    ULONG
+        numblks;         /* Number of data blocks in range */
+    ULONG
+        blk_size;        /* Number of bytes per data block */
+    char *
+        next_blk;        /* Block to link after the range (NULL if last) */
+    int
+        clear;           /* Nonzero if the blocks must be cleared */
+} prtn_init_job_t;
+
+/*
+**  Number of data blocks mapped by each word of an allocation bitmap
+*/
+#define MAP_BITS     (sizeof( ULONG ) * 8)
+
 /*****************************************************************************
 **  Control block for p2pthread memory partition
 **
@@ -70,18 +172,17 @@ typedef struct p2pt_partition
         */
     pthread_mutex_t
         prtn_lock;
+    lk_stat_t
+        prtn_lkstat;     /* Contention statistics for prtn_lock */
 
         /*
-        **  Pointer to first data block in free_list for partition
-        */
-    char **
-        first_free;
-
-        /*
-        **  Pointer to last data block in free_list for partition
+        **  Pointers to first and last extents with blocks in their free
+        **  lists.  Blocks are allocated from the first extent.
         */
-    char **
-        last_free;
+    prtn_extent_t *
+        first_avail;
+    prtn_extent_t *
+        last_avail;
 
         /*
         ** Total number of free data blocks in partition
@@ -95,6 +196,14 @@ typedef struct p2pt_partition
     ULONG
         used_blk_count;
 
+        /*
+        ** Number of data blocks held by callers of a PT_NOCHECK partition,
+        ** which has no bitmap to count them from.  Changed atomically,
+        ** since blocks pass through task caches without the prtn_lock.
+        */
+    ULONG
+        held_blk_count;
+
         /*
         ** Number of bytes per allocatable data block
         */
@@ -102,10 +211,48 @@ typedef struct p2pt_partition
         blk_size;
 
         /*
-        **  Pointer to data extent allocated for partition
+        **  List of data extents allocated for partition, in creation order
         */
     prtn_extent_t *
-        data_extent;
+        extent_list;
+
+        /*
+        **  Pointer to map of data extents sorted by address
+        */
+    extent_map_t * volatile
+        extent_map;
+
+        /*
+        **  Number of blocks added to a PT_GROW partition each time it runs
+        **  dry, and the maximum number of extents it may have
+        */
+    ULONG
+        grow_blocks;
+    ULONG
+        max_extents;
+
+        /*
+        **  Serial number of partition, never reused, so task caches can
+        **  tell a partition from a later one with the same ID
+        */
+    ULONG
+        serial;
+
+        /*
+        **  Number of blocks moved between a task cache and the free list
+        **  at a time (zero if blocks are not cached)
+        */
+    ULONG
+        cache_batch;
+
+        /*
+        **  Blocks taken from and returned to the free list since the
+        **  partition was created (in batches, for cached partitions)
+        */
+    ULONG
+        blks_taken;
+    ULONG
+        blks_returned;
 
         /*
         **  Pointer to next partition control block in partition list.
@@ -115,6 +262,21 @@ typedef struct p2pt_partition
 
 } p2pt_prtn_t;
 
+/*****************************************************************************
+**  Per-thread cache of free data blocks for one partition
+*****************************************************************************/
+typedef struct prtn_cache
+{
+    ULONG
+        ptid;            /* ID of partition the cached blocks belong to */
+    ULONG
+        serial;          /* Serial number of that partition (0 if none) */
+    ULONG
+        count;           /* Number of blocks in the cache */
+    char *
+        blocks[2 * PT_CACHE_BATCH];
+} prtn_cache_t;
+
 /*****************************************************************************
 **  External function and data references
 *****************************************************************************/
@@ -122,6 +284,12 @@ extern void *
     ts_malloc( size_t blksize );
 extern void 
     ts_free( void *blkaddr );
+extern void *
+    alloc_object( UINT obj_class, size_t blksize );
+extern void
+    free_object( UINT obj_class, void *block );
+extern int
+    ts_reserve( size_t blksize, ULONG count );
 extern void
    sched_lock( void );
 extern void
@@ -145,6 +313,79 @@ static p2pt_prtn_t *
 */
 static pthread_mutex_t
     prtn_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static lk_stat_t
+    prtn_list_lkstat = LK_STAT_INITIALIZER( TR_PRTN, "prtn_list_lock" );
+
+/*
+**  prtn_serial_count is the serial number of the last partition created
+*/
+static ULONG
+    prtn_serial_count;
+
+/*
+**  prtn_caches holds the calling thread's caches of free data blocks
+*/
+static __thread prtn_cache_t
+    prtn_caches[PT_CACHE_SLOTS];
+
+/*
+**  prtn_cache_key has a destructor which returns an exiting thread's cached
+**                 blocks to their partitions.  prtn_cache_once creates it.
+*/
+static pthread_key_t
+    prtn_cache_key;
+static pthread_once_t
+    prtn_cache_once = PTHREAD_ONCE_INIT;
+
+/*
+**  Each partition in the static configuration table gets its data blocks
+**  and allocation bitmap in static storage.  A block size pt_create() would
+**  reject fails to compile.
+*/
+#define P2PT_PARTITION( id, name, length, bsize, flags ) \
+typedef char id##_bsize_check[(((bsize) % 2) || ((bsize) < 4)) ? -1 : 1]; \
+static ULONG id##_pdata[((length) + sizeof( ULONG ) - 1) / sizeof( ULONG )]; \
+static ULONG id##_pmap[((length) / (bsize) + MAP_BITS - 1) / MAP_BITS + 1];
+#include "p2ptstatic.h"
+
+/*
+**  static_prtns lists the partitions in the static configuration table, and
+**               static_pcbs, static_extents and static_maps hold their
+**               control blocks, extents and extent maps
+*/
+typedef struct static_prtn
+{
+    char
+        name[4];
+    ULONG
+        length;
+    ULONG
+        bsize;
+    ULONG
+        flags;
+    char *
+        data;
+    ULONG *
+        alloc_map;
+} static_prtn_t;
+
+static const static_prtn_t
+    static_prtns[] =
+{
+#define P2PT_PARTITION( id, name, length, bsize, flags ) \
+    { name, (length), (bsize), (flags), (char *)id##_pdata, id##_pmap },
+#include "p2ptstatic.h"
+    { "", 0, 0, 0, (char *)NULL, (ULONG *)NULL }
+};
+
+#define STATIC_PRTNS ((sizeof( static_prtns ) / sizeof( static_prtn_t )) - 1)
+
+static p2pt_prtn_t
+    static_pcbs[STATIC_PRTNS + 1];
+static prtn_extent_t
+    static_extents[STATIC_PRTNS + 1];
+static extent_map_t
+    static_maps[STATIC_PRTNS + 1];
 
 
 /*****************************************************************************
@@ -201,7 +442,7 @@ static ULONG
 
     pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                           (void *)&prtn_list_lock );
-    pthread_mutex_lock( &prtn_list_lock );
+    lk_lock( &prtn_list_lock, &prtn_list_lkstat );
 
     /*
     **  Get the highest previously assigned queue id and add one.
@@ -239,7 +480,7 @@ static ULONG
     /*
     **  Re-enable access to the queue list by other threads.
     */
-    pthread_mutex_unlock( &prtn_list_lock );
+    lk_unlock( &prtn_list_lock, &prtn_list_lkstat );
     pthread_cleanup_pop( 0 );
 
     return( new_prtn_id );
@@ -258,7 +499,7 @@ static void
     */
     pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                           (void *)&prtn_list_lock );
-    pthread_mutex_lock( &prtn_list_lock );
+    lk_lock( &prtn_list_lock, &prtn_list_lkstat );
 
     new_prtn->nxt_prtn = (p2pt_prtn_t *)NULL;
     if ( prtn_list != (p2pt_prtn_t *)NULL )
@@ -296,7 +537,7 @@ static void
     /*
     **  Re-enable access to the partition list by other threads.
     */
-    pthread_mutex_unlock( &prtn_list_lock );
+    lk_unlock( &prtn_list_lock, &prtn_list_lkstat );
     pthread_cleanup_pop( 0 );
 }
 
@@ -319,7 +560,7 @@ static p2pt_prtn_t *
         */
         pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                               (void *)&prtn_list_lock );
-        pthread_mutex_lock( &prtn_list_lock );
+        lk_lock( &prtn_list_lock, &prtn_list_lkstat );
 
         /*
         **  Scan the partition list for a pcb with a matching partition ID
@@ -368,25 +609,372 @@ static p2pt_prtn_t *
         /*
         **  Re-enable access to the partition list by other threads.
         */
-        pthread_mutex_unlock( &prtn_list_lock );
+        lk_unlock( &prtn_list_lock, &prtn_list_lkstat );
         pthread_cleanup_pop( 0 );
     }
 
     return( selected_pcb );
 }
 
+/*****************************************************************************
+** map_prtn_memory - maps 'length' bytes of memory for a partition whose
+**                   caller supplied none.  Hugepages are used if any are
+**                   available (1 GB pages for regions of 1 GB or more, then
+**                   2 MB pages), else ordinary pages advised for transparent
+**                   hugepages.  The memory is bound to the NUMA node given
+**                   by PT_NODE() in the flags, if any, and locked in RAM if
+**                   the process is allowed to.  The mapped size is returned
+**                   in 'mapped_size'.
+*****************************************************************************/
+static char *
+   map_prtn_memory( ULONG length, ULONG flags, size_t *mapped_size )
+{
+    char *region;
+    size_t size;
+    ULONG node;
+    unsigned long nodemask[4];
+
+    region = (char *)MAP_FAILED;
+
+    /*
+    **  Try 1 GB hugepages, then 2 MB hugepages.  The length of a hugepage
+    **  mapping must be a multiple of the hugepage size.
+    */
+    if ( length >= HUGE_1GB )
+    {
+        size = (length + HUGE_1GB - 1) & ~(HUGE_1GB - 1);
+        region = (char *)mmap( (void *)NULL, size, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+                               (30 << MAP_HUGE_SHIFT), -1, 0 );
+    }
+    if ( region == (char *)MAP_FAILED )
+    {
+        size = (length + HUGE_2MB - 1) & ~(HUGE_2MB - 1);
+        region = (char *)mmap( (void *)NULL, size, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+                               (21 << MAP_HUGE_SHIFT), -1, 0 );
+    }
+    if ( region == (char *)MAP_FAILED )
+    {
+        /*
+        **  No hugepages reserved... ask for transparent hugepages instead.
+        */
+        size = (length + getpagesize() - 1) & ~((size_t)getpagesize() - 1);
+        region = (char *)mmap( (void *)NULL, size, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+        if ( region == (char *)MAP_FAILED )
+            return( (char *)NULL );
+        madvise( (void *)region, size, MADV_HUGEPAGE );
+    }
+
+    /*
+    **  Bind the memory to the requested NUMA node before it is touched.
+    */
+    node = (flags & PT_NODE_MASK) >> PT_NODE_SHIFT;
+    if ( node != 0L )
+    {
+        node--;
+        memset( nodemask, 0, sizeof( nodemask ) );
+        if ( node < (sizeof( nodemask ) * 8) )
+        {
+            nodemask[node / (sizeof( unsigned long ) * 8)] |=
+                           1UL << (node % (sizeof( unsigned long ) * 8));
+            syscall( SYS_mbind, region, size, MPOL_BIND, nodemask,
+                     sizeof( nodemask ) * 8 + 1, 0 );
+        }
+    }
+
+    /*
+    **  Lock the memory if RLIMIT_MEMLOCK allows... pages are faulted in
+    **  as the free list is built, so locking is best-effort.
+    */
+    mlock( (void *)region, size );
+
+#ifdef DIAG_PRINTFS 
+    printf( "\r\nmapped %lx bytes @ %p for partition", size, region );
+#endif
+    *mapped_size = size;
+    return( region );
+}
+
+/*****************************************************************************
+** init_blocks - clears (if required) and links one range of data blocks
+**               into the free list.  The last block in the range links to
+**               the first block of the next range.  Run by several threads
+**               at once for large extents, which also faults the pages in
+**               on several CPUs at once.
+*****************************************************************************/
+static void *
+   init_blocks( void *arg )
+{
+    prtn_init_job_t *job;
+    char *block_ptr;
+    char *last_blk;
+    ULONG blk_size;
+
+    job = (prtn_init_job_t *)arg;
+    blk_size = job->blk_size;
+
+    /*
+    **  Clear the data block memory.  Memory mapped by the library is
+    **  already zero.
+    */
+    if ( job->clear )
+        memset( job->first_blk, 0, job->numblks * blk_size );
+
+    /*
+    **  Write a pointer to the next data block into the first few bytes of
+    **  each data block in the range.
+    */
+    last_blk = job->first_blk + (job->numblks - 1) * blk_size;
+    for ( block_ptr = job->first_blk; block_ptr < last_blk;
+          block_ptr += blk_size )
+    {
+        *((char **)block_ptr) = (block_ptr + blk_size);
+#ifdef DIAG_PRINTFS 
+        printf( "\r\n   add prtn_data_block @ %p nxt_blk @ %p",
+                block_ptr, *((char **)block_ptr) );
+#endif
+    }
+    *((char **)last_blk) = job->next_blk;
+
+    return( (void *)NULL );
+}
+
+/*****************************************************************************
+** init_free_list - clears (if required) the data blocks of a new extent and
+**                  links them all into a free list, splitting large extents
+**                  among several threads.
+*****************************************************************************/
+static void
+   init_free_list( char *datablk, ULONG numblks, ULONG blk_size, int clear )
+{
+    prtn_init_job_t jobs[PT_INIT_THREADS];
+    pthread_t workers[PT_INIT_THREADS];
+    int started[PT_INIT_THREADS];
+    ULONG blks_per_job;
+    long nprocs;
+    int njobs;
+    int i;
+
+    /*
+    **  One thread per PT_INIT_CHUNK bytes, up to one per CPU.
+    */
+    njobs = (int)((numblks * blk_size) / PT_INIT_CHUNK);
+    nprocs = sysconf( _SC_NPROCESSORS_ONLN );
+    if ( njobs > nprocs )
+        njobs = (int)nprocs;
+    if ( njobs > PT_INIT_THREADS )
+        njobs = PT_INIT_THREADS;
+    if ( njobs < 1 )
+        njobs = 1;
+
+    blks_per_job = (numblks + njobs - 1) / njobs;
+    for ( i = 0; i < njobs; i++ )
+    {
+        jobs[i].blk_size = blk_size;
+        jobs[i].clear = clear;
+        jobs[i].first_blk = datablk + (i * blks_per_job) * blk_size;
+        jobs[i].numblks = blks_per_job;
+        jobs[i].next_blk = jobs[i].first_blk + blks_per_job * blk_size;
+        if ( i == (njobs - 1) )
+        {
+            jobs[i].numblks = numblks - (i * blks_per_job);
+            jobs[i].next_blk = (char *)NULL;
+        }
+    }
+
+    /*
+    **  Run the first range ourselves, and any others on worker threads.
+    **  A range whose thread cannot be started is done here afterward.
+    */
+    for ( i = 1; i < njobs; i++ )
+        started[i] = (pthread_create( &workers[i], (pthread_attr_t *)NULL,
+                                      init_blocks, (void *)&jobs[i] ) == 0);
+    init_blocks( (void *)&jobs[0] );
+    for ( i = 1; i < njobs; i++ )
+    {
+        if ( started[i] )
+            pthread_join( workers[i], (void **)NULL );
+        else
+            init_blocks( (void *)&jobs[i] );
+    }
+}
+
+/*****************************************************************************
+** free_extent - releases an extent control block along with its allocation
+**               bitmap and any data memory mapped for it by the library.
+*****************************************************************************/
+static void
+   free_extent( prtn_extent_t *extent )
+{
+    if ( extent->alloc_map != (ULONG *)NULL )
+        ts_free( (void *)extent->alloc_map );
+    if ( extent->mapped_size != 0 )
+        munmap( (void *)extent->baddr, extent->mapped_size );
+    ts_free( (void *)extent );
+}
+
+/*****************************************************************************
+** free_prtn_data - releases all of a partition's extents and extent maps
+*****************************************************************************/
+static void
+   free_prtn_data( p2pt_prtn_t *prtn )
+{
+    prtn_extent_t *extent;
+    extent_map_t *map;
+
+    while ( (extent = prtn->extent_list) != (prtn_extent_t *)NULL )
+    {
+        prtn->extent_list = extent->nxt_extent;
+        if ( (extent < static_extents) ||
+             (extent >= &(static_extents[STATIC_PRTNS])) )
+            free_extent( extent );
+    }
+    while ( (map = prtn->extent_map) != (extent_map_t *)NULL )
+    {
+        prtn->extent_map = map->nxt_map;
+        if ( (map < static_maps) || (map >= &(static_maps[STATIC_PRTNS])) )
+            ts_free( (void *)map );
+    }
+}
+
+/*****************************************************************************
+** extent_for - returns the extent of the partition holding the specified
+**              address, or NULL if none does.  Binary searches the extent
+**              map, without locking.
+*****************************************************************************/
+static prtn_extent_t *
+   extent_for( p2pt_prtn_t *prtn, char *blk_ptr )
+{
+    extent_map_t *map;
+    prtn_extent_t *extent;
+    ULONG lo, hi, mid;
+
+    map = prtn->extent_map;
+    if ( map == (extent_map_t *)NULL )
+        return( (prtn_extent_t *)NULL );
+
+    lo = 0;
+    hi = map->count;
+    while ( lo < hi )
+    {
+        mid = (lo + hi) / 2;
+        extent = map->extents[mid];
+        if ( blk_ptr < extent->baddr )
+            hi = mid;
+        else if ( blk_ptr >= (extent->baddr + extent->bcount * prtn->blk_size) )
+            lo = mid + 1;
+        else
+            return( extent );
+    }
+    return( (prtn_extent_t *)NULL );
+}
+
+/*****************************************************************************
+** map_extent - publishes a new extent map with the specified extent added
+**              in address order.  The old map is kept, since tasks may still
+**              be searching it, and freed with the partition.
+*****************************************************************************/
+static ULONG
+   map_extent( p2pt_prtn_t *prtn, prtn_extent_t *extent )
+{
+    extent_map_t *old_map;
+    extent_map_t *new_map;
+    ULONG count;
+    ULONG i, j;
+
+    old_map = prtn->extent_map;
+    count = 0L;
+    if ( old_map != (extent_map_t *)NULL )
+        count = old_map->count;
+
+    new_map = (extent_map_t *)ts_malloc( sizeof( extent_map_t ) +
+                                         count * sizeof( prtn_extent_t * ) );
+    if ( new_map == (extent_map_t *)NULL )
+        return( ERR_OBJTFULL );
+
+    j = 0;
+    for ( i = 0; i < count; i++ )
+    {
+        if ( (j == i) && (extent->baddr < old_map->extents[i]->baddr) )
+            new_map->extents[j++] = extent;
+        new_map->extents[j++] = old_map->extents[i];
+    }
+    if ( j == count )
+        new_map->extents[j] = extent;
+    new_map->count = count + 1;
+    new_map->nxt_map = old_map;
+
+    /*
+    **  Make the new map's contents visible before the map itself.
+    */
+    __sync_synchronize();
+    prtn->extent_map = new_map;
+
+    return( ERR_NO_ERROR );
+}
+
+/*****************************************************************************
+** append_free_list - appends a chain of linked free blocks to the rear of
+**                    the free list of the extent holding them.  An extent
+**                    whose free list was empty joins the partition's list
+**                    of extents with free blocks... at the front if it was
+**                    part of the partition as created, or at the rear if
+**                    it was grown, so grown extents are used last and can
+**                    go idle.
+*****************************************************************************/
+static void
+   append_free_list( p2pt_prtn_t *prtn, prtn_extent_t *extent,
+                     char *first_blk, char *last_blk, ULONG count )
+{
+    if ( extent->free_count == 0L )
+    {
+        /*
+        **  The free list is empty, so last_free is stale (its block is
+        **  allocated) and the chain starts a new list.
+        */
+        extent->first_free = (char **)first_blk;
+        if ( prtn->first_avail == (prtn_extent_t *)NULL )
+        {
+            extent->nxt_avail = (prtn_extent_t *)NULL;
+            prtn->first_avail = extent;
+            prtn->last_avail = extent;
+        }
+        else if ( extent->grown )
+        {
+            extent->nxt_avail = (prtn_extent_t *)NULL;
+            prtn->last_avail->nxt_avail = extent;
+            prtn->last_avail = extent;
+        }
+        else
+        {
+            extent->nxt_avail = prtn->first_avail;
+            prtn->first_avail = extent;
+        }
+    }
+    else
+        *(extent->last_free) = first_blk;
+    extent->last_free = (char **)last_blk;
+    extent->free_count += count;
+    prtn->free_blk_count += count;
+}
+
 /*****************************************************************************
 ** new_extent_for - allocates space for an extent control block, whioh maps
 **                  partition data areas.  Initializes the free block list in
 **                  the data block specified and updates the partition control
 **                  block to reflect the addition of the new data extent to
-**                  the free block and extent lists.
+**                  the free block and extent lists.  'mapped_size' is the size
+**                  of the data block if the library mapped it, else zero.
 *****************************************************************************/
 static prtn_extent_t *
-    new_extent_for( p2pt_prtn_t *prtn, char *datablk, unsigned long numblks )
+    new_extent_for( p2pt_prtn_t *prtn, char *datablk, unsigned long numblks,
+                    size_t mapped_size )
 {
     prtn_extent_t *new_extent;
-    size_t extent_data_size;
+    prtn_extent_t **link;
+    size_t map_size;
     char *block_ptr;
 
     /*
@@ -406,60 +994,71 @@ static prtn_extent_t *
             new_extent->bcount = numblks;
 
             /*
-            **  Clear the data block memory.
+            **  Allocate the bitmap used to check returned blocks, with all
+            **  blocks marked free.  Unchecked partitions need none.
             */
-            extent_data_size = (size_t)(prtn->blk_size * numblks);
-            if ( extent_data_size )
-                memset( datablk, 0, extent_data_size );
+            new_extent->alloc_map = (ULONG *)NULL;
+            if ( !(prtn->flags & PT_NOCHECK) )
+            {
+                map_size = ((numblks + MAP_BITS - 1) / MAP_BITS) *
+                           sizeof( ULONG );
+                if ( map_size == 0 )
+                    map_size = sizeof( ULONG );
+                new_extent->alloc_map = (ULONG *)ts_malloc( map_size );
+                if ( new_extent->alloc_map == (ULONG *)NULL )
+                {
+                    ts_free( (void *)new_extent );
+                    return( (prtn_extent_t *)NULL );
+                }
+                memset( new_extent->alloc_map, 0, map_size );
+            }
 
             /*
-            **  Initialize the free block list for the extent.  The free block
-            **  list is a forward-linked list of pointers to each of the
+            **  Clear the data block memory (unless the library mapped it),
+            **  and initialize the free block list for the extent.  The free
+            **  block list is a forward-linked list of pointers to each of the
             **  unused data blocks in the partition.  The linked list pointers
             **  are kept in the start of the data blocks themselves, and
             **  are overwritten when the blocks are allocated for use.  The
             **  pointer in the last data block is left NULL to terminate
             **  the list.
             */
-            for (block_ptr = datablk;
-                (block_ptr + prtn->blk_size) < (datablk + extent_data_size);
-                 block_ptr += prtn->blk_size )
+            new_extent->mapped_size = mapped_size;
+            block_ptr = (char *)NULL;
+            if ( numblks > 0L )
             {
-                /*
-                **  Write a pointer to the next data block into the
-                **  first few bytes of each data block in the extent.
-                */
-                *((char **)block_ptr) = (block_ptr + prtn->blk_size);
-#ifdef DIAG_PRINTFS 
-
-                printf( "\r\n   add prtn_data_block @ %p nxt_blk @ %p",
-                        block_ptr, *((char **)block_ptr) );
-#endif
+                init_free_list( datablk, numblks, prtn->blk_size,
+                                (mapped_size == 0) );
+                block_ptr = datablk + (numblks - 1) * prtn->blk_size;
             }
-#ifdef DIAG_PRINTFS 
-                printf( "\r\n   add prtn_data_block @ %p nxt_blk @ %p",
-                        block_ptr, *((char **)block_ptr) );
-#endif
-
-            /*
-            **  Link the new extent into the partition control block
-            */
-            prtn->data_extent = new_extent;
-
-            /*
-            **  First data block in this extent is first free block
-            */
-            prtn->first_free = (char **)datablk;
 
             /*
-            **  Last block in new extent is new last_free block
+            **  Link the new extent into the partition's extent map and list.
             */
-            prtn->last_free = (char **)block_ptr;
+            new_extent->first_free = (char **)NULL;
+            new_extent->last_free = (char **)NULL;
+            new_extent->free_count = 0L;
+            new_extent->nxt_avail = (prtn_extent_t *)NULL;
+            new_extent->grown = FALSE;
+            new_extent->released = FALSE;
+            new_extent->nxt_extent = (prtn_extent_t *)NULL;
+            if ( map_extent( prtn, new_extent ) != ERR_NO_ERROR )
+            {
+                if ( new_extent->alloc_map != (ULONG *)NULL )
+                    ts_free( (void *)new_extent->alloc_map );
+                ts_free( (void *)new_extent );
+                return( (prtn_extent_t *)NULL );
+            }
+            for ( link = &(prtn->extent_list); *link != (prtn_extent_t *)NULL;
+                  link = &((*link)->nxt_extent) );
+            *link = new_extent;
 
             /*
-            ** Initialize total number of free data blocks in partition
+            **  Make the extent's blocks available for allocation.
             */
-            prtn->free_blk_count = new_extent->bcount;
+            if ( numblks > 0L )
+                append_free_list( prtn, new_extent, datablk, block_ptr,
+                                  numblks );
         }
         else
         {
@@ -471,23 +1070,509 @@ static prtn_extent_t *
 }
 
 /*****************************************************************************
-** pt_create - creates a new memory management area from which fixed-size
-**             data blocks may be allocated for applications use.
+** grow_prtn - adds blocks to a partition whose free list is empty.  An
+**             extent released earlier is reused if there is one, otherwise
+**             a PT_GROW partition below its extent limit gets a new extent
+**             the size of its first.  The caller must hold the prtn_lock.
 *****************************************************************************/
-ULONG
-    pt_create( char name[4], void *paddr, void *laddr, ULONG length,
-               ULONG bsize, ULONG flags, ULONG *ptid, ULONG *nbuf )
+static void
+   grow_prtn( p2pt_prtn_t *prtn )
+{
+    extent_map_t *map;
+    prtn_extent_t *extent;
+    size_t mapped_size;
+    char *datablk;
+    ULONG i;
+
+    map = prtn->extent_map;
+    for ( i = 0; i < map->count; i++ )
+    {
+        extent = map->extents[i];
+        if ( extent->released )
+        {
+            /*
+            **  Take the memory back from the system and relink its blocks.
+            **  The pages come back zeroed, so need not be cleared.
+            */
+            mlock( (void *)extent->baddr, extent->mapped_size );
+            init_free_list( extent->baddr, extent->bcount, prtn->blk_size, 0 );
+            extent->released = FALSE;
+            append_free_list( prtn, extent, extent->baddr,
+                              extent->baddr +
+                              (extent->bcount - 1) * prtn->blk_size,
+                              extent->bcount );
+#ifdef DIAG_PRINTFS 
+            printf( "\r\nreused extent @ %p for partition %ld",
+                    extent->baddr, prtn->prtn_id );
+#endif
+            return;
+        }
+    }
+
+    if ( !(prtn->flags & PT_GROW) || (map->count >= prtn->max_extents) ||
+         (prtn->grow_blocks == 0L) )
+        return;
+
+    datablk = map_prtn_memory( prtn->grow_blocks * prtn->blk_size,
+                               prtn->flags, &mapped_size );
+    if ( datablk != (char *)NULL )
+    {
+        extent = new_extent_for( prtn, datablk, prtn->grow_blocks,
+                                 mapped_size );
+        if ( extent != (prtn_extent_t *)NULL )
+            extent->grown = TRUE;
+        else
+            munmap( (void *)datablk, mapped_size );
+#ifdef DIAG_PRINTFS 
+        printf( "\r\ngrew partition %ld by extent @ %p", prtn->prtn_id,
+                datablk );
+#endif
+    }
+}
+
+/*****************************************************************************
+** release_extent - takes an idle grown extent off the list of extents with
+**                  free blocks and gives its memory back to the system.
+**                  The extent stays in the extent map (so searches need no
+**                  locking), and is reused the next time the partition
+**                  runs dry.  The caller must hold the prtn_lock.
+*****************************************************************************/
+static void
+   release_extent( p2pt_prtn_t *prtn, prtn_extent_t *extent )
+{
+    prtn_extent_t **link;
+    prtn_extent_t *prv_extent;
+
+    /*
+    **  Unlink the extent from the list of extents with free blocks.  The
+    **  list holds at most one entry per extent, not per block.
+    */
+    prv_extent = (prtn_extent_t *)NULL;
+    for ( link = &(prtn->first_avail); *link != extent;
+          link = &((*link)->nxt_avail) )
+        prv_extent = *link;
+    *link = extent->nxt_avail;
+    if ( prtn->last_avail == extent )
+        prtn->last_avail = prv_extent;
+
+    prtn->free_blk_count -= extent->free_count;
+    extent->free_count = 0L;
+    extent->released = TRUE;
+
+    munlock( (void *)extent->baddr, extent->mapped_size );
+    madvise( (void *)extent->baddr, extent->mapped_size, MADV_DONTNEED );
+#ifdef DIAG_PRINTFS 
+    printf( "\r\nreleased extent @ %p of partition %ld", extent->baddr,
+            prtn->prtn_id );
+#endif
+}
+
+/*****************************************************************************
+** take_free_blocks - removes up to 'count' blocks from the front of the
+**                    partition's free list into the 'blocks' array,
+**                    growing the partition first if the list is empty.
+**                    Returns the number of blocks taken.
+**                    The caller must hold the prtn_lock.
+*****************************************************************************/
+static ULONG
+   take_free_blocks( p2pt_prtn_t *prtn, char **blocks, ULONG count )
+{
+    prtn_extent_t *extent;
+    char *blk_ptr;
+    ULONG taken;
+
+    if ( prtn->first_avail == (prtn_extent_t *)NULL )
+        grow_prtn( prtn );
+
+    for ( taken = 0; taken < count; taken++ )
+    {
+        /*
+        **  Each free data block contains a pointer to the next free data
+        **  block in the extent.  This pointer is a pointer to a char
+        **  as well as a pointer to a pointer to a char, since it is the
+        **  address of both the next block and the next link pointer.
+        **  Data blocks are always allocated from the front of the free list
+        **  of the first extent which has any.
+        */
+        extent = prtn->first_avail;
+        if ( extent == (prtn_extent_t *)NULL )
+            break;
+        blk_ptr = (char *)extent->first_free;
+        extent->first_free = *((char ***)blk_ptr);
+        blocks[taken] = blk_ptr;
+        if ( --(extent->free_count) == 0L )
+        {
+            prtn->first_avail = extent->nxt_avail;
+            if ( prtn->first_avail == (prtn_extent_t *)NULL )
+                prtn->last_avail = (prtn_extent_t *)NULL;
+        }
+#ifdef DIAG_PRINTFS 
+        printf( "\r\ntake_free_blocks block @ %p from partition %ld",
+                blk_ptr, prtn->prtn_id );
+#endif
+    }
+
+    /*
+    **  Adjust the block counters to reflect the blocks just taken.
+    */
+    prtn->free_blk_count -= taken;
+    prtn->used_blk_count += taken;
+    prtn->blks_taken += taken;
+
+    return( taken );
+}
+
+/*****************************************************************************
+** put_free_blocks - appends 'count' blocks from the 'blocks' array to the
+**                   rear of the free lists of their extents, ensuring an
+**                   even distribution of use for the blocks in each extent.
+**                   For PT_SHRINK partitions, a grown extent whose blocks
+**                   are now all free is released, as long as at least as
+**                   many free blocks remain in the rest of the partition.
+**                   The caller must hold the prtn_lock.
+*****************************************************************************/
+static void
+   put_free_blocks( p2pt_prtn_t *prtn, char **blocks, ULONG count )
+{
+    prtn_extent_t *extent;
+    char *blk_ptr;
+    ULONG i;
+
+    for ( i = 0; i < count; i++ )
+    {
+        /*
+        **  Insert a list-terminating NULL pointer into the block being
+        **  freed up, then link it after the last free block of its extent.
+        */
+        blk_ptr = blocks[i];
+        *(char **)blk_ptr = (char *)NULL;
+        extent = extent_for( prtn, blk_ptr );
+        append_free_list( prtn, extent, blk_ptr, blk_ptr, 1L );
+#ifdef DIAG_PRINTFS 
+        printf( "\r\nput_free_blocks block @ %p to partition %ld",
+                blk_ptr, prtn->prtn_id );
+#endif
+
+        /*
+        **  Adjust the block counters to reflect the block just released.
+        */
+        prtn->used_blk_count--;
+        prtn->blks_returned++;
+
+        if ( (prtn->flags & PT_SHRINK) && extent->grown &&
+             (extent->free_count == extent->bcount) &&
+             (prtn->free_blk_count >= (2 * extent->bcount)) )
+            release_extent( prtn, extent );
+    }
+}
+
+/*****************************************************************************
+** mark_allocated - sets the bit for a block in the extent's allocation
+**                  bitmap, or counts the block as held if the partition
+**                  has no bitmap.  Atomic, since blocks are handed out from
+**                  task caches without the prtn_lock.
+*****************************************************************************/
+static void
+   mark_allocated( p2pt_prtn_t *prtn, prtn_extent_t *extent, char *blk_ptr )
+{
+    ULONG blk_index;
+
+    if ( extent->alloc_map != (ULONG *)NULL )
+    {
+        blk_index = (ULONG)(blk_ptr - extent->baddr) / prtn->blk_size;
+        __sync_fetch_and_or( &(extent->alloc_map[blk_index / MAP_BITS]),
+                             (1UL << (blk_index % MAP_BITS)) );
+    }
+    else
+        __sync_fetch_and_add( &(prtn->held_blk_count), 1 );
+}
+
+/*****************************************************************************
+** mark_free - clears the bit for a block in the extent's allocation bitmap,
+**             or stops counting the block as held if the partition has no
+**             bitmap.  Returns ERR_BUFFREE if the block was not allocated.
+*****************************************************************************/
+static ULONG
+   mark_free( p2pt_prtn_t *prtn, prtn_extent_t *extent, char *blk_ptr )
+{
+    ULONG blk_index;
+    ULONG blk_bit;
+    ULONG old_map;
+
+    if ( extent->alloc_map != (ULONG *)NULL )
+    {
+        blk_index = (ULONG)(blk_ptr - extent->baddr) / prtn->blk_size;
+        blk_bit = 1UL << (blk_index % MAP_BITS);
+        old_map = __sync_fetch_and_and(
+                              &(extent->alloc_map[blk_index / MAP_BITS]),
+                              ~blk_bit );
+        if ( !(old_map & blk_bit) )
+            return( ERR_BUFFREE );
+    }
+    else
+        __sync_fetch_and_sub( &(prtn->held_blk_count), 1 );
+    return( ERR_NO_ERROR );
+}
+
+/*****************************************************************************
+** blocks_in_use - returns the number of the partition's blocks held by
+**                 callers.  Blocks in task caches are free in the bitmap,
+**                 and are not counted as held by partitions without one.
+**                 The caller must hold the prtn_lock.
+*****************************************************************************/
+static ULONG
+   blocks_in_use( p2pt_prtn_t *prtn )
+{
+    prtn_extent_t *extent;
+    ULONG in_use;
+    ULONG i;
+
+    if ( prtn->flags & PT_NOCHECK )
+        return( prtn->held_blk_count );
+
+    in_use = 0;
+    for ( extent = prtn->extent_list; extent != (prtn_extent_t *)NULL;
+          extent = extent->nxt_extent )
+    {
+        for ( i = 0; i < (extent->bcount + MAP_BITS - 1) / MAP_BITS; i++ )
+            in_use += __builtin_popcountl( extent->alloc_map[i] );
+    }
+    return( in_use );
+}
+
+/*****************************************************************************
+** flush_cache - returns the 'count' least recently cached blocks from a task
+**               cache to the free list of the partition they came from, all
+**               under one acquisition of the prtn_lock.  If that partition
+**               has been deleted, the blocks are simply dropped.
+*****************************************************************************/
+static void
+   flush_cache( prtn_cache_t *cache, ULONG count )
 {
     p2pt_prtn_t *prtn;
-    ULONG error;
+    ULONG i;
+
+    prtn = pcb_for( cache->ptid );
+    if ( (prtn != (p2pt_prtn_t *)NULL) && (prtn->serial == cache->serial) )
+    {
+        pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                              (void *)&(prtn->prtn_lock));
+        lk_lock( &(prtn->prtn_lock), &(prtn->prtn_lkstat) );
+        put_free_blocks( prtn, cache->blocks, count );
+        lk_unlock( &(prtn->prtn_lock), &(prtn->prtn_lkstat) );
+        pthread_cleanup_pop( 0 );
+    }
+
+    /*
+    **  Slide the remaining (most recently cached) blocks down.
+    */
+    for ( i = count; i < cache->count; i++ )
+        cache->blocks[i - count] = cache->blocks[i];
+    cache->count -= count;
+}
+
+/*****************************************************************************
+** flush_caches - returns all blocks in the exiting thread's caches to their
+**                partitions.  Called as the destructor of prtn_cache_key.
+*****************************************************************************/
+static void
+   flush_caches( void *caches )
+{
+    prtn_cache_t *cache;
+    int i;
+
+    for ( i = 0; i < PT_CACHE_SLOTS; i++ )
+    {
+        cache = &(((prtn_cache_t *)caches)[i]);
+        if ( cache->count > 0 )
+            flush_cache( cache, cache->count );
+        cache->serial = 0L;
+    }
+}
+
+/*****************************************************************************
+** create_cache_key - creates the key whose destructor flushes the caches of
+**                    an exiting thread
+*****************************************************************************/
+static void
+   create_cache_key( void )
+{
+    pthread_key_create( &prtn_cache_key, flush_caches );
+}
+
+/*****************************************************************************
+** cache_for - returns the calling thread's cache for the specified partition.
+**             A cache slot holding blocks of another partition is flushed
+**             and taken over.
+*****************************************************************************/
+static prtn_cache_t *
+   cache_for( p2pt_prtn_t *prtn )
+{
+    prtn_cache_t *cache;
+
+    cache = &(prtn_caches[prtn->prtn_id % PT_CACHE_SLOTS]);
+    if ( cache->serial != prtn->serial )
+    {
+        if ( cache->count > 0 )
+            flush_cache( cache, cache->count );
+        cache->ptid = prtn->prtn_id;
+        cache->serial = prtn->serial;
+        cache->count = 0L;
+
+        /*
+        **  Make sure the caches get flushed when this thread exits.
+        */
+        pthread_once( &prtn_cache_once, create_cache_key );
+        if ( pthread_getspecific( prtn_cache_key ) == (void *)NULL )
+            pthread_setspecific( prtn_cache_key, (void *)prtn_caches );
+    }
+    return( cache );
+}
+
+/*****************************************************************************
+** init_pcb - initializes the name, serial number and lock of a partition
+**            control block whose first extent has been added
+*****************************************************************************/
+static void
+   init_pcb( p2pt_prtn_t *prtn, const char name[4] )
+{
     int i;
 
+    /*
+    **  Name for partition
+    */
+    for ( i = 0; i < 4; i++ )
+        prtn->ptname[i] = name[i];
+
+    /*
+    **  Serial number, and batch size for task caches.  Small
+    **  partitions use small batches so caches cannot strand much
+    **  of the partition.
+    */
+    prtn->serial = __sync_add_and_fetch( &prtn_serial_count, 1 );
+    prtn->cache_batch = prtn->free_blk_count / PT_CACHE_SHARE;
+    if ( prtn->cache_batch > PT_CACHE_BATCH )
+        prtn->cache_batch = PT_CACHE_BATCH;
+    prtn->blks_taken = 0;
+    prtn->blks_returned = 0;
+    prtn->held_blk_count = 0;
+
+    /*
+    ** Mutex for partition get/release block
+    */
+    pthread_mutex_init( &(prtn->prtn_lock),
+                        (pthread_mutexattr_t *)NULL );
+    lk_init( &(prtn->prtn_lkstat), TR_PRTN, prtn->prtn_id,
+             prtn->ptname, "prtn_lock" );
+}
+
+/*****************************************************************************
+** create_static_prtns - initializes the partitions in the static
+**                       configuration table, links their free blocks and
+**                       links them into the partition list, in ID order,
+**                       before main() is called.
+*****************************************************************************/
+static void __attribute__(( constructor ))
+   create_static_prtns( void )
+{
+    const static_prtn_t *entry;
+    p2pt_prtn_t *prtn;
+    prtn_extent_t *extent;
+    extent_map_t *map;
+    ULONG numblks;
+    ULONG i;
+
+    for ( i = 0; i < STATIC_PRTNS; i++ )
+    {
+        entry = &(static_prtns[i]);
+        prtn = &(static_pcbs[i]);
+        extent = &(static_extents[i]);
+        map = &(static_maps[i]);
+        numblks = entry->length / entry->bsize;
+
+        prtn->prtn_id = i + 1;
+        prtn->flags = entry->flags;
+        prtn->blk_size = entry->bsize;
+        prtn->used_blk_count = 0L;
+        prtn->first_avail = (prtn_extent_t *)NULL;
+        prtn->last_avail = (prtn_extent_t *)NULL;
+        prtn->free_blk_count = 0L;
+        prtn->grow_blocks = numblks;
+        prtn->max_extents = PT_MAX_EXTENTS;
+
+        /*
+        **  The single extent covers the static data, which is already
+        **  zero, and is the only entry in the extent map.
+        */
+        extent->baddr = entry->data;
+        extent->bcount = numblks;
+        extent->alloc_map = (ULONG *)NULL;
+        if ( !(entry->flags & PT_NOCHECK) )
+            extent->alloc_map = entry->alloc_map;
+        extent->mapped_size = 0;
+        extent->first_free = (char **)NULL;
+        extent->last_free = (char **)NULL;
+        extent->free_count = 0L;
+        extent->nxt_avail = (prtn_extent_t *)NULL;
+        extent->grown = FALSE;
+        extent->released = FALSE;
+        extent->nxt_extent = (prtn_extent_t *)NULL;
+        map->count = 1L;
+        map->nxt_map = (extent_map_t *)NULL;
+        map->extents[0] = extent;
+        prtn->extent_list = extent;
+        prtn->extent_map = map;
+        if ( numblks > 0L )
+        {
+            init_free_list( entry->data, numblks, entry->bsize, 0 );
+            append_free_list( prtn, extent, entry->data,
+                              entry->data + (numblks - 1) * entry->bsize,
+                              numblks );
+        }
+
+        init_pcb( prtn, entry->name );
+        prtn->nxt_prtn = (p2pt_prtn_t *)NULL;
+        if ( i > 0 )
+            static_pcbs[i - 1].nxt_prtn = prtn;
+    }
+
+    if ( STATIC_PRTNS > 0 )
+        prtn_list = &(static_pcbs[0]);
+}
+
+/*****************************************************************************
+** reserve_pcbs - carves storage for the control blocks of 'count' partitions
+**                and of their first extents in advance
+*****************************************************************************/
+int
+   reserve_pcbs( ULONG count )
+{
+    int error;
+
+    error = ts_reserve( sizeof( p2pt_prtn_t ), count );
+    if ( error == 0 )
+        error = ts_reserve( sizeof( prtn_extent_t ), count );
+    return( error );
+}
+
+/*****************************************************************************
+** pt_create - creates a new memory management area from which fixed-size
+**             data blocks may be allocated for applications use.
+*****************************************************************************/
+ULONG
+    pt_create( char name[4], void *paddr, void *laddr, ULONG length,
+               ULONG bsize, ULONG flags, ULONG *ptid, ULONG *nbuf )
+{
+    p2pt_prtn_t *prtn;
+    size_t mapped_size;
+    ULONG error;
+
     error = ERR_NO_ERROR;
 
     /*
     **  First allocate memory for the partition control block.
     */
-    prtn = (p2pt_prtn_t *)ts_malloc( sizeof( p2pt_prtn_t ) );
+    prtn = (p2pt_prtn_t *)alloc_object( TR_PRTN, sizeof( p2pt_prtn_t ) );
     if ( prtn != (p2pt_prtn_t *)NULL )
     {
         /*
@@ -501,41 +1586,53 @@ ULONG
         prtn->used_blk_count = 0L;
 
         /*
-        **  Pointer to data extent for partition
+        **  Data extents for partition, and its (empty) free list
         */
-        prtn->data_extent = (prtn_extent_t *)NULL;
+        prtn->extent_list = (prtn_extent_t *)NULL;
+        prtn->extent_map = (extent_map_t *)NULL;
+        prtn->first_avail = (prtn_extent_t *)NULL;
+        prtn->last_avail = (prtn_extent_t *)NULL;
+        prtn->free_blk_count = 0L;
+
+        prtn->max_extents = PT_MAX_EXTENTS;
 
         /*
-        ** Total data blocks per memory allocation block (extent)
+        ** Total data blocks per memory allocation block (extent).
+        ** A PT_GROW partition grows by the size of its first extent.
         */
         if ( (bsize % 2) || (bsize < 4) )
             error = ERR_BUFSIZE;
+        else
+            prtn->grow_blocks = length / bsize;
         prtn->blk_size = bsize;
 
-        if ( new_extent_for( prtn, paddr, (length / bsize) ) !=
-             (prtn_extent_t *)NULL )
+        /*
+        ** Option Flags for partition
+        */
+        prtn->flags = flags;
+
+        /*
+        **  If the caller supplied no memory for the partition, map it.
+        */
+        mapped_size = 0;
+        if ( (paddr == (void *)NULL) && (error == ERR_NO_ERROR) )
+            paddr = (void *)map_prtn_memory( length, flags, &mapped_size );
+
+        /*
+        **  A rejected block size is not used to carve the caller's memory,
+        **  since blocks smaller than a free list link would overrun it.
+        */
+        if ( (error == ERR_NO_ERROR) &&
+             (new_extent_for( prtn, paddr, (length / bsize), mapped_size ) !=
+              (prtn_extent_t *)NULL) )
         {
             /*
             ** ID for partition
             */
             prtn->prtn_id = new_prtn_id();
             
-            /*
-            **  Name for partition
-            */
-            for ( i = 0; i < 4; i++ )
-                prtn->ptname[i] = name[i];
-
-            /*
-            ** Option Flags for partition
-            */
-            prtn->flags = flags;
+            init_pcb( prtn, name );
 
-            /*
-            ** Mutex for partition get/release block
-            */
-            pthread_mutex_init( &(prtn->prtn_lock),
-                                (pthread_mutexattr_t *)NULL );
             /*
             **  If no errors thus far, we have a new partition ready to link
             **  into the partition list.
@@ -559,6 +1656,8 @@ ULONG
                 */
                 if ( nbuf != (ULONG *)NULL )
                     *nbuf = prtn->free_blk_count;
+
+                TRACE( TR_PRTN | TR_CREATE, prtn->prtn_id, prtn->blk_size );
             }
             else
             {
@@ -566,8 +1665,8 @@ ULONG
                 **  Oops!  Problem somewhere above.  Release control block
                 **  and data memory and return.
                 */
-                ts_free( (void *)prtn->data_extent );
-                ts_free( (void *)prtn );
+                free_prtn_data( prtn );
+                free_object( TR_PRTN, (void *)prtn );
             }
         }
         else
@@ -575,8 +1674,11 @@ ULONG
             /*
             **  No memory for partition data... free partition control block
             */
-            ts_free( (void *)prtn );
-            error = ERR_OBJTFULL;
+            if ( mapped_size != 0 )
+                munmap( paddr, mapped_size );
+            free_object( TR_PRTN, (void *)prtn );
+            if ( error == ERR_NO_ERROR )
+                error = ERR_OBJTFULL;
         }
     }
     else
@@ -600,14 +1702,23 @@ static void
     unlink_pcb( prtn->prtn_id );
 
     /*
-    **  Next delete the extent control block allocated for partition data.
+    **  Fold the statistics of the partition's mutex into those of deleted
+    **  partitions.
+    */
+    lk_retire( &(prtn->prtn_lkstat) );
+
+    /*
+    **  Next delete the extent control blocks allocated for partition data,
+    **  along with their allocation bitmaps and any memory mapped for them.
     */
-    ts_free( (void *)prtn->data_extent );
+    free_prtn_data( prtn );
 
     /*
-    **  Finally delete the partition control block itself;
+    **  Finally delete the partition control block itself, unless it is one
+    **  of those in the static configuration table.
     */
-    ts_free( (void *)prtn );
+    if ( (prtn < static_pcbs) || (prtn >= &(static_pcbs[STATIC_PRTNS])) )
+        free_object( TR_PRTN, (void *)prtn );
 
 }
 
@@ -620,19 +1731,26 @@ ULONG
     pt_delete( ULONG ptid )
 {
     p2pt_prtn_t *prtn;
+    prtn_cache_t *cache;
     ULONG error;
 
     error = ERR_NO_ERROR;
 
     if ( (prtn = pcb_for( ptid )) != (p2pt_prtn_t *)NULL )
     {
+        /*
+        **  Return any blocks in our own cache to the partition.
+        */
+        cache = &(prtn_caches[prtn->prtn_id % PT_CACHE_SLOTS]);
+        if ( (cache->serial == prtn->serial) && (cache->count > 0L) )
+            flush_cache( cache, cache->count );
 
         /*
         ** Lock mutex for partition delete
         */
         pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                               (void *)&(prtn->prtn_lock));
-        pthread_mutex_lock( &(prtn->prtn_lock) );
+        lk_lock( &(prtn->prtn_lock), &(prtn->prtn_lkstat) );
 
         if ( prtn->flags & PT_DEL )
         {
@@ -653,14 +1771,14 @@ ULONG
             **  Ensure that none of the partition's buffers are allocated.
             */
             sched_lock();
-            if ( prtn->used_blk_count > 0L ) 
+            if ( blocks_in_use( prtn ) > 0L ) 
             {
                 error = ERR_BUFINUSE;
 
                 /*
                 **  Unlock the mutex for the condition variable
                 */
-                pthread_mutex_unlock( &(prtn->prtn_lock) );
+                lk_unlock( &(prtn->prtn_lock), &(prtn->prtn_lkstat) );
             }
             else
             {
@@ -674,6 +1792,9 @@ ULONG
         }
 
         pthread_cleanup_pop( 0 );
+
+        if ( error == ERR_NO_ERROR )
+            TRACE( TR_PRTN | TR_DELETE, ptid, 0 );
     }
     else
     {
@@ -685,57 +1806,68 @@ ULONG
 
 /*****************************************************************************
 ** pt_getbuf - obtains a free data buffer from the specified memory partition
+**             Buffers are taken from the calling thread's cache for the
+**             partition when it has any, with no locking.  An empty cache is
+**             refilled with a batch of blocks under one acquisition of the
+**             prtn_lock.
 *****************************************************************************/
 ULONG
     pt_getbuf( ULONG ptid, void **bufaddr )
 {
     p2pt_prtn_t *prtn;
+    prtn_cache_t *cache;
     char *blk_ptr;
     ULONG error;
 
     error = ERR_NO_ERROR;
+    blk_ptr = (char *)NULL;
 
     if ( (prtn = pcb_for( ptid )) != (p2pt_prtn_t *)NULL )
     {
-        /*
-        ** Lock mutex for partition block allocation
-        */
-        pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
-                              (void *)&(prtn->prtn_lock));
-        pthread_mutex_lock( &(prtn->prtn_lock) );
-
-        /*
-        **  Each free data block contains a pointer to the next free data
-        **  block in the partition.  This pointer is a pointer to a char
-        **  as well as a pointer to a pointer to a char, since it is the
-        **  address of both the next block and the next link pointer.
-        **  The caller wants the address of a data block, so cast the
-        **  first_free pointer to point to the first free data block
-        **  and give that block to the caller.  NOTE that if the free list
-        **  is empty, blk_ptr will be returned as a NULL pointer.
-        */
-        blk_ptr = (char *)prtn->first_free;
+        cache = (prtn_cache_t *)NULL;
+        if ( prtn->cache_batch > 0L )
+        {
+            cache = cache_for( prtn );
+            if ( cache->count > 0L )
+                blk_ptr = cache->blocks[--(cache->count)];
+        }
 
-        if ( blk_ptr != (char *)NULL )
+        if ( blk_ptr == (char *)NULL )
         {
             /*
-            **  Take the contents of the first free data block and interpret
-            **  its first bytes as the address of the link pointer in the
-            **  following data block.  This address becomes the new value for
-            **  the first_free pointer for the partition.  This means data
-            **  blocks are always allocated from the front of the free list.
+            ** Lock mutex for partition block allocation
             */
-            prtn->first_free = *((char ***)blk_ptr);
+            pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                                  (void *)&(prtn->prtn_lock));
+            lk_lock( &(prtn->prtn_lock), &(prtn->prtn_lkstat) );
+
+            if ( cache != (prtn_cache_t *)NULL )
+            {
+                /*
+                **  Refill the cache with a batch of blocks and take one.
+                */
+                cache->count = take_free_blocks( prtn, cache->blocks,
+                                                 prtn->cache_batch );
+                if ( cache->count > 0L )
+                    blk_ptr = cache->blocks[--(cache->count)];
+            }
+            else
+                take_free_blocks( prtn, &blk_ptr, 1L );
 
             /*
-            **  Adjust the block counters to reflect the fact that another
-            **  block was just allocated.
+            **  Unlock the mutex for the condition variable and clean up.
             */
-            prtn->free_blk_count--;
-            prtn->used_blk_count++;
+            lk_unlock( &(prtn->prtn_lock), &(prtn->prtn_lkstat) );
+            pthread_cleanup_pop( 0 );
+        }
+
+        if ( blk_ptr != (char *)NULL )
+        {
+            mark_allocated( prtn, extent_for( prtn, blk_ptr ), blk_ptr );
+            TRACE( TR_PRTN | TR_RECEIVE, ptid, (ULONG)blk_ptr );
 #ifdef DIAG_PRINTFS 
-            printf( "\r\npt_getbuf allocated block @ %p from partition %ld nxt_blk @ %p",
-                    blk_ptr, ptid, *((char **)blk_ptr) );
+            printf( "\r\npt_getbuf allocated block @ %p from partition %ld",
+                    blk_ptr, ptid );
 #endif
         }
         else
@@ -745,16 +1877,9 @@ ULONG
             printf( "\r\npt_getbuf - no blocks free in partition %ld", ptid );
 #endif
         }
-
-        /*
-        **  Unlock the mutex for the condition variable and clean up.
-        */
-        pthread_mutex_unlock( &(prtn->prtn_lock) );
-        pthread_cleanup_pop( 0 );
     }
     else
     {
-        blk_ptr = (char *)NULL;
         error = ERR_OBJDEL;       /* Invalid prtn specified */
 #ifdef DIAG_PRINTFS 
             printf( "\r\npt_getbuf - partition %ld not found", ptid );
@@ -773,13 +1898,17 @@ ULONG
 
 /*****************************************************************************
 ** pt_retbuf - releases a data buffer back to the specified memory partition
+**             Buffers go into the calling thread's cache for the partition
+**             with no locking.  A full cache first returns a batch of its
+**             oldest blocks to the free list under one acquisition of the
+**             prtn_lock.
 *****************************************************************************/
 ULONG
     pt_retbuf( ULONG ptid, void *bufaddr )
 {
     p2pt_prtn_t *prtn;
     prtn_extent_t *extent;
-    unsigned long extent_size;
+    prtn_cache_t *cache;
     char *blk_ptr;
     ULONG error;
 
@@ -789,75 +1918,53 @@ ULONG
     {
 
         /*
-        **  Ensure that the block being returned falls within this
-        **  partition's data memory range.
+        **  Ensure that the block being returned falls within one of this
+        **  partition's data extents, on a block boundary.
         */
         blk_ptr = (char *)bufaddr;
-        extent = prtn->data_extent;
-        extent_size = extent->bcount * prtn->blk_size;
+        extent = extent_for( prtn, blk_ptr );
 #ifdef DIAG_PRINTFS 
-        printf( "\r\npt_retbuf bufaddr @ %p extent base @ %p size %lx",
-                blk_ptr, extent->baddr, extent_size );
+        printf( "\r\npt_retbuf bufaddr @ %p extent @ %p", blk_ptr, extent );
 #endif
-        if ( (blk_ptr == extent->baddr) ||
-             ((blk_ptr > extent->baddr) && 
-              (blk_ptr < (extent->baddr + extent_size))) )
+        if ( (extent != (prtn_extent_t *)NULL) &&
+             (((unsigned long)(blk_ptr - extent->baddr) % prtn->blk_size)
+              == 0) )
         {
             /*
-            ** Lock mutex for partition block release
+            **  Check the extent's allocation bitmap to see if the caller's
+            **  buffer has already been freed.  PT_NOCHECK partitions keep
+            **  no bitmap and trust the caller.
             */
-            pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
-                                  (void *)&(prtn->prtn_lock));
-            pthread_mutex_lock( &(prtn->prtn_lock) );
+            error = mark_free( prtn, extent, blk_ptr );
+            if ( error == ERR_NO_ERROR )
+                TRACE( TR_PRTN | TR_SEND, ptid, (ULONG)blk_ptr );
 
-            /*
-            **  Search the partition's free list to see if the caller's
-            **  buffer has already been freed.
-            */
-            for ( blk_ptr = (char *)prtn->first_free;
-                  blk_ptr != (char *)NULL;
-                  blk_ptr = *(char **)blk_ptr )
+            if ( (error == ERR_NO_ERROR) && (prtn->cache_batch > 0L) )
             {
-#ifdef DIAG_PRINTFS 
-                printf( "\r\npt_retbuf cur_blk @ %p nxt_blk @ %p",
-                        blk_ptr, *(char **)blk_ptr );
-#endif
-                if ( blk_ptr == (char *)bufaddr )
-                {
-                    error = ERR_BUFFREE;
-                    break;
-                }
+                /*
+                **  Put the block in our cache, making room if needed.
+                */
+                cache = cache_for( prtn );
+                if ( cache->count >= (2 * prtn->cache_batch) )
+                    flush_cache( cache, prtn->cache_batch );
+                cache->blocks[(cache->count)++] = blk_ptr;
             }
-
-            if ( error == ERR_NO_ERROR )
+            else if ( error == ERR_NO_ERROR )
             {
                 /*
-                **  The caller's buffer address falls within the partition
-                **  and has not already been freed...
-                **  Insert a list-terminating NULL pointer into the block 
-                **  being freed up.  Then link the block into the free list
-                **  after the previous last free block.  This means free blocks
-                **  are always returned to the rear of the free list, ensuring
-                **  an even distribution of use for the blocks in the partition.
+                ** Lock mutex for partition block release
                 */
-                blk_ptr = (char *)bufaddr;
-                *(char **)blk_ptr = (char *)NULL;
-                *(prtn->last_free) = blk_ptr;
-                prtn->last_free = (char **)blk_ptr;
-                if ( prtn->first_free == (char **)NULL )
-                    prtn->first_free = (char **)blk_ptr;
+                pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                                      (void *)&(prtn->prtn_lock));
+                lk_lock( &(prtn->prtn_lock), &(prtn->prtn_lkstat) );
 
-#ifdef DIAG_PRINTFS 
-                printf( "\r\npt_retbuf returned block @ %p to partition %ld",
-                        blk_ptr, ptid );
-#endif
+                put_free_blocks( prtn, &blk_ptr, 1L );
 
                 /*
-                **  Adjust the block counters to reflect the fact that another
-                **  block was just released.
+                **  Unlock the mutex for the condition variable and clean up.
                 */
-                prtn->free_blk_count++;
-                prtn->used_blk_count--;
+                lk_unlock( &(prtn->prtn_lock), &(prtn->prtn_lkstat) );
+                pthread_cleanup_pop( 0 );
             }
 #ifdef DIAG_PRINTFS 
             else
@@ -865,11 +1972,6 @@ ULONG
                 printf( "\r\npt_retbuf - block @ %p already freed", blk_ptr );
             }
 #endif
-            /*
-            **  Unlock the mutex for the condition variable and clean up.
-            */
-            pthread_mutex_unlock( &(prtn->prtn_lock) );
-            pthread_cleanup_pop( 0 );
         }
         else
         {
@@ -888,6 +1990,37 @@ ULONG
     return( error );
 }
 
+/*****************************************************************************
+** pt_setlimit - sets the maximum number of extents a PT_GROW partition may
+**               grow to, counting the one it was created with
+*****************************************************************************/
+ULONG
+    pt_setlimit( ULONG ptid, ULONG max_extents )
+{
+    p2pt_prtn_t *prtn;
+    ULONG error;
+
+    error = ERR_NO_ERROR;
+
+    if ( (prtn = pcb_for( ptid )) != (p2pt_prtn_t *)NULL )
+    {
+        pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                              (void *)&(prtn->prtn_lock));
+        lk_lock( &(prtn->prtn_lock), &(prtn->prtn_lkstat) );
+
+        prtn->max_extents = max_extents;
+
+        lk_unlock( &(prtn->prtn_lock), &(prtn->prtn_lkstat) );
+        pthread_cleanup_pop( 0 );
+    }
+    else
+    {
+        error = ERR_OBJDEL;       /* Invalid prtn specified */
+    }
+
+    return( error );
+}
+
 /*****************************************************************************
 ** pt_ident - identifies the named p2pthread partition
 *****************************************************************************/
@@ -947,3 +2080,49 @@ ULONG
     return( error );
 }
 
+/*****************************************************************************
+** publish_prtns - fills in stats page entries for up to 'max_rows'
+**                 partitions.  Returns the number of partitions, which may
+**                 exceed 'max_rows'.
+*****************************************************************************/
+ULONG
+   publish_prtns( sp_object_t rows[], ULONG max_rows )
+{
+    p2pt_prtn_t *prtn;
+    sp_object_t *row;
+    ULONG count;
+    int i;
+
+    count = 0;
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&prtn_list_lock );
+    lk_lock( &prtn_list_lock, &prtn_list_lkstat );
+
+    /*
+    **  The partition cannot be freed while it is on the list we hold, but
+    **  pt_delete() takes the list lock with the prtn_lock held, so the
+    **  counts are read without the prtn_lock.
+    */
+    for ( prtn = prtn_list; prtn != (p2pt_prtn_t *)NULL;
+          prtn = prtn->nxt_prtn, count++ )
+    {
+        if ( count >= max_rows )
+            continue;
+        row = &(rows[count]);
+        memset( (void *)row, 0, sizeof( *row ) );
+        row->obj_class = SP_PRTN;
+        row->objid = prtn->prtn_id;
+        for ( i = 0; i < 4; i++ )
+            row->objname[i] = prtn->ptname[i];
+        row->free_blocks = prtn->free_blk_count;
+        row->depth = prtn->used_blk_count;
+        row->limit = row->free_blocks + row->depth;
+        row->puts = prtn->blks_returned;
+        row->gets = prtn->blks_taken;
+    }
+
+    lk_unlock( &prtn_list_lock, &prtn_list_lkstat );
+    pthread_cleanup_pop( 0 );
+
+    return( count );
+}
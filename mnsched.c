@@ -0,0 +1,1207 @@
+/*****************************************************************************
+ * mnsched.c - defines the M:N scheduler, which runs p2pthread tasks as
+ *             user-space contexts on a small pool of worker pthreads.
+ *             Tasks switch only at p2pthread API call points, so the
+ *             highest priority ready task takes over a worker whenever the
+ *             running task blocks, yields or makes such a task ready.
+ ****************************************************************************/
+
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "p2pthread.h"
+
+/*
+**  Built with -fexceptions, pthread_cleanup_push keeps its frames on the
+**  stack of the pushing task instead of linking them into the pthread,
+**  which for an M:N task context may change while one is pushed.  The
+**  Makefile builds the whole library so; this catches a build which
+**  does not.
+*/
+#ifndef __EXCEPTIONS
+#error "the p2pthread library must be compiled with -fexceptions"
+#endif
+
+#undef DIAG_PRINTFS
+
+#define ERR_MNMODE  0x97
+
+/*
+**  mn_start() options
+*/
+#define MN_STEAL    0x1
+
+/*
+**  MN_STACK_SIZE is the size of the stack of each task context, below which
+**                lies an inaccessible guard page.  Stack pages are only
+**                committed as they are touched.
+*/
+#define MN_STACK_SIZE   (256 * 1024)
+
+/*
+**  MN_MAX_WORKERS limits the number of worker pthreads, and MN_BUCKETS is the
+**                 number of lists of waiting tasks, hashed by wait address
+*/
+#define MN_MAX_WORKERS  64
+#define MN_BUCKETS      256     /* Must match the hash in bucket() */
+
+/*
+**  MN_PRIORITIES is the number of ready lists of each worker, one for each
+**                priority, and MN_MAP_WORDS the size of the bitmap of those
+**                which are not empty
+*/
+#define MN_PRIORITIES   256
+#define MN_MAP_BITS     (8 * (int)sizeof( unsigned long ))
+#define MN_MAP_WORDS    (MN_PRIORITIES / MN_MAP_BITS)
+
+/*
+**  States of a task context
+*/
+#define MN_READY        0
+#define MN_RUNNING      1
+#define MN_BLOCKED      2
+#define MN_DEAD         3
+
+/*****************************************************************************
+**  User-space context of a task run by the M:N scheduler
+*****************************************************************************/
+typedef struct mn_task
+{
+    ucontext_t
+        context;         /* Registers saved while switched out */
+    char *
+        stack;           /* Mapping holding guard page and stack (or NULL) */
+    size_t
+        stack_size;      /* Size of the mapping */
+    p2pthread_cb_t *
+        tcb;             /* Task control block (NULL once deleted) */
+    void *(*entry)( void * );
+    void *
+        arg;             /* Entry point of the task and its argument */
+    int
+        state;           /* MN_READY, MN_RUNNING, MN_BLOCKED or MN_DEAD */
+    int
+        worker;          /* Index of worker whose ready list holds task */
+    int
+        ready_pri;       /* Priority of the ready list holding task */
+    int
+        suspended;       /* Left out of scheduling by t_suspend */
+    int
+        killed;          /* Deleted by another task while running */
+    int
+        exiting;         /* Deleted itself... its worker frees everything */
+    int
+        pinned;          /* Blocked in a futex wait, so may not migrate */
+    const void *
+        wait_key;        /* Condition variable or futex word waited on */
+    unsigned long long
+        deadline;        /* Time of day in usec when wait ends (0 if never) */
+    int
+        timed_out;       /* Set when the deadline ended the wait */
+    int
+        heap_index;      /* Position in timer heap (-1 if not there) */
+    pthread_mutex_t *
+        release_mutex;   /* Unlocked by worker once task has switched out */
+    struct mn_task *
+        prv_ready;
+    struct mn_task *
+        nxt_ready;       /* Links in ready list of a worker */
+    struct mn_task *
+        prv_wait;
+    struct mn_task *
+        nxt_wait;        /* Links in list of waiting tasks */
+} mn_task_t;
+
+/*****************************************************************************
+**  Worker pthread of the M:N scheduler
+*****************************************************************************/
+typedef struct mn_worker
+{
+    pthread_t
+        pthrid;
+    int
+        index;           /* Position in workers[] */
+    ucontext_t
+        context;         /* Context of worker's scheduling loop */
+    pthread_cond_t
+        wakeup;          /* Signalled when idle worker may have work */
+    int
+        idle;            /* Waiting on wakeup */
+    mn_task_t *
+        current;         /* Task context now running (NULL if none) */
+    mn_task_t *
+        ready_head[MN_PRIORITIES];
+    mn_task_t *
+        ready_tail[MN_PRIORITIES];   /* Tasks ready to run, oldest first */
+    unsigned long
+        ready_map[MN_MAP_WORDS];     /* Bit set for each nonempty list */
+} mn_worker_t;
+
+/*****************************************************************************
+**  External function and data references
+*****************************************************************************/
+extern void
+   set_my_tcb( p2pthread_cb_t *tcb );
+
+/*****************************************************************************
+**  p2pthread Global Data Structures
+*****************************************************************************/
+
+/*
+**  mn_mode is nonzero once mn_start() has started the worker pthreads
+*/
+volatile int
+    mn_mode = 0;
+
+/*
+**  mn_lock serializes access to all the scheduler state below.  A task
+**          context holds it across each switch out, and the worker
+**          pthread which resumes the task hands it back still locked, so
+**          no wakeup can slip in between a task deciding to block and its
+**          context being saved.
+*/
+static pthread_mutex_t
+    mn_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+**  workers is the array of n_workers worker pthreads.  steal is set if idle
+**          workers may take ready tasks from the lists of busy ones, and
+**          next_worker is where the next task started is placed.
+*/
+static mn_worker_t *
+    workers = (mn_worker_t *)NULL;
+static int
+    n_workers = 0;
+static int
+    steal = 0;
+static int
+    next_worker = 0;
+
+/*
+**  wait_head and wait_tail are lists of blocked tasks, hashed by the address
+**                          they wait on and oldest first
+*/
+static mn_task_t *
+    wait_head[MN_BUCKETS];
+static mn_task_t *
+    wait_tail[MN_BUCKETS];
+
+/*
+**  timer_heap is a binary heap of the tasks whose waits have deadlines,
+**             earliest first.  It has room for every task, so adding a
+**             task to it never fails.
+*/
+static mn_task_t **
+    timer_heap = (mn_task_t **)NULL;
+static int
+    timer_count = 0;
+static int
+    timer_room = 0;
+
+/*
+**  mn_tasks is the number of task contexts in existence
+*/
+static int
+    mn_tasks = 0;
+
+/*
+**  mn_reaped is broadcast when the stack of a killed task has been freed,
+**            for pthreads waiting in mn_kill()
+*/
+static pthread_cond_t
+    mn_reaped = PTHREAD_COND_INITIALIZER;
+
+/*
+**  my_worker is the calling pthread's worker (NULL if not a worker)
+*/
+static __thread mn_worker_t *
+    my_worker = (mn_worker_t *)NULL;
+
+/*****************************************************************************
+** now_usec - returns the time of day in microseconds
+*****************************************************************************/
+static unsigned long long
+   now_usec( void )
+{
+    struct timeval now;
+
+    gettimeofday( &now, (struct timezone *)NULL );
+    return( (unsigned long long)now.tv_sec * 1000000ULL +
+            (unsigned long long)now.tv_usec );
+}
+
+/*****************************************************************************
+** timespec_usec - converts a timespec to microseconds
+*****************************************************************************/
+static unsigned long long
+   timespec_usec( const struct timespec *ts )
+{
+    return( (unsigned long long)ts->tv_sec * 1000000ULL +
+            (unsigned long long)(ts->tv_nsec / 1000) );
+}
+
+/*****************************************************************************
+** mn_self - returns the task context running on the calling pthread, or
+**           NULL if it is not running one
+*****************************************************************************/
+static mn_task_t *
+   mn_self( void )
+{
+    if ( my_worker == (mn_worker_t *)NULL )
+        return( (mn_task_t *)NULL );
+
+    return( my_worker->current );
+}
+
+/*****************************************************************************
+** mn_caller - returns TRUE if the caller is a task running as a user-space
+**             context on an M:N worker pthread
+*****************************************************************************/
+int
+   mn_caller( void )
+{
+    return( mn_self() != (mn_task_t *)NULL );
+}
+
+/*****************************************************************************
+** priority - returns the pSOS priority of a task context
+*****************************************************************************/
+static int
+   priority( mn_task_t *task )
+{
+    return( task->tcb->prv_priority.sched_priority & (MN_PRIORITIES - 1) );
+}
+
+/*****************************************************************************
+** link_ready - appends a task to its worker's ready list for its priority
+*****************************************************************************/
+static void
+   link_ready( mn_task_t *task )
+{
+    mn_worker_t *worker;
+    int pri;
+
+    worker = &workers[task->worker];
+    pri = priority( task );
+    task->ready_pri = pri;
+    task->nxt_ready = (mn_task_t *)NULL;
+    task->prv_ready = worker->ready_tail[pri];
+    if ( worker->ready_tail[pri] != (mn_task_t *)NULL )
+        worker->ready_tail[pri]->nxt_ready = task;
+    else
+    {
+        worker->ready_head[pri] = task;
+        worker->ready_map[pri / MN_MAP_BITS] |= 1UL << (pri % MN_MAP_BITS);
+    }
+    worker->ready_tail[pri] = task;
+}
+
+/*****************************************************************************
+** unlink_ready - removes a task from the ready list of its worker
+*****************************************************************************/
+static void
+   unlink_ready( mn_task_t *task )
+{
+    mn_worker_t *worker;
+    int pri;
+
+    worker = &workers[task->worker];
+    pri = task->ready_pri;
+    if ( task->prv_ready != (mn_task_t *)NULL )
+        task->prv_ready->nxt_ready = task->nxt_ready;
+    else
+        worker->ready_head[pri] = task->nxt_ready;
+    if ( task->nxt_ready != (mn_task_t *)NULL )
+        task->nxt_ready->prv_ready = task->prv_ready;
+    else
+        worker->ready_tail[pri] = task->prv_ready;
+    if ( worker->ready_head[pri] == (mn_task_t *)NULL )
+        worker->ready_map[pri / MN_MAP_BITS] &= ~(1UL << (pri % MN_MAP_BITS));
+    task->prv_ready = (mn_task_t *)NULL;
+    task->nxt_ready = (mn_task_t *)NULL;
+}
+
+/*****************************************************************************
+** bucket - returns the wait list index for a wait address
+*****************************************************************************/
+static int
+   bucket( const void *key )
+{
+    /*
+    **  Wait addresses inside control blocks are spaced a power of two
+    **  apart, so mix all their bits.
+    */
+    return( (int)(((unsigned long long)(unsigned long)key *
+                   0x9E3779B97F4A7C15ULL) >> 56) );
+}
+
+/*****************************************************************************
+** link_wait - appends a task to the list for the address it waits on
+*****************************************************************************/
+static void
+   link_wait( mn_task_t *task )
+{
+    int index;
+
+    index = bucket( task->wait_key );
+    task->nxt_wait = (mn_task_t *)NULL;
+    task->prv_wait = wait_tail[index];
+    if ( wait_tail[index] != (mn_task_t *)NULL )
+        wait_tail[index]->nxt_wait = task;
+    else
+        wait_head[index] = task;
+    wait_tail[index] = task;
+}
+
+/*****************************************************************************
+** unlink_wait - removes a task from the list for the address it waits on
+*****************************************************************************/
+static void
+   unlink_wait( mn_task_t *task )
+{
+    int index;
+
+    index = bucket( task->wait_key );
+    if ( task->prv_wait != (mn_task_t *)NULL )
+        task->prv_wait->nxt_wait = task->nxt_wait;
+    else
+        wait_head[index] = task->nxt_wait;
+    if ( task->nxt_wait != (mn_task_t *)NULL )
+        task->nxt_wait->prv_wait = task->prv_wait;
+    else
+        wait_tail[index] = task->prv_wait;
+    task->prv_wait = (mn_task_t *)NULL;
+    task->nxt_wait = (mn_task_t *)NULL;
+    task->wait_key = (const void *)NULL;
+}
+
+/*****************************************************************************
+** heap_place - stores a task at a position in the timer heap
+*****************************************************************************/
+static void
+   heap_place( mn_task_t *task, int index )
+{
+    timer_heap[index] = task;
+    task->heap_index = index;
+}
+
+/*****************************************************************************
+** heap_sift - moves the task at a position in the timer heap up or down
+**             until the heap is in deadline order again
+*****************************************************************************/
+static void
+   heap_sift( int index )
+{
+    mn_task_t *task;
+    int child;
+
+    task = timer_heap[index];
+    while ( (index > 0) &&
+            (timer_heap[(index - 1) / 2]->deadline > task->deadline) )
+    {
+        heap_place( timer_heap[(index - 1) / 2], index );
+        index = (index - 1) / 2;
+    }
+    for ( ;; )
+    {
+        child = index * 2 + 1;
+        if ( child >= timer_count )
+            break;
+        if ( (child + 1 < timer_count) &&
+             (timer_heap[child + 1]->deadline < timer_heap[child]->deadline) )
+            child++;
+        if ( timer_heap[child]->deadline >= task->deadline )
+            break;
+        heap_place( timer_heap[child], index );
+        index = child;
+    }
+    heap_place( task, index );
+}
+
+/*****************************************************************************
+** heap_remove - removes a task from the timer heap
+*****************************************************************************/
+static void
+   heap_remove( mn_task_t *task )
+{
+    int index;
+
+    index = task->heap_index;
+    task->heap_index = -1;
+    timer_count--;
+    if ( index < timer_count )
+    {
+        heap_place( timer_heap[timer_count], index );
+        heap_sift( index );
+    }
+}
+
+/*****************************************************************************
+** kick_idle - wakes every idle worker, so each recalculates how long to wait
+*****************************************************************************/
+static void
+   kick_idle( void )
+{
+    int i;
+
+    for ( i = 0; i < n_workers; i++ )
+    {
+        if ( workers[i].idle )
+            pthread_cond_signal( &(workers[i].wakeup) );
+    }
+}
+
+/*****************************************************************************
+** make_ready - puts a task on the ready list of the worker it last ran on,
+**              and wakes that worker (or if it is busy and stealing is
+**              allowed, an idle one) to run it
+*****************************************************************************/
+static void
+   make_ready( mn_task_t *task )
+{
+    int i;
+
+    task->state = MN_READY;
+    link_ready( task );
+    if ( task->suspended )
+        return;
+
+    if ( workers[task->worker].idle )
+    {
+        pthread_cond_signal( &(workers[task->worker].wakeup) );
+        return;
+    }
+    if ( steal && !task->pinned )
+    {
+        for ( i = 0; i < n_workers; i++ )
+        {
+            if ( workers[i].idle )
+            {
+                pthread_cond_signal( &(workers[i].wakeup) );
+                break;
+            }
+        }
+    }
+}
+
+/*****************************************************************************
+** block - takes a task out of scheduling until its wait address is woken
+**         or its deadline (if nonzero) passes
+*****************************************************************************/
+static void
+   block( mn_task_t *task, const void *key, unsigned long long deadline )
+{
+    task->state = MN_BLOCKED;
+    task->timed_out = FALSE;
+    task->wait_key = key;
+    if ( key != (const void *)NULL )
+        link_wait( task );
+    task->deadline = deadline;
+    if ( deadline != 0 )
+    {
+        heap_place( task, timer_count++ );
+        heap_sift( task->heap_index );
+        if ( task->heap_index == 0 )
+            kick_idle();
+    }
+}
+
+/*****************************************************************************
+** wake - makes a blocked task ready again
+*****************************************************************************/
+static void
+   wake( mn_task_t *task, int timed_out )
+{
+    if ( task->wait_key != (const void *)NULL )
+        unlink_wait( task );
+    if ( task->heap_index >= 0 )
+        heap_remove( task );
+    task->timed_out = timed_out;
+    make_ready( task );
+}
+
+/*****************************************************************************
+** wake_key - wakes up to count tasks waiting on an address, oldest first.
+**            Returns the number woken.
+*****************************************************************************/
+static int
+   wake_key( const void *key, int count )
+{
+    mn_task_t *task, *next;
+    int woken;
+
+    woken = 0;
+    for ( task = wait_head[bucket( key )];
+          (task != (mn_task_t *)NULL) && (woken < count); task = next )
+    {
+        next = task->nxt_wait;
+        if ( task->wait_key == key )
+        {
+            wake( task, FALSE );
+            woken++;
+        }
+    }
+
+    return( woken );
+}
+
+/*****************************************************************************
+** expire_timers - wakes the tasks whose deadlines have passed
+*****************************************************************************/
+static void
+   expire_timers( void )
+{
+    unsigned long long now;
+
+    if ( timer_count == 0 )
+        return;
+
+    now = now_usec();
+    while ( (timer_count > 0) && (timer_heap[0]->deadline <= now) )
+        wake( timer_heap[0], TRUE );
+}
+
+/*****************************************************************************
+** best_of - returns the oldest of the highest priority tasks on a worker's
+**           ready lists which may be run, by another worker if stealing
+*****************************************************************************/
+static mn_task_t *
+   best_of( mn_worker_t *worker, int stealing )
+{
+    mn_task_t *task;
+    unsigned long map;
+    int word, bit;
+
+    for ( word = MN_MAP_WORDS - 1; word >= 0; word-- )
+    {
+        for ( map = worker->ready_map[word]; map != 0;
+              map &= ~(1UL << bit) )
+        {
+            bit = MN_MAP_BITS - 1 - __builtin_clzl( map );
+            for ( task = worker->ready_head[word * MN_MAP_BITS + bit];
+                  task != (mn_task_t *)NULL; task = task->nxt_ready )
+            {
+                /*
+                **  A task blocked in a futex wait was in the middle of a
+                **  libc call which may have cached the location of errno
+                **  or other thread-local data, so it must resume on its
+                **  own worker.
+                */
+                if ( !task->suspended && !(stealing && task->pinned) )
+                    return( task );
+            }
+        }
+    }
+
+    return( (mn_task_t *)NULL );
+}
+
+/*****************************************************************************
+** best_ready - returns the highest priority task the worker may run, its
+**              own before those of other workers among equals
+*****************************************************************************/
+static mn_task_t *
+   best_ready( mn_worker_t *worker )
+{
+    mn_task_t *task, *best;
+    int i;
+
+    best = best_of( worker, FALSE );
+    if ( steal )
+    {
+        for ( i = 1; i < n_workers; i++ )
+        {
+            task = best_of( &workers[(worker->index + i) % n_workers], TRUE );
+            if ( (task != (mn_task_t *)NULL) &&
+                 ((best == (mn_task_t *)NULL) ||
+                  (task->ready_pri > best->ready_pri)) )
+                best = task;
+        }
+    }
+
+    return( best );
+}
+
+/*****************************************************************************
+** switch_out - saves the calling task's context and returns to its worker's
+**              scheduling loop.  Called and returns with mn_lock locked,
+**              possibly on a different worker.
+*****************************************************************************/
+static void
+   switch_out( mn_task_t *task )
+{
+    swapcontext( &(task->context), &(my_worker->context) );
+}
+
+/*****************************************************************************
+** free_stack - unmaps the stack of a task context which has died
+*****************************************************************************/
+static void
+   free_stack( mn_task_t *task )
+{
+    munmap( task->stack, task->stack_size );
+    task->stack = (char *)NULL;
+}
+
+/*****************************************************************************
+** die - ends the calling task context after another task deleted it, first
+**       unlocking the mutex it was about to wait with (if any).  Called
+**       with mn_lock locked.  Never returns.
+*****************************************************************************/
+static void
+   die( mn_task_t *task, pthread_mutex_t *mutex )
+{
+    task->release_mutex = mutex;
+    task->state = MN_DEAD;
+    switch_out( task );
+}
+
+/*****************************************************************************
+** run - switches from a worker's scheduling loop to a ready task, and deals
+**       with the task once it switches back out
+*****************************************************************************/
+static void
+   run( mn_worker_t *worker, mn_task_t *task )
+{
+    unlink_ready( task );
+    task->worker = worker->index;
+    task->state = MN_RUNNING;
+    worker->current = task;
+    set_my_tcb( task->tcb );
+
+    swapcontext( &(worker->context), &(task->context) );
+
+    set_my_tcb( (p2pthread_cb_t *)NULL );
+    worker->current = (mn_task_t *)NULL;
+
+    /*
+    **  The task is safely switched out now, so let other tasks have the
+    **  mutex it waits with.
+    */
+    if ( task->release_mutex != (pthread_mutex_t *)NULL )
+    {
+        pthread_mutex_unlock( task->release_mutex );
+        task->release_mutex = (pthread_mutex_t *)NULL;
+    }
+
+    if ( task->state == MN_DEAD )
+    {
+        free_stack( task );
+        if ( task->exiting )
+        {
+            mn_tasks--;
+            free( task );
+        }
+        else
+        {
+            /*
+            **  Let the task deleting it know it is gone.
+            */
+            wake_key( (const void *)task, mn_tasks );
+            pthread_cond_broadcast( &mn_reaped );
+        }
+    }
+}
+
+/*****************************************************************************
+** worker_main - the scheduling loop of a worker pthread, which runs the
+**               highest priority ready task it may until there are none
+**               left, then sleeps until one is made ready or times out
+*****************************************************************************/
+static void *
+   worker_main( void *arg )
+{
+    mn_worker_t *worker;
+    mn_task_t *task;
+    struct timespec until;
+    unsigned long long deadline;
+
+    worker = (mn_worker_t *)arg;
+    my_worker = worker;
+
+    pthread_mutex_lock( &mn_lock );
+    for ( ;; )
+    {
+        expire_timers();
+        task = best_ready( worker );
+        if ( task != (mn_task_t *)NULL )
+        {
+            run( worker, task );
+            continue;
+        }
+
+        worker->idle = TRUE;
+        if ( timer_count > 0 )
+        {
+            deadline = timer_heap[0]->deadline;
+            until.tv_sec = (time_t)(deadline / 1000000ULL);
+            until.tv_nsec = (long)(deadline % 1000000ULL) * 1000L;
+            pthread_cond_timedwait( &(worker->wakeup), &mn_lock, &until );
+        }
+        else
+            pthread_cond_wait( &(worker->wakeup), &mn_lock );
+        worker->idle = FALSE;
+    }
+
+    return( (void *)NULL );
+}
+
+/*****************************************************************************
+** mn_exit - ends the calling task context, which has deleted its own task.
+**           Its worker frees the context once switched out of it.  Never
+**           returns.
+*****************************************************************************/
+void
+   mn_exit( mn_task_t *task )
+{
+    pthread_mutex_lock( &mn_lock );
+    task->tcb = (p2pthread_cb_t *)NULL;
+    task->exiting = TRUE;
+    task->state = MN_DEAD;
+    switch_out( task );
+}
+
+/*****************************************************************************
+** mn_trampoline - is where a new task context begins.  It is entered from
+**                 the worker's scheduling loop with mn_lock locked.
+*****************************************************************************/
+static void
+   mn_trampoline( void )
+{
+    mn_task_t *task;
+
+    task = my_worker->current;
+    pthread_mutex_unlock( &mn_lock );
+
+    (*(task->entry))( task->arg );
+
+    /*
+    **  The entry point deletes its own task, so it only returns here if the
+    **  task was somehow deleted already.
+    */
+    mn_exit( task );
+}
+
+/*****************************************************************************
+** mn_attach - creates the user-space context of a task being started in M:N
+**             mode and makes it ready on the next worker in turn.  Returns
+**             zero or an errno value.
+*****************************************************************************/
+int
+   mn_attach( p2pthread_cb_t *tcb, void *(*entry)( void * ), void *arg )
+{
+    mn_task_t *task, **heap;
+    long page_size;
+    int room;
+
+    task = (mn_task_t *)malloc( sizeof( mn_task_t ) );
+    if ( task == (mn_task_t *)NULL )
+        return( ENOMEM );
+    memset( (void *)task, 0, sizeof( mn_task_t ) );
+
+    page_size = sysconf( _SC_PAGESIZE );
+    task->stack_size = MN_STACK_SIZE + page_size;
+    task->stack = (char *)mmap( (void *)NULL, task->stack_size,
+                                PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE |
+                                MAP_STACK, -1, 0 );
+    if ( task->stack == (char *)MAP_FAILED )
+    {
+        free( task );
+        return( ENOMEM );
+    }
+    mprotect( (void *)task->stack, page_size, PROT_NONE );
+
+    getcontext( &(task->context) );
+    task->context.uc_stack.ss_sp = (void *)(task->stack + page_size);
+    task->context.uc_stack.ss_size = MN_STACK_SIZE;
+    task->context.uc_link = (ucontext_t *)NULL;
+    makecontext( &(task->context), mn_trampoline, 0 );
+
+    task->tcb = tcb;
+    task->entry = entry;
+    task->arg = arg;
+    task->heap_index = -1;
+
+    pthread_mutex_lock( &mn_lock );
+
+    /*
+    **  Make sure the timer heap has room for every task.
+    */
+    if ( mn_tasks >= timer_room )
+    {
+        room = (timer_room == 0) ? 64 : timer_room * 2;
+        heap = (mn_task_t **)realloc( (void *)timer_heap,
+                                      room * sizeof( mn_task_t * ) );
+        if ( heap == (mn_task_t **)NULL )
+        {
+            pthread_mutex_unlock( &mn_lock );
+            free_stack( task );
+            free( task );
+            return( ENOMEM );
+        }
+        timer_heap = heap;
+        timer_room = room;
+    }
+    mn_tasks++;
+
+    tcb->mn_task = task;
+    task->worker = next_worker;
+    next_worker = (next_worker + 1) % n_workers;
+    make_ready( task );
+
+    pthread_mutex_unlock( &mn_lock );
+
+    return( 0 );
+}
+
+/*****************************************************************************
+** mn_kill - ends the task context of a task being deleted by another task.
+**           A context switched out is freed at once, but a running one is
+**           left to die at its next API call point, and the caller waits
+**           for that as t_delete would wait for a cancelled pthread.
+*****************************************************************************/
+void
+   mn_kill( p2pthread_cb_t *tcb )
+{
+    mn_task_t *task, *self;
+
+    task = tcb->mn_task;
+    self = mn_self();
+
+    pthread_mutex_lock( &mn_lock );
+    switch ( task->state )
+    {
+        case MN_READY:
+            unlink_ready( task );
+            break;
+        case MN_BLOCKED:
+            if ( task->wait_key != (const void *)NULL )
+                unlink_wait( task );
+            if ( task->heap_index >= 0 )
+                heap_remove( task );
+            break;
+        case MN_RUNNING:
+            task->killed = TRUE;
+            while ( task->stack != (char *)NULL )
+            {
+                if ( self != (mn_task_t *)NULL )
+                {
+                    block( self, (const void *)task, 0 );
+                    switch_out( self );
+                }
+                else
+                    pthread_cond_wait( &mn_reaped, &mn_lock );
+            }
+            break;
+    }
+    if ( task->stack != (char *)NULL )
+        free_stack( task );
+    mn_tasks--;
+    pthread_mutex_unlock( &mn_lock );
+
+    tcb->mn_task = (mn_task_t *)NULL;
+    free( task );
+}
+
+/*****************************************************************************
+** mn_suspend - takes a task out of scheduling for t_suspend, or puts it back
+**              for t_resume.  A task suspending itself switches out at once,
+**              and one running elsewhere at its next API call point.
+*****************************************************************************/
+void
+   mn_suspend( p2pthread_cb_t *tcb, int suspended )
+{
+    mn_task_t *task;
+
+    task = tcb->mn_task;
+
+    pthread_mutex_lock( &mn_lock );
+    task->suspended = suspended;
+    if ( suspended )
+    {
+        if ( task == mn_self() )
+        {
+            make_ready( task );
+            switch_out( task );
+        }
+    }
+    else if ( task->state == MN_READY )
+    {
+        unlink_ready( task );
+        make_ready( task );
+    }
+    pthread_mutex_unlock( &mn_lock );
+}
+
+/*****************************************************************************
+** mn_yield - lets a higher priority ready task preempt the calling task, or
+**            unless favoured, one of equal priority run first.  Returns
+**            FALSE if the caller is not a task context.
+*****************************************************************************/
+int
+   mn_yield( int favoured )
+{
+    mn_task_t *task, *best;
+
+    if ( (task = mn_self()) == (mn_task_t *)NULL )
+        return( FALSE );
+
+    pthread_mutex_lock( &mn_lock );
+    if ( task->killed )
+        die( task, (pthread_mutex_t *)NULL );
+    expire_timers();
+    best = best_ready( my_worker );
+    if ( task->suspended ||
+         ((best != (mn_task_t *)NULL) &&
+          ((best->ready_pri > priority( task )) ||
+           (!favoured && (best->ready_pri == priority( task ))))) )
+    {
+        make_ready( task );
+        switch_out( task );
+    }
+    pthread_mutex_unlock( &mn_lock );
+
+    return( TRUE );
+}
+
+/*****************************************************************************
+** mn_delay - blocks the calling task context for a number of ticks, leaving
+**            its worker free to run other tasks.  Returns FALSE if the
+**            caller is not a task context.
+*****************************************************************************/
+int
+   mn_delay( ULONG interval )
+{
+    mn_task_t *task;
+    unsigned long long deadline;
+
+    if ( (task = mn_self()) == (mn_task_t *)NULL )
+        return( FALSE );
+
+    deadline = now_usec() + (unsigned long long)interval * P2PT_TICK * 1000ULL;
+
+    pthread_mutex_lock( &mn_lock );
+    if ( task->killed )
+        die( task, (pthread_mutex_t *)NULL );
+    block( task, (const void *)NULL, deadline );
+    switch_out( task );
+    pthread_mutex_unlock( &mn_lock );
+
+    return( TRUE );
+}
+
+/*****************************************************************************
+** mn_cond_wait - waits on a condition variable with an internal mutex.  A
+**                task context switches out until lk_signal or lk_broadcast
+**                wakes it or the absolute timeout passes, while a pthread
+**                simply waits on the condition variable.  Returns zero or
+**                ETIMEDOUT.
+*****************************************************************************/
+int
+   mn_cond_wait( pthread_cond_t *cond, pthread_mutex_t *mutex,
+                 const struct timespec *timeout )
+{
+    mn_task_t *task;
+    unsigned long long deadline;
+    int timed_out;
+
+    if ( (task = mn_self()) == (mn_task_t *)NULL )
+    {
+        if ( timeout == (const struct timespec *)NULL )
+            return( pthread_cond_wait( cond, mutex ) );
+        return( pthread_cond_timedwait( cond, mutex, timeout ) );
+    }
+
+    deadline = 0;
+    if ( timeout != (const struct timespec *)NULL )
+    {
+        deadline = timespec_usec( timeout );
+        if ( deadline <= now_usec() )
+            return( ETIMEDOUT );
+    }
+
+    pthread_mutex_lock( &mn_lock );
+    if ( task->killed )
+        die( task, mutex );
+    block( task, (const void *)cond, deadline );
+    task->release_mutex = mutex;
+    switch_out( task );
+    timed_out = task->timed_out;
+    pthread_mutex_unlock( &mn_lock );
+
+    pthread_mutex_lock( mutex );
+
+    return( timed_out ? ETIMEDOUT : 0 );
+}
+
+/*****************************************************************************
+** mn_cond_wake - wakes one or all task contexts waiting on a condition
+**                variable.  Returns the number woken.
+*****************************************************************************/
+int
+   mn_cond_wake( pthread_cond_t *cond, int all )
+{
+    int woken;
+
+    pthread_mutex_lock( &mn_lock );
+    woken = wake_key( (const void *)cond, all ? mn_tasks : 1 );
+    pthread_mutex_unlock( &mn_lock );
+
+    return( woken );
+}
+
+/*****************************************************************************
+** mn_futex_wait - makes a FUTEX_WAIT or FUTEX_WAIT_BITSET wait on a futex
+**                 word for a task context, which switches out until
+**                 mn_futex_wake wakes it or the timeout passes.  A pthread
+**                 makes the system call instead.  Returns -1 with errno set
+**                 on failure, like futex_op.
+*****************************************************************************/
+long
+   mn_futex_wait( volatile int *uaddr, int op, int val,
+                  const struct timespec *timeout, volatile int *uaddr2,
+                  int val3 )
+{
+    mn_task_t *task;
+    struct timespec mono;
+    unsigned long long now, deadline;
+    int timed_out;
+
+    if ( (task = mn_self()) == (mn_task_t *)NULL )
+        return( syscall( SYS_futex, uaddr, op, val, timeout, uaddr2, val3 ) );
+
+    /*
+    **  FUTEX_WAIT takes a relative timeout, and FUTEX_WAIT_BITSET an
+    **  absolute one on the monotonic clock unless told otherwise.
+    */
+    deadline = 0;
+    if ( timeout != (const struct timespec *)NULL )
+    {
+        now = now_usec();
+        deadline = timespec_usec( timeout );
+        if ( (op & FUTEX_CMD_MASK) == FUTEX_WAIT )
+            deadline += now;
+        else if ( !(op & FUTEX_CLOCK_REALTIME) )
+        {
+            clock_gettime( CLOCK_MONOTONIC, &mono );
+            deadline += now - timespec_usec( &mono );
+        }
+        if ( deadline <= now )
+        {
+            errno = ETIMEDOUT;
+            return( -1 );
+        }
+    }
+
+    pthread_mutex_lock( &mn_lock );
+    if ( task->killed )
+        die( task, (pthread_mutex_t *)NULL );
+    if ( *uaddr != val )
+    {
+        pthread_mutex_unlock( &mn_lock );
+        errno = EAGAIN;
+        return( -1 );
+    }
+    block( task, (const void *)uaddr, deadline );
+    task->pinned = TRUE;
+    switch_out( task );
+    task->pinned = FALSE;
+    timed_out = task->timed_out;
+    pthread_mutex_unlock( &mn_lock );
+
+    if ( timed_out )
+    {
+        errno = ETIMEDOUT;
+        return( -1 );
+    }
+
+    return( 0 );
+}
+
+/*****************************************************************************
+** mn_futex_wake - wakes up to count task contexts waiting on a futex word.
+**                 Returns the number woken.
+*****************************************************************************/
+long
+   mn_futex_wake( volatile int *uaddr, int count )
+{
+    int woken;
+
+    pthread_mutex_lock( &mn_lock );
+    woken = wake_key( (const void *)uaddr, count );
+    pthread_mutex_unlock( &mn_lock );
+
+    return( (long)woken );
+}
+
+/*****************************************************************************
+** mn_start - starts the given number of worker pthreads (zero for one per
+**            online CPU) and enters M:N mode, in which tasks started from
+**            then on run as user-space contexts on the workers.  With
+**            MN_STEAL in opt, an idle worker runs ready tasks waiting for
+**            a busy one.  Cannot be combined with simulation mode.
+**            Returns zero, ERR_MNMODE or an errno value.
+*****************************************************************************/
+ULONG
+   mn_start( ULONG count, ULONG opt )
+{
+    int i, error;
+
+    if ( sim_mode || mn_mode )
+        return( ERR_MNMODE );
+
+    if ( count == 0 )
+    {
+        count = (ULONG)sysconf( _SC_NPROCESSORS_ONLN );
+        if ( (long)count < 1 )
+            count = 1;
+    }
+    if ( count > MN_MAX_WORKERS )
+        count = MN_MAX_WORKERS;
+
+    workers = (mn_worker_t *)calloc( count, sizeof( mn_worker_t ) );
+    if ( workers == (mn_worker_t *)NULL )
+        return( ENOMEM );
+
+    pthread_mutex_lock( &mn_lock );
+    steal = (opt & MN_STEAL) != 0;
+    for ( i = 0; i < (int)count; i++ )
+    {
+        workers[i].index = i;
+        pthread_cond_init( &(workers[i].wakeup), (pthread_condattr_t *)NULL );
+        error = pthread_create( &(workers[i].pthrid), (pthread_attr_t *)NULL,
+                                worker_main, (void *)&workers[i] );
+        if ( error != 0 )
+        {
+#ifdef DIAG_PRINTFS
+            perror( "\r\nmn_start pthread_create returned error:" );
+#endif
+            break;
+        }
+    }
+
+    /*
+    **  Carry on with fewer workers if some could not be started.
+    */
+    if ( i == 0 )
+    {
+        pthread_mutex_unlock( &mn_lock );
+        free( workers );
+        workers = (mn_worker_t *)NULL;
+        return( (ULONG)error );
+    }
+    n_workers = i;
+    mn_mode = 1;
+    pthread_mutex_unlock( &mn_lock );
+
+    return( (ULONG)0 );
+}
@@ -0,0 +1,1076 @@
+/*****************************************************************************
+ * mutex.c - defines the wrapper functions and data structures needed
+ *           to implement a Wind River pSOS+ (R) mutex API
+ *           in a POSIX Threads environment.
+ ****************************************************************************/
+
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <linux/futex.h>
+#include "p2pthread.h"
+
+#undef DIAG_PRINTFS
+
+#define MU_NOWAIT       0x01
+#define MU_RECURSIVE    0x04
+#define MU_PRIO_PROTECT 0x10
+
+#define ERR_TIMEOUT  0x01
+#define ERR_NODENO   0x04
+#define ERR_OBJDEL   0x05
+#define ERR_OBJNF    0x09
+#define ERR_SSFN     0x0B
+
+#define ERR_PRIOR    0x11
+
+#define ERR_NOMUCB   0x80
+#define ERR_NOMUTEX  0x81
+#define ERR_MUNOTOWN 0x82
+#define ERR_MURECURS 0x83
+#define ERR_MULOCKED 0x84
+#define ERR_MUCEIL   0x85
+#define ERR_MUODIED  0x86
+
+/*****************************************************************************
+**  Control block for p2pthread mutex
+**
+**  A pthread mutex cannot be waited on with a pSOS+ tick timeout while also
+**  reporting the death of its owner to the next locker, and the library
+**  could not reach the owner's identity to apply a priority ceiling.  This
+**  'wrapper' manages its own futex word using the kernel PI futex protocol:
+**  the word holds the kernel thread ID of the owner (or zero when unlocked),
+**  so an uncontended lock or unlock is a single compare-and-swap.  Only when
+**  the mutex is contended does a task enter the kernel, which queues waiters
+**  by priority and lends the highest waiting priority to the owner.
+**
+*****************************************************************************/
+typedef struct p2pt_mutex
+{
+        /*
+        ** ID for mutex
+        */
+    ULONG
+        muid;
+
+        /*
+        ** Mutex Name
+        */
+    char
+        mname[4];
+
+        /*
+        ** Option Flags for mutex
+        */
+    ULONG
+        flags;
+
+        /*
+        ** PI futex word... kernel thread ID of owner plus the
+        ** FUTEX_WAITERS state bit, or zero when unlocked.
+        */
+    volatile int
+        lock_word;
+
+        /*
+        ** Number of times the owner has locked the mutex
+        */
+    ULONG
+        lock_count;
+
+        /*
+        ** pthreads priority ceiling for a priority-protected mutex
+        */
+    int
+        ceiling;
+
+        /*
+        ** Set when the previous owner died holding the mutex, until the
+        ** next owner has been told about it.
+        */
+    int
+        owner_died;
+
+        /*
+        **  Pointer to next mutex held by the same owner.
+        */
+    struct p2pt_mutex *
+        nxt_held;
+
+        /*
+        **  Pointer to next mutex control block in mutex list.
+        */
+    struct p2pt_mutex *
+        nxt_mutex;
+} p2pt_mutex_t;
+
+/*****************************************************************************
+**  External function and data references
+*****************************************************************************/
+extern void *
+    ts_malloc( size_t blksize );
+extern void
+    ts_free( void *blkaddr );
+extern p2pthread_cb_t *
+   my_tcb( void );
+extern int
+   mn_caller( void );
+extern void
+   sched_lock( void );
+extern void
+   sched_unlock( void );
+extern pid_t
+   my_kernel_tid( void );
+extern long
+   futex_op( volatile int *uaddr, int op, int val,
+             const struct timespec *timeout, volatile int *uaddr2, int val3 );
+extern int
+   translate_priority( ULONG p2pt_priority, int sched_policy, ULONG *errp );
+extern void
+   stat_block( p2pthread_cb_t *tcb, int reason );
+extern void
+   stat_unblock( p2pthread_cb_t *tcb, int timedout );
+
+/*****************************************************************************
+**  p2pthread Global Data Structures
+*****************************************************************************/
+
+/*
+**  mutex_list is a linked list of mutex control blocks.  It is used to locate
+**             mutexes by their ID numbers.
+*/
+static p2pt_mutex_t *
+    mutex_list;
+
+/*
+**  mutex_list_lock is a mutex used to serialize access to the mutex list
+*/
+static pthread_mutex_t
+    mutex_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static lk_stat_t
+    mutex_list_lkstat = LK_STAT_INITIALIZER( TR_MUTEX, "mutex_list_lock" );
+
+/*
+**  held_mutexes is a per-pthread list of the mutexes locked by the pthread,
+**               most recently locked first.  It is only ever touched by
+**               its own pthread, so it needs no locking.
+*/
+static __thread p2pt_mutex_t *
+    held_mutexes = (p2pt_mutex_t *)NULL;
+
+/*
+**  pending_mutex is the mutex the pthread is blocked on in the kernel, if any.
+**                A task killed there may already have been made the owner.
+*/
+static __thread p2pt_mutex_t *
+    pending_mutex = (p2pt_mutex_t *)NULL;
+
+/*
+**  base_policy and base_priority are the scheduling policy and priority the
+**                pthread had before it locked the first of the priority-
+**                protected mutexes it holds.  Mutexes may be unlocked in any
+**                order, so the priority to drop back to is worked out from
+**                these and the ceilings of the mutexes still held.
+*/
+static __thread int
+    base_policy = SCHED_OTHER;
+static __thread struct sched_param
+    base_priority;
+
+
+/*****************************************************************************
+** mucb_for - returns the address of the mutex control block for the mutex
+**            idenified by muid
+*****************************************************************************/
+static p2pt_mutex_t *
+   mucb_for( ULONG muid )
+{
+    p2pt_mutex_t *current_mucb;
+
+    /*
+    **  No locking of the mutex list is done here since the access is
+    **  read-only... this keeps the uncontended lock path free of locks.
+    */
+    for ( current_mucb = mutex_list;
+          current_mucb != (p2pt_mutex_t *)NULL;
+          current_mucb = current_mucb->nxt_mutex )
+    {
+        if ( current_mucb->muid == muid )
+            break;
+    }
+
+    return( current_mucb );
+}
+
+/*****************************************************************************
+** new_muid - automatically returns a valid, unused mutex ID
+*****************************************************************************/
+static ULONG
+   new_muid( void )
+{
+    p2pt_mutex_t *current_mucb;
+    ULONG new_mutex_id;
+
+    /*
+    **  Protect the mutex list while we examine it.
+    */
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&mutex_list_lock );
+    lk_lock( &mutex_list_lock, &mutex_list_lkstat );
+
+    /*
+    **  Get the highest previously assigned mutex id and add one.
+    */
+    new_mutex_id = 0;
+    for ( current_mucb = mutex_list;
+          current_mucb != (p2pt_mutex_t *)NULL;
+          current_mucb = current_mucb->nxt_mutex )
+    {
+        if ( current_mucb->muid > new_mutex_id )
+            new_mutex_id = current_mucb->muid;
+    }
+    new_mutex_id++;
+
+    /*
+    **  Re-enable access to the mutex list by other threads.
+    */
+    lk_unlock( &mutex_list_lock, &mutex_list_lkstat );
+    pthread_cleanup_pop( 0 );
+
+    return( new_mutex_id );
+}
+
+/*****************************************************************************
+** link_mucb - appends a new mutex control block pointer to the mutex_list
+*****************************************************************************/
+static void
+   link_mucb( p2pt_mutex_t *new_mutex )
+{
+    p2pt_mutex_t *current_mucb;
+
+    /*
+    **  Protect the mutex list while we examine and modify it.
+    */
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&mutex_list_lock );
+    lk_lock( &mutex_list_lock, &mutex_list_lkstat );
+
+    new_mutex->nxt_mutex = (p2pt_mutex_t *)NULL;
+    if ( mutex_list != (p2pt_mutex_t *)NULL )
+    {
+        /*
+        **  One or more mutexes already exist in the mutex list...
+        **  Insert the new entry in ascending numerical sequence by muid.
+        */
+        for ( current_mucb = mutex_list;
+              current_mucb->nxt_mutex != (p2pt_mutex_t *)NULL;
+              current_mucb = current_mucb->nxt_mutex )
+        {
+            if ( (current_mucb->nxt_mutex)->muid > new_mutex->muid )
+            {
+                new_mutex->nxt_mutex = current_mucb->nxt_mutex;
+                break;
+            }
+        }
+        current_mucb->nxt_mutex = new_mutex;
+#ifdef DIAG_PRINTFS
+        printf( "\r\nadd mutex cb @ %p to list @ %p", new_mutex,
+                current_mucb );
+#endif
+    }
+    else
+    {
+        /*
+        **  this is the first mutex being added to the mutex list.
+        */
+        mutex_list = new_mutex;
+#ifdef DIAG_PRINTFS
+        printf( "\r\nadd mutex cb @ %p to list @ %p", new_mutex,
+                &mutex_list );
+#endif
+    }
+
+    /*
+    **  Re-enable access to the mutex list by other threads.
+    */
+    lk_unlock( &mutex_list_lock, &mutex_list_lkstat );
+    pthread_cleanup_pop( 0 );
+}
+
+/*****************************************************************************
+** unlink_mucb - removes a mutex control block pointer from the mutex_list
+*****************************************************************************/
+static p2pt_mutex_t *
+   unlink_mucb( ULONG muid )
+{
+    p2pt_mutex_t *current_mucb;
+    p2pt_mutex_t *selected_mucb;
+
+    selected_mucb =  (p2pt_mutex_t *)NULL;
+
+    /*
+    **  Protect the mutex list while we examine and modify it.
+    */
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&mutex_list_lock );
+    lk_lock( &mutex_list_lock, &mutex_list_lkstat );
+
+    if ( mutex_list != (p2pt_mutex_t *)NULL )
+    {
+        if ( mutex_list->muid == muid )
+        {
+            /*
+            **  The first mutex in the list matches the selected ID
+            */
+            selected_mucb = mutex_list;
+            mutex_list = selected_mucb->nxt_mutex;
+        }
+        else
+        {
+            /*
+            **  Scan the next mucb for a matching muid while retaining a
+            **  pointer to the current mucb.  If the next mucb matches,
+            **  select it and then unlink it from the mutex list.
+            */
+            for ( current_mucb = mutex_list;
+                  current_mucb->nxt_mutex != (p2pt_mutex_t *)NULL;
+                  current_mucb = current_mucb->nxt_mutex )
+            {
+                if ( (current_mucb->nxt_mutex)->muid == muid )
+                {
+                    selected_mucb = current_mucb->nxt_mutex;
+                    current_mucb->nxt_mutex = selected_mucb->nxt_mutex;
+                    break;
+                }
+            }
+        }
+#ifdef DIAG_PRINTFS
+        printf( "\r\ndel mutex cb @ %p from list", selected_mucb );
+#endif
+    }
+
+    /*
+    **  Re-enable access to the mutex list by other threads.
+    */
+    lk_unlock( &mutex_list_lock, &mutex_list_lkstat );
+    pthread_cleanup_pop( 0 );
+
+    return( selected_mucb );
+}
+
+/*****************************************************************************
+** unlink_held - removes a mutex from the calling pthread's held mutex list
+*****************************************************************************/
+static void
+   unlink_held( p2pt_mutex_t *mutex )
+{
+    p2pt_mutex_t **link;
+
+    for ( link = &held_mutexes; *link != (p2pt_mutex_t *)NULL;
+          link = &((*link)->nxt_held) )
+    {
+        if ( *link == mutex )
+        {
+            *link = mutex->nxt_held;
+            break;
+        }
+    }
+    mutex->nxt_held = (p2pt_mutex_t *)NULL;
+}
+
+/*****************************************************************************
+** release_futex - releases the PI futex word for a mutex owned by the
+**                 calling pthread.  Only if other pthreads are waiting in
+**                 the kernel is a system call needed to hand the mutex
+**                 to the highest priority waiter.
+*****************************************************************************/
+static void
+   release_futex( p2pt_mutex_t *mutex, pid_t tid )
+{
+    if ( !__sync_bool_compare_and_swap( &(mutex->lock_word), tid, 0 ) )
+    {
+        futex_op( &(mutex->lock_word), FUTEX_UNLOCK_PI | FUTEX_PRIVATE_FLAG,
+                  0, (struct timespec *)NULL, (volatile int *)NULL, 0 );
+    }
+}
+
+/*****************************************************************************
+** held_mutex_ceiling - returns the highest pthreads priority ceiling among
+**                      the priority-protected mutexes held by the calling
+**                      pthread, or zero if it holds none.
+*****************************************************************************/
+int
+   held_mutex_ceiling( void )
+{
+    p2pt_mutex_t *mutex;
+    int ceiling;
+
+    ceiling = 0;
+    for ( mutex = held_mutexes; mutex != (p2pt_mutex_t *)NULL;
+          mutex = mutex->nxt_held )
+    {
+        if ( (mutex->flags & MU_PRIO_PROTECT) && (mutex->ceiling > ceiling) )
+            ceiling = mutex->ceiling;
+    }
+
+    return( ceiling );
+}
+
+/*****************************************************************************
+** drop_from_ceiling - lowers the calling pthread from the ceiling of a
+**                     priority-protected mutex it has just released, to the
+**                     highest ceiling among those it still holds or else to
+**                     the priority it had before taking the first of them.
+*****************************************************************************/
+static void
+   drop_from_ceiling( void )
+{
+    struct sched_param param;
+    int policy;
+
+    policy = base_policy;
+    param = base_priority;
+    if ( held_mutex_ceiling() > param.sched_priority )
+    {
+        policy = SCHED_FIFO;
+        param.sched_priority = held_mutex_ceiling();
+    }
+    pthread_setschedparam( pthread_self(), policy, &param );
+}
+
+/*****************************************************************************
+** cleanup_held_mutexes - releases all mutexes held by a task which is being
+**                        killed, marking each one so that its next owner
+**                        learns that the state it protects may be
+**                        inconsistent.  Runs in the dying task's pthread.
+*****************************************************************************/
+void
+   cleanup_held_mutexes( void *tcb )
+{
+    p2pt_mutex_t *mutex;
+    pid_t tid;
+
+    tid = my_kernel_tid();
+
+    /*
+    **  If the task was killed while blocked in the kernel on a mutex, it may
+    **  have been handed ownership just before it died.
+    */
+    mutex = pending_mutex;
+    pending_mutex = (p2pt_mutex_t *)NULL;
+    if ( (mutex != (p2pt_mutex_t *)NULL) &&
+         ((mutex->lock_word & FUTEX_TID_MASK) == tid) )
+    {
+        mutex->owner_died = TRUE;
+        mutex->lock_count = 0;
+        release_futex( mutex, tid );
+    }
+
+    while ( held_mutexes != (p2pt_mutex_t *)NULL )
+    {
+        mutex = held_mutexes;
+        held_mutexes = mutex->nxt_held;
+        mutex->nxt_held = (p2pt_mutex_t *)NULL;
+#ifdef DIAG_PRINTFS
+        printf( "\r\ntask @ %p died holding mutex @ %p", tcb, mutex );
+#endif
+        mutex->owner_died = TRUE;
+        mutex->lock_count = 0;
+        release_futex( mutex, tid );
+    }
+}
+
+/*****************************************************************************
+** mu_create - creates a p2pthread mutex
+*****************************************************************************/
+ULONG
+    mu_create( char name[4], ULONG opt, ULONG ceiling, ULONG *muid )
+{
+    p2pt_mutex_t *mutex;
+    ULONG error;
+    int i;
+
+    /*
+    **  A mutex is owned by a kernel thread, which M:N tasks share.
+    */
+    if ( mn_caller() )
+        return( ERR_SSFN );
+
+    error = ERR_NO_ERROR;
+
+    /*
+    **  First allocate memory for the mutex control block
+    */
+    mutex = (p2pt_mutex_t *)ts_malloc( sizeof( p2pt_mutex_t ) );
+    if ( mutex != (p2pt_mutex_t *)NULL )
+    {
+        /*
+        **  Ok... got a control block.  Initialize it.
+        */
+
+        /*
+        ** Option Flags for mutex
+        */
+        mutex->flags = opt;
+
+        /*
+        ** Priority ceiling for a priority-protected mutex
+        */
+        mutex->ceiling = 0;
+        if ( opt & MU_PRIO_PROTECT )
+        {
+            mutex->ceiling = translate_priority( ceiling, SCHED_FIFO, &error );
+            if ( error != ERR_NO_ERROR )
+            {
+                ts_free( (void *)mutex );
+                return( error );
+            }
+        }
+
+        /*
+        ** ID for mutex
+        */
+        mutex->muid = new_muid();
+        if ( muid != (ULONG *)NULL )
+            *muid = mutex->muid;
+
+        /*
+        **  Name for mutex
+        */
+        for ( i = 0; i < 4; i++ )
+            mutex->mname[i] = name[i];
+
+#ifdef DIAG_PRINTFS
+        printf( "\r\nCreating mutex %c%c%c%c id %ld @ %p",
+                     mutex->mname[0], mutex->mname[1],
+                     mutex->mname[2], mutex->mname[3],
+                     mutex->muid, mutex );
+#endif
+
+        /*
+        ** The mutex is initially unlocked, with no owner history.
+        */
+        mutex->lock_word = 0;
+        mutex->lock_count = 0;
+        mutex->owner_died = FALSE;
+        mutex->nxt_held = (p2pt_mutex_t *)NULL;
+
+        /*
+        **  Link the new mutex into the mutex list.
+        */
+        link_mucb( mutex );
+        TRACE( TR_MUTEX | TR_CREATE, mutex->muid, opt );
+    }
+    else
+    {
+        error = ERR_NOMUCB;
+    }
+
+    return( error );
+}
+
+/*****************************************************************************
+** mu_delete - removes the specified mutex from the mutex list and frees
+**              the memory allocated for the mutex control block.
+**              A mutex locked by another task cannot be deleted, since
+**              the kernel offers no way to turn away its PI futex waiters.
+*****************************************************************************/
+ULONG
+   mu_delete( ULONG muid )
+{
+    p2pt_mutex_t *mutex;
+    pid_t tid;
+    ULONG error;
+
+    if ( mn_caller() )
+        return( ERR_SSFN );
+
+    error = ERR_NO_ERROR;
+
+    sched_lock();
+
+    if ( (mutex = mucb_for( muid )) != (p2pt_mutex_t *)NULL )
+    {
+        tid = my_kernel_tid();
+
+        if ( mutex->lock_word == tid )
+        {
+            /*
+            **  Caller holds the mutex and no other task is waiting for it...
+            **  Give up the caller's claim on it before deleting it.
+            */
+            unlink_held( mutex );
+            if ( mutex->flags & MU_PRIO_PROTECT )
+                drop_from_ceiling();
+        }
+        else if ( !__sync_bool_compare_and_swap( &(mutex->lock_word), 0, tid ) )
+        {
+            /*
+            **  Mutex is locked by another task or has tasks waiting on it.
+            */
+            error = ERR_MULOCKED;
+        }
+
+        if ( error == ERR_NO_ERROR )
+        {
+            /*
+            **  Caller now owns the unlocked mutex... remove it from the
+            **  mutex list and free its control block.
+            */
+            unlink_mucb( mutex->muid );
+            TRACE( TR_MUTEX | TR_DELETE, muid, 0 );
+            ts_free( (void *)mutex );
+        }
+    }
+    else
+    {
+        error = ERR_OBJDEL;       /* Invalid mutex specified */
+    }
+
+    sched_unlock();
+
+    return( error );
+}
+
+/*****************************************************************************
+** block_on_futex - blocks the calling task in the kernel on a PI futex
+**                  operation which ends with the task owning the mutex
+**                  (FUTEX_LOCK_PI, or FUTEX_WAIT_REQUEUE_PI on a condition
+**                  variable wait word).  The kernel lends our priority to
+**                  the mutex owner while we wait.  The task may be deleted
+**                  while it is blocked here.  Returns zero or an errno value.
+*****************************************************************************/
+static int
+   block_on_futex( p2pt_mutex_t *mutex, int op, volatile int *uaddr,
+                   struct timespec *timeoutp )
+{
+    int old_canceltype, result;
+
+    pending_mutex = mutex;
+    pthread_setcanceltype( PTHREAD_CANCEL_ASYNCHRONOUS, &old_canceltype );
+    do {
+        result = futex_op( uaddr, op | FUTEX_PRIVATE_FLAG, 0, timeoutp,
+                           &(mutex->lock_word), 0 );
+    } while ( (result != 0) && (errno == EINTR) );
+    pthread_setcanceltype( old_canceltype, (int *)NULL );
+    pending_mutex = (p2pt_mutex_t *)NULL;
+
+    return( (result == 0) ? 0 : errno );
+}
+
+/*****************************************************************************
+** took_mutex - records that the calling task now owns the specified mutex.
+**              Returns ERR_MUODIED if the previous owner died holding it.
+*****************************************************************************/
+static ULONG
+   took_mutex( p2pt_mutex_t *mutex, ULONG lock_count )
+{
+    ULONG error;
+
+    error = ERR_NO_ERROR;
+
+    mutex->lock_count = lock_count;
+    mutex->nxt_held = held_mutexes;
+    held_mutexes = mutex;
+
+    /*
+    **  Tell the caller if the previous owner task was killed while holding
+    **  the mutex.  The mutexes are not on any robust futex list, so a
+    **  pthread which exits outright holding one leaves it locked.
+    */
+    if ( mutex->owner_died )
+    {
+        mutex->owner_died = FALSE;
+        error = ERR_MUODIED;
+    }
+
+    return( error );
+}
+
+/*****************************************************************************
+** raise_to_ceiling - raises the calling task to the ceiling of the specified
+**                    priority-protected mutex, saving its previous policy
+**                    and priority for the caller.  A task whose own priority
+**                    is above the ceiling may not lock the mutex.
+*****************************************************************************/
+static ULONG
+   raise_to_ceiling( p2pt_mutex_t *mutex, int *policy,
+                     struct sched_param *param )
+{
+    p2pthread_cb_t *our_tcb;
+    struct sched_param ceiling_param;
+    int base_priority;
+
+    pthread_getschedparam( pthread_self(), policy, param );
+    our_tcb = my_tcb();
+    if ( our_tcb != (p2pthread_cb_t *)NULL )
+        base_priority = (our_tcb->prv_priority).sched_priority;
+    else
+        base_priority = param->sched_priority;
+    if ( base_priority > mutex->ceiling )
+        return( ERR_MUCEIL );
+
+    if ( param->sched_priority < mutex->ceiling )
+    {
+        ceiling_param.sched_priority = mutex->ceiling;
+        pthread_setschedparam( pthread_self(), SCHED_FIFO, &ceiling_param );
+    }
+
+    return( ERR_NO_ERROR );
+}
+
+/*****************************************************************************
+** mu_lock - locks the specified p2pthread mutex for the calling task,
+**           blocking if necessary until the mutex is unlocked by its owner.
+*****************************************************************************/
+ULONG
+   mu_lock( ULONG muid, ULONG opt, ULONG max_wait )
+{
+    p2pt_mutex_t *mutex;
+    p2pthread_cb_t *our_tcb;
+    struct timeval now;
+    struct timespec timeout;
+    struct timespec *timeoutp;
+    struct sched_param param;
+    int policy, result;
+    long sec, usec;
+    pid_t tid;
+    ULONG error;
+
+    if ( mn_caller() )
+        return( ERR_SSFN );
+
+    error = ERR_NO_ERROR;
+    policy = SCHED_FIFO;
+    param.sched_priority = 0;
+
+    if ( (mutex = mucb_for( muid )) == (p2pt_mutex_t *)NULL )
+        return( ERR_OBJDEL );
+
+    tid = my_kernel_tid();
+
+    /*
+    **  See if the caller already owns the mutex.
+    */
+    if ( (mutex->lock_word & FUTEX_TID_MASK) == tid )
+    {
+        if ( !(mutex->flags & MU_RECURSIVE) )
+            return( ERR_MURECURS );
+        mutex->lock_count++;
+        return( ERR_NO_ERROR );
+    }
+
+    /*
+    **  A priority-protected mutex raises the caller to the mutex ceiling
+    **  before the mutex is locked.
+    */
+    if ( mutex->flags & MU_PRIO_PROTECT )
+    {
+        if ( (error = raise_to_ceiling( mutex, &policy, &param )) !=
+             ERR_NO_ERROR )
+            return( error );
+    }
+
+    /*
+    **  Uncontended case... take the mutex without entering the kernel.
+    */
+    if ( !__sync_bool_compare_and_swap( &(mutex->lock_word), 0, tid ) )
+    {
+        if ( opt & MU_NOWAIT )
+        {
+            /*
+            **  Caller specified no wait on mutex.
+            */
+            error = ERR_NOMUTEX;
+        }
+        else
+        {
+            if ( max_wait == 0L )
+            {
+                /*
+                **  Infinite wait was specified.
+                */
+                timeoutp = (struct timespec *)NULL;
+            }
+            else
+            {
+                /*
+                **  FUTEX_LOCK_PI takes an absolute CLOCK_REALTIME timeout...
+                **  Calculate timeout delay in seconds and microseconds.
+                */
+                usec = max_wait * P2PT_TICK * 1000;
+                p2pt_time( &now );
+                usec += now.tv_usec;
+                sec = usec / 1000000;
+                usec = usec % 1000000;
+                timeout.tv_sec = now.tv_sec + sec;
+                timeout.tv_nsec = usec * 1000;
+                timeoutp = &timeout;
+            }
+
+            /*
+            **  Block in the kernel until the mutex is handed to us.
+            */
+            TRACE( TR_MUTEX | TR_BLOCK, muid, 0 );
+            our_tcb = my_tcb();
+            stat_block( our_tcb, WAIT_MUTEX );
+            result = block_on_futex( mutex, FUTEX_LOCK_PI,
+                                     &(mutex->lock_word), timeoutp );
+            TRACE( TR_MUTEX | ((result == ETIMEDOUT) ? TR_TIMEOUT : TR_WAKE),
+                   muid, 0 );
+            stat_unblock( our_tcb, (result == ETIMEDOUT) );
+            if ( result != 0 )
+            {
+                if ( result == ETIMEDOUT )
+                    error = ERR_TIMEOUT;
+                else
+                    error = ERR_OBJDEL;
+            }
+        }
+
+        if ( error != ERR_NO_ERROR )
+        {
+            /*
+            **  Didn't get the mutex... undo any ceiling priority boost.
+            */
+            if ( mutex->flags & MU_PRIO_PROTECT )
+                pthread_setschedparam( pthread_self(), policy, &param );
+#ifdef DIAG_PRINTFS
+            printf( "\r\nmutex @ %p lock failed, error %lx", mutex, error );
+#endif
+            return( error );
+        }
+    }
+
+    /*
+    **  Caller now owns the mutex.  If it is the first priority-protected
+    **  mutex the caller holds, remember the priority to drop back to.
+    */
+    if ( (mutex->flags & MU_PRIO_PROTECT) && (held_mutex_ceiling() == 0) )
+    {
+        base_policy = policy;
+        base_priority = param;
+    }
+
+    TRACE( TR_MUTEX | TR_RECEIVE, muid, 0 );
+
+    return( took_mutex( mutex, 1L ) );
+}
+
+/*****************************************************************************
+** mutex_wait_word - returns the futex word of the specified mutex, which
+**                   must be held by the calling task, for use as the requeue
+**                   target of a condition variable wait.
+*****************************************************************************/
+ULONG
+   mutex_wait_word( ULONG muid, volatile int **word )
+{
+    p2pt_mutex_t *mutex;
+
+    if ( (mutex = mucb_for( muid )) == (p2pt_mutex_t *)NULL )
+        return( ERR_OBJDEL );
+
+    if ( (mutex->lock_word & FUTEX_TID_MASK) != my_kernel_tid() )
+        return( ERR_MUNOTOWN );
+
+    *word = &(mutex->lock_word);
+
+    return( ERR_NO_ERROR );
+}
+
+/*****************************************************************************
+** mutex_cv_wait - releases the specified mutex (however deeply the calling
+**                 task has locked it) and waits on a condition variable wait
+**                 word with FUTEX_WAIT_REQUEUE_PI.  A signal hands the mutex
+**                 straight to the task, or requeues the task onto the mutex
+**                 without waking it if the mutex is busy.  The mutex is
+**                 always held again when this returns, even on timeout.
+*****************************************************************************/
+ULONG
+   mutex_cv_wait( ULONG muid, volatile int *cv_word,
+                  struct timespec *timeoutp )
+{
+    p2pt_mutex_t *mutex;
+    struct sched_param param;
+    ULONG lock_count;
+    ULONG error;
+    int policy, result;
+    pid_t tid;
+
+    if ( (mutex = mucb_for( muid )) == (p2pt_mutex_t *)NULL )
+        return( ERR_OBJDEL );
+
+    tid = my_kernel_tid();
+    if ( (mutex->lock_word & FUTEX_TID_MASK) != tid )
+        return( ERR_MUNOTOWN );
+
+    /*
+    **  Release the mutex completely, remembering the recursion depth.
+    */
+    lock_count = mutex->lock_count;
+    unlink_held( mutex );
+    if ( mutex->flags & MU_PRIO_PROTECT )
+    {
+        release_futex( mutex, tid );
+        drop_from_ceiling();
+    }
+    else
+        release_futex( mutex, tid );
+
+    /*
+    **  Wait for a signal.  The wait word is already nonzero if the task was
+    **  signalled before it got here, and the kernel returns EAGAIN at once.
+    */
+    error = ERR_NO_ERROR;
+    result = block_on_futex( mutex, FUTEX_WAIT_REQUEUE_PI | FUTEX_CLOCK_REALTIME,
+                             cv_word, timeoutp );
+    if ( result == ETIMEDOUT )
+        error = ERR_TIMEOUT;
+
+    /*
+    **  Unless the signal handed the mutex to us, lock it again now.
+    */
+    if ( (mutex->lock_word & FUTEX_TID_MASK) != tid )
+    {
+        while ( !__sync_bool_compare_and_swap( &(mutex->lock_word), 0, tid ) &&
+                (block_on_futex( mutex, FUTEX_LOCK_PI, &(mutex->lock_word),
+                                 (struct timespec *)NULL ) != 0) )
+            ;
+    }
+
+    /*
+    **  A priority-protected mutex takes its ceiling again once it is held.
+    */
+    if ( mutex->flags & MU_PRIO_PROTECT )
+    {
+        raise_to_ceiling( mutex, &policy, &param );
+        if ( held_mutex_ceiling() == 0 )
+        {
+            base_policy = policy;
+            base_priority = param;
+        }
+    }
+
+    if ( took_mutex( mutex, lock_count ) == ERR_MUODIED )
+        error = ERR_MUODIED;
+
+    return( error );
+}
+
+/*****************************************************************************
+** mu_unlock - unlocks the specified p2pthread mutex and hands it to the
+**             highest priority task waiting for it, if any.
+*****************************************************************************/
+ULONG
+   mu_unlock( ULONG muid )
+{
+    p2pt_mutex_t *mutex;
+    pid_t tid;
+
+    if ( mn_caller() )
+        return( ERR_SSFN );
+
+    if ( (mutex = mucb_for( muid )) == (p2pt_mutex_t *)NULL )
+        return( ERR_OBJDEL );
+
+    tid = my_kernel_tid();
+
+    /*
+    **  Only the owner may unlock a mutex.
+    */
+    if ( (mutex->lock_word & FUTEX_TID_MASK) != tid )
+        return( ERR_MUNOTOWN );
+
+    /*
+    **  A recursive lock is only released by the outermost unlock.
+    */
+    if ( --(mutex->lock_count) > 0 )
+        return( ERR_NO_ERROR );
+
+    unlink_held( mutex );
+    TRACE( TR_MUTEX | TR_SEND, muid, 0 );
+
+    /*
+    **  Once the mutex is released its next owner may delete it, so check
+    **  its flags before releasing it.
+    */
+    if ( mutex->flags & MU_PRIO_PROTECT )
+    {
+        release_futex( mutex, tid );
+
+        /*
+        **  Drop back to the highest ceiling still held, if any.
+        */
+        drop_from_ceiling();
+    }
+    else
+        release_futex( mutex, tid );
+
+    return( ERR_NO_ERROR );
+}
+
+/*****************************************************************************
+** mu_ident - identifies the specified p2pthread mutex
+*****************************************************************************/
+ULONG
+    mu_ident( char name[4], ULONG node, ULONG *muid )
+{
+    p2pt_mutex_t *current_mucb;
+    ULONG error;
+
+    if ( mn_caller() )
+        return( ERR_SSFN );
+
+    error = ERR_NO_ERROR;
+
+    /*
+    **  Validate the node specifier... only zero is allowed here.
+    */
+    if ( node != 0L )
+        error = ERR_NODENO;
+    else
+    {
+        /*
+        **  If mutex name string is a NULL pointer, return with error.
+        **  We'll ASSUME the muid pointer isn't NULL!
+        */
+        if ( name == (char *)NULL )
+        {
+            *muid = (ULONG)NULL;
+            error = ERR_OBJNF;
+        }
+        else
+        {
+            /*
+            **  Scan the mutex list for a name matching the caller's name.
+            */
+            for ( current_mucb = mutex_list;
+                  current_mucb != (p2pt_mutex_t *)NULL;
+                  current_mucb = current_mucb->nxt_mutex )
+            {
+                if ( (strncmp( name, current_mucb->mname, 4 )) == 0 )
+                {
+                    /*
+                    **  A matching name was found... return its MUID
+                    */
+                    *muid = current_mucb->muid;
+                    break;
+                }
+            }
+            if ( current_mucb == (p2pt_mutex_t *)NULL )
+            {
+                /*
+                **  No matching name found... return caller's MUID with error.
+                */
+                *muid = (ULONG)NULL;
+                error = ERR_OBJNF;
+            }
+        }
+    }
+
+    return( error );
+}
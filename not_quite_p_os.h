@@ -8,22 +8,46 @@
 #define USHORT          unsigned short
 #define UINT            unsigned int
 #define ULONG           unsigned long
+#define CV_FIFO         ((ULONG)0)
+#define CV_PRIOR        ((ULONG)2)
 
+#define EG_AUTOCLR      ((ULONG)1)
+#define EG_NOCLR        ((ULONG)0)
 #define EV_ALL          ((ULONG)0)
 #define EV_ANY          ((ULONG)2)
 #define EV_NOWAIT       ((ULONG)1)
 #define EV_WAIT         ((ULONG)0)
+#define MU_NORECURSIVE  ((ULONG)0)
+#define MU_RECURSIVE    ((ULONG)4)
+#define MU_PRIO_INHERIT ((ULONG)0)
+#define MU_PRIO_PROTECT ((ULONG)0x10)
+#define MU_NOWAIT       ((ULONG)1)
+#define MU_WAIT         ((ULONG)0)
 
+#define PT_CHECK        ((ULONG)0)
 #define PT_DEL          ((ULONG)4)
+#define PT_GROW         ((ULONG)0x20)
+#define PT_NOCHECK      ((ULONG)8)
 #define PT_NODEL        ((ULONG)0)
+#define PT_SHRINK       ((ULONG)0x40)
+#define PT_NODE(n)      (((ULONG)(n) + 1) << 16)
 
 #define Q_FIFO          ((ULONG)0)
+#define Q_INHERIT       ((ULONG)0x20)
 #define Q_LIMIT         ((ULONG)4)
 #define Q_NOLIMIT       ((ULONG)0)
 #define Q_NOWAIT        ((ULONG)1)
 #define Q_PRIOR         ((ULONG)2)
+#define Q_STAMP         ((ULONG)0x10)
 #define Q_WAIT          ((ULONG)0)
 
+#define RN_FIFO         ((ULONG)0)
+#define RN_PRIOR        ((ULONG)2)
+#define RN_DEL          ((ULONG)4)
+#define RN_NODEL        ((ULONG)0)
+#define RN_NOWAIT       ((ULONG)1)
+#define RN_WAIT         ((ULONG)0)
+
 #define SM_FIFO         ((ULONG)0)
 #define SM_PRIOR        ((ULONG)2)
 #define SM_NOWAIT       ((ULONG)1)
@@ -35,22 +59,47 @@
 #define T_NOTSLICE      ((ULONG)0)
 #define T_TSLICE        ((ULONG)2)
 
+ULONG cv_broadcast( ULONG cvid );
+ULONG cv_create( char name[4], ULONG opt, ULONG *cvid );
+ULONG cv_delete( ULONG cvid );
+ULONG cv_ident( char name[4], ULONG node, ULONG *cvid );
+ULONG cv_signal( ULONG cvid );
+ULONG cv_smwait( ULONG cvid, ULONG smid, ULONG max_wait );
+ULONG cv_wait( ULONG cvid, ULONG muid, ULONG max_wait );
+ULONG eg_clear( ULONG egid, ULONG events );
+ULONG eg_create( char name[4], ULONG opt, ULONG *egid );
+ULONG eg_delete( ULONG egid );
+ULONG eg_ident( char name[4], ULONG node, ULONG *egid );
+ULONG eg_receive( ULONG egid, ULONG mask, ULONG opt, ULONG max_wait,
+                  ULONG *captured );
+ULONG eg_send( ULONG egid, ULONG events );
 ULONG ev_receive( ULONG mask, ULONG opt, ULONG max_wait, ULONG *captured );
 ULONG ev_send( ULONG taskid, ULONG new_events );
+ULONG ev_send_isr( ULONG taskid, ULONG new_events );
+ULONG isr_errors( void );
 
+ULONG mu_create( char name[4], ULONG opt, ULONG ceiling, ULONG *muid );
+ULONG mu_delete( ULONG muid );
+ULONG mu_ident( char name[4], ULONG node, ULONG *muid );
+ULONG mu_lock( ULONG muid, ULONG opt, ULONG max_wait );
+ULONG mu_unlock( ULONG muid );
 ULONG pt_create( char name[4], void *paddr, void *laddr, ULONG length,
                  ULONG bsize, ULONG flags, ULONG *ptid, ULONG *nbuf );
 ULONG pt_delete( ULONG ptid );
 ULONG pt_getbuf( ULONG ptid, void **bufaddr );
 ULONG pt_ident( char name[4], ULONG node, ULONG *ptid );
 ULONG pt_retbuf( ULONG ptid, void *bufaddr );
+ULONG pt_setlimit( ULONG ptid, ULONG max_extents );
 
 ULONG q_broadcast( ULONG qid, ULONG msg[4], ULONG *count );
 ULONG q_create( char name[4], ULONG qsize, ULONG opt, ULONG *qid );
 ULONG q_delete( ULONG qid );
 ULONG q_ident( char name[4], ULONG node, ULONG *qid );
 ULONG q_receive( ULONG qid, ULONG opt, ULONG max_wait, ULONG msg[4] );
+ULONG q_receive_stamped( ULONG qid, ULONG opt, ULONG max_wait, ULONG msg[4],
+                         unsigned long long *sent_at );
 ULONG q_send( ULONG qid, ULONG msg[4] );
+ULONG q_send_isr( ULONG qid, ULONG msg[4] );
 ULONG q_urgent( ULONG qid, ULONG msg[4] );
 
 ULONG q_vcreate( char name[4], ULONG opt, ULONG qsize, ULONG msglen,
@@ -59,15 +108,41 @@ ULONG q_vdelete( ULONG qid );
 ULONG q_vident( char name[4], ULONG node, ULONG *qid );
 ULONG q_vreceive( ULONG qid, ULONG opt, ULONG max_wait, void *msgbuf,
                   ULONG buflen, ULONG *msglen );
+ULONG q_vreceive_stamped( ULONG qid, ULONG opt, ULONG max_wait, void *msgbuf,
+                          ULONG buflen, ULONG *msglen,
+                          unsigned long long *sent_at );
 ULONG q_vsend( ULONG qid, void *msgbuf, ULONG msglen );
 ULONG q_vurgent( ULONG qid, void *msgbuf, ULONG msglen );
 ULONG q_vbroadcast( ULONG qid, void *msgbuf, ULONG msglen, ULONG *tasks );
 
+typedef struct rn_stat
+{
+    ULONG total_bytes;
+    ULONG free_bytes;
+    ULONG min_free;
+    ULONG used_segs;
+    ULONG free_blocks;
+    ULONG largest_free;
+    ULONG frag_pct;
+} rn_stat_t;
+
+ULONG rn_create( char name[4], void *saddr, ULONG length, ULONG unit_size,
+                 ULONG flags, ULONG *rnid, ULONG *asiz );
+ULONG rn_delete( ULONG rnid );
+ULONG rn_getseg( ULONG rnid, ULONG size, ULONG flags, ULONG max_wait,
+                 void **seg_addr );
+ULONG rn_ident( char name[4], ULONG node, ULONG *rnid );
+ULONG rn_retseg( ULONG rnid, void *seg_addr );
+ULONG rn_stats( ULONG rnid, rn_stat_t *stats );
+
 ULONG sm_create( char name[4], ULONG count, ULONG opt, ULONG *smid );
 ULONG sm_delete( ULONG smid );
 ULONG sm_ident( char name[4], ULONG node, ULONG *smid );
 ULONG sm_p( ULONG smid, ULONG opt, ULONG max_wait );
+ULONG sm_pn( ULONG smid, ULONG tokens, ULONG opt, ULONG max_wait );
 ULONG sm_v( ULONG smid );
+ULONG sm_v_isr( ULONG smid );
+ULONG sm_vn( ULONG smid, ULONG tokens );
 
 ULONG t_create( char name[4], ULONG pri, ULONG sstack, ULONG ustack,
                ULONG mode, ULONG *tid );
@@ -84,3 +159,66 @@ ULONG t_suspend( ULONG tid );
 
 ULONG tm_wkafter( ULONG interval );
 
+typedef struct lk_info
+{
+    const char *obj_class;
+    ULONG objid;
+    char objname[4];
+    const char *lock_name;
+    ULONG acquires;
+    ULONG contended;
+    unsigned long long wait_ns;
+    unsigned long long max_wait_ns;
+    unsigned long long hold_ns;
+    unsigned long long max_hold_ns;
+    ULONG cv_waits;
+    unsigned long long cv_wait_ns;
+} lk_info_t;
+
+void lk_start( void );
+void lk_stop( void );
+ULONG lk_stats( lk_info_t info[], ULONG max_locks );
+ULONG lk_dump( int fd );
+ULONG lk_dump_on( int signo );
+
+void tr_start( void );
+void tr_stop( void );
+ULONG tr_dump( const char *filename );
+
+void sim_start( ULONG seed );
+ULONG sim_run( ULONG max_ticks );
+ULONG sim_ticks( void );
+
+#define MN_STEAL        ((ULONG)1)
+
+ULONG mn_start( ULONG workers, ULONG opt );
+
+#define P2PT_MLOCK_NONE     0
+#define P2PT_MLOCK_CURRENT  1
+#define P2PT_MLOCK_ALL      2
+
+typedef struct p2pt_config
+{
+    ULONG max_tasks;
+    ULONG max_queues;
+    ULONG max_sema4s;
+    ULONG max_partitions;
+    ULONG tick_ms;
+    ULONG mlock;
+} p2pt_config_t;
+
+ULONG p2linux_init( const p2pt_config_t *config );
+
+typedef struct ts_mstat
+{
+    ULONG blk_size;
+    ULONG slab_bytes;
+    ULONG allocs;
+    ULONG frees;
+    ULONG in_use;
+} ts_mstat_t;
+
+void *ts_malloc( size_t blksize );
+void ts_free( void *blkaddr );
+ULONG ts_mstats( ts_mstat_t stats[], ULONG max_classes );
+
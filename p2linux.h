@@ -6,20 +6,47 @@
 #define UINT            unsigned int
 #define ULONG           unsigned long
 
+#define CV_FIFO         ((ULONG)0)
+#define CV_PRIOR        ((ULONG)2)
+
+#define EG_AUTOCLR      ((ULONG)1)
+#define EG_NOCLR        ((ULONG)0)
+
 #define EV_ALL          ((ULONG)0)
 #define EV_ANY          ((ULONG)2)
 #define EV_NOWAIT       ((ULONG)1)
 #define EV_WAIT         ((ULONG)0)
 
+#define MU_NORECURSIVE  ((ULONG)0)
+#define MU_RECURSIVE    ((ULONG)4)
+#define MU_PRIO_INHERIT ((ULONG)0)
+#define MU_PRIO_PROTECT ((ULONG)0x10)
+#define MU_NOWAIT       ((ULONG)1)
+#define MU_WAIT         ((ULONG)0)
+
 #define PT_LOCAL        ((ULONG)0)
 #define PT_DEL          ((ULONG)4)
 #define PT_NODEL        ((ULONG)0)
+#define PT_NOCHECK      ((ULONG)8)
+#define PT_CHECK        ((ULONG)0)
+#define PT_GROW         ((ULONG)0x20)
+#define PT_SHRINK       ((ULONG)0x40)
+#define PT_NODE(n)      (((ULONG)(n) + 1) << 16)
+
+#define RN_FIFO         ((ULONG)0)
+#define RN_PRIOR        ((ULONG)2)
+#define RN_DEL          ((ULONG)4)
+#define RN_NODEL        ((ULONG)0)
+#define RN_NOWAIT       ((ULONG)1)
+#define RN_WAIT         ((ULONG)0)
 
 #define Q_FIFO          ((ULONG)0)
+#define Q_INHERIT       ((ULONG)0x20)
 #define Q_LIMIT         ((ULONG)4)
 #define Q_NOLIMIT       ((ULONG)0)
 #define Q_NOWAIT        ((ULONG)1)
 #define Q_PRIOR         ((ULONG)2)
+#define Q_STAMP         ((ULONG)0x10)
 #define Q_WAIT          ((ULONG)0)
 
 #define SM_FIFO         ((ULONG)0)
@@ -42,6 +69,19 @@
 void *ts_malloc( size_t blksize );  
 /* thread-safe free. */
 void ts_free( void *blkaddr );
+/* allocation statistics for one ts_malloc size class. */
+typedef struct ts_mstat
+{
+    ULONG blk_size;     /* block size of class (0 for blocks from malloc) */
+    ULONG slab_bytes;   /* bytes of slab memory carved for class */
+    ULONG allocs;       /* total blocks allocated */
+    ULONG frees;        /* total blocks freed */
+    ULONG in_use;       /* blocks currently allocated */
+} ts_mstat_t;
+/* fills in statistics for up to 'max_classes' ts_malloc size classes,
+   the last for blocks too large for any class.  Returns the number of
+   entries filled in (15 at most). */
+ULONG ts_mstats( ts_mstat_t stats[], ULONG max_classes );
 /* 'locks the scheduler' to prevent preemption of the 
    current task by other task-level code. You can use
    it in some urgent functions that needed to be 
@@ -105,18 +145,58 @@ ULONG ev_receive( ULONG mask, ULONG opt, ULONG max_wait, ULONG *captured );
 
 /* creates a new memory management area from which fixed-size
    data blocks may be allocated for applications use.
-   Note:  the arg 'laddr' is not used here, and it depends on 
-   youself to decide the 'paddr' value. */
+   Note:  the arg 'laddr' is not used here.  If 'paddr' is NULL, the
+   library maps the memory itself, on hugepages where possible, locked
+   and prefaulted, and on NUMA node n if PT_NODE(n) is in 'flags'. */
 ULONG pt_create( char name[4], void *paddr, void *laddr, ULONG length,
                  ULONG bsize, ULONG flags, ULONG *ptid, ULONG *nbuf );
 /* removes the specified partition from the memory. */
 ULONG pt_delete( ULONG ptid );
 /* obtains a free data buffer from the specified memory partition. */
 ULONG pt_getbuf( ULONG ptid, void **bufaddr );
-/* releases a data buffer back to the specified memory partition. */
+/* releases a data buffer back to the specified memory partition.
+   Returns 0x2F if the buffer is already free, unless the partition
+   was created with PT_NOCHECK. */
 ULONG pt_retbuf( ULONG ptid, void *bufaddr );
+/* sets the maximum number of extents (16 by default) a partition created
+   with PT_GROW may have.  Each extent added when the partition runs dry
+   is the size of the first, and with PT_SHRINK is given back to the
+   system when all its blocks are free again and at least as many are
+   free in the rest of the partition. */
+ULONG pt_setlimit( ULONG ptid, ULONG max_extents );
 /* identifies the named p2pthread partition. */
 ULONG pt_ident( char name[4], ULONG node, ULONG *ptid );
+/* creates a memory region from which variable-size segments may be
+   allocated in bounded time.  'unit_size' must be a power of two, 16 or
+   more; segments start on unit boundaries.  If 'saddr' is NULL, the
+   library maps the memory itself.  The bytes available for segments are
+   returned in 'asiz'. */
+ULONG rn_create( char name[4], void *saddr, ULONG length, ULONG unit_size,
+                 ULONG flags, ULONG *rnid, ULONG *asiz );
+/* removes the specified region.  Returns 0x1F if segments are still
+   allocated from it, unless it was created with RN_DEL. */
+ULONG rn_delete( ULONG rnid );
+/* allocates a segment of at least 'size' bytes from the specified region,
+   waiting up to 'max_wait' ticks (forever if 0) unless RN_NOWAIT. */
+ULONG rn_getseg( ULONG rnid, ULONG size, ULONG flags, ULONG max_wait,
+                 void **seg_addr );
+/* returns a segment to the specified region. */
+ULONG rn_retseg( ULONG rnid, void *seg_addr );
+/* allocation and fragmentation statistics for a region. */
+typedef struct rn_stat
+{
+    ULONG total_bytes;  /* bytes available for segments when region empty */
+    ULONG free_bytes;   /* bytes in free blocks, headers included */
+    ULONG min_free;     /* lowest free_bytes has been since rn_create */
+    ULONG used_segs;    /* segments currently allocated */
+    ULONG free_blocks;  /* number of free blocks */
+    ULONG largest_free; /* largest segment which could be allocated now */
+    ULONG frag_pct;     /* percent of free bytes not in the largest block */
+} rn_stat_t;
+/* returns allocation and fragmentation statistics for a region. */
+ULONG rn_stats( ULONG rnid, rn_stat_t *stats );
+/* identifies the named p2pthread region. */
+ULONG rn_ident( char name[4], ULONG node, ULONG *rnid );
 
 /*
 **  pSOS+ queue related functions.
@@ -134,6 +214,11 @@ ULONG q_ident( char name[4], ULONG node, ULONG *qid );
 /* blocks the calling task until a message is available in the
    specified p2pthread queue. */
 ULONG q_receive( ULONG qid, ULONG opt, ULONG max_wait, ULONG msg[4] );
+/* receives as q_receive(), and returns in 'sent_at' the CLOCK_MONOTONIC
+   time in nanoseconds at which the message was sent, if the queue was
+   created with Q_STAMP (else zero). */
+ULONG q_receive_stamped( ULONG qid, ULONG opt, ULONG max_wait, ULONG msg[4],
+                         unsigned long long *sent_at );
 /* posts a message to the tail of a p2pthread queue and awakens the
    first selected task waiting on the queue. */
 ULONG q_send( ULONG qid, ULONG msg[4] );
@@ -141,6 +226,68 @@ ULONG q_send( ULONG qid, ULONG msg[4] );
    first selected task waiting on the queue. */
 ULONG q_urgent( ULONG qid, ULONG msg[4] );
 
+#define Q_RES_BUCKETS   24
+#define Q_SAMPLE_RATE   16
+
+/* depth and traffic statistics of a queue or variable-length queue.
+   Residence is timed for one message in Q_SAMPLE_RATE, or for every
+   message of a queue created with Q_STAMP. */
+typedef struct q_info
+{
+    ULONG qid;               /* ID of queue */
+    char qname[4];           /* name of queue */
+    ULONG flags;             /* option flags of queue */
+    ULONG depth;             /* messages now queued */
+    ULONG high_water;        /* most messages ever queued at once */
+    ULONG limit;             /* length limit (0 if none) */
+    ULONG waiters;           /* tasks pended on queue */
+    ULONG sends;             /* successful sends */
+    ULONG urgents;           /* successful urgent sends */
+    ULONG broadcasts;        /* broadcasts which sent a message */
+    ULONG receives;          /* messages received */
+    ULONG timeouts;          /* receives which timed out */
+    ULONG full_errors;       /* sends refused with ERR_QFULL */
+    ULONG extents;           /* extents of message storage allocated */
+    ULONG residence[Q_RES_BUCKETS]; /* sampled messages by time queued...
+                                       bucket 0 under 1 usec, bucket n from
+                                       2^(n-1) usec */
+    unsigned long long max_residence_ns; /* longest sampled time queued */
+} q_info_t;
+/* fills in the depth and traffic statistics of a p2pthread queue. */
+ULONG q_info( ULONG qid, q_info_t *info );
+
+/*
+**  pSOS+ variable-length queue related functions.
+*/
+
+/* creates a p2pthread queue of up to 'qsize' messages of 1 to 'msglen'
+   bytes. */
+ULONG q_vcreate( char name[4], ULONG opt, ULONG qsize, ULONG msglen,
+                 ULONG *qid );
+/* deletes a p2pthread variable-length queue. */
+ULONG q_vdelete( ULONG qid );
+/* identifies the specified p2pthread variable-length queue. */
+ULONG q_vident( char name[4], ULONG node, ULONG *qid );
+/* blocks the calling task until a message is available in the
+   specified variable-length queue.  The message length is returned
+   in 'msglen'. */
+ULONG q_vreceive( ULONG qid, ULONG opt, ULONG max_wait, void *msgbuf,
+                  ULONG buflen, ULONG *msglen );
+/* receives as q_vreceive(), and returns the message's send time as
+   q_receive_stamped() does. */
+ULONG q_vreceive_stamped( ULONG qid, ULONG opt, ULONG max_wait, void *msgbuf,
+                          ULONG buflen, ULONG *msglen,
+                          unsigned long long *sent_at );
+/* posts a message to the tail of a variable-length queue. */
+ULONG q_vsend( ULONG qid, void *msgbuf, ULONG msglen );
+/* sends a message to the front of a variable-length queue. */
+ULONG q_vurgent( ULONG qid, void *msgbuf, ULONG msglen );
+/* sends a copy of the message to every task waiting on a variable-length
+   queue. */
+ULONG q_vbroadcast( ULONG qid, void *msgbuf, ULONG msglen, ULONG *tasks );
+/* fills in the depth and traffic statistics of a variable-length queue. */
+ULONG q_vinfo( ULONG qid, q_info_t *info );
+
 /*
 **  pSOS+ sema4 related functions.
 */
@@ -158,6 +305,377 @@ ULONG sm_p( ULONG smid, ULONG opt, ULONG max_wait );
 /* releases a p2pthread semaphore token and awakens the first selected
    task waiting on the semaphore. */
 ULONG sm_v( ULONG smid );
+/* blocks the calling task until the specified number of tokens can be
+   taken at once from the specified p2pthread semaphore.  A request for
+   zero tokens returns ERR_ZERO (0x20). */
+ULONG sm_pn( ULONG smid, ULONG tokens, ULONG opt, ULONG max_wait );
+/* releases the specified number of tokens to a p2pthread semaphore and
+   awakens the waiting tasks whose requests can now be satisfied.
+   Releasing zero tokens returns ERR_ZERO (0x20). */
+ULONG sm_vn( ULONG smid, ULONG tokens );
+
+/*
+**  pSOS+ mutex related functions.
+*/
+
+/* creates a p2pthread mutex.  Every mutex lends the priority of its
+   highest priority waiter to its owner; a MU_PRIO_PROTECT mutex also
+   raises its owner to the 'ceiling' priority while it is held. */
+ULONG mu_create( char name[4], ULONG opt, ULONG ceiling, ULONG *muid );
+/* removes the specified mutex from the mutex list and frees the memory
+   allocated for the mutex control block.  Fails if another task holds it. */
+ULONG mu_delete( ULONG muid );
+/* identifies the specified p2pthread mutex. */
+ULONG mu_ident( char name[4], ULONG node, ULONG *muid );
+/* locks the specified p2pthread mutex, blocking the calling task until
+   it is unlocked by its owner.  Returns 0x86 with the mutex locked if the
+   previous owner was deleted while holding it. */
+ULONG mu_lock( ULONG muid, ULONG opt, ULONG max_wait );
+/* unlocks the specified p2pthread mutex and hands it to the highest
+   priority task waiting for it. */
+ULONG mu_unlock( ULONG muid );
+
+/*
+**  Condition variable related functions.
+*/
+
+/* creates a p2pthread condition variable.  Waiting tasks are signalled
+   in CV_FIFO or CV_PRIOR order. */
+ULONG cv_create( char name[4], ULONG opt, ULONG *cvid );
+/* removes the specified condition variable and wakes any waiting tasks. */
+ULONG cv_delete( ULONG cvid );
+/* identifies the specified p2pthread condition variable. */
+ULONG cv_ident( char name[4], ULONG node, ULONG *cvid );
+/* unlocks the specified mutex and blocks the calling task until the
+   condition variable is signalled.  The mutex is held again on return. */
+ULONG cv_wait( ULONG cvid, ULONG muid, ULONG max_wait );
+/* releases a token to the specified semaphore and blocks the calling task
+   until the condition variable is signalled.  A token is taken again
+   before return. */
+ULONG cv_smwait( ULONG cvid, ULONG smid, ULONG max_wait );
+/* wakes the first selected task waiting on the condition variable. */
+ULONG cv_signal( ULONG cvid );
+/* wakes all tasks waiting on the condition variable.  Tasks waiting with
+   a mutex are moved onto the mutex and run one at a time as it is freed. */
+ULONG cv_broadcast( ULONG cvid );
+
+/*
+**  Event group related functions.
+*/
+
+/* creates a p2pthread event group with all flags clear.  With EG_AUTOCLR,
+   flags which satisfy a waiting task are cleared after it is awakened. */
+ULONG eg_create( char name[4], ULONG opt, ULONG *egid );
+/* removes the specified event group and wakes any waiting tasks. */
+ULONG eg_delete( ULONG egid );
+/* identifies the specified p2pthread event group. */
+ULONG eg_ident( char name[4], ULONG node, ULONG *egid );
+/* sets flags in the event group and wakes every task whose EV_ANY or
+   EV_ALL mask is now satisfied. */
+ULONG eg_send( ULONG egid, ULONG events );
+/* clears flags in the event group. */
+ULONG eg_clear( ULONG egid, ULONG events );
+/* blocks the calling task until the mask is satisfied in the event group.
+   Up to 32 flags are supported. */
+ULONG eg_receive( ULONG egid, ULONG mask, ULONG opt, ULONG max_wait,
+                  ULONG *captured );
+
+/*
+**  Trace related functions.  Each thread records the API operations it makes
+**  in a ring of its own holding its last 8192 events.
+*/
+
+/* discards the events recorded so far and starts tracing. */
+void tr_start( void );
+/* stops tracing, keeping the events recorded. */
+void tr_stop( void );
+/* writes the recorded events to the named file as Chrome / Perfetto trace
+   JSON.  Returns 0 or an errno value. */
+ULONG tr_dump( const char *filename );
+
+/*
+**  Lock profiler related functions.  While profiling, every mutex used
+**  inside p2pthread objects counts its acquisitions and contention and
+**  times its waits and holds, attributed to the object owning it.
+*/
+
+/* contention statistics for one internal mutex. */
+typedef struct lk_info
+{
+    const char *obj_class;   /* class of owning object ("queue", ...) */
+    ULONG objid;             /* ID of owning object (0 for a list) */
+    char objname[4];         /* name of owning object */
+    const char *lock_name;   /* name of mutex within object */
+    ULONG acquires;          /* times mutex was locked */
+    ULONG contended;         /* times mutex was found already locked */
+    unsigned long long wait_ns;     /* total nsec waiting to lock it */
+    unsigned long long max_wait_ns; /* longest wait to lock it */
+    unsigned long long hold_ns;     /* total nsec it was held */
+    unsigned long long max_hold_ns; /* longest time it was held */
+    ULONG cv_waits;          /* condition variable waits made with it */
+    unsigned long long cv_wait_ns;  /* total nsec spent in those waits */
+} lk_info_t;
+/* clears the statistics of all mutexes and starts profiling. */
+void lk_start( void );
+/* stops profiling, keeping the statistics gathered. */
+void lk_stop( void );
+/* fills in statistics for up to 'max_locks' mutexes, those waited on
+   longest first.  Mutexes of deleted objects are summed into one entry
+   per class.  Returns the number of entries filled in. */
+ULONG lk_stats( lk_info_t info[], ULONG max_locks );
+/* writes a table of the statistics to a file descriptor.  Returns 0 or
+   an errno value. */
+ULONG lk_dump( int fd );
+/* writes the table to stderr whenever the process receives 'signo'.
+   Returns 0 or an errno value. */
+ULONG lk_dump_on( int signo );
+
+/*
+**  Task statistics related functions.  Each task times its own waits, by
+**  what it waited on, and the latency from being made ready (or from the
+**  end of a delay) until it runs again.  CPU time, context switches and
+**  page faults are read from the kernel when the statistics are taken.
+*/
+
+/* WAIT_ codes of what a task is blocked or suspended on. */
+#define WAIT_READY      0
+#define WAIT_TSTRT      1
+#define WAIT_TSUSP      2
+#define WAIT_DELAY      3
+#define WAIT_ATIME      4
+#define WAIT_MUTEX      5
+#define WAIT_QUEUE      6
+#define WAIT_VQUE       7
+#define WAIT_SEMAP      8
+#define WAIT_EVENT      9
+#define WAIT_REGION     10
+#define WAIT_CONDV      11
+#define WAIT_NREASONS   12
+
+#define T_WAKE_BUCKETS  24
+
+/* scheduling and latency statistics for one task. */
+typedef struct t_stat
+{
+    ULONG taskid;            /* ID of task */
+    char taskname[4];        /* name of task */
+    int wait_reason;         /* WAIT_ code now (WAIT_READY if running) */
+    unsigned long long cpu_ns;      /* CPU time (zero for M:N tasks) */
+    ULONG vol_switches;      /* context switches made blocking */
+    ULONG invol_switches;    /* context switches made by preemption */
+    ULONG minor_faults;      /* page faults not needing I/O */
+    ULONG major_faults;      /* page faults needing I/O */
+    ULONG blocks[WAIT_NREASONS];    /* waits which blocked, by WAIT_ code */
+    unsigned long long blocked_ns[WAIT_NREASONS]; /* nsec blocked, by code */
+    ULONG wake_latency[T_WAKE_BUCKETS]; /* wakeups by latency... bucket 0
+                                           under 1 usec, bucket n from
+                                           2^(n-1) usec */
+    unsigned long long max_wake_ns; /* longest wakeup latency */
+} t_stat_t;
+/* fills in the statistics of the specified task (the calling task if tid
+   is zero).  Returns 0x05 if the task is deleted before they are read. */
+ULONG t_stats( ULONG tid, t_stat_t *stats );
+/* fills in the statistics of up to 'max_tasks' tasks, leaving out any
+   deleted before theirs are read.  Returns the number of entries filled
+   in. */
+ULONG t_stats_all( t_stat_t stats[], ULONG max_tasks );
+
+/*
+**  Stats page related functions.  sp_start() publishes a shared-memory page
+**  listing every task, queue, vqueue, semaphore and partition, which a
+**  thread of its own rewrites periodically.  Monitors such as p2top map it
+**  read-only and take consistent copies without taking any lock.
+*/
+
+#define SP_TASK         1
+#define SP_QUEUE        2
+#define SP_VQUEUE       3
+#define SP_SEMA4        4
+#define SP_PRTN         5
+
+#define SP_MAGIC        0x70327370
+#define SP_VERSION      1
+
+/* one object's entry in the stats page. */
+typedef struct sp_object
+{
+    ULONG obj_class;         /* SP_ class of object */
+    ULONG objid;             /* ID of object */
+    char objname[4];         /* name of object */
+    int state;               /* WAIT_ code of a task */
+    ULONG priority;          /* priority of a task */
+    ULONG depth;             /* messages queued, tokens available, or
+                                blocks off the free list */
+    ULONG limit;             /* queue length limit (0 if none), or
+                                total blocks */
+    ULONG waiters;           /* tasks pended on object */
+    ULONG free_blocks;       /* free blocks of a partition */
+    ULONG puts;              /* messages sent, tokens released, blocks
+                                returned, or waits a task blocked in */
+    ULONG gets;              /* messages received, tokens granted, blocks
+                                taken, or wakeups of a task timed */
+} sp_object_t;
+
+/* the stats page.  'seq' is odd while the page is being rewritten; a copy
+   is consistent if 'seq' was the same even number before and after it. */
+typedef struct sp_page
+{
+    ULONG magic;             /* SP_MAGIC once the page is ready */
+    ULONG version;           /* SP_VERSION */
+    volatile ULONG seq;      /* odd while the page is being rewritten */
+    ULONG pid;               /* process publishing the page */
+    ULONG period_ms;         /* milliseconds between updates */
+    ULONG max_objects;       /* entries the page has room for */
+    ULONG count;             /* entries now in objects[] */
+    ULONG dropped;           /* objects left out for lack of room */
+    ULONG updates;           /* times the page has been rewritten */
+    unsigned long long stamp_ns;    /* CLOCK_REALTIME of last update */
+    sp_object_t objects[1];  /* tasks, queues, vqueues, semaphores, then
+                                partitions */
+} sp_page_t;
+/* creates the shared-memory stats page 'name' (by default
+   "/p2linux.<pid>") with room for 'max_objects' objects (default 256),
+   and starts a thread which rewrites it every 'period_ms' milliseconds
+   (default 1000).  Returns 0 or an errno value. */
+ULONG sp_start( const char *name, ULONG max_objects, ULONG period_ms );
+/* stops updating the stats page and removes it.  Returns 0 or an errno
+   value. */
+ULONG sp_stop( void );
+
+/*
+**  Simulation related functions.  In simulation mode the tasks run one at a
+**  time, switching only when they block or make a p2pthread call which may
+**  ready a higher priority task, and all timeouts and delays are measured
+**  on a virtual clock.  Whenever every task is blocked the clock jumps to
+**  the next pending timeout, so a test which mostly waits runs as fast as
+**  its tasks can compute.  Runs with the same seed make the same choices.
+*/
+
+/* enters simulation mode.  Tasks started from then on run only inside
+   sim_run().  A nonzero seed breaks ties between ready tasks of equal
+   priority pseudo-randomly; zero runs them in the order they blocked. */
+void sim_start( ULONG seed );
+/* runs the simulated tasks until all have been deleted (returns 0), all
+   are blocked with no timeout pending (returns 0x95), or 'max_ticks' of
+   virtual time have passed (returns 0x01).  Zero 'max_ticks' sets no limit.
+   Returns 0x96 if sim_start() was never called.  Called by the pthread
+   which started the tasks, never by a task; it may be called again to
+   resume a run which hit its limit. */
+ULONG sim_run( ULONG max_ticks );
+/* returns the virtual time in ticks since sim_start() was called. */
+ULONG sim_ticks( void );
+
+/*
+**  M:N scheduler related functions.  In M:N mode each task runs as a
+**  user-space context on one of a few worker pthreads, which switch between
+**  tasks without entering the kernel scheduler when a task blocks on a
+**  queue, semaphore, region, event or event group, delays, or makes a call
+**  which readies a higher priority task.  A task which never makes such a
+**  call keeps its worker.  Mutexes (mu_) and condition variables (cv_) rely
+**  on kernel thread identity, and their calls return 0x0B to M:N tasks.  An
+**  M:N task's own pthread cleanup handlers must be compiled with -fexceptions
+**  like the library, since the task may resume on another worker while one
+**  is pushed.
+*/
+
+#define MN_STEAL 0x1    /* Idle workers run tasks waiting for busy ones */
+
+/* starts 'workers' worker pthreads (zero for one per online CPU) and enters
+   M:N mode, in which tasks started from then on run on the workers.  Each
+   task starts on the next worker in turn and stays there unless 'opt'
+   includes MN_STEAL.  Returns 0x97 if already in M:N or simulation mode,
+   or an errno value if no worker could be started. */
+ULONG mn_start( ULONG workers, ULONG opt );
+
+/*
+**  Startup configuration.  p2linux_init() may be called once, before any
+**  object is created, to cap the number of objects of each class, reserve
+**  their control blocks up front and lock the process's memory.
+*/
+
+#define P2PT_MLOCK_NONE     0   /* Leave memory pageable */
+#define P2PT_MLOCK_CURRENT  1   /* Lock the pages mapped at init */
+#define P2PT_MLOCK_ALL      2   /* Also lock pages mapped later */
+
+typedef struct p2pt_config
+{
+    ULONG
+        max_tasks;       /* Maximum number of tasks (0 for no limit) */
+    ULONG
+        max_queues;      /* Maximum number of message queues */
+    ULONG
+        max_sema4s;      /* Maximum number of semaphores */
+    ULONG
+        max_partitions;  /* Maximum number of partitions */
+    ULONG
+        tick_ms;         /* Milliseconds per tick (0 to keep the default) */
+    ULONG
+        mlock;           /* P2PT_MLOCK_NONE, _CURRENT or _ALL */
+} p2pt_config_t;
+
+/* sets the maximum numbers of tasks, queues, semaphores and partitions
+   (zero for no limit), carves and prefaults storage for all their control
+   blocks so that creating objects within the limits never calls malloc(),
+   then sets the tick length and locks memory as configured.  Creating one
+   object too many returns the same error as running out of memory.
+   Returns 0 or an errno value, EBUSY if called before or after any task,
+   queue, semaphore or partition was created. */
+ULONG p2linux_init( const p2pt_config_t *config );
+
+/*
+**  Static configuration.  The tasks, queues, semaphores and partitions
+**  declared in the configuration table built into the library (p2ptconf.h,
+**  or the file named by P2PT_CONFIG) exist before main() is called.  Their
+**  IDs are given in table order from 1 for each class, and are defined here
+**  by the identifiers in the table.
+*/
+
+enum p2pt_static_tids
+{
+    P2PT_TID_NONE,
+#define P2PT_TASK( id, name, priority, sstack, ustack, flags ) id,
+#include "p2ptstatic.h"
+};
+
+enum p2pt_static_qids
+{
+    P2PT_QID_NONE,
+#define P2PT_QUEUE( id, name, count, flags ) id,
+#include "p2ptstatic.h"
+};
+
+enum p2pt_static_smids
+{
+    P2PT_SMID_NONE,
+#define P2PT_SEMA4( id, name, count, flags ) id,
+#include "p2ptstatic.h"
+};
+
+enum p2pt_static_ptids
+{
+    P2PT_PTID_NONE,
+#define P2PT_PARTITION( id, name, length, bsize, flags ) id,
+#include "p2ptstatic.h"
+};
+
+/*
+**  ISR-context send functions.  These take no locks, allocate no memory and
+**  record no trace events... each only queues its send for a dispatch thread
+**  to make, so they may be called from signal handlers and from threads
+**  which are not p2pthread tasks.
+*/
+
+/* queues the setting of flag bits in a p2pthread task event group for the
+   ISR dispatch thread.  Returns 0x94 if the dispatch ring is full. */
+ULONG ev_send_isr( ULONG taskid, ULONG new_events );
+/* queues a message for the ISR dispatch thread to send to a p2pthread
+   queue.  Returns 0x94 if the dispatch ring is full. */
+ULONG q_send_isr( ULONG qid, ULONG msg[4] );
+/* queues a token release for the ISR dispatch thread to make to a
+   p2pthread semaphore.  Returns 0x94 if the dispatch ring is full. */
+ULONG sm_v_isr( ULONG smid );
+/* returns the number of deferred ISR sends which failed when made. */
+ULONG isr_errors( void );
 
 
 
@@ -0,0 +1,36 @@
+/*****************************************************************************
+ * p2ptconf.h - static configuration table of p2pthread objects
+ *
+ * Tasks, queues, semaphores and partitions declared here are laid out in
+ * static storage when the library is built and exist before main() is
+ * called, without any call to malloc().  Each entry takes the same
+ * arguments as the call which would otherwise create the object, preceded
+ * by an identifier which p2linux.h defines as the object's ID.  IDs are
+ * given in table order from 1 for each class, and objects created at
+ * runtime are numbered after them.
+ *
+ *   P2PT_TASK( id, name, priority, sstack, ustack, flags )
+ *   P2PT_QUEUE( id, name, count, flags )
+ *   P2PT_SEMA4( id, name, count, flags )
+ *   P2PT_PARTITION( id, name, length, bsize, flags )
+ *
+ * Tasks are created suspended and run once started with t_start().  Queues
+ * hold 'count' messages in static storage, and partitions 'length' bytes
+ * of 'bsize' byte blocks.  Static objects may be deleted, but their
+ * storage is not reused.
+ *
+ * p2ptstatic.h includes this file several times with different definitions
+ * of the entry macros, so it has no include guard.  To use another table,
+ * build the library and the application with -DP2PT_CONFIG=\"file.h\".
+ *
+ * Example:
+ *
+ *   P2PT_TASK( CTRL_TID, "CTRL", 50, 8192, 0, T_LOCAL )
+ *   P2PT_QUEUE( CMD_QID, "CMDQ", 16, Q_FIFO | Q_LIMIT )
+ *   P2PT_SEMA4( BUS_SMID, "BUS ", 1, SM_PRIOR )
+ *   P2PT_PARTITION( BUF_PTID, "BUFS", 64 * 256, 256, PT_DEL )
+ ****************************************************************************/
+
+/*
+**  Configuration table entries
+*/
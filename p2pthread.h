@@ -21,6 +21,7 @@
  ****************************************************************************/
 
 #include <pthread.h>
+#include <sys/time.h>
 
 #if __cplusplus
 extern "C" {
@@ -45,7 +46,8 @@ extern "C" {
 #define ULONG  unsigned long
 #endif
 
-#define P2PT_TICK 10 /* milliseconds per p2pthread scheduler tick */
+extern ULONG p2pt_tick;
+#define P2PT_TICK p2pt_tick /* milliseconds per p2pthread scheduler tick */
 
 /*
 **  Task Scheduling Priorities in p2pthread are higher as numbers increase...
@@ -71,6 +73,387 @@ extern "C" {
 #define WAIT_VQUE  7
 #define WAIT_SEMAP 8
 #define WAIT_EVENT 9
+#define WAIT_REGION 10
+#define WAIT_CONDV 11
+#define WAIT_NREASONS 12
+
+/*****************************************************************************
+**  Simulation mode task states
+*****************************************************************************/
+#define SIM_NONE     0     /* Task runs outside the simulator */
+#define SIM_STARTING 1     /* Pthread created, not yet waiting to run */
+#define SIM_READY    2     /* Waiting for its turn to run */
+#define SIM_RUNNING  3     /* Holds the run token */
+#define SIM_WAIT     4     /* Blocked on a p2pthread object */
+#define SIM_DELAY    5     /* Blocked in tm_wkafter */
+
+/*****************************************************************************
+**  Trace event codes... an object class ORed with an operation
+*****************************************************************************/
+#define TR_TASK      0x0100
+#define TR_QUEUE     0x0200
+#define TR_VQUEUE    0x0300
+#define TR_SEMA4     0x0400
+#define TR_EVENT     0x0500
+#define TR_EVGROUP   0x0600
+#define TR_PRTN      0x0700
+#define TR_REGION    0x0800
+#define TR_MUTEX     0x0900
+#define TR_CONDVAR   0x0A00
+#define TR_NCLASSES  11
+
+#define TR_CREATE       1
+#define TR_DELETE       2
+#define TR_SEND         3
+#define TR_RECEIVE      4
+#define TR_BLOCK        5
+#define TR_WAKE         6
+#define TR_TIMEOUT      7
+#define TR_SCHED_LOCK   8
+#define TR_SCHED_UNLOCK 9
+
+extern volatile int trace_enabled;
+extern void trace_event( UINT op, ULONG objid, ULONG arg );
+extern const char *trace_class_names[TR_NCLASSES];
+
+/*
+**  TRACE records an event in the calling thread's trace ring if tracing
+**  is enabled.  TRACE_BLOCK records a block event the first time a waiting
+**  loop is about to wait, setting 'blocked' so the wake or timeout which
+**  ends the wait is recorded too.
+*/
+#define TRACE( op, objid, arg ) \
+    do { if ( trace_enabled ) trace_event( (op), (objid), (arg) ); } while ( 0 )
+#define TRACE_BLOCK( blocked, class, objid ) \
+    do { if ( !(blocked) ) { (blocked) = TRUE; \
+         TRACE( (class) | TR_BLOCK, (objid), 0 ); } } while ( 0 )
+#define TRACE_UNBLOCK( blocked, class, objid, timedout ) \
+    do { if ( blocked ) \
+         TRACE( (class) | ((timedout) ? TR_TIMEOUT : TR_WAKE), (objid), 0 ); \
+       } while ( 0 )
+
+/*****************************************************************************
+**  Scheduling and latency statistics of one task, as returned by t_stats().
+**  The task itself counts its blocked time and wakeup latencies; its CPU
+**  time, context switches and page faults are read from its kernel thread
+**  when the statistics are taken.  Wakeup latency is the time from the
+**  task being made ready (or from the end of a delay) until it runs.
+*****************************************************************************/
+#define T_WAKE_BUCKETS 24
+
+typedef struct t_stat
+{
+        /*
+        ** ID and name of task, and the WAIT_ code of what it is blocked or
+        ** suspended on (WAIT_READY if neither)
+        */
+    ULONG
+        taskid;
+    char
+        taskname[4];
+    int
+        wait_reason;
+
+        /*
+        ** Counters of the task's kernel thread (zero for M:N tasks)
+        */
+    unsigned long long
+        cpu_ns;
+    ULONG
+        vol_switches;
+    ULONG
+        invol_switches;
+    ULONG
+        minor_faults;
+    ULONG
+        major_faults;
+
+        /*
+        ** Waits which blocked, and nanoseconds spent blocked, by WAIT_ code
+        */
+    ULONG
+        blocks[WAIT_NREASONS];
+    unsigned long long
+        blocked_ns[WAIT_NREASONS];
+
+        /*
+        ** Wakeups by latency... bucket 0 counts those under 1 usec, bucket
+        ** n those from 2^(n-1) usec, and the last bucket all longer ones
+        */
+    ULONG
+        wake_latency[T_WAKE_BUCKETS];
+    unsigned long long
+        max_wake_ns;
+} t_stat_t;
+
+/*****************************************************************************
+**  Depth and traffic statistics of one queue or variable-length queue, as
+**  returned by q_info() and q_vinfo().  Residence is the time a message
+**  spends in the queue from being sent until it is received.  It is timed
+**  for one message in Q_SAMPLE_RATE, to keep the cost off most sends, or
+**  for every message of a queue created with Q_STAMP.
+*****************************************************************************/
+#define Q_RES_BUCKETS 24
+#define Q_SAMPLE_RATE 16
+
+typedef struct q_info
+{
+        /*
+        ** ID, name and option flags of queue
+        */
+    ULONG
+        qid;
+    char
+        qname[4];
+    ULONG
+        flags;
+
+        /*
+        ** Messages queued now, the most ever queued at once, the length
+        ** limit (0 if none) and tasks pended on the queue
+        */
+    ULONG
+        depth;
+    ULONG
+        high_water;
+    ULONG
+        limit;
+    ULONG
+        waiters;
+
+        /*
+        ** Successful calls since the queue was created... sends, urgent
+        ** sends, broadcasts and receives
+        */
+    ULONG
+        sends;
+    ULONG
+        urgents;
+    ULONG
+        broadcasts;
+    ULONG
+        receives;
+
+        /*
+        ** Receives which timed out, and sends refused with ERR_QFULL
+        */
+    ULONG
+        timeouts;
+    ULONG
+        full_errors;
+
+        /*
+        ** Extents of message storage allocated (1 for variable-length queues)
+        */
+    ULONG
+        extents;
+
+        /*
+        ** Sampled messages by residence... bucket 0 counts those under
+        ** 1 usec, bucket n those from 2^(n-1) usec, and the last bucket all
+        ** longer ones
+        */
+    ULONG
+        residence[Q_RES_BUCKETS];
+    unsigned long long
+        max_residence_ns;
+} q_info_t;
+
+/*****************************************************************************
+**  One object's entry in the shared-memory stats page written by sp_start().
+**  The meaning of the depth, limit and counter fields depends on the class:
+**
+**    SP_TASK     state and priority, waits which blocked, wakeups timed
+**    SP_QUEUE    messages queued, length limit (0 if none), sends, receives
+**    SP_VQUEUE   messages queued, length limit, sends, receives
+**    SP_SEMA4    tokens available, -, tokens released, tokens granted
+**    SP_PRTN     blocks off the free list, total blocks, blocks returned
+**                to and taken from the free list
+*****************************************************************************/
+#define SP_TASK     1
+#define SP_QUEUE    2
+#define SP_VQUEUE   3
+#define SP_SEMA4    4
+#define SP_PRTN     5
+
+typedef struct sp_object
+{
+        /*
+        ** SP_ class, ID and name of object
+        */
+    ULONG
+        obj_class;
+    ULONG
+        objid;
+    char
+        objname[4];
+
+        /*
+        ** WAIT_ code and priority of a task
+        */
+    int
+        state;
+    ULONG
+        priority;
+
+        /*
+        ** Current and maximum fill of the object, tasks pended on it and
+        ** free blocks of a partition
+        */
+    ULONG
+        depth;
+    ULONG
+        limit;
+    ULONG
+        waiters;
+    ULONG
+        free_blocks;
+
+        /*
+        ** Operations into and out of the object since it was created
+        */
+    ULONG
+        puts;
+    ULONG
+        gets;
+} sp_object_t;
+
+#define SP_MAGIC    0x70327370
+#define SP_VERSION  1
+
+/*****************************************************************************
+**  Header of the shared-memory stats page.  The page is rewritten as a
+**  sequence lock: 'seq' is odd while the writer is changing the page, and
+**  a reader keeps the copy it took only if 'seq' was the same even number
+**  before and after taking it.
+*****************************************************************************/
+typedef struct sp_page
+{
+    ULONG
+        magic;           /* SP_MAGIC once the page is ready */
+    ULONG
+        version;         /* SP_VERSION */
+    volatile ULONG
+        seq;             /* Odd while the page is being rewritten */
+    ULONG
+        pid;             /* Process which publishes the page */
+    ULONG
+        period_ms;       /* Milliseconds between updates */
+    ULONG
+        max_objects;     /* Entries the page has room for */
+    ULONG
+        count;           /* Entries now in objects[] */
+    ULONG
+        dropped;         /* Objects left out for lack of room */
+    ULONG
+        updates;         /* Times the page has been rewritten */
+    unsigned long long
+        stamp_ns;        /* CLOCK_REALTIME of the last update */
+    sp_object_t
+        objects[1];      /* Tasks, then queues, vqueues, semaphores and
+                            partitions, each in list order */
+} sp_page_t;
+
+/*****************************************************************************
+**  Contention statistics for one internal mutex, kept by lk_lock() and
+**  lk_unlock() while lock profiling is enabled.  Only the thread holding
+**  the mutex updates them.
+*****************************************************************************/
+typedef struct lk_stat
+{
+        /*
+        ** Class (a TR_ code), ID and name of the object owning the mutex,
+        ** and the name of the mutex within it
+        */
+    UINT
+        obj_class;
+    ULONG
+        objid;
+    char
+        objname[4];
+    const char *
+        lock_name;
+
+        /*
+        ** Acquisitions, and those which found the mutex already locked
+        */
+    ULONG
+        acquires;
+    ULONG
+        contended;
+
+        /*
+        ** Nanoseconds spent waiting for and holding the mutex, in total
+        ** and at most
+        */
+    unsigned long long
+        wait_ns;
+    unsigned long long
+        max_wait_ns;
+    unsigned long long
+        hold_ns;
+    unsigned long long
+        max_hold_ns;
+
+        /*
+        ** Condition variable waits made with the mutex, and nanoseconds
+        ** spent in them
+        */
+    ULONG
+        cv_waits;
+    unsigned long long
+        cv_wait_ns;
+
+        /*
+        ** Time the mutex was last acquired (zero if not timed)
+        */
+    unsigned long long
+        acquired_at;
+
+        /*
+        ** Zero until the statistics are first linked into the list of
+        ** profiled mutexes, LK_RETIRED once the owning object is deleted
+        */
+    int
+        linked;
+    struct lk_stat *
+        nxt_stat;
+    struct lk_stat *
+        prv_stat;
+} lk_stat_t;
+
+#define LK_RETIRED  -1
+
+#define LK_STAT_INITIALIZER( class, name ) \
+    { .obj_class = (class), .objname = { ' ', ' ', ' ', ' ' }, \
+      .lock_name = (name) }
+
+extern void lk_init( lk_stat_t *stat, UINT obj_class, ULONG objid,
+                     char name[4], const char *lock_name );
+extern void lk_retire( lk_stat_t *stat );
+extern int lk_lock( pthread_mutex_t *mutex, lk_stat_t *stat );
+extern int lk_unlock( pthread_mutex_t *mutex, lk_stat_t *stat );
+extern int lk_wait( pthread_cond_t *cond, pthread_mutex_t *mutex,
+                    lk_stat_t *stat );
+extern int lk_timedwait( pthread_cond_t *cond, pthread_mutex_t *mutex,
+                         const struct timespec *timeout, lk_stat_t *stat );
+extern int lk_signal( pthread_cond_t *cond );
+extern int lk_broadcast( pthread_cond_t *cond );
+
+/*
+**  p2pt_time returns the time of day from which timeouts are calculated...
+**  the virtual time in simulation mode, or the real time otherwise.
+*/
+extern volatile int sim_mode;
+extern void p2pt_time( struct timeval *now );
+
+/*
+**  mn_mode is nonzero once mn_start() has started the M:N scheduler's
+**  worker pthreads.  Tasks started from then on run as user-space contexts
+**  on the workers instead of having pthreads of their own.
+*/
+extern volatile int mn_mode;
+struct mn_task;
 
 /*****************************************************************************
 **  Control block for pthread wrapper for p2pthread task
@@ -119,29 +502,61 @@ typedef struct p2pt_pthread_ctl_blk
         registers[NUM_TASK_REGS];
 
         /*
-        ** Mutex and Condition variable for task events
+        ** Futex word for task events... bumped by ev_send to wake the task
+        ** when it sends events the task is waiting for
+        */
+    volatile int
+        event_seq;
+
+        /*
+        ** Condition variable signalled when a semaphore grants tokens
+        ** to the task (or the semaphore it is pended on is deleted)
         */
-    pthread_mutex_t
-        event_lock;
     pthread_cond_t
-        event_change;
+        pend_wakeup;
 
         /*
-        ** Event state to awaken task (if suspended)
+        ** Number of semaphore tokens task is waiting for, and number
+        ** handed to it directly by a semaphore post while it waited.
+        ** tokens_served is set once the tokens have been handed over.
         */
     ULONG
-        event_mask;
+        tokens_wanted;
+    ULONG
+        tokens_granted;
+    int
+        tokens_served;
 
         /*
-        ** Current state of captured event flags for task
+        ** Size of region segment task is waiting for, and segment handed
+        ** to it directly by a segment return while it waited
         */
     ULONG
-        events_captured;
+        seg_wanted;
+    void *
+        seg_granted;
 
         /*
-        ** Current state of pending event flags for task
+        ** Futex word the task waits on in a condition variable, set nonzero
+        ** when it is signalled, and the futex word of the mutex it is to be
+        ** requeued onto (NULL if it waits with a semaphore instead)
         */
-    ULONG
+    volatile int
+        cv_wakeup;
+    volatile int *
+        cv_mutex_word;
+
+        /*
+        ** Events the task is waiting for (zero if it is not waiting)
+        */
+    volatile ULONG
+        event_mask;
+
+        /*
+        ** Current state of pending event flags for task... set and
+        ** cleared only with atomic operations
+        */
+    volatile ULONG
         events_pending;
 
         /*
@@ -175,6 +590,79 @@ typedef struct p2pt_pthread_ctl_blk
 	struct p2pt_pthread_ctl_blk *
         nxt_susp;
 
+        /*
+        ** Simulation mode state of the task (SIM_NONE if it was started
+        ** outside simulation mode), whether it is parked in the simulator
+        ** waiting for its turn, and whether t_suspend has taken it out of
+        ** the simulator's ready tasks
+        */
+    volatile int
+        sim_state;
+    int
+        sim_parked;
+    int
+        sim_suspended;
+
+        /*
+        ** Virtual time (in usec) at which the task's current wait times out
+        ** (zero if never), set nonzero once it has, the condition variable
+        ** and mutex or the futex word the task waits on
+        */
+    unsigned long long
+        sim_deadline;
+    volatile int
+        sim_expired;
+    pthread_cond_t *
+        sim_cond;
+    pthread_mutex_t *
+        sim_mutex;
+    volatile int *
+        sim_futex;
+
+        /*
+        ** Signalled when the simulator hands the task the run token
+        */
+    pthread_cond_t
+        sim_turn;
+
+        /*
+        ** Next task control block in list of simulated tasks
+        */
+    struct p2pt_pthread_ctl_blk *
+        nxt_sim;
+
+        /*
+        ** User-space context of a task run by the M:N scheduler (NULL if
+        ** the task has a pthread of its own)
+        */
+    struct mn_task *
+        mn_task;
+
+        /*
+        ** Scheduling statistics of the task, the kernel thread ID of its
+        ** pthread (zero for M:N tasks), the time its current wait blocked
+        ** (zero if not blocked), and the time it was made ready or was due
+        ** to wake (zero if not yet)
+        */
+    t_stat_t
+        stats;
+    pid_t
+        ktid;
+    unsigned long long
+        blocked_at;
+    volatile unsigned long long
+        woken_at;
+
+        /*
+        ** Q_INHERIT queue whose message the task is serving (NULL if none),
+        ** and the highest pthreads priority lent to it by the senders of
+        ** that queue's messages (zero if none)
+        */
+    void * volatile
+        serving;
+    volatile int
+        lent_priority;
+
         /*
         ** Next task control block in list
         */
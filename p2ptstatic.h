@@ -0,0 +1,31 @@
+/*****************************************************************************
+ * p2ptstatic.h - expands the static configuration table (p2ptconf.h, or the
+ *                file named by P2PT_CONFIG) with whichever of its entry
+ *                macros the includer has defined, the others expanding to
+ *                nothing.  Included once for each expansion, so it has no
+ *                include guard.
+ ****************************************************************************/
+
+#ifndef P2PT_CONFIG
+#define P2PT_CONFIG "p2ptconf.h"
+#endif
+
+#ifndef P2PT_TASK
+#define P2PT_TASK( id, name, priority, sstack, ustack, flags )
+#endif
+#ifndef P2PT_QUEUE
+#define P2PT_QUEUE( id, name, count, flags )
+#endif
+#ifndef P2PT_SEMA4
+#define P2PT_SEMA4( id, name, count, flags )
+#endif
+#ifndef P2PT_PARTITION
+#define P2PT_PARTITION( id, name, length, bsize, flags )
+#endif
+
+#include P2PT_CONFIG
+
+#undef P2PT_TASK
+#undef P2PT_QUEUE
+#undef P2PT_SEMA4
+#undef P2PT_PARTITION
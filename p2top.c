@@ -0,0 +1,262 @@
+/*****************************************************************************
+ * p2top.c - a monitor which shows the tasks, queues, semaphores and
+ *           partitions of a running p2pthread process, from the shared-
+ *           memory stats page the process publishes with sp_start().
+ *
+ *  The page is mapped read-only and copied under its sequence lock, so the
+ *  monitored process is never stopped, signalled or made to wait.  Every
+ *  interval the table is redrawn with the rate of each object's operations
+ *  since the previous one.
+ *
+ *  usage: p2top [-d seconds] [-n iterations] pid | /name
+ *
+ *      -d <seconds>    interval between updates (default 1)
+ *      -n <n>          number of updates to show, 0 for no limit (default 0)
+ *      pid             the process ID of a process which published its
+ *                      page under the default name, /p2linux.<pid>
+ *      /name           the name passed to sp_start()
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "p2linux.h"
+
+/*
+**  Tries at taking a consistent copy of the page before giving up
+*/
+#define MAX_TRIES       1000
+
+static const char *
+    class_names[] = { "?", "task", "queue", "vqueue", "sema4", "prtn" };
+
+static const char *
+    state_names[] = { "READY", "TSTRT", "TSUSP", "DELAY", "ATIME", "MUTEX",
+                      "QUEUE", "VQUE", "SEMAP", "EVENT", "REGN", "CONDV" };
+
+/*****************************************************************************
+** copy_page - takes a consistent copy of the shared page.  Returns 0, or
+**             -1 if the writer kept it busy for too long.
+*****************************************************************************/
+static int
+   copy_page( const sp_page_t *shared, sp_page_t *copy, size_t size )
+{
+    struct timespec pause;
+    ULONG seq;
+    int tries;
+
+    pause.tv_sec = 0;
+    pause.tv_nsec = 1000000L;
+
+    for ( tries = 0; tries < MAX_TRIES; tries++ )
+    {
+        seq = shared->seq;
+        __sync_synchronize();
+        if ( !(seq & 1) )
+        {
+            memcpy( (void *)copy, (const void *)shared, size );
+            __sync_synchronize();
+            if ( shared->seq == seq )
+            {
+                if ( copy->count > copy->max_objects )
+                    copy->count = copy->max_objects;
+                return( 0 );
+            }
+        }
+        nanosleep( &pause, (struct timespec *)NULL );
+    }
+    return( -1 );
+}
+
+/*****************************************************************************
+** find_object - returns the entry for the same object in the previous copy
+*****************************************************************************/
+static const sp_object_t *
+   find_object( const sp_page_t *prev, const sp_object_t *object )
+{
+    ULONG i;
+
+    for ( i = 0; i < prev->count; i++ )
+    {
+        if ( (prev->objects[i].obj_class == object->obj_class) &&
+             (prev->objects[i].objid == object->objid) )
+            return( &(prev->objects[i]) );
+    }
+    return( (const sp_object_t *)NULL );
+}
+
+/*****************************************************************************
+** show_page - draws the table for one copy of the page, with rates taken
+**             from the previous copy over 'secs' seconds
+*****************************************************************************/
+static void
+   show_page( const sp_page_t *page, const sp_page_t *prev, double secs )
+{
+    const sp_object_t *object;
+    const sp_object_t *before;
+    struct timespec now;
+    double age, put_rate, get_rate;
+    char state[8];
+    ULONG i;
+
+    clock_gettime( CLOCK_REALTIME, &now );
+    age = ((double)now.tv_sec * 1e9 + (double)now.tv_nsec -
+           (double)page->stamp_ns) / 1e9;
+
+    if ( isatty( STDOUT_FILENO ) )
+        printf( "\033[H\033[2J" );
+    printf( "p2top - pid %lu, %lu objects%s, updated %.1f s ago "
+            "(every %lu ms)\n\n", page->pid, page->count + page->dropped,
+            (page->dropped != 0) ? " (not all shown)" : "", age,
+            page->period_ms );
+    printf( "%-6s %6s %-4s %-5s %4s %8s %8s %5s %8s %10s %10s %12s %12s\n",
+            "CLASS", "ID", "NAME", "STATE", "PRI", "DEPTH", "LIMIT", "WAIT",
+            "FREE", "PUTS/s", "GETS/s", "PUTS", "GETS" );
+
+    for ( i = 0; i < page->count; i++ )
+    {
+        object = &(page->objects[i]);
+        put_rate = 0.0;
+        get_rate = 0.0;
+        if ( (prev != (const sp_page_t *)NULL) && (secs > 0.0) &&
+             ((before = find_object( prev, object )) !=
+              (const sp_object_t *)NULL) )
+        {
+            put_rate = (double)(object->puts - before->puts) / secs;
+            get_rate = (double)(object->gets - before->gets) / secs;
+        }
+
+        state[0] = '\0';
+        if ( object->obj_class == SP_TASK )
+        {
+            if ( (object->state >= 0) && (object->state < WAIT_NREASONS) )
+                snprintf( state, sizeof( state ), "%s",
+                          state_names[object->state] );
+            else
+                snprintf( state, sizeof( state ), "%d", object->state );
+        }
+
+        printf( "%-6s %6lu %-4.4s %-5s ",
+                class_names[(object->obj_class <= SP_PRTN) ?
+                            object->obj_class : 0],
+                object->objid, object->objname, state );
+        if ( object->obj_class == SP_TASK )
+            printf( "%4lu %8s %8s %5s %8s", object->priority, "", "", "",
+                    "" );
+        else if ( object->obj_class == SP_PRTN )
+            printf( "%4s %8lu %8lu %5s %8lu", "", object->depth,
+                    object->limit, "", object->free_blocks );
+        else
+            printf( "%4s %8lu %8lu %5lu %8s", "", object->depth,
+                    object->limit, object->waiters, "" );
+        printf( " %10.0f %10.0f %12lu %12lu\n", put_rate, get_rate,
+                object->puts, object->gets );
+    }
+    fflush( stdout );
+}
+
+int
+   main( int argc, char **argv )
+{
+    const sp_page_t *shared;
+    sp_page_t *page;
+    sp_page_t *prev;
+    sp_page_t *swap;
+    struct stat info;
+    struct timespec interval;
+    char name[64];
+    double secs;
+    long iterations, shown;
+    int opt;
+    int fd;
+
+    secs = 1.0;
+    iterations = 0;
+
+    while ( (opt = getopt( argc, argv, "d:n:" )) != -1 )
+    {
+        switch ( opt )
+        {
+            case 'd':
+                secs = atof( optarg );
+                break;
+            case 'n':
+                iterations = atol( optarg );
+                break;
+            default:
+                optind = argc;
+                break;
+        }
+    }
+    if ( (optind != argc - 1) || (secs <= 0.0) )
+    {
+        fprintf( stderr, "usage: %s [-d seconds] [-n iterations] pid | /name\n",
+                 argv[0] );
+        exit( 1 );
+    }
+
+    if ( argv[optind][0] == '/' )
+        snprintf( name, sizeof( name ), "%s", argv[optind] );
+    else
+        snprintf( name, sizeof( name ), "/p2linux.%s", argv[optind] );
+
+    if ( (fd = shm_open( name, O_RDONLY, 0 )) < 0 )
+    {
+        fprintf( stderr, "%s: cannot open stats page %s: %s\n", argv[0],
+                 name, strerror( errno ) );
+        exit( 1 );
+    }
+    if ( (fstat( fd, &info ) != 0) || (info.st_size < sizeof( sp_page_t )) )
+    {
+        fprintf( stderr, "%s: %s is not a stats page\n", argv[0], name );
+        exit( 1 );
+    }
+    shared = (const sp_page_t *)mmap( (void *)NULL, info.st_size, PROT_READ,
+                                      MAP_SHARED, fd, 0 );
+    close( fd );
+    if ( shared == (const sp_page_t *)MAP_FAILED )
+    {
+        fprintf( stderr, "%s: cannot map stats page %s: %s\n", argv[0],
+                 name, strerror( errno ) );
+        exit( 1 );
+    }
+    if ( (shared->magic != SP_MAGIC) || (shared->version != SP_VERSION) )
+    {
+        fprintf( stderr, "%s: %s is not a version %d stats page\n", argv[0],
+                 name, SP_VERSION );
+        exit( 1 );
+    }
+
+    page = (sp_page_t *)malloc( info.st_size );
+    prev = (sp_page_t *)malloc( info.st_size );
+    interval.tv_sec = (time_t)secs;
+    interval.tv_nsec = (long)((secs - (double)interval.tv_sec) * 1e9);
+
+    for ( shown = 0; (iterations == 0) || (shown < iterations); shown++ )
+    {
+        if ( copy_page( shared, page, info.st_size ) != 0 )
+        {
+            fprintf( stderr, "%s: stats page is not being updated\n",
+                     argv[0] );
+            exit( 1 );
+        }
+        show_page( page, (shown > 0) ? prev : (const sp_page_t *)NULL,
+                   (shown > 0) ? (double)(page->stamp_ns - prev->stamp_ns) /
+                                 1e9 : 0.0 );
+
+        swap = prev;
+        prev = page;
+        page = swap;
+
+        if ( (iterations == 0) || (shown + 1 < iterations) )
+            nanosleep( &interval, (struct timespec *)NULL );
+    }
+
+    return( 0 );
+}
@@ -19,9 +19,13 @@
 #define BCAST 1
 #define KILLD 2
 
+#define Q_FIFO       0x00
+#define Q_NOLIMIT    0x00
 #define Q_NOWAIT     0x01
 #define Q_PRIOR      0x02
 #define Q_LIMIT      0x04
+#define Q_STAMP      0x10
+#define Q_INHERIT    0x20
 
 #define ERR_TIMEOUT  0x01
 #define ERR_NODENO   0x04
@@ -42,6 +46,18 @@
 *****************************************************************************/
 typedef ULONG q_msg_t[4];
 
+/*****************************************************************************
+**  p2pthread queue message information... kept for each message location
+**  beside the message array, so that it takes no room in the message
+*****************************************************************************/
+typedef struct queue_slot_info
+{
+    unsigned long long
+        sent_at;         /* Send time of message if timed, else zero */
+    int
+        sender_pri;      /* Priority lent by sender (Q_INHERIT queues) */
+} q_slot_t;
+
 /*****************************************************************************
 **  p2pthread queue extent type - this is the header for a dynamically allocated
 **                           memory block of a size determined at runtime.
@@ -50,12 +66,15 @@ typedef ULONG q_msg_t[4];
 **                           element of the array is included in the header
 **                           to guarantee proper alignment for the additional
 **                           (qsize) array elements which will be allocated
-**                           and appended to it.
+**                           and appended to it.  The information on each
+**                           message follows the message array.
 *****************************************************************************/
 typedef struct queue_extent_header
 {
     void *
         nxt_extent;      /* Points to next extent block (if any, else NULL)*/
+    q_slot_t *
+        slots;           /* Information on each message in the extent */
     q_msg_t
         msgs[1];         /* Array of qsize + 1 q_msg_t messages */
 } q_extent_t;
@@ -97,6 +116,8 @@ typedef struct p2pt_queue
         */
     pthread_mutex_t
         queue_lock;
+    lk_stat_t
+        queue_lkstat;    /* Contention statistics for queue_lock */
     pthread_cond_t
         queue_send;
 
@@ -105,6 +126,8 @@ typedef struct p2pt_queue
         */
     pthread_mutex_t
         qbcst_lock;
+    lk_stat_t
+        qbcst_lkstat;    /* Contention statistics for qbcst_lock */
     pthread_cond_t
         queue_bcplt;
 
@@ -182,6 +205,56 @@ typedef struct p2pt_queue
         */
     int
         order;
+
+        /*
+        ** Successful sends, urgent sends, broadcasts and receives since the
+        ** queue was created, receives which timed out and sends refused
+        ** because the queue was full
+        */
+    ULONG
+        send_count;
+    ULONG
+        urgent_count;
+    ULONG
+        bcast_count;
+    ULONG
+        recv_count;
+    ULONG
+        timeout_count;
+    ULONG
+        full_count;
+
+        /*
+        ** Most messages ever in the queue at once
+        */
+    int
+        high_water;
+
+        /*
+        ** Messages put into the queue (which picks those to be timed), and
+        ** messages now in the queue with a send time
+        */
+    ULONG
+        msgs_in;
+    ULONG
+        stamped_msgs;
+
+        /*
+        ** Timed messages by residence, as returned by q_info()
+        */
+    ULONG
+        residence[Q_RES_BUCKETS];
+    unsigned long long
+        max_residence_ns;
+
+        /*
+        ** Task which last received from a Q_INHERIT queue (0 if none), and
+        ** the highest priority lent to it since by the queue's senders
+        */
+    ULONG
+        server_tid;
+    int
+        server_pri;
 } p2pt_queue_t;
 
 /*****************************************************************************
@@ -189,6 +262,9 @@ typedef struct p2pt_queue
 *****************************************************************************/
 extern void *ts_malloc( size_t blksize );
 extern void ts_free( void *blkaddr );
+extern void *alloc_object( UINT obj_class, size_t blksize );
+extern void free_object( UINT obj_class, void *block );
+extern int ts_reserve( size_t blksize, ULONG count );
 extern p2pthread_cb_t *
    my_tcb( void );
 extern void
@@ -203,6 +279,26 @@ extern void
    unlink_susp_tcb( p2pthread_cb_t **list_head, p2pthread_cb_t *entry );
 extern int
    signal_for_my_task( p2pthread_cb_t **list_head, int pend_order );
+extern p2pthread_cb_t *
+   next_susp_tcb( p2pthread_cb_t *list_head, int pend_order );
+extern void
+   init_isr_dispatch( void );
+extern void
+   stat_block( p2pthread_cb_t *tcb, int reason );
+extern void
+   stat_unblock( p2pthread_cb_t *tcb, int timedout );
+extern void
+   stat_wake( p2pthread_cb_t *tcb );
+extern void
+   stat_wake_all( p2pthread_cb_t *list_head );
+extern ULONG
+   count_susp_tcbs( p2pthread_cb_t *list_head );
+extern int
+   send_priority( p2pthread_cb_t *tcb );
+extern void
+   lend_priority( ULONG tid, void *object, int priority );
+extern void
+   end_lent_priority( p2pthread_cb_t *tcb );
 
 /*****************************************************************************
 **  p2pthread Global Data Structures
@@ -220,6 +316,58 @@ static p2pt_queue_t *
 */
 static pthread_mutex_t
     queue_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static lk_stat_t
+    queue_list_lkstat = LK_STAT_INITIALIZER( TR_QUEUE, "queue_list_lock" );
+
+/*
+**  Each queue in the static configuration table gets a first extent of
+**  (count + 1) messages in static storage, laid out as new_extent_for()
+**  would lay it out, and the information on those messages.
+*/
+#define P2PT_QUEUE( id, name, count, flags ) \
+static struct \
+{ \
+    q_extent_t extent; \
+    q_msg_t msgs[(count)]; \
+} id##_qdata; \
+static q_slot_t \
+    id##_qslots[(count) + 1];
+#include "p2ptstatic.h"
+
+/*
+**  static_queues lists the queues in the static configuration table, and
+**                static_qcbs holds their control blocks
+*/
+typedef struct static_queue
+{
+    char
+        name[4];
+    ULONG
+        count;
+    ULONG
+        flags;
+    q_extent_t *
+        extent;
+    q_msg_t *
+        last_msg;
+    q_slot_t *
+        slots;
+} static_queue_t;
+
+static const static_queue_t
+    static_queues[] =
+{
+#define P2PT_QUEUE( id, name, count, flags ) \
+    { name, (count), (flags), &(id##_qdata.extent), \
+      (q_msg_t *)(&(id##_qdata) + 1) - 1, id##_qslots },
+#include "p2ptstatic.h"
+    { "", 0, 0, (q_extent_t *)NULL, (q_msg_t *)NULL, (q_slot_t *)NULL }
+};
+
+#define STATIC_QUEUES ((sizeof( static_queues ) / sizeof( static_queue_t )) - 1)
+
+static p2pt_queue_t
+    static_qcbs[STATIC_QUEUES + 1];
 
 
 /*****************************************************************************
@@ -276,7 +424,7 @@ static ULONG
     */
     pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                           (void *)&queue_list_lock );
-    pthread_mutex_lock( &queue_list_lock );
+    lk_lock( &queue_list_lock, &queue_list_lkstat );
 
     /*
     **  Get the highest previously assigned queue id and add one.
@@ -314,7 +462,7 @@ static ULONG
     /*
     **  Re-enable access to the queue list by other threads.
     */
-    pthread_mutex_unlock( &queue_list_lock );
+    lk_unlock( &queue_list_lock, &queue_list_lkstat );
     pthread_cleanup_pop( 0 );
 
     return( new_queue_id );
@@ -333,7 +481,7 @@ static void
     */
     pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                           (void *)&queue_list_lock );
-    pthread_mutex_lock( &queue_list_lock );
+    lk_lock( &queue_list_lock, &queue_list_lkstat );
 
     new_queue->nxt_queue = (p2pt_queue_t *)NULL;
     if ( queue_list != (p2pt_queue_t *)NULL )
@@ -371,7 +519,7 @@ static void
     /*
     **  Re-enable access to the queue list by other threads.
     */
-    pthread_mutex_unlock( &queue_list_lock );
+    lk_unlock( &queue_list_lock, &queue_list_lkstat );
     pthread_cleanup_pop( 0 );
 }
 
@@ -394,7 +542,7 @@ static p2pt_queue_t *
         */
         pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                               (void *)&queue_list_lock );
-        pthread_mutex_lock( &queue_list_lock );
+        lk_lock( &queue_list_lock, &queue_list_lkstat );
 
         /*
         **  Scan the queue list for a qcb with a matching queue ID
@@ -443,13 +591,153 @@ static p2pt_queue_t *
         /*
         **  Re-enable access to the queue list by other threads.
         */
-        pthread_mutex_unlock( &queue_list_lock );
+        lk_unlock( &queue_list_lock, &queue_list_lkstat );
         pthread_cleanup_pop( 0 );
     }
 
     return( selected_qcb );
 }
 
+/*****************************************************************************
+** q_clock - returns the monotonic time in nanoseconds
+*****************************************************************************/
+static unsigned long long
+   q_clock( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return( (unsigned long long)now.tv_sec * 1000000000ULL +
+            (unsigned long long)now.tv_nsec );
+}
+
+/*****************************************************************************
+** slot_for - returns the information on the message in the specified
+**            message location of the specified queue
+*****************************************************************************/
+static q_slot_t *
+   slot_for( p2pt_queue_t *queue, q_msg_t *slot )
+{
+    q_extent_t *cur_extent;
+    int max_msg;
+
+    /*
+    **  The first extent has one message more than any others.
+    */
+    max_msg = queue->msgs_per_extent;
+    for ( cur_extent = queue->first_extent;
+          cur_extent->nxt_extent != (void *)NULL;
+          cur_extent = (q_extent_t *)(cur_extent->nxt_extent) )
+    {
+        if ( (slot >= &(cur_extent->msgs[0])) &&
+             (slot <= &(cur_extent->msgs[max_msg])) )
+            break;
+        max_msg = queue->msgs_per_extent - 1;
+    }
+    return( &(cur_extent->slots[slot - &(cur_extent->msgs[0])]) );
+}
+
+/*****************************************************************************
+** note_sender - records the priority the calling task lends with a message
+**               just put into the specified location of a Q_INHERIT queue,
+**               and lends it at once to the task serving the queue if the
+**               message is now at the head of the queue
+*****************************************************************************/
+static void
+   note_sender( p2pt_queue_t *queue, q_msg_t *slot )
+{
+    int priority;
+
+    priority = send_priority( my_tcb() );
+    slot_for( queue, slot )->sender_pri = priority;
+    if ( (slot == queue->queue_head) && (priority > queue->server_pri) &&
+         (queue->server_tid != 0) )
+    {
+        queue->server_pri = priority;
+        lend_priority( queue->server_tid, (void *)queue, priority );
+    }
+}
+
+/*****************************************************************************
+** start_serving - makes the calling task the server of a Q_INHERIT queue
+**                 from which it has just received a message, lending it
+**                 the priority of that message's sender or of the sender
+**                 of the message now at the head of the queue, if higher
+*****************************************************************************/
+static void
+   start_serving( p2pt_queue_t *queue, p2pthread_cb_t *tcb, int priority )
+{
+    int head_pri;
+
+    if ( tcb == (p2pthread_cb_t *)NULL )
+        return;
+
+    if ( queue->msg_count > 0 )
+    {
+        head_pri = slot_for( queue, queue->queue_head )->sender_pri;
+        if ( head_pri > priority )
+            priority = head_pri;
+    }
+
+    queue->server_tid = tcb->taskid;
+    queue->server_pri = priority;
+    tcb->serving = (void *)queue;
+    if ( priority > (tcb->prv_priority).sched_priority )
+        lend_priority( tcb->taskid, (void *)queue, priority );
+}
+
+/*****************************************************************************
+** note_msg_in - counts a message just put into the specified location of
+**               the specified queue, raising the high-water mark, and
+**               stamps it with its send time if the queue was created with
+**               Q_STAMP, else one message in Q_SAMPLE_RATE.  Notes the
+**               sender's priority if the queue was created with Q_INHERIT.
+*****************************************************************************/
+static void
+   note_msg_in( p2pt_queue_t *queue, q_msg_t *slot )
+{
+    if ( queue->msg_count > queue->high_water )
+        queue->high_water = queue->msg_count;
+
+    queue->msgs_in++;
+    if ( (queue->flags & Q_STAMP) ||
+         ((queue->msgs_in % Q_SAMPLE_RATE) == 0) )
+    {
+        slot_for( queue, slot )->sent_at = q_clock();
+        queue->stamped_msgs++;
+    }
+
+    if ( queue->flags & Q_INHERIT )
+        note_sender( queue, slot );
+}
+
+/*****************************************************************************
+** note_msg_out - adds the residence of a message being taken from the
+**                queue to the histogram, if the message was stamped
+*****************************************************************************/
+static void
+   note_msg_out( p2pt_queue_t *queue, q_slot_t *info )
+{
+    unsigned long long residence;
+    int bucket;
+
+    if ( info->sent_at == 0 )
+        return;
+
+    residence = q_clock() - info->sent_at;
+    bucket = 0;
+    if ( residence >= 1000ULL )
+        bucket = 64 - __builtin_clzll( residence / 1000ULL );
+    if ( bucket >= Q_RES_BUCKETS )
+        bucket = Q_RES_BUCKETS - 1;
+    queue->residence[bucket]++;
+    if ( residence > queue->max_residence_ns )
+        queue->max_residence_ns = residence;
+
+    info->sent_at = 0;
+    queue->stamped_msgs--;
+}
+
 /*****************************************************************************
 ** urgent_msg_to - sends a message to the front of the specified queue
 *****************************************************************************/
@@ -549,6 +837,7 @@ static void
     **  Increment the message counter for the queue
     */
     queue->msg_count++;
+    note_msg_in( queue, queue->queue_head );
 }
 
 /*****************************************************************************
@@ -560,6 +849,7 @@ static void
     q_extent_t *cur_extent;
     q_msg_t *first_msg_in_extent;
     q_msg_t *last_msg_in_extent;
+    q_msg_t *slot;
     int i, max_msg;
 
     /*
@@ -567,6 +857,7 @@ static void
     **  to accept the message about to be sent.  Start by sending the
     **  message.
     */
+    slot = queue->queue_tail;
     for ( i = 0; i < 4; i++ )
         (*(queue->queue_tail))[i] = msg[i];
 
@@ -644,18 +935,22 @@ static void
     **  Increment the message counter for the queue
     */
     queue->msg_count++;
+    note_msg_in( queue, slot );
 
     /*
-    **  Signal the condition variable for the queue
+    **  Signal the condition variable for the queue, noting when the task
+    **  selected to receive the message was made ready.
     */
-    pthread_cond_broadcast( &(queue->queue_send) );
+    stat_wake( next_susp_tcb( queue->first_susp, (queue->flags & Q_PRIOR) ) );
+    lk_broadcast( &(queue->queue_send) );
 }
 
 /*****************************************************************************
-** fetch_msg_from - fetches the next message from the specified queue
+** fetch_msg_from - fetches the next message from the specified queue, and
+**                  its send time and sender priority if 'info' is not NULL
 *****************************************************************************/
 static void
-    fetch_msg_from( p2pt_queue_t *queue, q_msg_t msg )
+    fetch_msg_from( p2pt_queue_t *queue, q_msg_t msg, q_slot_t *info )
 {
     q_extent_t *cur_extent;
     q_msg_t *first_msg_in_extent;
@@ -673,6 +968,22 @@ static void
             msg[i] = (*(queue->queue_head))[i];
     }
 
+    /*
+    **  Only queues created with Q_STAMP stamp every message, and only
+    **  Q_INHERIT queues note the priority of the sender.
+    */
+    if ( info != (q_slot_t *)NULL )
+    {
+        info->sent_at = 0;
+        info->sender_pri = 0;
+        if ( queue->flags & (Q_STAMP | Q_INHERIT) )
+        {
+            *info = *slot_for( queue, queue->queue_head );
+            if ( !(queue->flags & Q_STAMP) )
+                info->sent_at = 0;
+        }
+    }
+
 #ifdef DIAG_PRINTFS 
     printf( "\r\nfetched msg %lx%lx%lx%lx from queue_head @ %p",
             msg[0], msg[1], msg[2], msg[3], queue->queue_head );
@@ -717,6 +1028,13 @@ static void
             }
         }
 
+        /*
+        **  Time the message's residence if it was stamped when sent.
+        */
+        if ( queue->stamped_msgs != 0 )
+            note_msg_out( queue, &(cur_extent->slots[queue->queue_head -
+                                              &(cur_extent->msgs[0])]) );
+
         /*
         **  Found the extent containing the queue_head just sent into.
         **  Now increment the queue_head (send) pointer, adjusting for
@@ -772,19 +1090,19 @@ static void
             */
             pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                                   (void *)&(queue->qbcst_lock) );
-            pthread_mutex_lock( &(queue->qbcst_lock) );
+            lk_lock( &(queue->qbcst_lock), &(queue->qbcst_lkstat) );
 
             /*
             **  Signal the broadcast-complete condition variable for the queue
             */
-            pthread_cond_broadcast( &(queue->queue_bcplt) );
+            lk_broadcast( &(queue->queue_bcplt) );
 
             queue->send_type = SEND;
 
             /*
             **  Unlock the queue broadcast completion mutex. 
             */
-            pthread_mutex_unlock( &(queue->qbcst_lock) );
+            lk_unlock( &(queue->qbcst_lock), &(queue->qbcst_lkstat) );
             pthread_cleanup_pop( 0 );
         }
     }
@@ -819,6 +1137,11 @@ static q_extent_t *
     */
     block_size += sizeof( q_extent_t );
 
+    /*
+    **  The information on the (qsize + 1) messages follows the messages.
+    */
+    block_size += sizeof( q_slot_t ) * (qsize + 1);
+
     /*
     **  Now allocate a block of memory to contain the extent.
     */
@@ -853,6 +1176,7 @@ static q_extent_t *
             nxt_extent->nxt_extent = new_extent;
         }
         queue->last_msg_in_queue = &(new_extent->msgs[qsize]);
+        new_extent->slots = (q_slot_t *)&(new_extent->msgs[qsize + 1]);
     }
 #ifdef DIAG_PRINTFS 
     printf( "\r\nnew extent @ %p for queue @ %p", new_extent, queue );
@@ -860,6 +1184,157 @@ static q_extent_t *
     return( new_extent );
 }
 
+/*****************************************************************************
+** init_qcb - initializes the name, locks and message pointers of a queue
+**            control block whose first extent has been allocated
+*****************************************************************************/
+static void
+   init_qcb( p2pt_queue_t *queue, const char name[4], ULONG qsize )
+{
+    int i;
+
+    /*
+    **  Name for queue
+    */
+    for ( i = 0; i < 4; i++ )
+        queue->qname[i] = name[i];
+
+    /*
+    ** Mutex and Condition variable for queue send/pend
+    */
+    pthread_mutex_init( &(queue->queue_lock),
+                        (pthread_mutexattr_t *)NULL );
+    lk_init( &(queue->queue_lkstat), TR_QUEUE, queue->qid, queue->qname,
+             "queue_lock" );
+    pthread_cond_init( &(queue->queue_send),
+                       (pthread_condattr_t *)NULL );
+
+    /*
+    ** Mutex and Condition variable for queue broadcast/delete
+    */
+    pthread_mutex_init( &(queue->qbcst_lock),
+                        (pthread_mutexattr_t *)NULL );
+    lk_init( &(queue->qbcst_lkstat), TR_QUEUE, queue->qid, queue->qname,
+             "qbcst_lock" );
+    pthread_cond_init( &(queue->queue_bcplt),
+                       (pthread_condattr_t *)NULL );
+
+    if ( qsize > 0 )
+    {
+        /*
+        **  Pointer to next message pointer to be fetched from queue
+        */
+        queue->queue_head = &(queue->first_extent->msgs[1]);
+
+        /*
+        **  Pointer to last message pointer sent to queue
+        */
+        queue->queue_tail = &(queue->first_extent->msgs[1]);
+    }
+    else
+    {
+        /*
+        **  Pointer to next message pointer to be fetched from queue
+        */
+        queue->queue_head = &(queue->first_extent->msgs[0]);
+
+        /*
+        **  Pointer to last message pointer sent to queue
+        */
+        queue->queue_tail = &(queue->first_extent->msgs[0]);
+    }
+
+    /*
+    ** Type of send operation last performed on queue
+    */
+    queue->send_type = SEND;
+
+    /*
+    ** First task control block in list of tasks waiting on queue
+    */
+    queue->first_susp = (p2pthread_cb_t *)NULL;
+
+    /*
+    **  Count of tasks awakened by q_broadcast call
+    */
+    queue->bcst_tasks_awakened = 0;
+
+    /*
+    ** Total messages per memory allocation block (extent)
+    ** (First extent has one extra for urgent message.)
+    */
+    queue->msgs_per_extent = qsize;
+
+    /*
+    ** Total number of messages currently sent to queue
+    */
+    queue->msg_count = 0;
+
+    /*
+    ** Traffic and residence statistics for queue
+    */
+    queue->send_count = 0;
+    queue->urgent_count = 0;
+    queue->bcast_count = 0;
+    queue->recv_count = 0;
+    queue->timeout_count = 0;
+    queue->full_count = 0;
+    queue->high_water = 0;
+    queue->msgs_in = 0;
+    queue->stamped_msgs = 0;
+    for ( i = 0; i < Q_RES_BUCKETS; i++ )
+        queue->residence[i] = 0;
+    queue->max_residence_ns = 0;
+
+    /*
+    ** Task serving a Q_INHERIT queue
+    */
+    queue->server_tid = 0;
+    queue->server_pri = 0;
+}
+
+/*****************************************************************************
+** create_static_queues - initializes the queues in the static configuration
+**                        table and links them into the queue list, in ID
+**                        order, before main() is called.
+*****************************************************************************/
+static void __attribute__(( constructor ))
+   create_static_queues( void )
+{
+    p2pt_queue_t *queue;
+    ULONG i;
+
+    for ( i = 0; i < STATIC_QUEUES; i++ )
+    {
+        queue = &(static_qcbs[i]);
+        queue->qid = i + 1;
+        queue->flags = static_queues[i].flags;
+        queue->total_extents = 1;
+        queue->first_extent = static_queues[i].extent;
+        queue->first_extent->slots = static_queues[i].slots;
+        queue->last_msg_in_queue = static_queues[i].last_msg;
+        init_qcb( queue, static_queues[i].name, static_queues[i].count );
+        queue->nxt_queue = (p2pt_queue_t *)NULL;
+        if ( i > 0 )
+            static_qcbs[i - 1].nxt_queue = queue;
+    }
+
+    if ( STATIC_QUEUES > 0 )
+    {
+        queue_list = &(static_qcbs[0]);
+        init_isr_dispatch();
+    }
+}
+
+/*****************************************************************************
+** reserve_qcbs - carves storage for 'count' queue control blocks in advance
+*****************************************************************************/
+int
+   reserve_qcbs( ULONG count )
+{
+    return( ts_reserve( sizeof( p2pt_queue_t ), count ) );
+}
+
 /*****************************************************************************
 ** q_create - creates a p2pthread message queue
 *****************************************************************************/
@@ -868,14 +1343,18 @@ ULONG
 {
     p2pt_queue_t *queue;
     ULONG error;
-    int i;
 
     error = ERR_NO_ERROR;
 
+    /*
+    **  Make sure ISRs can send to the queue through the dispatch thread.
+    */
+    init_isr_dispatch();
+
     /*
     **  First allocate memory for the queue control block
     */
-    queue = (p2pt_queue_t *)ts_malloc( sizeof( p2pt_queue_t ) );
+    queue = (p2pt_queue_t *)alloc_object( TR_QUEUE, sizeof( p2pt_queue_t ) );
     if ( queue != (p2pt_queue_t *)NULL )
     {
         /*
@@ -889,6 +1368,7 @@ ULONG
         queue->flags = opt;
 
         queue->total_extents = 0;
+        queue->first_extent = (q_extent_t *)NULL;
         if ( new_extent_for( queue, qsize ) != (q_extent_t *)NULL )
         {
             /*
@@ -903,78 +1383,7 @@ ULONG
             if ( qid != (ULONG *)NULL )
                 *qid = queue->qid;
 
-            /*
-            **  Name for queue
-            */
-            for ( i = 0; i < 4; i++ )
-                queue->qname[i] = name[i];
-
-            /*
-            ** Mutex and Condition variable for queue send/pend
-            */
-            pthread_mutex_init( &(queue->queue_lock),
-                                (pthread_mutexattr_t *)NULL );
-            pthread_cond_init( &(queue->queue_send),
-                               (pthread_condattr_t *)NULL );
-
-            /*
-            ** Mutex and Condition variable for queue broadcast/delete
-            */
-            pthread_mutex_init( &(queue->qbcst_lock),
-                                (pthread_mutexattr_t *)NULL );
-            pthread_cond_init( &(queue->queue_bcplt),
-                               (pthread_condattr_t *)NULL );
-
-            if ( qsize > 0 )
-            {
-                /*
-                **  Pointer to next message pointer to be fetched from queue
-                */
-                queue->queue_head = &(queue->first_extent->msgs[1]);
-
-                /*
-                **  Pointer to last message pointer sent to queue
-                */
-                queue->queue_tail = &(queue->first_extent->msgs[1]);
-            }
-            else
-            {
-                /*
-                **  Pointer to next message pointer to be fetched from queue
-                */
-                queue->queue_head = &(queue->first_extent->msgs[0]);
-
-                /*
-                **  Pointer to last message pointer sent to queue
-                */
-                queue->queue_tail = &(queue->first_extent->msgs[0]);
-            }
-
-            /*
-            ** Type of send operation last performed on queue
-            */
-            queue->send_type = SEND;
-
-            /*
-            ** First task control block in list of tasks waiting on queue
-            */
-            queue->first_susp = (p2pthread_cb_t *)NULL;
-
-            /*
-            **  Count of tasks awakened by q_broadcast call
-            */
-            queue->bcst_tasks_awakened = 0;
-
-            /*
-            ** Total messages per memory allocation block (extent)
-            ** (First extent has one extra for urgent message.)
-            */
-            queue->msgs_per_extent = qsize;
-
-            /*
-            ** Total number of messages currently sent to queue
-            */
-            queue->msg_count = 0;
+            init_qcb( queue, name, qsize );
 
             /*
             **  If no errors thus far, we have a new queue ready to link into
@@ -983,6 +1392,7 @@ ULONG
             if ( error == ERR_NO_ERROR )
             {
                 link_qcb( queue );
+                TRACE( TR_QUEUE | TR_CREATE, queue->qid, 0 );
             }
             else
             {
@@ -991,7 +1401,7 @@ ULONG
                 **  and data memory and return.
                 */
                 ts_free( (void *)queue->first_extent );
-                ts_free( (void *)queue );
+                free_object( TR_QUEUE, (void *)queue );
             }
         }
         else
@@ -999,7 +1409,7 @@ ULONG
             /*
             **  No memory for queue data... free queue control block & return
             */
-            ts_free( (void *)queue );
+            free_object( TR_QUEUE, (void *)queue );
             error = ERR_NOMGB;
         }
     }
@@ -1047,7 +1457,7 @@ ULONG
         */
         pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                               (void *)&(queue->queue_lock));
-        pthread_mutex_lock( &(queue->queue_lock) );
+        lk_lock( &(queue->queue_lock), &(queue->queue_lkstat) );
 
         /*
         **  See how many messages are already sent into the queue
@@ -1082,7 +1492,9 @@ ULONG
                 /*
                 **  Signal the condition variable for the queue
                 */
-                pthread_cond_broadcast( &(queue->queue_send) );
+                stat_wake( next_susp_tcb( queue->first_susp,
+                                          (queue->flags & Q_PRIOR) ) );
+                lk_broadcast( &(queue->queue_send) );
             }
             else
                 /*
@@ -1100,13 +1512,20 @@ ULONG
             /*
             **  Signal the condition variable for the queue
             */
-            pthread_cond_broadcast( &(queue->queue_send) );
+            stat_wake( next_susp_tcb( queue->first_susp,
+                                      (queue->flags & Q_PRIOR) ) );
+            lk_broadcast( &(queue->queue_send) );
         }
 
+        if ( error == ERR_NO_ERROR )
+            queue->urgent_count++;
+        else
+            queue->full_count++;
+
         /*
         **  Unlock the queue mutex. 
         */
-        pthread_mutex_unlock( &(queue->queue_lock) );
+        lk_unlock( &(queue->queue_lock), &(queue->queue_lkstat) );
         pthread_cleanup_pop( 0 );
 
         /*
@@ -1114,6 +1533,9 @@ ULONG
         **  to a task made runnable by this call.
         */
         sched_unlock();
+
+        if ( error == ERR_NO_ERROR )
+            TRACE( TR_QUEUE | TR_SEND, qid, 1 );
     }
     else
     {
@@ -1162,7 +1584,7 @@ ULONG
         */
         pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                               (void *)&(queue->queue_lock));
-        pthread_mutex_lock( &(queue->queue_lock) );
+        lk_lock( &(queue->queue_lock), &(queue->queue_lkstat) );
 
         /*
         **  See how many messages are already sent into the queue
@@ -1267,10 +1689,15 @@ ULONG
             }
         }
 
+        if ( error == ERR_NO_ERROR )
+            queue->send_count++;
+        else
+            queue->full_count++;
+
         /*
         **  Unlock the queue mutex. 
         */
-        pthread_mutex_unlock( &(queue->queue_lock) );
+        lk_unlock( &(queue->queue_lock), &(queue->queue_lkstat) );
         pthread_cleanup_pop( 0 );
 
         /*
@@ -1278,6 +1705,9 @@ ULONG
         **  to a task made runnable by this call.
         */
         sched_unlock();
+
+        if ( error == ERR_NO_ERROR )
+            TRACE( TR_QUEUE | TR_SEND, qid, 0 );
     }
     else
     {
@@ -1308,7 +1738,7 @@ ULONG
         */
         pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                               (void *)&(queue->queue_lock));
-        pthread_mutex_lock( &(queue->queue_lock) );
+        lk_lock( &(queue->queue_lock), &(queue->queue_lkstat) );
 
         if ( queue->first_susp != (p2pthread_cb_t *)NULL )
         {
@@ -1366,12 +1796,17 @@ ULONG
                 */
                 queue->send_type = BCAST;
             }
+
+            if ( error == ERR_NO_ERROR )
+                queue->bcast_count++;
+            else
+                queue->full_count++;
         }
 
         /*
         **  Unlock the queue mutex. 
         */
-        pthread_mutex_unlock( &(queue->queue_lock) );
+        lk_unlock( &(queue->queue_lock), &(queue->queue_lkstat) );
         pthread_cleanup_pop( 0 );
 
         /*
@@ -1393,7 +1828,7 @@ ULONG
             */
             pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                                   (void *)&(queue->qbcst_lock) );
-            pthread_mutex_lock( &(queue->qbcst_lock) );
+            lk_lock( &(queue->qbcst_lock), &(queue->qbcst_lkstat) );
 
             /*
             **  Lock mutex for urgent queue send, so while i was broadcasting 
@@ -1404,18 +1839,19 @@ ULONG
             */
             pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                                   (void *)&(queue->queue_lock));
-            pthread_mutex_lock( &(queue->queue_lock) );
+            lk_lock( &(queue->queue_lock), &(queue->queue_lkstat) );
 
             /*
             **  Signal the condition variable for the queue, wake up the task
 			**  block on the ev_receive() call.
             */
-            pthread_cond_broadcast( &(queue->queue_send) );
+            stat_wake_all( queue->first_susp );
+            lk_broadcast( &(queue->queue_send) );
 
             /*
             **  Unlock the queue mutex. 
             */
-            pthread_mutex_unlock( &(queue->queue_lock) );
+            lk_unlock( &(queue->queue_lock), &(queue->queue_lkstat) );
             pthread_cleanup_pop( 0 );
 
             /*
@@ -1424,17 +1860,19 @@ ULONG
             **  broadcast-complete condition variable.
             */
             while ( queue->first_susp != (p2pthread_cb_t *)NULL )
-                pthread_cond_wait( &(queue->queue_bcplt),
-                                   &(queue->qbcst_lock) );
+                lk_wait( &(queue->queue_bcplt),
+                         &(queue->qbcst_lock),
+                         &(queue->qbcst_lkstat) );
 
             /*
             **  Unlock the queue broadcast completion mutex. 
             */
-            pthread_mutex_unlock( &(queue->qbcst_lock) );
+            lk_unlock( &(queue->qbcst_lock), &(queue->qbcst_lkstat) );
             pthread_cleanup_pop( 0 );
         }
 
         *count = queue->bcst_tasks_awakened;
+        TRACE( TR_QUEUE | TR_SEND, qid, *count );
 
         sched_unlock();
     }
@@ -1457,12 +1895,24 @@ static void
         current_extent;
     q_extent_t *
         next_extent;
+    int
+        static_queue;
+
+    static_queue = ((queue >= static_qcbs) &&
+                    (queue < &(static_qcbs[STATIC_QUEUES])));
 
     /*
     **  First remove the queue from the queue list
     */
     unlink_qcb( queue->qid );
 
+    /*
+    **  Fold the statistics of the queue's mutexes into those of deleted
+    **  queues.
+    */
+    lk_retire( &(queue->queue_lkstat) );
+    lk_retire( &(queue->qbcst_lkstat) );
+
     /*
     **  Next delete all extents allocated for queue data.
     */
@@ -1472,13 +1922,16 @@ static void
           current_extent = next_extent )
     {
         next_extent = (q_extent_t *)current_extent->nxt_extent;
-        ts_free( (void *)current_extent );
+        if ( !static_queue || (current_extent != queue->first_extent) )
+            ts_free( (void *)current_extent );
     }
 
     /*
-    **  Finally delete the queue control block itself;
+    **  Finally delete the queue control block itself, unless it is one of
+    **  those in the static configuration table.
     */
-    ts_free( (void *)queue );
+    if ( !static_queue )
+        free_object( TR_QUEUE, (void *)queue );
 
 }
 
@@ -1502,7 +1955,7 @@ ULONG
         */
         pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                               (void *)&(queue->queue_lock));
-        pthread_mutex_lock( &(queue->queue_lock) );
+        lk_lock( &(queue->queue_lock), &(queue->queue_lkstat) );
 
         if ( queue->msg_count )
             error = ERR_MATQDEL;
@@ -1525,7 +1978,7 @@ ULONG
         /*
         **  Unlock the queue mutex. 
         */
-        pthread_mutex_unlock( &(queue->queue_lock) );
+        lk_unlock( &(queue->queue_lock), &(queue->queue_lkstat) );
         pthread_cleanup_pop( 0 );
 
         /*
@@ -1539,24 +1992,25 @@ ULONG
             */
             pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                                   (void *)&(queue->qbcst_lock) );
-            pthread_mutex_lock( &(queue->qbcst_lock) );
+            lk_lock( &(queue->qbcst_lock), &(queue->qbcst_lkstat) );
 
             /*
             ** Lock mutex for urgent queue send
             */
             pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                                   (void *)&(queue->queue_lock));
-            pthread_mutex_lock( &(queue->queue_lock) );
+            lk_lock( &(queue->queue_lock), &(queue->queue_lkstat) );
 
             /*
             **  Signal the condition variable for the queue
             */
-            pthread_cond_broadcast( &(queue->queue_send) );
+            stat_wake_all( queue->first_susp );
+            lk_broadcast( &(queue->queue_send) );
 
             /*
             **  Unlock the queue mutex. 
             */
-            pthread_mutex_unlock( &(queue->queue_lock) );
+            lk_unlock( &(queue->queue_lock), &(queue->queue_lkstat) );
             pthread_cleanup_pop( 0 );
 
             /*
@@ -1565,15 +2019,17 @@ ULONG
             **  broadcast-complete condition variable.
             */
             while ( queue->first_susp != (p2pthread_cb_t *)NULL )
-                pthread_cond_wait( &(queue->queue_bcplt),
-                                   &(queue->qbcst_lock) );
+                lk_wait( &(queue->queue_bcplt),
+                         &(queue->qbcst_lock),
+                         &(queue->qbcst_lkstat) );
 
             /*
             **  Unlock the queue broadcast completion mutex. 
             */
-            pthread_mutex_unlock( &(queue->qbcst_lock) );
+            lk_unlock( &(queue->qbcst_lock), &(queue->qbcst_lkstat) );
             pthread_cleanup_pop( 0 );
         }
+        TRACE( TR_QUEUE | TR_DELETE, qid, 0 );
         delete_queue( queue );
         sched_unlock();
     }
@@ -1650,9 +2106,9 @@ static int
                 **  list of tasks waiting on the queue to get their
                 **  messages, bringing our task to the head of the list.
                 */
-                pthread_mutex_unlock( &(queue->queue_lock) );
+                lk_unlock( &(queue->queue_lock), &(queue->queue_lkstat) );
                 tm_wkafter( 1 );
-                pthread_mutex_lock( &(queue->queue_lock) );
+                lk_lock( &(queue->queue_lock), &(queue->queue_lkstat) );
             }
  
             /*
@@ -1661,7 +2117,7 @@ static int
             */
             if ( timeout != (struct timespec *)NULL )
             {
-                gettimeofday( &now, (struct timezone *)NULL );
+                p2pt_time( &now );
                 if ( timeout->tv_nsec > (now.tv_usec * 1000) )
                 {
                     usec = (timeout->tv_nsec - (now.tv_usec * 1000)) / 1000;
@@ -1690,22 +2146,36 @@ static int
 }
 
 /*****************************************************************************
-** q_receive - blocks the calling task until a message is available in the
-**             specified p2pthread queue.
+** q_receive_stamped - blocks the calling task until a message is available
+**                     in the specified p2pthread queue, and returns the
+**                     CLOCK_MONOTONIC nanoseconds at which it was sent if
+**                     the queue was created with Q_STAMP (else zero).
 *****************************************************************************/
 ULONG
-   q_receive( ULONG qid, ULONG opt, ULONG max_wait, q_msg_t msg )
+   q_receive_stamped( ULONG qid, ULONG opt, ULONG max_wait, q_msg_t msg,
+                      unsigned long long *sent_at )
 {
     p2pthread_cb_t *our_tcb;
     struct timeval now;
     struct timespec timeout;
     int retcode;
+    int blocked;
     long sec, usec;
     p2pt_queue_t *queue;
+    q_slot_t info;
     ULONG error;
 
     error = ERR_NO_ERROR;
 
+    if ( sent_at != (unsigned long long *)NULL )
+        *sent_at = 0;
+
+    /*
+    **  The caller has finished with any message it was serving, so it
+    **  gives back any priority lent to it with that message.
+    */
+    end_lent_priority( my_tcb() );
+
     if ( (queue = qcb_for( qid )) != (p2pt_queue_t *)NULL )
     {
 
@@ -1714,7 +2184,7 @@ ULONG
         */
         pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                               (void *)&(queue->queue_lock));
-        pthread_mutex_lock( &(queue->queue_lock) );
+        lk_lock( &(queue->queue_lock), &(queue->queue_lkstat) );
 
         /*
         **  If a broadcast is in progress, wait for it to complete
@@ -1722,9 +2192,9 @@ ULONG
         */
         while ( queue->send_type != SEND )
         {
-            pthread_mutex_unlock( &(queue->queue_lock) );
+            lk_unlock( &(queue->queue_lock), &(queue->queue_lkstat) );
             tm_wkafter( 1 );
-            pthread_mutex_lock( &(queue->queue_lock) );
+            lk_lock( &(queue->queue_lock), &(queue->queue_lkstat) );
         }
 
         /*
@@ -1739,6 +2209,7 @@ ULONG
         link_susp_tcb( &(queue->first_susp), our_tcb );
 
         retcode = 0;
+        blocked = FALSE;
 
         if ( opt & Q_NOWAIT )
         {
@@ -1746,7 +2217,7 @@ ULONG
             **  Caller specified no wait on queue message...
             **  Check the condition variable with an immediate timeout.
             */
-            gettimeofday( &now, (struct timezone *)NULL );
+            p2pt_time( &now );
             timeout.tv_sec = now.tv_sec;
             timeout.tv_nsec = now.tv_usec * 1000;
             while ( (waiting_on_queue( queue, &timeout, &retcode )) &&
@@ -1757,9 +2228,10 @@ ULONG
 				**  the queue doesn't own any messages, and then it blocks
 				**  on the sentence below to wait a new message.
 				*/
-                retcode = pthread_cond_timedwait( &(queue->queue_send),
-                                                  &(queue->queue_lock),
-                                                  &timeout );
+                retcode = lk_timedwait( &(queue->queue_send),
+                                        &(queue->queue_lock),
+                                        &timeout,
+                                        &(queue->queue_lkstat) );
             }
         }
         else
@@ -1774,8 +2246,11 @@ ULONG
                 */
                 while ( waiting_on_queue( queue, 0, &retcode ) )
                 {
-                    pthread_cond_wait( &(queue->queue_send),
-                                       &(queue->queue_lock) );
+                    TRACE_BLOCK( blocked, TR_QUEUE, qid );
+                    stat_block( our_tcb, WAIT_QUEUE );
+                    lk_wait( &(queue->queue_send),
+                             &(queue->queue_lock),
+                             &(queue->queue_lkstat) );
                 }
             }
             else
@@ -1786,7 +2261,7 @@ ULONG
                 */
                 sec = 0;
                 usec = max_wait * P2PT_TICK * 1000;
-                gettimeofday( &now, (struct timezone *)NULL );
+                p2pt_time( &now );
                 usec += now.tv_usec;
                 if ( usec > 1000000 )
                 {
@@ -1805,9 +2280,12 @@ ULONG
                 while ( (waiting_on_queue( queue, &timeout, &retcode )) &&
                         (retcode != ETIMEDOUT) )
                 {
-                    retcode = pthread_cond_timedwait( &(queue->queue_send),
-                                                      &(queue->queue_lock),
-                                                      &timeout );
+                    TRACE_BLOCK( blocked, TR_QUEUE, qid );
+                    stat_block( our_tcb, WAIT_QUEUE );
+                    retcode = lk_timedwait( &(queue->queue_send),
+                                            &(queue->queue_lock),
+                                            &timeout,
+                                            &(queue->queue_lkstat) );
                 }
             }
         }
@@ -1817,13 +2295,15 @@ ULONG
         **  for the queue.
         */
         unlink_susp_tcb( &(queue->first_susp), our_tcb );
+        TRACE_UNBLOCK( blocked, TR_QUEUE, qid, (retcode == ETIMEDOUT) );
+        stat_unblock( our_tcb, (retcode == ETIMEDOUT) );
 
         /*
         **  See if we were awakened due to a q_delete on the queue.
         */
         if ( queue->send_type & KILLD )
         {
-            fetch_msg_from( queue, msg );
+            fetch_msg_from( queue, msg, (q_slot_t *)NULL );
             error = ERR_QKILLD;
             msg = (ULONG *)NULL;
 #ifdef DIAG_PRINTFS 
@@ -1843,7 +2323,10 @@ ULONG
                 if ( opt & Q_NOWAIT )
                     error = ERR_NOMSG;
                 else
+                {
                     error = ERR_TIMEOUT;
+                    queue->timeout_count++;
+                }
                 msg = (ULONG *)NULL;
 #ifdef DIAG_PRINTFS 
                 printf( "...timed out" );
@@ -1855,7 +2338,13 @@ ULONG
                 **  A message was sent to the queue for this task...
                 **  Retrieve the message and clear the queue contents.
                 */
-                fetch_msg_from( queue, msg );
+                fetch_msg_from( queue, msg, &info );
+                queue->recv_count++;
+                if ( sent_at != (unsigned long long *)NULL )
+                    *sent_at = info.sent_at;
+                if ( queue->flags & Q_INHERIT )
+                    start_serving( queue, our_tcb, info.sender_pri );
+                TRACE( TR_QUEUE | TR_RECEIVE, qid, 0 );
 #ifdef DIAG_PRINTFS 
                 printf( "...rcvd queue msg %lu%lu%lu%lu",
                          msg[0], msg[1], msg[2], msg[3] );
@@ -1866,7 +2355,7 @@ ULONG
         /*
         **  Unlock the mutex for the condition variable and clean up.
         */
-        pthread_mutex_unlock( &(queue->queue_lock) );
+        lk_unlock( &(queue->queue_lock), &(queue->queue_lkstat) );
         pthread_cleanup_pop( 0 );
     }
     else
@@ -1878,6 +2367,17 @@ ULONG
     return( error );
 }
 
+/*****************************************************************************
+** q_receive - blocks the calling task until a message is available in the
+**             specified p2pthread queue.
+*****************************************************************************/
+ULONG
+   q_receive( ULONG qid, ULONG opt, ULONG max_wait, q_msg_t msg )
+{
+    return( q_receive_stamped( qid, opt, max_wait, msg,
+                               (unsigned long long *)NULL ) );
+}
+
 /*****************************************************************************
 ** q_ident - identifies the specified p2pthread queue
 *****************************************************************************/
@@ -1936,3 +2436,99 @@ ULONG
 
     return( error );
 }
+
+/*****************************************************************************
+** publish_queues - fills in stats page entries for up to 'max_rows' queues.
+**                  Returns the number of queues, which may exceed 'max_rows'.
+*****************************************************************************/
+ULONG
+   publish_queues( sp_object_t rows[], ULONG max_rows )
+{
+    p2pt_queue_t *queue;
+    sp_object_t *row;
+    ULONG count;
+    int i;
+
+    count = 0;
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&queue_list_lock );
+    lk_lock( &queue_list_lock, &queue_list_lkstat );
+
+    for ( queue = queue_list; queue != (p2pt_queue_t *)NULL;
+          queue = queue->nxt_queue, count++ )
+    {
+        if ( count >= max_rows )
+            continue;
+        row = &(rows[count]);
+        memset( (void *)row, 0, sizeof( *row ) );
+        row->obj_class = SP_QUEUE;
+        row->objid = queue->qid;
+        for ( i = 0; i < 4; i++ )
+            row->objname[i] = queue->qname[i];
+        if ( queue->flags & Q_LIMIT )
+            row->limit = (ULONG)queue->msgs_per_extent;
+
+        /*
+        **  The queue cannot be deleted while it is on the list we hold.
+        */
+        pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                              (void *)&(queue->queue_lock));
+        lk_lock( &(queue->queue_lock), &(queue->queue_lkstat) );
+        row->depth = (ULONG)queue->msg_count;
+        row->waiters = count_susp_tcbs( queue->first_susp );
+        row->puts = queue->send_count + queue->urgent_count +
+                    queue->bcast_count;
+        row->gets = queue->recv_count;
+        lk_unlock( &(queue->queue_lock), &(queue->queue_lkstat) );
+        pthread_cleanup_pop( 0 );
+    }
+
+    lk_unlock( &queue_list_lock, &queue_list_lkstat );
+    pthread_cleanup_pop( 0 );
+
+    return( count );
+}
+
+/*****************************************************************************
+** q_info - fills in the depth and traffic statistics of the specified queue
+*****************************************************************************/
+ULONG
+   q_info( ULONG qid, q_info_t *info )
+{
+    p2pt_queue_t *queue;
+    int i;
+
+    if ( (queue = qcb_for( qid )) == (p2pt_queue_t *)NULL )
+        return( ERR_OBJDEL );
+
+    memset( (void *)info, 0, sizeof( *info ) );
+    info->qid = queue->qid;
+    for ( i = 0; i < 4; i++ )
+        info->qname[i] = queue->qname[i];
+    info->flags = queue->flags;
+    if ( queue->flags & Q_LIMIT )
+        info->limit = (ULONG)queue->msgs_per_extent;
+
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&(queue->queue_lock));
+    lk_lock( &(queue->queue_lock), &(queue->queue_lkstat) );
+
+    info->depth = (ULONG)queue->msg_count;
+    info->high_water = (ULONG)queue->high_water;
+    info->waiters = count_susp_tcbs( queue->first_susp );
+    info->sends = queue->send_count;
+    info->urgents = queue->urgent_count;
+    info->broadcasts = queue->bcast_count;
+    info->receives = queue->recv_count;
+    info->timeouts = queue->timeout_count;
+    info->full_errors = queue->full_count;
+    info->extents = (ULONG)queue->total_extents;
+    for ( i = 0; i < Q_RES_BUCKETS; i++ )
+        info->residence[i] = queue->residence[i];
+    info->max_residence_ns = queue->max_residence_ns;
+
+    lk_unlock( &(queue->queue_lock), &(queue->queue_lkstat) );
+    pthread_cleanup_pop( 0 );
+
+    return( ERR_NO_ERROR );
+}
@@ -0,0 +1,1502 @@
+/*****************************************************************************
+ * region.c - defines the wrapper functions and data structures needed
+ *            to implement a Wind River pSOS+ (R) region API
+ *            in a POSIX Threads environment.
+ ****************************************************************************/
+
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include "p2pthread.h"
+
+#undef DIAG_PRINTFS
+
+#define RN_NOWAIT    0x01
+#define RN_PRIOR     0x02
+#define RN_DEL       0x04
+
+#define ERR_TIMEOUT  0x01
+#define ERR_NODENO   0x04
+#define ERR_OBJDEL   0x05
+#define ERR_OBJTFULL 0x08
+#define ERR_OBJNF    0x09
+
+#define ERR_RNADDR   0x1B
+#define ERR_UNITSIZE 0x1C
+#define ERR_TINYUNIT 0x1D
+#define ERR_TINYRN   0x1E
+#define ERR_SEGINUSE 0x1F
+#define ERR_ZERO     0x20
+#define ERR_TOOBIG   0x21
+#define ERR_NOSEG    0x22
+#define ERR_NOTINRN  0x23
+#define ERR_SEGADDR  0x24
+#define ERR_SEGFREE  0x25
+#define ERR_RNKILLD  0x26
+#define ERR_TATRNDEL 0x27
+
+#define SEND  0
+#define KILLD 2
+
+/*
+**  Free blocks are kept on segregated free lists, two levels deep.  The
+**  first level splits block sizes by powers of two, the second splits each
+**  power of two into RN_SL_COUNT equal ranges.  Blocks smaller than
+**  1 << RN_FL_SHIFT bytes all fall in first level list 0, in steps of
+**  1 << RN_MIN_LOG2 bytes.  Bitmaps of the non-empty lists let a fit be
+**  found with two bit scans, whatever the number of free blocks.
+*/
+#define RN_SL_LOG2   4
+#define RN_SL_COUNT  (1 << RN_SL_LOG2)
+#define RN_MIN_LOG2  4
+#define RN_FL_SHIFT  (RN_SL_LOG2 + RN_MIN_LOG2)
+#define RN_MAX_LOG2  40
+#define RN_FL_COUNT  (RN_MAX_LOG2 - RN_FL_SHIFT + 1)
+
+#define ULONG_BITS   (sizeof( ULONG ) * 8)
+
+/*****************************************************************************
+**  Header of a block of region memory.  A segment handed to the caller
+**  starts right after the size field; the free list links overlay the start
+**  of the segment and are valid only while the block is free.
+*****************************************************************************/
+typedef struct rn_block
+{
+    struct rn_block *
+        prv_phys;        /* Block just below this one in memory (or NULL) */
+    ULONG
+        size;            /* Bytes in block, header included, | BLK_FREE */
+    struct rn_block *
+        nxt_free;        /* Next block on same free list */
+    struct rn_block *
+        prv_free;        /* Previous block on same free list */
+} rn_block_t;
+
+#define RN_HDR_SIZE  (sizeof( rn_block_t * ) + sizeof( ULONG ))
+#define BLK_FREE     ((ULONG)0x01)
+#define BLK_SIZE(b)  ((b)->size & ~((ULONG)((1 << RN_MIN_LOG2) - 1)))
+#define NXT_PHYS(b)  ((rn_block_t *)((char *)(b) + BLK_SIZE( b )))
+
+/*****************************************************************************
+**  Region statistics, as returned by rn_stats()
+*****************************************************************************/
+typedef struct rn_stat
+{
+    ULONG
+        total_bytes;     /* Bytes available for segments when region empty */
+    ULONG
+        free_bytes;      /* Bytes in free blocks, headers included */
+    ULONG
+        min_free;        /* Lowest free_bytes has been since rn_create */
+    ULONG
+        used_segs;       /* Segments currently allocated */
+    ULONG
+        free_blocks;     /* Number of free blocks */
+    ULONG
+        largest_free;    /* Largest segment which could be allocated now */
+    ULONG
+        frag_pct;        /* Percent of free bytes not in the largest block */
+} rn_stat_t;
+
+/*****************************************************************************
+**  Control block for p2pthread region
+**
+**  The region memory holds only segments and their headers; the control
+**  block and free list heads are kept outside it.
+**
+*****************************************************************************/
+typedef struct p2pt_region
+{
+        /*
+        ** ID for region
+        */
+    ULONG
+        rnid;
+
+        /*
+        ** Region Name
+        */
+    char
+        rname[4];
+
+        /*
+        ** Option Flags for region
+        */
+    ULONG
+        flags;
+
+        /*
+        ** Mutex for region segment allocation and release.  Pended tasks
+        ** wait on the pend_wakeup condition variable in their own TCBs.
+        */
+    pthread_mutex_t
+        region_lock;
+    lk_stat_t
+        region_lkstat;   /* Contention statistics for region_lock */
+
+        /*
+        ** Mutex and Condition variable for region delete
+        */
+    pthread_mutex_t
+        rndel_lock;
+    lk_stat_t
+        rndel_lkstat;    /* Contention statistics for rndel_lock */
+    pthread_cond_t
+        rndel_cplt;
+
+        /*
+        ** Start and length of region memory, and the number of bytes the
+        ** library mapped for it (zero if the caller supplied it)
+        */
+    char *
+        saddr;
+    ULONG
+        length;
+    size_t
+        mapped_size;
+
+        /*
+        ** Allocation unit... segments start on unit boundaries and each
+        ** block (header included) is a whole number of units
+        */
+    ULONG
+        unit_size;
+
+        /*
+        ** Smallest block which can be split off and put on a free list
+        */
+    ULONG
+        min_block;
+
+        /*
+        ** First block in region, and zero-size block marking its end
+        */
+    rn_block_t *
+        first_block;
+    rn_block_t *
+        end_block;
+
+        /*
+        ** Bitmaps of non-empty first and second level free lists, and
+        ** the free list heads
+        */
+    ULONG
+        fl_bitmap;
+    ULONG
+        sl_bitmap[RN_FL_COUNT];
+    rn_block_t *
+        free_lists[RN_FL_COUNT][RN_SL_COUNT];
+
+        /*
+        ** Allocation statistics
+        */
+    ULONG
+        total_bytes;
+    ULONG
+        free_bytes;
+    ULONG
+        min_free;
+    ULONG
+        used_segs;
+    ULONG
+        free_blocks;
+
+        /*
+        ** Type of send operation last performed on region
+        */
+    int
+        send_type;
+
+        /*
+        **  Pointer to next region control block in region list.
+        */
+    struct p2pt_region *
+        nxt_region;
+
+        /*
+        ** First task control block in list of tasks waiting on region
+        */
+    p2pthread_cb_t *
+        first_susp;
+} p2pt_region_t;
+
+/*****************************************************************************
+**  External function and data references
+*****************************************************************************/
+extern void *
+    ts_malloc( size_t blksize );
+extern void
+    ts_free( void *blkaddr );
+extern p2pthread_cb_t *
+   my_tcb( void );
+extern void
+   sched_lock( void );
+extern void
+   sched_unlock( void );
+extern void
+   link_susp_tcb( p2pthread_cb_t **list_head, p2pthread_cb_t *new_entry );
+extern void
+   unlink_susp_tcb( p2pthread_cb_t **list_head, p2pthread_cb_t *entry );
+extern void
+   stat_block( p2pthread_cb_t *tcb, int reason );
+extern void
+   stat_unblock( p2pthread_cb_t *tcb, int timedout );
+extern void
+   stat_wake( p2pthread_cb_t *tcb );
+
+/*****************************************************************************
+**  p2pthread Global Data Structures
+*****************************************************************************/
+
+/*
+**  region_list is a linked list of region control blocks.  It is used to
+**              locate regions by their ID numbers.
+*/
+static p2pt_region_t *
+    region_list;
+
+/*
+**  region_list_lock is a mutex used to serialize access to the region list
+*/
+static pthread_mutex_t
+    region_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static lk_stat_t
+    region_list_lkstat = LK_STAT_INITIALIZER( TR_REGION, "region_list_lock" );
+
+
+/*****************************************************************************
+** rncb_for - returns the address of the region control block for the region
+**            idenified by rnid
+*****************************************************************************/
+static p2pt_region_t *
+   rncb_for( ULONG rnid )
+{
+    p2pt_region_t *current_rncb;
+
+    for ( current_rncb = region_list;
+          current_rncb != (p2pt_region_t *)NULL;
+          current_rncb = current_rncb->nxt_region )
+    {
+        if ( current_rncb->rnid == rnid )
+            break;
+    }
+
+    return( current_rncb );
+}
+
+/*****************************************************************************
+** new_rnid - automatically returns a valid, unused region ID
+*****************************************************************************/
+static ULONG
+   new_rnid( void )
+{
+    p2pt_region_t *current_rncb;
+    ULONG new_rnid;
+
+    /*
+    **  Protect the region list while we examine it.
+    */
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&region_list_lock );
+    lk_lock( &region_list_lock, &region_list_lkstat );
+
+    /*
+    **  Get the highest previously assigned region id and add one.
+    */
+    new_rnid = 0L;
+    for ( current_rncb = region_list;
+          current_rncb != (p2pt_region_t *)NULL;
+          current_rncb = current_rncb->nxt_region )
+    {
+        if ( current_rncb->rnid > new_rnid )
+            new_rnid = current_rncb->rnid;
+    }
+    new_rnid++;
+
+    /*
+    **  Re-enable access to the region list by other threads.
+    */
+    lk_unlock( &region_list_lock, &region_list_lkstat );
+    pthread_cleanup_pop( 0 );
+
+    return( new_rnid );
+}
+
+/*****************************************************************************
+** link_rncb - appends a new region control block pointer to the region_list
+*****************************************************************************/
+static void
+   link_rncb( p2pt_region_t *new_region )
+{
+    p2pt_region_t *current_rncb;
+
+    /*
+    **  Protect the region list while we examine and modify it.
+    */
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&region_list_lock );
+    lk_lock( &region_list_lock, &region_list_lkstat );
+
+    new_region->nxt_region = (p2pt_region_t *)NULL;
+    if ( region_list != (p2pt_region_t *)NULL )
+    {
+        /*
+        **  One or more regions already exist in the region list...
+        **  Insert the new entry in ascending numerical sequence by rnid.
+        */
+        for ( current_rncb = region_list;
+              current_rncb->nxt_region != (p2pt_region_t *)NULL;
+              current_rncb = current_rncb->nxt_region )
+        {
+            if ( (current_rncb->nxt_region)->rnid > new_region->rnid )
+            {
+                new_region->nxt_region = current_rncb->nxt_region;
+                break;
+            }
+        }
+        current_rncb->nxt_region = new_region;
+#ifdef DIAG_PRINTFS
+        printf( "\r\nadd region cb @ %p to list @ %p", new_region,
+                current_rncb );
+#endif
+    }
+    else
+    {
+        /*
+        **  this is the first region being added to the region list.
+        */
+        region_list = new_region;
+#ifdef DIAG_PRINTFS
+        printf( "\r\nadd region cb @ %p to list @ %p", new_region,
+                &region_list );
+#endif
+    }
+
+    /*
+    **  Re-enable access to the region list by other threads.
+    */
+    lk_unlock( &region_list_lock, &region_list_lkstat );
+    pthread_cleanup_pop( 0 );
+}
+
+/*****************************************************************************
+** unlink_rncb - removes a region control block pointer from the region_list
+*****************************************************************************/
+static p2pt_region_t *
+   unlink_rncb( ULONG rnid )
+{
+    p2pt_region_t *current_rncb;
+    p2pt_region_t *selected_rncb;
+
+    selected_rncb =  (p2pt_region_t *)NULL;
+
+    /*
+    **  Protect the region list while we examine and modify it.
+    */
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&region_list_lock );
+    lk_lock( &region_list_lock, &region_list_lkstat );
+
+    if ( region_list != (p2pt_region_t *)NULL )
+    {
+        if ( region_list->rnid == rnid )
+        {
+            /*
+            **  The first region in the list matches the region ID
+            */
+            selected_rncb = region_list;
+            region_list = selected_rncb->nxt_region;
+        }
+        else
+        {
+            /*
+            **  Scan the next rncb for a matching rnid while retaining a
+            **  pointer to the current rncb.  If the next rncb matches,
+            **  select it and then unlink it from the region list.
+            */
+            for ( current_rncb = region_list;
+                  current_rncb->nxt_region != (p2pt_region_t *)NULL;
+                  current_rncb = current_rncb->nxt_region )
+            {
+                if ( (current_rncb->nxt_region)->rnid == rnid )
+                {
+                    selected_rncb = current_rncb->nxt_region;
+                    current_rncb->nxt_region = selected_rncb->nxt_region;
+                    break;
+                }
+            }
+        }
+#ifdef DIAG_PRINTFS
+        printf( "\r\ndel region cb @ %p from list", selected_rncb );
+#endif
+    }
+
+    /*
+    **  Re-enable access to the region list by other threads.
+    */
+    lk_unlock( &region_list_lock, &region_list_lkstat );
+    pthread_cleanup_pop( 0 );
+
+    return( selected_rncb );
+}
+
+/*****************************************************************************
+** list_for - returns the first and second level free list indices for
+**            blocks of 'size' bytes
+*****************************************************************************/
+static void
+   list_for( ULONG size, int *fl, int *sl )
+{
+    int msb;
+
+    if ( size < (1UL << RN_FL_SHIFT) )
+    {
+        *fl = 0;
+        *sl = (int)(size >> RN_MIN_LOG2);
+    }
+    else
+    {
+        msb = (int)(ULONG_BITS - 1) - __builtin_clzl( size );
+        *fl = msb - RN_FL_SHIFT + 1;
+        *sl = (int)((size >> (msb - RN_SL_LOG2)) & (RN_SL_COUNT - 1));
+    }
+}
+
+/*****************************************************************************
+** insert_free - puts a free block at the head of its free list
+*****************************************************************************/
+static void
+   insert_free( p2pt_region_t *region, rn_block_t *block )
+{
+    int fl, sl;
+
+    list_for( BLK_SIZE( block ), &fl, &sl );
+
+    block->size |= BLK_FREE;
+    block->prv_free = (rn_block_t *)NULL;
+    block->nxt_free = region->free_lists[fl][sl];
+    if ( block->nxt_free != (rn_block_t *)NULL )
+        block->nxt_free->prv_free = block;
+    region->free_lists[fl][sl] = block;
+
+    region->sl_bitmap[fl] |= (1UL << sl);
+    region->fl_bitmap |= (1UL << fl);
+    region->free_blocks++;
+}
+
+/*****************************************************************************
+** remove_free - takes a free block off its free list
+*****************************************************************************/
+static void
+   remove_free( p2pt_region_t *region, rn_block_t *block )
+{
+    int fl, sl;
+
+    list_for( BLK_SIZE( block ), &fl, &sl );
+
+    if ( block->prv_free != (rn_block_t *)NULL )
+        block->prv_free->nxt_free = block->nxt_free;
+    else
+        region->free_lists[fl][sl] = block->nxt_free;
+    if ( block->nxt_free != (rn_block_t *)NULL )
+        block->nxt_free->prv_free = block->prv_free;
+
+    if ( region->free_lists[fl][sl] == (rn_block_t *)NULL )
+    {
+        region->sl_bitmap[fl] &= ~(1UL << sl);
+        if ( region->sl_bitmap[fl] == 0L )
+            region->fl_bitmap &= ~(1UL << fl);
+    }
+
+    block->size &= ~BLK_FREE;
+    region->free_blocks--;
+}
+
+/*****************************************************************************
+** find_free - takes a free block of at least 'size' bytes off the free
+**             lists, or returns NULL if there is none.  The search starts
+**             at the list above the one 'size' falls in, so any block
+**             found is big enough without looking further.  Only if that
+**             fails is the head of the list 'size' falls in tried.
+*****************************************************************************/
+static rn_block_t *
+   find_free( p2pt_region_t *region, ULONG size )
+{
+    rn_block_t *block;
+    ULONG search;
+    ULONG sl_map;
+    ULONG fl_map;
+    int msb;
+    int fl, sl;
+
+    search = size;
+    if ( size >= (1UL << RN_FL_SHIFT) )
+    {
+        msb = (int)(ULONG_BITS - 1) - __builtin_clzl( size );
+        search += (1UL << (msb - RN_SL_LOG2)) - 1;
+    }
+    list_for( search, &fl, &sl );
+
+    sl_map = 0L;
+    if ( fl < RN_FL_COUNT )
+        sl_map = region->sl_bitmap[fl] & (~0UL << sl);
+    if ( sl_map == 0L )
+    {
+        /*
+        **  Nothing left in this power of two... take the smallest list
+        **  of any larger one.
+        */
+        fl_map = 0L;
+        if ( (fl + 1) < RN_FL_COUNT )
+            fl_map = region->fl_bitmap & (~0UL << (fl + 1));
+        if ( fl_map == 0L )
+        {
+            /*
+            **  No list is sure to fit... the first block on the list 'size'
+            **  itself falls in still might, e.g. the whole of an empty
+            **  region.
+            */
+            list_for( size, &fl, &sl );
+            block = region->free_lists[fl][sl];
+            if ( (block == (rn_block_t *)NULL) || (BLK_SIZE( block ) < size) )
+                return( (rn_block_t *)NULL );
+            remove_free( region, block );
+            return( block );
+        }
+        fl = __builtin_ctzl( fl_map );
+        sl_map = region->sl_bitmap[fl];
+    }
+    sl = __builtin_ctzl( sl_map );
+
+    block = region->free_lists[fl][sl];
+    remove_free( region, block );
+    return( block );
+}
+
+/*****************************************************************************
+** alloc_segment - carves a segment of at least 'size' bytes from the region,
+**                 splitting off and freeing any usable remainder of the
+**                 block found.  Returns NULL if no free block is big enough.
+**                 The caller must hold the region mutex.
+*****************************************************************************/
+static void *
+   alloc_segment( p2pt_region_t *region, ULONG size )
+{
+    rn_block_t *block;
+    rn_block_t *rest;
+    ULONG blk_size;
+
+    if ( size > region->total_bytes )
+        return( (void *)NULL );
+
+    blk_size = (size + RN_HDR_SIZE + region->unit_size - 1) &
+               ~(region->unit_size - 1);
+    if ( blk_size < region->min_block )
+        blk_size = region->min_block;
+
+    if ( (block = find_free( region, blk_size )) == (rn_block_t *)NULL )
+        return( (void *)NULL );
+
+    if ( (BLK_SIZE( block ) - blk_size) >= region->min_block )
+    {
+        /*
+        **  Split the block and free what we don't need.
+        */
+        rest = (rn_block_t *)((char *)block + blk_size);
+        rest->size = BLK_SIZE( block ) - blk_size;
+        rest->prv_phys = block;
+        NXT_PHYS( rest )->prv_phys = rest;
+        block->size = blk_size;
+        insert_free( region, rest );
+    }
+
+    region->free_bytes -= BLK_SIZE( block );
+    if ( region->free_bytes < region->min_free )
+        region->min_free = region->free_bytes;
+    region->used_segs++;
+
+#ifdef DIAG_PRINTFS
+    printf( "\r\nallocated %lu byte block @ %p from region %lu",
+            BLK_SIZE( block ), block, region->rnid );
+#endif
+    return( (void *)((char *)block + RN_HDR_SIZE) );
+}
+
+/*****************************************************************************
+** free_segment - returns a segment's block to the region, merging it with
+**                free blocks on either side.  The caller must hold the
+**                region mutex.
+*****************************************************************************/
+static void
+   free_segment( p2pt_region_t *region, rn_block_t *block )
+{
+    rn_block_t *neighbor;
+
+    region->free_bytes += BLK_SIZE( block );
+    region->used_segs--;
+
+    neighbor = NXT_PHYS( block );
+    if ( neighbor->size & BLK_FREE )
+    {
+        remove_free( region, neighbor );
+        block->size += BLK_SIZE( neighbor );
+    }
+
+    neighbor = block->prv_phys;
+    if ( (neighbor != (rn_block_t *)NULL) && (neighbor->size & BLK_FREE) )
+    {
+        /*
+        **  Leave the merged header marked free, so a second rn_retseg of
+        **  the same segment is still recognized as such.
+        */
+        remove_free( region, neighbor );
+        neighbor->size += BLK_SIZE( block );
+        block->size |= BLK_FREE;
+        block = neighbor;
+    }
+
+    NXT_PHYS( block )->prv_phys = block;
+    insert_free( region, block );
+}
+
+/*****************************************************************************
+** check_segment - returns ERR_NO_ERROR if 'seg_addr' is a segment currently
+**                 allocated from the region, else the error explaining why
+**                 not.  The caller must hold the region mutex.
+*****************************************************************************/
+static ULONG
+   check_segment( p2pt_region_t *region, char *seg_addr )
+{
+    rn_block_t *block;
+    rn_block_t *prev;
+
+    if ( (seg_addr < (char *)region->first_block + RN_HDR_SIZE) ||
+         (seg_addr >= (char *)region->end_block) )
+        return( ERR_NOTINRN );
+
+    if ( ((ULONG)(seg_addr - ((char *)region->first_block + RN_HDR_SIZE)) &
+          (region->unit_size - 1)) != 0L )
+        return( ERR_SEGADDR );
+
+    block = (rn_block_t *)(seg_addr - RN_HDR_SIZE);
+    if ( block->size & BLK_FREE )
+        return( ERR_SEGFREE );
+
+    /*
+    **  A real segment's header fits between its neighbors' headers.
+    */
+    if ( (BLK_SIZE( block ) < region->min_block) ||
+         (BLK_SIZE( block ) > (ULONG)((char *)region->end_block -
+                                      (char *)block)) ||
+         (NXT_PHYS( block )->prv_phys != block) )
+        return( ERR_SEGADDR );
+    prev = block->prv_phys;
+    if ( ((prev == (rn_block_t *)NULL) && (block != region->first_block)) ||
+         ((prev != (rn_block_t *)NULL) && (NXT_PHYS( prev ) != block)) )
+        return( ERR_SEGADDR );
+
+    return( ERR_NO_ERROR );
+}
+
+/*****************************************************************************
+** largest_free - returns the largest segment which could be allocated from
+**                the region now.  Only the highest non-empty free list need
+**                be scanned.  The caller must hold the region mutex.
+*****************************************************************************/
+static ULONG
+   largest_free( p2pt_region_t *region )
+{
+    rn_block_t *block;
+    ULONG largest;
+    int fl, sl;
+
+    largest = 0L;
+    if ( region->fl_bitmap != 0L )
+    {
+        fl = (int)(ULONG_BITS - 1) - __builtin_clzl( region->fl_bitmap );
+        sl = (int)(ULONG_BITS - 1) -
+             __builtin_clzl( region->sl_bitmap[fl] );
+        for ( block = region->free_lists[fl][sl];
+              block != (rn_block_t *)NULL; block = block->nxt_free )
+        {
+            if ( BLK_SIZE( block ) > largest )
+                largest = BLK_SIZE( block );
+        }
+        largest -= RN_HDR_SIZE;
+    }
+
+    return( largest );
+}
+
+/*****************************************************************************
+** rn_create - creates a p2pthread memory region from which variable-size
+**             segments may be allocated.  If saddr is NULL the library
+**             maps the region memory itself.
+*****************************************************************************/
+ULONG
+    rn_create( char name[4], void *saddr, ULONG length, ULONG unit_size,
+               ULONG flags, ULONG *rnid, ULONG *asiz )
+{
+    p2pt_region_t *region;
+    char *first;
+    ULONG error;
+    ULONG blk_size;
+    int i;
+
+    error = ERR_NO_ERROR;
+
+    /*
+    **  Validate the allocation unit... a power of two, 16 bytes or more.
+    */
+    if ( (unit_size & (unit_size - 1)) != 0L )
+        return( ERR_UNITSIZE );
+    if ( unit_size < (1UL << RN_MIN_LOG2) )
+        return( ERR_TINYUNIT );
+    if ( ((unsigned long)saddr & (sizeof( ULONG ) - 1)) != 0L )
+        return( ERR_RNADDR );
+
+    /*
+    **  First allocate memory for the region control block.
+    */
+    region = (p2pt_region_t *)ts_malloc( sizeof( p2pt_region_t ) );
+    if ( region == (p2pt_region_t *)NULL )
+        return( ERR_OBJTFULL );
+    memset( (void *)region, 0, sizeof( p2pt_region_t ) );
+
+    /*
+    **  If the caller supplied no memory for the region, map it.
+    */
+    if ( saddr == (void *)NULL )
+    {
+        saddr = mmap( (void *)NULL, length, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+        if ( saddr == MAP_FAILED )
+        {
+            ts_free( (void *)region );
+            return( ERR_OBJTFULL );
+        }
+        region->mapped_size = length;
+    }
+    region->saddr = (char *)saddr;
+    region->length = length;
+    region->unit_size = unit_size;
+    region->min_block = unit_size;
+    if ( region->min_block < sizeof( rn_block_t ) )
+        region->min_block = sizeof( rn_block_t );
+
+    /*
+    **  Place the first block so its segment starts on a unit boundary, and
+    **  the end marker so the first block is a whole number of units.
+    */
+    first = (char *)(((unsigned long)saddr + RN_HDR_SIZE + unit_size - 1) &
+                     ~(unit_size - 1)) - RN_HDR_SIZE;
+    blk_size = 0L;
+    if ( (first + RN_HDR_SIZE) <= ((char *)saddr + length) )
+        blk_size = ((ULONG)((char *)saddr + length - first) - RN_HDR_SIZE) &
+                   ~(unit_size - 1);
+    if ( blk_size > ((1UL << RN_MAX_LOG2) - unit_size) )
+        blk_size = (1UL << RN_MAX_LOG2) - unit_size;
+    if ( blk_size < region->min_block )
+    {
+        if ( region->mapped_size != 0 )
+            munmap( saddr, region->mapped_size );
+        ts_free( (void *)region );
+        return( ERR_TINYRN );
+    }
+
+    region->first_block = (rn_block_t *)first;
+    region->first_block->prv_phys = (rn_block_t *)NULL;
+    region->first_block->size = blk_size;
+    region->end_block = (rn_block_t *)(first + blk_size);
+    region->end_block->prv_phys = region->first_block;
+    region->end_block->size = 0L;
+    insert_free( region, region->first_block );
+
+    region->total_bytes = blk_size - RN_HDR_SIZE;
+    region->free_bytes = blk_size;
+    region->min_free = blk_size;
+
+    /*
+    ** Option Flags for region
+    */
+    region->flags = flags;
+
+    /*
+    **  Name for region
+    */
+    for ( i = 0; i < 4; i++ )
+        region->rname[i] = name[i];
+
+    /*
+    ** Mutex for region get/return segment, and mutex and condition
+    ** variable for region delete
+    */
+    pthread_mutex_init( &(region->region_lock),
+                        (pthread_mutexattr_t *)NULL );
+    pthread_mutex_init( &(region->rndel_lock),
+                        (pthread_mutexattr_t *)NULL );
+    pthread_cond_init( &(region->rndel_cplt),
+                       (pthread_condattr_t *)NULL );
+    region->send_type = SEND;
+    region->first_susp = (p2pthread_cb_t *)NULL;
+
+    /*
+    ** ID for region
+    */
+    region->rnid = new_rnid();
+    lk_init( &(region->region_lkstat), TR_REGION, region->rnid,
+             region->rname, "region_lock" );
+    lk_init( &(region->rndel_lkstat), TR_REGION, region->rnid,
+             region->rname, "rndel_lock" );
+    link_rncb( region );
+    TRACE( TR_REGION | TR_CREATE, region->rnid, region->total_bytes );
+
+#ifdef DIAG_PRINTFS
+    printf( "\r\nCreating region %c%c%c%c id %ld @ %p, %lu bytes",
+            region->rname[0], region->rname[1], region->rname[2],
+            region->rname[3], region->rnid, region, region->total_bytes );
+#endif
+
+    if ( rnid != (ULONG *)NULL )
+        *rnid = region->rnid;
+    if ( asiz != (ULONG *)NULL )
+        *asiz = region->total_bytes;
+
+    return( error );
+}
+
+/*****************************************************************************
+** next_seg_waiter - returns the tcb of the pended task which is next in
+**                   line for a segment from the specified region, according
+**                   to the pend order for the region.  Tasks which have
+**                   already been granted their segments are skipped.  The
+**                   caller must hold the region mutex.
+*****************************************************************************/
+static p2pthread_cb_t *
+   next_seg_waiter( p2pt_region_t *region )
+{
+    p2pthread_cb_t *current_tcb;
+    p2pthread_cb_t *selected_tcb;
+
+    selected_tcb = (p2pthread_cb_t *)NULL;
+
+    for ( current_tcb = region->first_susp;
+          current_tcb != (p2pthread_cb_t *)NULL;
+          current_tcb = current_tcb->nxt_susp )
+    {
+        if ( current_tcb->seg_granted != (void *)NULL )
+            continue;
+
+        if ( !(region->flags & RN_PRIOR) )
+        {
+            /*
+            **  Tasks pend in FIFO order... the first ungranted task is next.
+            */
+            selected_tcb = current_tcb;
+            break;
+        }
+
+        /*
+        **  Tasks pend in priority order... select the highest priority
+        **  ungranted task, taking the earliest arrival among equals.
+        */
+        if ( (selected_tcb == (p2pthread_cb_t *)NULL) ||
+             ((current_tcb->prv_priority).sched_priority >
+              (selected_tcb->prv_priority).sched_priority) )
+            selected_tcb = current_tcb;
+    }
+
+    return( selected_tcb );
+}
+
+/*****************************************************************************
+** grant_segments - allocates segments directly to pended tasks in pend
+**                  order, as long as the next task in line can be given
+**                  its segment.  A task which cannot be satisfied blocks
+**                  all tasks behind it, so a large request is not starved
+**                  by a stream of small ones.  The caller must hold the
+**                  region mutex.
+*****************************************************************************/
+static void
+   grant_segments( p2pt_region_t *region )
+{
+    p2pthread_cb_t *tcb;
+    void *segment;
+
+    while ( (tcb = next_seg_waiter( region )) != (p2pthread_cb_t *)NULL )
+    {
+        segment = alloc_segment( region, tcb->seg_wanted );
+        if ( segment == (void *)NULL )
+            break;
+
+        tcb->seg_granted = segment;
+        stat_wake( tcb );
+        lk_signal( &(tcb->pend_wakeup) );
+#ifdef DIAG_PRINTFS
+        printf( "\r\ngranted segment @ %p to tcb @ %p", segment, tcb );
+#endif
+    }
+}
+
+/*****************************************************************************
+** delete_region - takes care of destroying the specified region and freeing
+**                 any resources allocated for that region
+*****************************************************************************/
+static void
+   delete_region( p2pt_region_t *region )
+{
+    /*
+    **  First remove the region from the region list
+    */
+    unlink_rncb( region->rnid );
+
+    /*
+    **  Fold the statistics of the region's mutexes into those of deleted
+    **  regions.
+    */
+    lk_retire( &(region->region_lkstat) );
+    lk_retire( &(region->rndel_lkstat) );
+
+    /*
+    **  Next unmap the region memory, if the library mapped it.
+    */
+    if ( region->mapped_size != 0 )
+        munmap( (void *)region->saddr, region->mapped_size );
+
+    /*
+    **  Finally delete the region control block itself;
+    */
+    ts_free( (void *)region );
+}
+
+/*****************************************************************************
+** rn_delete - removes the specified region from the region list and frees
+**             the memory allocated for the region control block.  Segments
+**             must all have been returned unless the region was created
+**             with RN_DEL.
+*****************************************************************************/
+ULONG
+   rn_delete( ULONG rnid )
+{
+    p2pthread_cb_t *tcb;
+    p2pt_region_t *region;
+    ULONG error;
+
+    error = ERR_NO_ERROR;
+
+    if ( (region = rncb_for( rnid )) != (p2pt_region_t *)NULL )
+    {
+        sched_lock();
+
+        /*
+        **  Ensure that none of the region's segments are allocated.
+        */
+        if ( !(region->flags & RN_DEL) && (region->used_segs > 0L) )
+        {
+            sched_unlock();
+            return( ERR_SEGINUSE );
+        }
+
+        /*
+        **  Send signal and block while any tasks are still waiting
+        **  on the region
+        */
+        if ( region->first_susp != (p2pthread_cb_t *)NULL )
+        {
+            /*
+            ** Lock mutex for region delete completion
+            */
+            pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                                  (void *)&(region->rndel_lock) );
+            lk_lock( &(region->rndel_lock), &(region->rndel_lkstat) );
+
+            /*
+            ** Lock mutex for region delete
+            */
+            pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                                  (void *)&(region->region_lock));
+            lk_lock( &(region->region_lock), &(region->region_lkstat) );
+
+            /*
+            **  Declare the send type
+            */
+            region->send_type = KILLD;
+
+            error = ERR_TATRNDEL;
+
+            /*
+            **  Awaken every task pended on the region
+            */
+            for ( tcb = region->first_susp;
+                  tcb != (p2pthread_cb_t *)NULL;
+                  tcb = tcb->nxt_susp )
+            {
+                stat_wake( tcb );
+                lk_signal( &(tcb->pend_wakeup) );
+            }
+
+            /*
+            **  Unlock the region mutex.
+            */
+            lk_unlock( &(region->region_lock), &(region->region_lkstat) );
+            pthread_cleanup_pop( 0 );
+
+            /*
+            **  Wait for all pended tasks to receive delete message.
+            **  The last task to receive the message will signal the
+            **  delete-complete condition variable.
+            */
+            while ( region->first_susp != (p2pthread_cb_t *)NULL )
+                lk_wait( &(region->rndel_cplt),
+                         &(region->rndel_lock),
+                         &(region->rndel_lkstat) );
+
+            /*
+            **  Unlock the region delete completion mutex.
+            */
+            lk_unlock( &(region->rndel_lock), &(region->rndel_lkstat) );
+            pthread_cleanup_pop( 0 );
+        }
+        TRACE( TR_REGION | TR_DELETE, rnid, 0 );
+        delete_region( region );
+        sched_unlock();
+    }
+    else
+    {
+        error = ERR_OBJDEL;
+    }
+
+    return( error );
+}
+
+/*****************************************************************************
+** waiting_on_region - returns a nonzero result unless a qualifying event
+**                     occurs on the specified region which should cause the
+**                     pended task to be awakened.  The qualifying events
+**                     are:
+**                         (1) a segment has been granted to the current task
+**                             by a segment return, or the current task is
+**                             next in line and a big enough block is free
+**                         (2) the region is deleted
+*****************************************************************************/
+static int
+    waiting_on_region( p2pt_region_t *region, p2pthread_cb_t *our_tcb,
+                       int *retcode )
+{
+    int result;
+
+    if ( region->send_type & KILLD )
+    {
+        /*
+        **  Region has been killed... waiting is over.
+        */
+        result = 0;
+        *retcode = 0;
+    }
+    else if ( our_tcb->seg_granted != (void *)NULL )
+    {
+        /*
+        **  A segment return already handed our task its segment...
+        **  waiting is over.
+        */
+        result = 0;
+        *retcode = 0;
+    }
+    else if ( (next_seg_waiter( region ) == our_tcb) &&
+              ((our_tcb->seg_granted =
+                alloc_segment( region, our_tcb->seg_wanted )) !=
+               (void *)NULL) )
+    {
+        /*
+        **  No other task is ahead of ours in line, and the segment could
+        **  be allocated... stop waiting.
+        */
+        result = 0;
+        *retcode = 0;
+    }
+    else
+    {
+        /*
+        **  No segment for our task yet... continue waiting.
+        */
+        result = 1;
+    }
+
+    return( result );
+}
+
+/*****************************************************************************
+** rn_getseg - allocates a segment of at least 'size' bytes from the
+**             specified region, optionally blocking the calling task until
+**             one can be allocated.  Allocation takes a bounded time
+**             regardless of the number of free blocks in the region.
+*****************************************************************************/
+ULONG
+   rn_getseg( ULONG rnid, ULONG size, ULONG flags, ULONG max_wait,
+              void **seg_addr )
+{
+    p2pthread_cb_t *our_tcb;
+    struct timeval now;
+    struct timespec timeout;
+    int retcode;
+    int blocked;
+    long sec, usec;
+    p2pt_region_t *region;
+    void *segment;
+    ULONG error;
+
+    error = ERR_NO_ERROR;
+    segment = (void *)NULL;
+
+    if ( (region = rncb_for( rnid )) != (p2pt_region_t *)NULL )
+    {
+        if ( size == 0L )
+            error = ERR_ZERO;
+        else if ( size > region->total_bytes )
+            error = ERR_TOOBIG;
+        else
+        {
+            /*
+            ** Lock mutex for region segment allocation
+            */
+            pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                                  (void *)&(region->region_lock));
+            lk_lock( &(region->region_lock), &(region->region_lkstat) );
+
+            /*
+            **  Take the segment at once if no task is waiting ahead of us.
+            */
+            if ( region->first_susp == (p2pthread_cb_t *)NULL )
+                segment = alloc_segment( region, size );
+
+            /*
+            **  Otherwise wait for one, if the caller allows and is a task.
+            */
+            our_tcb = (p2pthread_cb_t *)NULL;
+            if ( (segment == (void *)NULL) && !(flags & RN_NOWAIT) )
+                our_tcb = my_tcb();
+
+            if ( our_tcb != (p2pthread_cb_t *)NULL )
+            {
+#ifdef DIAG_PRINTFS
+                printf( "\r\ntask @ %p wait for %lu bytes on region list @ %p",
+                        our_tcb, size, &(region->first_susp) );
+#endif
+                our_tcb->seg_wanted = size;
+                our_tcb->seg_granted = (void *)NULL;
+                link_susp_tcb( &(region->first_susp), our_tcb );
+
+                retcode = 0;
+                blocked = FALSE;
+
+                if ( max_wait == 0L )
+                {
+                    /*
+                    **  Infinite wait was specified... wait without timeout.
+                    */
+                    while ( waiting_on_region( region, our_tcb, &retcode ) )
+                    {
+                        TRACE_BLOCK( blocked, TR_REGION, rnid );
+                        stat_block( our_tcb, WAIT_REGION );
+                        lk_wait( &(our_tcb->pend_wakeup),
+                                 &(region->region_lock),
+                                 &(region->region_lkstat) );
+                    }
+                }
+                else
+                {
+                    /*
+                    **  Wait on segment with timeout...
+                    **  Calculate timeout delay in seconds and microseconds.
+                    */
+                    sec = 0;
+                    usec = max_wait * P2PT_TICK * 1000;
+                    p2pt_time( &now );
+                    usec += now.tv_usec;
+                    if ( usec > 1000000 )
+                    {
+                        sec = usec / 1000000;
+                        usec = usec % 1000000;
+                    }
+                    timeout.tv_sec = now.tv_sec + sec;
+                    timeout.tv_nsec = usec * 1000;
+
+                    /*
+                    **  Wait for a segment to be granted to the current task
+                    **  or for the timeout to expire.  The loop is required
+                    **  since the task may be awakened by signals other than
+                    **  a segment grant.
+                    */
+                    while ( (waiting_on_region( region, our_tcb, &retcode )) &&
+                            (retcode != ETIMEDOUT) )
+                    {
+                        TRACE_BLOCK( blocked, TR_REGION, rnid );
+                        stat_block( our_tcb, WAIT_REGION );
+                        retcode =
+                            lk_timedwait( &(our_tcb->pend_wakeup),
+                                          &(region->region_lock),
+                                          &timeout,
+                                          &(region->region_lkstat) );
+                    }
+                }
+
+                /*
+                **  Remove the calling task's tcb from the waiting task list
+                **  for the region.
+                */
+                unlink_susp_tcb( &(region->first_susp), our_tcb );
+                segment = our_tcb->seg_granted;
+                TRACE_UNBLOCK( blocked, TR_REGION, rnid,
+                               (segment == (void *)NULL) );
+                stat_unblock( our_tcb, (retcode == ETIMEDOUT) );
+                our_tcb->seg_wanted = 0L;
+                our_tcb->seg_granted = (void *)NULL;
+
+                /*
+                **  See if we were awakened due to a rn_delete on the region.
+                */
+                if ( region->send_type & KILLD )
+                {
+                    error = ERR_RNKILLD;
+                    segment = (void *)NULL;
+
+                    if ( region->first_susp == (p2pthread_cb_t *)NULL )
+                    {
+                        /*
+                        ** Lock mutex for region delete completion
+                        */
+                        pthread_cleanup_push(
+                            (void(*)(void *))pthread_mutex_unlock,
+                            (void *)&(region->rndel_lock) );
+                        lk_lock( &(region->rndel_lock),
+                                 &(region->rndel_lkstat) );
+
+                        /*
+                        **  Signal the delete-complete condition variable
+                        **  for the region
+                        */
+                        lk_broadcast( &(region->rndel_cplt) );
+
+                        region->send_type = SEND;
+
+                        /*
+                        **  Unlock the region delete completion mutex.
+                        */
+                        lk_unlock( &(region->rndel_lock),
+                                   &(region->rndel_lkstat) );
+                        pthread_cleanup_pop( 0 );
+                    }
+                }
+                else if ( segment == (void *)NULL )
+                {
+                    error = ERR_TIMEOUT;
+
+                    /*
+                    **  Our task may have been holding up smaller requests
+                    **  behind it... let them have any segments now free.
+                    */
+                    if ( region->first_susp != (p2pthread_cb_t *)NULL )
+                        grant_segments( region );
+                }
+            }
+            else if ( segment == (void *)NULL )
+            {
+                error = ERR_NOSEG;
+            }
+
+            /*
+            **  Unlock the mutex for the condition variable and clean up.
+            */
+            lk_unlock( &(region->region_lock), &(region->region_lkstat) );
+            pthread_cleanup_pop( 0 );
+        }
+    }
+    else
+    {
+        error = ERR_OBJDEL;       /* Invalid region specified */
+    }
+
+    if ( segment != (void *)NULL )
+        TRACE( TR_REGION | TR_RECEIVE, rnid, size );
+
+    /*
+    **  Return the segment address (or NULL) to the caller's storage location.
+    */
+    if ( seg_addr != (void **)NULL )
+        *seg_addr = segment;
+
+    return( error );
+}
+
+/*****************************************************************************
+** rn_retseg - returns a segment to the specified region, and grants
+**             segments to as many pended tasks as the freed memory allows.
+*****************************************************************************/
+ULONG
+   rn_retseg( ULONG rnid, void *seg_addr )
+{
+    p2pt_region_t *region;
+    ULONG error;
+
+    error = ERR_NO_ERROR;
+
+    if ( (region = rncb_for( rnid )) != (p2pt_region_t *)NULL )
+    {
+        /*
+        **  'Lock the p2pthread scheduler' to defer any context switch to a
+        **  higher priority task until after this call has completed its work.
+        */
+        sched_lock();
+
+        /*
+        ** Lock mutex for region segment release
+        */
+        pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                              (void *)&(region->region_lock));
+        lk_lock( &(region->region_lock), &(region->region_lkstat) );
+
+        error = check_segment( region, (char *)seg_addr );
+        if ( error == ERR_NO_ERROR )
+        {
+            free_segment( region,
+                          (rn_block_t *)((char *)seg_addr - RN_HDR_SIZE) );
+            TRACE( TR_REGION | TR_SEND, rnid, (ULONG)seg_addr );
+
+            /*
+            **  Pass the freed memory on to as many pended tasks as it
+            **  satisfies.
+            */
+            if ( region->first_susp != (p2pthread_cb_t *)NULL )
+                grant_segments( region );
+        }
+#ifdef DIAG_PRINTFS
+        else
+        {
+            printf( "\r\nrn_retseg - segment @ %p error %lx", seg_addr,
+                    error );
+        }
+#endif
+
+        /*
+        **  Unlock the region mutex.
+        */
+        lk_unlock( &(region->region_lock), &(region->region_lkstat) );
+        pthread_cleanup_pop( 0 );
+
+        /*
+        **  'Unlock the p2pthread scheduler' to enable a possible context switch
+        **  to a task made runnable by this call.
+        */
+        sched_unlock();
+    }
+    else
+    {
+        error = ERR_OBJDEL;       /* Invalid region specified */
+    }
+
+    return( error );
+}
+
+/*****************************************************************************
+** rn_stats - returns allocation and fragmentation statistics for the
+**            specified region
+*****************************************************************************/
+ULONG
+   rn_stats( ULONG rnid, rn_stat_t *stats )
+{
+    p2pt_region_t *region;
+    ULONG error;
+
+    error = ERR_NO_ERROR;
+
+    if ( (region = rncb_for( rnid )) != (p2pt_region_t *)NULL )
+    {
+        pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                              (void *)&(region->region_lock));
+        lk_lock( &(region->region_lock), &(region->region_lkstat) );
+
+        stats->total_bytes = region->total_bytes;
+        stats->free_bytes = region->free_bytes;
+        stats->min_free = region->min_free;
+        stats->used_segs = region->used_segs;
+        stats->free_blocks = region->free_blocks;
+        stats->largest_free = largest_free( region );
+        stats->frag_pct = 0L;
+        if ( region->free_bytes != 0L )
+            stats->frag_pct = 100L - ((stats->largest_free + RN_HDR_SIZE) *
+                                      100L) / region->free_bytes;
+
+        lk_unlock( &(region->region_lock), &(region->region_lkstat) );
+        pthread_cleanup_pop( 0 );
+    }
+    else
+    {
+        error = ERR_OBJDEL;       /* Invalid region specified */
+    }
+
+    return( error );
+}
+
+/*****************************************************************************
+** rn_ident - identifies the named p2pthread region
+*****************************************************************************/
+ULONG
+    rn_ident( char name[4], ULONG node, ULONG *rnid )
+{
+    p2pt_region_t *current_rncb;
+    ULONG error;
+
+    error = ERR_NO_ERROR;
+
+    /*
+    **  Validate the node specifier... only zero is allowed here.
+    */
+    if ( node != 0L )
+        error = ERR_NODENO;
+    else
+    {
+        /*
+        **  If region name string is a NULL pointer, return with error.
+        **  We'll ASSUME the rnid pointer isn't NULL!
+        */
+        if ( name == (char *)NULL )
+        {
+            *rnid = (ULONG)NULL;
+            error = ERR_OBJNF;
+        }
+        else
+        {
+            /*
+            **  Scan the region list for a name matching the caller's name.
+            */
+            for ( current_rncb = region_list;
+                  current_rncb != (p2pt_region_t *)NULL;
+                  current_rncb = current_rncb->nxt_region )
+            {
+                if ( (strncmp( name, current_rncb->rname, 4 )) == 0 )
+                {
+                    /*
+                    **  A matching name was found... return its RNID
+                    */
+                    *rnid = current_rncb->rnid;
+                    break;
+                }
+            }
+            if ( current_rncb == (p2pt_region_t *)NULL )
+            {
+                /*
+                **  No matching name found... return caller's RNID with error.
+                */
+                *rnid = (ULONG)NULL;
+                error = ERR_OBJNF;
+            }
+        }
+    }
+
+    return( error );
+}
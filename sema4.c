@@ -11,12 +11,12 @@
 #include <stdio.h>
 #include <string.h>
 #include <signal.h>
-#include <semaphore.h>
 #include <sys/time.h>
 #include "p2pthread.h"
 
 #undef DIAG_PRINTFS
 
+#define SM_FIFO      0x00
 #define SM_PRIOR     0x02
 #define SM_NOWAIT    0x01
 
@@ -31,6 +31,8 @@
 #define ERR_SKILLD   0x43
 #define ERR_TATSDEL  0x44
 
+#define ERR_ZERO     0x20
+
 #define SEND  0
 #define KILLD 2
 
@@ -39,8 +41,9 @@
 **
 **  The basic POSIX semaphore does not provide for time-bounded waits nor
 **  for selection of a thread to ready based either on FIFO or PRIORITY-based
-**  waiting.  This 'wrapper' extends the POSIX pthreads semaphore to include
-**  the attributes of a p2pthread semaphore.
+**  waiting, nor for acquiring several tokens at once.  This 'wrapper' keeps
+**  the token count itself under the semaphore mutex and hands tokens directly
+**  to pended tasks in FIFO or PRIORITY order as they are released.
 **
 *****************************************************************************/
 typedef struct p2pt_sema4
@@ -64,26 +67,29 @@ typedef struct p2pt_sema4
         flags;
 
         /*
-        ** Mutex and Condition variable for semaphore post/pend
+        ** Mutex for semaphore post/pend.  Pended tasks wait on the
+        ** pend_wakeup condition variable in their own TCBs.
         */
     pthread_mutex_t
         sema4_lock;
-    pthread_cond_t
-        sema4_send;
+    lk_stat_t
+        sema4_lkstat;    /* Contention statistics for sema4_lock */
 
         /*
         ** Mutex and Condition variable for semaphore delete
         */
     pthread_mutex_t
         smdel_lock;
+    lk_stat_t
+        smdel_lkstat;    /* Contention statistics for smdel_lock */
     pthread_cond_t
         smdel_cplt;
 
         /*
-        **  Pthread semaphore used to maintain count.
+        **  Number of tokens currently available from the semaphore.
         */
-    sem_t
-        pthread_sema4;
+    ULONG
+        token_count;
 
         /*
         ** Type of send operation last performed on semaphore
@@ -102,6 +108,15 @@ typedef struct p2pt_sema4
         */
     p2pthread_cb_t *
         first_susp;
+
+        /*
+        ** Tokens released to and granted from semaphore since it was
+        ** created
+        */
+    ULONG
+        tokens_in;
+    ULONG
+        tokens_out;
 } p2pt_sema4_t;
 
 /*****************************************************************************
@@ -111,20 +126,32 @@ extern void *
     ts_malloc( size_t blksize );
 extern void
     ts_free( void *blkaddr );
+extern void *
+    alloc_object( UINT obj_class, size_t blksize );
+extern void
+    free_object( UINT obj_class, void *block );
+extern int
+    ts_reserve( size_t blksize, ULONG count );
 extern p2pthread_cb_t *
    my_tcb( void );
 extern void
    sched_lock( void );
 extern void
    sched_unlock( void );
-extern ULONG
-   tm_wkafter( ULONG interval );
 extern void
    link_susp_tcb( p2pthread_cb_t **list_head, p2pthread_cb_t *new_entry );
 extern void
    unlink_susp_tcb( p2pthread_cb_t **list_head, p2pthread_cb_t *entry );
-extern int
-   signal_for_my_task( p2pthread_cb_t **list_head, int pend_order );
+extern void
+   init_isr_dispatch( void );
+extern void
+   stat_block( p2pthread_cb_t *tcb, int reason );
+extern void
+   stat_unblock( p2pthread_cb_t *tcb, int timedout );
+extern void
+   stat_wake( p2pthread_cb_t *tcb );
+extern ULONG
+   count_susp_tcbs( p2pthread_cb_t *list_head );
 
 /*****************************************************************************
 **  p2pthread Global Data Structures
@@ -142,6 +169,36 @@ static p2pt_sema4_t *
 */
 static pthread_mutex_t
     sema4_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static lk_stat_t
+    sema4_list_lkstat = LK_STAT_INITIALIZER( TR_SEMA4, "sema4_list_lock" );
+
+/*
+**  static_sema4s lists the semaphores in the static configuration table,
+**                and static_smcbs holds their control blocks
+*/
+typedef struct static_sema4
+{
+    char
+        name[4];
+    ULONG
+        count;
+    ULONG
+        flags;
+} static_sema4_t;
+
+static const static_sema4_t
+    static_sema4s[] =
+{
+#define P2PT_SEMA4( id, name, count, flags ) \
+    { name, (count), (flags) },
+#include "p2ptstatic.h"
+    { "", 0, 0 }
+};
+
+#define STATIC_SEMA4S ((sizeof( static_sema4s ) / sizeof( static_sema4_t )) - 1)
+
+static p2pt_sema4_t
+    static_smcbs[STATIC_SEMA4S + 1];
 
 
 /*****************************************************************************
@@ -198,7 +255,7 @@ static ULONG
     */
     pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                           (void *)&sema4_list_lock );
-    pthread_mutex_lock( &sema4_list_lock );
+    lk_lock( &sema4_list_lock, &sema4_list_lkstat );
 
     /*
     **  Get the highest previously assigned semaphore id and add one.
@@ -236,7 +293,7 @@ static ULONG
     /*
     **  Re-enable access to the semaphore list by other threads.
     */
-    pthread_mutex_unlock( &sema4_list_lock );
+    lk_unlock( &sema4_list_lock, &sema4_list_lkstat );
     pthread_cleanup_pop( 0 );
 
     return( new_sema4_id );
@@ -255,7 +312,7 @@ static void
     */
     pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                           (void *)&sema4_list_lock );
-    pthread_mutex_lock( &sema4_list_lock );
+    lk_lock( &sema4_list_lock, &sema4_list_lkstat );
 
     new_sema4->nxt_sema4 = (p2pt_sema4_t *)NULL;
     if ( sema4_list != (p2pt_sema4_t *)NULL )
@@ -295,7 +352,7 @@ static void
     /*
     **  Re-enable access to the semaphore list by other threads.
     */
-    pthread_mutex_unlock( &sema4_list_lock );
+    lk_unlock( &sema4_list_lock, &sema4_list_lkstat );
     pthread_cleanup_pop( 0 );
 }
 
@@ -318,7 +375,7 @@ static p2pt_sema4_t *
         */
         pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                               (void *)&sema4_list_lock );
-        pthread_mutex_lock( &sema4_list_lock );
+        lk_lock( &sema4_list_lock, &sema4_list_lkstat );
 
         /*
         **  Scan the semaphore list for an smcb with a matching semaphore ID
@@ -367,13 +424,112 @@ static p2pt_sema4_t *
         /*
         **  Re-enable access to the semaphore list by other threads.
         */
-        pthread_mutex_unlock( &sema4_list_lock );
+        lk_unlock( &sema4_list_lock, &sema4_list_lkstat );
         pthread_cleanup_pop( 0 );
     }
 
     return( selected_smcb );
 }
 
+/*****************************************************************************
+** init_smcb - initializes the name, locks and token count of a semaphore
+**             control block
+*****************************************************************************/
+static void
+   init_smcb( p2pt_sema4_t *semaphore, const char name[4], ULONG count )
+{
+    int i;
+
+    /*
+    **  Name for semaphore
+    */
+    for ( i = 0; i < 4; i++ )
+        semaphore->sname[i] = name[i];
+
+#ifdef DIAG_PRINTFS 
+    printf( "\r\nCreating semaphore %c%c%c%c id %ld @ %p",
+                 semaphore->sname[0], semaphore->sname[1],
+                 semaphore->sname[r20], semaphore->sname[3],
+                 semaphore->smid, semaphore );
+#endif
+
+    /*
+    ** Mutex for semaphore send/pend
+    */
+    pthread_mutex_init( &(semaphore->sema4_lock),
+                        (pthread_mutexattr_t *)NULL );
+    lk_init( &(semaphore->sema4_lkstat), TR_SEMA4, semaphore->smid,
+             semaphore->sname, "sema4_lock" );
+
+    /*
+    ** Mutex and Condition variable for semaphore delete/delete
+    */
+    pthread_mutex_init( &(semaphore->smdel_lock),
+                        (pthread_mutexattr_t *)NULL );
+    lk_init( &(semaphore->smdel_lkstat), TR_SEMA4, semaphore->smid,
+             semaphore->sname, "smdel_lock" );
+    pthread_cond_init( &(semaphore->smdel_cplt),
+                       (pthread_condattr_t *)NULL );
+
+    /*
+    **  Initial number of tokens available from the semaphore.
+    */
+    semaphore->token_count = count;
+
+    /*
+    ** Type of send operation last performed on semaphore
+    */
+    semaphore->send_type = SEND;
+
+    /*
+    ** First task control block in list of tasks waiting on semaphore
+    */
+    semaphore->first_susp = (p2pthread_cb_t *)NULL;
+
+    semaphore->tokens_in = 0;
+    semaphore->tokens_out = 0;
+}
+
+/*****************************************************************************
+** create_static_sema4s - initializes the semaphores in the static
+**                        configuration table and links them into the
+**                        semaphore list, in ID order, before main() is
+**                        called.
+*****************************************************************************/
+static void __attribute__(( constructor ))
+   create_static_sema4s( void )
+{
+    p2pt_sema4_t *semaphore;
+    ULONG i;
+
+    for ( i = 0; i < STATIC_SEMA4S; i++ )
+    {
+        semaphore = &(static_smcbs[i]);
+        semaphore->smid = i + 1;
+        semaphore->flags = static_sema4s[i].flags;
+        init_smcb( semaphore, static_sema4s[i].name, static_sema4s[i].count );
+        semaphore->nxt_sema4 = (p2pt_sema4_t *)NULL;
+        if ( i > 0 )
+            static_smcbs[i - 1].nxt_sema4 = semaphore;
+    }
+
+    if ( STATIC_SEMA4S > 0 )
+    {
+        sema4_list = &(static_smcbs[0]);
+        init_isr_dispatch();
+    }
+}
+
+/*****************************************************************************
+** reserve_smcbs - carves storage for 'count' semaphore control blocks in
+**                 advance
+*****************************************************************************/
+int
+   reserve_smcbs( ULONG count )
+{
+    return( ts_reserve( sizeof( p2pt_sema4_t ), count ) );
+}
+
 /*****************************************************************************
 ** sm_create - creates a p2pthread message semaphore
 *****************************************************************************/
@@ -382,15 +538,19 @@ ULONG
 {
     p2pt_sema4_t *semaphore;
     ULONG error;
-    int i;
-    char create_error[80];
 
     error = ERR_NO_ERROR;
 
+    /*
+    **  Make sure ISRs can release tokens through the dispatch thread.
+    */
+    init_isr_dispatch();
+
     /*
     **  First allocate memory for the semaphore control block
     */
-    semaphore = (p2pt_sema4_t *)ts_malloc( sizeof( p2pt_sema4_t ) );
+    semaphore = (p2pt_sema4_t *)alloc_object( TR_SEMA4,
+                                                 sizeof( p2pt_sema4_t ) );
     if ( semaphore != (p2pt_sema4_t *)NULL )
     {
         /*
@@ -409,79 +569,112 @@ ULONG
         if ( smid != (ULONG *)NULL )
             *smid = semaphore->smid;
 
+        init_smcb( semaphore, name, count );
+
         /*
-        **  Name for semaphore
+        **  Link the new semaphore into the semaphore list.
         */
-        for ( i = 0; i < 4; i++ )
-            semaphore->sname[i] = name[i];
+        link_smcb( semaphore );
+        TRACE( TR_SEMA4 | TR_CREATE, semaphore->smid, count );
+    }
+    else
+    {
+        error = ERR_NOSCB;
+    }
 
-#ifdef DIAG_PRINTFS 
-        printf( "\r\nCreating semaphore %c%c%c%c id %ld @ %p",
-                     semaphore->sname[0], semaphore->sname[1],
-                     semaphore->sname[r20], semaphore->sname[3],
-                     semaphore->smid, semaphore );
-#endif
+    return( error );
+}
 
-        /*
-        ** Mutex and Condition variable for semaphore send/pend
-        */
-        pthread_mutex_init( &(semaphore->sema4_lock),
-                            (pthread_mutexattr_t *)NULL );
-        pthread_cond_init( &(semaphore->sema4_send),
-                           (pthread_condattr_t *)NULL );
+/*****************************************************************************
+** next_token_waiter - returns the tcb of the pended task which is next in
+**                     line for tokens from the specified semaphore, according
+**                     to the pend order for the semaphore.  Tasks which have
+**                     already been granted their tokens are skipped.  The
+**                     caller must hold the semaphore mutex.
+*****************************************************************************/
+static p2pthread_cb_t *
+   next_token_waiter( p2pt_sema4_t *semaphore )
+{
+    p2pthread_cb_t *current_tcb;
+    p2pthread_cb_t *selected_tcb;
 
-        /*
-        ** Mutex and Condition variable for semaphore delete/delete
-        */
-        pthread_mutex_init( &(semaphore->smdel_lock),
-                            (pthread_mutexattr_t *)NULL );
-        pthread_cond_init( &(semaphore->smdel_cplt),
-                           (pthread_condattr_t *)NULL );
+    selected_tcb = (p2pthread_cb_t *)NULL;
 
-        /*
-        **  Pthread semaphore used to maintain count. Cause Linuxthread
-		**  didn't inplement the multi-thread shared sema4, so the arg
-		**  'pshared' should be set to zero, any other value cause the 
-		**  function return with -1.
-        */
-        if ( sem_init( &(semaphore->pthread_sema4), 0, (unsigned int)count ) )
+    for ( current_tcb = semaphore->first_susp;
+          current_tcb != (p2pthread_cb_t *)NULL;
+          current_tcb = current_tcb->nxt_susp )
+    {
+        if ( current_tcb->tokens_served )
+            continue;
+
+        if ( !(semaphore->flags & SM_PRIOR) )
         {
-            sprintf( create_error,
-                     "\r\nSemaphore %c%c%c%c creation returned error:",
-                     semaphore->sname[0], semaphore->sname[1],
-                     semaphore->sname[2], semaphore->sname[3] );
-            perror( create_error );
+            /*
+            **  Tasks pend in FIFO order... the first ungranted task is next.
+            */
+            selected_tcb = current_tcb;
+            break;
         }
 
         /*
-        ** Type of send operation last performed on semaphore
+        **  Tasks pend in priority order... select the highest priority
+        **  ungranted task, taking the earliest arrival among equals.
         */
-        semaphore->send_type = SEND;
+        if ( (selected_tcb == (p2pthread_cb_t *)NULL) ||
+             ((current_tcb->prv_priority).sched_priority >
+              (selected_tcb->prv_priority).sched_priority) )
+            selected_tcb = current_tcb;
+    }
 
-        /*
-        ** First task control block in list of tasks waiting on semaphore
-        */
-        semaphore->first_susp = (p2pthread_cb_t *)NULL;
+    return( selected_tcb );
+}
 
-        /*
-        **  Link the new semaphore into the semaphore list.
-        */
-        link_smcb( semaphore );
-    }
-    else
+/*****************************************************************************
+** grant_tokens - hands available tokens directly to pended tasks in pend
+**                order, as long as the next task in line can be given its
+**                entire request.  Partial grants are never made, and a task
+**                which cannot be satisfied blocks all tasks behind it, so
+**                a large request is not starved by a stream of small ones.
+**                Each task granted its tokens is awakened individually.
+**                The caller must hold the semaphore mutex.
+**                Returns the number of tasks granted tokens.
+*****************************************************************************/
+static int
+   grant_tokens( p2pt_sema4_t *semaphore )
+{
+    p2pthread_cb_t *tcb;
+    int granted;
+
+    granted = 0;
+
+    while ( (tcb = next_token_waiter( semaphore )) != (p2pthread_cb_t *)NULL )
     {
-        error = ERR_NOSCB;
+        if ( semaphore->token_count < tcb->tokens_wanted )
+            break;
+
+        semaphore->token_count -= tcb->tokens_wanted;
+        semaphore->tokens_out += tcb->tokens_wanted;
+        tcb->tokens_granted = tcb->tokens_wanted;
+        tcb->tokens_served = TRUE;
+        stat_wake( tcb );
+        lk_signal( &(tcb->pend_wakeup) );
+        granted++;
+#ifdef DIAG_PRINTFS 
+        printf( "\r\ngranted %lu tokens to tcb @ %p", tcb->tokens_granted,
+                tcb );
+#endif
     }
 
-    return( error );
+    return( granted );
 }
 
 /*****************************************************************************
-** sm_v - releases a p2pthread semaphore token and awakens the first selected
-**        task waiting on the semaphore.
+** sm_vn - releases the specified number of p2pthread semaphore tokens in a
+**         single operation, and awakens every pended task which the new
+**         token count can satisfy.  Releasing zero tokens is an error.
 *****************************************************************************/
 ULONG
-   sm_v( ULONG smid )
+   sm_vn( ULONG smid, ULONG tokens )
 {
 #ifdef DIAG_PRINTFS 
     p2pthread_cb_t *our_tcb;
@@ -491,12 +684,16 @@ ULONG
 
     error = ERR_NO_ERROR;
 
-    if ( (semaphore = smcb_for( smid )) != (p2pt_sema4_t *)NULL )
+    if ( tokens == 0L )
+    {
+        error = ERR_ZERO;
+    }
+    else if ( (semaphore = smcb_for( smid )) != (p2pt_sema4_t *)NULL )
     {
 #ifdef DIAG_PRINTFS 
         our_tcb = my_tcb();
-        printf( "\r\ntask @ %p post to semaphore list @ %p", our_tcb,
-                &(semaphore->first_susp) );
+        printf( "\r\ntask @ %p post %lu tokens to semaphore list @ %p",
+                our_tcb, tokens, &(semaphore->first_susp) );
 #endif
 
         /*
@@ -510,20 +707,21 @@ ULONG
         */
         pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                               (void *)&(semaphore->sema4_lock));
-        pthread_mutex_lock( &(semaphore->sema4_lock) );
+        lk_lock( &(semaphore->sema4_lock), &(semaphore->sema4_lkstat) );
 
-        sem_post( &(semaphore->pthread_sema4) );
+        semaphore->token_count += tokens;
+        semaphore->tokens_in += tokens;
 
+        /*
+        **  Pass the new tokens on to as many pended tasks as they satisfy.
+        */
         if ( semaphore->first_susp != (p2pthread_cb_t *)NULL )
-            /*
-            **  Signal the condition variable for the semaphore
-            */
-            pthread_cond_broadcast( &(semaphore->sema4_send) );
+            grant_tokens( semaphore );
 
         /*
         **  Unlock the semaphore mutex. 
         */
-        pthread_mutex_unlock( &(semaphore->sema4_lock) );
+        lk_unlock( &(semaphore->sema4_lock), &(semaphore->sema4_lkstat) );
         pthread_cleanup_pop( 0 );
 
         /*
@@ -531,6 +729,8 @@ ULONG
         **  to a task made runnable by this call.
         */
         sched_unlock();
+
+        TRACE( TR_SEMA4 | TR_SEND, smid, tokens );
     }
     else
     {
@@ -540,6 +740,16 @@ ULONG
     return( error );
 }
 
+/*****************************************************************************
+** sm_v - releases a p2pthread semaphore token and awakens the first selected
+**        task waiting on the semaphore.
+*****************************************************************************/
+ULONG
+   sm_v( ULONG smid )
+{
+    return( sm_vn( smid, 1L ) );
+}
+
 /*****************************************************************************
 ** delete_sema4 - takes care of destroying the specified semaphore and freeing
 **                any resources allocated for that semaphore
@@ -553,14 +763,19 @@ static void
     unlink_smcb( semaphore->smid );
 
     /*
-    **  Next destroy the pthreads semaphore
+    **  Fold the statistics of the semaphore's mutexes into those of deleted
+    **  semaphores.
     */
-    sem_destroy( &(semaphore->pthread_sema4) );
+    lk_retire( &(semaphore->sema4_lkstat) );
+    lk_retire( &(semaphore->smdel_lkstat) );
 
     /*
-    **  Finally delete the semaphore control block itself;
+    **  Finally delete the semaphore control block itself, unless it is one
+    **  of those in the static configuration table.
     */
-    ts_free( (void *)semaphore );
+    if ( (semaphore < static_smcbs) ||
+         (semaphore >= &(static_smcbs[STATIC_SEMA4S])) )
+        free_object( TR_SEMA4, (void *)semaphore );
 
 }
 
@@ -571,6 +786,7 @@ static void
 ULONG
    sm_delete( ULONG smid )
 {
+    p2pthread_cb_t *tcb;
     p2pt_sema4_t *semaphore;
     ULONG error;
 
@@ -590,14 +806,14 @@ ULONG
             */
             pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                                   (void *)&(semaphore->smdel_lock) );
-            pthread_mutex_lock( &(semaphore->smdel_lock) );
+            lk_lock( &(semaphore->smdel_lock), &(semaphore->smdel_lkstat) );
 
             /*
             ** Lock mutex for semaphore delete
             */
             pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                                   (void *)&(semaphore->sema4_lock));
-            pthread_mutex_lock( &(semaphore->sema4_lock) );
+            lk_lock( &(semaphore->sema4_lock), &(semaphore->sema4_lkstat) );
 
             /*
             **  Declare the send type
@@ -607,14 +823,20 @@ ULONG
             error = ERR_TATSDEL;
 
             /*
-            **  Signal the condition variable for the semaphore
+            **  Awaken every task pended on the semaphore
             */
-            pthread_cond_broadcast( &(semaphore->sema4_send) );
+            for ( tcb = semaphore->first_susp;
+                  tcb != (p2pthread_cb_t *)NULL;
+                  tcb = tcb->nxt_susp )
+            {
+                stat_wake( tcb );
+                lk_signal( &(tcb->pend_wakeup) );
+            }
 
             /*
             **  Unlock the semaphore mutex. 
             */
-            pthread_mutex_unlock( &(semaphore->sema4_lock) );
+            lk_unlock( &(semaphore->sema4_lock), &(semaphore->sema4_lkstat) );
             pthread_cleanup_pop( 0 );
 
             /*
@@ -623,15 +845,17 @@ ULONG
             **  delete-complete condition variable.
             */
             while ( semaphore->first_susp != (p2pthread_cb_t *)NULL )
-                pthread_cond_wait( &(semaphore->smdel_cplt),
-                                   &(semaphore->smdel_lock) );
+                lk_wait( &(semaphore->smdel_cplt),
+                         &(semaphore->smdel_lock),
+                         &(semaphore->smdel_lkstat) );
 
             /*
             **  Unlock the semaphore delete completion mutex. 
             */
-            pthread_mutex_unlock( &(semaphore->smdel_lock) );
+            lk_unlock( &(semaphore->smdel_lock), &(semaphore->smdel_lkstat) );
             pthread_cleanup_pop( 0 );
         }
+        TRACE( TR_SEMA4 | TR_DELETE, smid, 0 );
         delete_sema4( semaphore );
         sched_unlock();
     }
@@ -648,18 +872,18 @@ ULONG
 **                    occurs on the specified semaphore which should cause the
 **                    pended task to be awakened.  The qualifying events
 **                    are:
-**                        (1) a message is sent to the semaphore and the current
-**                            task is selected to receive it
+**                        (1) the tokens requested by the current task have
+**                            been granted to it by a semaphore post, or
+**                            enough tokens are available and the current
+**                            task is next in line for them
 **                        (2) a delete message is sent to the semaphore
 **                        (3) the semaphore is deleted
 *****************************************************************************/
 static int
-    waiting_on_sema4( p2pt_sema4_t *semaphore, struct timespec *timeout,
+    waiting_on_sema4( p2pt_sema4_t *semaphore, p2pthread_cb_t *our_tcb,
                       int *retcode )
 {
     int result;
-    struct timeval now;
-    ULONG usec;
 
     if ( semaphore->send_type & KILLD )
     {
@@ -669,140 +893,99 @@ static int
         result = 0;
         *retcode = 0;
     }
-    else
+    else if ( our_tcb->tokens_served )
     {
         /*
-        **  Semaphore still in service... check for token availability.
-        **  Initially assume no token available for our task
+        **  A semaphore post already handed our task its tokens...
+        **  waiting is over.
         */
-        result = 1;
-
+        result = 0;
+        *retcode = 0;
+    }
+    else if ( (semaphore->token_count >= our_tcb->tokens_wanted) &&
+              (next_token_waiter( semaphore ) == our_tcb) )
+    {
         /*
-        **  Multiple posts to the semaphore may be represented by only
-        **  a single signal to the condition variable, so continue
-        **  checking for a token for our task as long as more tokens
-        **  are available.
+        **  Enough tokens are available and no other task is ahead of ours
+        **  in line for them... take them and stop waiting.
         */
-        while ( sem_trywait( &(semaphore->pthread_sema4) ) == 0 )
-        {
-            /*
-            **  Available token arrived... see if it's for our task.
-            */
-            if ( (signal_for_my_task( &(semaphore->first_susp),
-                                      (semaphore->flags & SM_PRIOR) )) )
-            {
-                /*
-                **  Token was destined for our task specifically...
-                **  waiting is over.
-                */
-                result = 0;
-                *retcode = 0;
-                break;
-            }
-            else
-            {
-                /*
-                **  Token isn't for our task...
-                **  Put it back and continue waiting.  Sleep awhile to
-                **  allow other tasks ahead of ours in the queue of tasks
-                **  waiting on the semaphore to get their tokens, bringing
-                **  our task to the head of the list.
-                */
-                sem_post( &(semaphore->pthread_sema4) );
-                pthread_mutex_unlock( &(semaphore->sema4_lock) );
-                tm_wkafter( 1 );
-                pthread_mutex_lock( &(semaphore->sema4_lock) );
-            }
-
-            /*
-            **  If a timeout was specified, make sure we respect it and
-            **  exit this loop if it expires.
-            */
-            if ( timeout != (struct timespec *)NULL )
-            {
-                gettimeofday( &now, (struct timezone *)NULL );
-                if ( timeout->tv_nsec > (now.tv_usec * 1000) )
-                {
-                    usec = (timeout->tv_nsec - (now.tv_usec * 1000)) / 1000;
-                    if ( timeout->tv_sec < now.tv_sec )
-                        usec = 0;
-                    else
-                        usec += ((timeout->tv_sec - now.tv_sec) * 1000000);
-                }
-                else
-                {
-                    usec = ((timeout->tv_nsec + 1000000000) -
-                            (now.tv_usec * 1000)) / 1000;
-                    if ( (timeout->tv_sec - 1) < now.tv_sec )
-                        usec = 0;
-                    else
-                        usec += (((timeout->tv_sec - 1) - now.tv_sec)
-                                 * 1000000);
-                }
-                if ( usec == 0 )
-                    break;
-            }
-        }
+        semaphore->token_count -= our_tcb->tokens_wanted;
+        semaphore->tokens_out += our_tcb->tokens_wanted;
+        our_tcb->tokens_granted = our_tcb->tokens_wanted;
+        our_tcb->tokens_served = TRUE;
+        result = 0;
+        *retcode = 0;
+    }
+    else
+    {
+        /*
+        **  Not enough tokens for our task yet... continue waiting.
+        */
+        result = 1;
     }
 
     return( result );
 }
 
 /*****************************************************************************
-** sm_p - blocks the calling task until a token is available on the
-**             specified p2pthread semaphore.
+** sm_pn - blocks the calling task until the specified number of tokens can
+**         be taken at once from the specified p2pthread semaphore.  Tokens
+**         are never partially granted; tasks are satisfied strictly in the
+**         FIFO or PRIORITY pend order of the semaphore.  A request for
+**         zero tokens is an error.
 *****************************************************************************/
 ULONG
-   sm_p( ULONG smid, ULONG opt, ULONG max_wait )
+   sm_pn( ULONG smid, ULONG tokens, ULONG opt, ULONG max_wait )
 {
     p2pthread_cb_t *our_tcb;
     struct timeval now;
     struct timespec timeout;
     int retcode;
+    int blocked;
     long sec, usec;
     p2pt_sema4_t *semaphore;
     ULONG error;
 
     error = ERR_NO_ERROR;
 
-    if ( (semaphore = smcb_for( smid )) != (p2pt_sema4_t *)NULL )
+    if ( tokens == 0L )
+    {
+        error = ERR_ZERO;
+    }
+    else if ( (semaphore = smcb_for( smid )) != (p2pt_sema4_t *)NULL )
     {
         /*
         ** Lock mutex for semaphore pend
         */
         pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                               (void *)&(semaphore->sema4_lock));
-        pthread_mutex_lock( &(semaphore->sema4_lock) );
+        lk_lock( &(semaphore->sema4_lock), &(semaphore->sema4_lkstat) );
 
         /*
         **  Add tcb for task to list of tasks waiting on semaphore
         */
         our_tcb = my_tcb();
 #ifdef DIAG_PRINTFS 
-        printf( "\r\ntask @ %p wait on semaphore list @ %p", our_tcb,
-                &(semaphore->first_susp) );
+        printf( "\r\ntask @ %p wait for %lu tokens on semaphore list @ %p",
+                our_tcb, tokens, &(semaphore->first_susp) );
 #endif
 
+        our_tcb->tokens_wanted = tokens;
+        our_tcb->tokens_granted = 0L;
+        our_tcb->tokens_served = FALSE;
         link_susp_tcb( &(semaphore->first_susp), our_tcb );
 
         retcode = 0;
+        blocked = FALSE;
 
         if ( opt & SM_NOWAIT )
         {
             /*
-            **  Caller specified no wait on semaphore token...
-            **  Check the condition variable with an immediate timeout.
+            **  Caller specified no wait on semaphore tokens...
+            **  Take the tokens only if they can be granted immediately.
             */
-            gettimeofday( &now, (struct timezone *)NULL );
-            timeout.tv_sec = now.tv_sec;
-            timeout.tv_nsec = now.tv_usec * 1000;
-            while ( (waiting_on_sema4( semaphore, &timeout, &retcode )) &&
-                    (retcode != ETIMEDOUT) )
-            {
-                retcode = pthread_cond_timedwait( &(semaphore->sema4_send),
-                                                  &(semaphore->sema4_lock),
-                                                  &timeout );
-            }
+            if ( waiting_on_sema4( semaphore, our_tcb, &retcode ) )
+                retcode = ETIMEDOUT;
         }
         else
         {
@@ -814,10 +997,13 @@ ULONG
                 /*
                 **  Infinite wait was specified... wait without timeout.
                 */
-                while ( waiting_on_sema4( semaphore, 0, &retcode ) )
+                while ( waiting_on_sema4( semaphore, our_tcb, &retcode ) )
                 {
-                    pthread_cond_wait( &(semaphore->sema4_send),
-                                       &(semaphore->sema4_lock) );
+                    TRACE_BLOCK( blocked, TR_SEMA4, smid );
+                    stat_block( our_tcb, WAIT_SEMAP );
+                    lk_wait( &(our_tcb->pend_wakeup),
+                             &(semaphore->sema4_lock),
+                             &(semaphore->sema4_lkstat) );
                 }
             }
             else
@@ -828,7 +1014,7 @@ ULONG
                 */
                 sec = 0;
                 usec = max_wait * P2PT_TICK * 1000;
-                gettimeofday( &now, (struct timezone *)NULL );
+                p2pt_time( &now );
                 usec += now.tv_usec;
                 if ( usec > 1000000 )
                 {
@@ -839,17 +1025,19 @@ ULONG
                 timeout.tv_nsec = usec * 1000;
 
                 /*
-                **  Wait for a semaphore message for the current task or for the
-                **  timeout to expire.  The loop is required since the task
-                **  may be awakened by signals for semaphore tokens which are
-                **  not ours, or for signals other than from a message send.
+                **  Wait for the tokens to be granted to the current task or
+                **  for the timeout to expire.  The loop is required since the
+                **  task may be awakened by signals other than a token grant.
                 */
-                while ( (waiting_on_sema4( semaphore, &timeout, &retcode )) &&
+                while ( (waiting_on_sema4( semaphore, our_tcb, &retcode )) &&
                         (retcode != ETIMEDOUT) )
                 {
-                    retcode = pthread_cond_timedwait( &(semaphore->sema4_send),
-                                                      &(semaphore->sema4_lock),
-                                                      &timeout );
+                    TRACE_BLOCK( blocked, TR_SEMA4, smid );
+                    stat_block( our_tcb, WAIT_SEMAP );
+                    retcode = lk_timedwait( &(our_tcb->pend_wakeup),
+                                            &(semaphore->sema4_lock),
+                                            &timeout,
+                                            &(semaphore->sema4_lkstat) );
                 }
             }
         }
@@ -859,6 +1047,11 @@ ULONG
         **  for the semaphore.
         */
         unlink_susp_tcb( &(semaphore->first_susp), our_tcb );
+        TRACE_UNBLOCK( blocked, TR_SEMA4, smid, (retcode == ETIMEDOUT) );
+        stat_unblock( our_tcb, (retcode == ETIMEDOUT) );
+        our_tcb->tokens_wanted = 0L;
+        our_tcb->tokens_granted = 0L;
+        our_tcb->tokens_served = FALSE;
 
         /*
         **  See if we were awakened due to a sm_delete on the semaphore.
@@ -874,20 +1067,21 @@ ULONG
                 */
                 pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                                       (void *)&(semaphore->smdel_lock) );
-                pthread_mutex_lock( &(semaphore->smdel_lock) );
+                lk_lock( &(semaphore->smdel_lock), &(semaphore->smdel_lkstat) );
 
                 /*
                 **  Signal the delete-complete condition variable
                 **  for the semaphore
                 */
-                pthread_cond_broadcast( &(semaphore->smdel_cplt) );
+                lk_broadcast( &(semaphore->smdel_cplt) );
 
                 semaphore->send_type = SEND;
 
                 /*
                 **  Unlock the semaphore delete completion mutex. 
                 */
-                pthread_mutex_unlock( &(semaphore->smdel_lock) );
+                lk_unlock( &(semaphore->smdel_lock),
+                           &(semaphore->smdel_lkstat) );
                 pthread_cleanup_pop( 0 );
             }
 
@@ -919,19 +1113,27 @@ ULONG
                     printf( "...timed out" );
 #endif
                 }
+
+                /*
+                **  Our task may have been holding up smaller requests
+                **  behind it... let them have any tokens now available.
+                */
+                if ( semaphore->first_susp != (p2pthread_cb_t *)NULL )
+                    grant_tokens( semaphore );
             }
-#ifdef DIAG_PRINTFS 
             else
             {
+                TRACE( TR_SEMA4 | TR_RECEIVE, smid, tokens );
+#ifdef DIAG_PRINTFS 
                 printf( "...rcvd semaphore token" );
-            }
 #endif
+            }
         }
 
         /*
         **  Unlock the mutex for the condition variable and clean up.
         */
-        pthread_mutex_unlock( &(semaphore->sema4_lock) );
+        lk_unlock( &(semaphore->sema4_lock), &(semaphore->sema4_lkstat) );
         pthread_cleanup_pop( 0 );
     }
     else
@@ -942,6 +1144,16 @@ ULONG
     return( error );
 }
 
+/*****************************************************************************
+** sm_p - blocks the calling task until a token is available on the
+**             specified p2pthread semaphore.
+*****************************************************************************/
+ULONG
+   sm_p( ULONG smid, ULONG opt, ULONG max_wait )
+{
+    return( sm_pn( smid, 1L, opt, max_wait ) );
+}
+
 /*****************************************************************************
 ** sm_ident - identifies the specified p2pthread semaphore
 *****************************************************************************/
@@ -1000,3 +1212,53 @@ ULONG
 
     return( error );
 }
+
+/*****************************************************************************
+** publish_sema4s - fills in stats page entries for up to 'max_rows'
+**                  semaphores.  Returns the number of semaphores, which may
+**                  exceed 'max_rows'.
+*****************************************************************************/
+ULONG
+   publish_sema4s( sp_object_t rows[], ULONG max_rows )
+{
+    p2pt_sema4_t *semaphore;
+    sp_object_t *row;
+    ULONG count;
+    int i;
+
+    count = 0;
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&sema4_list_lock );
+    lk_lock( &sema4_list_lock, &sema4_list_lkstat );
+
+    for ( semaphore = sema4_list; semaphore != (p2pt_sema4_t *)NULL;
+          semaphore = semaphore->nxt_sema4, count++ )
+    {
+        if ( count >= max_rows )
+            continue;
+        row = &(rows[count]);
+        memset( (void *)row, 0, sizeof( *row ) );
+        row->obj_class = SP_SEMA4;
+        row->objid = semaphore->smid;
+        for ( i = 0; i < 4; i++ )
+            row->objname[i] = semaphore->sname[i];
+
+        /*
+        **  The semaphore cannot be deleted while it is on the list we hold.
+        */
+        pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                              (void *)&(semaphore->sema4_lock));
+        lk_lock( &(semaphore->sema4_lock), &(semaphore->sema4_lkstat) );
+        row->depth = semaphore->token_count;
+        row->waiters = count_susp_tcbs( semaphore->first_susp );
+        row->puts = semaphore->tokens_in;
+        row->gets = semaphore->tokens_out;
+        lk_unlock( &(semaphore->sema4_lock), &(semaphore->sema4_lkstat) );
+        pthread_cleanup_pop( 0 );
+    }
+
+    lk_unlock( &sema4_list_lock, &sema4_list_lkstat );
+    pthread_cleanup_pop( 0 );
+
+    return( count );
+}
@@ -0,0 +1,870 @@
+/*****************************************************************************
+ * sim.c - defines the simulation mode, in which p2pthread tasks run one at
+ *         a time in a deterministic order against a virtual clock which
+ *         jumps to the next pending timeout whenever every task is blocked.
+ ****************************************************************************/
+
+#include <errno.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "p2pthread.h"
+
+#undef DIAG_PRINTFS
+
+#define ERR_TIMEOUT    0x01
+#define ERR_SIMBLOCKED 0x95
+#define ERR_NOSIM      0x96
+
+/*****************************************************************************
+**  External function and data references
+*****************************************************************************/
+extern p2pthread_cb_t *
+   my_tcb( void );
+extern pid_t
+   my_kernel_tid( void );
+
+/*****************************************************************************
+**  p2pthread Global Data Structures
+*****************************************************************************/
+
+/*
+**  sim_mode is nonzero once sim_start() has been called.  Tasks started
+**           from then on run under the simulator.
+*/
+volatile int
+    sim_mode = 0;
+
+/*
+**  sim_lock serializes access to the simulator state below.  It is never
+**           held while another mutex is acquired.
+*/
+static pthread_mutex_t
+    sim_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+**  sim_change is signalled whenever a simulated task changes state, so that
+**             sim_run() can choose the next task to run.
+*/
+static pthread_cond_t
+    sim_change = PTHREAD_COND_INITIALIZER;
+
+/*
+**  sim_list is a linked list of the simulated tasks, in the order they last
+**           blocked.  Ready tasks of equal priority are run in this order
+**           unless a seed was given.
+*/
+static p2pthread_cb_t *
+    sim_list = (p2pthread_cb_t *)NULL;
+
+/*
+**  sim_running is the task holding the run token (NULL while sim_run()
+**              chooses), and sim_favoured is a task which yielded without
+**              blocking, and so keeps running unless a higher priority task
+**              is ready.
+*/
+static p2pthread_cb_t *
+    sim_running = (p2pthread_cb_t *)NULL;
+static p2pthread_cb_t *
+    sim_favoured = (p2pthread_cb_t *)NULL;
+
+/*
+**  sim_base and sim_now are the virtual time of day in microseconds when
+**                       sim_start() was called and now
+*/
+static unsigned long long
+    sim_base = 0;
+static unsigned long long
+    sim_now = 0;
+
+/*
+**  sim_rand is the state of the generator which breaks ties between ready
+**           tasks of equal priority (zero to run them in list order)
+*/
+static unsigned long long
+    sim_rand = 0;
+
+/*****************************************************************************
+** timespec_usec - converts an absolute timespec to microseconds
+*****************************************************************************/
+static unsigned long long
+   timespec_usec( const struct timespec *ts )
+{
+    return( (unsigned long long)ts->tv_sec * 1000000ULL +
+            (unsigned long long)(ts->tv_nsec / 1000) );
+}
+
+/*****************************************************************************
+** link_sim - appends a task to the end of the simulated task list
+*****************************************************************************/
+static void
+   link_sim( p2pthread_cb_t *tcb )
+{
+    p2pthread_cb_t **link;
+
+    for ( link = &sim_list; *link != (p2pthread_cb_t *)NULL;
+          link = &((*link)->nxt_sim) ) ;
+    tcb->nxt_sim = (p2pthread_cb_t *)NULL;
+    *link = tcb;
+}
+
+/*****************************************************************************
+** unlink_sim - removes a task from the simulated task list
+*****************************************************************************/
+static void
+   unlink_sim( p2pthread_cb_t *tcb )
+{
+    p2pthread_cb_t **link;
+
+    for ( link = &sim_list; *link != (p2pthread_cb_t *)NULL;
+          link = &((*link)->nxt_sim) )
+    {
+        if ( *link == tcb )
+        {
+            *link = tcb->nxt_sim;
+            break;
+        }
+    }
+}
+
+/*****************************************************************************
+** changed - notes a task state change and wakes sim_run().  Called with
+**           sim_lock held.
+*****************************************************************************/
+static void
+   changed( void )
+{
+    pthread_cond_signal( &sim_change );
+}
+
+/*****************************************************************************
+** release - gives up the calling task's run token as it blocks or yields.
+**           A task which blocks goes to the end of the task list.  Called
+**           with sim_lock held.
+*****************************************************************************/
+static void
+   release( p2pthread_cb_t *tcb, int state, unsigned long long deadline )
+{
+    tcb->sim_state = state;
+    tcb->sim_deadline = deadline;
+    tcb->sim_expired = 0;
+    if ( state != SIM_READY )
+    {
+        unlink_sim( tcb );
+        link_sim( tcb );
+    }
+    if ( sim_running == tcb )
+        sim_running = (p2pthread_cb_t *)NULL;
+    changed();
+}
+
+/*****************************************************************************
+** ready - ends the wait or delay of a simulated task, which runs again once
+**         sim_run() chooses it.  Called with sim_lock held.
+*****************************************************************************/
+static void
+   ready( p2pthread_cb_t *tcb )
+{
+    tcb->sim_state = SIM_READY;
+    tcb->sim_cond = (pthread_cond_t *)NULL;
+    tcb->sim_futex = (volatile int *)NULL;
+}
+
+/*****************************************************************************
+** wait_turn - waits until sim_run() hands the calling task the run token.
+**             The task is parked here for as long as it waits, which is
+**             what sim_run() looks for before it chooses.  Called with
+**             sim_lock held.
+*****************************************************************************/
+static void
+   wait_turn( p2pthread_cb_t *tcb )
+{
+    tcb->sim_parked = TRUE;
+    while ( sim_running != tcb )
+        pthread_cond_wait( &(tcb->sim_turn), &sim_lock );
+    tcb->sim_parked = FALSE;
+}
+
+/*****************************************************************************
+** cleanup_turn - releases sim_lock if a task is deleted while waiting for
+**                its turn, and relocks the mutex of the condition variable
+**                it was waiting on, as its caller expects.
+*****************************************************************************/
+static void
+   cleanup_turn( void *arg )
+{
+    p2pthread_cb_t *tcb;
+
+    tcb = (p2pthread_cb_t *)arg;
+    pthread_mutex_unlock( &sim_lock );
+    if ( tcb->sim_mutex != (pthread_mutex_t *)NULL )
+        pthread_mutex_lock( tcb->sim_mutex );
+}
+
+/*****************************************************************************
+** sim_task - returns the task control block of the calling task if it is a
+**            simulated task holding the run token, or NULL otherwise.
+*****************************************************************************/
+static p2pthread_cb_t *
+   sim_task( void )
+{
+    p2pthread_cb_t *tcb;
+
+    tcb = my_tcb();
+    if ( (tcb != (p2pthread_cb_t *)NULL) && (tcb->sim_state == SIM_RUNNING) )
+        return( tcb );
+
+    return( (p2pthread_cb_t *)NULL );
+}
+
+/*****************************************************************************
+** p2pt_time - returns the time of day from which timeouts are calculated...
+**             the virtual time in simulation mode, or the real time otherwise.
+*****************************************************************************/
+void
+   p2pt_time( struct timeval *now )
+{
+    unsigned long long usec;
+
+    if ( sim_mode )
+    {
+        pthread_mutex_lock( &sim_lock );
+        usec = sim_now;
+        pthread_mutex_unlock( &sim_lock );
+        now->tv_sec = (time_t)(usec / 1000000ULL);
+        now->tv_usec = (suseconds_t)(usec % 1000000ULL);
+    }
+    else
+        gettimeofday( now, (struct timezone *)NULL );
+}
+
+/*****************************************************************************
+** sim_attach - puts a task being started in simulation mode under the
+**              simulator.  Called before its pthread is created.
+*****************************************************************************/
+void
+   sim_attach( p2pthread_cb_t *tcb )
+{
+    tcb->sim_parked = FALSE;
+    tcb->sim_suspended = FALSE;
+    tcb->sim_deadline = 0;
+    tcb->sim_expired = 0;
+    tcb->sim_cond = (pthread_cond_t *)NULL;
+    tcb->sim_mutex = (pthread_mutex_t *)NULL;
+    tcb->sim_futex = (volatile int *)NULL;
+    pthread_cond_init( &(tcb->sim_turn), (pthread_condattr_t *)NULL );
+
+    pthread_mutex_lock( &sim_lock );
+    tcb->sim_state = SIM_STARTING;
+    link_sim( tcb );
+    changed();
+    pthread_mutex_unlock( &sim_lock );
+}
+
+/*****************************************************************************
+** sim_enter - holds a newly started simulated task until its first turn.
+*****************************************************************************/
+void
+   sim_enter( p2pthread_cb_t *tcb )
+{
+    if ( tcb->sim_state == SIM_NONE )
+        return;
+
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&sim_lock );
+    pthread_mutex_lock( &sim_lock );
+    tcb->sim_state = SIM_READY;
+    changed();
+    wait_turn( tcb );
+    pthread_mutex_unlock( &sim_lock );
+    pthread_cleanup_pop( 0 );
+}
+
+/*****************************************************************************
+** sim_detach - removes a deleted task from the simulator, passing on the
+**              run token if it held it.
+*****************************************************************************/
+void
+   sim_detach( p2pthread_cb_t *tcb )
+{
+    if ( tcb->sim_state == SIM_NONE )
+        return;
+
+    pthread_mutex_lock( &sim_lock );
+    unlink_sim( tcb );
+    if ( sim_running == tcb )
+        sim_running = (p2pthread_cb_t *)NULL;
+    if ( sim_favoured == tcb )
+        sim_favoured = (p2pthread_cb_t *)NULL;
+    tcb->sim_state = SIM_NONE;
+    changed();
+    pthread_mutex_unlock( &sim_lock );
+    pthread_cond_destroy( &(tcb->sim_turn) );
+}
+
+/*****************************************************************************
+** sim_yield - lets the simulator run another task.  A favoured task keeps
+**             running unless a task of higher priority is ready; otherwise
+**             ready tasks of equal priority run first.  Returns FALSE if
+**             the caller is not simulated.
+*****************************************************************************/
+int
+   sim_yield( int favoured )
+{
+    p2pthread_cb_t *tcb;
+
+    if ( (tcb = sim_task()) == (p2pthread_cb_t *)NULL )
+        return( FALSE );
+
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&sim_lock );
+    pthread_mutex_lock( &sim_lock );
+    release( tcb, SIM_READY, 0 );
+    if ( favoured )
+        sim_favoured = tcb;
+    else
+    {
+        unlink_sim( tcb );
+        link_sim( tcb );
+    }
+    wait_turn( tcb );
+    pthread_mutex_unlock( &sim_lock );
+    pthread_cleanup_pop( 0 );
+
+    return( TRUE );
+}
+
+/*****************************************************************************
+** sim_suspend - takes a simulated task out of (or puts it back among) the
+**               tasks the simulator may run.  A task suspending itself
+**               waits here until it is resumed.
+*****************************************************************************/
+void
+   sim_suspend( p2pthread_cb_t *tcb, int suspended )
+{
+    pthread_mutex_lock( &sim_lock );
+    tcb->sim_suspended = suspended;
+    changed();
+    pthread_mutex_unlock( &sim_lock );
+
+    if ( suspended && (tcb == sim_task()) )
+        sim_yield( FALSE );
+}
+
+/*****************************************************************************
+** sim_delay - blocks the calling task for the specified number of ticks of
+**             virtual time.  Returns FALSE if the caller is not simulated.
+*****************************************************************************/
+int
+   sim_delay( ULONG interval )
+{
+    p2pthread_cb_t *tcb;
+
+    if ( (tcb = sim_task()) == (p2pthread_cb_t *)NULL )
+        return( FALSE );
+
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&sim_lock );
+    pthread_mutex_lock( &sim_lock );
+    release( tcb, SIM_DELAY,
+             sim_now + (unsigned long long)interval * P2PT_TICK * 1000ULL );
+    wait_turn( tcb );
+    tcb->sim_expired = 0;
+    pthread_mutex_unlock( &sim_lock );
+    pthread_cleanup_pop( 0 );
+
+    return( TRUE );
+}
+
+/*****************************************************************************
+** sim_cond_wait - waits on a condition variable for a simulated task, which
+**                 gives up its run token while it waits.  The timeout is in
+**                 virtual time.  Returns zero or ETIMEDOUT.
+*****************************************************************************/
+int
+   sim_cond_wait( pthread_cond_t *cond, pthread_mutex_t *mutex,
+                  const struct timespec *timeout )
+{
+    p2pthread_cb_t *tcb;
+    unsigned long long deadline;
+    int old_canceltype, expired;
+
+    if ( (tcb = sim_task()) == (p2pthread_cb_t *)NULL )
+    {
+        if ( timeout == (const struct timespec *)NULL )
+            return( pthread_cond_wait( cond, mutex ) );
+        return( pthread_cond_timedwait( cond, mutex, timeout ) );
+    }
+
+    deadline = 0;
+    if ( timeout != (const struct timespec *)NULL )
+    {
+        deadline = timespec_usec( timeout );
+        if ( deadline <= sim_now )
+            return( ETIMEDOUT );
+    }
+
+    /*
+    **  sim_lock must not be left locked by an asynchronous cancellation.
+    */
+    pthread_setcanceltype( PTHREAD_CANCEL_DEFERRED, &old_canceltype );
+    pthread_cleanup_push( cleanup_turn, (void *)tcb );
+    pthread_mutex_lock( &sim_lock );
+    release( tcb, SIM_WAIT, deadline );
+    tcb->sim_cond = cond;
+    tcb->sim_mutex = mutex;
+
+    /*
+    **  The task waits in the simulator rather than on the condition
+    **  variable... lk_signal() and lk_broadcast() find it here, and
+    **  sim_run() ends the wait if the virtual timeout expires.  Any task
+    **  waking us holds the mutex, so let go of it only once we are parked,
+    **  since the tasks which run before us may need it.
+    */
+    pthread_mutex_unlock( mutex );
+    wait_turn( tcb );
+    expired = tcb->sim_expired;
+    tcb->sim_expired = 0;
+    tcb->sim_mutex = (pthread_mutex_t *)NULL;
+    pthread_mutex_unlock( &sim_lock );
+    pthread_cleanup_pop( 0 );
+    pthread_setcanceltype( old_canceltype, (int *)NULL );
+
+    pthread_mutex_lock( mutex );
+
+    return( expired ? ETIMEDOUT : 0 );
+}
+
+/*****************************************************************************
+** sim_cond_wake - ends the waits of the first (or every) simulated task
+**                 waiting on a condition variable, in the order they
+**                 blocked.  The caller holds the condition variable's mutex.
+**                 Returns the number of tasks woken.
+*****************************************************************************/
+int
+   sim_cond_wake( pthread_cond_t *cond, int all )
+{
+    p2pthread_cb_t *tcb;
+    int woken;
+
+    woken = 0;
+    pthread_mutex_lock( &sim_lock );
+    for ( tcb = sim_list; tcb != (p2pthread_cb_t *)NULL; tcb = tcb->nxt_sim )
+    {
+        if ( (tcb->sim_state == SIM_WAIT) && (tcb->sim_cond == cond) )
+        {
+            ready( tcb );
+            woken++;
+            if ( !all )
+                break;
+        }
+    }
+    if ( woken != 0 )
+        changed();
+    pthread_mutex_unlock( &sim_lock );
+
+    return( woken );
+}
+
+/*****************************************************************************
+** take_pi_futex - takes a priority-inheritance futex word for the calling
+**                 task if it is free, or else sets its FUTEX_WAITERS bit so
+**                 that the owner unlocks it with FUTEX_UNLOCK_PI, which
+**                 wakes the task to try again.  Returns TRUE if the task
+**                 now owns the word.  Called with sim_lock held.
+*****************************************************************************/
+static int
+   take_pi_futex( volatile int *uaddr, pid_t tid )
+{
+    int word;
+
+    for ( ;; )
+    {
+        word = *uaddr;
+        if ( (word & FUTEX_TID_MASK) == 0 )
+        {
+            if ( __sync_bool_compare_and_swap( uaddr, word,
+                                               word | (int)tid ) )
+                return( TRUE );
+        }
+        else if ( (word & FUTEX_WAITERS) ||
+                  __sync_bool_compare_and_swap( uaddr, word,
+                                                word | FUTEX_WAITERS ) )
+            return( FALSE );
+    }
+}
+
+/*****************************************************************************
+** park_on_futex - gives up the calling task's run token until a wake on the
+**                 futex word or the virtual timeout.  Returns nonzero if the
+**                 wait timed out.  Called with sim_lock held.
+*****************************************************************************/
+static int
+   park_on_futex( p2pthread_cb_t *tcb, volatile int *uaddr,
+                  unsigned long long deadline )
+{
+    int expired;
+
+    release( tcb, SIM_WAIT, deadline );
+    tcb->sim_futex = uaddr;
+    wait_turn( tcb );
+    expired = tcb->sim_expired;
+    tcb->sim_expired = 0;
+
+    return( expired );
+}
+
+/*****************************************************************************
+** sim_futex_wait - makes a blocking futex operation for a simulated task,
+**                  which gives up its run token while it waits in the
+**                  simulator rather than in the kernel.  Absolute timeouts
+**                  are in virtual time.  A FUTEX_WAIT_REQUEUE_PI wait ends
+**                  without the mutex, which the caller then locks itself.
+**                  Returns -1 with errno set on failure, like futex_op.
+*****************************************************************************/
+long
+   sim_futex_wait( volatile int *uaddr, int op, int val,
+                   const struct timespec *timeout, volatile int *uaddr2,
+                   int val3 )
+{
+    p2pthread_cb_t *tcb;
+    unsigned long long deadline;
+    int cmd, old_canceltype, expired, error;
+
+    if ( (tcb = sim_task()) == (p2pthread_cb_t *)NULL )
+        return( syscall( SYS_futex, uaddr, op, val, timeout, uaddr2, val3 ) );
+
+    /*
+    **  FUTEX_WAIT takes a relative timeout, the others an absolute one.
+    */
+    cmd = op & FUTEX_CMD_MASK;
+    deadline = 0;
+    if ( timeout != (const struct timespec *)NULL )
+    {
+        deadline = timespec_usec( timeout );
+        if ( cmd == FUTEX_WAIT )
+            deadline += sim_now;
+    }
+
+    /*
+    **  sim_lock must not be left locked by an asynchronous cancellation.
+    */
+    pthread_setcanceltype( PTHREAD_CANCEL_DEFERRED, &old_canceltype );
+    pthread_cleanup_push( cleanup_turn, (void *)tcb );
+    pthread_mutex_lock( &sim_lock );
+    error = 0;
+    if ( cmd == FUTEX_LOCK_PI )
+    {
+        /*
+        **  Take the lock if it is free, or else wait for its owner to
+        **  unlock it and try again.  A lock which is free is taken even
+        **  if the timeout has already passed, as the kernel would.
+        */
+        expired = 0;
+        while ( !take_pi_futex( uaddr, my_kernel_tid() ) )
+        {
+            if ( expired || ((deadline != 0) && (deadline <= sim_now)) )
+            {
+                error = ETIMEDOUT;
+                break;
+            }
+            expired = park_on_futex( tcb, uaddr, deadline );
+        }
+    }
+    else if ( *uaddr != val )
+    {
+        /*
+        **  Waking tasks change the futex word before their wake reaches
+        **  sim_futex_wake(), so comparing it under sim_lock loses none.
+        */
+        error = EAGAIN;
+    }
+    else if ( (deadline != 0) && (deadline <= sim_now) )
+        error = ETIMEDOUT;
+    else if ( park_on_futex( tcb, uaddr, deadline ) )
+        error = ETIMEDOUT;
+    pthread_mutex_unlock( &sim_lock );
+    pthread_cleanup_pop( 0 );
+    pthread_setcanceltype( old_canceltype, (int *)NULL );
+
+    if ( error != 0 )
+    {
+        errno = error;
+        return( -1 );
+    }
+
+    return( 0 );
+}
+
+/*****************************************************************************
+** sim_futex_wake - ends the waits of up to 'count' simulated tasks waiting
+**                  on a futex word, in the order they blocked.  Returns the
+**                  number of tasks woken.
+*****************************************************************************/
+int
+   sim_futex_wake( volatile int *uaddr, int count )
+{
+    p2pthread_cb_t *tcb;
+    int woken;
+
+    woken = 0;
+    pthread_mutex_lock( &sim_lock );
+    for ( tcb = sim_list; (tcb != (p2pthread_cb_t *)NULL) && (woken < count);
+          tcb = tcb->nxt_sim )
+    {
+        if ( (tcb->sim_state == SIM_WAIT) && (tcb->sim_futex == uaddr) )
+        {
+            ready( tcb );
+            woken++;
+        }
+    }
+    if ( woken != 0 )
+        changed();
+    pthread_mutex_unlock( &sim_lock );
+
+    return( woken );
+}
+
+/*****************************************************************************
+** next_rand - returns the next number in the tie-breaking sequence
+*****************************************************************************/
+static unsigned long long
+   next_rand( void )
+{
+    sim_rand ^= sim_rand >> 12;
+    sim_rand ^= sim_rand << 25;
+    sim_rand ^= sim_rand >> 27;
+
+    return( sim_rand * 2685821657736338717ULL );
+}
+
+/*****************************************************************************
+** task_priority - returns the current pthread priority of a task, which
+**                 includes any boost from sched_lock or a mutex ceiling
+*****************************************************************************/
+static int
+   task_priority( p2pthread_cb_t *tcb )
+{
+    struct sched_param param;
+    int policy;
+
+    if ( pthread_getschedparam( tcb->pthrid, &policy, &param ) != 0 )
+        return( tcb->prv_priority.sched_priority );
+
+    return( param.sched_priority );
+}
+
+/*****************************************************************************
+** choose_task - returns the ready task to run next, or NULL if none is
+**               ready.  Called with sim_lock held.
+*****************************************************************************/
+static p2pthread_cb_t *
+   choose_task( void )
+{
+    p2pthread_cb_t *tcb;
+    p2pthread_cb_t *chosen;
+    int priority, best, ties;
+
+    chosen = (p2pthread_cb_t *)NULL;
+    best = -1;
+    ties = 0;
+    for ( tcb = sim_list; tcb != (p2pthread_cb_t *)NULL; tcb = tcb->nxt_sim )
+    {
+        if ( (tcb->sim_state != SIM_READY) || tcb->sim_suspended )
+            continue;
+        priority = task_priority( tcb );
+        if ( (priority > best) ||
+             ((priority == best) && (tcb == sim_favoured)) )
+        {
+            chosen = tcb;
+            best = priority;
+            ties = 1;
+        }
+        else if ( (priority == best) && (chosen != sim_favoured) )
+        {
+            /*
+            **  Equal priority... take the earlier in the list, or with a
+            **  seed, each of the tied tasks with equal probability.
+            */
+            ties++;
+            if ( (sim_rand != 0) && ((next_rand() % ties) == 0) )
+                chosen = tcb;
+        }
+    }
+    sim_favoured = (p2pthread_cb_t *)NULL;
+
+    return( chosen );
+}
+
+/*****************************************************************************
+** settled - returns TRUE once every simulated task is parked in the
+**           simulator, waiting for its turn or on an object, so the next
+**           choice of task cannot depend on how fast the others reached
+**           their waits.  Called with sim_lock held.
+*****************************************************************************/
+static int
+   settled( void )
+{
+    p2pthread_cb_t *tcb;
+
+    for ( tcb = sim_list; tcb != (p2pthread_cb_t *)NULL; tcb = tcb->nxt_sim )
+    {
+        if ( !tcb->sim_parked )
+            return( FALSE );
+    }
+
+    return( TRUE );
+}
+
+/*****************************************************************************
+** expire_waits - ends the waits of tasks whose timeouts are due, and returns
+**                the earliest timeout still pending (zero if none).  Called
+**                with sim_lock held.
+*****************************************************************************/
+static unsigned long long
+   expire_waits( void )
+{
+    p2pthread_cb_t *tcb;
+    unsigned long long next;
+
+    next = 0;
+    for ( tcb = sim_list; tcb != (p2pthread_cb_t *)NULL; tcb = tcb->nxt_sim )
+    {
+        if ( ((tcb->sim_state != SIM_WAIT) && (tcb->sim_state != SIM_DELAY)) ||
+             (tcb->sim_deadline == 0) || tcb->sim_expired )
+            continue;
+        if ( tcb->sim_deadline <= sim_now )
+        {
+            tcb->sim_expired = 1;
+            ready( tcb );
+        }
+        else if ( (next == 0) || (tcb->sim_deadline < next) )
+            next = tcb->sim_deadline;
+    }
+
+    return( next );
+}
+
+/*****************************************************************************
+** sim_start - enters simulation mode.  Tasks started from now on run one at
+**             a time when sim_run() is called, and time is virtual.  A
+**             nonzero seed breaks ties between ready tasks of equal
+**             priority pseudo-randomly; zero runs them in the order they
+**             last blocked.  Does nothing in M:N mode.
+*****************************************************************************/
+void
+   sim_start( ULONG seed )
+{
+    struct timeval now;
+
+    /*
+    **  Tasks running in M:N mode cannot be simulated.
+    */
+    if ( mn_mode )
+        return;
+
+    pthread_mutex_lock( &sim_lock );
+    if ( !sim_mode )
+    {
+        gettimeofday( &now, (struct timezone *)NULL );
+        sim_base = (unsigned long long)now.tv_sec * 1000000ULL +
+                   (unsigned long long)now.tv_usec;
+        sim_now = sim_base;
+    }
+    sim_rand = (seed == 0) ? 0 : (unsigned long long)seed *
+                                 0x9E3779B97F4A7C15ULL;
+    sim_mode = 1;
+    pthread_mutex_unlock( &sim_lock );
+}
+
+/*****************************************************************************
+** sim_ticks - returns the virtual time in ticks since sim_start()
+*****************************************************************************/
+ULONG
+   sim_ticks( void )
+{
+    unsigned long long usec;
+
+    pthread_mutex_lock( &sim_lock );
+    usec = sim_now - sim_base;
+    pthread_mutex_unlock( &sim_lock );
+
+    return( (ULONG)(usec / (P2PT_TICK * 1000ULL)) );
+}
+
+/*****************************************************************************
+** sim_run - runs the simulated tasks until all have been deleted, every one
+**           is blocked with no timeout pending, or max_ticks of virtual time
+**           have passed (zero for no limit).  Must not be called by a task.
+*****************************************************************************/
+ULONG
+   sim_run( ULONG max_ticks )
+{
+    p2pthread_cb_t *tcb;
+    unsigned long long limit, next;
+    ULONG error;
+
+    if ( !sim_mode )
+        return( ERR_NOSIM );
+
+    error = ERR_NO_ERROR;
+
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&sim_lock );
+    pthread_mutex_lock( &sim_lock );
+    limit = 0;
+    if ( max_ticks != 0 )
+        limit = sim_now + (unsigned long long)max_ticks * P2PT_TICK * 1000ULL;
+
+    for ( ;; )
+    {
+        /*
+        **  Wait for the running task to block, yield or be deleted, and for
+        **  every task just started to reach its first wait.
+        */
+        while ( (sim_running != (p2pthread_cb_t *)NULL) || !settled() )
+            pthread_cond_wait( &sim_change, &sim_lock );
+        if ( sim_list == (p2pthread_cb_t *)NULL )
+            break;
+
+        next = expire_waits();
+
+        /*
+        **  Hand the run token to the chosen ready task.
+        */
+        if ( (tcb = choose_task()) != (p2pthread_cb_t *)NULL )
+        {
+            tcb->sim_state = SIM_RUNNING;
+            sim_running = tcb;
+            pthread_cond_signal( &(tcb->sim_turn) );
+            continue;
+        }
+
+        /*
+        **  Nothing is ready... advance the clock to the next timeout.
+        */
+        if ( next == 0 )
+        {
+            error = ERR_SIMBLOCKED;
+            break;
+        }
+        if ( (limit != 0) && (next > limit) )
+        {
+            sim_now = limit;
+            error = ERR_TIMEOUT;
+            break;
+        }
+        sim_now = next;
+#ifdef DIAG_PRINTFS
+        printf( "\r\nsim_run advanced to tick %llu",
+                (sim_now - sim_base) / (P2PT_TICK * 1000ULL) );
+#endif
+    }
+
+    pthread_mutex_unlock( &sim_lock );
+    pthread_cleanup_pop( 0 );
+
+    return( error );
+}
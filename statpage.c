@@ -0,0 +1,291 @@
+/*****************************************************************************
+ * statpage.c - defines the shared-memory stats page, a read-only snapshot
+ *              of every task, queue, semaphore and partition which a
+ *              background thread rewrites periodically for monitors such
+ *              as p2top to read without disturbing the process.
+ ****************************************************************************/
+
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "p2pthread.h"
+
+#undef DIAG_PRINTFS
+
+#define SP_MAX_OBJECTS  256     /* Default number of entries in page */
+#define SP_PERIOD_MS    1000    /* Default milliseconds between updates */
+
+/*****************************************************************************
+**  External function and data references
+*****************************************************************************/
+extern ULONG
+   publish_tasks( sp_object_t rows[], ULONG max_rows );
+extern ULONG
+   publish_queues( sp_object_t rows[], ULONG max_rows );
+extern ULONG
+   publish_vqueues( sp_object_t rows[], ULONG max_rows );
+extern ULONG
+   publish_sema4s( sp_object_t rows[], ULONG max_rows );
+extern ULONG
+   publish_prtns( sp_object_t rows[], ULONG max_rows );
+
+/*****************************************************************************
+**  p2pthread Global Data Structures
+*****************************************************************************/
+
+/*
+**  publishers fill in the entries of each class of object, in page order
+*/
+static ULONG
+    (* const publishers[])( sp_object_t rows[], ULONG max_rows ) =
+{
+    publish_tasks,
+    publish_queues,
+    publish_vqueues,
+    publish_sema4s,
+    publish_prtns
+};
+
+/*
+**  page is the mapped stats page, of page_size bytes, named page_name.
+**  rows holds the entries gathered for the next update, so that the page
+**  is only held 'odd' while they are copied into it.
+*/
+static sp_page_t *
+    page = (sp_page_t *)NULL;
+static size_t
+    page_size;
+static char
+    page_name[64];
+static sp_object_t *
+    rows;
+
+/*
+**  sp_lock serializes sp_start() and sp_stop(), and with sp_wakeup lets
+**  sp_stop() end the publishing thread's wait between updates
+*/
+static pthread_mutex_t
+    sp_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t
+    sp_wakeup;
+static pthread_t
+    publish_thread;
+static int
+    publishing = FALSE;
+
+
+/*****************************************************************************
+** update_page - gathers the entries of every object and copies them into
+**               the stats page under the sequence lock
+*****************************************************************************/
+static void
+   update_page( void )
+{
+    struct timespec now;
+    ULONG count, total, found;
+    int i;
+
+    count = 0;
+    total = 0;
+    for ( i = 0; i < sizeof( publishers ) / sizeof( publishers[0] ); i++ )
+    {
+        found = (*publishers[i])( &(rows[count]), page->max_objects - count );
+        total += found;
+        if ( found > page->max_objects - count )
+            found = page->max_objects - count;
+        count += found;
+    }
+    clock_gettime( CLOCK_REALTIME, &now );
+
+    page->seq++;
+    __sync_synchronize();
+
+    memcpy( (void *)page->objects, (void *)rows,
+            count * sizeof( sp_object_t ) );
+    page->count = count;
+    page->dropped = total - count;
+    page->updates++;
+    page->stamp_ns = (unsigned long long)now.tv_sec * 1000000000ULL +
+                     (unsigned long long)now.tv_nsec;
+
+    __sync_synchronize();
+    page->seq++;
+}
+
+/*****************************************************************************
+** publish_task - rewrites the stats page once per period until sp_stop()
+*****************************************************************************/
+static void *
+   publish_task( void *arg )
+{
+    struct timespec due;
+
+    clock_gettime( CLOCK_MONOTONIC, &due );
+
+    pthread_mutex_lock( &sp_lock );
+    while ( publishing )
+    {
+        pthread_mutex_unlock( &sp_lock );
+        update_page();
+        pthread_mutex_lock( &sp_lock );
+
+        due.tv_sec += page->period_ms / 1000;
+        due.tv_nsec += (page->period_ms % 1000) * 1000000L;
+        if ( due.tv_nsec >= 1000000000L )
+        {
+            due.tv_sec++;
+            due.tv_nsec -= 1000000000L;
+        }
+        while ( publishing &&
+                (pthread_cond_timedwait( &sp_wakeup, &sp_lock, &due ) !=
+                 ETIMEDOUT) )
+            ;
+    }
+    pthread_mutex_unlock( &sp_lock );
+
+    return( (void *)NULL );
+}
+
+/*****************************************************************************
+** sp_start - creates the named shared-memory stats page (by default
+**            "/p2linux.<pid>"), with room for 'max_objects' objects, and
+**            starts a thread which rewrites it every 'period_ms'
+**            milliseconds.  Zero selects the defaults for either.
+**            Returns 0 or an errno value.
+*****************************************************************************/
+ULONG
+   sp_start( const char *name, ULONG max_objects, ULONG period_ms )
+{
+    pthread_condattr_t cond_attr;
+    ULONG error;
+    int fd;
+
+    if ( max_objects == 0 )
+        max_objects = SP_MAX_OBJECTS;
+    if ( period_ms == 0 )
+        period_ms = SP_PERIOD_MS;
+
+    error = ERR_NO_ERROR;
+
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&sp_lock );
+    pthread_mutex_lock( &sp_lock );
+
+    if ( page != (sp_page_t *)NULL )
+        error = (ULONG)EBUSY;
+    else
+    {
+        if ( name != (const char *)NULL )
+            snprintf( page_name, sizeof( page_name ), "%s", name );
+        else
+            snprintf( page_name, sizeof( page_name ), "/p2linux.%d",
+                      (int)getpid() );
+        page_size = sizeof( sp_page_t ) +
+                    (max_objects - 1) * sizeof( sp_object_t );
+
+        /*
+        **  Monitors map the page read-only, so only we may write it.
+        */
+        fd = shm_open( page_name, O_RDWR | O_CREAT | O_TRUNC, 0644 );
+        if ( fd < 0 )
+            error = (ULONG)errno;
+        else
+        {
+            if ( ftruncate( fd, (off_t)page_size ) != 0 )
+                error = (ULONG)errno;
+            else
+            {
+                page = (sp_page_t *)mmap( (void *)NULL, page_size,
+                                          PROT_READ | PROT_WRITE, MAP_SHARED,
+                                          fd, 0 );
+                if ( page == (sp_page_t *)MAP_FAILED )
+                {
+                    error = (ULONG)errno;
+                    page = (sp_page_t *)NULL;
+                }
+            }
+            close( fd );
+            if ( page == (sp_page_t *)NULL )
+                shm_unlink( page_name );
+        }
+
+        if ( (page != (sp_page_t *)NULL) &&
+             ((rows = (sp_object_t *)malloc( max_objects *
+                                             sizeof( sp_object_t ) )) ==
+              (sp_object_t *)NULL) )
+            error = (ULONG)ENOMEM;
+
+        if ( error == ERR_NO_ERROR )
+        {
+            page->version = SP_VERSION;
+            page->pid = (ULONG)getpid();
+            page->period_ms = period_ms;
+            page->max_objects = max_objects;
+            update_page();
+            __sync_synchronize();
+            page->magic = SP_MAGIC;
+
+            pthread_condattr_init( &cond_attr );
+            pthread_condattr_setclock( &cond_attr, CLOCK_MONOTONIC );
+            pthread_cond_init( &sp_wakeup, &cond_attr );
+            pthread_condattr_destroy( &cond_attr );
+
+            publishing = TRUE;
+            if ( pthread_create( &publish_thread, (pthread_attr_t *)NULL,
+                                 publish_task, (void *)NULL ) != 0 )
+            {
+                publishing = FALSE;
+                pthread_cond_destroy( &sp_wakeup );
+                error = (ULONG)EAGAIN;
+            }
+        }
+
+        if ( (error != ERR_NO_ERROR) && (page != (sp_page_t *)NULL) )
+        {
+            free( (void *)rows );
+            munmap( (void *)page, page_size );
+            shm_unlink( page_name );
+            page = (sp_page_t *)NULL;
+        }
+    }
+
+    pthread_mutex_unlock( &sp_lock );
+    pthread_cleanup_pop( 0 );
+
+    return( error );
+}
+
+/*****************************************************************************
+** sp_stop - stops updating the stats page and removes it.  Returns 0, or
+**           ENOENT if the page was not started.
+*****************************************************************************/
+ULONG
+   sp_stop( void )
+{
+    pthread_mutex_lock( &sp_lock );
+    if ( !publishing )
+    {
+        pthread_mutex_unlock( &sp_lock );
+        return( (ULONG)ENOENT );
+    }
+    publishing = FALSE;
+    pthread_cond_signal( &sp_wakeup );
+    pthread_mutex_unlock( &sp_lock );
+
+    pthread_join( publish_thread, (void **)NULL );
+
+    pthread_mutex_lock( &sp_lock );
+    pthread_cond_destroy( &sp_wakeup );
+    free( (void *)rows );
+    munmap( (void *)page, page_size );
+    shm_unlink( page_name );
+    page = (sp_page_t *)NULL;
+    pthread_mutex_unlock( &sp_lock );
+
+    return( ERR_NO_ERROR );
+}
@@ -13,6 +13,11 @@
 #include <signal.h>
 #include <sys/time.h>
 #include <string.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <time.h>
+#include <fcntl.h>
+#include <limits.h>
 #include "p2pthread.h"
 
 #undef DIAG_PRINTFS
@@ -45,6 +50,56 @@
 */
 // extern void user_sysroot( void );
 
+/*****************************************************************************
+**  External function and data references
+*****************************************************************************/
+extern int
+   held_mutex_ceiling( void );
+extern void
+   cleanup_held_mutexes( void *tcb );
+extern void *
+   ts_malloc( size_t blksize );
+extern void
+   ts_free( void *blkaddr );
+extern int
+   count_object( UINT obj_class );
+extern void
+   uncount_object( UINT obj_class );
+extern void
+   sim_attach( p2pthread_cb_t *tcb );
+extern void
+   init_isr_dispatch( void );
+extern void
+   sim_enter( p2pthread_cb_t *tcb );
+extern void
+   sim_detach( p2pthread_cb_t *tcb );
+extern void
+   sim_suspend( p2pthread_cb_t *tcb, int suspended );
+extern int
+   sim_yield( int favoured );
+extern long
+   sim_futex_wait( volatile int *uaddr, int op, int val,
+                   const struct timespec *timeout, volatile int *uaddr2,
+                   int val3 );
+extern int
+   sim_futex_wake( volatile int *uaddr, int count );
+extern int
+   mn_attach( p2pthread_cb_t *tcb, void *(*entry)( void * ), void *arg );
+extern void
+   mn_exit( struct mn_task *task );
+extern void
+   mn_kill( p2pthread_cb_t *tcb );
+extern void
+   mn_suspend( p2pthread_cb_t *tcb, int suspended );
+extern int
+   mn_yield( int favoured );
+extern long
+   mn_futex_wait( volatile int *uaddr, int op, int val,
+                  const struct timespec *timeout, volatile int *uaddr2,
+                  int val3 );
+extern long
+   mn_futex_wake( volatile int *uaddr, int count );
+
 /*****************************************************************************
 **  p2pthread Global Data Structures
 *****************************************************************************/
@@ -58,10 +113,14 @@ static p2pthread_cb_t *
     task_list = (p2pthread_cb_t *)NULL;
 
 /*
-**  task_list_lock is a mutex used to serialize access to the task list
+**  task_list_lock is a mutex used to serialize access to the task list.
+**                 ev_send holds it while it sets a task's events, so the
+**                 task's tcb cannot be freed under it.
 */
-static pthread_mutex_t
+pthread_mutex_t
     task_list_lock = PTHREAD_MUTEX_INITIALIZER;
+lk_stat_t
+    task_list_lkstat = LK_STAT_INITIALIZER( TR_TASK, "task_list_lock" );
 
 /*
 **  p2pt_sched_lock is a mutex used to make sched_lock exclusive to one thread
@@ -69,6 +128,8 @@ static pthread_mutex_t
 */
 pthread_mutex_t
     p2pt_sched_lock = PTHREAD_MUTEX_INITIALIZER;
+static lk_stat_t
+    p2pt_sched_lkstat = LK_STAT_INITIALIZER( TR_TASK, "p2pt_sched_lock" );
 
 /*
 **  scheduler_locked contains the pthread ID of the thread which currently
@@ -92,46 +153,184 @@ static unsigned long
 static pthread_cond_t
     sched_lock_change = PTHREAD_COND_INITIALIZER;
 
-/*****************************************************************************
-**  thread-safe malloc
-*****************************************************************************/
-void *ts_malloc( size_t blksize )
+/*
+**  own_tcb caches the task control block of each p2pthread task's own
+**          pthread, so my_tcb need not scan the task list.
+*/
+static __thread p2pthread_cb_t *
+    own_tcb = (p2pthread_cb_t *)NULL;
+
+/*
+**  tcb_cache is a direct-mapped cache of task control blocks indexed by the
+**            low bits of the task ID, so tcb_for seldom scans the task list.
+**            Entries are only written under task_list_lock, as their tasks
+**            are linked into and removed from the task list, so no entry
+**            can outlive its task.
+*/
+#define TCB_CACHE_SIZE 64
+static p2pthread_cb_t *
+    tcb_cache[TCB_CACHE_SIZE];
+
+/*
+**  first_free_tcb and last_free_tcb are the ends of the list of the control
+**                 blocks of deleted tasks, linked through nxt_task, oldest
+**                 first.  Task control blocks are never given back to the
+**                 allocator, so a tcb found in tcb_cache without a lock may
+**                 still be used after its task is deleted, and a block is
+**                 reused only after all those released before it.
+*/
+static p2pthread_cb_t *
+    first_free_tcb = (p2pthread_cb_t *)NULL;
+static p2pthread_cb_t *
+    last_free_tcb = (p2pthread_cb_t *)NULL;
+
+/*
+**  kernel_tid caches the kernel thread ID of each pthread after its first
+**             lookup, since futex-based objects compare it on every operation.
+*/
+static __thread pid_t
+    kernel_tid = 0;
+
+/*
+**  static_tasks lists the tasks in the static configuration table, and
+**               static_tcbs holds their control blocks.  A priority which
+**               t_create() would reject fails to compile.
+*/
+typedef struct static_task
+{
+    char
+        name[4];
+    ULONG
+        priority;
+} static_task_t;
+
+#define P2PT_TASK( id, name, priority, sstack, ustack, flags ) \
+typedef char id##_priority_check[(((priority) < MIN_P2PT_PRIORITY) || \
+                                  ((priority) > MAX_P2PT_PRIORITY)) ? -1 : 1];
+#include "p2ptstatic.h"
+
+static const static_task_t
+    static_tasks[] =
 {
-    void *blkaddr;
-    static pthread_mutex_t
-        malloc_lock = PTHREAD_MUTEX_INITIALIZER;
+#define P2PT_TASK( id, name, priority, sstack, ustack, flags ) \
+    { name, (priority) },
+#include "p2ptstatic.h"
+    { "", 0 }
+};
 
-    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
-                          (void *)&malloc_lock );
-    pthread_mutex_lock( &malloc_lock );
+#define STATIC_TASKS ((sizeof( static_tasks ) / sizeof( static_task_t )) - 1)
 
-    blkaddr = malloc( blksize );
+static p2pthread_cb_t
+    static_tcbs[STATIC_TASKS + 1];
 
-    pthread_mutex_unlock( &malloc_lock );
-    pthread_cleanup_pop( 0 );
+/*****************************************************************************
+** my_kernel_tid - returns the kernel thread ID of the calling pthread.
+*****************************************************************************/
+pid_t
+   my_kernel_tid( void )
+{
+    if ( kernel_tid == 0 )
+        kernel_tid = (pid_t)syscall( SYS_gettid );
 
-    return( blkaddr );
+    return( kernel_tid );
 }
-    
+
 /*****************************************************************************
-**  thread-safe free
+** set_my_tcb - sets the task control block of the task running on the
+**              calling pthread, which the M:N scheduler changes with each
+**              switch between task contexts on a worker pthread.
 *****************************************************************************/
-void ts_free( void *blkaddr )
+void
+   set_my_tcb( p2pthread_cb_t *tcb )
+{
+    own_tcb = tcb;
+}
 
+/*****************************************************************************
+** sched_id - returns the ID by which the scheduler lock knows its owner...
+**            the pthread ID of the calling task, or the address of its tcb
+**            if it is one of several tasks sharing an M:N worker pthread.
+*****************************************************************************/
+static pthread_t
+   sched_id( void )
 {
-    static pthread_mutex_t
-        free_lock = PTHREAD_MUTEX_INITIALIZER;
+    if ( (own_tcb != (p2pthread_cb_t *)NULL) &&
+         (own_tcb->mn_task != (struct mn_task *)NULL) )
+        return( (pthread_t)own_tcb );
 
-    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
-                          (void *)&free_lock );
-    pthread_mutex_lock( &free_lock );
+    return( pthread_self() );
+}
 
-    free( blkaddr );
+/*****************************************************************************
+** futex_op - issues a futex system call for objects which manage their own
+**            futex words.  In simulation mode, blocking operations and the
+**            wakes which end them go through the simulator, and in M:N
+**            mode plain waits and wakes go through the M:N scheduler.  Returns -1 with errno set on
+**            failure.
+*****************************************************************************/
+long
+   futex_op( volatile int *uaddr, int op, int val,
+             const struct timespec *timeout, volatile int *uaddr2, int val3 )
+{
+    long woken, result;
+    int cmd;
 
-    pthread_mutex_unlock( &free_lock );
-    pthread_cleanup_pop( 0 );
+    if ( sim_mode )
+    {
+        cmd = op & FUTEX_CMD_MASK;
+        if ( (cmd == FUTEX_WAIT) || (cmd == FUTEX_WAIT_BITSET) ||
+             (cmd == FUTEX_LOCK_PI) || (cmd == FUTEX_WAIT_REQUEUE_PI) )
+            return( sim_futex_wait( uaddr, op, val, timeout, uaddr2, val3 ) );
+        if ( (cmd == FUTEX_WAKE) || (cmd == FUTEX_CMP_REQUEUE_PI) )
+        {
+            /*
+            **  Wake simulated tasks first, then any pthreads for the rest.
+            **  A simulated task woken from a requeue locks the mutex itself.
+            */
+            woken = sim_futex_wake( uaddr, val );
+            if ( woken >= val )
+                return( woken );
+            result = syscall( SYS_futex, uaddr, op, val - (int)woken, timeout,
+                              uaddr2, val3 );
+            if ( result < 0 )
+                return( (woken > 0) ? woken : result );
+            return( woken + result );
+        }
+        if ( cmd == FUTEX_UNLOCK_PI )
+        {
+            /*
+            **  Simulated tasks waiting for the lock try again for it.
+            */
+            result = syscall( SYS_futex, uaddr, op, val, timeout, uaddr2,
+                              val3 );
+            sim_futex_wake( uaddr, INT_MAX );
+            return( result );
+        }
+    }
+    else if ( mn_mode )
+    {
+        cmd = op & FUTEX_CMD_MASK;
+        if ( (cmd == FUTEX_WAIT) || (cmd == FUTEX_WAIT_BITSET) )
+            return( mn_futex_wait( uaddr, op, val, timeout, uaddr2, val3 ) );
+        if ( cmd == FUTEX_WAKE )
+        {
+            /*
+            **  Wake task contexts first, then any pthreads for the rest.
+            */
+            woken = mn_futex_wake( uaddr, val );
+            if ( woken >= val )
+                return( woken );
+            result = syscall( SYS_futex, uaddr, op, val - (int)woken, timeout,
+                              uaddr2, val3 );
+            if ( result < 0 )
+                return( (woken > 0) ? woken : result );
+            return( woken + result );
+        }
+    }
+
+    return( syscall( SYS_futex, uaddr, op, val, timeout, uaddr2, val3 ) );
 }
-    
+
 /*****************************************************************************
 **  my_tcb - returns a pointer to the task control block for the calling task
 *****************************************************************************/
@@ -141,6 +340,12 @@ p2pthread_cb_t *
     pthread_t my_pthrid;
     p2pthread_cb_t *current_tcb;
 
+    /*
+    **  A p2pthread task knows its own tcb from the time it starts running.
+    */
+    if ( own_tcb != (p2pthread_cb_t *)NULL )
+        return( own_tcb );
+
     /*
     **  Get caller's pthread ID
     */
@@ -186,6 +391,15 @@ p2pthread_cb_t *
     p2pthread_cb_t *current_tcb;
     int found_taskid;
 
+        /*
+        **  Try the tcb cache first.  A task whose ID shares its cache
+        **  entry with a later task is found by scanning the task list.
+        */
+        current_tcb = tcb_cache[taskid % TCB_CACHE_SIZE];
+        if ( (current_tcb != (p2pthread_cb_t *)NULL) &&
+             (current_tcb->taskid == taskid) )
+            return( current_tcb );
+
         if ( task_list != (p2pthread_cb_t *)NULL )
         {
             /*
@@ -215,6 +429,24 @@ p2pthread_cb_t *
     return( current_tcb );
 }
 
+/*****************************************************************************
+** tcb_cached - returns the address of the task control block for the task
+**              identified by taskid if it is in tcb_cache, or NULL.  Takes
+**              no lock.  The task may be deleted at any time after, and its
+**              tcb reused for another task, so the caller must check the
+**              taskid again once it has used the tcb.
+*****************************************************************************/
+p2pthread_cb_t *
+   tcb_cached( ULONG taskid )
+{
+    p2pthread_cb_t *tcb;
+
+    tcb = tcb_cache[taskid % TCB_CACHE_SIZE];
+    if ( (tcb == (p2pthread_cb_t *)NULL) || (tcb->taskid != taskid) )
+        tcb = (p2pthread_cb_t *)NULL;
+    return( tcb );
+}
+
 /*****************************************************************************
 ** sched_lock - 'locks the scheduler' to prevent preemption of the current task
 **           by other task-level code.  Because we cannot actually lock the
@@ -243,7 +475,7 @@ void
     **  will then lock it ourselves before proceeding.
     */
     got_lock = FALSE;
-    my_pthrid = pthread_self();
+    my_pthrid = sched_id();
 
     /*
     **  'Spin' here until scheduler_locked == NULL or our pthread ID
@@ -262,7 +494,7 @@ void
         **  scheduler_locked flag.  Locking via pthread ID allows recursive
         **  locking by the same pthread while excluding all other pthreads.
         */
-        pthread_mutex_lock( &p2pt_sched_lock );
+        lk_lock( &p2pt_sched_lock, &p2pt_sched_lkstat );
         if ( (scheduler_locked == (pthread_t)NULL) ||
              (scheduler_locked == my_pthrid) )
         {
@@ -278,10 +510,11 @@ void
             if ( sched_lock_level == 0L )
                 sched_lock_level--;
             got_lock = TRUE;
+            TRACE( TR_TASK | TR_SCHED_LOCK, 0, sched_lock_level );
 			/* 
 			**  Note: i think maybe the statement below is useless.
 			*/
-			pthread_cond_broadcast( &sched_lock_change );
+			lk_broadcast( &sched_lock_change );
 #ifdef DIAG_PRINTFS 
             printf( "\r\nsched_lock sched_lock_level %lu locking tid %ld",
                 sched_lock_level,  scheduler_locked );
@@ -293,9 +526,10 @@ void
             printf( "\r\nsched_lock locking tid %ld my tid %ld",
                     scheduler_locked, my_pthrid );
 #endif
-            pthread_cond_wait( &sched_lock_change, &p2pt_sched_lock );
+            lk_wait( &sched_lock_change, &p2pt_sched_lock,
+                     &p2pt_sched_lkstat );
         }
-        pthread_mutex_unlock( &p2pt_sched_lock );
+        lk_unlock( &p2pt_sched_lock, &p2pt_sched_lkstat );
 
         /*
         **  Add a cancellation point to this loop, since there are no others.
@@ -311,9 +545,15 @@ void
     */
     pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                           (void *)&task_list_lock );
-    pthread_mutex_lock( &task_list_lock );
+    lk_lock( &task_list_lock, &task_list_lkstat );
     tcb = my_tcb();
-    if ( tcb != (p2pthread_cb_t *)NULL )
+
+    /*
+    **  A task run by the M:N scheduler is never preempted while it holds
+    **  the scheduler lock, since it only switches at API call points.
+    */
+    if ( (tcb != (p2pthread_cb_t *)NULL) &&
+         (tcb->mn_task == (struct mn_task *)NULL) )
     {
         pthread_attr_getschedpolicy( &(tcb->attr), &sched_policy );
         max_priority = sched_get_priority_max( sched_policy );
@@ -325,7 +565,7 @@ void
         pthread_setschedparam( tcb->pthrid, sched_policy,
                           &param );
     }
-    pthread_mutex_unlock( &task_list_lock );
+    lk_unlock( &task_list_lock, &task_list_lkstat );
     pthread_cleanup_pop( 0 );
 }
 
@@ -342,9 +582,11 @@ void
    sched_unlock( void )
 {
     p2pthread_cb_t *tcb;
-    int sched_policy;
+    int sched_policy, unlocked;
     struct sched_param param;
 
+    unlocked = FALSE;
+
     /*
     **  scheduler_locked ensures that only one p2pthread pthread at a time gets
     **  to run at max_priority (effectively locking out all other p2pthread
@@ -352,12 +594,13 @@ void
     */
     pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                           (void *)&p2pt_sched_lock );
-    pthread_mutex_lock( &p2pt_sched_lock );
+    lk_lock( &p2pt_sched_lock, &p2pt_sched_lkstat );
 
-    if ( scheduler_locked == pthread_self() )
+    if ( scheduler_locked == sched_id() )
     {
         if ( sched_lock_level > 0L )
             sched_lock_level--;
+        TRACE( TR_TASK | TR_SCHED_UNLOCK, 0, sched_lock_level );
         if ( sched_lock_level < 1L )
         {
             /*
@@ -367,22 +610,35 @@ void
             */
             pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                                   (void *)&task_list_lock );
-            pthread_mutex_lock( &task_list_lock );
+            lk_lock( &task_list_lock, &task_list_lkstat );
             tcb = my_tcb();
-            if ( tcb != (p2pthread_cb_t *)NULL )
+            if ( (tcb != (p2pthread_cb_t *)NULL) &&
+                 (tcb->mn_task == (struct mn_task *)NULL) )
             {
                 pthread_attr_getschedpolicy( &(tcb->attr), &sched_policy );
 		param.__sched_priority = tcb->prv_priority.sched_priority;
+                /*
+                **  Don't drop below the ceiling of any priority-protected
+                **  mutex still held by the task.
+                */
+                if ( held_mutex_ceiling() > param.__sched_priority )
+                    param.__sched_priority = held_mutex_ceiling();
+                /*
+                **  ...nor below any priority lent to it through a queue.
+                */
+                if ( tcb->lent_priority > param.__sched_priority )
+                    param.__sched_priority = tcb->lent_priority;
 //              ((tcb->attr).__schedparam).sched_priority = 
 //                                         tcb->prv_priority.sched_priority;
                 pthread_setschedparam( tcb->pthrid, sched_policy,
                           &param );
             }
-            pthread_mutex_unlock( &task_list_lock );
+            lk_unlock( &task_list_lock, &task_list_lkstat );
             pthread_cleanup_pop( 0 );
 
             scheduler_locked = (pthread_t)NULL;
-            pthread_cond_broadcast( &sched_lock_change );
+            lk_broadcast( &sched_lock_change );
+            unlocked = TRUE;
         }
 #ifdef DIAG_PRINTFS 
         printf( "\r\nsched_unlock sched_lock_level %lu locking tid %ld",
@@ -395,8 +651,17 @@ void
                 pthread_self() );
 #endif
 
-    pthread_mutex_unlock( &p2pt_sched_lock );
+    lk_unlock( &p2pt_sched_lock, &p2pt_sched_lkstat );
     pthread_cleanup_pop( 0 );
+
+    /*
+    **  In simulation and M:N modes, this is where a higher priority task
+    **  made ready by the caller gets to preempt it.
+    */
+    if ( unlocked && sim_mode )
+        sim_yield( TRUE );
+    else if ( unlocked && mn_mode )
+        mn_yield( TRUE );
 }
 
 /*****************************************************************************
@@ -412,7 +677,7 @@ void
     {
         pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                               (void *)&task_list_lock );
-        pthread_mutex_lock( &task_list_lock );
+        lk_lock( &task_list_lock, &task_list_lkstat );
         new_entry->nxt_susp = (p2pthread_cb_t *)NULL;
         if ( *list_head != (p2pthread_cb_t *)NULL )
         {
@@ -439,7 +704,7 @@ void
         */
         new_entry->suspend_list = list_head;
 
-        pthread_mutex_unlock( &task_list_lock );
+        lk_unlock( &task_list_lock, &task_list_lkstat );
         pthread_cleanup_pop( 0 );
     }
 }
@@ -457,7 +722,7 @@ void
     {
         pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                               (void *)&task_list_lock );
-        pthread_mutex_lock( &task_list_lock );
+        lk_lock( &task_list_lock, &task_list_lkstat );
         if ( *list_head == entry )
         {
             *list_head = entry->nxt_susp;
@@ -483,12 +748,70 @@ void
             }
         }
         entry->nxt_susp = (p2pthread_cb_t *)NULL;
-        pthread_mutex_unlock( &task_list_lock );
+        lk_unlock( &task_list_lock, &task_list_lkstat );
         pthread_cleanup_pop( 0 );
     }
 
 }
 
+/*****************************************************************************
+** next_susp_tcb - returns the task to be selected next from the specified
+**                 'pended task list' according to the specified pend order
+**                 (NULL if the list is empty)
+*****************************************************************************/
+p2pthread_cb_t *
+   next_susp_tcb( p2pthread_cb_t *list_head, int pend_order )
+{
+    p2pthread_cb_t *signalled_task;
+    p2pthread_cb_t *current_tcb;
+
+    signalled_task = list_head;
+    if ( pend_order != 0 )
+    {
+        /*
+        **  Tasks pend in priority order... locate the highest priority
+        **  task in the pended list.
+        */
+        for ( current_tcb = list_head;
+              current_tcb != (p2pthread_cb_t *)NULL;
+              current_tcb = current_tcb->nxt_susp )
+        {
+            if ( (current_tcb->prv_priority).sched_priority >
+                 (signalled_task->prv_priority).sched_priority )
+                signalled_task = current_tcb;
+#ifdef DIAG_PRINTFS 
+            printf( "\r\nnext_susp_tcb - tcb @ %p priority %d",
+                    current_tcb,
+                    (current_tcb->prv_priority).sched_priority );
+#endif
+        }
+    } /*
+    else
+        **
+        ** Tasks pend in FIFO order... signal is for task at list head.
+        */
+
+    return( signalled_task );
+}
+
+/*****************************************************************************
+** count_susp_tcbs - returns the number of tasks in the specified 'pended
+**                   task list'
+*****************************************************************************/
+ULONG
+   count_susp_tcbs( p2pthread_cb_t *list_head )
+{
+    p2pthread_cb_t *current_tcb;
+    ULONG count;
+
+    count = 0;
+    for ( current_tcb = list_head; current_tcb != (p2pthread_cb_t *)NULL;
+          current_tcb = current_tcb->nxt_susp )
+        count++;
+
+    return( count );
+}
+
 /*****************************************************************************
 ** signal_for_my_task - searches the specified 'pended task list' for the
 **                      task to be selected according to the specified
@@ -502,7 +825,6 @@ int
    signal_for_my_task( p2pthread_cb_t **list_head, int pend_order )
 {
     p2pthread_cb_t *signalled_task;
-    p2pthread_cb_t *current_tcb;
     int result;
 
     result = FALSE;
@@ -511,35 +833,10 @@ int
 #endif
     if ( list_head != (p2pthread_cb_t **)NULL )
     {
-        signalled_task = *list_head;
-
         /*
         **  First determine which task is being signalled
         */
-        if ( pend_order != 0 )
-        {
-            /*
-            **  Tasks pend in priority order... locate the highest priority
-            **  task in the pended list.
-            */
-            for ( current_tcb = *list_head;
-                  current_tcb != (p2pthread_cb_t *)NULL;
-                  current_tcb = current_tcb->nxt_susp )
-            {
-                if ( (current_tcb->prv_priority).sched_priority >
-                     (signalled_task->prv_priority).sched_priority )
-                    signalled_task = current_tcb;
-#ifdef DIAG_PRINTFS 
-                printf( "\r\nsignal_for_my_task - tcb @ %p priority %d",
-                        current_tcb,
-                        (current_tcb->prv_priority).sched_priority );
-#endif
-            }
-        } /*
-        else
-            **
-            ** Tasks pend in FIFO order... signal is for task at list head.
-            */
+        signalled_task = next_susp_tcb( *list_head, pend_order );
 
         /*
         **  Signalled task located... see if it's the currently executing task.
@@ -614,7 +911,7 @@ static ULONG
 /*****************************************************************************
 ** translate_priority - translates a p2pthread priority into a pthreads priority
 *****************************************************************************/
-static int
+int
    translate_priority( ULONG p2pt_priority, int sched_policy, ULONG *errp )
 {
     int max_priority, min_priority, pthread_priority;
@@ -650,9 +947,69 @@ static int
     return( pthread_priority );
 }
 
+/*****************************************************************************
+** new_tcb - returns a control block for a new task, reusing that of the task
+**           deleted longest ago if there is one.  Returns NULL if the maximum
+**           number of tasks already exist, or if there is no memory.
+*****************************************************************************/
+static p2pthread_cb_t *
+   new_tcb( void )
+{
+    p2pthread_cb_t *tcb;
+
+    if ( !count_object( TR_TASK ) )
+        return( (p2pthread_cb_t *)NULL );
+
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&task_list_lock );
+    lk_lock( &task_list_lock, &task_list_lkstat );
+    tcb = first_free_tcb;
+    if ( tcb != (p2pthread_cb_t *)NULL )
+    {
+        first_free_tcb = tcb->nxt_task;
+        if ( first_free_tcb == (p2pthread_cb_t *)NULL )
+            last_free_tcb = (p2pthread_cb_t *)NULL;
+    }
+    lk_unlock( &task_list_lock, &task_list_lkstat );
+    pthread_cleanup_pop( 0 );
+
+    if ( tcb == (p2pthread_cb_t *)NULL )
+    {
+        tcb = (p2pthread_cb_t *)ts_malloc( sizeof( p2pthread_cb_t ) );
+        if ( tcb == (p2pthread_cb_t *)NULL )
+            uncount_object( TR_TASK );
+    }
+
+    return( tcb );
+}
+
+/*****************************************************************************
+** release_tcb - puts the control block of a task which is gone on the end
+**               of the free list.  Its taskid is cleared first, so that an
+**               ev_send which found it before the task was deleted sees the
+**               task is gone.  A block from the static configuration table,
+**               which was never counted, is not reused.  The caller must
+**               hold task_list_lock.
+*****************************************************************************/
+static void
+   release_tcb( p2pthread_cb_t *tcb )
+{
+    tcb->taskid = 0L;
+    if ( (tcb < static_tcbs) || (tcb >= &(static_tcbs[STATIC_TASKS])) )
+    {
+        tcb->nxt_task = (p2pthread_cb_t *)NULL;
+        if ( last_free_tcb == (p2pthread_cb_t *)NULL )
+            first_free_tcb = tcb;
+        else
+            last_free_tcb->nxt_task = tcb;
+        last_free_tcb = tcb;
+        uncount_object( TR_TASK );
+    }
+}
+
 /*****************************************************************************
 ** tcb_delete - deletes a pthread task control block from the task_list
-**              and frees the memory allocated for the tcb
+**              and releases the tcb for reuse
 *****************************************************************************/
 static void
    tcb_delete( p2pthread_cb_t *tcb )
@@ -672,7 +1029,9 @@ static void
         unlink_susp_tcb( tcb->suspend_list, tcb );
         pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                               (void *)&task_list_lock );
-        pthread_mutex_lock( &task_list_lock );
+        lk_lock( &task_list_lock, &task_list_lkstat );
+        if ( tcb_cache[tcb->taskid % TCB_CACHE_SIZE] == tcb )
+            tcb_cache[tcb->taskid % TCB_CACHE_SIZE] = (p2pthread_cb_t *)NULL;
         if ( tcb == task_list )
         {
             task_list = tcb->nxt_task;
@@ -694,12 +1053,49 @@ static void
                 }
             }
         }
-        pthread_mutex_unlock( &task_list_lock );
+        lk_unlock( &task_list_lock, &task_list_lkstat );
         pthread_cleanup_pop( 0 );
     }
 
-    /* Release the memory occupied by the tcb being deleted. */
-    ts_free( (void *)tcb );
+    /*
+    **  A task deleting itself must not use its cached tcb from here on.
+    */
+    if ( own_tcb == tcb )
+        own_tcb = (p2pthread_cb_t *)NULL;
+
+    /*
+    **  Pass the simulator's run token on if the task held it.
+    */
+    sim_detach( tcb );
+
+    /*
+    **  Release the tcb being deleted for reuse by a later task.
+    */
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&task_list_lock );
+    lk_lock( &task_list_lock, &task_list_lkstat );
+    release_tcb( tcb );
+    lk_unlock( &task_list_lock, &task_list_lkstat );
+    pthread_cleanup_pop( 0 );
+}
+
+static void
+   cleanup_scheduler_lock( void *tcb );
+
+/*****************************************************************************
+** end_mn_task - ends the calling task in M:N mode, where it has no pthread of
+**               its own to exit.  Its user-space context is freed by the
+**               worker pthread it ran on.  Never returns.
+*****************************************************************************/
+static void
+   end_mn_task( p2pthread_cb_t *tcb )
+{
+    struct mn_task *task;
+
+    task = tcb->mn_task;
+    cleanup_scheduler_lock( (void *)tcb );
+    tcb_delete( tcb );
+    mn_exit( task );
 }
 
 /*****************************************************************************
@@ -726,6 +1122,8 @@ ULONG
         */
         if ( self_tcb != (p2pthread_cb_t *)NULL )
         {
+            TRACE( TR_TASK | TR_DELETE, self_tcb->taskid, 0 );
+
             /*
             **  Kill the currently executing task's pthread and 
             **  then de-allocate its data structures.
@@ -744,6 +1142,8 @@ ULONG
 			**  If the pthread is deleting itself it must be detached in order 
 			**  to free its Linux resources upon termination.
 			*/  
+            if ( self_tcb->mn_task != (struct mn_task *)NULL )
+                end_mn_task( self_tcb );
             pthread_detach( self_tcb->pthrid );
             pthread_cleanup_push( (void(*)(void *))tcb_delete,
                                   (void *)self_tcb );
@@ -771,6 +1171,7 @@ ULONG
             /*
             **  Found the task being deleted... delete it.
             */
+            TRACE( TR_TASK | TR_DELETE, tid, 0 );
             if ( current_tcb != self_tcb )
             {
                 /*
@@ -778,8 +1179,13 @@ ULONG
                 **  Kill the task pthread and wait for it to die.
                 **  Then de-allocate its data structures.
                 */
-                pthread_cancel( current_tcb->pthrid );
-                pthread_join( current_tcb->pthrid, (void **)NULL );
+                if ( current_tcb->mn_task != (struct mn_task *)NULL )
+                    mn_kill( current_tcb );
+                else
+                {
+                    pthread_cancel( current_tcb->pthrid );
+                    pthread_join( current_tcb->pthrid, (void **)NULL );
+                }
                 tcb_delete( current_tcb );
             }
             else
@@ -788,6 +1194,8 @@ ULONG
                 **  Kill the currently executing task's pthread
                 **  and then de-allocate its data structures.
                 */
+                if ( self_tcb->mn_task != (struct mn_task *)NULL )
+                    end_mn_task( self_tcb );
                 pthread_detach( self_tcb->pthrid );
                 pthread_cleanup_push( (void(*)(void *))tcb_delete,
                                       (void *)self_tcb );
@@ -813,14 +1221,15 @@ static void
     p2pthread_cb_t *mytcb;
 
     mytcb = (p2pthread_cb_t *)tcb;
-    pthread_mutex_lock( &p2pt_sched_lock );
+    lk_lock( &p2pt_sched_lock, &p2pt_sched_lkstat );
 
-    if ( scheduler_locked == pthread_self() )
+    if ( scheduler_locked == sched_id() )
     {
         sched_lock_level = 0;
         scheduler_locked = (pthread_t)NULL;
+        lk_broadcast( &sched_lock_change );
     }
-    pthread_mutex_unlock( &p2pt_sched_lock );
+    lk_unlock( &p2pt_sched_lock, &p2pt_sched_lkstat );
 }
 
 /*****************************************************************************
@@ -845,8 +1254,23 @@ static void *
     /*
     **  Note: ensure that this pthread will release the scheduler lock if killed.
     */
+    own_tcb = tcb;
+    if ( tcb->mn_task == (struct mn_task *)NULL )
+        tcb->ktid = my_kernel_tid();
+    tcb->blocked_at = 0;
     pthread_cleanup_push( cleanup_scheduler_lock, (void *)tcb );
 
+    /*
+    **  Ensure that a killed task releases any mutexes it holds, so the
+    **  next task to lock them can detect the owner's death.
+    */
+    pthread_cleanup_push( cleanup_held_mutexes, (void *)tcb );
+
+    /*
+    **  A simulated task waits here for its first turn to run.
+    */
+    sim_enter( tcb );
+
     /*
     **  Call the p2pthread task.  Normally this is an endless loop and doesn't
     **  return here.
@@ -864,6 +1288,7 @@ static void *
     **  pthread and task resources and kill the pthread.
     */
     pthread_cleanup_pop( 1 );
+    pthread_cleanup_pop( 1 );
 
     /*
     **  NOTE t_delete takes no action if the task has already been deleted.
@@ -874,104 +1299,184 @@ static void *
 }
 
 /*****************************************************************************
-** t_create - creates a pthread to contain the specified p2pthread task and
-**               initializes the requisite data structures to support p2pthread 
-**               task behavior not directly supported by Posix threads.
+** init_tcb - initializes a new task control block for a task which has not
+**            yet been started.  Returns ERR_PRIOR if the priority is out of
+**            range.
 *****************************************************************************/
-ULONG
-    t_create( char name[4], ULONG pri, ULONG sstack, ULONG ustack, ULONG mode,
-              ULONG *tid )
+static ULONG
+   init_tcb( p2pthread_cb_t *tcb, ULONG taskid, const char name[4], ULONG pri )
 {
-    p2pthread_cb_t *tcb;
-    p2pthread_cb_t *current_tcb;
     int i, new_priority;
-    ULONG error, my_tid;
+    ULONG error;
 
     error = ERR_NO_ERROR;
 
+    tcb->pthrid = (pthread_t)NULL;
+    tcb->taskid = taskid;
+
     /*
-    **  Establish task identifier
+    **  Copy the task name
     */
-    my_tid = new_tid();
-    if ( tid != (ULONG *)NULL )
-        *tid = my_tid;
+    for ( i = 0; i < 4; i++ )
+        tcb->taskname[i] = name[i];
 
-    /* First allocate memory for a new pthread task control block */
-    tcb = ts_malloc( sizeof( p2pthread_cb_t ) );
-    if ( tcb != (p2pthread_cb_t *)NULL )
-    {
-        pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
-                              (void *)&task_list_lock );
-        pthread_mutex_lock( &task_list_lock );
+    /*
+    **  Initialize the thread attributes to default values.
+    **  Then modify the attributes to make a real-time thread.
+    */
+    pthread_attr_init( &(tcb->attr) );
 
-        /*
-        **  Got a new task control block.  Initialize it.
-        */
-        tcb->pthrid = (pthread_t)NULL;
-        tcb->taskid = my_tid;
+    /*
+    **  Get the default scheduling priority & init prv_priority member
+    */
+    pthread_attr_getschedparam( &(tcb->attr), &(tcb->prv_priority) );
 
-        /*
-        **  Copy the task name
-        */
-        for ( i = 0; i < 4; i++ )
-            tcb->taskname[i] = name[i];
+    /*
+    **  Translate the p2pthread priority into a pthreads priority
+    **  and set the new scheduling priority.
+    */
+    pthread_attr_setschedpolicy( &(tcb->attr), SCHED_FIFO );
+    new_priority = translate_priority( pri, SCHED_FIFO, &error );
 
-        /*
-        **  Initialize the thread attributes to default values.
-        **  Then modify the attributes to make a real-time thread.
-        */
-        pthread_attr_init( &(tcb->attr) );
+    (tcb->prv_priority).sched_priority = new_priority;
+    pthread_attr_setschedparam( &(tcb->attr), &(tcb->prv_priority) );
 
-        /*
-        **  Get the default scheduling priority & init prv_priority member
-        */
-        pthread_attr_getschedparam( &(tcb->attr), &(tcb->prv_priority) );
+    /*
+    ** 'Registers' for task
+    */
+    for ( i = 1; i < 8; i++ )
+        tcb->registers[i] = (ULONG)NULL;
 
-        /*
-        **  Translate the p2pthread priority into a pthreads priority
-        **  and set the new scheduling priority.
-        */
-        pthread_attr_setschedpolicy( &(tcb->attr), SCHED_FIFO );
-        new_priority = translate_priority( pri, SCHED_FIFO, &error );
+    /*
+    ** Futex word for task events
+    */
+    tcb->event_seq = 0;
 
-        (tcb->prv_priority).sched_priority = new_priority;
-        pthread_attr_setschedparam( &(tcb->attr), &(tcb->prv_priority) );
+    /*
+    ** Semaphore token request state for task
+    */
+    pthread_cond_init( &(tcb->pend_wakeup), (pthread_condattr_t *)NULL );
+    tcb->tokens_wanted = (ULONG)NULL;
+    tcb->tokens_granted = (ULONG)NULL;
+    tcb->tokens_served = FALSE;
+    tcb->seg_wanted = (ULONG)NULL;
+    tcb->seg_granted = (void *)NULL;
 
-        /*
-        ** 'Registers' for task
-        */
-        for ( i = 1; i < 8; i++ )
-            tcb->registers[i] = (ULONG)NULL;
+    /*
+    ** Condition variable wait state for task
+    */
+    tcb->cv_wakeup = 0;
+    tcb->cv_mutex_word = (volatile int *)NULL;
 
-        /*
-        ** Mutex and Condition variable for task events
-        */
-        pthread_mutex_init( &(tcb->event_lock), (pthread_mutexattr_t *)NULL );
-        pthread_cond_init( &(tcb->event_change), (pthread_condattr_t *)NULL );
+    /*
+    ** Events the task is waiting for (none until it calls ev_receive)
+    */
+    tcb->event_mask = (ULONG)NULL;
 
-        /*
-        ** Event state to awaken task (if suspended)
-        */
-        tcb->event_mask = (ULONG)NULL;
+    /*
+    ** Current state of pending event flags for task
+    */
+    tcb->events_pending = (ULONG)NULL;
 
-        /*
-        ** Current state of captured event flags for task
-        */
-        tcb->events_captured = (ULONG)NULL;
+    /*
+    **  The task is initially created in a suspended state
+    */
+    tcb->suspend_reason = WAIT_TSTRT;
 
-        /*
-        ** Current state of pending event flags for task
-        */
-        tcb->events_pending = (ULONG)NULL;
+    tcb->suspend_list = (p2pthread_cb_t **)NULL;
+    tcb->nxt_susp = (p2pthread_cb_t *)NULL;
+    tcb->nxt_task = (p2pthread_cb_t *)NULL;
+
+    /*
+    **  The task joins the simulator (if at all) when it is started.
+    */
+    tcb->sim_state = SIM_NONE;
+    tcb->mn_task = (struct mn_task *)NULL;
+
+    /*
+    **  Scheduling statistics start from zero.
+    */
+    memset( (void *)&(tcb->stats), 0, sizeof( t_stat_t ) );
+    tcb->ktid = 0;
+    tcb->blocked_at = 0;
+    tcb->woken_at = 0;
+
+    /*
+    **  The task serves no Q_INHERIT queue until it receives from one.
+    */
+    tcb->serving = (void *)NULL;
+    tcb->lent_priority = 0;
+
+    return( error );
+}
+
+/*****************************************************************************
+** create_static_tasks - initializes the tasks in the static configuration
+**                       table, suspended until started by t_start(), and
+**                       links them into the task list, in ID order, before
+**                       main() is called.
+*****************************************************************************/
+static void __attribute__(( constructor ))
+   create_static_tasks( void )
+{
+    p2pthread_cb_t *tcb;
+    ULONG i;
+
+    for ( i = 0; i < STATIC_TASKS; i++ )
+    {
+        tcb = &(static_tcbs[i]);
+        init_tcb( tcb, i + 1, static_tasks[i].name, static_tasks[i].priority );
+        if ( i > 0 )
+            static_tcbs[i - 1].nxt_task = tcb;
+        tcb_cache[tcb->taskid % TCB_CACHE_SIZE] = tcb;
+    }
+
+    if ( STATIC_TASKS > 0 )
+    {
+        task_list = &(static_tcbs[0]);
+        init_isr_dispatch();
+    }
+}
+
+/*****************************************************************************
+** t_create - creates a pthread to contain the specified p2pthread task and
+**               initializes the requisite data structures to support p2pthread 
+**               task behavior not directly supported by Posix threads.
+*****************************************************************************/
+ULONG
+    t_create( char name[4], ULONG pri, ULONG sstack, ULONG ustack, ULONG mode,
+              ULONG *tid )
+{
+    p2pthread_cb_t *tcb;
+    p2pthread_cb_t *current_tcb;
+    ULONG error, my_tid;
+
+    error = ERR_NO_ERROR;
+
+    /*
+    **  Make sure ev_send_isr() has a dispatch thread to deliver its events.
+    */
+    init_isr_dispatch();
+
+    /*
+    **  Establish task identifier
+    */
+    my_tid = new_tid();
+    if ( tid != (ULONG *)NULL )
+        *tid = my_tid;
+
+    /* First allocate memory for a new pthread task control block */
+    tcb = new_tcb();
+    if ( tcb != (p2pthread_cb_t *)NULL )
+    {
+        pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                              (void *)&task_list_lock );
+        lk_lock( &task_list_lock, &task_list_lkstat );
 
         /*
-        **  The task is initially created in a suspended state
+        **  Got a new task control block.  Initialize it.
         */
-        tcb->suspend_reason = WAIT_TSTRT;
-
-        tcb->suspend_list = (p2pthread_cb_t **)NULL;
-        tcb->nxt_susp = (p2pthread_cb_t *)NULL;
-        tcb->nxt_task = (p2pthread_cb_t *)NULL;
+        error = init_tcb( tcb, my_tid, name, pri );
 
         /*
         **  If everything's okay thus far, we have a valid TCB ready to go.
@@ -996,16 +1501,20 @@ ULONG
                       current_tcb = current_tcb->nxt_task );
                 current_tcb->nxt_task = tcb;
             }
+            tcb_cache[tcb->taskid % TCB_CACHE_SIZE] = tcb;
         }
         else
         {
             /*
             **  OOPS! Something went wrong... clean up & exit.
             */
-            ts_free( (void *)tcb );
+            release_tcb( tcb );
         }
-        pthread_mutex_unlock( &task_list_lock );
+        lk_unlock( &task_list_lock, &task_list_lkstat );
         pthread_cleanup_pop( 0 );
+
+        if ( error == ERR_NO_ERROR )
+            TRACE( TR_TASK | TR_CREATE, my_tid, pri );
     }
     else /* malloc failed */
     {
@@ -1026,7 +1535,7 @@ ULONG
 {
     p2pthread_cb_t *tcb;
     p2pthread_pb_t *parmblk;
-    int sched_policy;
+    int sched_policy, result;
     ULONG error;
 
     error = ERR_NO_ERROR;
@@ -1090,8 +1599,23 @@ ULONG
                 printf( "\r\nt_start task @ %p tcb @ %p:", task, tcb );
 #endif
 
-                if ( pthread_create( &(tcb->pthrid), &(tcb->attr),
-                                     task_wrapper, (void *)parmblk ) != 0 )
+                /*
+                **  In simulation mode the task runs only when the simulator
+                **  hands it the run token.
+                */
+                if ( sim_mode )
+                    sim_attach( tcb );
+
+                /*
+                **  In M:N mode the task runs as a user-space context on one
+                **  of the M:N scheduler's worker pthreads instead.
+                */
+                if ( mn_mode )
+                    result = mn_attach( tcb, task_wrapper, (void *)parmblk );
+                else
+                    result = pthread_create( &(tcb->pthrid), &(tcb->attr),
+                                             task_wrapper, (void *)parmblk );
+                if ( result != 0 )
                 {
 #ifdef DIAG_PRINTFS 
                     perror( "\r\nt_start pthread_create returned error:" );
@@ -1131,6 +1655,36 @@ ULONG
     return( error );
 }
 
+/*****************************************************************************
+** stop_pthread - stops the pthread of the specified task.  A simulated or
+**                M:N task is instead left out of the tasks its scheduler
+**                may run.
+*****************************************************************************/
+static void
+   stop_pthread( p2pthread_cb_t *tcb )
+{
+    if ( tcb->mn_task != (struct mn_task *)NULL )
+        mn_suspend( tcb, TRUE );
+    else if ( tcb->sim_state != SIM_NONE )
+        sim_suspend( tcb, TRUE );
+    else
+        pthread_kill( tcb->pthrid, SIGSTOP );
+}
+
+/*****************************************************************************
+** continue_pthread - continues the pthread of a task stopped by stop_pthread
+*****************************************************************************/
+static void
+   continue_pthread( p2pthread_cb_t *tcb )
+{
+    if ( tcb->mn_task != (struct mn_task *)NULL )
+        mn_suspend( tcb, FALSE );
+    else if ( tcb->sim_state != SIM_NONE )
+        sim_suspend( tcb, FALSE );
+    else
+        pthread_kill( tcb->pthrid, SIGCONT );
+}
+
 /*****************************************************************************
 ** t_suspend - suspends the specified p2pthread task
 *****************************************************************************/
@@ -1156,33 +1710,33 @@ ULONG
             **  Don't suspend if currently executing task has the
             **  scheduler locked!
             */
-            pthread_mutex_lock( &p2pt_sched_lock );
-            if ( scheduler_locked == pthread_self() )
+            lk_lock( &p2pt_sched_lock, &p2pt_sched_lkstat );
+            if ( scheduler_locked == sched_id() )
             {
                 if ( sched_lock_level < 1L )
                 {
                     /*
                     **  Suspend the currently executing task's pthread
                     */
-                    pthread_mutex_unlock( &p2pt_sched_lock );
+                    lk_unlock( &p2pt_sched_lock, &p2pt_sched_lkstat );
                     self_tcb->suspend_reason = WAIT_TSUSP;
-                    pthread_kill( self_tcb->pthrid, SIGSTOP );
+                    stop_pthread( self_tcb );
                 }
                 else
 				    /*
 					**  Note: it seems that this condition did not suspend 
 					**  the task and no errno returned.
 					*/
-                    pthread_mutex_unlock( &p2pt_sched_lock );
+                    lk_unlock( &p2pt_sched_lock, &p2pt_sched_lkstat );
             }
             else
             {
                 /*
                 **  Suspend the currently executing task's pthread
                 */
-                pthread_mutex_unlock( &p2pt_sched_lock );
+                lk_unlock( &p2pt_sched_lock, &p2pt_sched_lkstat );
                 self_tcb->suspend_reason = WAIT_TSUSP;
-                pthread_kill( self_tcb->pthrid, SIGSTOP );
+                stop_pthread( self_tcb );
             }
         }
     }
@@ -1215,7 +1769,7 @@ ULONG
                     **  Task being suspended is not the current task.
                     */
                     current_tcb->suspend_reason = WAIT_TSUSP;
-                    pthread_kill( current_tcb->pthrid, SIGSTOP );
+                    stop_pthread( current_tcb );
                     sched_unlock();
                 }
                 else
@@ -1225,19 +1779,19 @@ ULONG
                     **  if it doesn't have the scheduler locked.
                     */
                     sched_unlock();
-                    pthread_mutex_lock( &p2pt_sched_lock );
-                    if ( scheduler_locked == pthread_self() )
+                    lk_lock( &p2pt_sched_lock, &p2pt_sched_lkstat );
+                    if ( scheduler_locked == sched_id() )
                     {
-                        pthread_mutex_unlock( &p2pt_sched_lock );
+                        lk_unlock( &p2pt_sched_lock, &p2pt_sched_lkstat );
                     }
                     else
                     {
                         /*
                         **  Suspend the currently executing pthread
                         */
-                        pthread_mutex_unlock( &p2pt_sched_lock );
+                        lk_unlock( &p2pt_sched_lock, &p2pt_sched_lkstat );
                         self_tcb->suspend_reason = WAIT_TSUSP;
-                        pthread_kill( self_tcb->pthrid, SIGSTOP );
+                        stop_pthread( self_tcb );
                     }
                 }
             }
@@ -1285,7 +1839,7 @@ ULONG
             **  Found the task being resumed... resume it.
             */
             current_tcb->suspend_reason = WAIT_READY;
-            pthread_kill( current_tcb->pthrid, SIGCONT );
+            continue_pthread( current_tcb );
         }
         else
         {
@@ -1490,6 +2044,129 @@ ULONG
     return( error );
 }
 
+/*****************************************************************************
+** send_priority - returns the pthreads priority the specified task lends
+**                 with a message it sends to a Q_INHERIT queue... its own
+**                 priority, or any higher priority lent to it, so that a
+**                 chain of servers passes the priority of its client along.
+**                 Callers which are not tasks lend none.
+*****************************************************************************/
+int
+   send_priority( p2pthread_cb_t *tcb )
+{
+    int priority;
+
+    if ( tcb == (p2pthread_cb_t *)NULL )
+        return( 0 );
+
+    priority = (tcb->prv_priority).sched_priority;
+    if ( tcb->lent_priority > priority )
+        priority = tcb->lent_priority;
+
+    return( priority );
+}
+
+/*****************************************************************************
+** lend_priority - raises the specified task to at least the specified
+**                 pthreads priority, if it is still serving a message from
+**                 the specified Q_INHERIT queue.  The task never drops
+**                 below a priority already lent or set, and gives the lent
+**                 priority back when it next calls q_receive or q_vreceive.
+**                 Only the one task is changed... the scheduler lock is not
+**                 taken.  Tasks run by the M:N scheduler are left alone.
+*****************************************************************************/
+void
+   lend_priority( ULONG tid, void *object, int priority )
+{
+    p2pthread_cb_t *tcb;
+    struct sched_param param;
+    int sched_policy;
+
+    /*
+    **  task_list_lock keeps the task from being deleted while we change it,
+    **  and serializes lenders to the same task.
+    */
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&task_list_lock );
+    lk_lock( &task_list_lock, &task_list_lkstat );
+
+    tcb = tcb_for( tid );
+    if ( (tcb != (p2pthread_cb_t *)NULL) && (tcb->serving == object) &&
+         (tcb->mn_task == (struct mn_task *)NULL) &&
+         (priority > tcb->lent_priority) )
+    {
+        tcb->lent_priority = priority;
+
+        /*
+        **  Raise the pthread only if it is not already running higher,
+        **  for instance with the scheduler locked or at a mutex ceiling.
+        */
+        if ( (pthread_getschedparam( tcb->pthrid, &sched_policy,
+                                     &param ) == 0) &&
+             ((sched_policy == SCHED_OTHER) ||
+              (param.sched_priority < priority)) )
+        {
+            pthread_attr_getschedpolicy( &(tcb->attr), &sched_policy );
+            param.sched_priority = priority;
+            pthread_setschedparam( tcb->pthrid, sched_policy, &param );
+        }
+    }
+
+    lk_unlock( &task_list_lock, &task_list_lkstat );
+    pthread_cleanup_pop( 0 );
+}
+
+/*****************************************************************************
+** end_lent_priority - ends the service of the calling task (tcb) to the
+**                     Q_INHERIT queue it last received from, and drops any
+**                     priority lent to it by the queue's senders.  Called
+**                     with no queue lock held, since task_list_lock is
+**                     taken inside queue locks by lend_priority.
+*****************************************************************************/
+void
+   end_lent_priority( p2pthread_cb_t *tcb )
+{
+    struct sched_param param;
+    int sched_policy;
+
+    /*
+    **  Only this task sets 'serving', and a lender cannot raise the task
+    **  once both are clear, so they may be checked without the lock.
+    */
+    if ( (tcb == (p2pthread_cb_t *)NULL) ||
+         ((tcb->serving == (void *)NULL) && (tcb->lent_priority == 0)) )
+        return;
+
+    /*
+    **  task_list_lock serializes this with lend_priority, so no lender
+    **  which saw the task still serving can raise it after it is restored.
+    */
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&task_list_lock );
+    lk_lock( &task_list_lock, &task_list_lkstat );
+
+    tcb->serving = (void *)NULL;
+
+    /*
+    **  Fall back to the task's own priority, unless the task holds the
+    **  scheduler lock or a priority-protected mutex.
+    */
+    if ( (tcb->lent_priority > (tcb->prv_priority).sched_priority) &&
+         (tcb->mn_task == (struct mn_task *)NULL) &&
+         (scheduler_locked != sched_id()) )
+    {
+        pthread_attr_getschedpolicy( &(tcb->attr), &sched_policy );
+        param.sched_priority = (tcb->prv_priority).sched_priority;
+        if ( held_mutex_ceiling() > param.sched_priority )
+            param.sched_priority = held_mutex_ceiling();
+        pthread_setschedparam( tcb->pthrid, sched_policy, &param );
+    }
+    tcb->lent_priority = 0;
+
+    lk_unlock( &task_list_lock, &task_list_lkstat );
+    pthread_cleanup_pop( 0 );
+}
+
 /*****************************************************************************
 ** t_mode - sets the value of the calling task's mode flags
 *****************************************************************************/
@@ -1505,7 +2182,7 @@ ULONG
 
     pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                           (void *)&task_list_lock );
-    pthread_mutex_lock( &task_list_lock );
+    lk_lock( &task_list_lock, &task_list_lkstat );
 
     tcb = my_tcb();
     if ( tcb != (p2pthread_cb_t *)NULL )
@@ -1521,7 +2198,7 @@ ULONG
         **  to either allow the task to be preempted or to prevent
         **  preemption.
         */
-        pthread_mutex_unlock( &task_list_lock );
+        lk_unlock( &task_list_lock, &task_list_lkstat );
 		/*
 		**  Note: modified from (mask & T_NOPREEMPT).
 		*/
@@ -1542,7 +2219,7 @@ ULONG
         /*
         **  Determine whether round-robin time-slicing is to be used or not
         */
-        pthread_mutex_lock( &task_list_lock );
+        lk_lock( &task_list_lock, &task_list_lkstat );
 		/*
 		**  Note: modified from (mask & T_TSLICE).
 		*/
@@ -1554,8 +2231,9 @@ ULONG
                 sched_policy = SCHED_FIFO;
             pthread_attr_setschedpolicy( &(tcb->attr), sched_policy );
             pthread_attr_getschedparam( &(tcb->attr), &param );
-            pthread_setschedparam( tcb->pthrid, sched_policy,
-                          &param );
+            if ( tcb->mn_task == (struct mn_task *)NULL )
+                pthread_setschedparam( tcb->pthrid, sched_policy,
+                                       &param );
         }
 
         /*
@@ -1568,7 +2246,7 @@ ULONG
     else
         error = ERR_OBJDEL;
 
-    pthread_mutex_unlock( &task_list_lock );
+    lk_unlock( &task_list_lock, &task_list_lkstat );
     pthread_cleanup_pop( 0 );
 
     return( error );
@@ -1634,6 +2312,370 @@ ULONG
     return( error );
 }
 
+/*****************************************************************************
+** stat_clock - returns the monotonic time in nanoseconds
+*****************************************************************************/
+static unsigned long long
+   stat_clock( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return( (unsigned long long)now.tv_sec * 1000000000ULL +
+            (unsigned long long)now.tv_nsec );
+}
+
+/*****************************************************************************
+** stat_block - starts timing a wait of the specified task (normally the
+**              caller) which is about to block for the specified WAIT_
+**              reason.  Called each time around a waiting loop, but only
+**              the first call of a wait counts.
+*****************************************************************************/
+void
+   stat_block( p2pthread_cb_t *tcb, int reason )
+{
+    if ( (tcb != (p2pthread_cb_t *)NULL) && (tcb->blocked_at == 0) )
+    {
+        tcb->woken_at = 0;
+        tcb->stats.wait_reason = reason;
+        tcb->blocked_at = stat_clock();
+    }
+}
+
+/*****************************************************************************
+** stat_delay - starts timing a delay of the calling task, which is due to
+**              wake 'usec' microseconds from now
+*****************************************************************************/
+void
+   stat_delay( p2pthread_cb_t *tcb, ULONG usec )
+{
+    stat_block( tcb, WAIT_DELAY );
+    if ( tcb != (p2pthread_cb_t *)NULL )
+        tcb->woken_at = tcb->blocked_at + (unsigned long long)usec * 1000ULL;
+}
+
+/*****************************************************************************
+** stat_wake - notes the time a blocked task was made ready by the caller,
+**             unless another task made it ready first
+*****************************************************************************/
+void
+   stat_wake( p2pthread_cb_t *tcb )
+{
+    if ( (tcb != (p2pthread_cb_t *)NULL) && (tcb->blocked_at != 0) &&
+         (tcb->woken_at == 0) )
+        tcb->woken_at = stat_clock();
+}
+
+/*****************************************************************************
+** stat_wake_all - notes the time every task in the specified 'pended task
+**                 list' was made ready by the caller
+*****************************************************************************/
+void
+   stat_wake_all( p2pthread_cb_t *list_head )
+{
+    p2pthread_cb_t *current_tcb;
+
+    for ( current_tcb = list_head; current_tcb != (p2pthread_cb_t *)NULL;
+          current_tcb = current_tcb->nxt_susp )
+        stat_wake( current_tcb );
+}
+
+/*****************************************************************************
+** stat_unblock - ends the timing of a wait of the calling task, adding the
+**                time blocked to the total for its reason and, unless the
+**                wait timed out, the wakeup latency to the histogram.
+*****************************************************************************/
+void
+   stat_unblock( p2pthread_cb_t *tcb, int timedout )
+{
+    unsigned long long now, latency;
+    int reason, bucket;
+
+    if ( (tcb == (p2pthread_cb_t *)NULL) || (tcb->blocked_at == 0) )
+        return;
+
+    now = stat_clock();
+    reason = tcb->stats.wait_reason;
+    tcb->stats.blocks[reason]++;
+    tcb->stats.blocked_ns[reason] += now - tcb->blocked_at;
+
+    if ( !timedout && (tcb->woken_at != 0) && (now >= tcb->woken_at) )
+    {
+        latency = now - tcb->woken_at;
+        bucket = 0;
+        if ( latency >= 1000ULL )
+            bucket = 64 - __builtin_clzll( latency / 1000ULL );
+        if ( bucket >= T_WAKE_BUCKETS )
+            bucket = T_WAKE_BUCKETS - 1;
+        tcb->stats.wake_latency[bucket]++;
+        if ( latency > tcb->stats.max_wake_ns )
+            tcb->stats.max_wake_ns = latency;
+    }
+
+    tcb->stats.wait_reason = WAIT_READY;
+    tcb->blocked_at = 0;
+}
+
+/*****************************************************************************
+** read_proc_file - reads a file under /proc/self/task/<ktid> into 'buf'.
+**                  Returns the number of bytes read, or 0.
+*****************************************************************************/
+static int
+   read_proc_file( pid_t ktid, const char *name, char *buf, int size )
+{
+    char path[64];
+    int fd, count;
+
+    snprintf( path, sizeof( path ), "/proc/self/task/%d/%s", (int)ktid, name );
+    if ( (fd = open( path, O_RDONLY )) < 0 )
+        return( 0 );
+    count = (int)read( fd, buf, size - 1 );
+    close( fd );
+    if ( count < 0 )
+        count = 0;
+    buf[count] = '\0';
+    return( count );
+}
+
+/*****************************************************************************
+** read_kernel_stats - fills in the CPU time, context switch and page fault
+**                     counts of a task from its kernel thread, whose CPU
+**                     clock was taken with the task list locked.  Returns
+**                     FALSE, leaving them zero, if the thread has gone.
+*****************************************************************************/
+static int
+   read_kernel_stats( pid_t ktid, clockid_t clock, t_stat_t *stats )
+{
+    struct timespec cpu;
+    char buf[4096];
+    char *field;
+
+    if ( ktid == 0 )
+        return( TRUE );
+
+    /*
+    **  The clock stops working once the thread has exited, after which its
+    **  kernel thread ID may name some other thread in /proc.
+    */
+    if ( clock_gettime( clock, &cpu ) != 0 )
+        return( FALSE );
+    stats->cpu_ns = (unsigned long long)cpu.tv_sec * 1000000000ULL +
+                    (unsigned long long)cpu.tv_nsec;
+
+    /*
+    **  Page faults are the 10th and 12th fields of the stat file.  The
+    **  command name (2nd field) may contain spaces, so count from the
+    **  parenthesis which ends it.
+    */
+    if ( (read_proc_file( ktid, "stat", buf, sizeof( buf ) ) > 0) &&
+         ((field = strrchr( buf, ')' )) != (char *)NULL) )
+        sscanf( field + 1, " %*c %*d %*d %*d %*d %*d %*u %lu %*u %lu",
+                &(stats->minor_faults), &(stats->major_faults) );
+
+    if ( read_proc_file( ktid, "status", buf, sizeof( buf ) ) > 0 )
+    {
+        if ( (field = strstr( buf, "\nvoluntary_ctxt_switches:" )) !=
+             (char *)NULL )
+            sscanf( field, "\nvoluntary_ctxt_switches: %lu",
+                    &(stats->vol_switches) );
+        if ( (field = strstr( buf, "\nnonvoluntary_ctxt_switches:" )) !=
+             (char *)NULL )
+            sscanf( field, "\nnonvoluntary_ctxt_switches: %lu",
+                    &(stats->invol_switches) );
+    }
+
+    /*
+    **  Discard what was read if the thread exited meanwhile.
+    */
+    if ( clock_gettime( clock, &cpu ) != 0 )
+    {
+        stats->cpu_ns = 0;
+        stats->vol_switches = 0;
+        stats->invol_switches = 0;
+        stats->minor_faults = 0;
+        stats->major_faults = 0;
+        return( FALSE );
+    }
+
+    return( TRUE );
+}
+
+/*****************************************************************************
+** copy_task_stats - copies the statistics kept by a task into 'stats' and
+**                   returns the kernel thread ID from which the rest are
+**                   to be read, with the CPU clock of its pthread in
+**                   'clock', or zero if there is no thread to read.  The
+**                   caller must hold the task_list_lock.
+*****************************************************************************/
+static pid_t
+   copy_task_stats( p2pthread_cb_t *tcb, t_stat_t *stats, clockid_t *clock )
+{
+    int i;
+
+    *stats = tcb->stats;
+    stats->taskid = tcb->taskid;
+    for ( i = 0; i < 4; i++ )
+        stats->taskname[i] = tcb->taskname[i];
+    if ( stats->wait_reason == WAIT_READY )
+        stats->wait_reason = tcb->suspend_reason;
+    stats->cpu_ns = 0;
+    stats->vol_switches = 0;
+    stats->invol_switches = 0;
+    stats->minor_faults = 0;
+    stats->major_faults = 0;
+
+    /*
+    **  The pthread ID is only valid while the task list holds the task.
+    */
+    if ( (tcb->ktid == 0) ||
+         (pthread_getcpuclockid( tcb->pthrid, clock ) != 0) )
+        return( 0 );
+
+    return( tcb->ktid );
+}
+
+/*****************************************************************************
+** t_stats - fills in the scheduling and latency statistics of the specified
+**           task (or of the calling task if tid is zero)
+*****************************************************************************/
+ULONG
+   t_stats( ULONG tid, t_stat_t *stats )
+{
+    p2pthread_cb_t *tcb;
+    clockid_t clock;
+    pid_t ktid;
+    ULONG error;
+
+    error = ERR_NO_ERROR;
+    ktid = 0;
+
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&task_list_lock );
+    lk_lock( &task_list_lock, &task_list_lkstat );
+
+    if ( tid == 0 )
+        tcb = my_tcb();
+    else
+        tcb = tcb_for( tid );
+    if ( tcb != (p2pthread_cb_t *)NULL )
+        ktid = copy_task_stats( tcb, stats, &clock );
+    else
+        error = ERR_OBJDEL;
+
+    lk_unlock( &task_list_lock, &task_list_lkstat );
+    pthread_cleanup_pop( 0 );
+
+    if ( (error == ERR_NO_ERROR) && !read_kernel_stats( ktid, clock, stats ) )
+        error = ERR_OBJDEL;
+
+    return( error );
+}
+
+/*****************************************************************************
+** t_stats_all - fills in the statistics of up to 'max_tasks' tasks, in task
+**               list order, as a snapshot taken with the task list locked.
+**               Tasks deleted before their kernel counters are read are
+**               left out.  Returns the number of entries filled in.
+*****************************************************************************/
+ULONG
+   t_stats_all( t_stat_t stats[], ULONG max_tasks )
+{
+    p2pthread_cb_t *tcb;
+    clockid_t *clocks;
+    pid_t *ktids;
+    ULONG count, kept, i;
+
+    if ( (ktids = (pid_t *)malloc( (max_tasks + 1) * sizeof( pid_t ) )) ==
+         (pid_t *)NULL )
+        return( 0L );
+    if ( (clocks = (clockid_t *)malloc( (max_tasks + 1) *
+                                        sizeof( clockid_t ) )) ==
+         (clockid_t *)NULL )
+    {
+        free( (void *)ktids );
+        return( 0L );
+    }
+
+    count = 0;
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&task_list_lock );
+    lk_lock( &task_list_lock, &task_list_lkstat );
+
+    for ( tcb = task_list;
+          (tcb != (p2pthread_cb_t *)NULL) && (count < max_tasks);
+          tcb = tcb->nxt_task )
+    {
+        ktids[count] = copy_task_stats( tcb, &(stats[count]),
+                                        &(clocks[count]) );
+        count++;
+    }
+
+    lk_unlock( &task_list_lock, &task_list_lkstat );
+    pthread_cleanup_pop( 0 );
+
+    /*
+    **  The kernel's counters are read after the task list is unlocked,
+    **  since reading them takes several system calls per task.
+    */
+    kept = 0;
+    for ( i = 0; i < count; i++ )
+    {
+        if ( !read_kernel_stats( ktids[i], clocks[i], &(stats[i]) ) )
+            continue;
+        if ( kept != i )
+            stats[kept] = stats[i];
+        kept++;
+    }
+    free( (void *)clocks );
+    free( (void *)ktids );
+
+    return( kept );
+}
+
+/*****************************************************************************
+** publish_tasks - fills in stats page entries for up to 'max_rows' tasks.
+**                 Returns the number of tasks, which may exceed 'max_rows'.
+*****************************************************************************/
+ULONG
+   publish_tasks( sp_object_t rows[], ULONG max_rows )
+{
+    p2pthread_cb_t *tcb;
+    sp_object_t *row;
+    ULONG count;
+    int i;
+
+    count = 0;
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&task_list_lock );
+    lk_lock( &task_list_lock, &task_list_lkstat );
+
+    for ( tcb = task_list; tcb != (p2pthread_cb_t *)NULL;
+          tcb = tcb->nxt_task, count++ )
+    {
+        if ( count >= max_rows )
+            continue;
+        row = &(rows[count]);
+        memset( (void *)row, 0, sizeof( *row ) );
+        row->obj_class = SP_TASK;
+        row->objid = tcb->taskid;
+        for ( i = 0; i < 4; i++ )
+            row->objname[i] = tcb->taskname[i];
+        row->state = tcb->stats.wait_reason;
+        if ( row->state == WAIT_READY )
+            row->state = tcb->suspend_reason;
+        row->priority = (ULONG)(tcb->prv_priority).sched_priority;
+        for ( i = 0; i < WAIT_NREASONS; i++ )
+            row->puts += tcb->stats.blocks[i];
+        for ( i = 0; i < T_WAKE_BUCKETS; i++ )
+            row->gets += tcb->stats.wake_latency[i];
+    }
+
+    lk_unlock( &task_list_lock, &task_list_lkstat );
+    pthread_cleanup_pop( 0 );
+
+    return( count );
+}
+
 /*****************************************************************************
 **  system initialization pthread
 *****************************************************************************/
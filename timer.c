@@ -26,6 +26,18 @@ extern void
    sched_unlock( void );
 extern p2pthread_cb_t *
    my_tcb( void );
+extern int
+   sim_delay( ULONG interval );
+extern int
+   sim_yield( int favoured );
+extern int
+   mn_delay( ULONG interval );
+extern int
+   mn_yield( int favoured );
+extern void
+   stat_delay( p2pthread_cb_t *tcb, ULONG usec );
+extern void
+   stat_unblock( p2pthread_cb_t *tcb, int timedout );
 
 /*****************************************************************************
 ** tm_wkafter - suspends the calling task for the specified number of ticks.
@@ -46,8 +58,38 @@ ULONG
     **  Note: delay of zero means yield CPU to other tasks of same 
     **  priority.
     */
+    if ( sim_mode )
+    {
+        /*
+        **  In simulation mode the delay is in virtual time, and a delay of
+        **  zero lets other ready tasks of the same priority run first.
+        */
+        if ( (usec > 0L) ? sim_delay( interval ) : sim_yield( FALSE ) )
+            return( (ULONG)0 );
+    }
+    else if ( mn_mode )
+    {
+        /*
+        **  A task run by the M:N scheduler gives up its worker pthread to
+        **  other tasks for the delay instead of sleeping in it.
+        */
+        if ( usec > 0L )
+            stat_delay( my_tcb(), usec );
+        if ( (usec > 0L) ? mn_delay( interval ) : mn_yield( FALSE ) )
+        {
+            stat_unblock( my_tcb(), FALSE );
+            return( (ULONG)0 );
+        }
+    }
+
     if ( usec > 0L )
     {
+        /*
+        **  Time the delay for the task statistics, taking any lateness in
+        **  waking up after the delay expires as its wakeup latency.
+        */
+        stat_delay( my_tcb(), usec );
+
         /*
         **  Establish absolute time at expiration of delay interval
         */
@@ -93,6 +135,7 @@ ULONG
                     usec += (((timeout.tv_sec - 1) - now.tv_sec) * 1000000);
             }
         }
+        stat_unblock( my_tcb(), FALSE );
     }
     else
         /*
@@ -0,0 +1,428 @@
+/*****************************************************************************
+ * trace.c - defines the event trace used to follow p2pthread API operations
+ *           at run time, and its export in Chrome / Perfetto trace format.
+ ****************************************************************************/
+
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include "p2pthread.h"
+
+#undef DIAG_PRINTFS
+
+/*
+**  Each thread records events in a ring of its own holding the last
+**  TRACE_RING_SIZE of them.  The rings of threads which have exited are kept
+**  for export until TRACE_MAX_RINGS rings exist, and are then reused.
+*/
+#define TRACE_RING_SIZE  8192
+#define TRACE_MAX_RINGS  256
+
+/*****************************************************************************
+**  One trace event
+*****************************************************************************/
+typedef struct tr_entry
+{
+    unsigned long long
+        stamp;           /* Time of event in trace_clock() units */
+    ULONG
+        objid;           /* ID of object operated on */
+    ULONG
+        arg;             /* Operation-specific value */
+    UINT
+        op;              /* Object class and operation */
+} tr_entry_t;
+
+/*****************************************************************************
+**  Ring of trace events written by one thread
+*****************************************************************************/
+typedef struct tr_ring
+{
+        /*
+        ** Number of events ever recorded in the ring... written only by
+        ** the owning thread, after the event itself
+        */
+    volatile ULONG
+        head;
+
+        /*
+        ** Value of head when tracing was last started... older events
+        ** are not exported
+        */
+    volatile ULONG
+        first;
+
+        /*
+        ** Kernel thread ID and name of the owning thread
+        */
+    pid_t
+        tid;
+    char
+        name[16];
+
+        /*
+        ** Nonzero once the owning thread has exited
+        */
+    volatile int
+        retired;
+
+        /*
+        ** Next ring in ring_list
+        */
+    struct tr_ring *
+        nxt_ring;
+
+    tr_entry_t
+        entries[TRACE_RING_SIZE];
+} tr_ring_t;
+
+/*****************************************************************************
+** External function and data references
+*****************************************************************************/
+extern p2pthread_cb_t *
+   my_tcb( void );
+extern pid_t
+   my_kernel_tid( void );
+
+/*****************************************************************************
+**  p2pthread Global Data Structures
+*****************************************************************************/
+
+/*
+**  trace_enabled is tested by the TRACE macro before recording each event
+*/
+volatile int
+    trace_enabled = 0;
+
+/*
+**  my_ring is the calling thread's trace ring, or NULL until it records
+**          its first event
+*/
+static __thread tr_ring_t *
+    my_ring;
+
+/*
+**  ring_list is a linked list of all trace rings, and ring_count the number
+**            of rings on it.  ring_lock serializes access to them.
+*/
+static tr_ring_t *
+    ring_list;
+static int
+    ring_count;
+static pthread_mutex_t
+    ring_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+**  ring_key has a destructor which marks an exiting thread's ring retired.
+**           ring_once initializes it.
+*/
+static pthread_key_t
+    ring_key;
+static pthread_once_t
+    ring_once = PTHREAD_ONCE_INIT;
+
+/*
+**  start_stamp and start_nsec are trace_clock() and CLOCK_MONOTONIC when
+**              tracing was last started, for converting stamps to time.
+*/
+static unsigned long long
+    start_stamp;
+static unsigned long long
+    start_nsec;
+
+/*
+**  trace_class_names and op_names are used to name events in exported
+**                    traces.  Lock profiles use trace_class_names as well.
+*/
+const char *
+    trace_class_names[TR_NCLASSES] =
+    {
+        "p2pthread", "task", "queue", "vqueue", "sema4", "event", "evgroup",
+        "partition", "region", "mutex", "condvar"
+    };
+static const char *
+    op_names[] =
+    {
+        "", "create", "delete", "send", "receive", "block", "wake",
+        "timeout", "sched_lock", "sched_unlock"
+    };
+
+
+/*****************************************************************************
+** trace_clock - returns a timestamp which is cheap to read... the processor
+**               cycle counter where there is one, otherwise nanoseconds
+*****************************************************************************/
+static __inline__ unsigned long long
+   trace_clock( void )
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int lo, hi;
+
+    __asm__ __volatile__( "rdtsc" : "=a" (lo), "=d" (hi) );
+    return( ((unsigned long long)hi << 32) | lo );
+#else
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return( (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec );
+#endif
+}
+
+/*****************************************************************************
+** monotonic_nsec - returns CLOCK_MONOTONIC in nanoseconds
+*****************************************************************************/
+static unsigned long long
+   monotonic_nsec( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return( (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec );
+}
+
+/*****************************************************************************
+** retire_ring - marks an exiting thread's ring as available for reuse once
+**               enough rings exist.  Called as the destructor of ring_key.
+*****************************************************************************/
+static void
+   retire_ring( void *ringp )
+{
+    ((tr_ring_t *)ringp)->retired = TRUE;
+}
+
+/*****************************************************************************
+** init_rings - initializes the ring key
+*****************************************************************************/
+static void
+   init_rings( void )
+{
+    pthread_key_create( &ring_key, retire_ring );
+}
+
+/*****************************************************************************
+** new_ring - gives the calling thread a trace ring, reusing the ring of an
+**            exited thread if TRACE_MAX_RINGS already exist
+*****************************************************************************/
+static tr_ring_t *
+   new_ring( void )
+{
+    p2pthread_cb_t *tcb;
+    tr_ring_t *ring;
+
+    pthread_once( &ring_once, init_rings );
+
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&ring_lock );
+    pthread_mutex_lock( &ring_lock );
+
+    ring = (tr_ring_t *)NULL;
+    if ( ring_count >= TRACE_MAX_RINGS )
+    {
+        for ( ring = ring_list; ring != (tr_ring_t *)NULL;
+              ring = ring->nxt_ring )
+        {
+            if ( ring->retired )
+                break;
+        }
+    }
+    if ( ring == (tr_ring_t *)NULL )
+    {
+        ring = (tr_ring_t *)malloc( sizeof( tr_ring_t ) );
+        if ( ring != (tr_ring_t *)NULL )
+        {
+            ring->nxt_ring = ring_list;
+            ring_list = ring;
+            ring_count++;
+        }
+    }
+    if ( ring != (tr_ring_t *)NULL )
+    {
+        ring->head = 0;
+        ring->first = 0;
+        ring->retired = FALSE;
+        ring->tid = my_kernel_tid();
+        tcb = my_tcb();
+        if ( tcb != (p2pthread_cb_t *)NULL )
+            sprintf( ring->name, "%.4s", tcb->taskname );
+        else
+            sprintf( ring->name, "thread %d", (int)ring->tid );
+    }
+
+    pthread_mutex_unlock( &ring_lock );
+    pthread_cleanup_pop( 0 );
+
+    if ( ring != (tr_ring_t *)NULL )
+        pthread_setspecific( ring_key, (void *)ring );
+    return( ring );
+}
+
+/*****************************************************************************
+** trace_event - records one event in the calling thread's ring.  Called
+**               through the TRACE macro only while tracing is enabled.
+*****************************************************************************/
+void
+   trace_event( UINT op, ULONG objid, ULONG arg )
+{
+    tr_ring_t *ring;
+    tr_entry_t *entry;
+    ULONG head;
+
+    if ( (ring = my_ring) == (tr_ring_t *)NULL )
+    {
+        if ( (ring = new_ring()) == (tr_ring_t *)NULL )
+            return;
+        my_ring = ring;
+    }
+
+    head = ring->head;
+    entry = &(ring->entries[head % TRACE_RING_SIZE]);
+    entry->stamp = trace_clock();
+    entry->objid = objid;
+    entry->arg = arg;
+    entry->op = op;
+
+    /*
+    **  Publish the event only after it is complete, for tr_dump().
+    */
+    __atomic_store_n( &(ring->head), head + 1, __ATOMIC_RELEASE );
+}
+
+/*****************************************************************************
+** tr_start - discards all events recorded so far and starts tracing
+*****************************************************************************/
+void
+   tr_start( void )
+{
+    tr_ring_t *ring;
+
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&ring_lock );
+    pthread_mutex_lock( &ring_lock );
+
+    for ( ring = ring_list; ring != (tr_ring_t *)NULL; ring = ring->nxt_ring )
+        ring->first = ring->head;
+    start_nsec = monotonic_nsec();
+    start_stamp = trace_clock();
+    trace_enabled = TRUE;
+
+    pthread_mutex_unlock( &ring_lock );
+    pthread_cleanup_pop( 0 );
+}
+
+/*****************************************************************************
+** tr_stop - stops tracing, keeping the events recorded for tr_dump()
+*****************************************************************************/
+void
+   tr_stop( void )
+{
+    trace_enabled = FALSE;
+}
+
+/*****************************************************************************
+** tr_dump - writes the events recorded since tracing was last started to
+**           the specified file as Chrome / Perfetto trace JSON.  Waits
+**           appear as slices from block to wake or timeout, and all other
+**           events as instants.  Returns 0, or an errno value if the file
+**           cannot be written.
+*****************************************************************************/
+ULONG
+   tr_dump( const char *filename )
+{
+    tr_ring_t *ring;
+    tr_entry_t entry;
+    FILE *file;
+    unsigned long long end_stamp, end_nsec;
+    double usec_per_tick, usec;
+    ULONG head, i;
+    UINT class, op;
+    ULONG error;
+
+    if ( (file = fopen( filename, "w" )) == (FILE *)NULL )
+        return( (ULONG)errno );
+
+    /*
+    **  Scale stamps to microseconds from the start of tracing by comparing
+    **  the elapsed trace_clock() with the elapsed CLOCK_MONOTONIC.
+    */
+    end_nsec = monotonic_nsec();
+    end_stamp = trace_clock();
+    if ( end_stamp > start_stamp )
+        usec_per_tick = (double)(end_nsec - start_nsec) / 1000.0 /
+                        (double)(end_stamp - start_stamp);
+    else
+        usec_per_tick = 0.001;
+
+    fprintf( file, "{\"traceEvents\":[\n" );
+    fprintf( file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+             "\"args\":{\"name\":\"p2linux\"}}", (int)getpid() );
+
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&ring_lock );
+    pthread_mutex_lock( &ring_lock );
+
+    for ( ring = ring_list; ring != (tr_ring_t *)NULL; ring = ring->nxt_ring )
+    {
+        head = __atomic_load_n( &(ring->head), __ATOMIC_ACQUIRE );
+        i = ring->first;
+        if ( head - i > TRACE_RING_SIZE )
+            i = head - TRACE_RING_SIZE;
+        if ( i == head )
+            continue;
+
+        fprintf( file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+                 "\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                 (int)getpid(), (int)ring->tid, ring->name );
+
+        for ( ; i != head; i++ )
+        {
+            entry = ring->entries[i % TRACE_RING_SIZE];
+
+            /*
+            **  Skip the event if the owning thread, still tracing, may have
+            **  overwritten it while we copied it.
+            */
+            if ( __atomic_load_n( &(ring->head), __ATOMIC_ACQUIRE ) - i >=
+                 TRACE_RING_SIZE )
+                continue;
+
+            class = (entry.op >> 8) & 0xff;
+            op = entry.op & 0xff;
+            if ( (class >= TR_NCLASSES) ||
+                 (op >= sizeof( op_names ) / sizeof( char * )) )
+                continue;
+
+            usec = (double)(long long)(entry.stamp - start_stamp) *
+                   usec_per_tick;
+            fprintf( file, ",\n{\"pid\":%d,\"tid\":%d,\"ts\":%.3f,"
+                     "\"cat\":\"%s\",", (int)getpid(), (int)ring->tid, usec,
+                     trace_class_names[class] );
+            if ( op == TR_BLOCK )
+                fprintf( file, "\"name\":\"%s wait\",\"ph\":\"B\",",
+                         trace_class_names[class] );
+            else if ( (op == TR_WAKE) || (op == TR_TIMEOUT) )
+                fprintf( file, "\"name\":\"%s wait\",\"ph\":\"E\",",
+                         trace_class_names[class] );
+            else
+                fprintf( file, "\"name\":\"%s %s\",\"ph\":\"i\",\"s\":\"t\",",
+                         trace_class_names[class], op_names[op] );
+            fprintf( file, "\"args\":{\"op\":\"%s\",\"id\":\"0x%lx\","
+                     "\"arg\":%lu}}", op_names[op], entry.objid, entry.arg );
+        }
+    }
+
+    pthread_mutex_unlock( &ring_lock );
+    pthread_cleanup_pop( 0 );
+
+    fprintf( file, "\n],\"displayTimeUnit\":\"ns\"}\n" );
+
+    error = ERR_NO_ERROR;
+    if ( ferror( file ) )
+        error = (ULONG)EIO;
+    if ( fclose( file ) != 0 )
+        error = (ULONG)errno;
+    return( error );
+}
@@ -0,0 +1,565 @@
+/*****************************************************************************
+ * tsmalloc.c - defines the thread-safe memory allocator used for the control
+ *              blocks, extents and parameter blocks of p2pthread objects,
+ *              and offered to applications as ts_malloc() and ts_free().
+ ****************************************************************************/
+
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "p2pthread.h"
+
+#undef DIAG_PRINTFS
+
+/*
+**  Blocks of up to TS_MAX_SMALL bytes are carved from slabs of TS_SLAB_SIZE
+**  bytes, in the size classes below.  Larger blocks come straight from
+**  malloc().  Each thread caches up to 2 * TS_CACHE_BATCH free blocks of each
+**  size class, moving TS_CACHE_BATCH at a time to or from the class free list.
+*/
+#define TS_NCLASSES     14
+#define TS_MAX_SMALL    2048
+#define TS_SLAB_SIZE    (64 * 1024)
+#define TS_CACHE_BATCH  16
+
+/*
+**  Size class number kept in the header of blocks from malloc()
+*/
+#define TS_LARGE        TS_NCLASSES
+
+#define TS_MAGIC        0x7453626cU
+
+/*****************************************************************************
+**  Header preceding each block handed out.  Its size keeps the caller's
+**  block aligned as malloc() would.
+*****************************************************************************/
+typedef struct ts_header
+{
+    unsigned int
+        size_class;      /* Size class of block, or TS_LARGE */
+    unsigned int
+        magic;           /* TS_MAGIC while allocated */
+    size_t
+        blksize;         /* Size requested for a TS_LARGE block */
+} ts_header_t;
+
+/*****************************************************************************
+**  Allocation statistics for one size class, as returned by ts_mstats()
+*****************************************************************************/
+typedef struct ts_mstat
+{
+    ULONG
+        blk_size;        /* Block size of class (0 for blocks from malloc) */
+    ULONG
+        slab_bytes;      /* Bytes of slab memory carved for class */
+    ULONG
+        allocs;          /* Total blocks allocated */
+    ULONG
+        frees;           /* Total blocks freed */
+    ULONG
+        in_use;          /* Blocks currently allocated */
+} ts_mstat_t;
+
+/*****************************************************************************
+**  Free list and statistics for one size class
+*****************************************************************************/
+typedef struct ts_class
+{
+        /*
+        ** Mutex for free list and slab carving
+        */
+    pthread_mutex_t
+        class_lock;
+    lk_stat_t
+        class_lkstat;    /* Contention statistics for class_lock */
+
+        /*
+        ** Free blocks not cached by any thread, linked through their
+        ** first word
+        */
+    void *
+        free_list;
+
+        /*
+        ** Total bytes of slab memory carved for the class
+        */
+    ULONG
+        slab_bytes;
+
+        /*
+        ** Allocations and frees made by threads which have exited
+        */
+    ULONG
+        retired_allocs;
+    ULONG
+        retired_frees;
+} ts_class_t;
+
+/*****************************************************************************
+**  Per-thread cache of free blocks, with the thread's allocation counts
+*****************************************************************************/
+typedef struct ts_cache
+{
+    ULONG
+        count[TS_NCLASSES + 1];
+    void *
+        blocks[TS_NCLASSES][2 * TS_CACHE_BATCH];
+    ULONG
+        allocs[TS_NCLASSES + 1];
+    ULONG
+        frees[TS_NCLASSES + 1];
+    int
+        registered;      /* Nonzero once linked into cache_registry */
+    struct ts_cache *
+        nxt_cache;
+    struct ts_cache *
+        prv_cache;
+} ts_cache_t;
+
+/*****************************************************************************
+**  p2pthread Global Data Structures
+*****************************************************************************/
+
+/*
+**  class_sizes holds the block size of each size class
+*/
+static const size_t
+    class_sizes[TS_NCLASSES] =
+    {
+        16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048
+    };
+
+/*
+**  size_classes holds the free list and statistics of each size class.
+**               TS_LARGE statistics are kept in the last entry.
+*/
+static ts_class_t
+    size_classes[TS_NCLASSES + 1];
+
+/*
+**  ts_cache is the calling thread's cache of free blocks
+*/
+static __thread ts_cache_t
+    ts_cache;
+
+/*
+**  cache_registry is a linked list of the caches of all running threads
+**                 which have used the allocator, so statistics can be
+**                 gathered.  registry_lock serializes access to it.
+*/
+static ts_cache_t *
+    cache_registry;
+static pthread_mutex_t
+    registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static lk_stat_t
+    registry_lkstat = LK_STAT_INITIALIZER( 0, "registry_lock" );
+
+/*
+**  ts_cache_key has a destructor which returns an exiting thread's cached
+**               blocks to their size classes.  ts_once initializes it and the
+**               size classes.
+*/
+static pthread_key_t
+    ts_cache_key;
+static pthread_once_t
+    ts_once = PTHREAD_ONCE_INIT;
+
+
+/*****************************************************************************
+** class_for - returns the smallest size class holding blocks of 'blksize'
+**             bytes, or TS_LARGE if none does
+*****************************************************************************/
+static unsigned int
+   class_for( size_t blksize )
+{
+    unsigned int size_class;
+
+    if ( blksize > TS_MAX_SMALL )
+        return( TS_LARGE );
+    for ( size_class = 0; class_sizes[size_class] < blksize; size_class++ );
+    return( size_class );
+}
+
+/*****************************************************************************
+** flush_class - returns the 'count' oldest blocks of one size class from a
+**               thread cache to the class free list, under one acquisition
+**               of the class lock
+*****************************************************************************/
+static void
+   flush_class( ts_cache_t *cache, unsigned int size_class, ULONG count )
+{
+    ts_class_t *tsclass;
+    void **blocks;
+    ULONG i;
+
+    tsclass = &size_classes[size_class];
+    blocks = cache->blocks[size_class];
+
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&(tsclass->class_lock) );
+    lk_lock( &(tsclass->class_lock), &(tsclass->class_lkstat) );
+
+    for ( i = 0; i < count; i++ )
+    {
+        *(void **)blocks[i] = tsclass->free_list;
+        tsclass->free_list = blocks[i];
+    }
+
+    lk_unlock( &(tsclass->class_lock), &(tsclass->class_lkstat) );
+    pthread_cleanup_pop( 0 );
+
+    /*
+    **  Slide the remaining (most recently freed) blocks down.
+    */
+    for ( i = count; i < cache->count[size_class]; i++ )
+        blocks[i - count] = blocks[i];
+    cache->count[size_class] -= count;
+}
+
+/*****************************************************************************
+** carve_slab - carves a new slab into blocks of one size class and puts them
+**              all on the class free list.  Every page of the slab is
+**              written in the process, since no block spans a whole page.
+**              Called with the class lock held.  Returns the number of
+**              blocks carved (zero if out of memory).
+*****************************************************************************/
+static ULONG
+   carve_slab( unsigned int size_class )
+{
+    ts_class_t *tsclass;
+    char *slab;
+    char *block;
+    size_t stride;
+    ULONG i;
+
+    tsclass = &size_classes[size_class];
+    stride = sizeof( ts_header_t ) + class_sizes[size_class];
+
+    if ( (slab = (char *)malloc( TS_SLAB_SIZE )) == (char *)NULL )
+        return( 0L );
+
+    for ( i = TS_SLAB_SIZE / stride; i-- > 0; )
+    {
+        block = slab + i * stride;
+        *(void **)(block + sizeof( ts_header_t )) = tsclass->free_list;
+        tsclass->free_list = (void *)(block + sizeof( ts_header_t ));
+        ((ts_header_t *)block)->size_class = size_class;
+        ((ts_header_t *)block)->magic = 0;
+    }
+    tsclass->slab_bytes += TS_SLAB_SIZE;
+#ifdef DIAG_PRINTFS
+    printf( "\r\nnew slab @ %p for %ld-byte blocks", slab,
+            (ULONG)class_sizes[size_class] );
+#endif
+
+    return( (ULONG)(TS_SLAB_SIZE / stride) );
+}
+
+/*****************************************************************************
+** refill_class - moves a batch of free blocks of one size class into an
+**                empty thread cache, carving a new slab if the class free
+**                list runs out.  Returns the number of blocks moved.
+*****************************************************************************/
+static ULONG
+   refill_class( ts_cache_t *cache, unsigned int size_class )
+{
+    ts_class_t *tsclass;
+    ULONG count;
+
+    tsclass = &size_classes[size_class];
+    count = 0;
+
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&(tsclass->class_lock) );
+    lk_lock( &(tsclass->class_lock), &(tsclass->class_lkstat) );
+
+    if ( tsclass->free_list == (void *)NULL )
+        carve_slab( size_class );
+
+    while ( (count < TS_CACHE_BATCH) && (tsclass->free_list != (void *)NULL) )
+    {
+        cache->blocks[size_class][count++] = tsclass->free_list;
+        tsclass->free_list = *(void **)tsclass->free_list;
+    }
+
+    lk_unlock( &(tsclass->class_lock), &(tsclass->class_lkstat) );
+    pthread_cleanup_pop( 0 );
+
+    cache->count[size_class] = count;
+    return( count );
+}
+
+/*****************************************************************************
+** retire_cache - returns all blocks in an exiting thread's cache to their
+**                size classes, and folds its statistics into the totals.
+**                Called as the destructor of ts_cache_key.
+*****************************************************************************/
+static void
+   retire_cache( void *cachep )
+{
+    ts_cache_t *cache;
+    unsigned int size_class;
+
+    cache = (ts_cache_t *)cachep;
+    for ( size_class = 0; size_class < TS_NCLASSES; size_class++ )
+    {
+        if ( cache->count[size_class] > 0 )
+            flush_class( cache, size_class, cache->count[size_class] );
+    }
+
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&registry_lock );
+    lk_lock( &registry_lock, &registry_lkstat );
+
+    for ( size_class = 0; size_class <= TS_NCLASSES; size_class++ )
+    {
+        size_classes[size_class].retired_allocs += cache->allocs[size_class];
+        size_classes[size_class].retired_frees += cache->frees[size_class];
+        cache->allocs[size_class] = 0;
+        cache->frees[size_class] = 0;
+    }
+    if ( cache->prv_cache != (ts_cache_t *)NULL )
+        cache->prv_cache->nxt_cache = cache->nxt_cache;
+    else
+        cache_registry = cache->nxt_cache;
+    if ( cache->nxt_cache != (ts_cache_t *)NULL )
+        cache->nxt_cache->prv_cache = cache->prv_cache;
+    cache->registered = FALSE;
+
+    lk_unlock( &registry_lock, &registry_lkstat );
+    pthread_cleanup_pop( 0 );
+}
+
+/*****************************************************************************
+** init_allocator - initializes the size classes and the cache key
+*****************************************************************************/
+static void
+   init_allocator( void )
+{
+    int i;
+
+    for ( i = 0; i <= TS_NCLASSES; i++ )
+    {
+        /*
+        **  Each size class's mutex is profiled under the block size of
+        **  the class (0 for large blocks).
+        */
+        pthread_mutex_init( &(size_classes[i].class_lock),
+                            (pthread_mutexattr_t *)NULL );
+        lk_init( &(size_classes[i].class_lkstat), 0,
+                 (i < TS_NCLASSES) ? (ULONG)class_sizes[i] : 0L, "tsma",
+                 "class_lock" );
+    }
+    pthread_key_create( &ts_cache_key, retire_cache );
+}
+
+/*****************************************************************************
+** my_cache - returns the calling thread's cache, registering it on first use
+*****************************************************************************/
+static ts_cache_t *
+   my_cache( void )
+{
+    ts_cache_t *cache;
+
+    cache = &ts_cache;
+    if ( !cache->registered )
+    {
+        pthread_once( &ts_once, init_allocator );
+
+        pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                              (void *)&registry_lock );
+        lk_lock( &registry_lock, &registry_lkstat );
+
+        cache->prv_cache = (ts_cache_t *)NULL;
+        cache->nxt_cache = cache_registry;
+        if ( cache_registry != (ts_cache_t *)NULL )
+            cache_registry->prv_cache = cache;
+        cache_registry = cache;
+        cache->registered = TRUE;
+
+        lk_unlock( &registry_lock, &registry_lkstat );
+        pthread_cleanup_pop( 0 );
+
+        pthread_setspecific( ts_cache_key, (void *)cache );
+    }
+    return( cache );
+}
+
+/*****************************************************************************
+**  thread-safe malloc
+*****************************************************************************/
+void *ts_malloc( size_t blksize )
+{
+    ts_cache_t *cache;
+    ts_header_t *header;
+    unsigned int size_class;
+
+    cache = my_cache();
+    size_class = class_for( blksize );
+
+    if ( size_class == TS_LARGE )
+    {
+        /*
+        **  Too big for a size class... malloc is thread-safe by itself.
+        */
+        header = (ts_header_t *)malloc( sizeof( ts_header_t ) + blksize );
+        if ( header == (ts_header_t *)NULL )
+            return( (void *)NULL );
+        header->size_class = TS_LARGE;
+        header->blksize = blksize;
+    }
+    else
+    {
+        /*
+        **  Take a block from our own cache, refilling it if it is empty.
+        */
+        if ( (cache->count[size_class] == 0) &&
+             (refill_class( cache, size_class ) == 0) )
+            return( (void *)NULL );
+        header = (ts_header_t *)
+                 cache->blocks[size_class][--(cache->count[size_class])] - 1;
+    }
+
+    header->magic = TS_MAGIC;
+    cache->allocs[size_class]++;
+    return( (void *)(header + 1) );
+}
+
+/*****************************************************************************
+**  thread-safe free
+*****************************************************************************/
+void ts_free( void *blkaddr )
+
+{
+    ts_cache_t *cache;
+    ts_header_t *header;
+    unsigned int size_class;
+
+    if ( blkaddr == (void *)NULL )
+        return;
+
+    cache = my_cache();
+    header = (ts_header_t *)blkaddr - 1;
+    if ( header->magic != TS_MAGIC )
+    {
+#ifdef DIAG_PRINTFS
+        printf( "\r\nts_free - block @ %p not allocated by ts_malloc",
+                blkaddr );
+#endif
+        return;
+    }
+    header->magic = 0;
+    size_class = header->size_class;
+    cache->frees[size_class]++;
+
+    if ( size_class == TS_LARGE )
+    {
+        free( (void *)header );
+    }
+    else
+    {
+        /*
+        **  Put the block in our own cache, making room if needed.
+        */
+        if ( cache->count[size_class] >= (2 * TS_CACHE_BATCH) )
+            flush_class( cache, size_class, TS_CACHE_BATCH );
+        cache->blocks[size_class][(cache->count[size_class])++] = blkaddr;
+    }
+}
+
+/*****************************************************************************
+** ts_reserve - carves slabs until at least 'count' blocks of 'blksize' bytes
+**              are free in their size class, so that allocating them later
+**              neither calls malloc() nor faults in a page.  Returns 0,
+**              EINVAL if the blocks are too large for any size class, or
+**              ENOMEM.
+*****************************************************************************/
+int
+   ts_reserve( size_t blksize, ULONG count )
+{
+    ts_class_t *tsclass;
+    unsigned int size_class;
+    void *block;
+    ULONG free_count, carved;
+    int error;
+
+    pthread_once( &ts_once, init_allocator );
+
+    size_class = class_for( blksize );
+    if ( size_class == TS_LARGE )
+        return( EINVAL );
+    tsclass = &size_classes[size_class];
+    error = 0;
+
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&(tsclass->class_lock) );
+    lk_lock( &(tsclass->class_lock), &(tsclass->class_lkstat) );
+
+    free_count = 0;
+    for ( block = tsclass->free_list; block != (void *)NULL;
+          block = *(void **)block )
+        free_count++;
+    while ( free_count < count )
+    {
+        if ( (carved = carve_slab( size_class )) == 0 )
+        {
+            error = ENOMEM;
+            break;
+        }
+        free_count += carved;
+    }
+
+    lk_unlock( &(tsclass->class_lock), &(tsclass->class_lkstat) );
+    pthread_cleanup_pop( 0 );
+
+    return( error );
+}
+
+/*****************************************************************************
+** ts_mstats - fills in allocation statistics for up to 'max_classes' size
+**             classes, the last being blocks too large for any class.
+**             Returns the number of entries filled in.
+*****************************************************************************/
+ULONG
+   ts_mstats( ts_mstat_t stats[], ULONG max_classes )
+{
+    ts_cache_t *cache;
+    ULONG size_class;
+    ULONG allocs;
+    ULONG frees;
+
+    pthread_once( &ts_once, init_allocator );
+
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&registry_lock );
+    lk_lock( &registry_lock, &registry_lkstat );
+
+    for ( size_class = 0;
+          (size_class <= TS_NCLASSES) && (size_class < max_classes);
+          size_class++ )
+    {
+        allocs = size_classes[size_class].retired_allocs;
+        frees = size_classes[size_class].retired_frees;
+        for ( cache = cache_registry; cache != (ts_cache_t *)NULL;
+              cache = cache->nxt_cache )
+        {
+            allocs += cache->allocs[size_class];
+            frees += cache->frees[size_class];
+        }
+
+        stats[size_class].blk_size = 0L;
+        if ( size_class < TS_NCLASSES )
+            stats[size_class].blk_size = class_sizes[size_class];
+        stats[size_class].slab_bytes = size_classes[size_class].slab_bytes;
+        stats[size_class].allocs = allocs;
+        stats[size_class].frees = frees;
+        stats[size_class].in_use = allocs - frees;
+    }
+
+    lk_unlock( &registry_lock, &registry_lkstat );
+    pthread_cleanup_pop( 0 );
+
+    return( size_class );
+}
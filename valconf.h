@@ -0,0 +1,12 @@
+/*****************************************************************************
+ * valconf.h - static configuration table for the validation suite
+ *
+ * Makefile_test builds the library and validate with -DP2PT_CONFIG naming
+ * this file, so that validate_static_config() has one object of each class
+ * to check.  See p2ptconf.h for the form of the entries.
+ ****************************************************************************/
+
+P2PT_TASK( VAL_TID, "VTSK", 20, 0, 0, T_LOCAL )
+P2PT_QUEUE( VAL_QID, "VQUE", 4, Q_FIFO | Q_LIMIT )
+P2PT_SEMA4( VAL_SMID, "VSEM", 2, SM_FIFO )
+P2PT_PARTITION( VAL_PTID, "VPRT", 8 * 64, 64, PT_DEL )
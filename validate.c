@@ -7,8 +7,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include "not_quite_p_os.h"
 #include "p2pthread.h"
+#include "histogram.h"
 
 typedef union
 {
@@ -43,10 +51,27 @@ typedef union
 #define EVENT9  0x080
 #define EVENT10 0x100
 
+/*
+**  Handshake event for the helper tasks of the later validation sections
+*/
+#define HELPER  0x200
+
 extern p2pthread_cb_t *
    my_tcb( void );
 extern p2pthread_cb_t *
    tcb_for( ULONG taskid );
+extern ULONG
+   t_stats( ULONG tid, t_stat_t *stats );
+extern ULONG
+   t_stats_all( t_stat_t stats[], ULONG max_tasks );
+extern ULONG
+   sp_start( const char *name, ULONG max_objects, ULONG period_ms );
+extern ULONG
+   sp_stop( void );
+extern ULONG
+   q_info( ULONG qid, q_info_t *info );
+extern ULONG
+   q_vinfo( ULONG qid, q_info_t *info );
 
 #undef errno
 extern int errno;
@@ -63,6 +88,10 @@ static ULONG part2_numblks;
 static char partition_3[2048];
 static ULONG part3_numblks;
 
+static char partition_4[65536];
+
+static ULONG region_1[1024];
+
 static ULONG task1_id;
 static ULONG task2_id;
 static ULONG task3_id;
@@ -92,6 +121,22 @@ static ULONG sema43_id;
 
 static ULONG test_cycle;
 
+static ULONG helper_err;
+
+/*****************************************************************************
+**  check_error
+**         Reports the result of a call whose error code is known in advance,
+**         flagging any call which did not return the expected code.
+*****************************************************************************/
+static void check_error( const char *call, ULONG err, ULONG expected )
+{
+    if ( err == expected )
+        printf( "%s returned %lx as expected\r\n", call, err );
+    else
+        printf( "%s returned %lx, expected %lx  <-- FAILED\r\n", call, err,
+                expected );
+}
+
 /*****************************************************************************
 **  display_tcb
 *****************************************************************************/
@@ -1118,153 +1163,3088 @@ void validate_partitions( void )
     if ( err != ERR_NO_ERROR )
         printf( "\npt_create returned error %lx\r\n", err );
     else
-        printf( "\npt_create created %ld 32-byte buffers\r\n", part2_numblks );
+        printf( "\npt_create created %ld 32-byte buffers\r\n", part2_numblks );
+
+    printf( "\r\nCreating Partition 3 with 16 128-byte buffers" );
+    err = pt_create( "PRT3", partition_3, partition_3, 2048,
+                     128, PT_DEL, &partn3_id, &part3_numblks );
+    if ( err != ERR_NO_ERROR )
+        printf( "\npt_create returned error %lx\r\n", err );
+    else
+        printf( "\npt_create created %ld 128-byte buffers\r\n", part3_numblks );
+
+    /************************************************************************
+    **  Partition Buffer Allocation, Use, and Release Test
+    ************************************************************************/
+
+    puts( "\n.......... Next we allocate 32 buffers from each partition:" );
+    puts( "           PRT3 should return error 0x2c for the last 16 buffers." );
+    puts( "           An ID string is written into each buffer obtained." );
+    for ( i = 0; i < 32; i++ )
+    {
+        printf( "\r\nAllocating buffer %d from PRT1", i + 1 );
+        err = pt_getbuf( partn1_id, (void **)&(buf1addr[i]) );
+        if ( err != ERR_NO_ERROR )
+            printf( "\npt_getbuf on PRT1 returned error %lx\r\n", err );
+        else
+            sprintf( buf1addr[i], "PRT1 buffer %d", i + 1 );
+
+        printf( "\r\nAllocating buffer %d from PRT2", i + 1 );
+        err = pt_getbuf( partn2_id, (void **)&(buf2addr[i]) );
+        if ( err != ERR_NO_ERROR )
+            printf( "\npt_getbuf on PRT2 returned error %lx\r\n", err );
+        else
+            sprintf( buf2addr[i], "PRT2 buffer %d", i + 1 );
+
+        printf( "\r\nAllocating buffer %d from PRT3", i + 1 );
+        err = pt_getbuf( partn3_id, (void **)&(buf3addr[i]) );
+        if ( err != ERR_NO_ERROR )
+            printf( "\npt_getbuf on PRT3 returned error %lx\r\n", err );
+        else
+            sprintf( buf3addr[i], "PRT3 buffer %d", i + 1 );
+    }
+
+    puts( "           Next print the ID strings from the first and last " );
+    puts( "           buffers allocated from each partition.  This proves" );
+    puts( "           that the buffers and partitions are unique." );
+    puts( buf1addr[0] );
+    puts( buf1addr[31] );
+    puts( buf2addr[0] );
+    puts( buf2addr[31] );
+    puts( buf3addr[0] );
+    puts( buf3addr[15] );
+
+    puts( "           Now try to return a buffer from PRT2 to PRT1." );
+    puts( "           This should return error 0x2d." );
+    err = pt_retbuf( partn1_id, (void *)buf2addr[0] );
+    if ( err != ERR_NO_ERROR )
+        printf( "\npt_retbuf on PRT1 returned error %lx\r\n", err );
+    else
+        printf( "\nReturned buffer %d  @ %p to PRT1\r\n", 1, buf2addr[0] );
+
+    puts( "           Now try to return a buffer from PRT2 more than once." );
+    puts( "           This should return error 0x2f on the second pt_retbuf." );
+    err = pt_retbuf( partn2_id, (void *)buf2addr[0] );
+    if ( err != ERR_NO_ERROR )
+        printf( "\npt_retbuf on PRT2 returned error %lx\r\n", err );
+    else
+        printf( "\nReturned buffer %d  @ %p to PRT2\r\n", 1, buf2addr[0] );
+
+    err = pt_retbuf( partn2_id, (void *)buf2addr[0] );
+    if ( err != ERR_NO_ERROR )
+        printf( "\npt_retbuf on PRT2 returned error %lx\r\n", err );
+    else
+        printf( "\nReturned buffer %d  @ %p to PRT2\r\n", 1, buf2addr[0] );
+
+    /************************************************************************
+    **  Partition Deletion Test
+    ************************************************************************/
+    puts( "\n.......... Now we delete partitions 1 and 2:" );
+    puts( "           Partitions 1 and 3 were created with the PT_DEL option.");
+    puts( "           They can be deleted even with buffers still allocated.");
+    puts( "           Partition 2 was created with the PT_NODEL option.");
+    puts( "           It cannot be deleted while buffers are still allocated.");
+
+    printf( "\r\nDeleting Partition 1 with buffers allocated" );
+    err = pt_delete( partn1_id );
+    if ( err != ERR_NO_ERROR )
+        printf( "\npt_delete of PRT1 returned error %lx\r\n", err );
+    else
+        printf( "\r\n" );
+  
+    printf( "\r\nDeleting Partition 2 with buffers allocated" );
+    err = pt_delete( partn2_id );
+    if ( err != ERR_NO_ERROR )
+        printf( "\npt_delete of PRT2 returned error %lx\r\n", err );
+    else
+        printf( "\r\n" );
+
+    puts( "Returning all buffers to PRT2" );
+    for ( i = 1; i < 32; i++ )
+    {
+        err = pt_retbuf( partn2_id, (void *)buf2addr[i] );
+        if ( err != ERR_NO_ERROR )
+            printf( "\npt_retbuf on PRT2 returned error %lx\r\n", err );
+    }
+  
+    printf( "\r\nDeleting Partition 2 with no buffers allocated" );
+    err = pt_delete( partn2_id );
+    if ( err != ERR_NO_ERROR )
+        printf( "\npt_delete of PRT2 returned error %lx\r\n", err );
+    else
+        printf( "\r\n" );
+  
+    /************************************************************************
+    **  Partition Identification and Partition-Not-Found Test
+    ************************************************************************/
+
+    puts( "\n.......... Finally, we test the pt_ident logic..." );
+    puts( "           Then we verify the error codes returned when" );
+    puts( "           a non-existent partition is specified." );
+
+    err = pt_ident( "PRT3", 0, &my_partn_id );
+    if ( err != ERR_NO_ERROR )
+        printf( "\npt_ident for PRT3 returned error %lx\r\n", err );
+    else
+        printf( "\npt_ident for PRT3 returned ID %lx... partn3_id == %lx\r\n",
+                 my_partn_id, partn3_id );
+
+    err = pt_ident( "PRT1", 0, &my_partn_id );
+    if ( err != ERR_NO_ERROR )
+        printf( "\npt_ident for PRT1 returned error %lx\r\n", err );
+    else
+        printf( "\npt_ident for PRT1 returned ID %lx partn1_id %lx\r\n",
+                  my_partn_id, partn1_id );
+
+    err = pt_getbuf( partn2_id, (void **)&buffer );
+    if ( err != ERR_NO_ERROR )
+        printf( "\npt_getbuf on PRT2 returned error %lx\r\n", err );
+    else
+        printf( "\npt_getbuf on PRT2 returned buffer @ %p\r\n", buffer );
+
+    err = pt_retbuf( partn1_id, buffer );
+    if ( err != ERR_NO_ERROR )
+        printf( "\npt_retbuf on PRT1 returned error %lx\r\n", err );
+    else
+        printf( "\r\n" );
+
+    err = sm_delete( partn1_id );
+    printf( "\nsm_delete for PRT1 returned error %lx\r\n", err );
+}
+
+/*****************************************************************************
+**  validate_token_pools
+**         This function sequences through a series of actions to exercise
+**         the multi-token semaphore calls sm_pn and sm_vn.
+**
+*****************************************************************************/
+void validate_token_pools( void )
+{
+    ULONG err;
+    ULONG my_sema4_id;
+
+    puts( "\r\n********** Multi-token semaphore validation:" );
+
+    puts( "\n.......... First we create a PRIORITY semaphore with no tokens" );
+    puts( "           and release 3 tokens to it at once." );
+    err = sm_create( "SEM4", 0, SM_PRIOR, &my_sema4_id );
+    check_error( "sm_create SEM4", err, ERR_NO_ERROR );
+    err = sm_vn( my_sema4_id, 3 );
+    check_error( "sm_vn 3 tokens to SEM4", err, ERR_NO_ERROR );
+
+    puts( "\n.......... Next we take the tokens in groups.  Taking 2 tokens" );
+    puts( "           succeeds, then 2 more without waiting should return" );
+    puts( "           error 0x42 and 2 more with a timeout error 0x01," );
+    puts( "           leaving the last token for a single-token sm_p." );
+    err = sm_pn( my_sema4_id, 2, SM_NOWAIT, 0 );
+    check_error( "sm_pn 2 tokens from SEM4", err, ERR_NO_ERROR );
+    err = sm_pn( my_sema4_id, 2, SM_NOWAIT, 0 );
+    check_error( "sm_pn 2 tokens from SEM4 without waiting", err, 0x42 );
+    err = sm_pn( my_sema4_id, 2, SM_WAIT, 2 );
+    check_error( "sm_pn 2 tokens from SEM4 with timeout", err, 0x01 );
+    err = sm_p( my_sema4_id, SM_NOWAIT, 0 );
+    check_error( "sm_p from SEM4", err, ERR_NO_ERROR );
+
+    puts( "\n.......... Requests for or releases of zero tokens are errors," );
+    puts( "           and should return error 0x20 without blocking." );
+    err = sm_pn( my_sema4_id, 0, SM_WAIT, 0 );
+    check_error( "sm_pn 0 tokens from SEM4", err, 0x20 );
+    err = sm_vn( my_sema4_id, 0 );
+    check_error( "sm_vn 0 tokens to SEM4", err, 0x20 );
+
+    err = sm_delete( my_sema4_id );
+    check_error( "sm_delete SEM4", err, ERR_NO_ERROR );
+    err = sm_vn( my_sema4_id, 1 );
+    check_error( "sm_vn to deleted SEM4", err, 0x05 );
+}
+
+/*****************************************************************************
+**  validate_mutexes
+**         This function sequences through a series of actions to exercise
+**         the pSOS+ mutex calls, including the priority ceilings of
+**         priority-protected mutexes unlocked out of order.
+**
+*****************************************************************************/
+void validate_mutexes( void )
+{
+    ULONG err;
+    ULONG mutex1_id;
+    ULONG mutex2_id;
+    ULONG mutex3_id;
+    ULONG my_mutex_id;
+    struct sched_param base, high, low;
+    int policy;
+
+    puts( "\r\n********** Mutex validation:" );
+
+    puts( "\n.......... First we create a recursive mutex, lock it twice" );
+    puts( "           and unlock it twice.  A third unlock should return" );
+    puts( "           error 0x82, since the mutex is no longer owned." );
+    err = mu_create( "MUT1", MU_RECURSIVE, 0, &mutex1_id );
+    check_error( "mu_create MUT1", err, ERR_NO_ERROR );
+    err = mu_lock( mutex1_id, MU_WAIT, 0 );
+    check_error( "mu_lock MUT1", err, ERR_NO_ERROR );
+    err = mu_lock( mutex1_id, MU_NOWAIT, 0 );
+    check_error( "mu_lock MUT1 again", err, ERR_NO_ERROR );
+    err = mu_unlock( mutex1_id );
+    check_error( "mu_unlock MUT1", err, ERR_NO_ERROR );
+    err = mu_unlock( mutex1_id );
+    check_error( "mu_unlock MUT1 again", err, ERR_NO_ERROR );
+    err = mu_unlock( mutex1_id );
+    check_error( "mu_unlock MUT1 unlocked", err, 0x82 );
+
+    puts( "\n.......... A non-recursive mutex may not be locked twice by" );
+    puts( "           its owner... this should return error 0x83." );
+    err = mu_create( "MUT2", MU_NORECURSIVE, 0, &mutex2_id );
+    check_error( "mu_create MUT2", err, ERR_NO_ERROR );
+    err = mu_lock( mutex2_id, MU_WAIT, 0 );
+    check_error( "mu_lock MUT2", err, ERR_NO_ERROR );
+    err = mu_lock( mutex2_id, MU_NOWAIT, 0 );
+    check_error( "mu_lock MUT2 again", err, 0x83 );
+    err = mu_unlock( mutex2_id );
+    check_error( "mu_unlock MUT2", err, ERR_NO_ERROR );
+    err = mu_delete( mutex2_id );
+    check_error( "mu_delete MUT2", err, ERR_NO_ERROR );
+
+    puts( "\n.......... Now we lock priority-protected mutexes with ceilings" );
+    puts( "           50 and 30 and unlock the higher one first.  Task 1" );
+    puts( "           should stay at the lower ceiling until it unlocks the" );
+    puts( "           second mutex, then drop back to its own priority." );
+    puts( "           A mutex with a ceiling of 10 is below Task 1's own" );
+    puts( "           priority, and locking it should return error 0x85." );
+    pthread_getschedparam( pthread_self(), &policy, &base );
+    err = mu_create( "MUT2", MU_PRIO_PROTECT, 50, &mutex2_id );
+    check_error( "mu_create MUT2 ceiling 50", err, ERR_NO_ERROR );
+    err = mu_create( "MUT3", MU_PRIO_PROTECT, 30, &mutex3_id );
+    check_error( "mu_create MUT3 ceiling 30", err, ERR_NO_ERROR );
+    err = mu_lock( mutex2_id, MU_WAIT, 0 );
+    check_error( "mu_lock MUT2", err, ERR_NO_ERROR );
+    err = mu_lock( mutex3_id, MU_WAIT, 0 );
+    check_error( "mu_lock MUT3", err, ERR_NO_ERROR );
+    pthread_getschedparam( pthread_self(), &policy, &high );
+    err = mu_unlock( mutex2_id );
+    check_error( "mu_unlock MUT2", err, ERR_NO_ERROR );
+    pthread_getschedparam( pthread_self(), &policy, &low );
+    if ( (low.sched_priority < high.sched_priority) &&
+         (low.sched_priority > base.sched_priority) )
+        printf( "Task 1 dropped from priority %d to %d, above its own %d\r\n",
+                high.sched_priority, low.sched_priority,
+                base.sched_priority );
+    else
+        printf( "Task 1 priority %d after unlocking MUT2 (held %d, own %d)"
+                "  <-- FAILED\r\n", low.sched_priority, high.sched_priority,
+                base.sched_priority );
+    err = mu_unlock( mutex3_id );
+    check_error( "mu_unlock MUT3", err, ERR_NO_ERROR );
+    pthread_getschedparam( pthread_self(), &policy, &low );
+    if ( low.sched_priority == base.sched_priority )
+        printf( "Task 1 back at its own priority %d\r\n", low.sched_priority );
+    else
+        printf( "Task 1 priority %d after unlocking MUT3, own %d"
+                "  <-- FAILED\r\n", low.sched_priority, base.sched_priority );
+    err = mu_delete( mutex3_id );
+    check_error( "mu_delete MUT3", err, ERR_NO_ERROR );
+    err = mu_create( "MUT3", MU_PRIO_PROTECT, 10, &mutex3_id );
+    check_error( "mu_create MUT3 ceiling 10", err, ERR_NO_ERROR );
+    err = mu_lock( mutex3_id, MU_WAIT, 0 );
+    check_error( "mu_lock MUT3 below own priority", err, 0x85 );
+
+    puts( "\n.......... Finally, we test the mu_ident logic and the error" );
+    puts( "           codes returned for a deleted mutex." );
+    err = mu_ident( "MUT2", 0, &my_mutex_id );
+    check_error( "mu_ident MUT2", err, ERR_NO_ERROR );
+    if ( my_mutex_id != mutex2_id )
+        printf( "mu_ident for MUT2 returned ID %lx, expected %lx  <-- FAILED\r\n",
+                my_mutex_id, mutex2_id );
+    err = mu_delete( mutex1_id );
+    check_error( "mu_delete MUT1", err, ERR_NO_ERROR );
+    err = mu_delete( mutex2_id );
+    check_error( "mu_delete MUT2", err, ERR_NO_ERROR );
+    err = mu_delete( mutex3_id );
+    check_error( "mu_delete MUT3", err, ERR_NO_ERROR );
+    err = mu_ident( "MUT1", 0, &my_mutex_id );
+    check_error( "mu_ident deleted MUT1", err, 0x09 );
+    err = mu_lock( mutex1_id, MU_WAIT, 0 );
+    check_error( "mu_lock deleted MUT1", err, 0x05 );
+}
+
+/*****************************************************************************
+**  cv_waiter
+**         Helper task for validate_condvars... waits on the condition
+**         variable with the mutex and handshakes with the creating task
+**         once it has been signalled and holds the mutex again.
+*****************************************************************************/
+void cv_waiter( ULONG cvid, ULONG muid, ULONG parent_id, ULONG dummy3 )
+{
+    ULONG err;
+
+    err = mu_lock( muid, MU_WAIT, 0 );
+    check_error( "CVW1 mu_lock MUT4", err, ERR_NO_ERROR );
+    ev_send( parent_id, HELPER );
+
+    err = cv_wait( cvid, muid, 0 );
+    check_error( "CVW1 cv_wait on CV1", err, ERR_NO_ERROR );
+    err = mu_unlock( muid );
+    check_error( "CVW1 mu_unlock MUT4", err, ERR_NO_ERROR );
+    ev_send( parent_id, HELPER );
+
+    t_delete( 0L );
+}
+
+/*****************************************************************************
+**  validate_condvars
+**         This function sequences through a series of actions to exercise
+**         the pSOS+ condition variable calls.
+**
+*****************************************************************************/
+void validate_condvars( void )
+{
+    ULONG err;
+    ULONG condvar_id;
+    ULONG mutex_id;
+    ULONG sema4_id;
+    ULONG waiter_id;
+    ULONG my_condvar_id;
+    ULONG args[4];
+
+    puts( "\r\n********** Condition variable validation:" );
+
+    err = cv_create( "CV1 ", CV_PRIOR, &condvar_id );
+    check_error( "cv_create CV1", err, ERR_NO_ERROR );
+    err = mu_create( "MUT4", MU_NORECURSIVE, 0, &mutex_id );
+    check_error( "mu_create MUT4", err, ERR_NO_ERROR );
+    err = sm_create( "SEM5", 1, SM_FIFO, &sema4_id );
+    check_error( "sm_create SEM5", err, ERR_NO_ERROR );
+
+    puts( "\n.......... A wait which is never signalled times out with" );
+    puts( "           error 0x01, holding the mutex or semaphore token" );
+    puts( "           again.  Waiting with a mutex not held returns 0x82." );
+    err = mu_lock( mutex_id, MU_WAIT, 0 );
+    check_error( "mu_lock MUT4", err, ERR_NO_ERROR );
+    err = cv_wait( condvar_id, mutex_id, 2 );
+    check_error( "cv_wait on CV1 with timeout", err, 0x01 );
+    err = mu_unlock( mutex_id );
+    check_error( "mu_unlock MUT4 after cv_wait", err, ERR_NO_ERROR );
+    err = cv_wait( condvar_id, mutex_id, 2 );
+    check_error( "cv_wait on CV1 without MUT4", err, 0x82 );
+    err = sm_p( sema4_id, SM_NOWAIT, 0 );
+    check_error( "sm_p SEM5", err, ERR_NO_ERROR );
+    err = cv_smwait( condvar_id, sema4_id, 2 );
+    check_error( "cv_smwait on CV1 with timeout", err, 0x01 );
+    err = sm_p( sema4_id, SM_NOWAIT, 0 );
+    check_error( "sm_p SEM5 after cv_smwait", err, 0x42 );
+    err = sm_v( sema4_id );
+    check_error( "sm_v SEM5", err, ERR_NO_ERROR );
+
+    puts( "\n.......... Next a helper task waits on CV1 with MUT4.  Once" );
+    puts( "           Task 1 can lock MUT4 the helper is waiting, and a" );
+    puts( "           signal hands it MUT4 when Task 1 unlocks it." );
+    t_ident( (char *)NULL, 0, &args[2] );
+    args[0] = condvar_id;
+    args[1] = mutex_id;
+    args[3] = 0;
+    err = t_create( "CVW1", 30, 0, 0, T_LOCAL, &waiter_id );
+    check_error( "t_create CVW1", err, ERR_NO_ERROR );
+    err = t_start( waiter_id, T_PREEMPT, cv_waiter, args );
+    check_error( "t_start CVW1", err, ERR_NO_ERROR );
+    err = ev_receive( HELPER, EV_ANY, 0, (ULONG *)NULL );
+    check_error( "ev_receive from CVW1", err, ERR_NO_ERROR );
+    err = mu_lock( mutex_id, MU_WAIT, 0 );
+    check_error( "mu_lock MUT4", err, ERR_NO_ERROR );
+    err = cv_signal( condvar_id );
+    check_error( "cv_signal CV1", err, ERR_NO_ERROR );
+    err = mu_unlock( mutex_id );
+    check_error( "mu_unlock MUT4", err, ERR_NO_ERROR );
+    err = ev_receive( HELPER, EV_ANY, 100, (ULONG *)NULL );
+    check_error( "ev_receive from CVW1 after signal", err, ERR_NO_ERROR );
+    err = cv_broadcast( condvar_id );
+    check_error( "cv_broadcast CV1 with no waiters", err, ERR_NO_ERROR );
+
+    puts( "\n.......... Finally, we test the cv_ident logic and the error" );
+    puts( "           codes returned for a deleted condition variable." );
+    err = cv_ident( "CV1 ", 0, &my_condvar_id );
+    check_error( "cv_ident CV1", err, ERR_NO_ERROR );
+    if ( my_condvar_id != condvar_id )
+        printf( "cv_ident for CV1 returned ID %lx, expected %lx  <-- FAILED\r\n",
+                my_condvar_id, condvar_id );
+    err = cv_delete( condvar_id );
+    check_error( "cv_delete CV1", err, ERR_NO_ERROR );
+    err = cv_signal( condvar_id );
+    check_error( "cv_signal deleted CV1", err, 0x05 );
+    err = cv_ident( "CV1 ", 0, &my_condvar_id );
+    check_error( "cv_ident deleted CV1", err, 0x09 );
+    mu_delete( mutex_id );
+    sm_delete( sema4_id );
+}
+
+/*****************************************************************************
+**  ev_waiter
+**         Helper task for validate_event_flags... waits for any event and
+**         hands the events it received back to the creating task.
+*****************************************************************************/
+void ev_waiter( ULONG parent_id, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    ULONG events;
+
+    ev_receive( ~HELPER, EV_ANY, 0, &events );
+    ev_send( parent_id, HELPER | events );
+
+    t_delete( 0L );
+}
+
+/*****************************************************************************
+**  ev_sink
+**         Helper task for validate_event_flags... takes EVENT5 until it
+**         is deleted.
+*****************************************************************************/
+void ev_sink( ULONG dummy0, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    for ( ;; )
+        ev_receive( EVENT5, EV_ANY, 0, (ULONG *)NULL );
+}
+
+/*****************************************************************************
+**  ev_hammer
+**         Helper task for validate_event_flags... sends EVENT5 to a task
+**         which is deleted and created again meanwhile, reporting in
+**         helper_err any error but 0x05, until the creating task sends
+**         it HELPER.  It sleeps a tick after each burst of sends, so the
+**         creating task gets to run on a single processor.  Then
+**         handshakes with the creating task.
+*****************************************************************************/
+void ev_hammer( ULONG target_id, ULONG parent_id, ULONG dummy2, ULONG dummy3 )
+{
+    ULONG err;
+    ULONG i;
+
+    helper_err = ERR_NO_ERROR;
+    while ( ev_receive( HELPER, EV_ANY | EV_NOWAIT, 0, (ULONG *)NULL ) !=
+            ERR_NO_ERROR )
+    {
+        for ( i = 0; i < 1000; i++ )
+        {
+            err = ev_send( target_id, EVENT5 );
+            if ( (err != ERR_NO_ERROR) && (err != 0x05) )
+                helper_err = err;
+        }
+        tm_wkafter( 1 );
+    }
+    ev_send( parent_id, HELPER );
+
+    t_delete( 0L );
+}
+
+/*****************************************************************************
+**  validate_event_flags
+**         This function sequences through a series of actions to exercise
+**         the error codes and corner cases of the task event flag calls.
+**
+*****************************************************************************/
+void validate_event_flags( void )
+{
+    ULONG err;
+    ULONG my_id;
+    ULONG waiter_id;
+    ULONG old_id;
+    ULONG hammer_id;
+    ULONG events;
+    ULONG count;
+    ULONG args[4];
+
+    puts( "\r\n********** Event flag validation:" );
+
+    t_ident( (char *)NULL, 0, &my_id );
+
+    puts( "\n.......... An empty mask returns the pending events at once," );
+    puts( "           even with EV_WAIT, and leaves them pending." );
+    err = ev_send( my_id, EVENT2 | EVENT3 );
+    check_error( "ev_send EVENT2 | EVENT3 to Task 1", err, ERR_NO_ERROR );
+    err = ev_receive( 0, EV_WAIT, 0, &events );
+    check_error( "ev_receive of no events", err, ERR_NO_ERROR );
+    if ( events != (EVENT2 | EVENT3) )
+        printf( "ev_receive of no events captured %lx  <-- FAILED\r\n", events );
+
+    puts( "\n.......... An ALL wait for events not all pending returns" );
+    puts( "           error 0x3c without waiting or 0x01 with a timeout," );
+    puts( "           and takes none of them." );
+    err = ev_receive( EVENT2 | EVENT4, EV_ALL | EV_NOWAIT, 0, &events );
+    check_error( "ev_receive ALL without waiting", err, 0x3c );
+    err = ev_receive( EVENT2 | EVENT4, EV_ALL, 2, &events );
+    check_error( "ev_receive ALL with timeout", err, 0x01 );
+    err = ev_receive( EVENT2 | EVENT3, EV_ALL | EV_NOWAIT, 0, &events );
+    check_error( "ev_receive EVENT2 | EVENT3", err, ERR_NO_ERROR );
+    err = ev_receive( EVENT2 | EVENT3, EV_ANY | EV_NOWAIT, 0, &events );
+    check_error( "ev_receive EVENT2 | EVENT3 again", err, 0x3c );
+
+    puts( "\n.......... Sending to a task deleted while it waits for events" );
+    puts( "           returns error 0x05.  A task created with the same ID" );
+    puts( "           then gets the events." );
+    args[0] = my_id;
+    args[1] = args[2] = args[3] = 0;
+    err = t_create( "EVW1", 30, 0, 0, T_LOCAL, &old_id );
+    check_error( "t_create EVW1", err, ERR_NO_ERROR );
+    err = t_start( old_id, T_PREEMPT, ev_waiter, args );
+    check_error( "t_start EVW1", err, ERR_NO_ERROR );
+    tm_wkafter( 2 );
+    err = t_delete( old_id );
+    check_error( "t_delete EVW1", err, ERR_NO_ERROR );
+    err = ev_send( old_id, EVENT4 );
+    check_error( "ev_send to deleted EVW1", err, 0x05 );
+    err = t_create( "EVW2", 30, 0, 0, T_LOCAL, &waiter_id );
+    check_error( "t_create EVW2", err, ERR_NO_ERROR );
+    if ( waiter_id != old_id )
+        printf( "EVW2 has ID %lx, EVW1 had %lx\r\n", waiter_id, old_id );
+    err = t_start( waiter_id, T_PREEMPT, ev_waiter, args );
+    check_error( "t_start EVW2", err, ERR_NO_ERROR );
+    err = ev_send( waiter_id, EVENT4 );
+    check_error( "ev_send EVENT4 to EVW2", err, ERR_NO_ERROR );
+    err = ev_receive( HELPER, EV_ANY, 100, &events );
+    check_error( "ev_receive from EVW2", err, ERR_NO_ERROR );
+    err = ev_receive( EVENT4, EV_ANY, 100, &events );
+    check_error( "ev_receive EVENT4 passed back by EVW2", err, ERR_NO_ERROR );
+
+    puts( "\n.......... A task sending events to a task which is deleted and" );
+    puts( "           created again meanwhile gets only 0 or error 0x05." );
+    err = t_create( "EVH1", 30, 0, 0, T_LOCAL, &hammer_id );
+    check_error( "t_create EVH1", err, ERR_NO_ERROR );
+    err = t_create( "EVS1", 30, 0, 0, T_LOCAL, &waiter_id );
+    check_error( "t_create EVS1", err, ERR_NO_ERROR );
+    err = t_start( waiter_id, T_PREEMPT, ev_sink, args );
+    check_error( "t_start EVS1", err, ERR_NO_ERROR );
+    args[0] = waiter_id;
+    args[1] = my_id;
+    err = t_start( hammer_id, T_PREEMPT, ev_hammer, args );
+    check_error( "t_start EVH1", err, ERR_NO_ERROR );
+    for ( count = 0; count < 100; count++ )
+    {
+        err = t_delete( waiter_id );
+        if ( err == ERR_NO_ERROR )
+            err = t_create( "EVS1", 30, 0, 0, T_LOCAL, &waiter_id );
+        if ( err == ERR_NO_ERROR )
+            err = t_start( waiter_id, T_PREEMPT, ev_sink, args );
+        if ( err != ERR_NO_ERROR )
+        {
+            printf( "Recreating EVS1 returned %lx  <-- FAILED\r\n", err );
+            break;
+        }
+    }
+    ev_send( hammer_id, HELPER );
+    err = ev_receive( HELPER, EV_ANY, 100, &events );
+    check_error( "ev_receive from EVH1", err, ERR_NO_ERROR );
+    check_error( "ev_send to EVS1 while it is recreated", helper_err,
+                 ERR_NO_ERROR );
+    err = t_delete( waiter_id );
+    check_error( "t_delete EVS1", err, ERR_NO_ERROR );
+}
+
+/*****************************************************************************
+**  eg_waiter
+**         Helper task for validate_event_groups... waits for any of the
+**         flags in 'mask' of the event group, then reports the result of
+**         the wait in helper_err and handshakes with the creating task.
+*****************************************************************************/
+void eg_waiter( ULONG egid, ULONG mask, ULONG parent_id, ULONG dummy3 )
+{
+    helper_err = eg_receive( egid, mask, EV_ANY, 0, (ULONG *)NULL );
+    ev_send( parent_id, HELPER );
+
+    t_delete( 0L );
+}
+
+/*****************************************************************************
+**  validate_event_groups
+**         This function sequences through a series of actions to exercise
+**         the event group calls, including the deletion of a task waiting
+**         on an event group and of an event group with a task waiting.
+**
+*****************************************************************************/
+void validate_event_groups( void )
+{
+    ULONG err;
+    ULONG evgroup_id;
+    ULONG waiter_id;
+    ULONG my_evgroup_id;
+    ULONG events;
+    ULONG args[4];
+
+    puts( "\r\n********** Event group validation:" );
+
+    err = eg_create( "EGR1", EG_NOCLR, &evgroup_id );
+    check_error( "eg_create EGR1", err, ERR_NO_ERROR );
+
+    puts( "\n.......... An ALL wait with only some flags set returns error" );
+    puts( "           0x3c without waiting or 0x01 with a timeout.  Flags" );
+    puts( "           stay set after a match until they are cleared." );
+    err = eg_send( evgroup_id, 0x11 );
+    check_error( "eg_send 0x11 to EGR1", err, ERR_NO_ERROR );
+    err = eg_receive( evgroup_id, 0x13, EV_ALL | EV_NOWAIT, 0, &events );
+    check_error( "eg_receive ALL 0x13 without waiting", err, 0x3c );
+    err = eg_receive( evgroup_id, 0x13, EV_ALL, 2, &events );
+    check_error( "eg_receive ALL 0x13 with timeout", err, 0x01 );
+    err = eg_receive( evgroup_id, 0x13, EV_ANY | EV_NOWAIT, 0, &events );
+    check_error( "eg_receive ANY 0x13", err, ERR_NO_ERROR );
+    if ( events != 0x11 )
+        printf( "eg_receive ANY 0x13 captured %lx  <-- FAILED\r\n", events );
+    err = eg_receive( evgroup_id, 0x11, EV_ALL | EV_NOWAIT, 0, &events );
+    check_error( "eg_receive ALL 0x11 again", err, ERR_NO_ERROR );
+    err = eg_clear( evgroup_id, 0x11 );
+    check_error( "eg_clear 0x11 in EGR1", err, ERR_NO_ERROR );
+    err = eg_receive( evgroup_id, 0x11, EV_ANY | EV_NOWAIT, 0, &events );
+    check_error( "eg_receive ANY 0x11 after eg_clear", err, 0x3c );
+
+    puts( "\n.......... Next a helper task waiting on EGR1 is deleted, and" );
+    puts( "           the flag it waited on is set.  A second helper is" );
+    puts( "           then woken by the flag." );
+    t_ident( (char *)NULL, 0, &args[2] );
+    args[0] = evgroup_id;
+    args[1] = 0x100;
+    args[3] = 0;
+    err = t_create( "EGW1", 30, 0, 0, T_LOCAL, &waiter_id );
+    check_error( "t_create EGW1", err, ERR_NO_ERROR );
+    err = t_start( waiter_id, T_PREEMPT, eg_waiter, args );
+    check_error( "t_start EGW1", err, ERR_NO_ERROR );
+    tm_wkafter( 2 );
+    err = t_delete( waiter_id );
+    check_error( "t_delete EGW1 waiting on EGR1", err, ERR_NO_ERROR );
+    err = eg_send( evgroup_id, 0x100 );
+    check_error( "eg_send 0x100 to EGR1", err, ERR_NO_ERROR );
+    err = eg_clear( evgroup_id, 0x100 );
+    check_error( "eg_clear 0x100 in EGR1", err, ERR_NO_ERROR );
+    err = t_create( "EGW2", 30, 0, 0, T_LOCAL, &waiter_id );
+    check_error( "t_create EGW2", err, ERR_NO_ERROR );
+    err = t_start( waiter_id, T_PREEMPT, eg_waiter, args );
+    check_error( "t_start EGW2", err, ERR_NO_ERROR );
+    tm_wkafter( 2 );
+    err = eg_send( evgroup_id, 0x100 );
+    check_error( "eg_send 0x100 to EGR1", err, ERR_NO_ERROR );
+    err = ev_receive( HELPER, EV_ANY, 100, (ULONG *)NULL );
+    check_error( "ev_receive from EGW2", err, ERR_NO_ERROR );
+    check_error( "EGW2 eg_receive", helper_err, ERR_NO_ERROR );
+
+    puts( "\n.......... Deleting EGR1 with a helper task waiting on it wakes" );
+    puts( "           the helper with error 0x93." );
+    err = t_create( "EGW3", 30, 0, 0, T_LOCAL, &waiter_id );
+    check_error( "t_create EGW3", err, ERR_NO_ERROR );
+    args[1] = 0x200;
+    err = t_start( waiter_id, T_PREEMPT, eg_waiter, args );
+    check_error( "t_start EGW3", err, ERR_NO_ERROR );
+    tm_wkafter( 2 );
+    err = eg_ident( "EGR1", 0, &my_evgroup_id );
+    check_error( "eg_ident EGR1", err, ERR_NO_ERROR );
+    if ( my_evgroup_id != evgroup_id )
+        printf( "eg_ident for EGR1 returned ID %lx, expected %lx  <-- FAILED\r\n",
+                my_evgroup_id, evgroup_id );
+    err = eg_delete( evgroup_id );
+    check_error( "eg_delete EGR1", err, ERR_NO_ERROR );
+    err = ev_receive( HELPER, EV_ANY, 100, (ULONG *)NULL );
+    check_error( "ev_receive from EGW3", err, ERR_NO_ERROR );
+    check_error( "EGW3 eg_receive", helper_err, 0x93 );
+    err = eg_send( evgroup_id, 0x200 );
+    check_error( "eg_send to deleted EGR1", err, 0x05 );
+    err = eg_ident( "EGR1", 0, &my_evgroup_id );
+    check_error( "eg_ident deleted EGR1", err, 0x09 );
+}
+
+/*****************************************************************************
+**  pt_user
+**         Helper task for validate_buffer_checks... takes and returns a
+**         buffer, leaving blocks in its own cache, and waits to be told
+**         to exit.
+*****************************************************************************/
+void pt_user( ULONG partn_id, ULONG parent_id, ULONG dummy2, ULONG dummy3 )
+{
+    void *buffer;
+
+    helper_err = pt_getbuf( partn_id, &buffer );
+    if ( helper_err == ERR_NO_ERROR )
+        helper_err = pt_retbuf( partn_id, buffer );
+    ev_send( parent_id, HELPER );
+    ev_receive( HELPER, EV_ANY, 0, (ULONG *)NULL );
+
+    t_delete( 0L );
+}
+
+/*****************************************************************************
+**  validate_buffer_checks
+*****************************************************************************/
+void validate_buffer_checks( void )
+{
+    ULONG err;
+    ULONG partn_id;
+    ULONG numblks;
+    ULONG user_id;
+    ULONG args[4];
+    char *buf[3];
+
+    puts( "\r\n********** Partition buffer check validation:" );
+
+    err = pt_create( "PRT4", partition_4, partition_4, sizeof( partition_4 ),
+                     16, PT_NODEL | PT_CHECK, &partn_id, &numblks );
+    check_error( "pt_create PRT4", err, ERR_NO_ERROR );
+    err = pt_getbuf( partn_id, (void **)&buf[0] );
+    check_error( "pt_getbuf 1 from PRT4", err, ERR_NO_ERROR );
+    err = pt_getbuf( partn_id, (void **)&buf[1] );
+    check_error( "pt_getbuf 2 from PRT4", err, ERR_NO_ERROR );
+    err = pt_getbuf( partn_id, (void **)&buf[2] );
+    check_error( "pt_getbuf 3 from PRT4", err, ERR_NO_ERROR );
+
+    puts( "\n.......... Addresses off a block boundary or outside PRT4 are" );
+    puts( "           refused with error 0x2d." );
+    err = pt_retbuf( partn_id, (void *)(buf[0] + 1) );
+    check_error( "pt_retbuf inside a PRT4 block", err, 0x2d );
+    err = pt_retbuf( partn_id, (void *)&(partition_4[sizeof( partition_4 )]) );
+    check_error( "pt_retbuf past the end of PRT4", err, 0x2d );
+    err = pt_retbuf( partn_id, (void *)partition_1 );
+    check_error( "pt_retbuf of a PRT1 address to PRT4", err, 0x2d );
+
+    puts( "\n.......... A second return of a buffer is refused with error" );
+    puts( "           0x2f, whether or not the buffer was returned last." );
+    err = pt_retbuf( partn_id, (void *)buf[0] );
+    check_error( "pt_retbuf of buffer 1 to PRT4", err, ERR_NO_ERROR );
+    err = pt_retbuf( partn_id, (void *)buf[0] );
+    check_error( "pt_retbuf of buffer 1 again", err, 0x2f );
+    err = pt_retbuf( partn_id, (void *)buf[1] );
+    check_error( "pt_retbuf of buffer 2 to PRT4", err, ERR_NO_ERROR );
+    err = pt_retbuf( partn_id, (void *)buf[0] );
+    check_error( "pt_retbuf of buffer 1 a third time", err, 0x2f );
+
+    puts( "\n.......... PRT4 (PT_NODEL) cannot be deleted until its last" );
+    puts( "           buffer is returned." );
+    err = pt_delete( partn_id );
+    check_error( "pt_delete PRT4 with buffer 3 allocated", err, 0x2b );
+    err = pt_retbuf( partn_id, (void *)buf[2] );
+    check_error( "pt_retbuf of buffer 3 to PRT4", err, ERR_NO_ERROR );
+    err = pt_delete( partn_id );
+    check_error( "pt_delete PRT4", err, ERR_NO_ERROR );
+    err = pt_retbuf( partn_id, (void *)buf[2] );
+    check_error( "pt_retbuf to deleted PRT4", err, 0x05 );
+
+    puts( "\n.......... A PT_NOCHECK partition still refuses misaligned" );
+    puts( "           addresses, and can be deleted once its buffers are" );
+    puts( "           returned, though they sit in another task's cache." );
+    err = pt_create( "PRT5", partition_4, partition_4, sizeof( partition_4 ),
+                     16, PT_NODEL | PT_NOCHECK, &partn_id, &numblks );
+    check_error( "pt_create PRT5", err, ERR_NO_ERROR );
+    err = pt_getbuf( partn_id, (void **)&buf[0] );
+    check_error( "pt_getbuf 1 from PRT5", err, ERR_NO_ERROR );
+    err = pt_getbuf( partn_id, (void **)&buf[1] );
+    check_error( "pt_getbuf 2 from PRT5", err, ERR_NO_ERROR );
+    err = pt_retbuf( partn_id, (void *)(buf[0] + 2) );
+    check_error( "pt_retbuf inside a PRT5 block", err, 0x2d );
+    err = pt_retbuf( partn_id, (void *)buf[0] );
+    check_error( "pt_retbuf of buffer 1 to PRT5", err, ERR_NO_ERROR );
+    err = pt_delete( partn_id );
+    check_error( "pt_delete PRT5 with buffer 2 allocated", err, 0x2b );
+    err = pt_retbuf( partn_id, (void *)buf[1] );
+    check_error( "pt_retbuf of buffer 2 to PRT5", err, ERR_NO_ERROR );
+    args[0] = partn_id;
+    t_ident( (char *)NULL, 0, &args[1] );
+    args[2] = args[3] = 0;
+    err = t_create( "PTU1", 30, 0, 0, T_LOCAL, &user_id );
+    check_error( "t_create PTU1", err, ERR_NO_ERROR );
+    err = t_start( user_id, T_PREEMPT, pt_user, args );
+    check_error( "t_start PTU1", err, ERR_NO_ERROR );
+    err = ev_receive( HELPER, EV_ANY, 100, (ULONG *)NULL );
+    check_error( "ev_receive from PTU1", err, ERR_NO_ERROR );
+    check_error( "PTU1 pt_getbuf and pt_retbuf", helper_err, ERR_NO_ERROR );
+    err = pt_delete( partn_id );
+    check_error( "pt_delete PRT5 with blocks cached by PTU1", err,
+                 ERR_NO_ERROR );
+    err = ev_send( user_id, HELPER );
+    check_error( "ev_send to PTU1", err, ERR_NO_ERROR );
+}
+
+/*****************************************************************************
+**  validate_mapped_partitions
+*****************************************************************************/
+void validate_mapped_partitions( void )
+{
+    ULONG err;
+    ULONG partn_id;
+    ULONG numblks;
+    ULONG count;
+    char *buffer;
+    char *first_buf;
+
+    puts( "\r\n********** Library-mapped partition validation:" );
+
+    puts( "\n.......... A partition created with no memory gets 1 MB mapped" );
+    puts( "           by the library.  All 4096 256-byte buffers can be" );
+    puts( "           allocated, and they start out cleared." );
+    err = pt_create( "PRT6", (void *)NULL, (void *)NULL, 0x100000, 15,
+                     PT_DEL, &partn_id, &numblks );
+    check_error( "pt_create PRT6 with block size 15", err, 0x29 );
+    err = pt_create( "PRT6", (void *)NULL, (void *)NULL, 0x100000, 256,
+                     PT_DEL | PT_NODE(0), &partn_id, &numblks );
+    check_error( "pt_create PRT6 on node 0", err, ERR_NO_ERROR );
+    if ( numblks != 4096 )
+        printf( "pt_create PRT6 made %ld buffers, expected 4096  <-- FAILED\r\n",
+                numblks );
+    first_buf = (char *)NULL;
+    for ( count = 0; pt_getbuf( partn_id, (void **)&buffer ) == ERR_NO_ERROR;
+          count++ )
+    {
+        if ( (buffer[8] != 0) || (buffer[255] != 0) )
+            printf( "PRT6 buffer @ %p not cleared  <-- FAILED\r\n", buffer );
+        memset( buffer, 0x5a, 256 );
+        if ( first_buf == (char *)NULL )
+            first_buf = buffer;
+    }
+    if ( count != 4096 )
+        printf( "PRT6 gave %ld buffers, expected 4096  <-- FAILED\r\n", count );
+    err = pt_getbuf( partn_id, (void **)&buffer );
+    check_error( "pt_getbuf from empty PRT6", err, 0x2c );
+    err = pt_retbuf( partn_id, (void *)first_buf );
+    check_error( "pt_retbuf to PRT6", err, ERR_NO_ERROR );
+    err = pt_getbuf( partn_id, (void **)&buffer );
+    check_error( "pt_getbuf of returned PRT6 buffer", err, ERR_NO_ERROR );
+    err = pt_delete( partn_id );
+    check_error( "pt_delete PRT6 with buffers allocated", err, ERR_NO_ERROR );
+}
+
+/*****************************************************************************
+**  validate_growing_partitions
+*****************************************************************************/
+void validate_growing_partitions( void )
+{
+    ULONG err;
+    ULONG partn_id;
+    ULONG numblks;
+    ULONG count;
+    ULONG i;
+    char *bufaddr[256];
+    char *grown_first;
+    char *grown_last;
+
+    puts( "\r\n********** Growing partition validation:" );
+
+    err = pt_create( "PRT7", partition_4, partition_4, 8192, 0,
+                     PT_DEL | PT_GROW | PT_SHRINK, &partn_id, &numblks );
+    check_error( "pt_create PRT7 with block size 0", err, 0x29 );
+    err = pt_create( "PRT7", partition_4, partition_4, 8192, 64,
+                     PT_DEL | PT_GROW | PT_SHRINK, &partn_id, &numblks );
+    check_error( "pt_create PRT7 with 128 buffers", err, ERR_NO_ERROR );
+    err = pt_setlimit( partn_id, 2 );
+    check_error( "pt_setlimit PRT7 to 2 extents", err, ERR_NO_ERROR );
+    err = pt_setlimit( 0x7fff, 2 );
+    check_error( "pt_setlimit on nonexistent partition", err, 0x05 );
+
+    puts( "\n.......... PRT7 grows by one extent of 128 buffers when it runs" );
+    puts( "           dry, and then returns 0x2c at its limit of 2 extents." );
+    for ( count = 0; count < 256; count++ )
+    {
+        err = pt_getbuf( partn_id, (void **)&bufaddr[count] );
+        if ( err != ERR_NO_ERROR )
+            break;
+    }
+    if ( count != 256 )
+        printf( "PRT7 gave %ld buffers, expected 256  <-- FAILED\r\n", count );
+    err = pt_getbuf( partn_id, (void **)&grown_first );
+    check_error( "pt_getbuf from PRT7 at its limit", err, 0x2c );
+    grown_first = (char *)NULL;
+    grown_last = (char *)NULL;
+    for ( i = 0; i < count; i++ )
+    {
+        if ( (bufaddr[i] >= partition_4) &&
+             (bufaddr[i] < (partition_4 + 8192)) )
+            continue;
+        if ( (grown_first == (char *)NULL) || (bufaddr[i] < grown_first) )
+            grown_first = bufaddr[i];
+        if ( (grown_last == (char *)NULL) || (bufaddr[i] > grown_last) )
+            grown_last = bufaddr[i];
+    }
+    if ( (grown_first == (char *)NULL) ||
+         ((grown_last - grown_first) != (127 * 64)) )
+        printf( "PRT7 grown extent @ %p to %p not 128 buffers  <-- FAILED\r\n",
+                grown_first, grown_last );
+
+    puts( "\n.......... Once all buffers are returned, the grown extent is" );
+    puts( "           released, and its pages come back cleared.  Buffers" );
+    puts( "           come from the first extent before the released one is" );
+    puts( "           taken back." );
+    for ( i = 0; i < count; i++ )
+    {
+        if ( (bufaddr[i] >= partition_4) &&
+             (bufaddr[i] < (partition_4 + 8192)) )
+        {
+            err = pt_retbuf( partn_id, (void *)bufaddr[i] );
+            if ( err != ERR_NO_ERROR )
+                printf( "pt_retbuf to PRT7 returned %lx  <-- FAILED\r\n",
+                        err );
+        }
+    }
+    for ( i = 0; i < count; i++ )
+    {
+        if ( (bufaddr[i] < partition_4) ||
+             (bufaddr[i] >= (partition_4 + 8192)) )
+        {
+            memset( bufaddr[i], 0x5a, 64 );
+            err = pt_retbuf( partn_id, (void *)bufaddr[i] );
+            if ( err != ERR_NO_ERROR )
+                printf( "pt_retbuf to PRT7 returned %lx  <-- FAILED\r\n",
+                        err );
+        }
+    }
+    for ( i = 0; i < 128; i++ )
+    {
+        err = pt_getbuf( partn_id, (void **)&bufaddr[i] );
+        if ( (err != ERR_NO_ERROR) || (bufaddr[i] < partition_4) ||
+             (bufaddr[i] >= (partition_4 + 8192)) )
+        {
+            printf( "pt_getbuf %ld from PRT7 returned %lx @ %p  <-- FAILED\r\n",
+                    i, err, bufaddr[i] );
+            break;
+        }
+    }
+    err = pt_getbuf( partn_id, (void **)&bufaddr[128] );
+    check_error( "pt_getbuf from released extent of PRT7", err, ERR_NO_ERROR );
+    if ( (bufaddr[128] < grown_first) || (bufaddr[128] > grown_last) )
+        printf( "PRT7 buffer @ %p not in released extent  <-- FAILED\r\n",
+                bufaddr[128] );
+    if ( bufaddr[128][8] != 0 )
+        printf( "PRT7 buffer @ %p not released  <-- FAILED\r\n", bufaddr[128] );
+    err = pt_delete( partn_id );
+    check_error( "pt_delete PRT7", err, ERR_NO_ERROR );
+}
+
+/*****************************************************************************
+**  ts_freer
+**         Helper task for validate_ts_malloc... frees a block allocated
+**         by the creating task.
+*****************************************************************************/
+void ts_freer( ULONG blkaddr, ULONG parent_id, ULONG dummy2, ULONG dummy3 )
+{
+    ts_free( (void *)blkaddr );
+    ev_send( parent_id, HELPER );
+
+    t_delete( 0L );
+}
+
+/*****************************************************************************
+**  ts_class_in_use
+**         Returns the number of blocks in use in the smallest ts_malloc
+**         size class holding 'blksize' bytes, or in the class of blocks
+**         too large for any.
+*****************************************************************************/
+static ULONG ts_class_in_use( ULONG blksize )
+{
+    ts_mstat_t stats[15];
+    ULONG count;
+    ULONG i;
+
+    count = ts_mstats( stats, 15 );
+    for ( i = 0; i < count - 1; i++ )
+    {
+        if ( stats[i].blk_size >= blksize )
+            return( stats[i].in_use );
+    }
+    return( stats[count - 1].in_use );
+}
+
+/*****************************************************************************
+**  validate_ts_malloc
+*****************************************************************************/
+void validate_ts_malloc( void )
+{
+    static ULONG not_ts_block[16];
+    ULONG err;
+    ULONG in_use;
+    ULONG freer_id;
+    ULONG args[4];
+    ts_mstat_t stats[16];
+    char *block;
+    char *large_block;
+
+    puts( "\r\n********** Thread-safe malloc validation:" );
+
+    puts( "\n.......... ts_mstats reports 14 size classes and one for large" );
+    puts( "           blocks, and counts blocks in use in each." );
+    if ( ts_mstats( stats, 16 ) != 15 )
+        printf( "ts_mstats returned %ld classes, expected 15  <-- FAILED\r\n",
+                ts_mstats( stats, 16 ) );
+    if ( stats[14].blk_size != 0 )
+        printf( "ts_mstats large class size %ld, expected 0  <-- FAILED\r\n",
+                stats[14].blk_size );
+    in_use = ts_class_in_use( 100 );
+    block = (char *)ts_malloc( 100 );
+    if ( block == (char *)NULL )
+        puts( "ts_malloc of 100 bytes returned NULL  <-- FAILED" );
+    memset( block, 0x5a, 100 );
+    if ( ts_class_in_use( 100 ) != in_use + 1 )
+        printf( "ts_malloc left %ld blocks in use, expected %ld  <-- FAILED\r\n",
+                ts_class_in_use( 100 ), in_use + 1 );
+    ts_free( (void *)block );
+    if ( ts_class_in_use( 100 ) != in_use )
+        printf( "ts_free left %ld blocks in use, expected %ld  <-- FAILED\r\n",
+                ts_class_in_use( 100 ), in_use );
+
+    puts( "\n.......... Blocks too large for a size class come from malloc." );
+    in_use = ts_class_in_use( 0x100000 );
+    large_block = (char *)ts_malloc( 0x100000 );
+    if ( large_block == (char *)NULL )
+        puts( "ts_malloc of 1 MB returned NULL  <-- FAILED" );
+    memset( large_block, 0x5a, 0x100000 );
+    if ( ts_class_in_use( 0x100000 ) != in_use + 1 )
+        puts( "ts_malloc of 1 MB not counted as a large block  <-- FAILED" );
+    ts_free( (void *)large_block );
+    if ( ts_class_in_use( 0x100000 ) != in_use )
+        puts( "ts_free of 1 MB not counted as a large block  <-- FAILED" );
+
+    puts( "\n.......... A block may be freed by another task, and freeing" );
+    puts( "           NULL or a block not from ts_malloc does nothing." );
+    in_use = ts_class_in_use( 100 );
+    block = (char *)ts_malloc( 100 );
+    args[0] = (ULONG)block;
+    t_ident( (char *)NULL, 0, &args[1] );
+    args[2] = args[3] = 0;
+    err = t_create( "TSF1", 30, 0, 0, T_LOCAL, &freer_id );
+    check_error( "t_create TSF1", err, ERR_NO_ERROR );
+    err = t_start( freer_id, T_PREEMPT, ts_freer, args );
+    check_error( "t_start TSF1", err, ERR_NO_ERROR );
+    err = ev_receive( HELPER, EV_ANY, 100, (ULONG *)NULL );
+    check_error( "ev_receive from TSF1", err, ERR_NO_ERROR );
+    if ( ts_class_in_use( 100 ) != in_use )
+        printf( "ts_free by TSF1 left %ld blocks in use, expected %ld  <-- FAILED\r\n",
+                ts_class_in_use( 100 ), in_use );
+    ts_free( (void *)NULL );
+    ts_free( (void *)&(not_ts_block[8]) );
+    if ( ts_class_in_use( 100 ) != in_use )
+        puts( "ts_free of a foreign block changed the counts  <-- FAILED" );
+}
+
+/*****************************************************************************
+**  rn_waiter
+**         Helper task for validate_regions... waits for a segment the size
+**         of the whole region and returns it, passing back the result.
+*****************************************************************************/
+void rn_waiter( ULONG region_id, ULONG size, ULONG parent_id, ULONG dummy3 )
+{
+    void *segment;
+
+    helper_err = rn_getseg( region_id, size, RN_WAIT, 0, &segment );
+    if ( helper_err == ERR_NO_ERROR )
+        rn_retseg( region_id, segment );
+    ev_send( parent_id, HELPER );
+
+    t_delete( 0L );
+}
+
+/*****************************************************************************
+**  validate_regions
+*****************************************************************************/
+void validate_regions( void )
+{
+    ULONG err;
+    ULONG region_id;
+    ULONG my_region_id;
+    ULONG waiter_id;
+    ULONG asiz;
+    ULONG args[4];
+    rn_stat_t stats;
+    char *seg1;
+    char *seg2;
+    char *no_seg;
+
+    puts( "\r\n********** Region validation:" );
+
+    puts( "\n.......... Units must be a power of two of 16 bytes or more," );
+    puts( "           and regions word-aligned and big enough for a unit." );
+    err = rn_create( "RGN1", region_1, sizeof( region_1 ), 24, RN_NODEL,
+                     &region_id, &asiz );
+    check_error( "rn_create with 24-byte units", err, 0x1c );
+    err = rn_create( "RGN1", region_1, sizeof( region_1 ), 8, RN_NODEL,
+                     &region_id, &asiz );
+    check_error( "rn_create with 8-byte units", err, 0x1d );
+    err = rn_create( "RGN1", (char *)region_1 + 1, 4096, 16, RN_NODEL,
+                     &region_id, &asiz );
+    check_error( "rn_create at an odd address", err, 0x1b );
+    err = rn_create( "RGN1", region_1, 16, 16, RN_NODEL, &region_id, &asiz );
+    check_error( "rn_create of 16 bytes", err, 0x1e );
+    err = rn_create( "RGN1", region_1, sizeof( region_1 ), 16,
+                     RN_NODEL | RN_FIFO, &region_id, &asiz );
+    check_error( "rn_create RGN1", err, ERR_NO_ERROR );
+    err = rn_ident( "RGN1", 0, &my_region_id );
+    check_error( "rn_ident RGN1", err, ERR_NO_ERROR );
+    if ( my_region_id != region_id )
+        printf( "rn_ident for RGN1 returned ID %lx, expected %lx  <-- FAILED\r\n",
+                my_region_id, region_id );
+
+    puts( "\n.......... Segments of zero or more than the region's bytes" );
+    puts( "           are refused with 0x20 and 0x21." );
+    err = rn_getseg( region_id, 0, RN_NOWAIT, 0, (void **)&no_seg );
+    check_error( "rn_getseg of 0 bytes", err, 0x20 );
+    err = rn_getseg( region_id, asiz + 1, RN_NOWAIT, 0, (void **)&no_seg );
+    check_error( "rn_getseg of more than RGN1 holds", err, 0x21 );
+
+    puts( "\n.......... Two segments are allocated, then one the size of" );
+    puts( "           the region fails with 0x22 or times out with 0x01." );
+    err = rn_getseg( region_id, 100, RN_NOWAIT, 0, (void **)&seg1 );
+    check_error( "rn_getseg of 100 bytes", err, ERR_NO_ERROR );
+    err = rn_getseg( region_id, 1000, RN_WAIT, 0, (void **)&seg2 );
+    check_error( "rn_getseg of 1000 bytes", err, ERR_NO_ERROR );
+    memset( seg1, 0x5a, 100 );
+    memset( seg2, 0xa5, 1000 );
+    if ( (((unsigned long)seg1 & 15) != 0) ||
+         (((unsigned long)seg2 & 15) != 0) )
+        printf( "RGN1 segments @ %p and %p not on 16-byte units  <-- FAILED\r\n",
+                seg1, seg2 );
+    err = rn_stats( region_id, &stats );
+    check_error( "rn_stats RGN1", err, ERR_NO_ERROR );
+    if ( (stats.total_bytes != asiz) || (stats.used_segs != 2) )
+        printf( "rn_stats gave %ld bytes and %ld segments, expected %ld and 2  <-- FAILED\r\n",
+                stats.total_bytes, stats.used_segs, asiz );
+    err = rn_getseg( region_id, asiz, RN_NOWAIT, 0, (void **)&no_seg );
+    check_error( "rn_getseg of RGN1 size without waiting", err, 0x22 );
+    err = rn_getseg( region_id, asiz, RN_WAIT, 2, (void **)&no_seg );
+    check_error( "rn_getseg of RGN1 size with timeout", err, 0x01 );
+
+    puts( "\n.......... Bad returns give 0x23 (outside region), 0x24 (not" );
+    puts( "           a segment) and 0x25 (already free)." );
+    err = rn_retseg( region_id, (void *)partition_1 );
+    check_error( "rn_retseg outside RGN1", err, 0x23 );
+    err = rn_retseg( region_id, (void *)(seg2 + 8) );
+    check_error( "rn_retseg inside a segment", err, 0x24 );
+    err = rn_retseg( region_id, (void *)seg2 );
+    check_error( "rn_retseg of 1000-byte segment", err, ERR_NO_ERROR );
+    err = rn_retseg( region_id, (void *)seg2 );
+    check_error( "rn_retseg of 1000-byte segment again", err, 0x25 );
+
+    puts( "\n.......... A helper waiting for the whole region gets it when" );
+    puts( "           the last segment is returned.  RGN1 (RN_NODEL) cannot" );
+    puts( "           be deleted while a segment is allocated." );
+    args[0] = region_id;
+    args[1] = asiz;
+    t_ident( (char *)NULL, 0, &args[2] );
+    args[3] = 0;
+    err = t_create( "RNW1", 30, 0, 0, T_LOCAL, &waiter_id );
+    check_error( "t_create RNW1", err, ERR_NO_ERROR );
+    err = t_start( waiter_id, T_PREEMPT, rn_waiter, args );
+    check_error( "t_start RNW1", err, ERR_NO_ERROR );
+    tm_wkafter( 2 );
+    err = rn_delete( region_id );
+    check_error( "rn_delete RGN1 with a segment allocated", err, 0x1f );
+    err = rn_retseg( region_id, (void *)seg1 );
+    check_error( "rn_retseg of 100-byte segment", err, ERR_NO_ERROR );
+    err = ev_receive( HELPER, EV_ANY, 100, (ULONG *)NULL );
+    check_error( "ev_receive from RNW1", err, ERR_NO_ERROR );
+    check_error( "RNW1 rn_getseg", helper_err, ERR_NO_ERROR );
+    err = rn_delete( region_id );
+    check_error( "rn_delete RGN1", err, ERR_NO_ERROR );
+    err = rn_ident( "RGN1", 0, &my_region_id );
+    check_error( "rn_ident deleted RGN1", err, 0x09 );
+    err = rn_getseg( region_id, 100, RN_NOWAIT, 0, (void **)&no_seg );
+    check_error( "rn_getseg from deleted RGN1", err, 0x05 );
+
+    puts( "\n.......... Deleting an RN_DEL region with a helper waiting on" );
+    puts( "           it returns 0x27, and wakes the helper with 0x26." );
+    err = rn_create( "RGN2", (void *)NULL, 0x10000, 64, RN_DEL | RN_PRIOR,
+                     &region_id, &asiz );
+    check_error( "rn_create RGN2 in library memory", err, ERR_NO_ERROR );
+    err = rn_getseg( region_id, 64, RN_NOWAIT, 0, (void **)&seg1 );
+    check_error( "rn_getseg from RGN2", err, ERR_NO_ERROR );
+    args[0] = region_id;
+    args[1] = asiz;
+    err = t_create( "RNW2", 30, 0, 0, T_LOCAL, &waiter_id );
+    check_error( "t_create RNW2", err, ERR_NO_ERROR );
+    err = t_start( waiter_id, T_PREEMPT, rn_waiter, args );
+    check_error( "t_start RNW2", err, ERR_NO_ERROR );
+    tm_wkafter( 2 );
+    err = rn_delete( region_id );
+    check_error( "rn_delete RGN2 with RNW2 waiting", err, 0x27 );
+    err = ev_receive( HELPER, EV_ANY, 100, (ULONG *)NULL );
+    check_error( "ev_receive from RNW2", err, ERR_NO_ERROR );
+    check_error( "RNW2 rn_getseg", helper_err, 0x26 );
+}
+
+/*****************************************************************************
+**  validate_histograms
+*****************************************************************************/
+void validate_histograms( void )
+{
+    static hist_t hist;
+    static hist_t other;
+    unsigned long value;
+    unsigned long pct;
+    int bucket;
+
+    puts( "\r\n********** Benchmark histogram validation:" );
+
+    puts( "\n.......... Every value falls in a bucket whose range holds it," );
+    puts( "           and bucket ranges are within about 6% of the value." );
+    for ( value = 1; value < (1UL << 40); value += (value / 7) + 1 )
+    {
+        bucket = hist_bucket( value );
+        if ( (value > hist_bucket_top( bucket )) ||
+             ((bucket > 0) && (value <= hist_bucket_top( bucket - 1 ))) ||
+             ((hist_bucket_top( bucket ) - value) > (value / 16)) )
+        {
+            printf( "value %lu in bucket %d, top %lu  <-- FAILED\r\n",
+                    value, bucket, hist_bucket_top( bucket ) );
+            break;
+        }
+    }
+    if ( hist_bucket( ~0UL ) != (HIST_BUCKETS - 1) )
+        printf( "largest value in bucket %d, expected %d  <-- FAILED\r\n",
+                hist_bucket( ~0UL ), HIST_BUCKETS - 1 );
+
+    puts( "\n.......... Percentiles of 1..1000 come within a bucket of the" );
+    puts( "           exact values, and merged histograms add up." );
+    hist_init( &hist );
+    hist_init( &other );
+    for ( value = 1; value <= 500; value++ )
+        hist_record( &hist, value );
+    for ( value = 501; value <= 1000; value++ )
+        hist_record( &other, value );
+    hist_merge( &hist, &other );
+    if ( (hist.count != 1000) || (hist.min != 1) || (hist.max != 1000) ||
+         (hist.sum != 500500) )
+        printf( "merged histogram has %lu values %lu..%lu sum %lu  <-- FAILED\r\n",
+                hist.count, hist.min, hist.max, hist.sum );
+    for ( pct = 10; pct <= 100; pct += 10 )
+    {
+        value = hist_percentile( &hist, (double)pct );
+        if ( (value < pct * 10) || (value > (pct * 10) + (pct * 10) / 16) )
+            printf( "p%lu of 1..1000 is %lu  <-- FAILED\r\n", pct, value );
+    }
+    hist_init( &other );
+    if ( hist_percentile( &other, 50.0 ) != 0 )
+        puts( "percentile of an empty histogram not 0  <-- FAILED" );
+}
+
+/*****************************************************************************
+**  trace_lines
+**         Returns the number of events in a dumped trace file with the
+**         specified name and object ID, or -1 if the file cannot be read.
+*****************************************************************************/
+static int trace_lines( const char *filename, const char *name, ULONG objid )
+{
+    FILE *file;
+    char line[512];
+    char name_text[64];
+    char id_text[64];
+    int count;
+
+    if ( (file = fopen( filename, "r" )) == (FILE *)NULL )
+        return( -1 );
+    sprintf( name_text, "\"name\":\"%s\"", name );
+    sprintf( id_text, "\"id\":\"0x%lx\"", objid );
+    count = 0;
+    while ( fgets( line, sizeof( line ), file ) != (char *)NULL )
+    {
+        if ( (strstr( line, name_text ) != (char *)NULL) &&
+             (strstr( line, id_text ) != (char *)NULL) )
+            count++;
+    }
+    fclose( file );
+    return( count );
+}
+
+/*****************************************************************************
+**  validate_trace
+*****************************************************************************/
+void validate_trace( void )
+{
+    static const char trace_file[] = "/tmp/p2linux_validate_trace.json";
+    ULONG err;
+    ULONG queue_id;
+    ULONG msg[4];
+
+    puts( "\r\n********** Trace validation:" );
+
+    puts( "\n.......... Operations on TRQ1 while tracing appear once each in" );
+    puts( "           the dump.  Its deletion after tr_stop does not." );
+    tr_start();
+    err = q_create( "TRQ1", 4, Q_FIFO | Q_LIMIT, &queue_id );
+    check_error( "q_create TRQ1", err, ERR_NO_ERROR );
+    msg[0] = msg[1] = msg[2] = msg[3] = 0;
+    err = q_send( queue_id, msg );
+    check_error( "q_send to TRQ1", err, ERR_NO_ERROR );
+    err = q_receive( queue_id, Q_NOWAIT, 0, msg );
+    check_error( "q_receive from TRQ1", err, ERR_NO_ERROR );
+    tr_stop();
+    err = q_delete( queue_id );
+    check_error( "q_delete TRQ1", err, ERR_NO_ERROR );
+    err = tr_dump( trace_file );
+    check_error( "tr_dump", err, ERR_NO_ERROR );
+    if ( trace_lines( trace_file, "queue create", queue_id ) != 1 )
+        printf( "trace has %d TRQ1 creates, expected 1  <-- FAILED\r\n",
+                trace_lines( trace_file, "queue create", queue_id ) );
+    if ( trace_lines( trace_file, "queue send", queue_id ) != 1 )
+        printf( "trace has %d TRQ1 sends, expected 1  <-- FAILED\r\n",
+                trace_lines( trace_file, "queue send", queue_id ) );
+    if ( trace_lines( trace_file, "queue receive", queue_id ) != 1 )
+        printf( "trace has %d TRQ1 receives, expected 1  <-- FAILED\r\n",
+                trace_lines( trace_file, "queue receive", queue_id ) );
+    if ( trace_lines( trace_file, "queue delete", queue_id ) != 0 )
+        printf( "trace has %d TRQ1 deletes, expected 0  <-- FAILED\r\n",
+                trace_lines( trace_file, "queue delete", queue_id ) );
+
+    puts( "\n.......... tr_start discards the events recorded so far, and" );
+    puts( "           tr_dump returns errno if the file cannot be written." );
+    tr_start();
+    tr_stop();
+    err = tr_dump( trace_file );
+    check_error( "tr_dump after restart", err, ERR_NO_ERROR );
+    if ( trace_lines( trace_file, "queue create", queue_id ) != 0 )
+        puts( "trace still has TRQ1 create after tr_start  <-- FAILED" );
+    unlink( trace_file );
+    err = tr_dump( "/nonexistent/p2linux_trace.json" );
+    check_error( "tr_dump to a missing directory", err, ENOENT );
+}
+
+/*****************************************************************************
+**  sema4_lock_info
+**         Finds the lock profile entry for the sema4_lock of a semaphore.
+**         Returns FALSE if there is none.
+*****************************************************************************/
+static int sema4_lock_info( ULONG sema4_id, lk_info_t *found )
+{
+    static lk_info_t info[256];
+    ULONG count;
+    ULONG i;
+
+    count = lk_stats( info, 256 );
+    for ( i = 0; i < count; i++ )
+    {
+        if ( (strcmp( info[i].obj_class, "sema4" ) == 0) &&
+             (info[i].objid == sema4_id) &&
+             (strcmp( info[i].lock_name, "sema4_lock" ) == 0) )
+        {
+            *found = info[i];
+            return( TRUE );
+        }
+    }
+    return( FALSE );
+}
+
+/*****************************************************************************
+**  validate_lock_profile
+*****************************************************************************/
+void validate_lock_profile( void )
+{
+    ULONG err;
+    ULONG sema4_id;
+    ULONG acquires;
+    lk_info_t info;
+    int fd;
+    int i;
+
+    puts( "\r\n********** Lock profile validation:" );
+
+    puts( "\n.......... While profiling, the sema4_lock of LKS1 counts its" );
+    puts( "           acquisitions and condition variable waits, under the" );
+    puts( "           semaphore's ID and name." );
+    err = sm_create( "LKS1", 0, SM_FIFO, &sema4_id );
+    check_error( "sm_create LKS1", err, ERR_NO_ERROR );
+    lk_start();
+    for ( i = 0; i < 10; i++ )
+    {
+        sm_v( sema4_id );
+        sm_p( sema4_id, SM_NOWAIT, 0 );
+    }
+    err = sm_p( sema4_id, SM_WAIT, 2 );
+    check_error( "sm_p on LKS1 with timeout", err, 0x01 );
+    lk_stop();
+    if ( !sema4_lock_info( sema4_id, &info ) )
+        puts( "no lock profile for LKS1 sema4_lock  <-- FAILED" );
+    else
+    {
+        if ( strncmp( info.objname, "LKS1", 4 ) != 0 )
+            printf( "LKS1 sema4_lock profiled as %.4s  <-- FAILED\r\n",
+                    info.objname );
+        if ( (info.acquires < 21) || (info.cv_waits < 1) )
+            printf( "LKS1 sema4_lock acquired %ld times with %ld waits  <-- FAILED\r\n",
+                    info.acquires, info.cv_waits );
+        if ( info.hold_ns == 0 )
+            puts( "LKS1 sema4_lock hold time not recorded  <-- FAILED" );
+    }
+
+    puts( "\n.......... After lk_stop the counts stay as they were, and" );
+    puts( "           lk_start clears them." );
+    acquires = info.acquires;
+    sm_v( sema4_id );
+    sm_p( sema4_id, SM_NOWAIT, 0 );
+    if ( sema4_lock_info( sema4_id, &info ) && (info.acquires != acquires) )
+        printf( "LKS1 sema4_lock counted %ld acquisitions after lk_stop  <-- FAILED\r\n",
+                info.acquires - acquires );
+    lk_start();
+    lk_stop();
+    if ( sema4_lock_info( sema4_id, &info ) && (info.acquires != 0) )
+        printf( "LKS1 sema4_lock has %ld acquisitions after lk_start  <-- FAILED\r\n",
+                info.acquires );
+
+    puts( "\n.......... lk_dump writes the table, and lk_dump_on refuses an" );
+    puts( "           invalid signal number." );
+    fd = open( "/dev/null", O_WRONLY );
+    err = lk_dump( fd );
+    check_error( "lk_dump to /dev/null", err, ERR_NO_ERROR );
+    close( fd );
+    err = lk_dump_on( 12345 );
+    check_error( "lk_dump_on signal 12345", err, EINVAL );
+    err = sm_delete( sema4_id );
+    check_error( "sm_delete LKS1", err, ERR_NO_ERROR );
+}
+
+/*****************************************************************************
+**  Shared state for the producer and consumer helper tasks of
+**  validate_load
+*****************************************************************************/
+#define LOAD_PRODUCERS  4
+#define LOAD_CONSUMERS  3
+#define LOAD_MSGS       50
+
+static ULONG load_queue_id;
+static ULONG load_credits_id;
+static ULONG load_done_id;
+static ULONG load_received[LOAD_CONSUMERS];
+static ULONG load_sums[LOAD_CONSUMERS];
+static ULONG load_send_errors;
+
+/*****************************************************************************
+**  load_producer
+**         Helper task for validate_load... sends LOAD_MSGS numbered
+**         messages, taking a credit for each so that no more than 16 are
+**         outstanding.
+*****************************************************************************/
+void load_producer( ULONG index, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    ULONG msg[4];
+    ULONG i;
+
+    for ( i = 1; i <= LOAD_MSGS; i++ )
+    {
+        msg[0] = index;
+        msg[1] = i;
+        msg[2] = msg[3] = 0;
+        sm_p( load_credits_id, SM_WAIT, 0 );
+        if ( q_send( load_queue_id, msg ) != ERR_NO_ERROR )
+            load_send_errors++;
+    }
+    sm_v( load_done_id );
+
+    t_delete( 0L );
+}
+
+/*****************************************************************************
+**  load_consumer
+**         Helper task for validate_load... receives messages until it gets
+**         one numbered 0, counting and summing the numbers and returning
+**         a credit for each.
+*****************************************************************************/
+void load_consumer( ULONG index, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    ULONG msg[4];
+
+    for ( ;; )
+    {
+        if ( q_receive( load_queue_id, Q_WAIT, 0, msg ) != ERR_NO_ERROR )
+        {
+            load_send_errors++;
+            break;
+        }
+        if ( msg[1] == 0 )
+            break;
+        load_received[index]++;
+        load_sums[index] += msg[1];
+        sm_v( load_credits_id );
+    }
+    sm_v( load_done_id );
+
+    t_delete( 0L );
+}
+
+/*****************************************************************************
+**  validate_load
+*****************************************************************************/
+void validate_load( void )
+{
+    ULONG err;
+    ULONG task_id;
+    ULONG received;
+    ULONG sum;
+    ULONG msg[4];
+    ULONG args[4];
+    ULONG i;
+
+    puts( "\r\n********** Producer / consumer load validation:" );
+
+    puts( "\n.......... Four producers send 50 messages each through a" );
+    puts( "           queue to three consumers, with at most 16 messages" );
+    puts( "           outstanding.  Every message arrives exactly once." );
+    err = q_create( "LDQ1", 16 + LOAD_CONSUMERS, Q_FIFO | Q_LIMIT,
+                    &load_queue_id );
+    check_error( "q_create LDQ1", err, ERR_NO_ERROR );
+    err = sm_create( "LDS2", 16, SM_FIFO, &load_credits_id );
+    check_error( "sm_create LDS2", err, ERR_NO_ERROR );
+    err = sm_create( "LDS1", 0, SM_FIFO, &load_done_id );
+    check_error( "sm_create LDS1", err, ERR_NO_ERROR );
+    load_send_errors = 0;
+    args[1] = args[2] = args[3] = 0;
+    for ( i = 0; i < LOAD_CONSUMERS; i++ )
+    {
+        load_received[i] = 0;
+        load_sums[i] = 0;
+        args[0] = i;
+        t_create( "LDC ", 30, 0, 0, T_LOCAL, &task_id );
+        err = t_start( task_id, T_PREEMPT | T_TSLICE, load_consumer, args );
+        check_error( "t_start consumer", err, ERR_NO_ERROR );
+    }
+    for ( i = 0; i < LOAD_PRODUCERS; i++ )
+    {
+        args[0] = i;
+        t_create( "LDP ", 30, 0, 0, T_LOCAL, &task_id );
+        err = t_start( task_id, T_PREEMPT | T_TSLICE, load_producer, args );
+        check_error( "t_start producer", err, ERR_NO_ERROR );
+    }
+    for ( i = 0; i < LOAD_PRODUCERS; i++ )
+    {
+        err = sm_p( load_done_id, SM_WAIT, 1000 );
+        check_error( "sm_p for a producer", err, ERR_NO_ERROR );
+    }
+    msg[0] = msg[1] = msg[2] = msg[3] = 0;
+    for ( i = 0; i < LOAD_CONSUMERS; i++ )
+        q_send( load_queue_id, msg );
+    for ( i = 0; i < LOAD_CONSUMERS; i++ )
+    {
+        err = sm_p( load_done_id, SM_WAIT, 1000 );
+        check_error( "sm_p for a consumer", err, ERR_NO_ERROR );
+    }
+
+    received = 0;
+    sum = 0;
+    for ( i = 0; i < LOAD_CONSUMERS; i++ )
+    {
+        received += load_received[i];
+        sum += load_sums[i];
+    }
+    if ( (received != LOAD_PRODUCERS * LOAD_MSGS) ||
+         (sum != LOAD_PRODUCERS * (LOAD_MSGS * (LOAD_MSGS + 1) / 2)) ||
+         (load_send_errors != 0) )
+        printf( "consumers got %ld messages summing to %ld, expected %d and %d  <-- FAILED\r\n",
+                received, sum, LOAD_PRODUCERS * LOAD_MSGS,
+                LOAD_PRODUCERS * (LOAD_MSGS * (LOAD_MSGS + 1) / 2) );
+    err = q_delete( load_queue_id );
+    check_error( "q_delete LDQ1", err, ERR_NO_ERROR );
+    err = sm_delete( load_done_id );
+    check_error( "sm_delete LDS1", err, ERR_NO_ERROR );
+    err = sm_delete( load_credits_id );
+    check_error( "sm_delete LDS2", err, ERR_NO_ERROR );
+}
+
+/*****************************************************************************
+**  Shared state for the helper tasks of validate_simulation
+*****************************************************************************/
+static ULONG vt_mutex_id;
+static ULONG vt_queue_id;
+static ULONG vt_sema4_id;
+static ULONG vt_got_mutex_at;
+static ULONG vt_event_timeout_at;
+static ULONG vt_got_msg_at;
+static ULONG vt_sema4_timeout_at;
+static ULONG vt_errors;
+
+/*****************************************************************************
+**  vt_holder
+**         Helper task for validate_simulation... holds the mutex for 100
+**         ticks, then sends a message 50 ticks after releasing it.
+*****************************************************************************/
+void vt_holder( ULONG dummy0, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    ULONG msg[4];
+
+    if ( mu_lock( vt_mutex_id, MU_WAIT, 0 ) != ERR_NO_ERROR )
+        vt_errors++;
+    tm_wkafter( 100 );
+    if ( mu_unlock( vt_mutex_id ) != ERR_NO_ERROR )
+        vt_errors++;
+    tm_wkafter( 50 );
+    msg[0] = 0x5555;
+    msg[1] = msg[2] = msg[3] = 0;
+    if ( q_send( vt_queue_id, msg ) != ERR_NO_ERROR )
+        vt_errors++;
+
+    t_delete( 0L );
+}
+
+/*****************************************************************************
+**  vt_waiter
+**         Helper task for validate_simulation... waits on the mutex, on
+**         its events, on the queue and on the semaphore in turn, noting
+**         the virtual time at which each wait ends.
+*****************************************************************************/
+void vt_waiter( ULONG dummy0, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    ULONG msg[4];
+    ULONG events;
+
+    if ( mu_lock( vt_mutex_id, MU_WAIT, 0 ) != ERR_NO_ERROR )
+        vt_errors++;
+    vt_got_mutex_at = sim_ticks();
+    if ( mu_unlock( vt_mutex_id ) != ERR_NO_ERROR )
+        vt_errors++;
+
+    if ( ev_receive( EVENT2, EV_WAIT | EV_ALL, 20, &events ) != 0x01 )
+        vt_errors++;
+    vt_event_timeout_at = sim_ticks();
+
+    if ( (q_receive( vt_queue_id, Q_WAIT, 0, msg ) != ERR_NO_ERROR) ||
+         (msg[0] != 0x5555) )
+        vt_errors++;
+    vt_got_msg_at = sim_ticks();
+
+    if ( sm_p( vt_sema4_id, SM_WAIT, 10 ) != 0x01 )
+        vt_errors++;
+    vt_sema4_timeout_at = sim_ticks();
+
+    t_delete( 0L );
+}
+
+/*****************************************************************************
+**  vt_blocker
+**         Helper task for validate_simulation... waits forever on the
+**         empty queue.
+*****************************************************************************/
+void vt_blocker( ULONG dummy0, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    ULONG msg[4];
+
+    q_receive( vt_queue_id, Q_WAIT, 0, msg );
+
+    t_delete( 0L );
+}
+
+/*****************************************************************************
+**  vt_ticker
+**         Helper task for validate_simulation... sleeps 10 ticks at a time
+**         forever.
+*****************************************************************************/
+void vt_ticker( ULONG dummy0, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    for ( ;; )
+        tm_wkafter( 10 );
+}
+
+/*****************************************************************************
+**  vt_simulate - runs the simulation checks in a child process, since tasks
+**                started after sim_start() all run under the simulator.
+**                Returns the exit status for the child.
+*****************************************************************************/
+static int vt_simulate( void )
+{
+    struct timeval before, after;
+    ULONG err;
+    ULONG task_id;
+    ULONG args[4];
+    ULONG ticks;
+    long msecs;
+
+    err = sim_run( 0 );
+    check_error( "sim_run before sim_start", err, 0x96 );
+
+    sim_start( 0 );
+    err = mu_create( "VTM1", MU_PRIO_INHERIT, 0, &vt_mutex_id );
+    check_error( "mu_create VTM1", err, ERR_NO_ERROR );
+    err = q_create( "VTQ1", 4, Q_FIFO | Q_LIMIT, &vt_queue_id );
+    check_error( "q_create VTQ1", err, ERR_NO_ERROR );
+    err = sm_create( "VTS1", 0, SM_FIFO, &vt_sema4_id );
+    check_error( "sm_create VTS1", err, ERR_NO_ERROR );
+    args[0] = args[1] = args[2] = args[3] = 0;
+    vt_errors = 0;
+
+    puts( "\n.......... A task holding a mutex for 100 ticks, then sending" );
+    puts( "           a message 50 ticks later, runs against a task which" );
+    puts( "           waits on the mutex, its events (20 tick timeout), the" );
+    puts( "           queue and a semaphore (10 tick timeout).  Every wait" );
+    puts( "           ends on the virtual tick it should." );
+    t_create( "VTH ", 30, 0, 0, T_LOCAL, &task_id );
+    err = t_start( task_id, T_PREEMPT, vt_holder, args );
+    check_error( "t_start holder", err, ERR_NO_ERROR );
+    t_create( "VTW ", 20, 0, 0, T_LOCAL, &task_id );
+    err = t_start( task_id, T_PREEMPT, vt_waiter, args );
+    check_error( "t_start waiter", err, ERR_NO_ERROR );
+    err = sim_run( 0 );
+    check_error( "sim_run until the tasks are deleted", err, ERR_NO_ERROR );
+    if ( (vt_got_mutex_at != 100) || (vt_event_timeout_at != 120) ||
+         (vt_got_msg_at != 150) || (vt_sema4_timeout_at != 160) ||
+         (sim_ticks() != 160) || (vt_errors != 0) )
+        printf( "waits ended at ticks %ld, %ld, %ld and %ld, run at %ld, %ld errors  <-- FAILED\r\n",
+                vt_got_mutex_at, vt_event_timeout_at, vt_got_msg_at,
+                vt_sema4_timeout_at, sim_ticks(), vt_errors );
+    else
+        puts( "waits ended at ticks 100, 120, 150 and 160 as expected" );
+
+    puts( "\n.......... A task waiting forever on an empty queue leaves" );
+    puts( "           nothing to run." );
+    t_create( "VTB ", 20, 0, 0, T_LOCAL, &task_id );
+    err = t_start( task_id, T_PREEMPT, vt_blocker, args );
+    check_error( "t_start blocker", err, ERR_NO_ERROR );
+    err = sim_run( 0 );
+    check_error( "sim_run with every task blocked", err, 0x95 );
+
+    puts( "\n.......... A task sleeping 10 ticks at a time runs until a" );
+    puts( "           1000 tick limit, in far less real time." );
+    t_create( "VTT ", 20, 0, 0, T_LOCAL, &task_id );
+    err = t_start( task_id, T_PREEMPT, vt_ticker, args );
+    check_error( "t_start ticker", err, ERR_NO_ERROR );
+    ticks = sim_ticks();
+    gettimeofday( &before, (struct timezone *)NULL );
+    err = sim_run( 1000 );
+    gettimeofday( &after, (struct timezone *)NULL );
+    check_error( "sim_run with a tick limit", err, 0x01 );
+    msecs = (after.tv_sec - before.tv_sec) * 1000 +
+            (after.tv_usec - before.tv_usec) / 1000;
+    if ( (sim_ticks() - ticks != 1000) || (msecs >= 2000) )
+        printf( "ran %ld ticks in %ld ms, expected 1000 ticks in under 2000 ms  <-- FAILED\r\n",
+                sim_ticks() - ticks, msecs );
+    else
+        puts( "ran 1000 ticks in under 2000 ms as expected" );
+
+    return( 0 );
+}
+
+/*****************************************************************************
+**  validate_simulation
+*****************************************************************************/
+void validate_simulation( void )
+{
+    pid_t child;
+    int status;
+
+    puts( "\r\n********** Simulation mode validation:" );
+
+    status = 0;
+
+    /*
+    **  The child runs with an alarm set, in case the simulator hangs.
+    */
+    fflush( stdout );
+    if ( (child = fork()) == 0 )
+    {
+        alarm( 30 );
+        status = vt_simulate();
+        fflush( stdout );
+        _exit( status );
+    }
+    if ( (child < 0) || (waitpid( child, &status, 0 ) != child) ||
+         !WIFEXITED( status ) || (WEXITSTATUS( status ) != 0) )
+        printf( "simulation child process failed, status %x  <-- FAILED\r\n",
+                status );
+}
+
+/*****************************************************************************
+**  Shared state for the helper tasks of validate_mn_tasks
+*****************************************************************************/
+#define MT_ROUNDS  100
+
+static ULONG mt_mutex_id;
+static ULONG mt_condvar_id;
+static ULONG mt_sema4_id;
+static ULONG mt_ping_id;
+static ULONG mt_pong_id;
+static ULONG mt_done_id;
+static ULONG mt_rounds;
+static ULONG mt_errors;
+static ULONG mt_results[12];
+
+static const char *mt_calls[12] =
+{
+    "mu_create", "mu_ident", "mu_lock", "mu_unlock", "mu_delete",
+    "cv_create", "cv_ident", "cv_wait", "cv_smwait", "cv_signal",
+    "cv_broadcast", "cv_delete"
+};
+
+/*****************************************************************************
+**  mt_misuser
+**         Helper task for validate_mn_tasks... makes each mutex and
+**         condition variable call from an M:N task.
+*****************************************************************************/
+void mt_misuser( ULONG dummy0, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    ULONG id;
+
+    mt_results[0] = mu_create( "MTM2", MU_PRIO_INHERIT, 0, &id );
+    mt_results[1] = mu_ident( "MTM1", 0, &id );
+    mt_results[2] = mu_lock( mt_mutex_id, MU_WAIT, 0 );
+    mt_results[3] = mu_unlock( mt_mutex_id );
+    mt_results[4] = mu_delete( mt_mutex_id );
+    mt_results[5] = cv_create( "MTC2", CV_FIFO, &id );
+    mt_results[6] = cv_ident( "MTC1", 0, &id );
+    mt_results[7] = cv_wait( mt_condvar_id, mt_mutex_id, 1 );
+    mt_results[8] = cv_smwait( mt_condvar_id, mt_sema4_id, 1 );
+    mt_results[9] = cv_signal( mt_condvar_id );
+    mt_results[10] = cv_broadcast( mt_condvar_id );
+    mt_results[11] = cv_delete( mt_condvar_id );
+    sm_v( mt_done_id );
+
+    t_delete( 0L );
+}
+
+/*****************************************************************************
+**  mt_pinger
+**         Helper task for validate_mn_tasks... sends MT_ROUNDS numbered
+**         messages to the ponger, waiting for each to come back.
+*****************************************************************************/
+void mt_pinger( ULONG dummy0, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    ULONG msg[4];
+    ULONG i;
+
+    for ( i = 1; i <= MT_ROUNDS; i++ )
+    {
+        msg[0] = i;
+        msg[1] = msg[2] = msg[3] = 0;
+        if ( (q_send( mt_ping_id, msg ) != ERR_NO_ERROR) ||
+             (q_receive( mt_pong_id, Q_WAIT, 0, msg ) != ERR_NO_ERROR) ||
+             (msg[0] != i) )
+            mt_errors++;
+        else
+            mt_rounds++;
+        if ( (i % 10) == 0 )
+            tm_wkafter( 1 );
+    }
+    msg[0] = 0;
+    q_send( mt_ping_id, msg );
+    sm_v( mt_done_id );
+
+    t_delete( 0L );
+}
+
+/*****************************************************************************
+**  mt_ponger
+**         Helper task for validate_mn_tasks... returns each message the
+**         pinger sends until it gets one numbered 0.
+*****************************************************************************/
+void mt_ponger( ULONG dummy0, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    ULONG msg[4];
+
+    for ( ;; )
+    {
+        if ( q_receive( mt_ping_id, Q_WAIT, 0, msg ) != ERR_NO_ERROR )
+        {
+            mt_errors++;
+            break;
+        }
+        if ( msg[0] == 0 )
+            break;
+        if ( q_send( mt_pong_id, msg ) != ERR_NO_ERROR )
+            mt_errors++;
+    }
+    sm_v( mt_done_id );
+
+    t_delete( 0L );
+}
+
+/*****************************************************************************
+**  mt_schedule - runs the M:N checks in a child process, since tasks
+**                started after mn_start() all run on the workers.
+**                Returns the exit status for the child.
+*****************************************************************************/
+static int mt_schedule( void )
+{
+    ULONG err;
+    ULONG task_id;
+    ULONG args[4];
+    int i;
+
+    err = mu_create( "MTM1", MU_PRIO_INHERIT, 0, &mt_mutex_id );
+    check_error( "mu_create MTM1", err, ERR_NO_ERROR );
+    err = cv_create( "MTC1", CV_FIFO, &mt_condvar_id );
+    check_error( "cv_create MTC1", err, ERR_NO_ERROR );
+    err = sm_create( "MTS1", 1, SM_FIFO, &mt_sema4_id );
+    check_error( "sm_create MTS1", err, ERR_NO_ERROR );
+    err = sm_create( "MTS2", 0, SM_FIFO, &mt_done_id );
+    check_error( "sm_create MTS2", err, ERR_NO_ERROR );
+    err = q_create( "MTQ1", 4, Q_FIFO | Q_LIMIT, &mt_ping_id );
+    check_error( "q_create MTQ1", err, ERR_NO_ERROR );
+    err = q_create( "MTQ2", 4, Q_FIFO | Q_LIMIT, &mt_pong_id );
+    check_error( "q_create MTQ2", err, ERR_NO_ERROR );
+
+    err = mn_start( 2, MN_STEAL );
+    check_error( "mn_start with two stealing workers", err, ERR_NO_ERROR );
+    err = mn_start( 2, 0 );
+    check_error( "mn_start again", err, 0x97 );
+    args[0] = args[1] = args[2] = args[3] = 0;
+    mt_rounds = 0;
+    mt_errors = 0;
+
+    puts( "\n.......... Every mutex and condition variable call made from an" );
+    puts( "           M:N task returns 0x0B." );
+    t_create( "MTX ", 20, 0, 0, T_LOCAL, &task_id );
+    err = t_start( task_id, T_PREEMPT, mt_misuser, args );
+    check_error( "t_start misuser", err, ERR_NO_ERROR );
+    err = sm_p( mt_done_id, SM_WAIT, 500 );
+    check_error( "sm_p for the misuser", err, ERR_NO_ERROR );
+    for ( i = 0; i < 12; i++ )
+        check_error( mt_calls[i], mt_results[i], 0x0B );
+
+    puts( "\n.......... Two M:N tasks pass 100 messages back and forth over" );
+    puts( "           two queues, switching contexts at every wait." );
+    t_create( "MTP ", 20, 0, 0, T_LOCAL, &task_id );
+    err = t_start( task_id, T_PREEMPT, mt_ponger, args );
+    check_error( "t_start ponger", err, ERR_NO_ERROR );
+    t_create( "MTI ", 20, 0, 0, T_LOCAL, &task_id );
+    err = t_start( task_id, T_PREEMPT, mt_pinger, args );
+    check_error( "t_start pinger", err, ERR_NO_ERROR );
+    for ( i = 0; i < 2; i++ )
+    {
+        err = sm_p( mt_done_id, SM_WAIT, 500 );
+        check_error( "sm_p for a ping-pong task", err, ERR_NO_ERROR );
+    }
+    if ( (mt_rounds != MT_ROUNDS) || (mt_errors != 0) )
+        printf( "%ld rounds completed with %ld errors, expected %d and 0  <-- FAILED\r\n",
+                mt_rounds, mt_errors, MT_ROUNDS );
+    else
+        printf( "%d rounds completed as expected\r\n", MT_ROUNDS );
+
+    return( 0 );
+}
+
+/*****************************************************************************
+**  validate_mn_tasks
+*****************************************************************************/
+void validate_mn_tasks( void )
+{
+    pid_t child;
+    int status;
+
+    puts( "\r\n********** M:N scheduler validation:" );
+
+    status = 0;
+
+    /*
+    **  The child runs with an alarm set, in case a task context hangs.
+    */
+    fflush( stdout );
+    if ( (child = fork()) == 0 )
+    {
+        alarm( 30 );
+        status = mt_schedule();
+        fflush( stdout );
+        _exit( status );
+    }
+    if ( (child < 0) || (waitpid( child, &status, 0 ) != child) ||
+         !WIFEXITED( status ) || (WEXITSTATUS( status ) != 0) )
+        printf( "M:N child process failed, status %x  <-- FAILED\r\n",
+                status );
+}
+
+/*****************************************************************************
+**  validate_init - checks the result of the p2linux_init() call made by
+**                  user_sysroot, that later calls are refused, and that the
+**                  semaphore limit it set is enforced.
+*****************************************************************************/
+static ULONG init_err;
+
+#define INIT_MAX_SEMA4S 64
+
+void validate_init( void )
+{
+    p2pt_config_t config;
+    ULONG sema4_ids[INIT_MAX_SEMA4S + 1];
+    ULONG err;
+    int count;
+
+    puts( "\r\n********** Startup configuration validation:" );
+
+    check_error( "p2linux_init from user_sysroot", init_err, ERR_NO_ERROR );
+
+    memset( (void *)&config, 0, sizeof( config ) );
+    err = p2linux_init( (const p2pt_config_t *)NULL );
+    check_error( "p2linux_init with no configuration", err, EINVAL );
+    err = p2linux_init( &config );
+    check_error( "p2linux_init called again", err, EBUSY );
+
+    /*
+    **  Take semaphores until the limit, less those the suite already holds,
+    **  is reached.  Then one more may be created once one is deleted.
+    */
+    count = 0;
+    do
+    {
+        err = sm_create( "INIT", 0, SM_FIFO, &(sema4_ids[count]) );
+        if ( err == ERR_NO_ERROR )
+            count++;
+    } while ( (err == ERR_NO_ERROR) && (count <= INIT_MAX_SEMA4S) );
+    check_error( "sm_create beyond max_sema4s", err, 0x41 );
+    printf( "%d semaphores created within the limit\r\n", count );
+    if ( count == 0 )
+        printf( "No semaphore could be created  <-- FAILED\r\n" );
+    else
+    {
+        err = sm_delete( sema4_ids[--count] );
+        check_error( "sm_delete at the limit", err, ERR_NO_ERROR );
+        err = sm_create( "INIT", 0, SM_FIFO, &(sema4_ids[count]) );
+        check_error( "sm_create after sm_delete", err, ERR_NO_ERROR );
+        if ( err == ERR_NO_ERROR )
+            count++;
+    }
+    while ( count > 0 )
+        sm_delete( sema4_ids[--count] );
+}
+
+/*****************************************************************************
+**  Static configuration table entries, numbered from 1 for each class in
+**  table order, as the library assigns their IDs.  The table is empty
+**  unless the suite is built with P2PT_CONFIG naming one (see Makefile_test).
+*****************************************************************************/
+enum sc_tids
+{
+    SC_TID_NONE,
+#define P2PT_TASK( id, name, priority, sstack, ustack, flags ) id,
+#include "p2ptstatic.h"
+    SC_TID_END
+};
+
+enum sc_qids
+{
+    SC_QID_NONE,
+#define P2PT_QUEUE( id, name, count, flags ) id,
+#include "p2ptstatic.h"
+    SC_QID_END
+};
+
+enum sc_smids
+{
+    SC_SMID_NONE,
+#define P2PT_SEMA4( id, name, count, flags ) id,
+#include "p2ptstatic.h"
+    SC_SMID_END
+};
+
+enum sc_ptids
+{
+    SC_PTID_NONE,
+#define P2PT_PARTITION( id, name, length, bsize, flags ) id,
+#include "p2ptstatic.h"
+    SC_PTID_END
+};
+
+#define SC_MAX_BUFS 64
+
+static ULONG sc_done_id;
+
+/*****************************************************************************
+**  sc_task
+**         Helper task for validate_static_config... run in a static task,
+**         signals that it started, then waits for an event before deleting
+**         itself.
+*****************************************************************************/
+void sc_task( ULONG dummy0, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    ULONG events;
+
+    sm_v( sc_done_id );
+    ev_receive( 0x01, EV_ALL, 0, &events );
+
+    t_delete( 0L );
+}
+
+/*****************************************************************************
+**  check_static_task - checks that a static task is found by name with the
+**                      ID of its table entry, and that it starts only once.
+*****************************************************************************/
+void check_static_task( char *name, ULONG tid )
+{
+    ULONG id;
+    ULONG err;
+
+    printf( "\r\nStatic task %.4s, ID %lx\r\n", name, tid );
+    err = t_ident( name, 0, &id );
+    check_error( "t_ident", err, ERR_NO_ERROR );
+    if ( (err == ERR_NO_ERROR) && (id != tid) )
+        printf( "t_ident returned ID %lx  <-- FAILED\r\n", id );
+
+    err = t_start( tid, T_PREEMPT, sc_task, (ULONG *)NULL );
+    check_error( "t_start", err, ERR_NO_ERROR );
+    if ( err != ERR_NO_ERROR )
+        return;
+    err = sm_p( sc_done_id, SM_WAIT, 100 );
+    check_error( "sm_p for task start", err, ERR_NO_ERROR );
+    err = t_start( tid, T_PREEMPT, sc_task, (ULONG *)NULL );
+    check_error( "t_start of running task", err, 0x12 );
+    ev_send( tid, 0x01 );
+}
+
+/*****************************************************************************
+**  check_static_queue - checks that a static queue is found by name with the
+**                       ID of its table entry and holds 'count' messages.
+*****************************************************************************/
+void check_static_queue( char *name, ULONG qid, ULONG count,
+                         ULONG flags )
+{
+    ULONG msg[4];
+    ULONG id;
+    ULONG err;
+    ULONG i;
+
+    printf( "\r\nStatic queue %.4s, ID %lx\r\n", name, qid );
+    err = q_ident( name, 0, &id );
+    check_error( "q_ident", err, ERR_NO_ERROR );
+    if ( (err == ERR_NO_ERROR) && (id != qid) )
+        printf( "q_ident returned ID %lx  <-- FAILED\r\n", id );
+
+    msg[1] = msg[2] = msg[3] = 0;
+    for ( i = 0, err = ERR_NO_ERROR; (i < count) && (err == ERR_NO_ERROR);
+          i++ )
+    {
+        msg[0] = i;
+        err = q_send( qid, msg );
+    }
+    check_error( "q_send up to count", err, ERR_NO_ERROR );
+    if ( flags & Q_LIMIT )
+    {
+        err = q_send( qid, msg );
+        check_error( "q_send beyond count", err, 0x35 );
+    }
+
+    for ( i = 0, err = ERR_NO_ERROR; (i < count) && (err == ERR_NO_ERROR);
+          i++ )
+    {
+        err = q_receive( qid, Q_NOWAIT, 0, msg );
+        if ( (err == ERR_NO_ERROR) && (msg[0] != i) )
+            printf( "q_receive returned message %lx for %lx  <-- FAILED\r\n",
+                    msg[0], i );
+    }
+    check_error( "q_receive up to count", err, ERR_NO_ERROR );
+    err = q_receive( qid, Q_NOWAIT, 0, msg );
+    check_error( "q_receive from empty queue", err, 0x37 );
+}
+
+/*****************************************************************************
+**  check_static_sema4 - checks that a static semaphore is found by name with
+**                       the ID of its table entry and holds 'count' tokens.
+*****************************************************************************/
+void check_static_sema4( char *name, ULONG smid, ULONG count )
+{
+    ULONG id;
+    ULONG err;
+    ULONG i;
+
+    printf( "\r\nStatic semaphore %.4s, ID %lx\r\n", name, smid );
+    err = sm_ident( name, 0, &id );
+    check_error( "sm_ident", err, ERR_NO_ERROR );
+    if ( (err == ERR_NO_ERROR) && (id != smid) )
+        printf( "sm_ident returned ID %lx  <-- FAILED\r\n", id );
+
+    for ( i = 0, err = ERR_NO_ERROR; (i < count) && (err == ERR_NO_ERROR);
+          i++ )
+        err = sm_p( smid, SM_NOWAIT, 0 );
+    check_error( "sm_p of initial tokens", err, ERR_NO_ERROR );
+    err = sm_p( smid, SM_NOWAIT, 0 );
+    check_error( "sm_p with no tokens", err, 0x42 );
+    for ( i = 0; i < count; i++ )
+        sm_v( smid );
+}
+
+/*****************************************************************************
+**  check_static_partition - checks that a static partition is found by name
+**                           with the ID of its table entry and holds
+**                           length / bsize blocks.
+*****************************************************************************/
+void check_static_partition( char *name, ULONG ptid, ULONG length,
+                             ULONG bsize )
+{
+    void *bufs[SC_MAX_BUFS];
+    ULONG id;
+    ULONG err;
+    ULONG count;
+    ULONG i;
+
+    printf( "\r\nStatic partition %.4s, ID %lx\r\n", name, ptid );
+    err = pt_ident( name, 0, &id );
+    check_error( "pt_ident", err, ERR_NO_ERROR );
+    if ( (err == ERR_NO_ERROR) && (id != ptid) )
+        printf( "pt_ident returned ID %lx  <-- FAILED\r\n", id );
+
+    count = length / bsize;
+    if ( count > SC_MAX_BUFS )
+        count = SC_MAX_BUFS;
+    for ( i = 0, err = ERR_NO_ERROR; (i < count) && (err == ERR_NO_ERROR);
+          i++ )
+        err = pt_getbuf( ptid, &(bufs[i]) );
+    if ( err != ERR_NO_ERROR )
+        i--;
+    check_error( "pt_getbuf of every block", err, ERR_NO_ERROR );
+    if ( (err == ERR_NO_ERROR) && (count == (length / bsize)) )
+    {
+        err = pt_getbuf( ptid, &(bufs[0]) );
+        check_error( "pt_getbuf from empty partition", err, 0x2C );
+        if ( err == ERR_NO_ERROR )
+            pt_retbuf( ptid, bufs[0] );
+    }
+    while ( i > 0 )
+        pt_retbuf( ptid, bufs[--i] );
+}
+
+/*****************************************************************************
+**  validate_static_config - checks each object of the static configuration
+**                           table, and that objects created at runtime are
+**                           numbered after the static ones of their class.
+*****************************************************************************/
+void validate_static_config( void )
+{
+    ULONG id;
+    ULONG err;
+
+    puts( "\r\n********** Static configuration validation:" );
+
+    err = sm_create( "SCDN", 0, SM_FIFO, &sc_done_id );
+    check_error( "sm_create SCDN", err, ERR_NO_ERROR );
+    if ( (SC_TID_END == 1) && (SC_QID_END == 1) && (SC_SMID_END == 1) &&
+         (SC_PTID_END == 1) )
+        puts( "No static objects configured." );
+
+#define P2PT_TASK( id, name, priority, sstack, ustack, flags ) \
+    check_static_task( name, id );
+#define P2PT_QUEUE( id, name, count, flags ) \
+    check_static_queue( name, id, count, flags );
+#define P2PT_SEMA4( id, name, count, flags ) \
+    check_static_sema4( name, id, count );
+#define P2PT_PARTITION( id, name, length, bsize, flags ) \
+    check_static_partition( name, id, length, bsize );
+#include "p2ptstatic.h"
+
+    /*
+    **  Runtime IDs follow the static ones.
+    */
+    err = q_create( "SCRQ", 1, Q_FIFO, &id );
+    check_error( "q_create SCRQ", err, ERR_NO_ERROR );
+    if ( err == ERR_NO_ERROR )
+    {
+        if ( id < SC_QID_END )
+            printf( "q_create returned static ID %lx  <-- FAILED\r\n", id );
+        q_delete( id );
+    }
+    if ( sc_done_id < SC_SMID_END )
+        printf( "sm_create returned static ID %lx  <-- FAILED\r\n",
+                sc_done_id );
+
+    sm_delete( sc_done_id );
+}
+
+/*****************************************************************************
+**  st_worker
+**         Helper task for validate_task_stats... uses some CPU time, times
+**         out of a semaphore wait, then blocks on an event until told to
+**         delete itself.
+*****************************************************************************/
+#define ST_CPU_NS   20000000ULL
+#define ST_MAX_ROWS 64
+
+static ULONG st_sema4_id;
+static ULONG st_done_id;
+
+void st_worker( ULONG dummy0, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    struct timespec cpu;
+    ULONG events;
+
+    do
+        clock_gettime( CLOCK_THREAD_CPUTIME_ID, &cpu );
+    while ( ((unsigned long long)cpu.tv_sec * 1000000000ULL +
+             (unsigned long long)cpu.tv_nsec) < ST_CPU_NS );
+    sm_p( st_sema4_id, SM_WAIT, 5 );
+    sm_v( st_done_id );
+    ev_receive( 0x01, EV_ALL, 0, &events );
+
+    t_delete( 0L );
+}
+
+/*****************************************************************************
+**  validate_task_stats
+*****************************************************************************/
+void validate_task_stats( void )
+{
+    static t_stat_t rows[ST_MAX_ROWS];
+    t_stat_t stats;
+    ULONG task_id;
+    ULONG err;
+    ULONG count, i;
+
+    puts( "\r\n********** Task statistics validation:" );
+
+    sm_create( "STS4", 0, SM_FIFO, &st_sema4_id );
+    sm_create( "STDN", 0, SM_FIFO, &st_done_id );
+    err = t_create( "STAT", 30, 0, 0, T_LOCAL, &task_id );
+    check_error( "t_create STAT", err, ERR_NO_ERROR );
+    err = t_start( task_id, T_PREEMPT, st_worker, (ULONG *)NULL );
+    check_error( "t_start STAT", err, ERR_NO_ERROR );
+    sm_p( st_done_id, SM_WAIT, 0 );
+
+    /*
+    **  Let STAT block on its event before taking its statistics.
+    */
+    tm_wkafter( 2 );
+    err = t_stats( task_id, &stats );
+    check_error( "t_stats for STAT", err, ERR_NO_ERROR );
+    if ( err == ERR_NO_ERROR )
+    {
+        if ( (stats.taskid != task_id) ||
+             (strncmp( stats.taskname, "STAT", 4 ) != 0) )
+            printf( "t_stats returned task %lx %.4s  <-- FAILED\r\n",
+                    stats.taskid, stats.taskname );
+        if ( stats.wait_reason != WAIT_EVENT )
+            printf( "STAT waiting on %d, not its event  <-- FAILED\r\n",
+                    stats.wait_reason );
+        if ( (stats.blocks[WAIT_SEMAP] != 1) ||
+             (stats.blocked_ns[WAIT_SEMAP] < 4 * P2PT_TICK * 1000000ULL) )
+            printf( "STAT blocked %lu times on semaphores, %llu nsec"
+                    "  <-- FAILED\r\n", stats.blocks[WAIT_SEMAP],
+                    stats.blocked_ns[WAIT_SEMAP] );
+        if ( stats.cpu_ns < ST_CPU_NS )
+            printf( "STAT used %llu nsec of CPU  <-- FAILED\r\n",
+                    stats.cpu_ns );
+        if ( stats.vol_switches == 0 )
+            printf( "STAT made no voluntary context switches  <-- FAILED\r\n" );
+    }
+
+    err = t_stats( 0, &stats );
+    check_error( "t_stats for the calling task", err, ERR_NO_ERROR );
+    if ( (err == ERR_NO_ERROR) && (stats.cpu_ns == 0) )
+        printf( "Calling task used no CPU  <-- FAILED\r\n" );
+
+    count = t_stats_all( rows, ST_MAX_ROWS );
+    for ( i = 0; (i < count) && (rows[i].taskid != task_id); i++ )
+        ;
+    if ( i == count )
+        printf( "t_stats_all left out STAT from %lu tasks  <-- FAILED\r\n",
+                count );
+    else if ( rows[i].cpu_ns < ST_CPU_NS )
+        printf( "t_stats_all gave STAT %llu nsec of CPU  <-- FAILED\r\n",
+                rows[i].cpu_ns );
+    else
+        printf( "t_stats_all returned STAT among %lu tasks\r\n", count );
+
+    /*
+    **  Once STAT has deleted itself it has no statistics.
+    */
+    ev_send( task_id, 0x01 );
+    tm_wkafter( 5 );
+    err = t_stats( task_id, &stats );
+    check_error( "t_stats for deleted STAT", err, 0x05 );
+    count = t_stats_all( rows, ST_MAX_ROWS );
+    for ( i = 0; i < count; i++ )
+    {
+        if ( rows[i].taskid == task_id )
+            printf( "t_stats_all returned deleted STAT  <-- FAILED\r\n" );
+    }
+
+    sm_delete( st_sema4_id );
+    sm_delete( st_done_id );
+}
+
+/*****************************************************************************
+**  sp_snapshot - takes a consistent copy of the first 'size' bytes of a
+**                mapped stats page, as a monitor would, without any lock.
+*****************************************************************************/
+#define SP_ROWS     256
+
+static void sp_snapshot( const sp_page_t *mapped, sp_page_t *copy,
+                         size_t size )
+{
+    ULONG seq;
+
+    do
+    {
+        while ( (seq = mapped->seq) & 1 )
+            sched_yield();
+        __sync_synchronize();
+        memcpy( (void *)copy, (const void *)mapped, size );
+        __sync_synchronize();
+    } while ( mapped->seq != seq );
+}
+
+/*****************************************************************************
+**  validate_stats_page
+*****************************************************************************/
+void validate_stats_page( void )
+{
+    static char copy_buf[sizeof( sp_page_t ) +
+                         (SP_ROWS - 1) * sizeof( sp_object_t )];
+    sp_page_t *copy;
+    sp_page_t *mapped;
+    struct stat st;
+    char name[64];
+    ULONG msg[4];
+    ULONG queue_id;
+    ULONG updates;
+    ULONG err;
+    ULONG i;
+    int fd;
+
+    puts( "\r\n********** Stats page validation:" );
+
+    copy = (sp_page_t *)copy_buf;
+    snprintf( name, sizeof( name ), "/p2linux.validate.%d", (int)getpid() );
+
+    err = sp_stop();
+    check_error( "sp_stop before sp_start", err, ENOENT );
+    err = sp_start( "bad/name", 0, 0 );
+    check_error( "sp_start with an invalid name", err, EINVAL );
+
+    err = q_create( "SPQ1", 4, Q_FIFO, &queue_id );
+    check_error( "q_create SPQ1", err, ERR_NO_ERROR );
+    msg[0] = msg[1] = msg[2] = msg[3] = 0;
+    q_send( queue_id, msg );
+    q_send( queue_id, msg );
+
+    err = sp_start( name, SP_ROWS, 20 );
+    check_error( "sp_start", err, ERR_NO_ERROR );
+    if ( err != ERR_NO_ERROR )
+    {
+        q_delete( queue_id );
+        return;
+    }
+    err = sp_start( name, SP_ROWS, 20 );
+    check_error( "sp_start when started", err, EBUSY );
+
+    /*
+    **  Map the page read-only, as a monitor does.
+    */
+    mapped = (sp_page_t *)MAP_FAILED;
+    if ( ((fd = shm_open( name, O_RDONLY, 0 )) < 0) ||
+         (fstat( fd, &st ) != 0) ||
+         (st.st_size != (off_t)sizeof( copy_buf )) ||
+         ((mapped = (sp_page_t *)mmap( (void *)NULL, st.st_size, PROT_READ,
+                                       MAP_SHARED, fd, 0 )) ==
+          (sp_page_t *)MAP_FAILED) )
+        printf( "Stats page %s could not be mapped  <-- FAILED\r\n", name );
+    if ( fd >= 0 )
+        close( fd );
+
+    if ( mapped != (sp_page_t *)MAP_FAILED )
+    {
+        sp_snapshot( mapped, copy, sizeof( copy_buf ) );
+        if ( (copy->magic != SP_MAGIC) || (copy->version != SP_VERSION) ||
+             (copy->pid != (ULONG)getpid()) || (copy->period_ms != 20) ||
+             (copy->max_objects != SP_ROWS) )
+            printf( "Stats page header %lx %lu %lu %lu %lu  <-- FAILED\r\n",
+                    copy->magic, copy->version, copy->pid, copy->period_ms,
+                    copy->max_objects );
+        updates = copy->updates;
+
+        /*
+        **  A third message shows up on the page within a few periods.
+        */
+        q_send( queue_id, msg );
+        tm_wkafter( 10 );
+        sp_snapshot( mapped, copy, sizeof( copy_buf ) );
+        if ( copy->updates <= updates )
+            printf( "Stats page not rewritten, %lu updates  <-- FAILED\r\n",
+                    copy->updates );
+        if ( copy->dropped != 0 )
+            printf( "Stats page dropped %lu objects  <-- FAILED\r\n",
+                    copy->dropped );
+        for ( i = 0; (i < copy->count) &&
+                     ((copy->objects[i].obj_class != SP_QUEUE) ||
+                      (copy->objects[i].objid != queue_id)); i++ )
+            ;
+        if ( i == copy->count )
+            printf( "SPQ1 not on the stats page  <-- FAILED\r\n" );
+        else if ( (strncmp( copy->objects[i].objname, "SPQ1", 4 ) != 0) ||
+                  (copy->objects[i].depth != 3) ||
+                  (copy->objects[i].puts != 3) )
+            printf( "SPQ1 on the stats page with depth %lu, %lu sends"
+                    "  <-- FAILED\r\n", copy->objects[i].depth,
+                    copy->objects[i].puts );
+        else
+            printf( "SPQ1 on the stats page with 3 messages\r\n" );
+        munmap( (void *)mapped, st.st_size );
+    }
+
+    err = sp_stop();
+    check_error( "sp_stop", err, ERR_NO_ERROR );
+    fd = shm_open( name, O_RDONLY, 0 );
+    if ( fd >= 0 )
+    {
+        printf( "Stats page %s left after sp_stop  <-- FAILED\r\n", name );
+        close( fd );
+    }
+    err = sp_stop();
+    check_error( "sp_stop when stopped", err, ENOENT );
+
+    /*
+    **  A page with room for a single object counts the others as dropped.
+    */
+    err = sp_start( name, 1, 20 );
+    check_error( "sp_start with room for one object", err, ERR_NO_ERROR );
+    if ( err == ERR_NO_ERROR )
+    {
+        if ( ((fd = shm_open( name, O_RDONLY, 0 )) >= 0) &&
+             ((mapped = (sp_page_t *)mmap( (void *)NULL, sizeof( sp_page_t ),
+                                           PROT_READ, MAP_SHARED, fd, 0 )) !=
+              (sp_page_t *)MAP_FAILED) )
+        {
+            sp_snapshot( mapped, copy, sizeof( sp_page_t ) );
+            if ( (copy->count != 1) || (copy->dropped == 0) )
+                printf( "Stats page of one object holds %lu, dropped %lu"
+                        "  <-- FAILED\r\n", copy->count, copy->dropped );
+            munmap( (void *)mapped, sizeof( sp_page_t ) );
+        }
+        else
+            printf( "Stats page %s could not be mapped  <-- FAILED\r\n",
+                    name );
+        if ( fd >= 0 )
+            close( fd );
+        sp_stop();
+    }
+
+    q_delete( queue_id );
+}
+
+/*****************************************************************************
+**  check_queue_info - compares the counters returned by q_info or q_vinfo
+**                     with those expected.
+*****************************************************************************/
+static void check_queue_info( const char *call, const q_info_t *info,
+                              ULONG depth, ULONG high_water, ULONG sends,
+                              ULONG urgents, ULONG broadcasts, ULONG receives,
+                              ULONG timeouts, ULONG full_errors )
+{
+    if ( (info->depth != depth) || (info->high_water != high_water) ||
+         (info->sends != sends) || (info->urgents != urgents) ||
+         (info->broadcasts != broadcasts) || (info->receives != receives) ||
+         (info->timeouts != timeouts) || (info->full_errors != full_errors) )
+        printf( "%s returned depth %lu high %lu sends %lu urgents %lu"
+                " broadcasts %lu receives %lu timeouts %lu full %lu"
+                "  <-- FAILED\r\n", call, info->depth, info->high_water,
+                info->sends, info->urgents, info->broadcasts, info->receives,
+                info->timeouts, info->full_errors );
+    else
+        printf( "%s returned the expected counts\r\n", call );
+}
+
+/*****************************************************************************
+**  qi_receiver
+**         Helper task for validate_queue_info... waits for a message on
+**         the queue being checked, so that a broadcast has a task to reach.
+*****************************************************************************/
+#define QI_ROUNDS   32
+
+static ULONG qi_queue_id;
+static ULONG qi_done_id;
+
+void qi_receiver( ULONG dummy0, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    ULONG msg[4];
+
+    q_receive( qi_queue_id, Q_WAIT, 0, msg );
+    sm_v( qi_done_id );
+
+    t_delete( 0L );
+}
+
+/*****************************************************************************
+**  validate_queue_info
+*****************************************************************************/
+
+void validate_queue_info( void )
+{
+    q_info_t info;
+    ULONG msg[4];
+    char vmsg[16];
+    ULONG queue_id;
+    ULONG task_id;
+    ULONG count;
+    ULONG err;
+    ULONG i, sampled;
+
+    puts( "\r\n********** Queue statistics validation:" );
+
+    err = q_create( "QIN1", 3, Q_FIFO | Q_LIMIT, &queue_id );
+    check_error( "q_create QIN1", err, ERR_NO_ERROR );
+    qi_queue_id = queue_id;
+    sm_create( "QIDN", 0, SM_FIFO, &qi_done_id );
+    err = q_info( queue_id, &info );
+    check_error( "q_info for new QIN1", err, ERR_NO_ERROR );
+    if ( (info.qid != queue_id) || (strncmp( info.qname, "QIN1", 4 ) != 0) ||
+         (info.limit != 3) || (info.extents != 1) )
+        printf( "q_info returned queue %lx %.4s limit %lu extents %lu"
+                "  <-- FAILED\r\n", info.qid, info.qname, info.limit,
+                info.extents );
+    check_queue_info( "q_info for new QIN1", &info, 0, 0, 0, 0, 0, 0, 0, 0 );
+
+    /*
+    **  Broadcast to a waiting task, then fill the queue and overfill it.
+    */
+    t_create( "QIRV", 30, 0, 0, T_LOCAL, &task_id );
+    t_start( task_id, T_PREEMPT, qi_receiver, (ULONG *)NULL );
+    tm_wkafter( 2 );
+    q_info( queue_id, &info );
+    if ( info.waiters != 1 )
+        printf( "q_info returned %lu waiters on QIN1  <-- FAILED\r\n",
+                info.waiters );
+    msg[0] = msg[1] = msg[2] = msg[3] = 0;
+    err = q_broadcast( queue_id, msg, &count );
+    check_error( "q_broadcast to QIN1", err, ERR_NO_ERROR );
+    if ( (err == ERR_NO_ERROR) && (count != 1) )
+        printf( "q_broadcast reached %lu tasks  <-- FAILED\r\n", count );
+    sm_p( qi_done_id, SM_WAIT, 0 );
+
+    q_send( queue_id, msg );
+    q_urgent( queue_id, msg );
+    q_send( queue_id, msg );
+    err = q_send( queue_id, msg );
+    check_error( "q_send to full QIN1", err, 0x35 );
+    q_info( queue_id, &info );
+    check_queue_info( "q_info for full QIN1", &info, 3, 3, 2, 1, 1, 1, 0, 1 );
+
+    for ( i = 0; i < 3; i++ )
+        q_receive( queue_id, Q_NOWAIT, 0, msg );
+    err = q_receive( queue_id, Q_WAIT, 1, msg );
+    check_error( "q_receive timeout from QIN1", err, 0x01 );
+    q_info( queue_id, &info );
+    check_queue_info( "q_info for emptied QIN1", &info,
+                      0, 3, 2, 1, 1, 4, 1, 1 );
+
+    /*
+    **  Residence is timed for one message in Q_SAMPLE_RATE.
+    */
+    for ( i = 0; i < QI_ROUNDS; i++ )
+    {
+        q_send( queue_id, msg );
+        q_receive( queue_id, Q_NOWAIT, 0, msg );
+    }
+    q_info( queue_id, &info );
+    for ( i = 0, sampled = 0; i < Q_RES_BUCKETS; i++ )
+        sampled += info.residence[i];
+    if ( (sampled < QI_ROUNDS / Q_SAMPLE_RATE) ||
+         (sampled > info.receives / Q_SAMPLE_RATE + 1) ||
+         (info.max_residence_ns == 0) )
+        printf( "q_info timed %lu messages, longest %llu nsec  <-- FAILED\r\n",
+                sampled, info.max_residence_ns );
+    else
+        printf( "q_info timed %lu of %lu messages\r\n", sampled,
+                info.receives );
+
+    q_delete( queue_id );
+    sm_delete( qi_done_id );
+    err = q_info( queue_id, &info );
+    check_error( "q_info for deleted QIN1", err, 0x05 );
+
+    err = q_vcreate( "QIV1", Q_FIFO, 2, 16, &queue_id );
+    check_error( "q_vcreate QIV1", err, ERR_NO_ERROR );
+    memset( (void *)vmsg, 0, sizeof( vmsg ) );
+    q_vsend( queue_id, vmsg, 8 );
+    q_vurgent( queue_id, vmsg, 16 );
+    err = q_vsend( queue_id, vmsg, 8 );
+    check_error( "q_vsend to full QIV1", err, 0x35 );
+    err = q_vinfo( queue_id, &info );
+    check_error( "q_vinfo for full QIV1", err, ERR_NO_ERROR );
+    if ( (info.qid != queue_id) || (strncmp( info.qname, "QIV1", 4 ) != 0) ||
+         (info.limit != 2) || (info.extents != 1) )
+        printf( "q_vinfo returned queue %lx %.4s limit %lu extents %lu"
+                "  <-- FAILED\r\n", info.qid, info.qname, info.limit,
+                info.extents );
+    check_queue_info( "q_vinfo for full QIV1", &info, 2, 2, 1, 1, 0, 0, 0, 1 );
 
-    printf( "\r\nCreating Partition 3 with 16 128-byte buffers" );
-    err = pt_create( "PRT3", partition_3, partition_3, 2048,
-                     128, PT_DEL, &partn3_id, &part3_numblks );
-    if ( err != ERR_NO_ERROR )
-        printf( "\npt_create returned error %lx\r\n", err );
-    else
-        printf( "\npt_create created %ld 128-byte buffers\r\n", part3_numblks );
+    for ( i = 0; i < 2; i++ )
+        q_vreceive( queue_id, Q_NOWAIT, 0, vmsg, sizeof( vmsg ), &count );
+    err = q_vreceive( queue_id, Q_WAIT, 1, vmsg, sizeof( vmsg ), &count );
+    check_error( "q_vreceive timeout from QIV1", err, 0x01 );
+    q_vinfo( queue_id, &info );
+    check_queue_info( "q_vinfo for emptied QIV1", &info,
+                      0, 2, 1, 1, 0, 2, 1, 1 );
+
+    q_vdelete( queue_id );
+    err = q_vinfo( queue_id, &info );
+    check_error( "q_vinfo for deleted QIV1", err, 0x05 );
+}
 
-    /************************************************************************
-    **  Partition Buffer Allocation, Use, and Release Test
-    ************************************************************************/
+/*****************************************************************************
+**  qs_now - returns the CLOCK_MONOTONIC time in nanoseconds, the clock with
+**           which Q_STAMP queues stamp their messages.
+*****************************************************************************/
+static unsigned long long qs_now( void )
+{
+    struct timespec now;
 
-    puts( "\n.......... Next we allocate 32 buffers from each partition:" );
-    puts( "           PRT3 should return error 0x2c for the last 16 buffers." );
-    puts( "           An ID string is written into each buffer obtained." );
-    for ( i = 0; i < 32; i++ )
-    {
-        printf( "\r\nAllocating buffer %d from PRT1", i + 1 );
-        err = pt_getbuf( partn1_id, (void **)&(buf1addr[i]) );
-        if ( err != ERR_NO_ERROR )
-            printf( "\npt_getbuf on PRT1 returned error %lx\r\n", err );
-        else
-            sprintf( buf1addr[i], "PRT1 buffer %d", i + 1 );
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return( (unsigned long long)now.tv_sec * 1000000000ULL +
+            (unsigned long long)now.tv_nsec );
+}
 
-        printf( "\r\nAllocating buffer %d from PRT2", i + 1 );
-        err = pt_getbuf( partn2_id, (void **)&(buf2addr[i]) );
-        if ( err != ERR_NO_ERROR )
-            printf( "\npt_getbuf on PRT2 returned error %lx\r\n", err );
-        else
-            sprintf( buf2addr[i], "PRT2 buffer %d", i + 1 );
+/*****************************************************************************
+**  qs_receiver
+**         Helper task for validate_stamped_queues... waits for a message on
+**         a Q_STAMP queue, so that its stamp is taken on the way to a task
+**         already waiting, and notes the stamp and when it arrived.
+*****************************************************************************/
+static ULONG qs_queue_id;
+static ULONG qs_done_id;
+static ULONG qs_err;
+static unsigned long long qs_sent_at;
+static unsigned long long qs_received_at;
 
-        printf( "\r\nAllocating buffer %d from PRT3", i + 1 );
-        err = pt_getbuf( partn3_id, (void **)&(buf3addr[i]) );
-        if ( err != ERR_NO_ERROR )
-            printf( "\npt_getbuf on PRT3 returned error %lx\r\n", err );
-        else
-            sprintf( buf3addr[i], "PRT3 buffer %d", i + 1 );
-    }
+void qs_receiver( ULONG dummy0, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    ULONG msg[4];
 
-    puts( "           Next print the ID strings from the first and last " );
-    puts( "           buffers allocated from each partition.  This proves" );
-    puts( "           that the buffers and partitions are unique." );
-    puts( buf1addr[0] );
-    puts( buf1addr[31] );
-    puts( buf2addr[0] );
-    puts( buf2addr[31] );
-    puts( buf3addr[0] );
-    puts( buf3addr[15] );
+    qs_err = q_receive_stamped( qs_queue_id, Q_WAIT, 0, msg, &qs_sent_at );
+    qs_received_at = qs_now();
+    sm_v( qs_done_id );
 
-    puts( "           Now try to return a buffer from PRT2 to PRT1." );
-    puts( "           This should return error 0x2d." );
-    err = pt_retbuf( partn1_id, (void *)buf2addr[0] );
-    if ( err != ERR_NO_ERROR )
-        printf( "\npt_retbuf on PRT1 returned error %lx\r\n", err );
-    else
-        printf( "\nReturned buffer %d  @ %p to PRT1\r\n", 1, buf2addr[0] );
+    t_delete( 0L );
+}
 
-    puts( "           Now try to return a buffer from PRT2 more than once." );
-    puts( "           This should return error 0x2f on the second pt_retbuf." );
-    err = pt_retbuf( partn2_id, (void *)buf2addr[0] );
-    if ( err != ERR_NO_ERROR )
-        printf( "\npt_retbuf on PRT2 returned error %lx\r\n", err );
+/*****************************************************************************
+**  check_stamp - checks that a message stamp falls between the times taken
+**                just before and after it was sent.
+*****************************************************************************/
+static void check_stamp( const char *call, unsigned long long sent_at,
+                         unsigned long long before, unsigned long long after )
+{
+    if ( (sent_at < before) || (sent_at > after) )
+        printf( "%s stamp %llu outside %llu..%llu  <-- FAILED\r\n", call,
+                sent_at, before, after );
     else
-        printf( "\nReturned buffer %d  @ %p to PRT2\r\n", 1, buf2addr[0] );
+        printf( "%s stamp within the send\r\n", call );
+}
 
-    err = pt_retbuf( partn2_id, (void *)buf2addr[0] );
-    if ( err != ERR_NO_ERROR )
-        printf( "\npt_retbuf on PRT2 returned error %lx\r\n", err );
-    else
-        printf( "\nReturned buffer %d  @ %p to PRT2\r\n", 1, buf2addr[0] );
+/*****************************************************************************
+**  validate_stamped_queues
+*****************************************************************************/
+void validate_stamped_queues( void )
+{
+    unsigned long long before[2], after[2], sent_at;
+    q_info_t info;
+    ULONG msg[4];
+    char vmsg[16];
+    ULONG queue_id, plain_id;
+    ULONG task_id;
+    ULONG msglen;
+    ULONG err;
+    ULONG i, timed;
 
-    /************************************************************************
-    **  Partition Deletion Test
-    ************************************************************************/
-    puts( "\n.......... Now we delete partitions 1 and 2:" );
-    puts( "           Partitions 1 and 3 were created with the PT_DEL option.");
-    puts( "           They can be deleted even with buffers still allocated.");
-    puts( "           Partition 2 was created with the PT_NODEL option.");
-    puts( "           It cannot be deleted while buffers are still allocated.");
+    puts( "\r\n********** Stamped queue validation:" );
 
-    printf( "\r\nDeleting Partition 1 with buffers allocated" );
-    err = pt_delete( partn1_id );
-    if ( err != ERR_NO_ERROR )
-        printf( "\npt_delete of PRT1 returned error %lx\r\n", err );
-    else
-        printf( "\r\n" );
-  
-    printf( "\r\nDeleting Partition 2 with buffers allocated" );
-    err = pt_delete( partn2_id );
-    if ( err != ERR_NO_ERROR )
-        printf( "\npt_delete of PRT2 returned error %lx\r\n", err );
-    else
-        printf( "\r\n" );
+    err = q_create( "QST1", 4, Q_FIFO | Q_STAMP, &queue_id );
+    check_error( "q_create QST1 with Q_STAMP", err, ERR_NO_ERROR );
+    err = q_create( "QST2", 4, Q_FIFO, &plain_id );
+    check_error( "q_create QST2", err, ERR_NO_ERROR );
 
-    puts( "Returning all buffers to PRT2" );
-    for ( i = 1; i < 32; i++ )
+    /*
+    **  Two messages sent a few ticks apart carry their own send times.
+    */
+    msg[1] = msg[2] = msg[3] = 0;
+    for ( i = 0; i < 2; i++ )
     {
-        err = pt_retbuf( partn2_id, (void *)buf2addr[i] );
-        if ( err != ERR_NO_ERROR )
-            printf( "\npt_retbuf on PRT2 returned error %lx\r\n", err );
+        msg[0] = i;
+        before[i] = qs_now();
+        q_send( queue_id, msg );
+        after[i] = qs_now();
+        tm_wkafter( 2 );
+    }
+    for ( i = 0; i < 2; i++ )
+    {
+        sent_at = 0;
+        err = q_receive_stamped( queue_id, Q_NOWAIT, 0, msg, &sent_at );
+        check_error( "q_receive_stamped from QST1", err, ERR_NO_ERROR );
+        if ( msg[0] != i )
+            printf( "q_receive_stamped returned message %lx  <-- FAILED\r\n",
+                    msg[0] );
+        check_stamp( "q_receive_stamped", sent_at, before[i], after[i] );
     }
-  
-    printf( "\r\nDeleting Partition 2 with no buffers allocated" );
-    err = pt_delete( partn2_id );
-    if ( err != ERR_NO_ERROR )
-        printf( "\npt_delete of PRT2 returned error %lx\r\n", err );
-    else
-        printf( "\r\n" );
-  
-    /************************************************************************
-    **  Partition Identification and Partition-Not-Found Test
-    ************************************************************************/
 
-    puts( "\n.......... Finally, we test the pt_ident logic..." );
-    puts( "           Then we verify the error codes returned when" );
-    puts( "           a non-existent partition is specified." );
+    /*
+    **  A message sent to a waiting task is stamped as well.
+    */
+    qs_queue_id = queue_id;
+    sm_create( "QSDN", 0, SM_FIFO, &qs_done_id );
+    t_create( "QSRV", 30, 0, 0, T_LOCAL, &task_id );
+    t_start( task_id, T_PREEMPT, qs_receiver, (ULONG *)NULL );
+    tm_wkafter( 2 );
+    before[0] = qs_now();
+    q_send( queue_id, msg );
+    after[0] = qs_now();
+    sm_p( qs_done_id, SM_WAIT, 0 );
+    check_error( "q_receive_stamped by waiting task", qs_err, ERR_NO_ERROR );
+    check_stamp( "q_receive_stamped by waiting task", qs_sent_at, before[0],
+                 after[0] );
+    if ( qs_received_at < qs_sent_at )
+        printf( "Message received at %llu before its stamp  <-- FAILED\r\n",
+                qs_received_at );
+    sm_delete( qs_done_id );
 
-    err = pt_ident( "PRT3", 0, &my_partn_id );
-    if ( err != ERR_NO_ERROR )
-        printf( "\npt_ident for PRT3 returned error %lx\r\n", err );
+    /*
+    **  Every message of a Q_STAMP queue is timed for q_info.
+    */
+    q_info( queue_id, &info );
+    for ( i = 0, timed = 0; i < Q_RES_BUCKETS; i++ )
+        timed += info.residence[i];
+    if ( timed != info.receives )
+        printf( "q_info timed %lu of %lu messages  <-- FAILED\r\n", timed,
+                info.receives );
     else
-        printf( "\npt_ident for PRT3 returned ID %lx... partn3_id == %lx\r\n",
-                 my_partn_id, partn3_id );
+        printf( "q_info timed all %lu messages\r\n", timed );
+
+    err = q_receive_stamped( queue_id, Q_NOWAIT, 0, msg, &sent_at );
+    check_error( "q_receive_stamped from empty QST1", err, 0x37 );
+    err = q_receive_stamped( queue_id, Q_WAIT, 1, msg, &sent_at );
+    check_error( "q_receive_stamped timeout from QST1", err, 0x01 );
+
+    q_send( plain_id, msg );
+    sent_at = 1;
+    err = q_receive_stamped( plain_id, Q_NOWAIT, 0, msg, &sent_at );
+    check_error( "q_receive_stamped from QST2", err, ERR_NO_ERROR );
+    if ( sent_at != 0 )
+        printf( "Unstamped queue returned stamp %llu  <-- FAILED\r\n",
+                sent_at );
+
+    q_delete( queue_id );
+    q_delete( plain_id );
+    err = q_receive_stamped( queue_id, Q_NOWAIT, 0, msg, &sent_at );
+    check_error( "q_receive_stamped from deleted QST1", err, 0x05 );
+
+    err = q_vcreate( "QSV1", Q_FIFO | Q_STAMP, 4, 16, &queue_id );
+    check_error( "q_vcreate QSV1 with Q_STAMP", err, ERR_NO_ERROR );
+    err = q_vcreate( "QSV2", Q_FIFO, 4, 16, &plain_id );
+    check_error( "q_vcreate QSV2", err, ERR_NO_ERROR );
+
+    memset( (void *)vmsg, 0x5A, sizeof( vmsg ) );
+    before[0] = qs_now();
+    q_vsend( queue_id, vmsg, 12 );
+    after[0] = qs_now();
+    err = q_vreceive_stamped( queue_id, Q_NOWAIT, 0, vmsg, sizeof( vmsg ),
+                              &msglen, &sent_at );
+    check_error( "q_vreceive_stamped from QSV1", err, ERR_NO_ERROR );
+    if ( msglen != 12 )
+        printf( "q_vreceive_stamped returned %lu bytes  <-- FAILED\r\n",
+                msglen );
+    check_stamp( "q_vreceive_stamped", sent_at, before[0], after[0] );
+    err = q_vreceive_stamped( queue_id, Q_NOWAIT, 0, vmsg, sizeof( vmsg ),
+                              &msglen, &sent_at );
+    check_error( "q_vreceive_stamped from empty QSV1", err, 0x37 );
+
+    q_vsend( plain_id, vmsg, 12 );
+    sent_at = 1;
+    err = q_vreceive_stamped( plain_id, Q_NOWAIT, 0, vmsg, sizeof( vmsg ),
+                              &msglen, &sent_at );
+    check_error( "q_vreceive_stamped from QSV2", err, ERR_NO_ERROR );
+    if ( sent_at != 0 )
+        printf( "Unstamped queue returned stamp %llu  <-- FAILED\r\n",
+                sent_at );
+
+    q_vdelete( queue_id );
+    q_vdelete( plain_id );
+    err = q_vreceive_stamped( queue_id, Q_NOWAIT, 0, vmsg, sizeof( vmsg ),
+                              &msglen, &sent_at );
+    check_error( "q_vreceive_stamped from deleted QSV1", err, 0x05 );
+}
 
-    err = pt_ident( "PRT1", 0, &my_partn_id );
-    if ( err != ERR_NO_ERROR )
-        printf( "\npt_ident for PRT1 returned error %lx\r\n", err );
-    else
-        printf( "\npt_ident for PRT1 returned ID %lx partn1_id %lx\r\n",
-                  my_partn_id, partn1_id );
+/*****************************************************************************
+**  ih_server
+**         Helper task for validate_inherit... serves a Q_INHERIT queue at a
+**         low priority, noting the priority lent to it with each message
+**         and holding on to the message until told to go on.  A message
+**         numbered IH_STOP ends it.
+*****************************************************************************/
+#define IH_STOP     2
 
-    err = pt_getbuf( partn2_id, (void **)&buffer );
-    if ( err != ERR_NO_ERROR )
-        printf( "\npt_getbuf on PRT2 returned error %lx\r\n", err );
-    else
-        printf( "\npt_getbuf on PRT2 returned buffer @ %p\r\n", buffer );
+static ULONG ih_queue_id;
+static ULONG ih_got_id;
+static ULONG ih_go_id;
+static int ih_lent[IH_STOP + 1];
 
-    err = pt_retbuf( partn1_id, buffer );
-    if ( err != ERR_NO_ERROR )
-        printf( "\npt_retbuf on PRT1 returned error %lx\r\n", err );
+void ih_server( ULONG dummy0, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    ULONG msg[4];
+
+    do
+    {
+        q_receive( ih_queue_id, Q_WAIT, 0, msg );
+        if ( msg[0] <= IH_STOP )
+            ih_lent[msg[0]] = my_tcb()->lent_priority;
+        sm_v( ih_got_id );
+        if ( msg[0] != IH_STOP )
+            sm_p( ih_go_id, SM_WAIT, 0 );
+    } while ( msg[0] != IH_STOP );
+
+    t_delete( 0L );
+}
+
+/*****************************************************************************
+**  ih_sender
+**         Helper task for validate_inherit... sends message 1 at a priority
+**         below that of the server.
+*****************************************************************************/
+void ih_sender( ULONG dummy0, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
+{
+    ULONG msg[4];
+
+    msg[0] = 1;
+    msg[1] = msg[2] = msg[3] = 0;
+    q_send( ih_queue_id, msg );
+
+    t_delete( 0L );
+}
+
+/*****************************************************************************
+**  check_lent - checks the priority lent to a task and whether it is still
+**               serving a Q_INHERIT queue.
+*****************************************************************************/
+static void check_lent( const char *when, ULONG tid, int lent, int serving )
+{
+    p2pthread_cb_t *tcb;
+
+    if ( (tcb = tcb_for( tid )) == (p2pthread_cb_t *)NULL )
+        printf( "%s: server task not found  <-- FAILED\r\n", when );
+    else if ( (tcb->lent_priority != lent) ||
+              ((tcb->serving != (void *)NULL) != serving) )
+        printf( "%s: lent priority %d, %sserving  <-- FAILED\r\n", when,
+                tcb->lent_priority, (tcb->serving == (void *)NULL) ? "not " : "" );
     else
-        printf( "\r\n" );
+        printf( "%s: lent priority %d as expected\r\n", when, lent );
+}
 
-    err = sm_delete( partn1_id );
-    printf( "\nsm_delete for PRT1 returned error %lx\r\n", err );
+/*****************************************************************************
+**  validate_inherit
+*****************************************************************************/
+void validate_inherit( void )
+{
+    ULONG msg[4];
+    ULONG server_id, sender_id;
+    ULONG err;
+    int own;
+
+    puts( "\r\n********** Queue priority inheritance validation:" );
+
+    own = (my_tcb()->prv_priority).sched_priority;
+    err = q_create( "QIH1", 4, Q_FIFO | Q_INHERIT, &ih_queue_id );
+    check_error( "q_create QIH1 with Q_INHERIT", err, ERR_NO_ERROR );
+    sm_create( "IHGT", 0, SM_FIFO, &ih_got_id );
+    sm_create( "IHGO", 0, SM_FIFO, &ih_go_id );
+    err = t_create( "IHSV", 10, 0, 0, T_LOCAL, &server_id );
+    check_error( "t_create IHSV", err, ERR_NO_ERROR );
+    t_start( server_id, T_PREEMPT, ih_server, (ULONG *)NULL );
+    tm_wkafter( 2 );
+    check_lent( "Server waiting", server_id, 0, FALSE );
+
+    /*
+    **  The server takes our priority with our message, and keeps it while
+    **  it holds the message.
+    */
+    msg[0] = 0;
+    msg[1] = msg[2] = msg[3] = 0;
+    q_send( ih_queue_id, msg );
+    sm_p( ih_got_id, SM_WAIT, 0 );
+    if ( ih_lent[0] != own )
+        printf( "Server received with priority %d lent, not %d"
+                "  <-- FAILED\r\n", ih_lent[0], own );
+    check_lent( "Server holding our message", server_id, own, TRUE );
+
+    /*
+    **  A message from a task below the server lends nothing, and the
+    **  server gives back our priority when it receives again.
+    */
+    t_create( "IHLO", 5, 0, 0, T_LOCAL, &sender_id );
+    t_start( sender_id, T_PREEMPT, ih_sender, (ULONG *)NULL );
+    tm_wkafter( 2 );
+    check_lent( "Low priority message queued", server_id, own, TRUE );
+    sm_v( ih_go_id );
+    sm_p( ih_got_id, SM_WAIT, 0 );
+    if ( ih_lent[1] != 0 )
+        printf( "Server received with priority %d lent, not 0"
+                "  <-- FAILED\r\n", ih_lent[1] );
+    check_lent( "Server holding low priority message", server_id, 0, TRUE );
+
+    /*
+    **  Waiting on an empty queue ends the service.
+    */
+    sm_v( ih_go_id );
+    tm_wkafter( 2 );
+    check_lent( "Server waiting again", server_id, 0, FALSE );
+
+    msg[0] = IH_STOP;
+    q_send( ih_queue_id, msg );
+    sm_p( ih_got_id, SM_WAIT, 0 );
+    tm_wkafter( 2 );
+
+    q_delete( ih_queue_id );
+    sm_delete( ih_got_id );
+    sm_delete( ih_go_id );
+}
+
+/*****************************************************************************
+**  isr_handler - stands in for an interrupt service routine.  Makes one
+**                send of each kind from signal context.
+*****************************************************************************/
+static ULONG isr_task_id;
+static ULONG isr_queue_id;
+static ULONG isr_sema4_id;
+
+static void isr_handler( int signo )
+{
+    ULONG msg[4];
+
+    msg[0] = 0x1511;
+    msg[1] = msg[2] = msg[3] = 0;
+    ev_send_isr( isr_task_id, 0x10 );
+    q_send_isr( isr_queue_id, msg );
+    sm_v_isr( isr_sema4_id );
+}
+
+/*****************************************************************************
+**  validate_isr_sends
+*****************************************************************************/
+void validate_isr_sends( void )
+{
+    ULONG err;
+    ULONG errors;
+    ULONG events;
+    ULONG msg[4];
+    struct sigaction action;
+    struct sigaction old_action;
+
+    puts( "\r\n********** ISR send validation:" );
+
+    err = q_create( "ISRQ", 4, Q_FIFO | Q_LIMIT, &isr_queue_id );
+    check_error( "q_create ISRQ", err, ERR_NO_ERROR );
+    err = sm_create( "ISRS", 0, SM_FIFO, &isr_sema4_id );
+    check_error( "sm_create ISRS", err, ERR_NO_ERROR );
+    t_ident( (char *)NULL, 0, &isr_task_id );
+
+    puts( "\n.......... A signal handler sends an event, a queue message and" );
+    puts( "           a semaphore token.  The dispatch thread delivers all" );
+    puts( "           three to this task." );
+    memset( &action, 0, sizeof( action ) );
+    action.sa_handler = isr_handler;
+    sigemptyset( &action.sa_mask );
+    sigaction( SIGUSR2, &action, &old_action );
+    errors = isr_errors();
+    raise( SIGUSR2 );
+    err = ev_receive( 0x10, EV_ANY, 100, &events );
+    check_error( "ev_receive event from ISR", err, ERR_NO_ERROR );
+    err = q_receive( isr_queue_id, Q_WAIT, 100, msg );
+    check_error( "q_receive message from ISR", err, ERR_NO_ERROR );
+    if ( msg[0] != 0x1511 )
+        printf( "q_receive from ISR got %lx, expected 1511  <-- FAILED\r\n",
+                msg[0] );
+    err = sm_p( isr_sema4_id, SM_WAIT, 100 );
+    check_error( "sm_p token from ISR", err, ERR_NO_ERROR );
+    sigaction( SIGUSR2, &old_action, (struct sigaction *)NULL );
+
+    puts( "\n.......... ISR sends to a deleted queue and semaphore are" );
+    puts( "           accepted, and counted by isr_errors() when the dispatch" );
+    puts( "           thread fails to deliver them." );
+    err = q_delete( isr_queue_id );
+    check_error( "q_delete ISRQ", err, ERR_NO_ERROR );
+    err = sm_delete( isr_sema4_id );
+    check_error( "sm_delete ISRS", err, ERR_NO_ERROR );
+    msg[0] = 0x1512;
+    err = q_send_isr( isr_queue_id, msg );
+    check_error( "q_send_isr to deleted ISRQ", err, ERR_NO_ERROR );
+    err = sm_v_isr( isr_sema4_id );
+    check_error( "sm_v_isr to deleted ISRS", err, ERR_NO_ERROR );
+    err = ev_send_isr( isr_task_id, 0x10 );
+    check_error( "ev_send_isr after the failed sends", err, ERR_NO_ERROR );
+    err = ev_receive( 0x10, EV_ANY, 100, &events );
+    check_error( "ev_receive event after the failed sends", err,
+                 ERR_NO_ERROR );
+    if ( isr_errors() != errors + 2 )
+        printf( "isr_errors returned %lx, expected %lx  <-- FAILED\r\n",
+                isr_errors(), errors + 2 );
 }
 
 /*****************************************************************************
@@ -2566,6 +5546,78 @@ void task1( ULONG dummy0, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
     test_cycle++;
     validate_partitions();
 
+    test_cycle++;
+    validate_token_pools();
+
+    test_cycle++;
+    validate_mutexes();
+
+    test_cycle++;
+    validate_condvars();
+
+    test_cycle++;
+    validate_event_flags();
+
+    test_cycle++;
+    validate_event_groups();
+
+    test_cycle++;
+    validate_isr_sends();
+
+    test_cycle++;
+    validate_buffer_checks();
+
+    test_cycle++;
+    validate_mapped_partitions();
+
+    test_cycle++;
+    validate_growing_partitions();
+
+    test_cycle++;
+    validate_ts_malloc();
+
+    test_cycle++;
+    validate_regions();
+
+    test_cycle++;
+    validate_histograms();
+
+    test_cycle++;
+    validate_trace();
+
+    test_cycle++;
+    validate_lock_profile();
+
+    test_cycle++;
+    validate_load();
+
+    test_cycle++;
+    validate_simulation();
+
+    test_cycle++;
+    validate_mn_tasks();
+
+    test_cycle++;
+    validate_init();
+
+    test_cycle++;
+    validate_static_config();
+
+    test_cycle++;
+    validate_task_stats();
+
+    test_cycle++;
+    validate_stats_page();
+
+    test_cycle++;
+    validate_queue_info();
+
+    test_cycle++;
+    validate_stamped_queues();
+
+    test_cycle++;
+    validate_inherit();
+
     perror("Validation tests completed - enter 'q' to quit... (ignore errno)");
 
     /*
@@ -2585,10 +5637,22 @@ void task1( ULONG dummy0, ULONG dummy1, ULONG dummy2, ULONG dummy3 )
 void
     user_sysroot( void )
 {
+    p2pt_config_t config;
     ULONG err;
  
     printf( "\r\n" );
 
+    /*
+    **  Configure the library before creating anything, with a limit on
+    **  semaphores for validate_init to reach.
+    */
+    memset( (void *)&config, 0, sizeof( config ) );
+    config.max_sema4s = INIT_MAX_SEMA4S;
+    config.mlock = P2PT_MLOCK_NONE;
+    init_err = p2linux_init( &config );
+    if ( init_err != ERR_NO_ERROR )
+        printf( "p2linux_init returned error %lx\r\n", init_err );
+
     puts( "Creating Queue 1, extensible with 4 16-byte messages" );
     err = q_create( "QUE1", 4, Q_FIFO, &queue1_id );
     if ( err != ERR_NO_ERROR )
@@ -22,6 +22,8 @@
 #define Q_NOWAIT     0x01
 #define Q_PRIOR      0x02
 #define Q_LIMIT      0x04
+#define Q_STAMP      0x10
+#define Q_INHERIT    0x20
 
 #define ERR_TIMEOUT  0x01
 #define ERR_NODENO   0x04
@@ -48,6 +50,18 @@ typedef struct q_varlen_msg
     char *msgbuf;
 } q_vmsg_t;
 
+/*****************************************************************************
+**  p2pthread queue message information... kept for each message location
+**  beside the message array, so that it takes no room in the message
+*****************************************************************************/
+typedef struct queue_slot_info
+{
+    unsigned long long
+        sent_at;         /* Send time of message if timed, else zero */
+    int
+        sender_pri;      /* Priority lent by sender (Q_INHERIT queues) */
+} q_slot_t;
+
 /*****************************************************************************
 **  Control block for p2pthread queue
 **
@@ -84,6 +98,8 @@ typedef struct p2pt_vqueue
         */
     pthread_mutex_t
         queue_lock;
+    lk_stat_t
+        queue_lkstat;    /* Contention statistics for queue_lock */
     pthread_cond_t
         queue_send;
 
@@ -92,6 +108,8 @@ typedef struct p2pt_vqueue
         */
     pthread_mutex_t
         qbcst_lock;
+    lk_stat_t
+        qbcst_lkstat;    /* Contention statistics for qbcst_lock */
     pthread_cond_t
         qbcst_cmplt;
 
@@ -172,6 +190,62 @@ typedef struct p2pt_vqueue
         */
     int
         order;
+
+        /*
+        ** Information on each message, indexed as the messages in the queue
+        */
+    q_slot_t *
+        slots;
+
+        /*
+        ** Successful sends, urgent sends, broadcasts and receives since the
+        ** queue was created, receives which timed out and sends refused
+        ** because the queue was full
+        */
+    ULONG
+        send_count;
+    ULONG
+        urgent_count;
+    ULONG
+        bcast_count;
+    ULONG
+        recv_count;
+    ULONG
+        timeout_count;
+    ULONG
+        full_count;
+
+        /*
+        ** Most messages ever in the queue at once
+        */
+    int
+        high_water;
+
+        /*
+        ** Messages put into the queue (which picks those to be timed), and
+        ** messages now in the queue with a send time
+        */
+    ULONG
+        msgs_in;
+    ULONG
+        stamped_msgs;
+
+        /*
+        ** Timed messages by residence, as returned by q_vinfo()
+        */
+    ULONG
+        residence[Q_RES_BUCKETS];
+    unsigned long long
+        max_residence_ns;
+
+        /*
+        ** Task which last received from a Q_INHERIT queue (0 if none), and
+        ** the highest priority lent to it since by the queue's senders
+        */
+    ULONG
+        server_tid;
+    int
+        server_pri;
 } p2pt_vqueue_t;
 
 /*****************************************************************************
@@ -195,6 +269,24 @@ extern void
    unlink_susp_tcb( p2pthread_cb_t **list_head, p2pthread_cb_t *entry );
 extern int
    signal_for_my_task( p2pthread_cb_t **list_head, int pend_order );
+extern p2pthread_cb_t *
+   next_susp_tcb( p2pthread_cb_t *list_head, int pend_order );
+extern void
+   stat_block( p2pthread_cb_t *tcb, int reason );
+extern void
+   stat_unblock( p2pthread_cb_t *tcb, int timedout );
+extern void
+   stat_wake( p2pthread_cb_t *tcb );
+extern void
+   stat_wake_all( p2pthread_cb_t *list_head );
+extern ULONG
+   count_susp_tcbs( p2pthread_cb_t *list_head );
+extern int
+   send_priority( p2pthread_cb_t *tcb );
+extern void
+   lend_priority( ULONG tid, void *object, int priority );
+extern void
+   end_lent_priority( p2pthread_cb_t *tcb );
 
 /*****************************************************************************
 **  p2pthread Global Data Structures
@@ -212,6 +304,8 @@ static p2pt_vqueue_t *
 */
 static pthread_mutex_t
     vqueue_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static lk_stat_t
+    vqueue_list_lkstat = LK_STAT_INITIALIZER( TR_VQUEUE, "vqueue_list_lock" );
 
 
 /*****************************************************************************
@@ -267,7 +361,7 @@ static ULONG
     */
     pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                           (void *)&vqueue_list_lock );
-    pthread_mutex_lock( &vqueue_list_lock );
+    lk_lock( &vqueue_list_lock, &vqueue_list_lkstat );
 
     /*
     **  Get the highest previously assigned queue id and add one.
@@ -305,7 +399,7 @@ static ULONG
     /*
     **  Re-enable access to the queue list by other threads.
     */
-    pthread_mutex_unlock( &vqueue_list_lock );
+    lk_unlock( &vqueue_list_lock, &vqueue_list_lkstat );
     pthread_cleanup_pop( 0 );
 
     return( new_queue_id );
@@ -324,7 +418,7 @@ static void
     */
     pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                           (void *)&vqueue_list_lock );
-    pthread_mutex_lock( &vqueue_list_lock );
+    lk_lock( &vqueue_list_lock, &vqueue_list_lkstat );
 
     new_vqueue->nxt_queue = (p2pt_vqueue_t *)NULL;
     if ( vqueue_list != (p2pt_vqueue_t *)NULL )
@@ -362,7 +456,7 @@ static void
     /*
     **  Re-enable access to the queue list by other threads.
     */
-    pthread_mutex_unlock( &vqueue_list_lock );
+    lk_unlock( &vqueue_list_lock, &vqueue_list_lkstat );
     pthread_cleanup_pop( 0 );
 }
 
@@ -385,7 +479,7 @@ static p2pt_vqueue_t *
         */
         pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                               (void *)&vqueue_list_lock );
-        pthread_mutex_lock( &vqueue_list_lock );
+        lk_lock( &vqueue_list_lock, &vqueue_list_lkstat );
 
         /*
         **  Scan the queue list for a qcb with a matching queue ID
@@ -434,13 +528,138 @@ static p2pt_vqueue_t *
         /*
         **  Re-enable access to the queue list by other threads.
         */
-        pthread_mutex_unlock( &vqueue_list_lock );
+        lk_unlock( &vqueue_list_lock, &vqueue_list_lkstat );
         pthread_cleanup_pop( 0 );
     }
 
     return( selected_qcb );
 }
 
+/*****************************************************************************
+** q_clock - returns the monotonic time in nanoseconds
+*****************************************************************************/
+static unsigned long long
+   q_clock( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return( (unsigned long long)now.tv_sec * 1000000000ULL +
+            (unsigned long long)now.tv_nsec );
+}
+
+/*****************************************************************************
+** slot_for - returns the information on the message in the specified
+**            message location of the specified queue
+*****************************************************************************/
+static q_slot_t *
+   slot_for( p2pt_vqueue_t *queue, q_vmsg_t *slot )
+{
+    return( &(queue->slots[((char *)slot - (char *)queue->first_msg_in_queue) /
+                           queue->vmsg_len]) );
+}
+
+/*****************************************************************************
+** note_sender - records the priority the calling task lends with a message
+**               just put into the specified location of a Q_INHERIT queue,
+**               and lends it at once to the task serving the queue if the
+**               message is now at the head of the queue
+*****************************************************************************/
+static void
+   note_sender( p2pt_vqueue_t *queue, q_vmsg_t *slot )
+{
+    int priority;
+
+    priority = send_priority( my_tcb() );
+    slot_for( queue, slot )->sender_pri = priority;
+    if ( (slot == queue->queue_head) && (priority > queue->server_pri) &&
+         (queue->server_tid != 0) )
+    {
+        queue->server_pri = priority;
+        lend_priority( queue->server_tid, (void *)queue, priority );
+    }
+}
+
+/*****************************************************************************
+** start_serving - makes the calling task the server of a Q_INHERIT queue
+**                 from which it has just received a message, lending it
+**                 the priority of that message's sender or of the sender
+**                 of the message now at the head of the queue, if higher
+*****************************************************************************/
+static void
+   start_serving( p2pt_vqueue_t *queue, p2pthread_cb_t *tcb, int priority )
+{
+    int head_pri;
+
+    if ( tcb == (p2pthread_cb_t *)NULL )
+        return;
+
+    if ( queue->msg_count > 0 )
+    {
+        head_pri = slot_for( queue, queue->queue_head )->sender_pri;
+        if ( head_pri > priority )
+            priority = head_pri;
+    }
+
+    queue->server_tid = tcb->taskid;
+    queue->server_pri = priority;
+    tcb->serving = (void *)queue;
+    if ( priority > (tcb->prv_priority).sched_priority )
+        lend_priority( tcb->taskid, (void *)queue, priority );
+}
+
+/*****************************************************************************
+** note_msg_in - counts a message just put into the specified location of
+**               the specified queue, raising the high-water mark, and
+**               stamps it with its send time if the queue was created with
+**               Q_STAMP, else one message in Q_SAMPLE_RATE.  Notes the
+**               sender's priority if the queue was created with Q_INHERIT.
+*****************************************************************************/
+static void
+   note_msg_in( p2pt_vqueue_t *queue, q_vmsg_t *slot )
+{
+    if ( queue->msg_count > queue->high_water )
+        queue->high_water = queue->msg_count;
+
+    queue->msgs_in++;
+    if ( (queue->flags & Q_STAMP) ||
+         ((queue->msgs_in % Q_SAMPLE_RATE) == 0) )
+    {
+        slot_for( queue, slot )->sent_at = q_clock();
+        queue->stamped_msgs++;
+    }
+
+    if ( queue->flags & Q_INHERIT )
+        note_sender( queue, slot );
+}
+
+/*****************************************************************************
+** note_msg_out - adds the residence of a message being taken from the
+**                queue to the histogram, if the message was stamped
+*****************************************************************************/
+static void
+   note_msg_out( p2pt_vqueue_t *queue, q_slot_t *info )
+{
+    unsigned long long residence;
+    int bucket;
+
+    if ( info->sent_at == 0 )
+        return;
+
+    residence = q_clock() - info->sent_at;
+    bucket = 0;
+    if ( residence >= 1000ULL )
+        bucket = 64 - __builtin_clzll( residence / 1000ULL );
+    if ( bucket >= Q_RES_BUCKETS )
+        bucket = Q_RES_BUCKETS - 1;
+    queue->residence[bucket]++;
+    if ( residence > queue->max_residence_ns )
+        queue->max_residence_ns = residence;
+
+    info->sent_at = 0;
+    queue->stamped_msgs--;
+}
+
 /*****************************************************************************
 ** urgent_msg_to - sends a message to the front of the specified queue
 *****************************************************************************/
@@ -496,6 +715,7 @@ static void
     **  Increment the message counter for the queue
     */
     queue->msg_count++;
+    note_msg_in( queue, queue->queue_head );
 }
 
 /*****************************************************************************
@@ -506,12 +726,14 @@ static void
 {
     ULONG i;
     char *element;
+    q_vmsg_t *slot;
 
     /*
     **  It is assumed when we enter this function that the queue has space
     **  to accept the message about to be sent.  Start by sending the
     **  message.
     */
+    slot = queue->queue_tail;
     if ( msg != (char *)NULL )
     {
         element = (char *)&((queue->queue_tail)->msgbuf);
@@ -552,18 +774,23 @@ static void
     **  Increment the message counter for the queue
     */
     queue->msg_count++;
+    note_msg_in( queue, slot );
 
     /*
-    **  Signal the condition variable for the queue
+    **  Signal the condition variable for the queue, noting when the task
+    **  selected to receive the message was made ready.
     */
-    pthread_cond_broadcast( &(queue->queue_send) );
+    stat_wake( next_susp_tcb( queue->first_susp, (queue->flags & Q_PRIOR) ) );
+    lk_broadcast( &(queue->queue_send) );
 }
 
 /*****************************************************************************
-** fetch_msg_from - fetches the next message from the specified queue
+** fetch_msg_from - fetches the next message from the specified queue, and
+**                  its send time and sender priority if 'info' is not NULL
 *****************************************************************************/
 static void
-    fetch_msg_from( p2pt_vqueue_t *queue, char *msg, ULONG *msglen )
+    fetch_msg_from( p2pt_vqueue_t *queue, char *msg, ULONG *msglen,
+                    q_slot_t *info )
 {
     char *element;
     int i;
@@ -585,6 +812,22 @@ static void
     if ( msglen != (ULONG *)NULL )
         *msglen = (queue->queue_head)->msglen;
 
+    /*
+    **  Only queues created with Q_STAMP stamp every message, and only
+    **  Q_INHERIT queues note the priority of the sender.
+    */
+    if ( info != (q_slot_t *)NULL )
+    {
+        info->sent_at = 0;
+        info->sender_pri = 0;
+        if ( queue->flags & (Q_STAMP | Q_INHERIT) )
+        {
+            *info = *slot_for( queue, queue->queue_head );
+            if ( !(queue->flags & Q_STAMP) )
+                info->sent_at = 0;
+        }
+    }
+
 #ifdef DIAG_PRINTFS 
     printf( "\r\nfetched msg of len %lx from queue_head @ %p",
             (queue->queue_head)->msglen, queue->queue_head );
@@ -604,6 +847,12 @@ static void
         *element = (char)NULL;
         (queue->queue_head)->msglen = 0L;
 
+        /*
+        **  Time the message's residence if it was stamped when sent.
+        */
+        if ( queue->stamped_msgs != 0 )
+            note_msg_out( queue, slot_for( queue, queue->queue_head ) );
+
         /*
         **  Now increment the queue_head (send) pointer, adjusting for
         **  possible wrap to the beginning of the queue.
@@ -643,19 +892,19 @@ static void
             */
             pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                                   (void *)&(queue->qbcst_lock) );
-            pthread_mutex_lock( &(queue->qbcst_lock) );
+            lk_lock( &(queue->qbcst_lock), &(queue->qbcst_lkstat) );
 
             /*
             **  Signal the broadcast-complete condition variable for the queue
             */
-            pthread_cond_broadcast( &(queue->qbcst_cmplt) );
+            lk_broadcast( &(queue->qbcst_cmplt) );
 
             queue->send_type = SEND;
 
             /*
             **  Unlock the queue broadcast completion mutex. 
             */
-            pthread_mutex_unlock( &(queue->qbcst_lock) );
+            lk_unlock( &(queue->qbcst_lock), &(queue->qbcst_lkstat) );
             pthread_cleanup_pop( 0 );
         }
     }
@@ -671,6 +920,7 @@ static q_vmsg_t *
     char *new_extent;
     char *last_msg;
     size_t alloc_size;
+    size_t slots_offset;
 
     /*
     **  Calculate the number of bytes of memory needed for this extent.
@@ -689,6 +939,14 @@ static q_vmsg_t *
     */
     alloc_size = queue->vmsg_len * (queue->msgs_per_queue + 1);
 
+    /*
+    **  The information on the messages follows the messages, aligned.
+    */
+    slots_offset = (alloc_size + sizeof( unsigned long long ) - 1) &
+                   ~(sizeof( unsigned long long ) - 1);
+    alloc_size = slots_offset +
+                 sizeof( q_slot_t ) * (queue->msgs_per_queue + 1);
+
     /*
     **  Now allocate a block of memory to contain the extent.
     */
@@ -706,6 +964,7 @@ static q_vmsg_t *
         last_msg = new_extent + (queue->vmsg_len * queue->msgs_per_queue);
         queue->first_msg_in_queue = (q_vmsg_t *)new_extent;
         queue->last_msg_in_queue = (q_vmsg_t *)last_msg;
+        queue->slots = (q_slot_t *)(new_extent + slots_offset);
     }
 #ifdef DIAG_PRINTFS 
     printf( "\r\nnew extent @ %p for queue @ %p vmsg_len %x", new_extent,
@@ -780,6 +1039,8 @@ ULONG
             */
             pthread_mutex_init( &(queue->queue_lock),
                                 (pthread_mutexattr_t *)NULL );
+            lk_init( &(queue->queue_lkstat), TR_VQUEUE, queue->qid, queue->qname,
+                     "queue_lock" );
             pthread_cond_init( &(queue->queue_send),
                                (pthread_condattr_t *)NULL );
 
@@ -788,6 +1049,8 @@ ULONG
             */
             pthread_mutex_init( &(queue->qbcst_lock),
                                 (pthread_mutexattr_t *)NULL );
+            lk_init( &(queue->qbcst_lkstat), TR_VQUEUE, queue->qid, queue->qname,
+                     "qbcst_lock" );
             pthread_cond_init( &(queue->qbcst_cmplt),
                                (pthread_condattr_t *)NULL );
 
@@ -821,6 +1084,28 @@ ULONG
             */
             queue->msg_count = 0;
 
+            /*
+            ** Traffic and residence statistics for queue
+            */
+            queue->send_count = 0;
+            queue->urgent_count = 0;
+            queue->bcast_count = 0;
+            queue->recv_count = 0;
+            queue->timeout_count = 0;
+            queue->full_count = 0;
+            queue->high_water = 0;
+            queue->msgs_in = 0;
+            queue->stamped_msgs = 0;
+            for ( i = 0; i < Q_RES_BUCKETS; i++ )
+                queue->residence[i] = 0;
+            queue->max_residence_ns = 0;
+
+            /*
+            ** Task serving a Q_INHERIT queue
+            */
+            queue->server_tid = 0;
+            queue->server_pri = 0;
+
             /*
             ** Task pend order (FIFO or Priority) for queue
             */
@@ -836,6 +1121,7 @@ ULONG
             if ( error == ERR_NO_ERROR )
             {
                 link_qcb( queue );
+                TRACE( TR_VQUEUE | TR_CREATE, queue->qid, msglen );
             }
             else
             {
@@ -908,7 +1194,7 @@ ULONG
         */
         pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                               (void *)&(queue->queue_lock));
-        pthread_mutex_lock( &(queue->queue_lock) );
+        lk_lock( &(queue->queue_lock), &(queue->queue_lkstat) );
 
         /*
         **  See how many messages are already sent into the queue
@@ -930,13 +1216,20 @@ ULONG
             /*
             **  Signal the condition variable for the queue
             */
-            pthread_cond_broadcast( &(queue->queue_send) );
+            stat_wake( next_susp_tcb( queue->first_susp,
+                                      (queue->flags & Q_PRIOR) ) );
+            lk_broadcast( &(queue->queue_send) );
         }
 
+        if ( error == ERR_NO_ERROR )
+            queue->urgent_count++;
+        else
+            queue->full_count++;
+
         /*
         **  Unlock the queue mutex. 
         */
-        pthread_mutex_unlock( &(queue->queue_lock) );
+        lk_unlock( &(queue->queue_lock), &(queue->queue_lkstat) );
         pthread_cleanup_pop( 0 );
 
         /*
@@ -944,6 +1237,9 @@ ULONG
         **  to a task made runnable by this call.
         */
         sched_unlock();
+
+        if ( error == ERR_NO_ERROR )
+            TRACE( TR_VQUEUE | TR_SEND, qid, msglen );
     }
     else
     {
@@ -997,7 +1293,7 @@ ULONG
         */
         pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                               (void *)&(queue->queue_lock));
-        pthread_mutex_lock( &(queue->queue_lock) );
+        lk_lock( &(queue->queue_lock), &(queue->queue_lkstat) );
 
         /*
         **  See how many messages are already sent into the queue
@@ -1038,10 +1334,15 @@ ULONG
             }
         }
 
+        if ( error == ERR_NO_ERROR )
+            queue->send_count++;
+        else
+            queue->full_count++;
+
         /*
         **  Unlock the queue mutex. 
         */
-        pthread_mutex_unlock( &(queue->queue_lock) );
+        lk_unlock( &(queue->queue_lock), &(queue->queue_lkstat) );
         pthread_cleanup_pop( 0 );
 
         /*
@@ -1049,6 +1350,9 @@ ULONG
         **  to a task made runnable by this call.
         */
         sched_unlock();
+
+        if ( error == ERR_NO_ERROR )
+            TRACE( TR_VQUEUE | TR_SEND, qid, msglen );
     }
     else
     {
@@ -1077,7 +1381,7 @@ ULONG
         */
         pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                               (void *)&(queue->queue_lock));
-        pthread_mutex_lock( &(queue->queue_lock) );
+        lk_lock( &(queue->queue_lock), &(queue->queue_lkstat) );
 
         if ( queue->first_susp != (p2pthread_cb_t *)NULL )
         {
@@ -1104,12 +1408,17 @@ ULONG
                 queue->send_type = BCAST;
                 queue->bcst_tasks_awakened = 0;
             }
+
+            if ( error == ERR_NO_ERROR )
+                queue->bcast_count++;
+            else
+                queue->full_count++;
         }
 
         /*
         **  Unlock the queue mutex. 
         */
-        pthread_mutex_unlock( &(queue->queue_lock) );
+        lk_unlock( &(queue->queue_lock), &(queue->queue_lkstat) );
         pthread_cleanup_pop( 0 );
 
         /*
@@ -1124,24 +1433,25 @@ ULONG
             */
             pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                                   (void *)&(queue->qbcst_lock) );
-            pthread_mutex_lock( &(queue->qbcst_lock) );
+            lk_lock( &(queue->qbcst_lock), &(queue->qbcst_lkstat) );
 
             /*
             ** Lock mutex for urgent queue send
             */
             pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                                   (void *)&(queue->queue_lock));
-            pthread_mutex_lock( &(queue->queue_lock) );
+            lk_lock( &(queue->queue_lock), &(queue->queue_lkstat) );
 
             /*
             **  Signal the condition variable for the queue
             */
-            pthread_cond_broadcast( &(queue->queue_send) );
+            stat_wake_all( queue->first_susp );
+            lk_broadcast( &(queue->queue_send) );
 
             /*
             **  Unlock the queue mutex. 
             */
-            pthread_mutex_unlock( &(queue->queue_lock) );
+            lk_unlock( &(queue->queue_lock), &(queue->queue_lkstat) );
             pthread_cleanup_pop( 0 );
 
             /*
@@ -1151,14 +1461,15 @@ ULONG
             */
             while ( queue->first_susp != (p2pthread_cb_t *)NULL )
             {
-                pthread_cond_wait( &(queue->qbcst_cmplt),
-                                   &(queue->qbcst_lock) );
+                lk_wait( &(queue->qbcst_cmplt),
+                         &(queue->qbcst_lock),
+                         &(queue->qbcst_lkstat) );
             }
 
             /*
             **  Unlock the queue broadcast completion mutex. 
             */
-            pthread_mutex_unlock( &(queue->qbcst_lock) );
+            lk_unlock( &(queue->qbcst_lock), &(queue->qbcst_lkstat) );
             pthread_cleanup_pop( 0 );
 
             if ( tasks != (ULONG *)NULL )
@@ -1166,6 +1477,7 @@ ULONG
         }
 
         *tasks = queue->bcst_tasks_awakened;
+        TRACE( TR_VQUEUE | TR_SEND, qid, msglen );
 
         sched_unlock();
     }
@@ -1189,6 +1501,13 @@ static void
     */
     unlink_qcb( queue->qid );
 
+    /*
+    **  Fold the statistics of the queue's mutexes into those of deleted
+    **  queues.
+    */
+    lk_retire( &(queue->queue_lkstat) );
+    lk_retire( &(queue->qbcst_lkstat) );
+
     /*
     **  Next delete extent allocated for queue data.
     */
@@ -1221,7 +1540,7 @@ ULONG
         */
         pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                               (void *)&(queue->queue_lock));
-        pthread_mutex_lock( &(queue->queue_lock) );
+        lk_lock( &(queue->queue_lock), &(queue->queue_lkstat) );
 
         if ( queue->msg_count )
             error = ERR_MATQDEL;
@@ -1245,7 +1564,7 @@ ULONG
         /*
         **  Unlock the queue mutex. 
         */
-        pthread_mutex_unlock( &(queue->queue_lock) );
+        lk_unlock( &(queue->queue_lock), &(queue->queue_lkstat) );
         pthread_cleanup_pop( 0 );
 
         /*
@@ -1259,24 +1578,25 @@ ULONG
             */
             pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                                   (void *)&(queue->qbcst_lock) );
-            pthread_mutex_lock( &(queue->qbcst_lock) );
+            lk_lock( &(queue->qbcst_lock), &(queue->qbcst_lkstat) );
 
             /*
             ** Lock mutex for urgent queue send
             */
             pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                                   (void *)&(queue->queue_lock));
-            pthread_mutex_lock( &(queue->queue_lock) );
+            lk_lock( &(queue->queue_lock), &(queue->queue_lkstat) );
 
             /*
             **  Signal the condition variable for the queue
             */
-            pthread_cond_broadcast( &(queue->queue_send) );
+            stat_wake_all( queue->first_susp );
+            lk_broadcast( &(queue->queue_send) );
 
             /*
             **  Unlock the queue mutex. 
             */
-            pthread_mutex_unlock( &(queue->queue_lock) );
+            lk_unlock( &(queue->queue_lock), &(queue->queue_lkstat) );
             pthread_cleanup_pop( 0 );
 
             /*
@@ -1286,17 +1606,19 @@ ULONG
             */
             while ( queue->first_susp != (p2pthread_cb_t *)NULL )
             {
-                pthread_cond_wait( &(queue->qbcst_cmplt),
-                                   &(queue->qbcst_lock) );
+                lk_wait( &(queue->qbcst_cmplt),
+                         &(queue->qbcst_lock),
+                         &(queue->qbcst_lkstat) );
             }
 
             /*
             **  Unlock the queue broadcast completion mutex. 
             */
-            pthread_mutex_unlock( &(queue->qbcst_lock) );
+            lk_unlock( &(queue->qbcst_lock), &(queue->qbcst_lkstat) );
             pthread_cleanup_pop( 0 );
         }
 
+        TRACE( TR_VQUEUE | TR_DELETE, qid, 0 );
         delete_vqueue( queue );
         sched_unlock();
     }
@@ -1373,9 +1695,9 @@ static int
                 **  list of tasks waiting on the queue to get their
                 **  messages, bringing our task to the head of the list.
                 */
-                pthread_mutex_unlock( &(queue->queue_lock) );
+                lk_unlock( &(queue->queue_lock), &(queue->queue_lkstat) );
                 tm_wkafter( 1 );
-                pthread_mutex_lock( &(queue->queue_lock) );
+                lk_lock( &(queue->queue_lock), &(queue->queue_lkstat) );
             }
 
             /*
@@ -1384,7 +1706,7 @@ static int
             */
             if ( timeout != (struct timespec *)NULL )
             {
-                gettimeofday( &now, (struct timezone *)NULL );
+                p2pt_time( &now );
                 if ( timeout->tv_nsec > (now.tv_usec * 1000) )
                 {
                     usec = (timeout->tv_nsec - (now.tv_usec * 1000)) / 1000;
@@ -1413,23 +1735,37 @@ static int
 }
 
 /*****************************************************************************
-** q_vreceive - blocks the calling task until a message is available in the
-**             specified p2pthread queue.
+** q_vreceive_stamped - blocks the calling task until a message is available
+**                      in the specified p2pthread queue, and returns the
+**                      CLOCK_MONOTONIC nanoseconds at which it was sent if
+**                      the queue was created with Q_STAMP (else zero).
 *****************************************************************************/
 ULONG
-   q_vreceive( ULONG qid, ULONG opt, ULONG max_wait, void *msgbuf,
-               ULONG buflen, ULONG *msglen )
+   q_vreceive_stamped( ULONG qid, ULONG opt, ULONG max_wait, void *msgbuf,
+                       ULONG buflen, ULONG *msglen,
+                       unsigned long long *sent_at )
 {
     p2pthread_cb_t *our_tcb;
     struct timeval now;
     struct timespec timeout;
     int retcode;
+    int blocked;
     long sec, usec;
     p2pt_vqueue_t *queue;
+    q_slot_t info;
     ULONG error;
 
     error = ERR_NO_ERROR;
 
+    if ( sent_at != (unsigned long long *)NULL )
+        *sent_at = 0;
+
+    /*
+    **  The caller has finished with any message it was serving, so it
+    **  gives back any priority lent to it with that message.
+    */
+    end_lent_priority( my_tcb() );
+
     if ( (queue = qcb_for( qid )) != (p2pt_vqueue_t *)NULL )
     {
         /*
@@ -1447,7 +1783,7 @@ ULONG
         */
         pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
                               (void *)&(queue->queue_lock));
-        pthread_mutex_lock( &(queue->queue_lock) );
+        lk_lock( &(queue->queue_lock), &(queue->queue_lkstat) );
 
         /*
         **  If a broadcast is in progress, wait for it to complete
@@ -1455,9 +1791,9 @@ ULONG
         */
         while ( queue->send_type != SEND )
         {
-            pthread_mutex_unlock( &(queue->queue_lock) );
+            lk_unlock( &(queue->queue_lock), &(queue->queue_lkstat) );
             tm_wkafter( 1 );
-            pthread_mutex_lock( &(queue->queue_lock) );
+            lk_lock( &(queue->queue_lock), &(queue->queue_lkstat) );
         }
 
         /*
@@ -1472,6 +1808,7 @@ ULONG
         link_susp_tcb( &(queue->first_susp), our_tcb );
 
         retcode = 0;
+        blocked = FALSE;
 
         if ( opt & Q_NOWAIT )
         {
@@ -1479,15 +1816,16 @@ ULONG
             **  Caller specified no wait on queue message...
             **  Check the condition variable with an immediate timeout.
             */
-            gettimeofday( &now, (struct timezone *)NULL );
+            p2pt_time( &now );
             timeout.tv_sec = now.tv_sec;
             timeout.tv_nsec = now.tv_usec * 1000;
             while ( (waiting_on_vqueue( queue, &timeout, &retcode )) &&
                     (retcode != ETIMEDOUT) )
             {
-                retcode = pthread_cond_timedwait( &(queue->queue_send),
-                                                  &(queue->queue_lock),
-                                                  &timeout );
+                retcode = lk_timedwait( &(queue->queue_send),
+                                        &(queue->queue_lock),
+                                        &timeout,
+                                        &(queue->queue_lkstat) );
             }
         }
         else
@@ -1502,8 +1840,11 @@ ULONG
                 */
                 while ( waiting_on_vqueue( queue, 0, &retcode ) )
                 {
-                    pthread_cond_wait( &(queue->queue_send),
-                                       &(queue->queue_lock) );
+                    TRACE_BLOCK( blocked, TR_VQUEUE, qid );
+                    stat_block( our_tcb, WAIT_VQUE );
+                    lk_wait( &(queue->queue_send),
+                             &(queue->queue_lock),
+                             &(queue->queue_lkstat) );
                 }
             }
             else
@@ -1514,7 +1855,7 @@ ULONG
                 */
                 sec = 0;
                 usec = max_wait * P2PT_TICK * 1000;
-                gettimeofday( &now, (struct timezone *)NULL );
+                p2pt_time( &now );
                 usec += now.tv_usec;
                 if ( usec > 1000000 )
                 {
@@ -1533,9 +1874,12 @@ ULONG
                 while ( (waiting_on_vqueue( queue, &timeout, &retcode )) &&
                         (retcode != ETIMEDOUT) )
                 {
-                    retcode = pthread_cond_timedwait( &(queue->queue_send),
-                                                      &(queue->queue_lock),
-                                                      &timeout );
+                    TRACE_BLOCK( blocked, TR_VQUEUE, qid );
+                    stat_block( our_tcb, WAIT_VQUE );
+                    retcode = lk_timedwait( &(queue->queue_send),
+                                            &(queue->queue_lock),
+                                            &timeout,
+                                            &(queue->queue_lkstat) );
                 }
             }
         }
@@ -1545,13 +1889,16 @@ ULONG
         **  for the queue.
         */
         unlink_susp_tcb( &(queue->first_susp), our_tcb );
+        TRACE_UNBLOCK( blocked, TR_VQUEUE, qid, (retcode == ETIMEDOUT) );
+        stat_unblock( our_tcb, (retcode == ETIMEDOUT) );
 
         /*
         **  See if we were awakened due to a q_vdelete on the queue.
         */
         if ( queue->send_type & KILLD )
         {
-            fetch_msg_from( queue, (char *)msgbuf, msglen );
+            fetch_msg_from( queue, (char *)msgbuf, msglen,
+                            (q_slot_t *)NULL );
             error = ERR_QKILLD;
             *((char *)msgbuf) = (char)NULL;
 #ifdef DIAG_PRINTFS 
@@ -1571,7 +1918,10 @@ ULONG
                 if ( opt & Q_NOWAIT )
                     error = ERR_NOMSG;
                 else
+                {
                     error = ERR_TIMEOUT;
+                    queue->timeout_count++;
+                }
                 *((char *)msgbuf) = (char)NULL;
 #ifdef DIAG_PRINTFS 
                 printf( "...timed out" );
@@ -1583,7 +1933,13 @@ ULONG
                 **  A message was sent to the queue for this task...
                 **  Retrieve the message and clear the queue contents.
                 */
-                fetch_msg_from( queue, (char *)msgbuf, msglen );
+                fetch_msg_from( queue, (char *)msgbuf, msglen, &info );
+                queue->recv_count++;
+                if ( sent_at != (unsigned long long *)NULL )
+                    *sent_at = info.sent_at;
+                if ( queue->flags & Q_INHERIT )
+                    start_serving( queue, our_tcb, info.sender_pri );
+                TRACE( TR_VQUEUE | TR_RECEIVE, qid, *msglen );
 #ifdef DIAG_PRINTFS 
                 printf( "...rcvd queue msg @ %p len %lx", msgbuf, *msglen );
 #endif
@@ -1593,7 +1949,7 @@ ULONG
         /*
         **  Unlock the mutex for the condition variable and clean up.
         */
-        pthread_mutex_unlock( &(queue->queue_lock) );
+        lk_unlock( &(queue->queue_lock), &(queue->queue_lkstat) );
         pthread_cleanup_pop( 0 );
     }
     else
@@ -1605,6 +1961,18 @@ ULONG
     return( error );
 }
 
+/*****************************************************************************
+** q_vreceive - blocks the calling task until a message is available in the
+**             specified p2pthread queue.
+*****************************************************************************/
+ULONG
+   q_vreceive( ULONG qid, ULONG opt, ULONG max_wait, void *msgbuf,
+               ULONG buflen, ULONG *msglen )
+{
+    return( q_vreceive_stamped( qid, opt, max_wait, msgbuf, buflen, msglen,
+                                (unsigned long long *)NULL ) );
+}
+
 /*****************************************************************************
 ** q_vident - identifies the specified p2pthread queue
 *****************************************************************************/
@@ -1663,3 +2031,99 @@ ULONG
 
     return( error );
 }
+
+/*****************************************************************************
+** publish_vqueues - fills in stats page entries for up to 'max_rows'
+**                   variable length queues.  Returns the number of queues,
+**                   which may exceed 'max_rows'.
+*****************************************************************************/
+ULONG
+   publish_vqueues( sp_object_t rows[], ULONG max_rows )
+{
+    p2pt_vqueue_t *queue;
+    sp_object_t *row;
+    ULONG count;
+    int i;
+
+    count = 0;
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&vqueue_list_lock );
+    lk_lock( &vqueue_list_lock, &vqueue_list_lkstat );
+
+    for ( queue = vqueue_list; queue != (p2pt_vqueue_t *)NULL;
+          queue = queue->nxt_queue, count++ )
+    {
+        if ( count >= max_rows )
+            continue;
+        row = &(rows[count]);
+        memset( (void *)row, 0, sizeof( *row ) );
+        row->obj_class = SP_VQUEUE;
+        row->objid = queue->qid;
+        for ( i = 0; i < 4; i++ )
+            row->objname[i] = queue->qname[i];
+        row->limit = (ULONG)queue->msgs_per_queue;
+
+        /*
+        **  The queue cannot be deleted while it is on the list we hold.
+        */
+        pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                              (void *)&(queue->queue_lock));
+        lk_lock( &(queue->queue_lock), &(queue->queue_lkstat) );
+        row->depth = (ULONG)queue->msg_count;
+        row->waiters = count_susp_tcbs( queue->first_susp );
+        row->puts = queue->send_count + queue->urgent_count +
+                    queue->bcast_count;
+        row->gets = queue->recv_count;
+        lk_unlock( &(queue->queue_lock), &(queue->queue_lkstat) );
+        pthread_cleanup_pop( 0 );
+    }
+
+    lk_unlock( &vqueue_list_lock, &vqueue_list_lkstat );
+    pthread_cleanup_pop( 0 );
+
+    return( count );
+}
+
+/*****************************************************************************
+** q_vinfo - fills in the depth and traffic statistics of the specified
+**           variable length queue
+*****************************************************************************/
+ULONG
+   q_vinfo( ULONG qid, q_info_t *info )
+{
+    p2pt_vqueue_t *queue;
+    int i;
+
+    if ( (queue = qcb_for( qid )) == (p2pt_vqueue_t *)NULL )
+        return( ERR_OBJDEL );
+
+    memset( (void *)info, 0, sizeof( *info ) );
+    info->qid = queue->qid;
+    for ( i = 0; i < 4; i++ )
+        info->qname[i] = queue->qname[i];
+    info->flags = queue->flags;
+    info->limit = (ULONG)queue->msgs_per_queue;
+    info->extents = 1;
+
+    pthread_cleanup_push( (void(*)(void *))pthread_mutex_unlock,
+                          (void *)&(queue->queue_lock));
+    lk_lock( &(queue->queue_lock), &(queue->queue_lkstat) );
+
+    info->depth = (ULONG)queue->msg_count;
+    info->high_water = (ULONG)queue->high_water;
+    info->waiters = count_susp_tcbs( queue->first_susp );
+    info->sends = queue->send_count;
+    info->urgents = queue->urgent_count;
+    info->broadcasts = queue->bcast_count;
+    info->receives = queue->recv_count;
+    info->timeouts = queue->timeout_count;
+    info->full_errors = queue->full_count;
+    for ( i = 0; i < Q_RES_BUCKETS; i++ )
+        info->residence[i] = queue->residence[i];
+    info->max_residence_ns = queue->max_residence_ns;
+
+    lk_unlock( &(queue->queue_lock), &(queue->queue_lkstat) );
+    pthread_cleanup_pop( 0 );
+
+    return( ERR_NO_ERROR );
+}